@@ -0,0 +1,634 @@
+#include "bvh.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+using namespace okami;
+
+namespace {
+    constexpr uint32_t kMaxBins = 32;
+    // Below this depth the builder stops using SAH and splits at the median,
+    // which bounds the traversal stack size
+    constexpr uint32_t kMaxSAHDepth = 64;
+    constexpr size_t kTraversalStackSize = 128;
+    // Ranges at least this large are split with parallel binning; smaller ones
+    // become independent subtrees that are built serially on a worker
+    constexpr size_t kSubtreeThreshold = 16384;
+    constexpr size_t kParallelGrain = 16384;
+
+    constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+    // Scale applied to the far slab distance so that rounding in the slab test
+    // can never cull a box the triangle test would hit (Ize, 2013)
+    constexpr float kGamma3 = (3.0f * FLT_EPSILON * 0.5f) / (1.0f - 3.0f * FLT_EPSILON * 0.5f);
+    constexpr float kRobustFarScale = 1.0f + 2.0f * kGamma3;
+
+    inline AABB EmptyBounds() {
+        return AABB{ glm::vec3(kInfinity), glm::vec3(-kInfinity) };
+    }
+
+    inline void Grow(AABB& bounds, glm::vec3 const& point) {
+        bounds.m_min = glm::min(bounds.m_min, point);
+        bounds.m_max = glm::max(bounds.m_max, point);
+    }
+
+    inline void Grow(AABB& bounds, AABB const& other) {
+        bounds.m_min = glm::min(bounds.m_min, other.m_min);
+        bounds.m_max = glm::max(bounds.m_max, other.m_max);
+    }
+
+    inline float HalfArea(AABB const& bounds) {
+        glm::vec3 d = bounds.m_max - bounds.m_min;
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    template <typename Func>
+    void ForRange(bool parallel, size_t count, Func&& func) {
+        if (parallel && count > kParallelGrain) {
+            ParallelFor(count, kParallelGrain, func);
+        } else if (count > 0) {
+            func(0, count);
+        }
+    }
+
+    struct BuildTask {
+        uint32_t m_node;
+        uint32_t m_begin;
+        uint32_t m_end;
+        uint32_t m_depth;
+    };
+
+    struct Bin {
+        AABB m_bounds = EmptyBounds();
+        uint32_t m_count = 0;
+    };
+
+    using BinArray = std::array<std::array<Bin, kMaxBins>, 3>;
+
+    struct RangeBounds {
+        AABB m_bounds = EmptyBounds();
+        AABB m_centroidBounds = EmptyBounds();
+    };
+
+    class Builder {
+    public:
+        std::vector<AABB> m_triangleBounds;
+        std::vector<glm::vec3> m_centroids;
+        std::vector<uint32_t> m_order;
+        std::vector<BVHNode> m_nodes;
+        std::atomic<uint32_t> m_nodeCount{1};
+        uint32_t m_binCount = 16;
+        uint32_t m_maxLeafSize = 4;
+
+        RangeBounds ComputeBounds(uint32_t begin, uint32_t end, bool parallel) const {
+            size_t count = end - begin;
+            size_t chunkCount = (count + kParallelGrain - 1) / kParallelGrain;
+            std::vector<RangeBounds> partial(parallel ? chunkCount : 1);
+
+            ForRange(parallel, count, [&](size_t chunkBegin, size_t chunkEnd) {
+                RangeBounds local;
+                for (size_t i = begin + chunkBegin; i < begin + chunkEnd; ++i) {
+                    auto triangle = m_order[i];
+                    Grow(local.m_bounds, m_triangleBounds[triangle]);
+                    Grow(local.m_centroidBounds, m_centroids[triangle]);
+                }
+                partial[parallel ? chunkBegin / kParallelGrain : 0] = local;
+            });
+
+            RangeBounds result;
+            for (auto const& local : partial) {
+                Grow(result.m_bounds, local.m_bounds);
+                Grow(result.m_centroidBounds, local.m_centroidBounds);
+            }
+            return result;
+        }
+
+        inline uint32_t BinIndex(float centroid, float min, float scale) const {
+            auto index = static_cast<uint32_t>((centroid - min) * scale);
+            return std::min(index, m_binCount - 1);
+        }
+
+        BinArray ComputeBins(uint32_t begin, uint32_t end, AABB const& centroidBounds, bool parallel) const {
+            glm::vec3 extent = centroidBounds.m_max - centroidBounds.m_min;
+            glm::vec3 scale;
+            for (int axis = 0; axis < 3; ++axis) {
+                scale[axis] = extent[axis] > 0.0f ? static_cast<float>(m_binCount) / extent[axis] : 0.0f;
+            }
+
+            size_t count = end - begin;
+            size_t chunkCount = (count + kParallelGrain - 1) / kParallelGrain;
+            std::vector<BinArray> partial(parallel ? chunkCount : 1);
+
+            ForRange(parallel, count, [&](size_t chunkBegin, size_t chunkEnd) {
+                auto& bins = partial[parallel ? chunkBegin / kParallelGrain : 0];
+                for (size_t i = begin + chunkBegin; i < begin + chunkEnd; ++i) {
+                    auto triangle = m_order[i];
+                    auto const& centroid = m_centroids[triangle];
+                    for (int axis = 0; axis < 3; ++axis) {
+                        auto& bin = bins[axis][BinIndex(centroid[axis], centroidBounds.m_min[axis], scale[axis])];
+                        Grow(bin.m_bounds, m_triangleBounds[triangle]);
+                        bin.m_count++;
+                    }
+                }
+            });
+
+            BinArray result = partial[0];
+            for (size_t chunk = 1; chunk < partial.size(); ++chunk) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    for (uint32_t i = 0; i < m_binCount; ++i) {
+                        Grow(result[axis][i].m_bounds, partial[chunk][axis][i].m_bounds);
+                        result[axis][i].m_count += partial[chunk][axis][i].m_count;
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Finalizes the node of the given task, and returns the tasks for its
+        // children if it was split
+        std::optional<std::pair<BuildTask, BuildTask>> Subdivide(BuildTask const& task, bool parallel) {
+            auto& node = m_nodes[task.m_node];
+            auto [bounds, centroidBounds] = ComputeBounds(task.m_begin, task.m_end, parallel);
+            node.m_bounds = bounds;
+
+            uint32_t count = task.m_end - task.m_begin;
+            if (count <= m_maxLeafSize) {
+                node.m_first = task.m_begin;
+                node.m_count = count;
+                return std::nullopt;
+            }
+
+            auto first = m_order.begin() + task.m_begin;
+            auto last = m_order.begin() + task.m_end;
+            uint32_t mid = task.m_begin;
+            glm::vec3 extent = centroidBounds.m_max - centroidBounds.m_min;
+
+            if (task.m_depth < kMaxSAHDepth) {
+                auto bins = ComputeBins(task.m_begin, task.m_end, centroidBounds, parallel);
+
+                float bestCost = kInfinity;
+                int bestAxis = -1;
+                uint32_t bestSplit = 0;
+
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (!(extent[axis] > 0.0f)) {
+                        continue;
+                    }
+
+                    // Sweep from the right to get the cost of every right partition
+                    std::array<float, kMaxBins> rightCost;
+                    AABB accumulated = EmptyBounds();
+                    uint32_t accumulatedCount = 0;
+                    for (uint32_t i = m_binCount - 1; i > 0; --i) {
+                        Grow(accumulated, bins[axis][i].m_bounds);
+                        accumulatedCount += bins[axis][i].m_count;
+                        rightCost[i] = accumulatedCount > 0 ?
+                            HalfArea(accumulated) * static_cast<float>(accumulatedCount) : kInfinity;
+                    }
+
+                    // Then from the left, splitting between bins i and i + 1
+                    accumulated = EmptyBounds();
+                    accumulatedCount = 0;
+                    for (uint32_t i = 0; i < m_binCount - 1; ++i) {
+                        Grow(accumulated, bins[axis][i].m_bounds);
+                        accumulatedCount += bins[axis][i].m_count;
+                        if (accumulatedCount == 0) {
+                            continue;
+                        }
+                        float cost = HalfArea(accumulated) * static_cast<float>(accumulatedCount) + rightCost[i + 1];
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestSplit = i + 1;
+                        }
+                    }
+                }
+
+                if (bestAxis >= 0) {
+                    float min = centroidBounds.m_min[bestAxis];
+                    float scale = static_cast<float>(m_binCount) / extent[bestAxis];
+                    auto it = std::partition(first, last, [&](uint32_t triangle) {
+                        return BinIndex(m_centroids[triangle][bestAxis], min, scale) < bestSplit;
+                    });
+                    mid = static_cast<uint32_t>(it - m_order.begin());
+                }
+            }
+
+            if (mid == task.m_begin || mid == task.m_end) {
+                // No usable SAH split (coincident centroids or too deep), split at the median
+                int axis = 0;
+                if (extent.y > extent[axis]) axis = 1;
+                if (extent.z > extent[axis]) axis = 2;
+                mid = task.m_begin + count / 2;
+                std::nth_element(first, m_order.begin() + mid, last, [&](uint32_t a, uint32_t b) {
+                    return m_centroids[a][axis] < m_centroids[b][axis];
+                });
+            }
+
+            uint32_t left = m_nodeCount.fetch_add(2);
+            node.m_first = left;
+            node.m_count = 0;
+
+            return std::pair{
+                BuildTask{ left, task.m_begin, mid, task.m_depth + 1 },
+                BuildTask{ left + 1, mid, task.m_end, task.m_depth + 1 }
+            };
+        }
+
+        void BuildSerial(BuildTask const& root) {
+            std::vector<BuildTask> stack{ root };
+            while (!stack.empty()) {
+                auto task = stack.back();
+                stack.pop_back();
+                if (auto children = Subdivide(task, false)) {
+                    stack.push_back(children->second);
+                    stack.push_back(children->first);
+                }
+            }
+        }
+
+        void BuildParallel(BuildTask const& root) {
+            std::vector<BuildTask> frontier{ root };
+            std::vector<BuildTask> subtrees;
+
+            // Split the top of the tree level by level, using parallel binning for
+            // large ranges, until every remaining range is small enough for one worker
+            while (!frontier.empty()) {
+                std::vector<BuildTask> large;
+                for (auto const& task : frontier) {
+                    if (task.m_end - task.m_begin >= kSubtreeThreshold) {
+                        large.push_back(task);
+                    } else {
+                        subtrees.push_back(task);
+                    }
+                }
+
+                std::vector<std::optional<std::pair<BuildTask, BuildTask>>> children(large.size());
+                ParallelFor(large.size(), 1, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        children[i] = Subdivide(large[i], true);
+                    }
+                });
+
+                frontier.clear();
+                for (auto const& pair : children) {
+                    if (pair) {
+                        frontier.push_back(pair->first);
+                        frontier.push_back(pair->second);
+                    }
+                }
+            }
+
+            ParallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    BuildSerial(subtrees[i]);
+                }
+            });
+        }
+    };
+
+    struct RayData {
+        glm::vec3 m_origin;
+        glm::vec3 m_invDirection;
+        int m_kx;
+        int m_ky;
+        int m_kz;
+        float m_sx;
+        float m_sy;
+        float m_sz;
+    };
+
+    RayData PrepareRay(Ray const& ray) {
+        RayData result;
+        result.m_origin = ray.m_origin;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            // Avoid 0 * inf in the slab test for axis-aligned rays
+            float d = ray.m_direction[axis];
+            if (std::abs(d) < 1e-30f) {
+                d = std::copysign(1e-30f, d);
+            }
+            result.m_invDirection[axis] = 1.0f / d;
+        }
+
+        // Permute so that z is the dominant axis of the ray direction, keeping
+        // the winding by swapping x and y when z points backwards
+        glm::vec3 absDirection = glm::abs(ray.m_direction);
+        int kz = 0;
+        if (absDirection.y > absDirection[kz]) kz = 1;
+        if (absDirection.z > absDirection[kz]) kz = 2;
+        int kx = (kz + 1) % 3;
+        int ky = (kx + 1) % 3;
+        if (ray.m_direction[kz] < 0.0f) {
+            std::swap(kx, ky);
+        }
+
+        result.m_kx = kx;
+        result.m_ky = ky;
+        result.m_kz = kz;
+        result.m_sx = ray.m_direction[kx] / ray.m_direction[kz];
+        result.m_sy = ray.m_direction[ky] / ray.m_direction[kz];
+        result.m_sz = 1.0f / ray.m_direction[kz];
+        return result;
+    }
+
+    inline bool IntersectBounds(AABB const& bounds, RayData const& ray, float tMin, float tMax, float& tEntry) {
+        glm::vec3 t0 = (bounds.m_min - ray.m_origin) * ray.m_invDirection;
+        glm::vec3 t1 = (bounds.m_max - ray.m_origin) * ray.m_invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+        float exit = std::min(std::min(tFar.x, tFar.y), tFar.z) * kRobustFarScale;
+        exit = std::min(exit, tMax);
+
+        tEntry = entry;
+        return entry <= exit;
+    }
+
+    // Watertight ray/triangle intersection (Woop, Benthin and Wald, 2013)
+    inline bool IntersectTriangle(
+        TriangleBVH::Triangle const& triangle,
+        RayData const& ray,
+        float tMin,
+        float tMax,
+        float& tHit,
+        glm::vec2& barycentrics) {
+        glm::vec3 a = triangle.m_v0 - ray.m_origin;
+        glm::vec3 b = triangle.m_v1 - ray.m_origin;
+        glm::vec3 c = triangle.m_v2 - ray.m_origin;
+
+        float ax = a[ray.m_kx] - ray.m_sx * a[ray.m_kz];
+        float ay = a[ray.m_ky] - ray.m_sy * a[ray.m_kz];
+        float bx = b[ray.m_kx] - ray.m_sx * b[ray.m_kz];
+        float by = b[ray.m_ky] - ray.m_sy * b[ray.m_kz];
+        float cx = c[ray.m_kx] - ray.m_sx * c[ray.m_kz];
+        float cy = c[ray.m_ky] - ray.m_sy * c[ray.m_kz];
+
+        float u = cx * by - cy * bx;
+        float v = ax * cy - ay * cx;
+        float w = bx * ay - by * ax;
+
+        // Fall back to double precision on edges, where float rounding decides
+        // which of the neighbouring triangles gets the hit
+        if (u == 0.0f || v == 0.0f || w == 0.0f) {
+            u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+            v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+            w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+        }
+
+        if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {
+            return false;
+        }
+
+        float det = u + v + w;
+        if (det == 0.0f) {
+            return false;
+        }
+
+        float az = ray.m_sz * a[ray.m_kz];
+        float bz = ray.m_sz * b[ray.m_kz];
+        float cz = ray.m_sz * c[ray.m_kz];
+        float invDet = 1.0f / det;
+        float t = (u * az + v * bz + w * cz) * invDet;
+
+        if (!(t >= tMin && t <= tMax)) {
+            return false;
+        }
+
+        tHit = t;
+        barycentrics = glm::vec2(v * invDet, w * invDet);
+        return true;
+    }
+
+    struct StackEntry {
+        uint32_t m_node;
+        float m_entry;
+    };
+
+    template <bool AnyHit>
+    bool Traverse(
+        std::span<BVHNode const> nodes,
+        std::span<TriangleBVH::Triangle const> triangles,
+        std::span<uint32_t const> triangleIds,
+        Ray const& ray,
+        RayHit* hit) {
+        if (nodes.empty()) {
+            return false;
+        }
+
+        auto rayData = PrepareRay(ray);
+        float tMax = ray.m_tMax;
+        float entry;
+        if (!IntersectBounds(nodes[0].m_bounds, rayData, ray.m_tMin, tMax, entry)) {
+            return false;
+        }
+
+        std::array<StackEntry, kTraversalStackSize> stack;
+        size_t stackSize = 0;
+        uint32_t current = 0;
+        bool found = false;
+
+        while (true) {
+            auto const& node = nodes[current];
+
+            if (node.IsLeaf()) {
+                for (uint32_t i = node.m_first; i < node.m_first + node.m_count; ++i) {
+                    float t;
+                    glm::vec2 barycentrics;
+                    if (IntersectTriangle(triangles[i], rayData, ray.m_tMin, tMax, t, barycentrics)) {
+                        if constexpr (AnyHit) {
+                            return true;
+                        }
+                        found = true;
+                        tMax = t;
+                        *hit = RayHit{ t, triangleIds[i], barycentrics };
+                    }
+                }
+            } else {
+                uint32_t left = node.m_first;
+                uint32_t right = node.m_first + 1;
+                float leftEntry, rightEntry;
+                bool hitLeft = IntersectBounds(nodes[left].m_bounds, rayData, ray.m_tMin, tMax, leftEntry);
+                bool hitRight = IntersectBounds(nodes[right].m_bounds, rayData, ray.m_tMin, tMax, rightEntry);
+
+                if (hitLeft && hitRight) {
+                    // Visit the nearer child first so tMax shrinks as early as possible
+                    if (rightEntry < leftEntry) {
+                        std::swap(left, right);
+                        std::swap(leftEntry, rightEntry);
+                    }
+                    stack[stackSize++] = StackEntry{ right, rightEntry };
+                    current = left;
+                    continue;
+                } else if (hitLeft) {
+                    current = left;
+                    continue;
+                } else if (hitRight) {
+                    current = right;
+                    continue;
+                }
+            }
+
+            // Pop the next node that can still contain a closer hit
+            bool popped = false;
+            while (stackSize > 0) {
+                auto next = stack[--stackSize];
+                if (next.m_entry <= tMax) {
+                    current = next.m_node;
+                    popped = true;
+                    break;
+                }
+            }
+            if (!popped) {
+                break;
+            }
+        }
+
+        return found;
+    }
+
+    Ray ToLocalRay(Transform const& transform, Ray const& ray) {
+        // Affine maps keep the ray parametrization, so local hit distances are
+        // valid world-space distances along the original ray
+        auto invRotation = glm::inverse(transform.m_rotation);
+        auto invScaleShear = glm::inverse(transform.m_scaleShear);
+        return Ray{
+            invScaleShear * (invRotation * (ray.m_origin - transform.m_position)),
+            invScaleShear * (invRotation * ray.m_direction),
+            ray.m_tMin,
+            ray.m_tMax
+        };
+    }
+}
+
+Expected<TriangleBVH> TriangleBVH::Build(
+    std::span<glm::vec3 const> positions,
+    std::span<uint32_t const> indices,
+    BVHBuildParams const& params) {
+    size_t triangleCount = indices.empty() ? positions.size() / 3 : indices.size() / 3;
+    if (triangleCount >= std::numeric_limits<uint32_t>::max() / 2) {
+        return std::unexpected(Error("Too many triangles for a BVH"));
+    }
+
+    TriangleBVH result;
+    if (triangleCount == 0) {
+        return result;
+    }
+
+    Builder builder;
+    builder.m_binCount = std::clamp(params.m_binCount, 2u, kMaxBins);
+    builder.m_maxLeafSize = std::max(params.m_maxLeafSize, 1u);
+    builder.m_triangleBounds.resize(triangleCount);
+    builder.m_centroids.resize(triangleCount);
+    builder.m_order.resize(triangleCount);
+    builder.m_nodes.resize(2 * triangleCount - 1);
+
+    std::vector<Triangle> triangles(triangleCount);
+    std::atomic<bool> invalidIndex{false};
+
+    ForRange(params.m_parallel, triangleCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t i0 = static_cast<uint32_t>(3 * i);
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + 2;
+            if (!indices.empty()) {
+                i0 = indices[3 * i];
+                i1 = indices[3 * i + 1];
+                i2 = indices[3 * i + 2];
+                if (i0 >= positions.size() || i1 >= positions.size() || i2 >= positions.size()) {
+                    invalidIndex.store(true, std::memory_order_relaxed);
+                    i0 = i1 = i2 = 0;
+                }
+            }
+
+            auto& triangle = triangles[i];
+            triangle = Triangle{ positions[i0], positions[i1], positions[i2] };
+
+            AABB bounds = EmptyBounds();
+            Grow(bounds, triangle.m_v0);
+            Grow(bounds, triangle.m_v1);
+            Grow(bounds, triangle.m_v2);
+            builder.m_triangleBounds[i] = bounds;
+            builder.m_centroids[i] = (bounds.m_min + bounds.m_max) * 0.5f;
+            builder.m_order[i] = static_cast<uint32_t>(i);
+        }
+    });
+
+    if (invalidIndex.load()) {
+        return std::unexpected(Error("Index out of range while building BVH"));
+    }
+
+    BuildTask root{ 0, 0, static_cast<uint32_t>(triangleCount), 0 };
+    if (params.m_parallel) {
+        builder.BuildParallel(root);
+    } else {
+        builder.BuildSerial(root);
+    }
+
+    builder.m_nodes.resize(builder.m_nodeCount.load());
+    result.m_nodes = std::move(builder.m_nodes);
+
+    // Store triangles in leaf order
+    result.m_triangles.resize(triangleCount);
+    ForRange(params.m_parallel, triangleCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            result.m_triangles[i] = triangles[builder.m_order[i]];
+        }
+    });
+    result.m_triangleIds = std::move(builder.m_order);
+
+    return result;
+}
+
+Expected<TriangleBVH> TriangleBVH::Build(
+    RawGeometry const& geometry,
+    size_t meshIndex,
+    BVHBuildParams const& params) {
+    if (meshIndex >= geometry.GetMeshCount()) {
+        return std::unexpected(Error("Invalid mesh index"));
+    }
+
+    auto positions = geometry.TryAccess<glm::vec3 const>(AttributeType::Position, meshIndex);
+    if (!positions) {
+        return std::unexpected(Error("Mesh has no position attribute"));
+    }
+
+    auto indices = geometry.ReadIndices(meshIndex);
+    OKAMI_UNEXPECTED_RETURN(indices);
+
+    return Build(
+        std::span<glm::vec3 const>(positions->begin(), positions->end()),
+        *indices,
+        params);
+}
+
+std::optional<RayHit> TriangleBVH::Raycast(Ray const& ray) const {
+    RayHit hit;
+    if (Traverse<false>(m_nodes, m_triangles, m_triangleIds, ray, &hit)) {
+        return hit;
+    }
+    return std::nullopt;
+}
+
+bool TriangleBVH::Occluded(Ray const& ray) const {
+    return Traverse<true>(m_nodes, m_triangles, m_triangleIds, ray, nullptr);
+}
+
+std::optional<RayHit> okami::Raycast(
+    TriangleBVH const& bvh,
+    Transform const& transform,
+    Ray const& ray) {
+    return bvh.Raycast(ToLocalRay(transform, ray));
+}
+
+bool okami::Occluded(
+    TriangleBVH const& bvh,
+    Transform const& transform,
+    Ray const& ray) {
+    return bvh.Occluded(ToLocalRay(transform, ray));
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <optional>
+#include <limits>
+
+#include "common.hpp"
+#include "aabb.hpp"
+#include "geometry.hpp"
+#include "transform.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace okami {
+	struct Ray {
+		glm::vec3 m_origin;
+		glm::vec3 m_direction;
+		float m_tMin = 0.0f;
+		float m_tMax = std::numeric_limits<float>::infinity();
+	};
+
+	struct RayHit {
+		// Ray parameter of the hit. This is the distance along the ray
+		// whenever the ray direction is normalized.
+		float m_distance;
+		// Index of the triangle in the source mesh's index order
+		uint32_t m_triangle;
+		// Weights of the triangle's second and third vertex; the first
+		// vertex has weight 1 - x - y
+		glm::vec2 m_barycentrics;
+	};
+
+	struct BVHNode {
+		AABB m_bounds;
+		// Interior nodes: index of the left child, the right child follows it.
+		// Leaves: index of the first triangle.
+		uint32_t m_first = 0;
+		// Number of triangles in a leaf, zero for interior nodes
+		uint32_t m_count = 0;
+
+		inline bool IsLeaf() const {
+			return m_count > 0;
+		}
+	};
+
+	struct BVHBuildParams {
+		uint32_t m_binCount = 16;
+		uint32_t m_maxLeafSize = 4;
+		bool m_parallel = true;
+	};
+
+	// Bounding volume hierarchy over the triangles of a single mesh, built
+	// with binned SAH. Triangles are copied into leaf order so that traversal
+	// does not have to go through the index buffer.
+	class TriangleBVH {
+	public:
+		struct Triangle {
+			glm::vec3 m_v0;
+			glm::vec3 m_v1;
+			glm::vec3 m_v2;
+		};
+
+	private:
+		std::vector<BVHNode> m_nodes;
+		std::vector<Triangle> m_triangles;
+		std::vector<uint32_t> m_triangleIds;
+
+	public:
+		TriangleBVH() = default;
+		OKAMI_NO_COPY(TriangleBVH);
+		OKAMI_MOVE(TriangleBVH);
+
+		// If indices is empty, every three consecutive positions form a triangle
+		static Expected<TriangleBVH> Build(
+			std::span<glm::vec3 const> positions,
+			std::span<uint32_t const> indices,
+			BVHBuildParams const& params = {});
+
+		static Expected<TriangleBVH> Build(
+			RawGeometry const& geometry,
+			size_t meshIndex,
+			BVHBuildParams const& params = {});
+
+		// Closest hit within [m_tMin, m_tMax], using a watertight ray/triangle
+		// test so rays through shared edges and vertices never slip through.
+		std::optional<RayHit> Raycast(Ray const& ray) const;
+
+		// Returns as soon as any hit within [m_tMin, m_tMax] is found
+		bool Occluded(Ray const& ray) const;
+
+		inline AABB GetBounds() const {
+			return m_nodes.empty() ? AABB{ glm::vec3(0.0f), glm::vec3(0.0f) } : m_nodes[0].m_bounds;
+		}
+
+		inline size_t GetTriangleCount() const {
+			return m_triangles.size();
+		}
+
+		inline std::span<BVHNode const> GetNodes() const {
+			return std::span(m_nodes);
+		}
+	};
+
+	// Raycast against an instance of the BVH placed in the world by transform.
+	// The ray is given in world space and the hit distance is reported in
+	// the parametrization of that world-space ray.
+	std::optional<RayHit> Raycast(
+		TriangleBVH const& bvh,
+		Transform const& transform,
+		Ray const& ray);
+
+	bool Occluded(
+		TriangleBVH const& bvh,
+		Transform const& transform,
+		Ray const& ray);
+}
@@ -1,6 +1,7 @@
 #include "camera.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/geometric.hpp>
 
 using namespace okami;
 
@@ -129,4 +130,47 @@ glm::mat4 Camera::GetProjectionMatrix(int width, int height, bool usingDirectX)
 	return std::visit(
 		[&](const auto& proj) { return proj.GetProjectionMatrix(width, height, usingDirectX); },
 		m_projection);
-}
\ No newline at end of file
+}
+
+Frustum Frustum::FromMatrix(glm::mat4 const& m, bool usingDirectX) {
+	auto row = [&](int i) {
+		return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	};
+
+	Frustum frustum;
+	frustum.m_planes[0] = row(3) + row(0); // Left
+	frustum.m_planes[1] = row(3) - row(0); // Right
+	frustum.m_planes[2] = row(3) + row(1); // Bottom
+	frustum.m_planes[3] = row(3) - row(1); // Top
+	// DirectX clips depth to [0, w] instead of [-w, w]
+	frustum.m_planes[4] = usingDirectX ? row(2) : row(3) + row(2); // Near
+	frustum.m_planes[5] = row(3) - row(2); // Far
+
+	for (auto& plane : frustum.m_planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool Frustum::Intersects(glm::vec3 const& center, float radius) const {
+	for (auto const& plane : m_planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::Intersects(AABB const& aabb) const {
+	for (auto const& plane : m_planes) {
+		// Corner furthest along the plane normal
+		glm::vec3 corner(
+			plane.x >= 0.0f ? aabb.m_max.x : aabb.m_min.x,
+			plane.y >= 0.0f ? aabb.m_max.y : aabb.m_min.y,
+			plane.z >= 0.0f ? aabb.m_max.z : aabb.m_min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -2,9 +2,13 @@
 
 #include <variant>
 #include <optional>
+#include <array>
+
+#include "aabb.hpp"
 
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
 
 namespace okami {
 	struct PerspectiveProjection {
@@ -63,4 +67,17 @@ namespace okami {
 			float nearZ,
 			float farZ);
 	};
+
+	// View frustum as six inward facing planes; xyz is the unit normal and w
+	// the offset, so a point p is inside a plane if dot(xyz, p) + w >= 0.
+	struct Frustum {
+		std::array<glm::vec4, 6> m_planes;
+
+		// Extracts the planes of a view-projection matrix (Gribb & Hartmann).
+		// The planes are in whatever space the matrix transforms from.
+		static Frustum FromMatrix(glm::mat4 const& viewProjection, bool usingDirectX);
+
+		bool Intersects(glm::vec3 const& center, float radius) const;
+		bool Intersects(AABB const& aabb) const;
+	};
 }
\ No newline at end of file
@@ -37,12 +37,20 @@
 #define OKAMI_UNEXPECTED_RETURN(x) if (!x) { return std::unexpected(okami::MakeError(std::move(x))); }
 
 namespace okami {
+	// Kinds of error callers need to tell apart without parsing the message
+	enum class ErrorCode {
+		Unspecified,
+		// The operation was abandoned because nothing wanted its result
+		Cancelled,
+	};
+
 	struct Error {
 		std::variant<std::monostate, std::string_view, std::string> m_message;
+		ErrorCode m_code = ErrorCode::Unspecified;
 
 		Error() : m_message(std::monostate{}) {}
-		Error(const std::string& msg) : m_message(msg) {}
-		Error(const char* msg) : m_message(std::string_view{ msg }) {}
+		Error(const std::string& msg, ErrorCode code = ErrorCode::Unspecified) : m_message(msg), m_code(code) {}
+		Error(const char* msg, ErrorCode code = ErrorCode::Unspecified) : m_message(std::string_view{ msg }), m_code(code) {}
 
 		operator bool() const {
 			return IsOk();
@@ -70,6 +78,11 @@ namespace okami {
 			}
 			return "No error message";
 		}
+
+		// The same error, code included, with ": context" appended to its message
+		inline Error WithContext(std::string_view context) const {
+			return Error(Str() + ": " + std::string(context), m_code);
+		}
 	};
 
 	inline Error MakeError(Error err) {
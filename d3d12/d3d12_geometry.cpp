@@ -2,6 +2,8 @@
 
 #include "d3d12_geometry.hpp"
 #include "d3d12_mesh_formats.hpp"
+#include "../lod.hpp"
+#include "../paths.hpp"
 
 #include <glog/logging.h>
 
@@ -17,7 +19,7 @@ Error MeshLoadTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList& com
             return Error("No path or geometry provided for StaticMeshLoadTask");
         }
 
-        auto result = RawGeometry::LoadGLTF(*m_path);
+        auto result = RawGeometry::Load(*m_path);
         if (!result.has_value()) {
             return result.error();
         }
@@ -25,45 +27,75 @@ Error MeshLoadTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList& com
         initGeometry = std::move(result.value());
     }
 
-    auto reqs = GetD3D12MeshRequirements();
-
-    size_t indexBufferSize = 0;
-    size_t vertexBufferSize = 0;
-
-    // Generate the descs for the meshes that will actually be on the GPU
-    std::vector<GeometryMeshDesc> convertedMeshes;
-    for (auto const& mesh : initGeometry->GetMeshes()) {
-        auto meshCopy = mesh;
-        auto const& meshReqs = reqs[mesh.m_type];
-        meshCopy.m_attributes.clear();
-        for (auto attrib : meshReqs) {
-            meshCopy.m_attributes.push_back(Attribute{
-                .m_type = attrib,
-                .m_buffer = 0,
-                .m_offset = vertexBufferSize,
-            });
-            vertexBufferSize += GetStride(attrib) * 
-                mesh.m_vertexCount;
+    // Hash before any processing so duplicates skip it along with the upload
+    std::optional<ContentHash> contentHash;
+    if (m_manager->IsContentDeduplicationEnabled()) {
+        contentHash = initGeometry->ComputeContentHash();
+        m_sharedWith = m_manager->FindByContent(*contentHash);
+        if (m_sharedWith) {
+            return {};
         }
-        if (mesh.HasIndexBuffer()) {
-            meshCopy.m_indices->m_buffer = 1;
-            meshCopy.m_indices->m_offset = indexBufferSize;
-            indexBufferSize += GetStride(AccessorType::Scalar, meshCopy.m_indices->m_type) * 
-                meshCopy.m_indices->m_count;
+    }
+
+    // Imported geometry can get its levels of detail here; cooked geometry
+    // carries whatever the cook produced
+    auto const& reqs = m_manager->GetRequirements();
+    auto meshes = initGeometry->GetMeshes();
+    bool hasLods = std::any_of(meshes.begin(), meshes.end(), [](auto const& mesh) { return !mesh.m_lods.empty(); });
+    if (m_manager->IsGeneratingLods() && !hasLods && !initGeometry->IsPacked(reqs)) {
+        auto lodError = initGeometry->GenerateLods(LodChainParams{});
+        if (lodError.IsError()) {
+            LOG(WARNING) << "Failed to generate levels of detail for geometry: " << lodError;
+        }
+    }
+
+    if (m_manager->IsBuildingBVHs() && initGeometry->GetBVHs().empty()) {
+        auto bvhError = initGeometry->BuildBVHs();
+        if (bvhError.IsError()) {
+            LOG(WARNING) << "Failed to build BVH for geometry: " << bvhError;
+        }
+    }
+    m_resource.m_bvhs.assign(initGeometry->GetBVHs().begin(), initGeometry->GetBVHs().end());
+
+    if (m_manager->IsBuildingMeshlets() && initGeometry->GetMeshletTables().empty()) {
+        auto meshletError = initGeometry->BuildMeshlets();
+        if (meshletError.IsError()) {
+            LOG(WARNING) << "Failed to build meshlets for geometry: " << meshletError;
         }
-        convertedMeshes.push_back(meshCopy);
     }
+    m_resource.m_meshlets.assign(initGeometry->GetMeshletTables().begin(), initGeometry->GetMeshletTables().end());
+
+    // Cooked geometry is already in the GPU layout and is uploaded as is
+    if (!initGeometry->IsPacked(reqs)) {
+        auto packed = initGeometry->Pack(reqs);
+        OKAMI_ERROR_RETURN(packed);
+        initGeometry = std::move(packed.value());
+    }
+
+    auto vertexData = initGeometry->GetRawVertexData(0);
+    auto indexData = initGeometry->GetBuffers().size() > 1 ?
+        initGeometry->GetRawVertexData(1) : std::span<uint8_t>();
 
     GeometryPrivate privateData;
 
-    auto vertexBuffer = StaticBuffer::Create(device, vertexBufferSize);
-    OKAMI_ERROR_RETURN(vertexBuffer);
-    privateData.m_vertexBuffer = std::move(vertexBuffer.value());
+    auto vertices = m_manager->GetVertexHeap().Allocate(
+        device, vertexData.size(), GeometryManager::kGeometryAlignment);
+    OKAMI_ERROR_RETURN(vertices);
+    privateData.m_vertices = *vertices;
 
-    if (indexBufferSize > 0) {
-        auto indexBuffer = StaticBuffer::Create(device, indexBufferSize);
-        OKAMI_ERROR_RETURN(indexBuffer);
-        privateData.m_indexBuffer = std::move(indexBuffer.value());
+    // Nothing else knows about the ranges until they are stored in m_resource
+    ScopeGuard freeRanges([&]() {
+        m_manager->GetVertexHeap().Free(privateData.m_vertices);
+        if (privateData.m_indices) {
+            m_manager->GetIndexHeap().Free(*privateData.m_indices);
+        }
+    });
+
+    if (!indexData.empty()) {
+        auto indices = m_manager->GetIndexHeap().Allocate(
+            device, indexData.size(), GeometryManager::kGeometryAlignment);
+        OKAMI_ERROR_RETURN(indices);
+        privateData.m_indices = *indices;
     }
 
     // Create and populate vertex upload buffer
@@ -71,127 +103,113 @@ Error MeshLoadTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList& com
         device,
         UploadBufferType::Vertex,
         L"Vertex Upload Buffer",
-        vertexBufferSize
+        vertexData.size()
     );
     OKAMI_ERROR_RETURN(vertexUploadBuffer);
 
     {
         auto map = vertexUploadBuffer->Map();
         OKAMI_ERROR_RETURN(map);
-
-        for (int i = 0; i < convertedMeshes.size(); i++) {
-            const auto& mesh = convertedMeshes[i];
-            const auto& originalMesh = initGeometry->GetMeshes()[i];
-
-            for (auto attrib : originalMesh.m_attributes) {
-                auto it = std::find_if(mesh.m_attributes.begin(), mesh.m_attributes.end(),
-                    [attrib](const Attribute& a) { return a.m_type == attrib.m_type; });
-
-                // Original mesh doesn't have this attribute
-                if (it == mesh.m_attributes.end()) {
-                    GenerateDefaultAttributeData(
-                        std::span(map->Data() + attrib.m_offset,
-                            GetStride(attrib.m_type) * mesh.m_vertexCount),
-                        attrib.m_type);
-                } else {
-                    // Mesh has this attribute, copy
-                    std::memcpy(
-                        map->Data() + attrib.m_offset,
-                        initGeometry->GetRawVertexData(it->m_buffer).data() + it->m_offset,
-                        GetStride(attrib.m_type) * mesh.m_vertexCount
-                    );
-                }
-            }
-        }
+        std::memcpy(map->Data(), vertexData.data(), vertexData.size());
     }
     // Write copy commands into command list
-    commandList.CopyResource(privateData.m_vertexBuffer.GetResource(),
-        vertexUploadBuffer->GetResource());
+    commandList.CopyBufferRegion(privateData.m_vertices.m_resource,
+        privateData.m_vertices.m_allocation.m_offset,
+        vertexUploadBuffer->GetResource(), 0, vertexData.size());
     m_uploadBuffers.push_back(vertexUploadBuffer->GetResource());
 
     // Create and populate an index upload buffer
-    if (privateData.m_indexBuffer) {
+    if (privateData.m_indices) {
         auto indexUploadBuffer = UploadBuffer<uint8_t>::Create(
             device,
             UploadBufferType::Index,
             L"Index Upload Buffer",
-            indexBufferSize
+            indexData.size()
         );
         OKAMI_ERROR_RETURN(indexUploadBuffer);
 
         {
             auto map = indexUploadBuffer->Map();
             OKAMI_ERROR_RETURN(map);
-
-            for (int i = 0; i < convertedMeshes.size(); i++) {
-                const auto& mesh = convertedMeshes[i];
-                const auto& originalMesh = initGeometry->GetMeshes()[i];
-
-                if (mesh.HasIndexBuffer()) {
-                    std::memcpy(
-                        map->Data() + mesh.m_indices->m_offset,
-                        initGeometry->GetRawVertexData(originalMesh.m_indices->m_buffer).data() + originalMesh.m_indices->m_offset,
-                        mesh.m_indices->GetStride() * mesh.m_indices->m_count
-                    );
-                }
-            }
+            std::memcpy(map->Data(), indexData.data(), indexData.size());
         }
         // Write copy commands into command list
-        commandList.CopyResource(privateData.m_indexBuffer->GetResource(),
-            indexUploadBuffer->GetResource());
+        commandList.CopyBufferRegion(privateData.m_indices->m_resource,
+            privateData.m_indices->m_allocation.m_offset,
+            indexUploadBuffer->GetResource(), 0, indexData.size());
         m_uploadBuffers.push_back(indexUploadBuffer->GetResource());
     }
 
-    m_resource.m_meshes = std::move(convertedMeshes);
+    m_resource.m_meshes.assign(initGeometry->GetMeshes().begin(), initGeometry->GetMeshes().end());
+    freeRanges.Dismiss();
     m_resource.m_privateData = std::move(privateData);
 
+    if (contentHash) {
+        m_manager->RegisterContent(*contentHash, m_resourceId);
+    }
+
     return {};
 }
 
 Error MeshLoadTask::Finalize() {
+    if (IsLoadCancelled(GetError())) {
+        return m_manager->FinalizeCancelled(m_resourceId);
+    }
+    if (m_sharedWith && GetError().IsOk()) {
+        return m_manager->FinalizeShared(m_resourceId, *m_sharedWith);
+    }
     return m_manager->Finalize(m_resourceId, std::move(m_resource), GetError());
 }
 
-void GeometryManager::TransitionMeshes(ID3D12GraphicsCommandList& commandList) {
-    // Transition all meshes that need to be transitioned
-    std::vector<D3D12_RESOURCE_BARRIER> barriers;
-    while (!m_meshesToTransition.empty()) {
-        auto nextResourceId = m_meshesToTransition.front();
-        m_meshesToTransition.pop();
-
-        auto it = m_meshesById.find(nextResourceId);
-        if (it == m_meshesById.end()) {
-            LOG(WARNING) << "Geometry with ID " << nextResourceId << " not found for transition";
-            continue;
-        }
-        auto& geometry = it->second;
-
-        auto& privateData = std::any_cast<GeometryPrivate&>(geometry->m_data.m_privateData);
-
-        // Vertex buffer transition
-        D3D12_RESOURCE_BARRIER vertexBarrier = {};
-        vertexBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        vertexBarrier.Transition.pResource = privateData.m_vertexBuffer.GetResource();
-        vertexBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-        vertexBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-        vertexBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-        barriers.push_back(vertexBarrier);
-
-        // Index buffer transition
-        if (privateData.m_indexBuffer) {
-            D3D12_RESOURCE_BARRIER indexBarrier = {};
-            indexBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            indexBarrier.Transition.pResource = privateData.m_indexBuffer->GetResource();
-            indexBarrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            indexBarrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-            indexBarrier.Transition.StateAfter = D3D12_RESOURCE_STATE_INDEX_BUFFER;
-            barriers.push_back(indexBarrier);
+Expected<GeometryHeapAllocation> GeometryHeap::Allocate(
+    ID3D12Device& device, uint64_t size, uint64_t alignment) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (uint32_t i = 0; i < m_pages.size(); ++i) {
+        auto& page = m_pages[i];
+        if (auto allocation = page.m_allocator.Allocate(size, alignment)) {
+            return GeometryHeapAllocation{
+                .m_page = i,
+                .m_resource = page.m_buffer.GetResource(),
+                .m_address = page.m_buffer.GetGPUAddress() + allocation->m_offset,
+                .m_allocation = *allocation,
+            };
         }
     }
 
-    if (!barriers.empty()) {
-        commandList.ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+    // Geometry larger than a page gets a page of its own
+    auto pageSize = std::max(m_pageSize, size);
+    auto buffer = StaticBuffer::Create(device, pageSize);
+    OKAMI_UNEXPECTED_RETURN(buffer);
+    buffer->GetResource()->SetName(m_name.c_str());
+
+    m_pages.push_back(Page{ std::move(buffer.value()), OffsetAllocator(pageSize) });
+    auto& page = m_pages.back();
+    auto allocation = page.m_allocator.Allocate(size, alignment);
+    if (!allocation) {
+        return std::unexpected(Error("Failed to allocate geometry from a new page"));
     }
+    return GeometryHeapAllocation{
+        .m_page = static_cast<uint32_t>(m_pages.size() - 1),
+        .m_resource = page.m_buffer.GetResource(),
+        .m_address = page.m_buffer.GetGPUAddress() + allocation->m_offset,
+        .m_allocation = *allocation,
+    };
+}
+
+void GeometryHeap::Free(GeometryHeapAllocation const& allocation) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pages[allocation.m_page].m_allocator.Free(allocation.m_allocation);
+}
+
+ID3D12Resource* GeometryHeap::GetPage(uint32_t page) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pages[page].m_buffer.GetResource();
+}
+
+size_t GeometryHeap::GetPageCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pages.size();
 }
 
 std::pair<resource_id_t, ResHandle<Geometry>> GeometryManager::NewResource(
@@ -215,43 +233,236 @@ Error GeometryManager::Finalize(resource_id_t resourceId,
 
     it->second->m_data = std::move(data);
 
-    if (error.IsOk()) {
-        m_meshesToTransition.push(resourceId);
+    size_t bytes = 0;
+    if (auto const* privateData = std::any_cast<GeometryPrivate>(&it->second->m_data.m_privateData)) {
+        bytes = privateData->m_vertices.m_allocation.m_size;
+        if (privateData->m_indices) {
+            bytes += privateData->m_indices->m_allocation.m_size;
+        }
+    }
+    m_cache.Add(resourceId, bytes);
+
+    it->second->m_loaded.store(true);
+    CompleteLoad(resourceId, error);
+    return {};
+}
+
+void GeometryManager::Collect(uint64_t submittedFrame, uint64_t completedFrame) {
+    m_submittedFrame = submittedFrame;
+    m_retired.Release(completedFrame, [this](GeometryPrivate& retired) {
+        m_vertexHeap.Free(retired.m_vertices);
+        if (retired.m_indices) {
+            m_indexHeap.Free(*retired.m_indices);
+        }
+    });
+
+    // Held throughout so load tasks cannot start sharing evicted geometry
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    m_keptAlive.clear();
+    for (auto const& [alias, shared] : m_aliasesToShared) {
+        m_keptAlive.insert(shared);
+    }
+    for (auto const& [id, shares] : m_pendingShares) {
+        m_keptAlive.insert(id);
+    }
+    for (auto const& [id, mesh] : m_meshesById) {
+        m_cache.SetReferenced(id,
+            mesh->m_refCount.load(std::memory_order_relaxed) > 0 || m_keptAlive.contains(id));
+    }
+
+    m_evicted.clear();
+    m_cache.Collect(m_evicted);
+    for (auto id : m_evicted) {
+        Destroy(id);
+    }
+}
+
+void GeometryManager::Destroy(resource_id_t resourceId) {
+    auto it = m_meshesById.find(resourceId);
+    if (it == m_meshesById.end()) {
+        return;
+    }
+    auto& mesh = *it->second;
+
+    // Aliases only borrow the buffers of the geometry they share
+    if (auto aliasIt = m_aliasesToShared.find(resourceId); aliasIt != m_aliasesToShared.end()) {
+        m_aliasesToShared.erase(aliasIt);
+    } else if (auto* privateData = std::any_cast<GeometryPrivate>(&mesh.m_data.m_privateData)) {
+        m_retired.Push(*privateData, m_submittedFrame);
+    }
+
+    if (auto contentIt = m_idsToContent.find(resourceId); contentIt != m_idsToContent.end()) {
+        m_contentToIds.erase(contentIt->second);
+        m_idsToContent.erase(contentIt);
+    }
+    if (!mesh.m_path.empty()) {
+        auto pathIt = m_meshPathsToIds.find(NormalizePath(mesh.m_path));
+        if (pathIt != m_meshPathsToIds.end() && pathIt->second == resourceId) {
+            m_meshPathsToIds.erase(pathIt);
+        }
+    }
+    m_meshesById.erase(it);
+}
+
+std::optional<resource_id_t> GeometryManager::FindByContent(ContentHash const& hash) {
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    if (auto it = m_contentToIds.find(hash); it != m_contentToIds.end()) {
+        // Kept alive until the alias is finalized
+        m_pendingShares[it->second]++;
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+void GeometryManager::RegisterContent(ContentHash const& hash, resource_id_t resourceId) {
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    if (m_contentToIds.try_emplace(hash, resourceId).second) {
+        m_idsToContent.emplace(resourceId, hash);
+    }
+}
+
+Error GeometryManager::FinalizeShared(resource_id_t resourceId, resource_id_t sharedId) {
+    {
+        std::lock_guard<std::mutex> lock(m_contentMutex);
+        if (--m_pendingShares[sharedId] <= 0) {
+            m_pendingShares.erase(sharedId);
+        }
+    }
+
+    auto it = m_meshesById.find(resourceId);
+    if (it == m_meshesById.end()) {
+        return Error("Geometry not found");
+    }
+
+    // Tasks finalize in the order they executed, so the shared geometry is
+    // already final
+    Error error;
+    auto sharedIt = m_meshesById.find(sharedId);
+    if (sharedIt != m_meshesById.end() && sharedIt->second->m_data.m_privateData.has_value()) {
+        it->second->m_data = sharedIt->second->m_data;
+        m_aliasesToShared.emplace(resourceId, sharedId);
     } else {
-        // Use default texture?
+        LOG(WARNING) << "Geometry " << resourceId << " shares content with " << sharedId << ", which failed to load";
+        error = Error("Shared geometry failed to load");
     }
 
+    // The buffers' bytes count against the geometry it shares
+    m_cache.Add(resourceId, 0);
     it->second->m_loaded.store(true);
+    CompleteLoad(resourceId, error);
     return {};
 }
 
-ResHandle<Geometry> GeometryManager::Load(std::string_view path) {
-     // Find existing mesh if already loaded
-    if (auto it = m_meshPathsToIds.find(path); it != m_meshPathsToIds.end()) {
+Error GeometryManager::FinalizeCancelled(resource_id_t resourceId) {
+    auto it = m_meshesById.find(resourceId);
+    if (it == m_meshesById.end()) {
+        return Error("Geometry not found");
+    }
+    auto& mesh = *it->second;
+
+    auto pendingIt = m_pendingLoads.find(resourceId);
+    if (mesh.m_refCount.load(std::memory_order_relaxed) > 0) {
+        // Requested again after the load was cancelled
+        if (pendingIt != m_pendingLoads.end()) {
+            SubmitLoad(mesh, pendingIt->second);
+            return {};
+        }
+        // Created geometry has nothing left to load from
+        return Finalize(resourceId, Geometry{}, LoadCancelledError());
+    }
+
+    // Forgotten before the callbacks run, so they may load the path afresh
+    std::vector<LoadCallback<Geometry>> callbacks;
+    if (pendingIt != m_pendingLoads.end()) {
+        callbacks = std::move(pendingIt->second.m_callbacks);
+        m_pendingLoads.erase(pendingIt);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_contentMutex);
+        Destroy(resourceId);
+    }
+    for (auto& callback : callbacks) {
+        callback(ResHandle<Geometry>(), LoadCancelledError());
+    }
+    return {};
+}
+
+void GeometryManager::CompleteLoad(resource_id_t resourceId, Error const& error) {
+    auto pendingIt = m_pendingLoads.find(resourceId);
+    if (pendingIt == m_pendingLoads.end()) {
+        return;
+    }
+    auto callbacks = std::move(pendingIt->second.m_callbacks);
+    m_pendingLoads.erase(pendingIt);
+
+    if (auto it = m_meshesById.find(resourceId); it != m_meshesById.end()) {
+        ResHandle<Geometry> handle(it->second.get());
+        for (auto& callback : callbacks) {
+            callback(handle, error);
+        }
+    }
+}
+
+void GeometryManager::SubmitLoad(Resource<Geometry>& mesh, PendingLoad const& pending) {
+    m_uploader->SubmitTask(
+        std::make_unique<MeshLoadTask>(
+            std::filesystem::path(mesh.m_path),
+            mesh.m_id,
+            this,
+            &mesh.m_refCount),
+        pending.m_priority,
+        &mesh);
+}
+
+ResHandle<Geometry> GeometryManager::Load(std::string_view path, LoadParams<Geometry> params) {
+    auto normalizedPath = NormalizePath(path);
+
+     // Find existing mesh if already loaded or loading
+    if (auto it = m_meshPathsToIds.find(normalizedPath); it != m_meshPathsToIds.end()) {
         auto resourceId = it->second;
         auto meshIt = m_meshesById.find(resourceId);
         if (meshIt != m_meshesById.end()) {
-            return meshIt->second.get();
+            auto& mesh = *meshIt->second;
+            ResHandle<Geometry> handle(&mesh);
+            if (auto pendingIt = m_pendingLoads.find(resourceId); pendingIt != m_pendingLoads.end()) {
+                auto& pending = pendingIt->second;
+                if (params.m_priority < pending.m_priority) {
+                    pending.m_priority = params.m_priority;
+                    m_uploader->Reprioritize(&mesh, params.m_priority);
+                }
+                if (params.m_onLoaded) {
+                    pending.m_callbacks.push_back(std::move(params.m_onLoaded));
+                }
+            } else if (params.m_onLoaded) {
+                params.m_onLoaded(handle, mesh.m_data.m_privateData.has_value() ?
+                    Error() : Error("Geometry failed to load"));
+            }
+            return handle;
         }
     }
 
     auto [resourceId, handle] = NewResource(path);
-    m_uploader->SubmitTask(
-        std::make_unique<MeshLoadTask>(
-            std::filesystem::path(path),
-            resourceId,
-            this));
-    m_meshPathsToIds.emplace(path, resourceId);
+    auto& pending = m_pendingLoads[resourceId];
+    pending.m_priority = params.m_priority;
+    if (params.m_onLoaded) {
+        pending.m_callbacks.push_back(std::move(params.m_onLoaded));
+    }
+    SubmitLoad(*handle.Ptr(), pending);
+    m_meshPathsToIds.emplace(std::move(normalizedPath), resourceId);
     return handle;
 }
 
 ResHandle<Geometry> GeometryManager::Create(typename Geometry::CreationData&& data) {
     auto [resourceId, handle] = NewResource();
+    // Nothing to read, so these go ahead of loads from files
     m_uploader->SubmitTask(
         std::make_unique<MeshLoadTask>(
             std::move(data),
             resourceId,
-            this));
+            this,
+            &handle.Ptr()->m_refCount),
+        LoadPriority::Immediate,
+        handle.Ptr());
     return handle;
 }
 
@@ -2,9 +2,14 @@
 
 #ifdef USE_D3D12
 
+#include <unordered_set>
+
 #include "../renderer.hpp"
 #include "../storage.hpp"
 #include "../geometry.hpp"
+#include "../hash.hpp"
+#include "../offset_allocator.hpp"
+#include "../resource_cache.hpp"
 
 #include "d3d12_common.hpp"
 #include "d3d12_upload.hpp"
@@ -12,9 +17,50 @@
 namespace okami {
     class GeometryManager;
 
+    // A range of one of a GeometryHeap's pages
+    struct GeometryHeapAllocation {
+        uint32_t m_page = 0;
+        ID3D12Resource* m_resource = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS m_address = 0;
+        OffsetAllocation m_allocation;
+    };
+
+    // Suballocates geometry from a few large buffers instead of creating a
+    // committed resource per mesh. Pages are created as needed, at least
+    // m_pageSize bytes each, and stay in the common state: buffers are
+    // promoted to copy destination or vertex/index buffer on use and decay
+    // back, so uploads into one range need no barriers on the others.
+    class GeometryHeap {
+    private:
+        struct Page {
+            StaticBuffer m_buffer;
+            OffsetAllocator m_allocator;
+        };
+
+        std::mutex m_mutex;
+        std::vector<Page> m_pages;
+        uint64_t m_pageSize;
+        std::wstring m_name;
+
+    public:
+        inline GeometryHeap(uint64_t pageSize, std::wstring name) :
+            m_pageSize(pageSize), m_name(std::move(name)) {}
+
+        OKAMI_NO_COPY(GeometryHeap);
+        OKAMI_NO_MOVE(GeometryHeap);
+
+        // Safe to call from the upload thread
+        Expected<GeometryHeapAllocation> Allocate(ID3D12Device& device, uint64_t size, uint64_t alignment);
+        void Free(GeometryHeapAllocation const& allocation);
+
+        // Whole page, for binding once and drawing many meshes from it
+        ID3D12Resource* GetPage(uint32_t page);
+        size_t GetPageCount();
+    };
+
     struct GeometryPrivate {
-        StaticBuffer m_vertexBuffer;
-        std::optional<StaticBuffer> m_indexBuffer;
+        GeometryHeapAllocation m_vertices;
+        std::optional<GeometryHeapAllocation> m_indices;
 	};
 
     struct MeshLoadTask final : public GpuUploaderTask {
@@ -23,7 +69,13 @@ namespace okami {
         std::optional<RawGeometry> m_initData;
         resource_id_t m_resourceId;
         GeometryManager* m_manager = nullptr;
+        // References to the geometry; the load is cancelled if they are all
+        // released before it runs
+        std::atomic<int> const* m_refCount = nullptr;
         Geometry m_resource;
+        // Set when identical geometry was already uploaded; nothing is
+        // uploaded and the resource aliases that geometry's buffers
+        std::optional<resource_id_t> m_sharedWith;
 
         // Temporary upload buffers
         // These will be released after the GPU upload is complete
@@ -33,19 +85,25 @@ namespace okami {
         inline MeshLoadTask(
             std::filesystem::path path,
             resource_id_t resourceId,
-            GeometryManager* manager) :
-            m_path(std::move(path)), m_resourceId(resourceId), m_manager(manager) {}
+            GeometryManager* manager,
+            std::atomic<int> const* refCount = nullptr) :
+            m_path(std::move(path)), m_resourceId(resourceId), m_manager(manager), m_refCount(refCount) {}
 
         inline MeshLoadTask(
             RawGeometry initData,
             resource_id_t resourceId,
-            GeometryManager* manager) :
-            m_initData(std::move(initData)), m_resourceId(resourceId), m_manager(manager) {}
+            GeometryManager* manager,
+            std::atomic<int> const* refCount = nullptr) :
+            m_initData(std::move(initData)), m_resourceId(resourceId), m_manager(manager), m_refCount(refCount) {}
 
         Error Execute(
             ID3D12Device& device, 
             ID3D12GraphicsCommandList& commandList) override;
         Error Finalize() override;
+
+        inline bool IsWanted() const override {
+            return !m_refCount || m_refCount->load(std::memory_order_relaxed) > 0;
+        }
     };
 
     class GeometryManager : public IResourceManager<Geometry> {
@@ -53,13 +111,63 @@ namespace okami {
         std::unordered_map<std::filesystem::path, resource_id_t> m_meshPathsToIds;
 		std::unordered_map<resource_id_t, std::unique_ptr<Resource<Geometry>>> m_meshesById;
 
-		std::queue<resource_id_t> m_meshesToTransition;
 		std::atomic<resource_id_t> m_nextResourceId{0};
 
         std::shared_ptr<GpuUploader> m_uploader;
+        // Layout every geometry is packed into before upload
+        MeshRequirements m_requirements;
+
+        GeometryHeap m_vertexHeap{ kVertexPageSize, L"Geometry Vertex Page" };
+        GeometryHeap m_indexHeap{ kIndexPageSize, L"Geometry Index Page" };
+
+        // Content hashes of uploaded geometry, written and read by load tasks
+        std::mutex m_contentMutex;
+        std::unordered_map<ContentHash, resource_id_t> m_contentToIds;
+        std::unordered_map<resource_id_t, ContentHash> m_idsToContent;
+        // Geometry load tasks found to share, until the alias is finalized
+        std::unordered_map<resource_id_t, int> m_pendingShares;
+        std::atomic<bool> m_deduplicate{true};
+        std::atomic<bool> m_buildBVHs{false};
+        std::atomic<bool> m_buildMeshlets{false};
+        std::atomic<bool> m_generateLods{false};
+
+        // Aliases and the geometry whose buffers they use, which must outlive them
+        std::unordered_map<resource_id_t, resource_id_t> m_aliasesToShared;
+        std::unordered_set<resource_id_t> m_keptAlive;
+
+        ResourceCache m_cache;
+        // Buffers of destroyed geometry, kept until the frames that may
+        // still draw from them have finished
+        DeferredReleaseQueue<GeometryPrivate> m_retired;
+        std::vector<resource_id_t> m_evicted;
+        // Last frame submitted to the GPU, see Collect
+        uint64_t m_submittedFrame = 0;
+
+        // Loads from files not finalized yet
+        struct PendingLoad {
+            LoadPriority m_priority;
+            std::vector<LoadCallback<Geometry>> m_callbacks;
+        };
+        std::unordered_map<resource_id_t, PendingLoad> m_pendingLoads;
+
+        // Retires the geometry's buffers and forgets it; m_contentMutex must be held
+        void Destroy(resource_id_t resourceId);
+
+        void SubmitLoad(Resource<Geometry>& mesh, PendingLoad const& pending);
+        // Hands the outcome of a finalized load to its callbacks
+        void CompleteLoad(resource_id_t resourceId, Error const& error);
     
     public:
-        inline GeometryManager(std::shared_ptr<GpuUploader> uploader) : m_uploader(std::move(uploader)) {}
+        static constexpr uint64_t kVertexPageSize = 64ull << 20;
+        static constexpr uint64_t kIndexPageSize = 32ull << 20;
+        // Enough for every vertex and index buffer view offset
+        static constexpr uint64_t kGeometryAlignment = 256;
+
+        inline GeometryManager(
+            std::shared_ptr<GpuUploader> uploader,
+            MeshRequirements requirements,
+            ResourceCacheParams cacheParams = {}) :
+            m_uploader(std::move(uploader)), m_requirements(std::move(requirements)), m_cache(cacheParams) {}
 
         OKAMI_NO_COPY(GeometryManager);
         OKAMI_NO_MOVE(GeometryManager);
@@ -72,6 +180,71 @@ namespace okami {
             return m_meshesById;
         }
 
+        inline MeshRequirements const& GetRequirements() const {
+            return m_requirements;
+        }
+
+        inline GeometryHeap& GetVertexHeap() {
+            return m_vertexHeap;
+        }
+
+        inline GeometryHeap& GetIndexHeap() {
+            return m_indexHeap;
+        }
+
+        // When enabled, geometry whose content matches an earlier upload
+        // shares its GPU buffers instead of being uploaded again
+        inline void SetContentDeduplication(bool enabled) {
+            m_deduplicate.store(enabled);
+        }
+
+        inline bool IsContentDeduplicationEnabled() const {
+            return m_deduplicate.load();
+        }
+
+        // When enabled, loads build a triangle BVH per mesh for raycasting.
+        // Off by default since it delays every upload behind it.
+        inline void SetBuildBVHs(bool enabled) {
+            m_buildBVHs.store(enabled);
+        }
+
+        inline bool IsBuildingBVHs() const {
+            return m_buildBVHs.load();
+        }
+
+        // When enabled, loads split every mesh into meshlets for cluster
+        // culling. Off by default; nothing draws per meshlet yet.
+        inline void SetBuildMeshlets(bool enabled) {
+            m_buildMeshlets.store(enabled);
+        }
+
+        inline bool IsBuildingMeshlets() const {
+            return m_buildMeshlets.load();
+        }
+
+        // When enabled, geometry imported without levels of detail gets a
+        // chain generated on load. Off by default: CookOkMesh generates them
+        // at cook time, and simplifying on the uploader thread is slow.
+        inline void SetGenerateLods(bool enabled) {
+            m_generateLods.store(enabled);
+        }
+
+        inline bool IsGeneratingLods() const {
+            return m_generateLods.load();
+        }
+
+        inline ResourceCacheStats const& GetCacheStats() const {
+            return m_cache.GetStats();
+        }
+
+        // Destroys geometry nothing has referenced for longer than the cache
+        // keeps it, and frees buffers retired by frames up to completedFrame.
+        // Once per frame, after submitting submittedFrame.
+        void Collect(uint64_t submittedFrame, uint64_t completedFrame);
+
+        std::optional<resource_id_t> FindByContent(ContentHash const& hash);
+        void RegisterContent(ContentHash const& hash, resource_id_t resourceId);
+
         std::pair<resource_id_t, ResHandle<Geometry>> NewResource(
             std::optional<std::string_view> path = std::nullopt);
 
@@ -79,11 +252,17 @@ namespace okami {
             resource_id_t resourceId, 
             Geometry data,
             Error error);
+        // Finalizes a resource as an alias of an already finalized one
+        Error FinalizeShared(
+            resource_id_t resourceId,
+            resource_id_t sharedId);
+        // Forgets geometry whose load was cancelled, or loads it again if
+        // it was requested since
+        Error FinalizeCancelled(resource_id_t resourceId);
 
-		ResHandle<Geometry> Load(std::string_view path) override;
+        using IResourceManager<Geometry>::Load;
+		ResHandle<Geometry> Load(std::string_view path, LoadParams<Geometry> params) override;
 		ResHandle<Geometry> Create(typename Geometry::CreationData&& data) override;
-
-        void TransitionMeshes(ID3D12GraphicsCommandList& commandList);
     };
 }
 
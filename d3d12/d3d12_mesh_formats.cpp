@@ -57,6 +57,22 @@ DXGI_FORMAT okami::GetD3D12Format(AttributeType type) {
     return GetD3D12Format(GetAccessorType(type), GetComponentType(type));
 }
 
+DXGI_FORMAT okami::GetD3D12Format(AttributeType type, AttributeEncoding encoding) {
+    if (encoding == AttributeEncoding::Float) {
+        return GetD3D12Format(type);
+    }
+
+    switch (type) {
+    case AttributeType::Position: return DXGI_FORMAT_R16G16B16A16_UNORM;
+    case AttributeType::Normal: return DXGI_FORMAT_R16G16_SNORM;
+    case AttributeType::TexCoord: return DXGI_FORMAT_R16G16_FLOAT;
+    case AttributeType::Color: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    case AttributeType::Tangent: return DXGI_FORMAT_R16G16B16A16_SNORM;
+    case AttributeType::Bitangent: return DXGI_FORMAT_R16G16_SNORM;
+    default: return DXGI_FORMAT_UNKNOWN;
+    }
+}
+
 std::string_view okami::GetD3D12SemanticName(AttributeType type) {
     switch (type) {
     case AttributeType::Position: return "POSITION";
@@ -69,11 +85,11 @@ std::string_view okami::GetD3D12SemanticName(AttributeType type) {
     }
 }
 
-D3D12_INPUT_ELEMENT_DESC okami::GetD3D12InputElementDesc(AttributeType type, UINT inputSlot) {
+D3D12_INPUT_ELEMENT_DESC okami::GetD3D12InputElementDesc(AttributeType type, UINT inputSlot, AttributeEncoding encoding) {
     D3D12_INPUT_ELEMENT_DESC desc = {};
     desc.SemanticName = GetD3D12SemanticName(type).data();
     desc.SemanticIndex = 0;
-    desc.Format = GetD3D12Format(type);
+    desc.Format = GetD3D12Format(type, encoding);
     desc.InputSlot = inputSlot;
     desc.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT;
     desc.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
@@ -81,11 +97,17 @@ D3D12_INPUT_ELEMENT_DESC okami::GetD3D12InputElementDesc(AttributeType type, UIN
     return desc;
 }
 
-MeshRequirements okami::GetD3D12MeshRequirements() {
-    static MeshRequirements reqs = {
-        { MeshType::Static, std::vector(kStaticMeshAttributes.begin(), kStaticMeshAttributes.end()) }
-    };
-    return reqs;
+std::vector<D3D12_INPUT_ELEMENT_DESC> okami::GetD3D12InputLayout(std::span<AttributeRequirement const> attributes) {
+    std::vector<D3D12_INPUT_ELEMENT_DESC> layout;
+    layout.reserve(attributes.size());
+    for (uint32_t i = 0; i < attributes.size(); ++i) {
+        layout.push_back(GetD3D12InputElementDesc(attributes[i].m_type, i, attributes[i].m_encoding));
+    }
+    return layout;
+}
+
+MeshRequirements okami::GetD3D12MeshRequirements(AttributeEncoding encoding) {
+    return GetDefaultMeshRequirements(encoding);
 }
 
 #endif
\ No newline at end of file
@@ -6,34 +6,27 @@
 
 #include <d3d12.h>
 #include <array>
+#include <span>
 #include <string_view>
+#include <vector>
 
 namespace okami {
-    constexpr std::array<AttributeType, 4> kStaticMeshAttributes = {
-        AttributeType::Position,
-        AttributeType::Normal,
-        AttributeType::TexCoord,
-        AttributeType::Tangent
-    };
-
-	using MeshRequirements = std::unordered_map<MeshType, std::vector<AttributeType>>;
-
-    MeshRequirements GetD3D12MeshRequirements();
+    // Layout the static mesh renderer consumes: kStaticMeshAttributes, each
+    // in its own vertex buffer slot, all stored with the given encoding
+    MeshRequirements GetD3D12MeshRequirements(AttributeEncoding encoding = AttributeEncoding::Float);
 
     DXGI_FORMAT GetD3D12Format(AccessorType type, AccessorComponentType componentType);
     DXGI_FORMAT GetD3D12Format(AttributeType type);
-    D3D12_INPUT_ELEMENT_DESC GetD3D12InputElementDesc(AttributeType type, UINT inputSlot);
+    // Quantized attributes use normalized and half float formats, so the
+    // input assembler hands the shader floats either way
+    DXGI_FORMAT GetD3D12Format(AttributeType type, AttributeEncoding encoding);
+    D3D12_INPUT_ELEMENT_DESC GetD3D12InputElementDesc(
+        AttributeType type,
+        UINT inputSlot,
+        AttributeEncoding encoding = AttributeEncoding::Float);
     std::string_view GetD3D12SemanticName(AttributeType type);
 
-    template <size_t N>
-    constexpr std::array<D3D12_INPUT_ELEMENT_DESC, N> GetD3D12InputLayout(
-        std::array<AttributeType, N> const& attributes) {
-        std::array<D3D12_INPUT_ELEMENT_DESC, N> layout = {};
-        for (uint32_t i = 0; i < N; ++i) {
-            layout[i] = GetD3D12InputElementDesc(attributes[i], i);
-        }
-        return layout;
-    }
+    std::vector<D3D12_INPUT_ELEMENT_DESC> GetD3D12InputLayout(std::span<AttributeRequirement const> attributes);
 }
 
 #endif
\ No newline at end of file
@@ -23,6 +23,7 @@
 
 #include "../engine.hpp"
 #include "../config.hpp"
+#include "../image_writer.hpp"
 
 #include "d3d12_descriptor_pool.hpp"
 #include "d3d12_imgui.hpp"
@@ -51,6 +52,20 @@ struct RendererConfig {
 	int backbufferWidth = 1280;
 	int backbufferHeight = 720;
 	int syncInterval = 1; // VSync enabled
+	bool quantizeVertices = false; // 24 instead of 48 bytes per static mesh vertex
+	bool deduplicateResources = true; // Identical geometry and textures share GPU memory
+	bool buildMeshBVHs = false; // CPU triangle BVHs for raycasting against loaded meshes
+	bool buildMeshlets = false; // Meshlet tables with bounds for cluster culling
+	bool generateMeshLods = false; // Simplify imported glTF meshes on load; cooked meshes bring their own
+	int textureDecodeBudgetMB = 256; // Decoded texture data waiting for upload
+	bool generateMips = true; // Full mip chains for loaded textures
+	bool compressTextures = false; // BC7 encode loaded textures, a quarter of the memory
+	bool bindlessSprites = false; // One draw per sprite layer instead of per texture
+	int capturePngLevel = 1; // Headless PNG captures, 0 (stored, fastest) to 9 (smallest)
+	bool streamTextures = false; // Fine mips load as sprites need them, under a budget
+	int textureStreamingBudgetMB = 256; // Streamed mip levels resident on the GPU
+	int geometryCacheMB = 64; // Released geometry kept loaded in case it is used again
+	int textureCacheMB = 64; // Released textures kept loaded in case they are used again
 
 	OKAMI_CONFIG(renderer) {
 		OKAMI_CONFIG_FIELD(bufferCount);
@@ -58,6 +73,20 @@ struct RendererConfig {
 		OKAMI_CONFIG_FIELD(backbufferWidth);
 		OKAMI_CONFIG_FIELD(backbufferHeight);
 		OKAMI_CONFIG_FIELD(syncInterval);
+		OKAMI_CONFIG_FIELD(quantizeVertices);
+		OKAMI_CONFIG_FIELD(deduplicateResources);
+		OKAMI_CONFIG_FIELD(buildMeshBVHs);
+		OKAMI_CONFIG_FIELD(buildMeshlets);
+		OKAMI_CONFIG_FIELD(generateMeshLods);
+		OKAMI_CONFIG_FIELD(textureDecodeBudgetMB);
+		OKAMI_CONFIG_FIELD(generateMips);
+		OKAMI_CONFIG_FIELD(compressTextures);
+		OKAMI_CONFIG_FIELD(bindlessSprites);
+		OKAMI_CONFIG_FIELD(capturePngLevel);
+		OKAMI_CONFIG_FIELD(streamTextures);
+		OKAMI_CONFIG_FIELD(textureStreamingBudgetMB);
+		OKAMI_CONFIG_FIELD(geometryCacheMB);
+		OKAMI_CONFIG_FIELD(textureCacheMB);
 	}
 };
 
@@ -577,15 +606,33 @@ public:
 		}
 
 		// Initialize the mesh manager
-		m_meshManager = std::make_shared<GeometryManager>(m_uploader);
+		m_meshManager = std::make_shared<GeometryManager>(
+			m_uploader,
+			GetD3D12MeshRequirements(m_config.quantizeVertices ? AttributeEncoding::Quantized : AttributeEncoding::Float),
+			ResourceCacheParams{ .m_budgetBytes = static_cast<size_t>(std::max(m_config.geometryCacheMB, 0)) << 20 });
+		m_meshManager->SetContentDeduplication(m_config.deduplicateResources);
+		m_meshManager->SetBuildBVHs(m_config.buildMeshBVHs);
+		m_meshManager->SetBuildMeshlets(m_config.buildMeshlets);
+		m_meshManager->SetGenerateLods(m_config.generateMeshLods);
 		m_meshManager->Register(queryable);
 
 		// Initialize the texture manager
-		auto manager = TextureManager::Create(*m_d3d12Device.Get(), m_uploader);
+		auto manager = TextureManager::Create(*m_d3d12Device.Get(), m_uploader, TextureDecoderParams{
+			.m_maxInFlightBytes = static_cast<size_t>(std::max(m_config.textureDecodeBudgetMB, 1)) << 20,
+			.m_mips = m_config.generateMips ? std::optional<MipChainParams>(MipChainParams{}) : std::nullopt,
+			.m_compressTo = m_config.compressTextures ? std::optional<TextureFormat>(TextureFormat::BC7) : std::nullopt,
+			.m_compression = BlockCompressionParams{ .m_quality = CompressionQuality::Fast },
+		}, ResourceCacheParams{ .m_budgetBytes = static_cast<size_t>(std::max(m_config.textureCacheMB, 0)) << 20 });
 		if (!manager) {
 			return Error("Failed to create TextureManager");
 		}
 		m_textureManager = manager.value();
+		m_textureManager->SetContentDeduplication(m_config.deduplicateResources);
+		if (m_config.streamTextures) {
+			m_textureManager->EnableStreaming(TextureStreamingParams{
+				.m_budgetBytes = static_cast<size_t>(std::max(m_config.textureStreamingBudgetMB, 1)) << 20,
+			});
+		}
 		m_textureManager->Register(queryable);
 
 		// Initialize static mesh renderer
@@ -607,7 +654,8 @@ public:
 			m_textureManager,
 			m_samplerPool,
 			GetBackbufferRenderTargetState(),
-			static_cast<int>(m_perFrameData.size())
+			static_cast<int>(m_perFrameData.size()),
+			m_config.bindlessSprites
 		);
 		if (!spriteRenderer) {
 			return Error("Failed to create SpriteRenderer");
@@ -777,7 +825,6 @@ public:
 		frameData.m_commandList->Reset(frameData.m_commandAllocator.Get(), nullptr);
 
 		// Perform necessary resource transitions
-		m_meshManager->TransitionMeshes(*frameData.m_commandList.Get());
 		m_textureManager->TransitionTextures(*m_d3d12Device.Get(), *frameData.m_commandList.Get());
 
 		// Set up viewport and scissor rectangle
@@ -841,18 +888,26 @@ public:
 			*m_transforms
 		);
 
+		LodSelector lodSelector(
+			camera.value_or(Camera::Identity()),
+			transform,
+			m_config.backbufferWidth,
+			m_config.backbufferHeight);
+
 		m_staticMeshRenderer->Render(
 			*m_d3d12Device.Get(),
 			*frameData.m_commandList.Get(),
 			globals,
-			*m_transforms
+			*m_transforms,
+			lodSelector
 		);
 
 		m_spriteRenderer->Render(
 			*m_d3d12Device.Get(),
 			*frameData.m_commandList.Get(),
 			globals,
-			*m_transforms
+			*m_transforms,
+			lodSelector
 		);
 
 		// Draw IMGUI if initialized 
@@ -883,6 +938,14 @@ public:
 		m_commandQueue->Signal(m_fence.Get(), ++m_currentFrame);
 		frameData.m_fenceValue = m_currentFrame;
 
+		// Request the mip levels this frame's sprites asked for
+		m_textureManager->UpdateStreaming();
+
+		// Destroy what nothing references any more, once the GPU is done with it
+		auto completedFrame = m_fence->GetCompletedValue();
+		m_meshManager->Collect(m_currentFrame, completedFrame);
+		m_textureManager->Collect(m_currentFrame, completedFrame);
+
 		// Present or save to file
 		if (!m_headlessMode) {
 			// Present
@@ -966,19 +1029,15 @@ public:
 			return Error("Failed to map readback buffer")	;
 		}
 
-		TextureInfo info{
-			.type = TextureType::TEXTURE_2D,
-			.format = TextureFormat::RGBA8,
-			.width = static_cast<uint32_t>(m_config.backbufferWidth),
-			.height = static_cast<uint32_t>(m_config.backbufferHeight),
-			.depth = 1,
-			.arraySize = 1,
-			.mipLevels = 1
+		// Written straight from the readback buffer, rows pitched as copied
+		ImageView image{
+			.m_data = static_cast<uint8_t const*>(mappedData) + footprint.Offset,
+			.m_width = static_cast<uint32_t>(m_config.backbufferWidth),
+			.m_height = static_cast<uint32_t>(m_config.backbufferHeight),
+			.m_channels = 4,
+			.m_rowPitch = footprint.Footprint.RowPitch
 		};
-
-		RawTexture texture(info);
-		std::memcpy(texture.GetData().data(), mappedData, texture.GetData().size());
-		return texture.SavePNG(filename);
+		return WriteImage(filename, image, ImageWriteParams{ .m_pngLevel = m_config.capturePngLevel });
 	}
 
 	void SetHeadlessMode(bool headless) override {
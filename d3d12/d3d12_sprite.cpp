@@ -9,6 +9,8 @@
 #include <d3d12.h>
 #include <directx/d3dx12.h>
 
+#include <glog/logging.h>
+
 using namespace okami;
 using namespace DirectX;
 
@@ -19,10 +21,11 @@ constexpr D3D12_INPUT_ELEMENT_DESC kInputLayout[] = {
     { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     { "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     { "ORIGIN", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 40, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 48, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TEXINDEX", 0, DXGI_FORMAT_R32_UINT, 0, 64, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 };
 
-Expected<ComPtr<ID3D12RootSignature>> SpriteRenderer::CreateRootSignature(ID3D12Device& device)
+Expected<ComPtr<ID3D12RootSignature>> SpriteRenderer::CreateRootSignature(ID3D12Device& device, bool bindless)
 {
     // Define root parameters
     CD3DX12_ROOT_PARAMETER1 rootParameters[3];
@@ -30,9 +33,15 @@ Expected<ComPtr<ID3D12RootSignature>> SpriteRenderer::CreateRootSignature(ID3D12
     // b0: Globals constant buffer
     rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC, D3D12_SHADER_VISIBILITY_ALL);
 
-    // t1: Sprite texture
+    // t1: Sprite texture, or t0 in space1: every texture of the SRV heap when
+    // bindless. The heap has free slots, so its descriptors are volatile.
     CD3DX12_DESCRIPTOR_RANGE1 textureRange;
-    textureRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+    if (bindless) {
+        textureRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 1,
+            D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+    } else {
+        textureRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+    }
     rootParameters[1].InitAsDescriptorTable(1, &textureRange, D3D12_SHADER_VISIBILITY_PIXEL);
 
     // s0: Sprite sampler
@@ -74,12 +83,24 @@ Expected<std::shared_ptr<SpriteRenderer>> SpriteRenderer::Create(
     std::shared_ptr<TextureManager> manager,
     std::shared_ptr<DescriptorPool> samplerPool,
     DirectX::RenderTargetState rts,
-    int bufferCount)
+    int bufferCount,
+    bool bindless)
 {
     auto renderer = std::shared_ptr<SpriteRenderer>(new SpriteRenderer());
 
+    // Unbounded descriptor tables need resource binding tier 2
+    if (bindless) {
+        D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+        if (FAILED(device.CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) ||
+            options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2) {
+            LOG(WARNING) << "Bindless sprites need resource binding tier 2, drawing one texture at a time";
+            bindless = false;
+        }
+    }
+    renderer->m_bindless = bindless;
+
     // Create root signature
-    auto rootSigResult = CreateRootSignature(device);
+    auto rootSigResult = CreateRootSignature(device, bindless);
     if (!rootSigResult) {
         return std::unexpected(rootSigResult.error());
     }
@@ -98,7 +119,7 @@ Expected<std::shared_ptr<SpriteRenderer>> SpriteRenderer::Create(
     }
 
     // Load pixel shader
-    auto pixelShader = LoadShaderFromFile(GetShaderPath("sprite_ps.cso"));
+    auto pixelShader = LoadShaderFromFile(GetShaderPath(bindless ? "sprite_bindless_ps.cso" : "sprite_ps.cso"));
     if (!pixelShader.has_value()) {
         return std::unexpected(pixelShader.error());
     }
@@ -186,7 +207,8 @@ Error SpriteRenderer::Render(
     ID3D12Device& device,
     ID3D12GraphicsCommandList& commandList,
     hlsl::Globals const& globals,
-    IStorageAccessor<Transform> const& transforms)
+    IStorageAccessor<Transform> const& transforms,
+    LodSelector const& view)
 {
     auto& frameData = m_perFrameData[m_currentBuffer];
 
@@ -199,28 +221,29 @@ Error SpriteRenderer::Render(
         **globalMap = globals;
     }
 
-    struct Instance {
-        Transform m_transform;
-        SpriteComponent m_sprite;
-    };
-
-    // Collect and batch sprite instances by texture
-    std::vector<Instance> batchedSprites;
-
-    auto storage = m_staticSpriteStorage.GetStorage<SpriteComponent>();
-
-    for (auto [e, sprite] : storage) {
-        // Get transform for this entity
-        auto transformPtr = transforms.TryGet(e);
-        const Transform& transform = transformPtr ? *transformPtr : Transform::Identity();
-
-        batchedSprites.push_back(Instance{
-            .m_transform = transform,
-            .m_sprite = sprite
-        });
+    // The builder keeps pointers to the components, so iterate in place
+    m_batchBuilder.Clear();
+    auto const& storage = m_staticSpriteStorage.GetStorage<SpriteComponent>();
+    m_batchBuilder.Reserve(storage.size());
+    bool streaming = m_textureManager->IsStreaming();
+    for (auto const& [e, sprite] : storage) {
+        auto const* transform = transforms.TryGet(e);
+        m_batchBuilder.Add(transform, sprite);
+
+        if (streaming && sprite.m_texture.IsLoaded()) {
+            m_textureManager->ReportUsage(
+                sprite.m_texture.GetId(),
+                GetProjectedTextureSize(transform ? *transform : Transform::Identity(), sprite, view));
+        }
     }
 
-    if (batchedSprites.empty()) {
+    auto const& srvPool = m_textureManager->GetSrvPool();
+    m_batchBuilder.Build(SpriteBatchParams{ .m_bindless = m_bindless }, [](Texture const& texture) {
+        return std::any_cast<TexturePrivate const&>(texture.m_privateData).m_handle;
+    });
+
+    auto instanceCount = m_batchBuilder.GetInstanceCount();
+    if (instanceCount == 0) {
         return {}; // Nothing to render
     }
 
@@ -244,79 +267,34 @@ Error SpriteRenderer::Render(
     // Bind default sampler
     commandList.SetGraphicsRootDescriptorTable(2, m_samplerPool->GetGpuHandle(m_samplerHandle));
 
-    std::sort(batchedSprites.begin(), batchedSprites.end(),
-        [](const auto& a, const auto& b) {
-            if (a.m_sprite.m_layer == b.m_sprite.m_layer) {
-                return a.m_sprite.m_texture.Ptr() < b.m_sprite.m_texture.Ptr(); // Sort by texture pointer if layers are equal
-            }
-            return a.m_sprite.m_layer < b.m_sprite.m_layer; // Sort by layer
-        });
+    // Texture indices are relative to the start of the heap
+    if (m_bindless) {
+        commandList.SetGraphicsRootDescriptorTable(1, srvPool.GetGpuHandle(0));
+    }
 
-    frameData.m_instanceBuffer.Reserve(device, batchedSprites.size());
+    frameData.m_instanceBuffer.Reserve(device, instanceCount);
 
-    auto instanceMap = frameData.m_instanceBuffer.Map();
-    if (!instanceMap) {
-        return Error("Failed to map instance buffer: " + instanceMap.error().Str());
+    {
+        auto instanceMap = frameData.m_instanceBuffer.Map();
+        if (!instanceMap) {
+            return Error("Failed to map instance buffer: " + instanceMap.error().Str());
+        }
+        m_batchBuilder.WriteInstances(std::span(instanceMap->Data(), instanceCount));
     }
 
     // Render each batch
-    size_t instanceId = 0;
-    UINT bufferOffset = 0;
-    for (auto batchBegin = batchedSprites.begin(); batchBegin != batchedSprites.end();) {
-        auto batchEnd = std::find_if(batchBegin, batchedSprites.end(),
-            [texture = batchBegin->m_sprite.m_texture.Ptr()](const Instance& instance) {
-                return instance.m_sprite.m_texture.Ptr() != texture;
-            });
-
-        for (auto it = batchBegin; it != batchEnd; ++it) {
-            const Instance& instance = *it;
-
-            // Create instance data
-            hlsl::SpriteInstance instanceData;
-            instanceData.position = { instance.m_transform.m_position.x, instance.m_transform.m_position.y, instance.m_transform.m_position.z };
-            float rotation = static_cast<float>(2.0 * glm::atan(instance.m_transform.m_rotation.z, instance.m_transform.m_rotation.w));
-            glm::vec2 scale{instance.m_transform.m_scaleShear[0][0], instance.m_transform.m_scaleShear[1][1]};
-            glm::vec2 imageSize;
-        
-            if (instance.m_sprite.m_sourceRect) {
-                imageSize = instance.m_sprite.m_sourceRect->GetSize();
-                auto textureSize = instance.m_sprite.m_texture->GetSize();
-                instanceData.uv0 = instance.m_sprite.m_sourceRect->GetMin() / textureSize;
-                instanceData.uv1 = instance.m_sprite.m_sourceRect->GetMax() / textureSize;
-            } else {
-                imageSize = instance.m_sprite.m_texture->GetSize();
-                instanceData.uv0 = glm::vec2(0.0f, 0.0f);
-                instanceData.uv1 = glm::vec2(1.0f, 1.0f);
-            }
-
-            instanceData.origin = scale * instance.m_sprite.m_origin.value_or(imageSize / 2.0f);
-            instanceData.size = scale * imageSize;
-            instanceData.color = instance.m_sprite.m_color;
-            instanceData.rotation = rotation;
-
-            // Update instance buffer 
-            instanceMap->operator[](instanceId++) = instanceData;
+    D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+    vertexBufferView.BufferLocation = frameData.m_instanceBuffer.GetGPUAddress();
+    vertexBufferView.StrideInBytes = sizeof(hlsl::SpriteInstance);
+    vertexBufferView.SizeInBytes = static_cast<UINT>(instanceCount * sizeof(hlsl::SpriteInstance));
+    commandList.IASetVertexBuffers(0, 1, &vertexBufferView);
+
+    for (auto const& batch : m_batchBuilder.GetBatches()) {
+        if (batch.m_texture) {
+            auto const& privateData = std::any_cast<TexturePrivate const&>(batch.m_texture->m_privateData);
+            commandList.SetGraphicsRootDescriptorTable(1, srvPool.GetGpuHandle(privateData.m_handle));
         }
-
-        UINT batchSize = static_cast<UINT>(batchEnd - batchBegin);
-
-        // Set vertex buffers
-        D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[1];
-        vertexBufferViews[0].BufferLocation = frameData.m_instanceBuffer.GetGPUAddress() + sizeof(hlsl::SpriteInstance) * bufferOffset;
-        vertexBufferViews[0].StrideInBytes = sizeof(hlsl::SpriteInstance);
-        vertexBufferViews[0].SizeInBytes = static_cast<UINT>(batchSize * sizeof(hlsl::SpriteInstance));
-
-        commandList.IASetVertexBuffers(0, 1, vertexBufferViews);
-
-        // Bind texture
-        auto const& privateData = std::any_cast<TexturePrivate const&>(batchBegin->m_sprite.m_texture->m_privateData);
-
-        auto textureHandle = privateData.m_handle;
-        commandList.SetGraphicsRootDescriptorTable(1, m_textureManager->GetSrvPool().GetGpuHandle(textureHandle));
-        commandList.DrawInstanced(batchSize, 1, 0, 0);
-
-        batchBegin = batchEnd;
-        bufferOffset += batchSize;
+        commandList.DrawInstanced(batch.m_instanceCount, 1, batch.m_firstInstance, 0);
     }
 
     // Advance to next frame buffer
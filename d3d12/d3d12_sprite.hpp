@@ -7,6 +7,7 @@
 #include "../shaders/sprite.fxh"
 #include "../shaders/common.fxh"
 #include "../renderer.hpp"
+#include "../sprite_batch.hpp"
 #include "../storage.hpp"
 
 #include "d3d12_common.hpp"
@@ -33,7 +34,11 @@ namespace okami {
 		std::vector<PerFrameData> m_perFrameData;
 		int m_currentBuffer = 0;
 
-		static Expected<ComPtr<ID3D12RootSignature>> CreateRootSignature(ID3D12Device& device);
+		SpriteBatchBuilder m_batchBuilder;
+		// Samples textures by index from the whole SRV heap, one draw per layer
+		bool m_bindless = false;
+
+		static Expected<ComPtr<ID3D12RootSignature>> CreateRootSignature(ID3D12Device& device, bool bindless);
 
 		SpriteRenderer() = default;
 
@@ -55,13 +60,17 @@ namespace okami {
 			std::shared_ptr<TextureManager> manager,
             std::shared_ptr<DescriptorPool> samplerPool,
 			DirectX::RenderTargetState rts,
-			int bufferCount);
+			int bufferCount,
+			bool bindless = false);
 
+		// Also reports how large each sprite's texture is drawn when the
+		// texture manager streams, measured with view
 		Error Render(
 			ID3D12Device& device,
 			ID3D12GraphicsCommandList& commandList,
 			hlsl::Globals const& globals,
-			IStorageAccessor<Transform> const& transforms);
+			IStorageAccessor<Transform> const& transforms,
+			LodSelector const& view);
     };
 }
 
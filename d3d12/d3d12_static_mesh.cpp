@@ -9,6 +9,9 @@
 #include <unordered_set>
 
 #include <array>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "../paths.hpp"
 #include "d3d12_common.hpp"
@@ -57,8 +60,29 @@ Expected<std::shared_ptr<StaticMeshRenderer>> StaticMeshRenderer::Create(
     auto renderer = std::shared_ptr<StaticMeshRenderer>(new StaticMeshRenderer());
     renderer->m_manager = manager;
 
+    // Meshes are packed to the manager's layout before upload; the vertex
+    // shader has to match it
+    auto const& requirements = manager->GetRequirements();
+    auto staticLayout = requirements.find(MeshType::Static);
+    if (staticLayout == requirements.end()) {
+        return std::unexpected(Error("No vertex layout for static meshes"));
+    }
+    auto isEncoded = [&](AttributeEncoding encoding) {
+        return staticLayout->second.size() == kStaticMeshAttributes.size() &&
+            std::equal(kStaticMeshAttributes.begin(), kStaticMeshAttributes.end(), staticLayout->second.begin(),
+                [encoding](AttributeType type, AttributeRequirement const& req) {
+                    return req.m_type == type && req.m_encoding == encoding;
+                });
+    };
+    if (isEncoded(AttributeEncoding::Quantized)) {
+        renderer->m_quantized = true;
+    } else if (!isEncoded(AttributeEncoding::Float)) {
+        return std::unexpected(Error("Unsupported static mesh vertex layout"));
+    }
+
     // Load vertex shader
-    auto vertexShader = LoadShaderFromFile(GetShaderPath("static_mesh_vs.cso"));
+    auto vertexShader = LoadShaderFromFile(GetShaderPath(
+        renderer->m_quantized ? "static_mesh_quantized_vs.cso" : "static_mesh_vs.cso"));
     if (!vertexShader.has_value()) {
         return std::unexpected(vertexShader.error());
     }
@@ -78,7 +102,7 @@ Expected<std::shared_ptr<StaticMeshRenderer>> StaticMeshRenderer::Create(
 
     // Define the graphics pipeline state object description
     D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-    auto inputLayout = GetD3D12InputLayout(kStaticMeshAttributes);
+    auto inputLayout = GetD3D12InputLayout(staticLayout->second);
     psoDesc.InputLayout = { 
         inputLayout.data(), 
         static_cast<UINT>(inputLayout.size()) 
@@ -134,7 +158,8 @@ Error StaticMeshRenderer::Render(
     ID3D12Device& device,
     ID3D12GraphicsCommandList& commandList,
     hlsl::Globals const& globals,
-    IStorageAccessor<Transform> const& transforms) {
+    IStorageAccessor<Transform> const& transforms,
+    LodSelector const& lodSelector) {
     // Render static meshes
     auto staticMeshes = m_staticMeshStorage.GetStorage<StaticMeshComponent>();
 
@@ -172,12 +197,27 @@ Error StaticMeshRenderer::Render(
             continue; // Geometry not loaded yet
         }
 
+        // Swap in the level of detail before sorting so instances of the same
+        // level still batch together
+        auto component = staticMeshComponent;
+        component.m_meshIndex = lodSelector.Select(component.m_mesh->m_meshes, component.m_meshIndex, transform);
+
+        // Quantized positions are normalized to the mesh's bounds; undoing
+        // that is folded into the world matrix. Normals are unaffected.
+        auto inverseTranspose = glm::inverse(glm::transpose(worldMatrix));
+        if (m_quantized) {
+            auto const& aabb = component.m_mesh->m_meshes[component.m_meshIndex].m_aabb;
+            worldMatrix = worldMatrix *
+                glm::translate(glm::mat4(1.0f), aabb.m_min) *
+                glm::scale(glm::mat4(1.0f), aabb.m_max - aabb.m_min);
+        }
+
         instanceData.emplace_back(
             MeshInstanceData{
-            .m_component = staticMeshComponent,
+            .m_component = component,
             .m_instance = hlsl::Instance{
                 .m_worldMatrix = worldMatrix,
-                .m_worldInverseTransposeMatrix = glm::inverse(glm::transpose(worldMatrix))
+                .m_worldInverseTransposeMatrix = inverseTranspose
             }
         });
     }
@@ -222,6 +262,11 @@ Error StaticMeshRenderer::Render(
     commandList.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     commandList.SetGraphicsRootConstantBufferView(0, globalConstantsBuffer.GetGPUAddress());
 
+    // Geometry shares index pages, so the index buffer only changes when
+    // the page or index format does
+    ID3D12Resource* boundIndexPage = nullptr;
+    DXGI_FORMAT boundIndexFormat = DXGI_FORMAT_UNKNOWN;
+
     UINT firstInstance = 0;
     for (auto beginIt = instanceData.begin(); beginIt != instanceData.end();) {
         auto endIt = std::find_if(beginIt, instanceData.end(), [&beginIt](const auto& pair) {
@@ -238,9 +283,8 @@ Error StaticMeshRenderer::Render(
         std::array<D3D12_VERTEX_BUFFER_VIEW, kStaticMeshAttributes.size()> vertexBufferViews;
         for (int i = 0; i < vertexBufferViews.size(); ++i) {
             auto& meshAttrib = mesh.m_attributes[i];
-            auto& buffer = privateData.m_vertexBuffer;
             vertexBufferViews[i] = {};
-            vertexBufferViews[i].BufferLocation = buffer.GetGPUAddress() + meshAttrib.m_offset;
+            vertexBufferViews[i].BufferLocation = privateData.m_vertices.m_address + meshAttrib.m_offset;
             vertexBufferViews[i].SizeInBytes = static_cast<UINT>(mesh.m_vertexCount * meshAttrib.GetStride());
             vertexBufferViews[i].StrideInBytes = static_cast<UINT>(meshAttrib.GetStride());
         }
@@ -249,15 +293,24 @@ Error StaticMeshRenderer::Render(
             static_cast<UINT>(vertexBufferViews.size()),
             vertexBufferViews.data());
 
+        UINT startIndex = 0;
         if (mesh.HasIndexBuffer()) {
-            auto& buffer = *privateData.m_indexBuffer;
-            D3D12_INDEX_BUFFER_VIEW indexBuffer;
-            indexBuffer.BufferLocation = buffer.GetGPUAddress() + mesh.m_indices->m_offset;
-            indexBuffer.SizeInBytes = static_cast<UINT>(mesh.m_indices->m_count * mesh.m_indices->GetStride());
-            indexBuffer.Format = GetD3D12Format(AccessorType::Scalar, mesh.m_indices->m_type);
-
-            // Set index buffer
-            commandList.IASetIndexBuffer(&indexBuffer);
+            auto const& indices = *privateData.m_indices;
+            auto format = GetD3D12Format(AccessorType::Scalar, mesh.m_indices->m_type);
+            if (indices.m_resource != boundIndexPage || format != boundIndexFormat) {
+                D3D12_INDEX_BUFFER_VIEW indexBuffer;
+                indexBuffer.BufferLocation = indices.m_resource->GetGPUVirtualAddress();
+                indexBuffer.SizeInBytes = static_cast<UINT>(indices.m_resource->GetDesc().Width);
+                indexBuffer.Format = format;
+
+                // Set index buffer
+                commandList.IASetIndexBuffer(&indexBuffer);
+                boundIndexPage = indices.m_resource;
+                boundIndexFormat = format;
+            }
+            // Allocations are aligned to more than any index size
+            startIndex = static_cast<UINT>((indices.m_allocation.m_offset + mesh.m_indices->m_offset) /
+                mesh.m_indices->GetStride());
         }
 
         // Count instances of this mesh
@@ -269,7 +322,7 @@ Error StaticMeshRenderer::Render(
         // Draw with or without index buffer
         if (mesh.HasIndexBuffer()) {
             commandList.DrawIndexedInstanced(static_cast<UINT>(mesh.m_indices->m_count),
-                instanceCount, 0, 0, firstInstance);
+                instanceCount, startIndex, 0, firstInstance);
         } else {
             commandList.DrawInstanced(static_cast<UINT>(mesh.m_vertexCount), 
                 instanceCount, 0, firstInstance);
@@ -6,6 +6,7 @@
 
 #include "../renderer.hpp"
 #include "../storage.hpp"
+#include "../lod.hpp"
 
 #include "d3d12_common.hpp"
 #include "d3d12_upload.hpp"
@@ -31,6 +32,9 @@ namespace okami {
 
 		std::shared_ptr<GpuUploader> m_uploader;
 
+		// Vertices use AttributeEncoding::Quantized rather than floats
+		bool m_quantized = false;
+
 		static Expected<ComPtr<ID3D12RootSignature>> CreateRootSignature(ID3D12Device& device);
 
 		StaticMeshRenderer() = default;
@@ -58,7 +62,8 @@ namespace okami {
 			ID3D12Device& device,
 			ID3D12GraphicsCommandList& commandList,
 			hlsl::Globals const& globals,
-			IStorageAccessor<Transform> const& transforms);
+			IStorageAccessor<Transform> const& transforms,
+			LodSelector const& lodSelector);
 	};
 }
 
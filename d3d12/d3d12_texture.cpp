@@ -1,12 +1,95 @@
 #ifdef USE_D3D12
 
 #include "d3d12_texture.hpp"
+#include "../paths.hpp"
+#include "../texture_conversion.hpp"
 
 #include <glog/logging.h>
 #include <directx/d3dx12.h>
 
 using namespace okami;
 
+namespace {
+    // Creates a resource holding levels firstMip and coarser of texture and
+    // records their upload through uploadBuffer
+    Error CreateAndUpload(
+        ID3D12Device& device,
+        ID3D12GraphicsCommandList& commandList,
+        RawTexture const& texture,
+        uint32_t firstMip,
+        DXGI_FORMAT dxgiFormat,
+        TexturePrivate& privateData,
+        ComPtr<ID3D12Resource>& uploadBuffer) {
+        auto const& info = texture.GetInfo();
+        uint32_t mipLevels = info.mipLevels - firstMip;
+
+        // Create texture resource
+        D3D12_RESOURCE_DESC textureDesc = {};
+        textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        textureDesc.Alignment = 0;
+        textureDesc.Width = std::max(1u, info.width >> firstMip);
+        textureDesc.Height = std::max(1u, info.height >> firstMip);
+        textureDesc.DepthOrArraySize = 1;
+        textureDesc.MipLevels = mipLevels;
+        textureDesc.Format = dxgiFormat;
+        textureDesc.SampleDesc.Count = 1;
+        textureDesc.SampleDesc.Quality = 0;
+        textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+        auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        HRESULT hr = device.CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &textureDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(&privateData.m_resource));
+
+        if (FAILED(hr)) {
+            return Error("Failed to create texture resource");
+        }
+        privateData.m_resource->SetName(L"Okami Managed Texture Resource");
+
+        // Store texture properties
+        privateData.m_dxgiFormat = dxgiFormat;
+        privateData.m_residentMip = firstMip;
+
+        // Create upload buffer
+        const UINT64 uploadBufferSize = GetRequiredIntermediateSize(privateData.m_resource.Get(), 0, mipLevels);
+
+        heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+        auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
+        hr = device.CreateCommittedResource(
+            &heapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &resourceDesc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr,
+            IID_PPV_ARGS(&uploadBuffer));
+
+        if (FAILED(hr)) {
+            return Error("Failed to create texture upload buffer");
+        }
+        uploadBuffer->SetName(L"Okami Managed Texture Upload Buffer");
+
+        // Prepare subresource data, one per mip level
+        std::vector<D3D12_SUBRESOURCE_DATA> subresourceData(mipLevels);
+        for (uint32_t i = 0; i < mipLevels; ++i) {
+            uint32_t mip = firstMip + i;
+            auto mipData = texture.GetMipData(mip);
+            subresourceData[i].pData = mipData.data();
+            subresourceData[i].RowPitch = GetRowPitch(info.format, std::max(1u, info.width >> mip));
+            subresourceData[i].SlicePitch = subresourceData[i].RowPitch * GetRowCount(info.format, std::max(1u, info.height >> mip));
+        }
+
+        // Upload texture data
+        UpdateSubresources(&commandList, privateData.m_resource.Get(), uploadBuffer.Get(), 0, 0,
+            mipLevels, subresourceData.data());
+        return {};
+    }
+}
+
 DXGI_FORMAT TextureLoadTask::TextureFormatToDXGI(TextureFormat format) {
     switch (format) {
         case TextureFormat::R8:
@@ -14,7 +97,7 @@ DXGI_FORMAT TextureLoadTask::TextureFormatToDXGI(TextureFormat format) {
         case TextureFormat::RG8:
             return DXGI_FORMAT_R8G8_UNORM;
         case TextureFormat::RGB8:
-            return DXGI_FORMAT_R8G8B8A8_UNORM; // D3D12 doesn't support RGB8, use RGBA8
+            return DXGI_FORMAT_R8G8B8A8_UNORM; // D3D12 doesn't support RGB8, expanded to RGBA8 in Execute
         case TextureFormat::RGBA8:
             return DXGI_FORMAT_R8G8B8A8_UNORM;
         case TextureFormat::R32F:
@@ -25,21 +108,39 @@ DXGI_FORMAT TextureLoadTask::TextureFormatToDXGI(TextureFormat format) {
             return DXGI_FORMAT_R32G32B32_FLOAT;
         case TextureFormat::RGBA32F:
             return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        case TextureFormat::BC1:
+            return DXGI_FORMAT_BC1_UNORM;
+        case TextureFormat::BC3:
+            return DXGI_FORMAT_BC3_UNORM;
+        case TextureFormat::BC4:
+            return DXGI_FORMAT_BC4_UNORM;
+        case TextureFormat::BC5:
+            return DXGI_FORMAT_BC5_UNORM;
+        case TextureFormat::BC7:
+            return DXGI_FORMAT_BC7_UNORM;
+        case TextureFormat::R16F:
+            return DXGI_FORMAT_R16_FLOAT;
+        case TextureFormat::RG16F:
+            return DXGI_FORMAT_R16G16_FLOAT;
+        case TextureFormat::RGBA16F:
+            return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case TextureFormat::R11G11B10F:
+            return DXGI_FORMAT_R11G11B10_FLOAT;
+        case TextureFormat::RGB9E5:
+            return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
         default:
             return DXGI_FORMAT_UNKNOWN;
     }
 }
 
-uint32_t TextureLoadTask::GetBytesPerPixel(TextureFormat format) {
-    return GetPixelStride(format);
-}
-
 Error TextureLoadTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList& commandList) {
     std::optional<RawTexture> rawTexture;
 
-    if (m_path) {
+    if (m_decodeError.IsError()) {
+        return m_decodeError;
+    } else if (m_path) {
         // Load from file
-        auto result = RawTexture::FromPNG(*m_path);
+        auto result = RawTexture::Load(*m_path);
         if (!result.has_value()) {
             return result.error();
         }
@@ -51,90 +152,86 @@ Error TextureLoadTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList&
         return Error("No texture data provided");
     }
 
-    const auto& info = rawTexture->GetInfo();
-    auto textureData = rawTexture->GetData();
+    // There is no three channel 8 bit DXGI format
+    if (rawTexture->GetInfo().format == TextureFormat::RGB8) {
+        auto error = rawTexture->Convert(TextureFormat::RGBA8, PixelConversionParams{});
+        OKAMI_ERROR_RETURN(error);
+    }
+
+    // Streamed textures replace their resource as they stream, so they do not share one
+    std::optional<ContentHash> contentHash;
+    if (m_manager->IsContentDeduplicationEnabled() && !m_manager->IsStreaming()) {
+        contentHash = rawTexture->ComputeContentHash();
+        m_sharedWith = m_manager->FindByContent(*contentHash);
+        if (m_sharedWith) {
+            return {};
+        }
+    }
+
+    const auto info = rawTexture->GetInfo();
 
     // Convert texture format to DXGI format
     DXGI_FORMAT dxgiFormat = TextureFormatToDXGI(info.format);
     if (dxgiFormat == DXGI_FORMAT_UNKNOWN) {
         return Error("Unsupported texture format");
     }
-
-    // Create texture resource
-    D3D12_RESOURCE_DESC textureDesc = {};
-    textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    textureDesc.Alignment = 0;
-    textureDesc.Width = info.width;
-    textureDesc.Height = info.height;
-    textureDesc.DepthOrArraySize = 1;
-    textureDesc.MipLevels = info.mipLevels;
-    textureDesc.Format = dxgiFormat;
-    textureDesc.SampleDesc.Count = 1;
-    textureDesc.SampleDesc.Quality = 0;
-    textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-    textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-    TexturePrivate privateData;
-
-    auto heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-    HRESULT hr = device.CreateCommittedResource(
-        &heapProperties,
-        D3D12_HEAP_FLAG_NONE,
-        &textureDesc,
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&privateData.m_resource));
-
-    if (FAILED(hr)) {
-        return Error("Failed to create texture resource");
+    // Smaller mips are padded to whole blocks, but the base level must not be
+    if (IsBlockCompressed(info.format) && (info.width % 4 != 0 || info.height % 4 != 0)) {
+        return Error("Block compressed textures must be a multiple of 4 texels wide and high");
     }
-    privateData.m_resource->SetName(L"Okami Managed Texture Resource");
 
-    // Store texture properties
-    privateData.m_dxgiFormat = dxgiFormat;
+    // Streamed textures start with their tail; finer levels follow as
+    // usage asks for them
+    auto tailMip = m_manager->GetStreamingTailMip(info);
 
-    // Create upload buffer
-    const UINT64 uploadBufferSize = GetRequiredIntermediateSize(privateData.m_resource.Get(), 0, 1);
-
-    heapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-    auto resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
-    hr = device.CreateCommittedResource(
-        &heapProperties,
-        D3D12_HEAP_FLAG_NONE,
-        &resourceDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&m_uploadBuffer));
+    TexturePrivate privateData;
+    auto error = CreateAndUpload(device, commandList, *rawTexture, tailMip.value_or(0), dxgiFormat, privateData, m_uploadBuffer);
+    OKAMI_ERROR_RETURN(error);
 
-    if (FAILED(hr)) {
-        return Error("Failed to create texture upload buffer");
+    // The pixels now live in the upload buffer, though streamed textures
+    // keep them to upload finer levels from
+    if (tailMip) {
+        privateData.m_source = std::make_shared<RawTexture const>(std::move(*rawTexture));
     }
-    m_uploadBuffer->SetName(L"Okami Managed Texture Upload Buffer");
-
-    // Prepare subresource data
-    D3D12_SUBRESOURCE_DATA subresourceData = {};
-    subresourceData.pData = textureData.data();
-    subresourceData.RowPitch = info.width * GetBytesPerPixel(info.format);
-    subresourceData.SlicePitch = subresourceData.RowPitch * info.height;
-
-    // Upload texture data
-    UpdateSubresources(&commandList, privateData.m_resource.Get(), m_uploadBuffer.Get(), 0, 0, 1, &subresourceData);
+    rawTexture.reset();
+    m_lease.Reset();
 
     // Set resource data
     m_resource.m_info = info;
     m_resource.m_privateData = std::move(privateData);
 
+    if (contentHash) {
+        m_manager->RegisterContent(*contentHash, m_resourceId);
+    }
+
     return {};
 }
 
 Error TextureLoadTask::Finalize() {
+    if (IsLoadCancelled(GetError())) {
+        return m_manager->FinalizeCancelled(m_resourceId);
+    }
+    if (m_sharedWith && GetError().IsOk()) {
+        return m_manager->FinalizeShared(m_resourceId, *m_sharedWith);
+    }
     return m_manager->Finalize(m_resourceId, std::move(m_resource), GetError());
 }
 
+Error TextureStreamTask::Execute(ID3D12Device& device, ID3D12GraphicsCommandList& commandList) {
+    m_result.m_source = m_source;
+    return CreateAndUpload(device, commandList, *m_source, m_finestMip, m_dxgiFormat, m_result, m_uploadBuffer);
+}
+
+Error TextureStreamTask::Finalize() {
+    return m_manager->FinalizeStream(m_resourceId, std::move(m_result), GetError());
+}
+
 Expected<std::shared_ptr<TextureManager>> TextureManager::Create(
     ID3D12Device& device,
-    std::shared_ptr<GpuUploader> uploader) {
-    std::shared_ptr<TextureManager> manager = std::shared_ptr<TextureManager>(new TextureManager(uploader));
+    std::shared_ptr<GpuUploader> uploader,
+    TextureDecoderParams decoderParams,
+    ResourceCacheParams cacheParams) {
+    std::shared_ptr<TextureManager> manager = std::shared_ptr<TextureManager>(new TextureManager(uploader, decoderParams, cacheParams));
 
     auto pool = DescriptorPool::Create(
         &device,
@@ -178,25 +275,26 @@ Error TextureManager::TransitionTextures(ID3D12Device& device, ID3D12GraphicsCom
         barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
         barriers.push_back(barrier);
 
-        // Create shader resource view
-        auto handle = m_srvDescriptorPool.TryAlloc();
-
-        if (!handle) {
-            continue;
-        }
-
-        auto srvDesc = privateData.GetSRVDesc(texture->m_data.m_info);
-        device.CreateShaderResourceView(
-            privateData.m_resource.Get(),
-            &srvDesc,
-            m_srvDescriptorPool.GetCpuHandle(*handle));
-        privateData.m_handle = *handle;
+        CreateSRV(device, nextResourceId, *texture);
     }
 
     if (!barriers.empty()) {
         commandList.ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
     }
 
+    // Aliases were transitioned with the texture they share
+    while (!m_texturesNeedingViews.empty()) {
+        auto nextResourceId = m_texturesNeedingViews.front();
+        m_texturesNeedingViews.pop();
+
+        auto it = m_texturesById.find(nextResourceId);
+        if (it == m_texturesById.end()) {
+            LOG(WARNING) << "Texture with ID " << nextResourceId << " not found for view creation";
+            continue;
+        }
+        CreateSRV(device, nextResourceId, *it->second);
+    }
+
     // Regenerate all shader resource views
     auto newSize = m_sizer.GetNextSize(m_texturesById.size());
     if (newSize) {
@@ -222,28 +320,35 @@ Error TextureManager::RegenerateSRVs(ID3D12Device& device, uint32_t poolSize) {
 
     m_srvDescriptorPool = std::move(newPool.value());
 
+    // Views of retired resources went with the old pool
+    ++m_poolGeneration;
+
     for (auto it = m_texturesById.begin(); it != m_texturesById.end(); ++it) {
-        auto& texture = it->second;
+        CreateSRV(device, it->first, *it->second);
+    }
 
-        // Create shader resource view
-        auto handle = m_srvDescriptorPool.TryAlloc();
-        if (!handle) {
-            LOG(WARNING) << "Failed to allocate descriptor handle for texture " << it->first;
-            continue;
-        }
+    return {};
+}
 
-        auto& privateData = std::any_cast<TexturePrivate&>(texture->m_data.m_privateData);
+void TextureManager::CreateSRV(ID3D12Device& device, resource_id_t resourceId, Resource<Texture>& texture) {
+    auto* privateData = std::any_cast<TexturePrivate>(&texture.m_data.m_privateData);
+    if (!privateData) {
+        // Not loaded yet, or failed to load
+        return;
+    }
 
-        // Create SRV for the texture
-        auto srvDesc = privateData.GetSRVDesc(texture->m_data.m_info);
-        device.CreateShaderResourceView(
-            privateData.m_resource.Get(),
-            &srvDesc,
-            m_srvDescriptorPool.GetCpuHandle(*handle));
-        privateData.m_handle = *handle;
+    auto handle = m_srvDescriptorPool.TryAlloc();
+    if (!handle) {
+        LOG(WARNING) << "Failed to allocate descriptor handle for texture " << resourceId;
+        return;
     }
 
-    return {};
+    auto srvDesc = privateData->GetSRVDesc(texture.m_data.m_info);
+    device.CreateShaderResourceView(
+        privateData->m_resource.Get(),
+        &srvDesc,
+        m_srvDescriptorPool.GetCpuHandle(*handle));
+    privateData->m_handle = *handle;
 }
 
 D3D12_SHADER_RESOURCE_VIEW_DESC TexturePrivate::GetSRVDesc(TextureInfo const& info) const {
@@ -251,7 +356,7 @@ D3D12_SHADER_RESOURCE_VIEW_DESC TexturePrivate::GetSRVDesc(TextureInfo const& in
     srvDesc.Format = m_dxgiFormat;
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Texture2D.MipLevels = info.mipLevels;
+    srvDesc.Texture2D.MipLevels = info.mipLevels - m_residentMip;
     return srvDesc;
 }
 
@@ -279,40 +384,346 @@ Error TextureManager::Finalize(resource_id_t resourceId,
 
     if (!error.IsError()) {
         m_texturesToTransition.push(resourceId);
+
+        auto const& privateData = std::any_cast<TexturePrivate const&>(it->second->m_data.m_privateData);
+        auto const& info = it->second->m_data.m_info;
+        if (m_streamer && privateData.m_source) {
+            m_streamer->Add(resourceId, info, privateData.m_residentMip);
+            m_cache.Add(resourceId, GetStreamedBytes(info, privateData.m_residentMip));
+        } else {
+            m_cache.Add(resourceId, GetTextureSize(info));
+        }
+    } else {
+        m_cache.Add(resourceId, 0);
+    }
+
+    it->second->m_loaded.store(true);
+    CompleteLoad(resourceId, error);
+
+    return {};
+}
+
+Error TextureManager::FinalizeStream(resource_id_t resourceId,
+    TexturePrivate data,
+    Error error) {
+    auto it = m_texturesById.find(resourceId);
+    auto* privateData = it != m_texturesById.end() ?
+        std::any_cast<TexturePrivate>(&it->second->m_data.m_privateData) : nullptr;
+    if (!privateData) {
+        // Collected while the task ran
+        m_streamer->OnStreamed(resourceId, false);
+        return {};
+    }
+    if (error.IsError()) {
+        LOG(WARNING) << "Failed to stream texture " << resourceId << ": " << error.Str();
+        m_streamer->OnStreamed(resourceId, false);
+        return {};
+    }
+
+    // Frames in flight may still sample the old resource through its view
+    m_retired.Push(RetiredTexture{
+        .m_resource = std::move(privateData->m_resource),
+        .m_handle = privateData->m_handle,
+        .m_poolGeneration = m_poolGeneration }, m_submittedFrame);
+    *privateData = std::move(data);
+    m_texturesToTransition.push(resourceId);
+    m_cache.SetBytes(resourceId, GetStreamedBytes(it->second->m_data.m_info, privateData->m_residentMip));
+
+    m_streamer->OnStreamed(resourceId, true);
+    return {};
+}
+
+void TextureManager::EnableStreaming(TextureStreamingParams params) {
+    m_streamer.emplace(params);
+}
+
+void TextureManager::Collect(uint64_t submittedFrame, uint64_t completedFrame) {
+    m_submittedFrame = submittedFrame;
+    m_retired.Release(completedFrame, [this](RetiredTexture& retired) {
+        if (retired.m_handle && retired.m_poolGeneration == m_poolGeneration) {
+            m_srvDescriptorPool.Free(*retired.m_handle);
+        }
+    });
+
+    // Held throughout so load tasks cannot start sharing an evicted texture
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    for (auto const& [id, texture] : m_texturesById) {
+        m_cache.SetReferenced(id,
+            texture->m_refCount.load(std::memory_order_relaxed) > 0 || m_pendingShares.contains(id));
+    }
+
+    m_evicted.clear();
+    m_cache.Collect(m_evicted);
+    for (auto id : m_evicted) {
+        Destroy(id);
+    }
+}
+
+void TextureManager::Destroy(resource_id_t resourceId) {
+    auto it = m_texturesById.find(resourceId);
+    if (it == m_texturesById.end()) {
+        return;
+    }
+    auto& texture = *it->second;
+
+    // Aliases hold a reference to the shared resource, which lives on until
+    // the last of them is retired
+    if (auto* privateData = std::any_cast<TexturePrivate>(&texture.m_data.m_privateData)) {
+        m_retired.Push(RetiredTexture{
+            .m_resource = std::move(privateData->m_resource),
+            .m_handle = privateData->m_handle,
+            .m_poolGeneration = m_poolGeneration }, m_submittedFrame);
+    }
+    if (m_streamer) {
+        m_streamer->Remove(resourceId);
+    }
+
+    if (auto contentIt = m_idsToContent.find(resourceId); contentIt != m_idsToContent.end()) {
+        m_contentToIds.erase(contentIt->second);
+        m_idsToContent.erase(contentIt);
+    }
+    if (!texture.m_path.empty()) {
+        auto pathIt = m_texturePathsToIds.find(NormalizePath(texture.m_path));
+        if (pathIt != m_texturePathsToIds.end() && pathIt->second == resourceId) {
+            m_texturePathsToIds.erase(pathIt);
+        }
+    }
+    m_texturesById.erase(it);
+}
+
+std::optional<uint32_t> TextureManager::GetStreamingTailMip(TextureInfo const& info) const {
+    if (!m_streamer || info.type != TextureType::TEXTURE_2D) {
+        return std::nullopt;
+    }
+
+    uint32_t tailMip = okami::GetStreamingTailMip(info, m_streamer->GetParams().m_tailSize);
+    // Block compressed resources must be whole blocks at their largest level
+    if (IsBlockCompressed(info.format)) {
+        uint32_t aligned = 0;
+        while (aligned < tailMip &&
+            (info.width >> (aligned + 1)) % 4 == 0 &&
+            (info.height >> (aligned + 1)) % 4 == 0) {
+            ++aligned;
+        }
+        tailMip = aligned;
+    }
+
+    if (tailMip == 0) {
+        return std::nullopt;
+    }
+    return tailMip;
+}
+
+void TextureManager::ReportUsage(resource_id_t resourceId, glm::vec2 projectedSize) {
+    if (m_streamer) {
+        m_streamer->ReportUsage(resourceId, projectedSize);
+    }
+}
+
+void TextureManager::UpdateStreaming() {
+    if (!m_streamer) {
+        return;
+    }
+
+    m_streamer->Update(m_streamRequests);
+    for (auto const& request : m_streamRequests) {
+        auto it = m_texturesById.find(request.m_texture);
+        auto* privateData = it != m_texturesById.end() ?
+            std::any_cast<TexturePrivate>(&it->second->m_data.m_privateData) : nullptr;
+        if (!privateData || !privateData->m_source) {
+            m_streamer->OnStreamed(request.m_texture, false);
+            continue;
+        }
+        m_uploader->SubmitTask(
+            std::make_unique<TextureStreamTask>(
+                request.m_texture,
+                request.m_finestMip,
+                privateData->m_source,
+                privateData->m_dxgiFormat,
+                this));
+    }
+}
+
+std::optional<resource_id_t> TextureManager::FindByContent(ContentHash const& hash) {
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    if (auto it = m_contentToIds.find(hash); it != m_contentToIds.end()) {
+        // Kept alive until the alias is finalized
+        m_pendingShares[it->second]++;
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+void TextureManager::RegisterContent(ContentHash const& hash, resource_id_t resourceId) {
+    std::lock_guard<std::mutex> lock(m_contentMutex);
+    if (m_contentToIds.try_emplace(hash, resourceId).second) {
+        m_idsToContent.emplace(resourceId, hash);
+    }
+}
+
+Error TextureManager::FinalizeShared(resource_id_t resourceId, resource_id_t sharedId) {
+    {
+        std::lock_guard<std::mutex> lock(m_contentMutex);
+        if (--m_pendingShares[sharedId] <= 0) {
+            m_pendingShares.erase(sharedId);
+        }
+    }
+
+    auto it = m_texturesById.find(resourceId);
+    if (it == m_texturesById.end()) {
+        return Error("Texture not found");
+    }
+
+    // Tasks finalize in the order they executed, so the shared texture is
+    // already final. The alias gets its own view of the same resource.
+    Error error;
+    auto sharedIt = m_texturesById.find(sharedId);
+    if (sharedIt != m_texturesById.end() && sharedIt->second->m_data.m_privateData.has_value()) {
+        it->second->m_data = sharedIt->second->m_data;
+        m_texturesNeedingViews.push(resourceId);
+    } else {
+        LOG(WARNING) << "Texture " << resourceId << " shares content with " << sharedId << ", which failed to load";
+        error = Error("Shared texture failed to load");
     }
 
+    // The resource's bytes count against the texture it shares
+    m_cache.Add(resourceId, 0);
     it->second->m_loaded.store(true);
+    CompleteLoad(resourceId, error);
+    return {};
+}
+
+Error TextureManager::FinalizeCancelled(resource_id_t resourceId) {
+    auto it = m_texturesById.find(resourceId);
+    if (it == m_texturesById.end()) {
+        return Error("Texture not found");
+    }
+    auto& texture = *it->second;
+
+    auto pendingIt = m_pendingLoads.find(resourceId);
+    if (texture.m_refCount.load(std::memory_order_relaxed) > 0) {
+        // Requested again after the load was cancelled
+        if (pendingIt != m_pendingLoads.end()) {
+            SubmitLoad(texture, pendingIt->second);
+            return {};
+        }
+        // Created textures have nothing left to load from
+        return Finalize(resourceId, Texture{}, LoadCancelledError());
+    }
 
+    // Forgotten before the callbacks run, so they may load the path afresh
+    std::vector<LoadCallback<Texture>> callbacks;
+    if (pendingIt != m_pendingLoads.end()) {
+        callbacks = std::move(pendingIt->second.m_callbacks);
+        m_pendingLoads.erase(pendingIt);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_contentMutex);
+        Destroy(resourceId);
+    }
+    for (auto& callback : callbacks) {
+        callback(ResHandle<Texture>(), LoadCancelledError());
+    }
     return {};
 }
 
-ResHandle<Texture> TextureManager::Load(std::string_view path) {
-    // Find existing texture if already loaded
-    if (auto it = m_texturePathsToIds.find(path); it != m_texturePathsToIds.end()) {
+void TextureManager::CompleteLoad(resource_id_t resourceId, Error const& error) {
+    auto pendingIt = m_pendingLoads.find(resourceId);
+    if (pendingIt == m_pendingLoads.end()) {
+        return;
+    }
+    auto callbacks = std::move(pendingIt->second.m_callbacks);
+    m_pendingLoads.erase(pendingIt);
+
+    if (auto it = m_texturesById.find(resourceId); it != m_texturesById.end()) {
+        ResHandle<Texture> handle(it->second.get());
+        for (auto& callback : callbacks) {
+            callback(handle, error);
+        }
+    }
+}
+
+void TextureManager::SubmitLoad(Resource<Texture>& texture, PendingLoad const& pending) {
+    void const* key = &texture;
+    auto const* refCount = &texture.m_refCount;
+    m_decoder.Submit(std::filesystem::path(texture.m_path),
+        [this, resourceId = texture.m_id, key, refCount, priority = pending.m_priority](
+            Expected<RawTexture> decoded, TextureDecodeLease lease) {
+            auto submitted = priority->load();
+            m_uploader->SubmitTask(
+                std::make_unique<TextureLoadTask>(
+                    std::move(decoded),
+                    std::move(lease),
+                    resourceId,
+                    this,
+                    refCount),
+                submitted,
+                key);
+            // Raised while the texture was decoding
+            if (auto latest = priority->load(); latest != submitted) {
+                m_uploader->Reprioritize(key, latest);
+            }
+        },
+        pending.m_priority->load(),
+        key,
+        [refCount]() { return refCount->load(std::memory_order_relaxed) > 0; });
+}
+
+void TextureManager::Reprioritize(Resource<Texture> const& texture, PendingLoad& pending, LoadPriority priority) {
+    if (priority >= pending.m_priority->load()) {
+        return;
+    }
+    // Stored first, so a decode finishing meanwhile uploads at the new priority
+    pending.m_priority->store(priority);
+    m_decoder.Reprioritize(&texture, priority);
+    m_uploader->Reprioritize(&texture, priority);
+}
+
+ResHandle<Texture> TextureManager::Load(std::string_view path, LoadParams<Texture> params) {
+    auto normalizedPath = NormalizePath(path);
+
+    // Find existing texture if already loaded or loading
+    if (auto it = m_texturePathsToIds.find(normalizedPath); it != m_texturePathsToIds.end()) {
         auto resourceId = it->second;
         auto textureIt = m_texturesById.find(resourceId);
         if (textureIt != m_texturesById.end()) {
-            return textureIt->second.get();
+            auto& texture = *textureIt->second;
+            ResHandle<Texture> handle(&texture);
+            if (auto pendingIt = m_pendingLoads.find(resourceId); pendingIt != m_pendingLoads.end()) {
+                Reprioritize(texture, pendingIt->second, params.m_priority);
+                if (params.m_onLoaded) {
+                    pendingIt->second.m_callbacks.push_back(std::move(params.m_onLoaded));
+                }
+            } else if (params.m_onLoaded) {
+                params.m_onLoaded(handle, texture.m_data.m_privateData.has_value() ?
+                    Error() : Error("Texture failed to load"));
+            }
+            return handle;
         }
     }
 
     auto [resourceId, handle] = NewResource(path);
-    m_uploader->SubmitTask(
-        std::make_unique<TextureLoadTask>(
-            std::filesystem::path(path),
-            resourceId,
-            this));
-    m_texturePathsToIds.emplace(path, resourceId);
+    auto& pending = m_pendingLoads[resourceId];
+    pending.m_priority = std::make_shared<std::atomic<LoadPriority>>(params.m_priority);
+    if (params.m_onLoaded) {
+        pending.m_callbacks.push_back(std::move(params.m_onLoaded));
+    }
+    SubmitLoad(*handle.Ptr(), pending);
+    m_texturePathsToIds.emplace(std::move(normalizedPath), resourceId);
     return handle;
 }
 
 ResHandle<Texture> TextureManager::Create(typename Texture::CreationData&& data) {
     auto [resourceId, handle] = NewResource();
+    // Nothing to read, so these go ahead of loads from files
     m_uploader->SubmitTask(
         std::make_unique<TextureLoadTask>(
             std::move(data),
             resourceId,
-            this));
+            this,
+            &handle.Ptr()->m_refCount),
+        LoadPriority::Immediate,
+        handle.Ptr());
     return handle;
 }
 
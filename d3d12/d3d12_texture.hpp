@@ -5,6 +5,10 @@
 #include "../renderer.hpp"
 #include "../storage.hpp"
 #include "../texture.hpp"
+#include "../hash.hpp"
+#include "../resource_cache.hpp"
+#include "../texture_decoder.hpp"
+#include "../texture_streaming.hpp"
 
 #include "d3d12_common.hpp"
 #include "d3d12_upload.hpp"
@@ -17,6 +21,10 @@ namespace okami {
         ComPtr<ID3D12Resource> m_resource;
         DescriptorPool::Handle m_handle;
         DXGI_FORMAT m_dxgiFormat = DXGI_FORMAT_UNKNOWN;
+        // Finest level the resource holds, as its own level 0
+        uint32_t m_residentMip = 0;
+        // Pixels finer levels stream from; null unless the texture streams
+        std::shared_ptr<RawTexture const> m_source;
 
         D3D12_SHADER_RESOURCE_VIEW_DESC GetSRVDesc(TextureInfo const& info) const;
     };
@@ -25,9 +33,20 @@ namespace okami {
     private:
         std::optional<std::filesystem::path> m_path;
         std::optional<RawTexture> m_initData;
+        // Set when the texture failed to decode before reaching the task
+        Error m_decodeError;
+        // Budget held by pixels decoded off the uploader thread, returned
+        // once they are copied to the upload buffer
+        TextureDecodeLease m_lease;
         resource_id_t m_resourceId;
         TextureManager* m_manager = nullptr;
+        // References to the texture; the load is cancelled if they are all
+        // released before it runs
+        std::atomic<int> const* m_refCount = nullptr;
         Texture m_resource;
+        // Set when an identical texture was already uploaded; nothing is
+        // uploaded and the resource aliases that texture
+        std::optional<resource_id_t> m_sharedWith;
 
         // Temporary upload buffers
         // These will be released after the GPU upload is complete
@@ -43,15 +62,63 @@ namespace okami {
         inline TextureLoadTask(
             RawTexture initData,
             resource_id_t resourceId,
-            TextureManager* manager) :
-            m_initData(std::move(initData)), m_resourceId(resourceId), m_manager(manager) {}
+            TextureManager* manager,
+            std::atomic<int> const* refCount = nullptr) :
+            m_initData(std::move(initData)), m_resourceId(resourceId), m_manager(manager), m_refCount(refCount) {}
+
+        inline TextureLoadTask(
+            Expected<RawTexture> decoded,
+            TextureDecodeLease lease,
+            resource_id_t resourceId,
+            TextureManager* manager,
+            std::atomic<int> const* refCount = nullptr) :
+            m_lease(std::move(lease)), m_resourceId(resourceId), m_manager(manager), m_refCount(refCount) {
+            if (decoded) {
+                m_initData = std::move(decoded.value());
+            } else {
+                m_decodeError = decoded.error();
+            }
+        }
 
         Error Execute(ID3D12Device& device, ID3D12GraphicsCommandList& commandList) override;
         Error Finalize() override;
 
+        inline bool IsWanted() const override {
+            return !m_refCount || m_refCount->load(std::memory_order_relaxed) > 0;
+        }
+
     private:
         DXGI_FORMAT TextureFormatToDXGI(TextureFormat format);
-        uint32_t GetBytesPerPixel(TextureFormat format);
+    };
+
+    // Replaces a streamed texture's resource with one holding levels
+    // m_finestMip and coarser
+    struct TextureStreamTask final : public GpuUploaderTask {
+    private:
+        resource_id_t m_resourceId;
+        uint32_t m_finestMip;
+        std::shared_ptr<RawTexture const> m_source;
+        DXGI_FORMAT m_dxgiFormat;
+        TextureManager* m_manager = nullptr;
+        TexturePrivate m_result;
+
+        ComPtr<ID3D12Resource> m_uploadBuffer;
+
+    public:
+        inline TextureStreamTask(
+            resource_id_t resourceId,
+            uint32_t finestMip,
+            std::shared_ptr<RawTexture const> source,
+            DXGI_FORMAT dxgiFormat,
+            TextureManager* manager) :
+            m_resourceId(resourceId),
+            m_finestMip(finestMip),
+            m_source(std::move(source)),
+            m_dxgiFormat(dxgiFormat),
+            m_manager(manager) {}
+
+        Error Execute(ID3D12Device& device, ID3D12GraphicsCommandList& commandList) override;
+        Error Finalize() override;
     };
 
     class TextureManager : public IResourceManager<Texture> {
@@ -60,16 +127,75 @@ namespace okami {
         std::unordered_map<resource_id_t, std::unique_ptr<Resource<Texture>>> m_texturesById;
 
         std::queue<resource_id_t> m_texturesToTransition;
+        // Textures aliasing another texture's resource only need a view
+        std::queue<resource_id_t> m_texturesNeedingViews;
         std::atomic<resource_id_t> m_nextResourceId{0};
 
         std::shared_ptr<GpuUploader> m_uploader;
        
         DescriptorPool m_srvDescriptorPool;
         Sizer m_sizer;
+
+        // Content hashes of uploaded textures, written and read by load tasks
+        std::mutex m_contentMutex;
+        std::unordered_map<ContentHash, resource_id_t> m_contentToIds;
+        std::unordered_map<resource_id_t, ContentHash> m_idsToContent;
+        // Textures load tasks found to share, until the alias is finalized
+        std::unordered_map<resource_id_t, int> m_pendingShares;
+        std::atomic<bool> m_deduplicate{true};
+
+        // Destroyed or replaced resources and their views, kept until the
+        // frames that may still sample them have finished
+        struct RetiredTexture {
+            ComPtr<ID3D12Resource> m_resource;
+            std::optional<DescriptorPool::Handle> m_handle;
+            // Handles of an older pool went with it, see RegenerateSRVs
+            uint32_t m_poolGeneration;
+        };
+
+        ResourceCache m_cache;
+        DeferredReleaseQueue<RetiredTexture> m_retired;
+        std::vector<resource_id_t> m_evicted;
+        uint32_t m_poolGeneration = 0;
+        // Last frame submitted to the GPU, see Collect
+        uint64_t m_submittedFrame = 0;
+
+        // Set by EnableStreaming, before any texture loads
+        std::optional<TextureStreamer> m_streamer;
+        std::vector<TextureStreamRequest> m_streamRequests;
+
+        // Loads from files not finalized yet
+        struct PendingLoad {
+            // Shared with decode callbacks, which submit the upload at the
+            // latest priority
+            std::shared_ptr<std::atomic<LoadPriority>> m_priority;
+            std::vector<LoadCallback<Texture>> m_callbacks;
+        };
+        std::unordered_map<resource_id_t, PendingLoad> m_pendingLoads;
     
         static constexpr size_t kMinPoolSize = 128;
 
-        inline TextureManager(std::shared_ptr<GpuUploader> uploader) : m_uploader(std::move(uploader)) {}
+        // Reads and decodes files on worker threads; the uploader thread only
+        // records copies. Declared last so it stops before anything its
+        // callbacks use is destroyed.
+        TextureDecoder m_decoder;
+
+        inline TextureManager(
+            std::shared_ptr<GpuUploader> uploader,
+            TextureDecoderParams decoderParams,
+            ResourceCacheParams cacheParams) :
+            m_uploader(std::move(uploader)), m_cache(cacheParams), m_decoder(decoderParams) {}
+
+        void CreateSRV(ID3D12Device& device, resource_id_t resourceId, Resource<Texture>& texture);
+        // Retires the texture's resource and forgets it; m_contentMutex must be held
+        void Destroy(resource_id_t resourceId);
+
+        // Decodes, then uploads, a texture from its path
+        void SubmitLoad(Resource<Texture>& texture, PendingLoad const& pending);
+        // Moves a pending load up wherever it waits
+        void Reprioritize(Resource<Texture> const& texture, PendingLoad& pending, LoadPriority priority);
+        // Hands the outcome of a finalized load to its callbacks
+        void CompleteLoad(resource_id_t resourceId, Error const& error);
 
     public:
         OKAMI_NO_COPY(TextureManager);
@@ -77,7 +203,9 @@ namespace okami {
 
         static Expected<std::shared_ptr<TextureManager>> Create(
             ID3D12Device& device,
-            std::shared_ptr<GpuUploader> uploader
+            std::shared_ptr<GpuUploader> uploader,
+            TextureDecoderParams decoderParams = {},
+            ResourceCacheParams cacheParams = {}
         );
 
         inline void Register(InterfaceCollection& queryable) {
@@ -96,6 +224,41 @@ namespace okami {
             return m_srvDescriptorPool;
         }
 
+        // When enabled, textures whose content matches an earlier upload
+        // share its GPU resource instead of being uploaded again
+        inline void SetContentDeduplication(bool enabled) {
+            m_deduplicate.store(enabled);
+        }
+
+        inline bool IsContentDeduplicationEnabled() const {
+            return m_deduplicate.load();
+        }
+
+        // Streams the mip levels of textures loaded from now on, see
+        // TextureStreamer
+        void EnableStreaming(TextureStreamingParams params);
+
+        inline bool IsStreaming() const {
+            return m_streamer.has_value();
+        }
+
+        inline std::optional<TextureStreamingStats> GetStreamingStats() const {
+            return m_streamer ? std::optional(m_streamer->GetStats()) : std::nullopt;
+        }
+
+        // Finest level a texture loads with when streaming; none when it
+        // loads whole
+        std::optional<uint32_t> GetStreamingTailMip(TextureInfo const& info) const;
+
+        // How large a texture is drawn this frame, see TextureStreamer::ReportUsage
+        void ReportUsage(resource_id_t resourceId, glm::vec2 projectedSize);
+        // Submits the levels this frame's usage asked for. Once per frame,
+        // after rendering.
+        void UpdateStreaming();
+
+        std::optional<resource_id_t> FindByContent(ContentHash const& hash);
+        void RegisterContent(ContentHash const& hash, resource_id_t resourceId);
+
         std::pair<resource_id_t, ResHandle<Texture>> NewResource(
             std::optional<std::string_view> path = std::nullopt);
 
@@ -103,10 +266,37 @@ namespace okami {
             resource_id_t resourceId,
             Texture data,
             Error error);
+        // Swaps in a streamed texture's new resource
+        Error FinalizeStream(
+            resource_id_t resourceId,
+            TexturePrivate data,
+            Error error);
+        // Finalizes a resource as an alias of an already finalized one
+        Error FinalizeShared(
+            resource_id_t resourceId,
+            resource_id_t sharedId);
+        // Forgets a texture whose load was cancelled, or loads it again if
+        // it was requested since
+        Error FinalizeCancelled(resource_id_t resourceId);
 
-        ResHandle<Texture> Load(std::string_view path) override;
+        using IResourceManager<Texture>::Load;
+        ResHandle<Texture> Load(std::string_view path, LoadParams<Texture> params) override;
         ResHandle<Texture> Create(typename Texture::CreationData&& data) override;
 
+        // Files waiting to be read; uploads wait in the uploader's queue
+        inline LoadQueueStats GetDecodeQueueStats() const {
+            return m_decoder.GetQueueStats();
+        }
+
+        inline ResourceCacheStats const& GetCacheStats() const {
+            return m_cache.GetStats();
+        }
+
+        // Destroys textures nothing has referenced for longer than the cache
+        // keeps them, and releases resources retired by frames up to
+        // completedFrame. Once per frame, after submitting submittedFrame.
+        void Collect(uint64_t submittedFrame, uint64_t completedFrame);
+
         Error RegenerateSRVs(ID3D12Device& device, uint32_t poolSize);
         Error TransitionTextures(ID3D12Device& device, ID3D12GraphicsCommandList& commandList);
     };
@@ -33,7 +33,9 @@ struct GpuUploaderImpl {
     std::atomic<UINT64> m_currentWriteIndex{0};
     std::atomic<UINT64> m_currentReadIndex{0};
 
-    moodycamel::ConcurrentQueue<std::unique_ptr<GpuUploaderTask>> m_taskQueue;
+    // Guarded by m_taskMutex
+    LoadQueue<std::unique_ptr<GpuUploaderTask>, void const*> m_taskQueue;
+    std::vector<std::unique_ptr<GpuUploaderTask>> m_cancelledTasks;
     moodycamel::ConcurrentQueue<std::unique_ptr<GpuUploaderTask>> m_tasksNeedFinalize;
     std::queue<std::unique_ptr<GpuUploaderTask>> m_tasksOnGpu;
 
@@ -105,6 +107,26 @@ struct GpuUploaderImpl {
         return std::nullopt;
     }
 
+    // Pops the most urgent wanted task; unwanted ones on the way go
+    // straight to finalization
+    std::unique_ptr<GpuUploaderTask> TryPopTask(UINT64 fenceValue) {
+        std::optional<std::unique_ptr<GpuUploaderTask>> task;
+        {
+            std::lock_guard<std::mutex> lock(m_taskMutex);
+            task = m_taskQueue.Pop([](std::unique_ptr<GpuUploaderTask> const& queued) {
+                return queued->IsWanted();
+            }, m_cancelledTasks);
+        }
+
+        for (auto& cancelled : m_cancelledTasks) {
+            cancelled->m_fenceValue = fenceValue;
+            cancelled->m_result = LoadCancelledError();
+            m_tasksNeedFinalize.enqueue(std::move(cancelled));
+        }
+        m_cancelledTasks.clear();
+        return task ? std::move(*task) : nullptr;
+    }
+
     void ReleaseLock(GpuUploaderCommandListLock& lock) {
         ++m_currentReadIndex;
         Kick();
@@ -140,16 +162,14 @@ struct GpuUploaderImpl {
             batch.m_commandList->Reset(batch.m_commandAllocator.Get(), nullptr);
 
             while (m_shouldExit.load() == false) {
-                // Wait for a task to be available using condition variable
-                std::unique_ptr<GpuUploaderTask> task;
-                
                 // Try to get a task without blocking first
-                if (!m_taskQueue.try_dequeue(task)) {
+                auto task = TryPopTask(fenceValue);
+                if (!task) {
                     // No task available, wait for notification
                     std::unique_lock<std::mutex> lock(m_taskMutex);
                     m_taskCondition.wait(lock, [this, &shouldMoveToNextBatch] {
                         std::unique_ptr<GpuUploaderTask> tempTask;
-                        return m_shouldExit.load() || m_taskQueue.size_approx() > 0 || shouldMoveToNextBatch();
+                        return m_shouldExit.load() || !m_taskQueue.IsEmpty() || shouldMoveToNextBatch();
                     });
 
                     // If we should move to the next batch, break out
@@ -166,7 +186,9 @@ struct GpuUploaderImpl {
                     }
                     
                     // Try to dequeue again after waking up
-                    if (!m_taskQueue.try_dequeue(task)) {
+                    lock.unlock();
+                    task = TryPopTask(fenceValue);
+                    if (!task) {
                         continue;
                     }
                 }
@@ -206,10 +228,23 @@ struct GpuUploaderImpl {
         m_taskCondition.notify_one();
     }
 
-    void SubmitTask(std::unique_ptr<GpuUploaderTask> task) {
+    void SubmitTask(std::unique_ptr<GpuUploaderTask> task, LoadPriority priority, void const* key) {
         // Enqueue the task for processing
-        m_taskQueue.enqueue(std::move(task));
-        Kick();
+        {
+            std::lock_guard<std::mutex> lock(m_taskMutex);
+            m_taskQueue.Push(std::move(task), priority, key ? std::optional(key) : std::nullopt);
+        }
+        m_taskCondition.notify_one();
+    }
+
+    void Reprioritize(void const* key, LoadPriority priority) {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        m_taskQueue.Reprioritize(key, priority);
+    }
+
+    LoadQueueStats GetQueueStats() {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        return m_taskQueue.GetStats();
     }
 
     void Stop() {
@@ -274,8 +309,16 @@ size_t GpuUploader::FetchAndFinalizeTasks() {
     return m_impl->FetchAndFinalizeTasks();
 }
 
-void GpuUploader::SubmitTask(std::unique_ptr<GpuUploaderTask> task) {
-    m_impl->SubmitTask(std::move(task));
+void GpuUploader::SubmitTask(std::unique_ptr<GpuUploaderTask> task, LoadPriority priority, void const* key) {
+    m_impl->SubmitTask(std::move(task), priority, key);
+}
+
+void GpuUploader::Reprioritize(void const* key, LoadPriority priority) {
+    m_impl->Reprioritize(key, priority);
+}
+
+LoadQueueStats GpuUploader::GetQueueStats() {
+    return m_impl->GetQueueStats();
 }
 
 void GpuUploader::Stop() {
@@ -9,6 +9,7 @@
 #include <chrono>
 
 #include "../common.hpp"
+#include "../load_queue.hpp"
 #include "d3d12_common.hpp"
 
 namespace okami {
@@ -24,6 +25,12 @@ namespace okami {
         // Called on main thread after task has completed uploading to GPU
         virtual Error Finalize() = 0;
 
+        // Called on I/O thread before Execute. Tasks nothing wants any more
+        // are finalized without executing, with LoadCancelledError.
+        virtual bool IsWanted() const {
+            return true;
+        }
+
         inline Error GetError() const {
             return m_result;
         }
@@ -93,8 +100,18 @@ namespace okami {
 
         void Stop();
 
-        // Submits a task to the GPU uploader queue.
-        void SubmitTask(std::unique_ptr<GpuUploaderTask> task);
+        // Submits a task to the GPU uploader queue. Tasks execute most
+        // urgent first; a key, such as the resource being loaded, lets the
+        // task be reprioritized while it waits.
+        void SubmitTask(
+            std::unique_ptr<GpuUploaderTask> task,
+            LoadPriority priority = LoadPriority::Visible,
+            void const* key = nullptr);
+
+        // Moves a waiting task to a more urgent priority
+        void Reprioritize(void const* key, LoadPriority priority);
+
+        LoadQueueStats GetQueueStats();
 
         // Gets a command list that is ready to be executed.
         std::optional<GpuUploaderCommandListLock> GetExecutableCommandListIfAny();
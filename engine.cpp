@@ -89,7 +89,7 @@ void Engine::UploadResources() {
 
 std::filesystem::path Engine::GetRenderOutputPath(size_t frameIndex) {
 	return std::filesystem::path("renders/") /
-		(std::string{m_params.m_headlessOutputFileStem} + "_" + std::to_string(frameIndex) + ".png");
+		(std::string{m_params.m_headlessOutputFileStem} + "_" + std::to_string(frameIndex) + std::string{m_params.m_headlessOutputExtension});
 }
 
 void Engine::Run(std::optional<size_t> runFrameCount) {
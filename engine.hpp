@@ -14,6 +14,8 @@
 #include <string>
 #include <filesystem>
 #include <atomic>
+#include <memory>
+#include <span>
 
 #include "entity_tree.hpp"
 #include "common.hpp"
@@ -114,6 +116,29 @@ namespace okami {
 		entity_t m_entity;
 	};
 
+	// Components for many entities at once, m_components[i] going to m_entities[i]
+	template <typename T>
+	struct ComponentBatch {
+		std::vector<entity_t> m_entities;
+		std::vector<T> m_components;
+	};
+
+	// One signal per batch instead of one per component. The batch is shared
+	// so that handing the signal to several handlers does not copy it.
+	template <typename T>
+	struct ComponentAddBatchSignal {
+		std::shared_ptr<ComponentBatch<T> const> m_batch;
+	};
+
+	// Makes count copies of a component when a subtree is cloned. Components
+	// holding ResHandles specialize this to take all references at once.
+	template <typename T>
+	struct ComponentCloner {
+		static void Clone(T const& source, size_t count, std::vector<T>& copies) {
+			copies.insert(copies.end(), count, source);
+		}
+	};
+
 	class ISignalBus {
 	public:
 		virtual void Publish(const std::type_info& eventType, std::any event) const = 0;
@@ -128,6 +153,13 @@ namespace okami {
 			Publish(ComponentAddSignal<T>{ e, std::move(component) });
 		}
 
+		template <typename T>
+		void AddComponents(std::vector<entity_t> entities, std::vector<T> components) const {
+			OKAMI_ASSERT(entities.size() == components.size(), "Every entity needs a component");
+			Publish(ComponentAddBatchSignal<T>{ std::make_shared<ComponentBatch<T> const>(
+				ComponentBatch<T>{ std::move(entities), std::move(components) }) });
+		}
+
 		template <typename T>
 		void UpdateComponent(entity_t e, T component) const {
 			Publish(ComponentUpdateSignal<T>{ e, std::move(component) });
@@ -249,6 +281,8 @@ namespace okami {
 		std::string_view m_configFilePath = "default.yaml";
 		bool m_headlessMode = false;
 		std::string_view m_headlessOutputFileStem = "output";
+		// Picks the capture format: .png, .qoi, .ppm or .raw
+		std::string_view m_headlessOutputExtension = ".png";
 		bool m_forceLogToConsole = false;
 	};
 
@@ -278,6 +312,9 @@ namespace okami {
 		std::atomic<int> m_refCount{ 0 };
 	};
 
+	// Tag for handles taking over a reference already counted by ResHandle::Retain
+	struct AdoptRef {};
+
 	template <ResourceType T>
 	struct ResHandle {
 	private:
@@ -288,17 +325,29 @@ namespace okami {
 			return m_resource;
 		}
 
+		// Counts count more references with a single atomic add, each of which
+		// must then be handed to a handle constructed with AdoptRef
+		inline void Retain(int count) const {
+			if (m_resource && count > 0) {
+				m_resource->m_refCount.fetch_add(count, std::memory_order_relaxed);
+			}
+		}
+
 		inline ResHandle() = default;
 		inline ResHandle(Resource<T>* resource) : m_resource(resource) {
 			if (m_resource) {
 				m_resource->m_refCount.fetch_add(1, std::memory_order_relaxed);
 			}
 		}
+		inline ResHandle(Resource<T>* resource, AdoptRef) : m_resource(resource) {}
 		inline ResHandle(const ResHandle& other) : m_resource(other.m_resource) {
 			if (m_resource) {
 				m_resource->m_refCount.fetch_add(1, std::memory_order_relaxed);
 			}
 		}
+		inline ResHandle(ResHandle&& other) noexcept : m_resource(other.m_resource) {
+			other.m_resource = nullptr;
+		}
 		inline ResHandle& operator=(const ResHandle& other) {
 			if (this != &other) {
 				if (m_resource) {
@@ -311,6 +360,16 @@ namespace okami {
 			}
 			return *this;
 		}
+		inline ResHandle& operator=(ResHandle&& other) noexcept {
+			if (this != &other) {
+				if (m_resource) {
+					m_resource->m_refCount.fetch_sub(1, std::memory_order_relaxed);
+				}
+				m_resource = other.m_resource;
+				other.m_resource = nullptr;
+			}
+			return *this;
+		}
 		inline ~ResHandle() {
 			if (m_resource) {
 				m_resource->m_refCount.fetch_sub(1, std::memory_order_relaxed);
@@ -345,18 +404,61 @@ namespace okami {
 		}
 	};
 
+	// How soon a load is needed. Loads run most urgent first, and in the
+	// order they were requested within a priority.
+	enum class LoadPriority : uint8_t {
+		// Needed this frame
+		Immediate,
+		// On screen, or about to be
+		Visible,
+		// Speculative, run when nothing else waits
+		Prefetch,
+	};
+
+	constexpr size_t kLoadPriorityCount = 3;
+
+	// Reported for loads nothing referenced any more when they were about to run
+	inline Error LoadCancelledError() {
+		return Error("Load cancelled", ErrorCode::Cancelled);
+	}
+
+	inline bool IsLoadCancelled(Error const& error) {
+		return error.IsError() && error.m_code == ErrorCode::Cancelled;
+	}
+
+	template <ResourceType T>
+	using LoadCallback = std::function<void(ResHandle<T> const&, Error const&)>;
+
+	template <ResourceType T>
+	struct LoadParams {
+		// Requesting a path again at a more urgent priority moves its
+		// pending load up
+		LoadPriority m_priority = LoadPriority::Visible;
+		// Called on the main thread once the resource has loaded or failed
+		// to, or right away if it already has. Loads whose handles are all
+		// released before they run are cancelled, and report so with an
+		// empty handle; a callback capturing the handle keeps its load alive.
+		LoadCallback<T> m_onLoaded;
+	};
+
 	template <ResourceType T>
 	class IResourceManager {
 	public:
-		virtual ResHandle<T> Load(std::string_view path) = 0;
+		virtual ResHandle<T> Load(std::string_view path, LoadParams<T> params) = 0;
 		virtual ResHandle<T> Create(typename T::CreationData&& data) = 0;
 
+		inline ResHandle<T> Load(std::string_view path) {
+			return Load(path, LoadParams<T>{});
+		}
 		inline ResHandle<T> Load(std::string const& path) {
 			return Load(std::string_view(path));
 		}
 		inline ResHandle<T> Load(std::filesystem::path const& path) {
 			return Load(path.string());
 		}
+		inline ResHandle<T> Load(std::filesystem::path const& path, LoadParams<T> params) {
+			return Load(std::string_view(path.string()), std::move(params));
+		}
 	};
 
 	class Engine final {
@@ -405,6 +507,17 @@ namespace okami {
 			return m_entityTree.CreateEntity(m_signalHandlers, parent);
 		}
 
+		// Creates one entity per entry of parentIndices; see EntityTree::CreateEntities
+		inline void CreateEntities(std::span<int32_t const> parentIndices, std::span<entity_t> entities, entity_t parent = kRoot) {
+			m_entityTree.CreateEntities(m_signalHandlers, parentIndices, entities, parent);
+		}
+
+		// Copies root's subtree count times under newParent, components
+		// included, and returns the roots of the copies
+		inline std::vector<entity_t> CloneSubtree(entity_t root, entity_t newParent, size_t count) {
+			return m_entityTree.CloneSubtree(m_signalHandlers, root, newParent, count);
+		}
+
 		inline void RemoveEntity(entity_t entity) {
 			m_entityTree.RemoveEntity(m_signalHandlers, entity);
 		}
@@ -418,6 +531,11 @@ namespace okami {
 			m_signalHandlers.AddComponent(entity, std::move(component));
 		}
 
+		template <typename T>
+		void AddComponents(std::vector<entity_t> entities, std::vector<T> components) {
+			m_signalHandlers.AddComponents(std::move(entities), std::move(components));
+		}
+
 		template <typename T>
 		void UpdateComponent(entity_t entity, T component) {
 			m_signalHandlers.UpdateComponent(entity, std::move(component));
@@ -442,6 +560,15 @@ namespace okami {
 			return resourceManager->Load(path);
 		}
 
+		template <typename T>
+		ResHandle<T> Load(std::filesystem::path const& path, LoadParams<T> params) {
+			auto resourceManager = GetResourceManager<T>();
+			if (!resourceManager) {
+				throw std::runtime_error("Resource manager for type not found");
+			}
+			return resourceManager->Load(path, std::move(params));
+		}
+
 		std::filesystem::path GetRenderOutputPath(size_t frameIndex);
 
 		/*
@@ -45,6 +45,78 @@ entity_t EntityTree::CreateEntity(ISignalBus const& signalBus, entity_t parent)
 	return newId;
 }
 
+void EntityTree::CreateEntities(
+	ISignalBus const& signalBus,
+	std::span<int32_t const> parentIndices,
+	std::span<entity_t> entities,
+	entity_t parent) {
+	OKAMI_ASSERT(entities.size() >= parentIndices.size(), "Output span is too small");
+	m_impl->m_entityPool.Reserve(parentIndices.size());
+
+	for (size_t i = 0; i < parentIndices.size(); ++i) {
+		auto parentIndex = parentIndices[i];
+		OKAMI_ASSERT(parentIndex < static_cast<int32_t>(i), "Parents must be created before their children");
+		entity_t entityParent = parentIndex < 0 ? parent : entities[parentIndex];
+
+		entities[i] = m_impl->m_entityPool.Allocate();
+		AddEntity(entities[i], entityParent);
+
+		signalBus.Publish(EntityCreateSignal{ .m_entity = entities[i], .m_parent = entityParent });
+	}
+}
+
+std::vector<entity_t> EntityTree::CloneSubtree(
+	ISignalBus const& signalBus,
+	entity_t root,
+	entity_t newParent,
+	size_t count) {
+	OKAMI_ASSERT(root != kRoot, "Cannot clone the root entity");
+	OKAMI_ASSERT(!m_impl->m_entityPool.IsFree(root), "Entity must exist in the tree");
+	if (count == 0) {
+		return {};
+	}
+
+	// Flatten the subtree parent first, keeping sibling order
+	auto batch = std::make_shared<EntityCloneBatch>();
+	std::vector<int32_t> sourceParents;
+	std::vector<std::pair<entity_t, int32_t>> stack{ { root, -1 } };
+	while (!stack.empty()) {
+		auto [entity, parentIndex] = stack.back();
+		stack.pop_back();
+
+		auto index = static_cast<int32_t>(batch->m_sources.size());
+		batch->m_sources.push_back(entity);
+		sourceParents.push_back(parentIndex);
+
+		for (entity_t child = m_impl->m_entityPool[entity].m_lastChild;
+			child != kNullEntity;
+			child = m_impl->m_entityPool[child].m_previousSibling) {
+			stack.emplace_back(child, index);
+		}
+	}
+
+	auto const sourceCount = batch->m_sources.size();
+	std::vector<int32_t> parentIndices;
+	parentIndices.reserve(sourceCount * count);
+	for (size_t copy = 0; copy < count; ++copy) {
+		auto offset = static_cast<int32_t>(copy * sourceCount);
+		for (auto parentIndex : sourceParents) {
+			parentIndices.push_back(parentIndex < 0 ? -1 : offset + parentIndex);
+		}
+	}
+
+	batch->m_clones.resize(parentIndices.size());
+	CreateEntities(signalBus, parentIndices, batch->m_clones, newParent);
+
+	std::vector<entity_t> roots(count);
+	for (size_t copy = 0; copy < count; ++copy) {
+		roots[copy] = batch->m_clones[copy * sourceCount];
+	}
+
+	signalBus.Publish(EntityCloneSignal{ std::move(batch) });
+	return roots;
+}
+
 void EntityTree::AddEntity(entity_t entity, entity_t parent) {
 	OKAMI_ASSERT(!m_impl->m_entityPool.IsFree(parent), "Parent entity must exist in the tree");
 
@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <cstdint>
+#include <span>
+#include <vector>
 
 namespace okami
 {
@@ -27,6 +29,19 @@ namespace okami
 		entity_t m_newParent;
 	};
 
+	// Copies of a subtree. m_sources lists the subtree with parents before
+	// children; m_clones holds one entity per source for each copy, copy by
+	// copy, in the same order.
+	struct EntityCloneBatch {
+		std::vector<entity_t> m_sources;
+		std::vector<entity_t> m_clones;
+	};
+
+	// Asks component storages to duplicate the sources' components onto the clones
+	struct EntityCloneSignal {
+		std::shared_ptr<EntityCloneBatch const> m_batch;
+	};
+
 	// Forward declarations
 	struct EntityTreeImpl;
 	class EntityTree;
@@ -95,6 +110,23 @@ namespace okami
 		void RemoveEntity(ISignalBus const& signalBus, entity_t entity);
 		void SetParent(ISignalBus const& signalBus, entity_t entity, entity_t parent = kRoot);
 
+		// Creates a batch of entities, writing their ids to entities.
+		// parentIndices[i] is the index of entity i's parent within the batch,
+		// which must come before it, or -1 to attach it to parent.
+		void CreateEntities(
+			ISignalBus const& signalBus,
+			std::span<int32_t const> parentIndices,
+			std::span<entity_t> entities,
+			entity_t parent = kRoot);
+
+		// Creates count copies of root's subtree under newParent and returns
+		// the roots of the copies. Components follow through EntityCloneSignal.
+		std::vector<entity_t> CloneSubtree(
+			ISignalBus const& signalBus,
+			entity_t root,
+			entity_t newParent,
+			size_t count);
+
 		// Hierarchy navigation
 		entity_t GetParent(entity_t entity) const;
 		EntityIteratorRange<EntityChildrenIterator> GetChildren(entity_t entity) const;
@@ -0,0 +1,236 @@
+#include "float_packing.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace okami;
+
+namespace {
+    inline uint32_t FloatBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline float BitsFloat(uint32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Unsigned float with a 5 bit exponent biased by 15, as in halves, and
+    // mantissaBits of mantissa. Rounds like FloatToHalf.
+    uint32_t FloatToUnsignedFloat(float value, uint32_t mantissaBits) {
+        uint32_t largest = (30u << mantissaBits) | ((1u << mantissaBits) - 1);
+        if (!(value > 0.0f)) {
+            return 0;
+        }
+        uint32_t bits = FloatBits(value);
+        if (bits >= (143u << 23)) {
+            // 2^16 and up, infinity included
+            return largest;
+        }
+
+        uint32_t shift = 23 - mantissaBits;
+        uint32_t result;
+        if (bits < (113u << 23)) {
+            // Subnormal or zero; the FPU does the rounding at the step of
+            // the smallest exponent
+            uint32_t denormMagic = ((127 - 15) + shift + 1) << 23;
+            result = FloatBits(BitsFloat(bits) + BitsFloat(denormMagic)) - denormMagic;
+        } else {
+            uint32_t mantissaOdd = (bits >> shift) & 1;
+            bits += (static_cast<uint32_t>(15 - 127) << 23) + (1u << (shift - 1)) - 1 + mantissaOdd;
+            result = bits >> shift;
+        }
+        // Rounding up can carry past the largest encoding
+        return std::min(result, largest);
+    }
+
+    float UnsignedFloatToFloat(uint32_t value, uint32_t mantissaBits) {
+        // Multiplying by 2^112 rebiases the exponent and normalizes subnormals
+        uint32_t bits = FloatBits(BitsFloat(value << (23 - mantissaBits)) * BitsFloat((254 - 15) << 23));
+        if (value >= (31u << mantissaBits)) {
+            bits |= 255u << 23;
+        }
+        return BitsFloat(bits);
+    }
+
+    constexpr int kRgb9e5MantissaBits = 9;
+    constexpr int kRgb9e5ExponentBias = 15;
+    constexpr float kRgb9e5Largest = 511.0f / 512.0f * 65536.0f;
+
+    // 2^exponent for exponents a float can hold as a normal number
+    inline float Exp2(int exponent) {
+        return BitsFloat(static_cast<uint32_t>(127 + exponent) << 23);
+    }
+
+#ifdef OKAMI_SSE2
+    // Packs four int32 lanes holding values in [0, 65535] into 16 bits each.
+    // packs saturates signed, so the values are sign extended from 16 bits first.
+    inline __m128i PackUInt16(__m128i values) {
+        values = _mm_srai_epi32(_mm_slli_epi32(values, 16), 16);
+        return _mm_packs_epi32(values, values);
+    }
+
+    inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // Four lane version of FloatToHalf; results are in the low 16 bits of each lane
+    inline __m128i FloatToHalf4(__m128 value) {
+        __m128i bits = _mm_castps_si128(value);
+        __m128i sign = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0x80000000u)));
+        __m128i absolute = _mm_xor_si128(bits, sign);
+
+        __m128i isInfNan = _mm_cmpgt_epi32(absolute, _mm_set1_epi32(0x47800000 - 1));
+        __m128i isNan = _mm_cmpgt_epi32(absolute, _mm_set1_epi32(0x7F800000));
+        __m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNan, _mm_set1_epi32(0x0200)));
+
+        __m128i isSubnormal = _mm_cmplt_epi32(absolute, _mm_set1_epi32(113 << 23));
+        __m128 denormMagic = _mm_castsi128_ps(_mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23));
+        __m128i subnormal = _mm_sub_epi32(
+            _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(absolute), denormMagic)),
+            _mm_castps_si128(denormMagic));
+
+        __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(absolute, 13), _mm_set1_epi32(1));
+        __m128i normal = _mm_add_epi32(absolute, _mm_set1_epi32(((15 - 127) << 23) + 0xFFF));
+        normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissaOdd), 13);
+
+        __m128i result = Select(isInfNan, infNan, Select(isSubnormal, subnormal, normal));
+        return _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+    }
+
+    // Four lane version of HalfToFloat; halves are in the low 16 bits of each lane
+    inline __m128 HalfToFloat4(__m128i halves) {
+        __m128i exponentMantissa = _mm_and_si128(halves, _mm_set1_epi32(0x7FFF));
+        __m128i sign = _mm_slli_epi32(_mm_xor_si128(halves, exponentMantissa), 16);
+        __m128 scaled = _mm_mul_ps(
+            _mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)),
+            _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+        __m128i wasInfNan = _mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7BFF));
+        __m128i infNanExponent = _mm_and_si128(wasInfNan, _mm_set1_epi32(255 << 23));
+        return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNanExponent)));
+    }
+#endif
+}
+
+uint16_t okami::FloatToHalf(float value) {
+    uint32_t bits = FloatBits(value);
+    uint32_t sign = bits & 0x80000000u;
+    uint32_t absolute = bits ^ sign;
+
+    uint32_t result;
+    if (absolute >= 0x47800000u) {
+        // Too large for a half, infinity or NaN
+        result = absolute > 0x7F800000u ? 0x7E00u : 0x7C00u;
+    } else if (absolute < (113u << 23)) {
+        // Subnormal half or zero; the FPU does the rounding
+        constexpr uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+        result = FloatBits(BitsFloat(absolute) + BitsFloat(denormMagic)) - denormMagic;
+    } else {
+        uint32_t mantissaOdd = (absolute >> 13) & 1;
+        absolute += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF + mantissaOdd;
+        result = absolute >> 13;
+    }
+    return static_cast<uint16_t>(result | (sign >> 16));
+}
+
+float okami::HalfToFloat(uint16_t value) {
+    uint32_t exponentMantissa = value & 0x7FFFu;
+    // Multiplying by 2^112 rebiases the exponent and normalizes subnormals
+    uint32_t bits = FloatBits(BitsFloat(exponentMantissa << 13) * BitsFloat((254 - 15) << 23));
+    if (exponentMantissa > 0x7BFFu) {
+        bits |= 255u << 23;
+    }
+    return BitsFloat(bits | (static_cast<uint32_t>(value & 0x8000u) << 16));
+}
+
+void okami::EncodeHalf(std::span<float const> values, std::span<uint16_t> halves) {
+    size_t count = std::min(values.size(), halves.size());
+    size_t i = 0;
+#ifdef OKAMI_F16C
+    for (; i + 8 <= count; i += 8) {
+        __m128i result = _mm256_cvtps_ph(_mm256_loadu_ps(values.data() + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(halves.data() + i), result);
+    }
+#endif
+#ifdef OKAMI_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128i result = FloatToHalf4(_mm_loadu_ps(values.data() + i));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(halves.data() + i), PackUInt16(result));
+    }
+#endif
+    for (; i < count; ++i) {
+        halves[i] = FloatToHalf(values[i]);
+    }
+}
+
+void okami::DecodeHalf(std::span<uint16_t const> halves, std::span<float> values) {
+    size_t count = std::min(values.size(), halves.size());
+    size_t i = 0;
+#ifdef OKAMI_F16C
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<__m128i const*>(halves.data() + i));
+        _mm256_storeu_ps(values.data() + i, _mm256_cvtph_ps(packed));
+    }
+#endif
+#ifdef OKAMI_SSE2
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i packed = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(halves.data() + i));
+        _mm_storeu_ps(values.data() + i, HalfToFloat4(_mm_unpacklo_epi16(packed, zero)));
+    }
+#endif
+    for (; i < count; ++i) {
+        values[i] = HalfToFloat(halves[i]);
+    }
+}
+
+uint32_t okami::PackR11G11B10F(glm::vec3 const& color) {
+    return FloatToUnsignedFloat(color.x, 6) |
+        (FloatToUnsignedFloat(color.y, 6) << 11) |
+        (FloatToUnsignedFloat(color.z, 5) << 22);
+}
+
+glm::vec3 okami::UnpackR11G11B10F(uint32_t packed) {
+    return glm::vec3(
+        UnsignedFloatToFloat(packed & 0x7FFu, 6),
+        UnsignedFloatToFloat((packed >> 11) & 0x7FFu, 6),
+        UnsignedFloatToFloat(packed >> 22, 5));
+}
+
+// Follows EXT_texture_shared_exponent: the exponent is picked for the
+// largest channel, and bumped when that channel rounds up to 2^9
+uint32_t okami::PackRGB9E5(glm::vec3 const& color) {
+    glm::vec3 clamped;
+    for (int c = 0; c < 3; ++c) {
+        clamped[c] = color[c] > 0.0f ? std::min(color[c], kRgb9e5Largest) : 0.0f;
+    }
+    float largest = std::max(std::max(clamped.x, clamped.y), clamped.z);
+
+    // floor(log2(largest)), from the float's own exponent; zero and
+    // subnormals take the smallest shared exponent
+    int exponent = std::max(-kRgb9e5ExponentBias - 1, static_cast<int>(FloatBits(largest) >> 23) - 127);
+    exponent += 1 + kRgb9e5ExponentBias;
+    float scale = Exp2(kRgb9e5ExponentBias + kRgb9e5MantissaBits - exponent);
+    if (static_cast<uint32_t>(largest * scale + 0.5f) == (1u << kRgb9e5MantissaBits)) {
+        ++exponent;
+        scale *= 0.5f;
+    }
+
+    uint32_t packed = static_cast<uint32_t>(exponent) << 27;
+    for (int c = 0; c < 3; ++c) {
+        packed |= static_cast<uint32_t>(clamped[c] * scale + 0.5f) << (c * kRgb9e5MantissaBits);
+    }
+    return packed;
+}
+
+glm::vec3 okami::UnpackRGB9E5(uint32_t packed) {
+    float scale = Exp2(static_cast<int>(packed >> 27) - kRgb9e5ExponentBias - kRgb9e5MantissaBits);
+    return glm::vec3(
+        static_cast<float>(packed & 0x1FFu) * scale,
+        static_cast<float>((packed >> 9) & 0x1FFu) * scale,
+        static_cast<float>((packed >> 18) & 0x1FFu) * scale);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+namespace okami {
+	// Largest relative error of a normal half float
+	constexpr float kHalfMaxRelativeError = 1.0f / 2048.0f;
+
+	// IEEE 754 binary16, rounding to nearest even
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+	// Batch kernels; F16C or SSE2 is used where available, with the same
+	// results as the scalar versions up to NaN payloads
+	void EncodeHalf(std::span<float const> values, std::span<uint16_t> halves);
+	void DecodeHalf(std::span<uint16_t const> halves, std::span<float> values);
+
+	// DXGI R11G11B10_FLOAT: unsigned floats with 5 bit exponents and 6, 6 and
+	// 5 bit mantissas, red in the low bits. Rounds to nearest even; negative
+	// values and NaN become 0 and values past the largest encoding clamp to it.
+	uint32_t PackR11G11B10F(glm::vec3 const& color);
+	glm::vec3 UnpackR11G11B10F(uint32_t packed);
+
+	// DXGI R9G9B9E5_SHAREDEXP: 9 bit mantissas, red in the low bits, sharing
+	// a 5 bit exponent in the high bits. Clamped like PackR11G11B10F, to
+	// 65408; channels far below the largest lose precision first.
+	uint32_t PackRGB9E5(glm::vec3 const& color);
+	glm::vec3 UnpackRGB9E5(uint32_t packed);
+}
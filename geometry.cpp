@@ -1,16 +1,34 @@
 #include "geometry.hpp"
+#include "bvh.hpp"
+#include "lod.hpp"
+#include "meshlet.hpp"
+#include "mesh_optimizer.hpp"
+#include "okmesh.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "vertex_quantization.hpp"
+#include "simd.hpp"
 #include <tiny_gltf.h>
+#include <nlohmann/json.hpp>
 #include <filesystem>
+#include <fstream>
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <glog/logging.h>
 #include <cctype>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <array>
 
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <numeric>
+#include <limits>
 
 using namespace okami;
 
@@ -97,14 +115,79 @@ uint32_t okami::GetStride(AttributeType type) {
     return GetStride(GetAccessorType(type), GetComponentType(type));
 }
 
+uint32_t okami::GetStride(AttributeType type, AttributeEncoding encoding) {
+    if (encoding == AttributeEncoding::Float) {
+        return GetStride(type);
+    }
+
+    switch (type) {
+        case AttributeType::Position: return 4 * sizeof(uint16_t);
+        case AttributeType::Normal: return 2 * sizeof(int16_t);
+        case AttributeType::TexCoord: return 2 * sizeof(uint16_t);
+        case AttributeType::Color: return 4 * sizeof(uint16_t);
+        case AttributeType::Tangent: return 4 * sizeof(int16_t);
+        case AttributeType::Bitangent: return 2 * sizeof(int16_t);
+        default: throw std::runtime_error("Not implemented!");
+    }
+}
+
 uint32_t Attribute::GetStride() const {
-    return okami::GetStride(m_type);
+    return okami::GetStride(m_type, m_encoding);
 }
 
 uint32_t IndexInfo::GetStride() const {
     return okami::GetStride(AccessorType::Scalar, m_type);
 }
 
+AABB okami::ComputeAABB(std::span<glm::vec3 const> positions) {
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+    size_t i = 0;
+
+#ifdef OKAMI_SSE2
+    // Four positions are three vectors: (x0 y0 z0 x1) (y1 z1 x2 y2) (z2 x3 y3 z3).
+    // Each vector keeps its own running min and max, and the lanes holding the
+    // same axis are merged at the end. Operands are ordered so a NaN position
+    // never replaces the running value, as with glm::min and glm::max.
+    if (positions.size() >= 4) {
+        auto const* data = reinterpret_cast<float const*>(positions.data());
+        __m128 min0 = _mm_set1_ps(min.x), min1 = min0, min2 = min0;
+        __m128 max0 = _mm_set1_ps(max.x), max1 = max0, max2 = max0;
+        for (; i + 4 <= positions.size(); i += 4) {
+            __m128 a = _mm_loadu_ps(data + i * 3);
+            __m128 b = _mm_loadu_ps(data + i * 3 + 4);
+            __m128 c = _mm_loadu_ps(data + i * 3 + 8);
+            min0 = _mm_min_ps(a, min0);
+            min1 = _mm_min_ps(b, min1);
+            min2 = _mm_min_ps(c, min2);
+            max0 = _mm_max_ps(a, max0);
+            max1 = _mm_max_ps(b, max1);
+            max2 = _mm_max_ps(c, max2);
+        }
+
+        alignas(16) float lo[12];
+        alignas(16) float hi[12];
+        _mm_store_ps(lo, min0);
+        _mm_store_ps(lo + 4, min1);
+        _mm_store_ps(lo + 8, min2);
+        _mm_store_ps(hi, max0);
+        _mm_store_ps(hi + 4, max1);
+        _mm_store_ps(hi + 8, max2);
+        for (int lane = 0; lane < 12; ++lane) {
+            int axis = lane % 3;
+            min[axis] = std::min(min[axis], lo[lane]);
+            max[axis] = std::max(max[axis], hi[lane]);
+        }
+    }
+#endif
+
+    for (; i < positions.size(); ++i) {
+        min = glm::min(min, positions[i]);
+        max = glm::max(max, positions[i]);
+    }
+    return AABB{ min, max };
+}
+
 void okami::GenerateDefaultAttributeData(
     std::span<uint8_t> buffer, 
     AttributeType attrType) {
@@ -171,6 +254,653 @@ void okami::GenerateDefaultAttributeData(
     }
 }
 
+MeshRequirements okami::GetDefaultMeshRequirements(AttributeEncoding encoding) {
+    std::vector<AttributeRequirement> attributes;
+    for (auto type : kStaticMeshAttributes) {
+        attributes.emplace_back(type, encoding);
+    }
+    return MeshRequirements{
+        { MeshType::Static, std::move(attributes) }
+    };
+}
+
+GeometryBuffer::GeometryBuffer(std::vector<uint8_t> data) {
+    auto owned = std::make_shared<std::vector<uint8_t>>(std::move(data));
+    m_data = std::span(*owned);
+    m_owner = std::move(owned);
+}
+
+RawGeometry::RawGeometry(
+    std::vector<std::vector<uint8_t>> buffers,
+    std::vector<GeometryMeshDesc> meshes) :
+    m_meshes(std::move(meshes)) {
+    m_buffers.reserve(buffers.size());
+    for (auto& buffer : buffers) {
+        m_buffers.emplace_back(std::move(buffer));
+    }
+}
+
+RawGeometry::RawGeometry(
+    std::vector<GeometryBuffer> buffers,
+    std::vector<GeometryMeshDesc> meshes) :
+    m_buffers(std::move(buffers)), m_meshes(std::move(meshes)) {
+}
+
+Expected<std::vector<uint32_t>> RawGeometry::ReadIndices(size_t meshIndex) const {
+    if (meshIndex >= m_meshes.size()) {
+        return std::unexpected(Error("Invalid mesh index"));
+    }
+
+    auto const& mesh = m_meshes[meshIndex];
+    std::vector<uint32_t> result;
+
+    if (!mesh.m_indices) {
+        result.resize(mesh.m_vertexCount);
+        std::iota(result.begin(), result.end(), 0u);
+        return result;
+    }
+
+    auto const& indices = *mesh.m_indices;
+    auto data = GetRawVertexData(indices.m_buffer);
+    if (indices.m_offset + indices.m_count * indices.GetStride() > data.size()) {
+        return std::unexpected(Error("Index buffer out of range"));
+    }
+
+    auto read = [&]<typename T>(TypeWrapper<T>) {
+        result.resize(indices.m_count);
+        auto src = data.data() + indices.m_offset;
+        for (size_t i = 0; i < indices.m_count; ++i) {
+            T value;
+            std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+            result[i] = static_cast<uint32_t>(value);
+        }
+    };
+
+    switch (indices.m_type) {
+        case AccessorComponentType::UByte:
+        case AccessorComponentType::Byte:
+            read(TypeWrapper<uint8_t>{});
+            break;
+        case AccessorComponentType::UShort:
+        case AccessorComponentType::Short:
+            read(TypeWrapper<uint16_t>{});
+            break;
+        case AccessorComponentType::UInt:
+        case AccessorComponentType::Int:
+            read(TypeWrapper<uint32_t>{});
+            break;
+        default:
+            return std::unexpected(Error("Unsupported index component type"));
+    }
+
+    return result;
+}
+
+Error RawGeometry::BuildBVHs() {
+    m_bvhs.assign(m_meshes.size(), nullptr);
+    std::vector<Error> errors(m_meshes.size());
+
+    ParallelFor(m_meshes.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto position = m_meshes[i].TryGetAttribute(AttributeType::Position);
+            if (!position || position->m_encoding != AttributeEncoding::Float) {
+                continue;
+            }
+            auto bvh = TriangleBVH::Build(*this, i);
+            if (bvh) {
+                m_bvhs[i] = std::make_shared<TriangleBVH const>(std::move(*bvh));
+            } else {
+                errors[i] = bvh.error();
+            }
+        }
+    });
+
+    for (auto const& error : errors) {
+        if (error.IsError()) {
+            return error;
+        }
+    }
+    return {};
+}
+
+Error RawGeometry::BuildMeshlets() {
+    m_meshlets.assign(m_meshes.size(), nullptr);
+    std::vector<Error> errors(m_meshes.size());
+
+    ParallelFor(m_meshes.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto position = m_meshes[i].TryGetAttribute(AttributeType::Position);
+            if (!position || position->m_encoding != AttributeEncoding::Float) {
+                continue;
+            }
+            auto meshlets = MeshletTable::Build(*this, i);
+            if (meshlets) {
+                m_meshlets[i] = std::make_shared<MeshletTable const>(std::move(*meshlets));
+            } else {
+                errors[i] = meshlets.error();
+            }
+        }
+    });
+
+    for (auto const& error : errors) {
+        if (error.IsError()) {
+            return error;
+        }
+    }
+    return {};
+}
+
+namespace {
+    struct PackedLayout {
+        std::vector<GeometryMeshDesc> m_meshes;
+        size_t m_vertexBufferSize = 0;
+        size_t m_indexBufferSize = 0;
+    };
+
+    inline size_t AlignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // GPUs only take 16 and 32 bit indices
+    AccessorComponentType GetPackedIndexType(AccessorComponentType type) {
+        switch (type) {
+            case AccessorComponentType::UInt:
+            case AccessorComponentType::Int:
+                return AccessorComponentType::UInt;
+            default:
+                return AccessorComponentType::UShort;
+        }
+    }
+
+    Expected<PackedLayout> ComputePackedLayout(
+        std::span<GeometryMeshDesc const> meshes,
+        MeshRequirements const& requirements) {
+        PackedLayout layout;
+        layout.m_meshes.reserve(meshes.size());
+
+        // Packed offset of every (type, encoding, buffer, offset, vertex count,
+        // bounds) source block; generated defaults use buffer -1. Quantized
+        // positions are normalized to their mesh's AABB, so they are only
+        // shared between meshes with the same bounds.
+        using Bounds = std::array<float, 6>;
+        std::map<std::tuple<AttributeType, AttributeEncoding, int, size_t, size_t, Bounds>, size_t> packedBlocks;
+
+        for (auto const& mesh : meshes) {
+            auto reqs = requirements.find(mesh.m_type);
+            if (reqs == requirements.end()) {
+                return std::unexpected(Error("No vertex layout for mesh type"));
+            }
+
+            auto packed = mesh;
+            packed.m_attributes.clear();
+            for (auto const& attrib : reqs->second) {
+                auto source = mesh.TryGetAttribute(attrib.m_type);
+                Bounds bounds = {};
+                if (attrib.m_type == AttributeType::Position && attrib.m_encoding == AttributeEncoding::Quantized) {
+                    bounds = {
+                        mesh.m_aabb.m_min.x, mesh.m_aabb.m_min.y, mesh.m_aabb.m_min.z,
+                        mesh.m_aabb.m_max.x, mesh.m_aabb.m_max.y, mesh.m_aabb.m_max.z };
+                }
+                auto key = source ?
+                    std::make_tuple(attrib.m_type, attrib.m_encoding, source->m_buffer, source->m_offset, mesh.m_vertexCount, bounds) :
+                    std::make_tuple(attrib.m_type, attrib.m_encoding, -1, size_t{ 0 }, mesh.m_vertexCount, bounds);
+                auto [block, inserted] = packedBlocks.emplace(key, layout.m_vertexBufferSize);
+                packed.m_attributes.push_back(Attribute{
+                    .m_type = attrib.m_type,
+                    .m_buffer = 0,
+                    .m_offset = block->second,
+                    .m_encoding = attrib.m_encoding,
+                });
+                if (inserted) {
+                    layout.m_vertexBufferSize += GetStride(attrib.m_type, attrib.m_encoding) * mesh.m_vertexCount;
+                }
+            }
+
+            if (packed.m_indices) {
+                packed.m_indices->m_type = GetPackedIndexType(packed.m_indices->m_type);
+                auto stride = packed.m_indices->GetStride();
+                layout.m_indexBufferSize = AlignUp(layout.m_indexBufferSize, stride);
+                packed.m_indices->m_buffer = 1;
+                packed.m_indices->m_offset = layout.m_indexBufferSize;
+                layout.m_indexBufferSize += stride * packed.m_indices->m_count;
+            }
+
+            layout.m_meshes.push_back(std::move(packed));
+        }
+
+        return layout;
+    }
+}
+
+Expected<RawGeometry> RawGeometry::Pack(MeshRequirements const& requirements) const {
+    auto layout = ComputePackedLayout(m_meshes, requirements);
+    OKAMI_UNEXPECTED_RETURN(layout);
+
+    std::vector<uint8_t> vertexData(layout->m_vertexBufferSize);
+    std::vector<uint8_t> indexData(layout->m_indexBufferSize);
+
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        auto const& source = m_meshes[i];
+        auto const& packed = layout->m_meshes[i];
+
+        for (auto const& attrib : packed.m_attributes) {
+            auto dest = std::span(vertexData.data() + attrib.m_offset, attrib.GetStride() * packed.m_vertexCount);
+            auto sourceAttrib = source.TryGetAttribute(attrib.m_type);
+            if (!sourceAttrib) {
+                std::vector<uint8_t> defaults(GetStride(attrib.m_type) * packed.m_vertexCount);
+                GenerateDefaultAttributeData(defaults, attrib.m_type);
+                auto error = ConvertAttribute(attrib.m_type, AttributeEncoding::Float, attrib.m_encoding,
+                    defaults, dest, packed.m_vertexCount, source.m_aabb);
+                OKAMI_UNEXPECTED_RETURN(error);
+                continue;
+            }
+
+            if (sourceAttrib->m_buffer < 0 || sourceAttrib->m_buffer >= m_buffers.size()) {
+                return std::unexpected(Error("Invalid attribute buffer index"));
+            }
+            auto sourceData = m_buffers[sourceAttrib->m_buffer].GetData();
+            auto sourceSize = sourceAttrib->GetStride() * packed.m_vertexCount;
+            if (sourceAttrib->m_offset + sourceSize > sourceData.size()) {
+                return std::unexpected(Error("Attribute data out of range"));
+            }
+            auto error = ConvertAttribute(attrib.m_type, sourceAttrib->m_encoding, attrib.m_encoding,
+                sourceData.subspan(sourceAttrib->m_offset, sourceSize), dest, packed.m_vertexCount, source.m_aabb);
+            OKAMI_UNEXPECTED_RETURN(error);
+        }
+
+        if (packed.m_indices) {
+            auto indices = ReadIndices(i);
+            OKAMI_UNEXPECTED_RETURN(indices);
+
+            auto dest = indexData.data() + packed.m_indices->m_offset;
+            if (packed.m_indices->m_type == AccessorComponentType::UInt) {
+                std::memcpy(dest, indices->data(), indices->size() * sizeof(uint32_t));
+            } else {
+                for (size_t j = 0; j < indices->size(); ++j) {
+                    auto index = static_cast<uint16_t>((*indices)[j]);
+                    std::memcpy(dest + j * sizeof(uint16_t), &index, sizeof(uint16_t));
+                }
+            }
+        }
+    }
+
+    std::vector<GeometryBuffer> buffers;
+    buffers.emplace_back(std::move(vertexData));
+    if (layout->m_indexBufferSize > 0) {
+        buffers.emplace_back(std::move(indexData));
+    }
+
+    RawGeometry result(std::move(buffers), std::move(layout->m_meshes));
+    result.m_bvhs = m_bvhs;
+    result.m_meshlets = m_meshlets;
+    return result;
+}
+
+bool RawGeometry::IsPacked(MeshRequirements const& requirements) const {
+    auto layout = ComputePackedLayout(m_meshes, requirements);
+    if (!layout) {
+        return false;
+    }
+
+    size_t expectedBufferCount = layout->m_indexBufferSize > 0 ? 2 : 1;
+    if (m_buffers.size() != expectedBufferCount ||
+        m_buffers[0].size() != layout->m_vertexBufferSize ||
+        (expectedBufferCount > 1 && m_buffers[1].size() != layout->m_indexBufferSize)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        auto const& mesh = m_meshes[i];
+        auto const& packed = layout->m_meshes[i];
+
+        if (mesh.m_attributes.size() != packed.m_attributes.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < mesh.m_attributes.size(); ++j) {
+            auto const& a = mesh.m_attributes[j];
+            auto const& b = packed.m_attributes[j];
+            if (a.m_type != b.m_type || a.m_buffer != b.m_buffer || a.m_offset != b.m_offset || a.m_encoding != b.m_encoding) {
+                return false;
+            }
+        }
+
+        if (mesh.m_indices.has_value() != packed.m_indices.has_value()) {
+            return false;
+        }
+        if (mesh.m_indices) {
+            auto const& a = *mesh.m_indices;
+            auto const& b = *packed.m_indices;
+            if (a.m_type != b.m_type || a.m_buffer != b.m_buffer || a.m_offset != b.m_offset) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+ContentHash RawGeometry::ComputeContentHash() const {
+    ContentHasher hasher;
+
+    // Descriptions are hashed field by field since the structs have padding
+    hasher.UpdateValue(static_cast<uint64_t>(m_buffers.size()));
+    for (auto const& buffer : m_buffers) {
+        hasher.UpdateValue(static_cast<uint64_t>(buffer.size()));
+        hasher.Update(buffer.GetData());
+    }
+
+    hasher.UpdateValue(static_cast<uint64_t>(m_meshes.size()));
+    for (auto const& mesh : m_meshes) {
+        hasher.UpdateValue(mesh.m_type);
+        hasher.UpdateValue(static_cast<uint64_t>(mesh.m_vertexCount));
+
+        hasher.UpdateValue(static_cast<uint64_t>(mesh.m_attributes.size()));
+        for (auto const& attribute : mesh.m_attributes) {
+            hasher.UpdateValue(attribute.m_type);
+            hasher.UpdateValue(attribute.m_encoding);
+            hasher.UpdateValue(static_cast<int64_t>(attribute.m_buffer));
+            hasher.UpdateValue(static_cast<uint64_t>(attribute.m_offset));
+        }
+
+        hasher.UpdateValue(mesh.m_indices.has_value());
+        if (mesh.m_indices) {
+            hasher.UpdateValue(mesh.m_indices->m_type);
+            hasher.UpdateValue(static_cast<int64_t>(mesh.m_indices->m_buffer));
+            hasher.UpdateValue(static_cast<uint64_t>(mesh.m_indices->m_count));
+            hasher.UpdateValue(static_cast<uint64_t>(mesh.m_indices->m_offset));
+        }
+
+        for (int axis = 0; axis < 3; ++axis) {
+            hasher.UpdateValue(mesh.m_aabb.m_min[axis]);
+            hasher.UpdateValue(mesh.m_aabb.m_max[axis]);
+        }
+
+        hasher.UpdateValue(static_cast<uint64_t>(mesh.m_lods.size()));
+        for (auto const& lod : mesh.m_lods) {
+            hasher.UpdateValue(lod.m_meshIndex);
+            hasher.UpdateValue(lod.m_error);
+        }
+    }
+
+    return hasher.Finish();
+}
+
+Expected<RawGeometry> RawGeometry::Optimize(
+    MeshOptimizationParams const& params,
+    std::vector<MeshOptimizationStats>* stats) const {
+    std::vector<uint8_t> vertexData;
+    std::vector<uint8_t> indexData;
+    std::vector<GeometryMeshDesc> meshes;
+    meshes.reserve(m_meshes.size());
+    if (stats) {
+        stats->clear();
+        stats->reserve(m_meshes.size());
+    }
+
+    auto identity = [](size_t vertexCount) {
+        VertexRemap remap;
+        remap.m_remap.resize(vertexCount);
+        std::iota(remap.m_remap.begin(), remap.m_remap.end(), 0u);
+        remap.m_vertexCount = vertexCount;
+        return remap;
+    };
+
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        auto const& source = m_meshes[i];
+
+        auto indices = ReadIndices(i);
+        OKAMI_UNEXPECTED_RETURN(indices);
+        if (indices->size() % 3 != 0) {
+            return std::unexpected(Error("Mesh is not a triangle list"));
+        }
+        if (std::any_of(indices->begin(), indices->end(),
+            [&](uint32_t index) { return index >= source.m_vertexCount; })) {
+            return std::unexpected(Error("Index out of range"));
+        }
+
+        std::vector<VertexStream> streams;
+        streams.reserve(source.m_attributes.size());
+        for (auto const& attrib : source.m_attributes) {
+            if (attrib.m_buffer < 0 || attrib.m_buffer >= m_buffers.size()) {
+                return std::unexpected(Error("Invalid attribute buffer index"));
+            }
+            auto data = m_buffers[attrib.m_buffer].GetData();
+            size_t size = attrib.GetStride() * source.m_vertexCount;
+            if (attrib.m_offset + size > data.size()) {
+                return std::unexpected(Error("Attribute data out of range"));
+            }
+            streams.push_back(VertexStream{ data.subspan(attrib.m_offset, size), attrib.GetStride() });
+        }
+
+        MeshOptimizationStats meshStats;
+        meshStats.m_before = AnalyzeVertexCache(*indices, source.m_vertexCount, params.m_cacheSize);
+        meshStats.m_indexBytesBefore = source.GetIndexByteSize();
+
+        // Triangle reordering works on deduplicated vertex indices;
+        // representatives maps each of them back to one source vertex
+        auto dedup = params.m_deduplicateVertices ?
+            DeduplicateVertices(streams, source.m_vertexCount) : identity(source.m_vertexCount);
+        RemapIndices(*indices, dedup);
+        std::vector<uint32_t> representatives(dedup.m_vertexCount);
+        for (size_t v = 0; v < source.m_vertexCount; ++v) {
+            representatives[dedup.m_remap[v]] = static_cast<uint32_t>(v);
+        }
+
+        if (params.m_optimizeVertexCache) {
+            *indices = OptimizeVertexCache(*indices, dedup.m_vertexCount);
+        }
+
+        auto positionAttrib = source.TryGetAttribute(AttributeType::Position);
+        if (params.m_optimizeOverdraw && positionAttrib && positionAttrib->m_encoding == AttributeEncoding::Float) {
+            auto positionStream = streams[positionAttrib - source.m_attributes.data()];
+            std::vector<glm::vec3> positions(dedup.m_vertexCount);
+            for (size_t v = 0; v < dedup.m_vertexCount; ++v) {
+                std::memcpy(&positions[v], positionStream.m_data.data() + representatives[v] * positionStream.m_stride, sizeof(glm::vec3));
+            }
+            *indices = OptimizeOverdraw(*indices, positions, params.m_overdrawThreshold, params.m_cacheSize);
+        }
+
+        auto fetch = params.m_optimizeVertexFetch ?
+            OptimizeVertexFetch(*indices, dedup.m_vertexCount) : identity(dedup.m_vertexCount);
+        RemapIndices(*indices, fetch);
+
+        // Compose both remaps so every attribute is gathered only once
+        VertexRemap combined;
+        combined.m_remap.assign(source.m_vertexCount, kUnusedVertex);
+        combined.m_vertexCount = fetch.m_vertexCount;
+        for (size_t v = 0; v < dedup.m_vertexCount; ++v) {
+            if (fetch.m_remap[v] != kUnusedVertex) {
+                combined.m_remap[representatives[v]] = fetch.m_remap[v];
+            }
+        }
+
+        auto mesh = source;
+        mesh.m_vertexCount = combined.m_vertexCount;
+        mesh.m_attributes.clear();
+        for (size_t a = 0; a < streams.size(); ++a) {
+            auto remapped = RemapVertexStream(streams[a], combined);
+            mesh.m_attributes.push_back(Attribute{
+                .m_type = source.m_attributes[a].m_type,
+                .m_buffer = 0,
+                .m_offset = vertexData.size(),
+                .m_encoding = source.m_attributes[a].m_encoding,
+            });
+            vertexData.insert(vertexData.end(), remapped.begin(), remapped.end());
+        }
+
+        // 0xFFFF is left unused since it doubles as the strip cut value
+        AccessorComponentType indexType = AccessorComponentType::UInt;
+        if (params.m_narrowIndices) {
+            if (combined.m_vertexCount <= 0xFFFF) {
+                indexType = AccessorComponentType::UShort;
+            }
+        } else if (source.m_indices) {
+            indexType = GetPackedIndexType(source.m_indices->m_type);
+        }
+
+        IndexInfo indexInfo{ indexType, 1, indices->size(), 0 };
+        auto indexStride = indexInfo.GetStride();
+        indexInfo.m_offset = AlignUp(indexData.size(), indexStride);
+        indexData.resize(indexInfo.m_offset + indexStride * indices->size());
+        auto dest = indexData.data() + indexInfo.m_offset;
+        if (indexType == AccessorComponentType::UInt) {
+            std::memcpy(dest, indices->data(), indices->size() * sizeof(uint32_t));
+        } else {
+            for (size_t j = 0; j < indices->size(); ++j) {
+                auto index = static_cast<uint16_t>((*indices)[j]);
+                std::memcpy(dest + j * sizeof(uint16_t), &index, sizeof(uint16_t));
+            }
+        }
+        mesh.m_indices = indexInfo;
+
+        meshStats.m_after = AnalyzeVertexCache(*indices, mesh.m_vertexCount, params.m_cacheSize);
+        meshStats.m_indexBytesAfter = mesh.GetIndexByteSize();
+        if (stats) {
+            stats->push_back(meshStats);
+        }
+
+        meshes.push_back(std::move(mesh));
+    }
+
+    std::vector<GeometryBuffer> buffers;
+    buffers.emplace_back(std::move(vertexData));
+    if (!indexData.empty()) {
+        buffers.emplace_back(std::move(indexData));
+    }
+
+    RawGeometry result(std::move(buffers), std::move(meshes));
+    // BVH triangle ids and meshlet vertices refer to the old order
+    if (!m_bvhs.empty()) {
+        auto error = result.BuildBVHs();
+        OKAMI_UNEXPECTED_RETURN(error);
+    }
+    if (!m_meshlets.empty()) {
+        auto error = result.BuildMeshlets();
+        OKAMI_UNEXPECTED_RETURN(error);
+    }
+    return result;
+}
+
+Error RawGeometry::GenerateLods(LodChainParams const& params) {
+    for (auto const& mesh : m_meshes) {
+        if (!mesh.m_lods.empty()) {
+            return Error("Geometry already has levels of detail");
+        }
+    }
+
+    struct Level {
+        std::vector<uint32_t> m_indices;
+        float m_error;
+    };
+
+    size_t baseCount = m_meshes.size();
+    std::vector<std::vector<Level>> chains(baseCount);
+    std::vector<Error> errors(baseCount);
+
+    ParallelFor(baseCount, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto const& mesh = m_meshes[i];
+            auto access = TryAccess<glm::vec3 const>(AttributeType::Position, i);
+            if (!access) {
+                continue;
+            }
+            auto indices = ReadIndices(i);
+            if (!indices) {
+                errors[i] = indices.error();
+                continue;
+            }
+            if (indices->size() % 3 != 0) {
+                continue;
+            }
+
+            std::span<glm::vec3 const> positions(access->begin(), access->end());
+            float diagonal = glm::length(mesh.m_aabb.m_max - mesh.m_aabb.m_min);
+            size_t baseTriangles = indices->size() / 3;
+
+            // Each level is simplified from the previous one, so errors add up
+            std::vector<uint32_t> current = std::move(*indices);
+            float error = 0.0f;
+            for (auto const& level : params.m_levels) {
+                size_t targetIndexCount = static_cast<size_t>(baseTriangles * level.m_targetRatio) * 3;
+                if (targetIndexCount >= current.size()) {
+                    continue;
+                }
+                auto simplified = SimplifyMesh(positions, current, targetIndexCount, level.m_maxError * diagonal);
+                if (!simplified) {
+                    errors[i] = simplified.error();
+                    break;
+                }
+                if (simplified->m_indices.size() > current.size() * (1.0f - params.m_minReduction)) {
+                    break;
+                }
+                current = OptimizeVertexCache(simplified->m_indices, mesh.m_vertexCount);
+                error += simplified->m_error;
+                chains[i].push_back(Level{ current, error });
+            }
+        }
+    });
+
+    for (auto const& error : errors) {
+        if (error.IsError()) {
+            return error;
+        }
+    }
+
+    // All levels go into one new index buffer
+    std::vector<uint8_t> indexData;
+    int indexBuffer = static_cast<int>(m_buffers.size());
+    for (size_t i = 0; i < baseCount; ++i) {
+        for (auto const& level : chains[i]) {
+            auto lod = m_meshes[i];
+            lod.m_lods.clear();
+
+            // 0xFFFF is left unused since it doubles as the strip cut value
+            auto indexType = lod.m_vertexCount <= 0xFFFF ? AccessorComponentType::UShort : AccessorComponentType::UInt;
+            IndexInfo indexInfo{ indexType, indexBuffer, level.m_indices.size(), 0 };
+            auto indexStride = indexInfo.GetStride();
+            indexInfo.m_offset = AlignUp(indexData.size(), indexStride);
+            indexData.resize(indexInfo.m_offset + indexStride * level.m_indices.size());
+            auto dest = indexData.data() + indexInfo.m_offset;
+            if (indexType == AccessorComponentType::UInt) {
+                std::memcpy(dest, level.m_indices.data(), level.m_indices.size() * sizeof(uint32_t));
+            } else {
+                for (size_t j = 0; j < level.m_indices.size(); ++j) {
+                    auto index = static_cast<uint16_t>(level.m_indices[j]);
+                    std::memcpy(dest + j * sizeof(uint16_t), &index, sizeof(uint16_t));
+                }
+            }
+            lod.m_indices = indexInfo;
+
+            m_meshes[i].m_lods.push_back(MeshLod{ static_cast<uint32_t>(m_meshes.size()), level.m_error });
+            m_meshes.push_back(std::move(lod));
+        }
+    }
+
+    if (indexData.empty()) {
+        return {};
+    }
+    m_buffers.emplace_back(std::move(indexData));
+
+    if (!m_bvhs.empty()) {
+        auto error = BuildBVHs();
+        OKAMI_ERROR_RETURN(error);
+    }
+    if (!m_meshlets.empty()) {
+        auto error = BuildMeshlets();
+        OKAMI_ERROR_RETURN(error);
+    }
+    return {};
+}
+
+Expected<RawGeometry> RawGeometry::Load(std::filesystem::path const& path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == kOkMeshExtension) {
+        return LoadOkMesh(path);
+    }
+    return LoadGLTF(path);
+}
+
 // Helper functions for GLTF loading
 namespace {
     AccessorComponentType ConvertComponentType(int gltfComponentType) {
@@ -209,10 +939,341 @@ namespace {
         // Note: GLTF doesn't typically have BITANGENT, it's computed from normal and tangent
         return AttributeType::Unknown; // fallback - will be handled as unsupported
     }
+
+    // Geometry import never looks at images, so they are not decoded
+    bool SkipImageData(tinygltf::Image*, int, std::string*, std::string*, int, int, unsigned char const*, int, void*) {
+        return true;
+    }
+
+    Error ParseGLTFModel(
+        tinygltf::Model& model,
+        std::string_view json,
+        std::filesystem::path const& path) {
+        tinygltf::TinyGLTF loader;
+        loader.SetImageLoader(SkipImageData, nullptr);
+        std::string err;
+        std::string warn;
+        bool ret = loader.LoadASCIIFromString(&model, &err, &warn,
+            json.data(), static_cast<unsigned int>(json.size()), path.parent_path().string());
+
+        if (!warn.empty()) {
+            LOG(WARNING) << "GLTF loading warning: " << warn;
+        }
+        if (!err.empty()) {
+            return Error("GLTF loading error: " + err);
+        }
+        if (!ret) {
+            return Error("Failed to parse GLTF file");
+        }
+        return {};
+    }
+
+    Error LoadGLTFModel(std::filesystem::path const& path, tinygltf::Model& model) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return Error("Failed to open GLTF file: " + path.string());
+        }
+        std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return ParseGLTFModel(model, json, path);
+    }
+
+    constexpr uint32_t kGLBMagic = 0x46546C67; // "glTF"
+    constexpr uint32_t kGLBVersion = 2;
+    constexpr uint32_t kGLBChunkJSON = 0x4E4F534A;
+    constexpr uint32_t kGLBChunkBIN = 0x004E4942;
+
+    struct GLBModel {
+        std::shared_ptr<MappedFile> m_mapping;
+        // Index of the buffer stored in the BIN chunk, -1 if there is none
+        int m_embeddedBuffer = -1;
+        std::span<uint8_t> m_embeddedData;
+    };
+
+    // Loads a .glb, leaving its binary chunk in a file mapping. tinygltf
+    // copies the chunk into the model when it parses a .glb, so only the
+    // JSON chunk is handed to it, with the embedded buffer swapped for a one
+    // byte placeholder. Images are dropped for the same reason: decoding
+    // them would read the placeholder.
+    Expected<GLBModel> LoadGLBModel(std::filesystem::path const& path, tinygltf::Model& model) {
+        GLBModel glb;
+        auto mapping = MappedFile::Open(path);
+        OKAMI_UNEXPECTED_RETURN(mapping);
+        glb.m_mapping = std::move(*mapping);
+
+        auto data = glb.m_mapping->GetData();
+        auto readUInt32 = [&data](size_t offset) {
+            uint32_t value;
+            std::memcpy(&value, data.data() + offset, sizeof(value));
+            return value;
+        };
+        if (data.size() < 20 || readUInt32(0) != kGLBMagic || readUInt32(4) != kGLBVersion) {
+            return std::unexpected(Error("Not a glTF 2.0 binary file: " + path.string()));
+        }
+        size_t length = std::min<size_t>(readUInt32(8), data.size());
+        size_t jsonLength = readUInt32(12);
+        if (readUInt32(16) != kGLBChunkJSON || 20 + jsonLength > length) {
+            return std::unexpected(Error("Corrupt GLB JSON chunk: " + path.string()));
+        }
+        std::string_view jsonChunk(reinterpret_cast<char const*>(data.data() + 20), jsonLength);
+
+        std::span<uint8_t> binary;
+        size_t binaryOffset = 20 + jsonLength;
+        if (binaryOffset + 8 <= length) {
+            size_t binaryLength = readUInt32(binaryOffset);
+            if (readUInt32(binaryOffset + 4) != kGLBChunkBIN || binaryOffset + 8 + binaryLength > length) {
+                return std::unexpected(Error("Corrupt GLB binary chunk: " + path.string()));
+            }
+            binary = data.subspan(binaryOffset + 8, binaryLength);
+        }
+
+        auto json = nlohmann::json::parse(jsonChunk, nullptr, false);
+        if (json.is_discarded() || !json.is_object()) {
+            return std::unexpected(Error("Invalid GLB JSON chunk: " + path.string()));
+        }
+
+        // Per the spec only the first buffer may live in the BIN chunk
+        auto buffers = json.find("buffers");
+        if (buffers != json.end() && buffers->is_array() && !buffers->empty() &&
+            (*buffers)[0].is_object() && !(*buffers)[0].contains("uri")) {
+            auto& buffer = (*buffers)[0];
+            size_t byteLength = buffer.value("byteLength", size_t{ 0 });
+            if (byteLength > binary.size()) {
+                return std::unexpected(Error("GLB binary chunk is smaller than its buffer: " + path.string()));
+            }
+            glb.m_embeddedBuffer = 0;
+            glb.m_embeddedData = binary.first(byteLength);
+            buffer["uri"] = "data:application/octet-stream;base64,AA==";
+            buffer["byteLength"] = 1;
+        }
+        json.erase("images");
+
+        auto error = ParseGLTFModel(model, json.dump(), path);
+        OKAMI_UNEXPECTED_RETURN(error);
+        return glb;
+    }
+
+    // Primitives are small enough on average that claiming a few at a time
+    // keeps the pool busy without contending on every one
+    constexpr size_t kGLTFPrimitiveGrainSize = 4;
+
+    // Byte offset of an accessor's data in its buffer, after checking that the
+    // data is tightly packed with the given element size and fits the buffer.
+    // The model's buffer data has already been moved into buffers.
+    Expected<size_t> GetGLTFAccessorOffset(
+        tinygltf::Model const& model,
+        std::span<GeometryBuffer const> buffers,
+        tinygltf::Accessor const& accessor,
+        size_t elementSize) {
+        if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(model.bufferViews.size())) {
+            return std::unexpected(Error("Accessor has no buffer view"));
+        }
+        auto const& bufferView = model.bufferViews[accessor.bufferView];
+        if (bufferView.buffer < 0 || bufferView.buffer >= static_cast<int>(buffers.size())) {
+            return std::unexpected(Error("Buffer view references a missing buffer"));
+        }
+        if (bufferView.byteStride != 0 && bufferView.byteStride != elementSize) {
+            return std::unexpected(Error("Interleaved accessors are not supported"));
+        }
+        size_t dataEnd = accessor.byteOffset + accessor.count * elementSize;
+        if (dataEnd > bufferView.byteLength ||
+            bufferView.byteOffset + bufferView.byteLength > buffers[bufferView.buffer].size()) {
+            return std::unexpected(Error("Accessor data out of range"));
+        }
+        return bufferView.byteOffset + accessor.byteOffset;
+    }
+
+    Expected<GeometryMeshDesc> ExtractGLTFPrimitive(
+        tinygltf::Model const& model,
+        std::span<GeometryBuffer const> buffers,
+        tinygltf::Primitive const& primitive) {
+        GeometryMeshDesc geometryMesh;
+        geometryMesh.m_type = MeshType::Static;
+
+        // Process attributes
+        size_t vertexCount = 0;
+        for (const auto& [attribName, accessorIndex] : primitive.attributes) {
+            AttributeType attrType = MapGLTFAttributeName(attribName);
+            if (attrType == AttributeType::Unknown) {
+                LOG(WARNING) << "Skipping unknown attribute: " << attribName;
+                continue;
+            }
+
+            if (accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size())) {
+                return std::unexpected(Error("Invalid accessor for attribute " + attribName));
+            }
+            const auto& accessor = model.accessors[accessorIndex];
+            if (ConvertAccessorType(accessor.type) != GetAccessorType(attrType) ||
+                ConvertComponentType(accessor.componentType) != GetComponentType(attrType)) {
+                LOG(WARNING) << "Skipping attribute " << attribName << " with unsupported format";
+                continue;
+            }
+
+            auto offset = GetGLTFAccessorOffset(model, buffers, accessor, GetStride(attrType));
+            if (!offset) {
+                return std::unexpected(Error(attribName + ": " + offset.error().Str()));
+            }
+
+            Attribute attribute;
+            attribute.m_type = attrType;
+            attribute.m_buffer = model.bufferViews[accessor.bufferView].buffer;
+            attribute.m_offset = *offset;
+            
+            geometryMesh.m_attributes.push_back(attribute);
+            
+            // Track vertex count (should be same for all attributes)
+            if (vertexCount == 0) {
+                vertexCount = accessor.count;
+            } else if (vertexCount != accessor.count) {
+                LOG(WARNING) << "Attribute " << attribName << " has different vertex count (" 
+                            << accessor.count << ") than expected (" << vertexCount << ")";
+            }
+        }
+        
+        geometryMesh.m_vertexCount = vertexCount;
+
+        // Process indices if present
+        if (primitive.indices >= 0) {
+            if (primitive.indices >= static_cast<int>(model.accessors.size())) {
+                return std::unexpected(Error("Invalid index accessor"));
+            }
+            const auto& accessor = model.accessors[primitive.indices];
+            
+            IndexInfo indexInfo;
+            indexInfo.m_type = ConvertComponentType(accessor.componentType);
+            if (ConvertAccessorType(accessor.type) != AccessorType::Scalar ||
+                (indexInfo.m_type != AccessorComponentType::UByte &&
+                 indexInfo.m_type != AccessorComponentType::UShort &&
+                 indexInfo.m_type != AccessorComponentType::UInt)) {
+                return std::unexpected(Error("Unsupported index format"));
+            }
+
+            auto offset = GetGLTFAccessorOffset(model, buffers, accessor, indexInfo.GetStride());
+            if (!offset) {
+                return std::unexpected(Error("Indices: " + offset.error().Str()));
+            }
+            indexInfo.m_buffer = model.bufferViews[accessor.bufferView].buffer;
+            indexInfo.m_count = accessor.count;
+            indexInfo.m_offset = *offset;
+            
+            geometryMesh.m_indices = indexInfo;
+        }
+
+        return geometryMesh;
+    }
+
+    glm::mat4 GetGLTFLocalTransform(tinygltf::Node const& node) {
+        if (node.matrix.size() == 16) {
+            // Column major, like glm
+            glm::mat4 matrix;
+            for (int i = 0; i < 16; ++i) {
+                matrix[i / 4][i % 4] = static_cast<float>(node.matrix[i]);
+            }
+            return matrix;
+        }
+
+        glm::mat4 transform(1.0f);
+        if (node.translation.size() == 3) {
+            transform = glm::translate(transform, glm::vec3(
+                node.translation[0], node.translation[1], node.translation[2]));
+        }
+        if (node.rotation.size() == 4) {
+            // glTF stores quaternions as x, y, z, w
+            transform = transform * glm::mat4_cast(glm::quat(
+                static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+                static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+        }
+        if (node.scale.size() == 3) {
+            transform = glm::scale(transform, glm::vec3(
+                node.scale[0], node.scale[1], node.scale[2]));
+        }
+        return transform;
+    }
+
+    // Flattens the default scene's node tree depth first. Files without
+    // scenes use every node that is not some other node's child as a root.
+    Expected<std::vector<GLTFNode>> ReadGLTFNodes(tinygltf::Model const& model) {
+        // Primitives were flattened into meshes in file order
+        std::vector<uint32_t> firstMeshes(model.meshes.size());
+        uint32_t meshCount = 0;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            firstMeshes[i] = meshCount;
+            meshCount += static_cast<uint32_t>(model.meshes[i].primitives.size());
+        }
+
+        int nodeCount = static_cast<int>(model.nodes.size());
+        std::vector<int> roots;
+        int sceneIndex = model.defaultScene >= 0 ? model.defaultScene : (model.scenes.empty() ? -1 : 0);
+        if (sceneIndex >= static_cast<int>(model.scenes.size())) {
+            return std::unexpected(Error("Invalid default scene"));
+        } else if (sceneIndex >= 0) {
+            roots = model.scenes[sceneIndex].nodes;
+        } else {
+            std::vector<bool> isChild(model.nodes.size(), false);
+            for (auto const& node : model.nodes) {
+                for (int child : node.children) {
+                    if (child >= 0 && child < nodeCount) {
+                        isChild[child] = true;
+                    }
+                }
+            }
+            for (int i = 0; i < nodeCount; ++i) {
+                if (!isChild[i]) {
+                    roots.push_back(i);
+                }
+            }
+        }
+
+        std::vector<GLTFNode> nodes;
+        std::vector<bool> visited(model.nodes.size(), false);
+        // glTF node and the index of its parent in nodes
+        std::vector<std::pair<int, int32_t>> stack;
+        for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+            stack.emplace_back(*it, -1);
+        }
+        while (!stack.empty()) {
+            auto [nodeIndex, parent] = stack.back();
+            stack.pop_back();
+
+            if (nodeIndex < 0 || nodeIndex >= nodeCount) {
+                return std::unexpected(Error("Invalid node index " + std::to_string(nodeIndex)));
+            }
+            if (visited[nodeIndex]) {
+                return std::unexpected(Error("Node " + std::to_string(nodeIndex) + " has more than one parent"));
+            }
+            visited[nodeIndex] = true;
+
+            auto const& node = model.nodes[nodeIndex];
+            GLTFNode result;
+            result.m_parent = parent;
+            result.m_localTransform = GetGLTFLocalTransform(node);
+            result.m_name = node.name;
+            if (node.mesh >= static_cast<int>(model.meshes.size())) {
+                return std::unexpected(Error("Node " + std::to_string(nodeIndex) + " has an invalid mesh"));
+            } else if (node.mesh >= 0) {
+                result.m_firstMesh = firstMeshes[node.mesh];
+                result.m_meshCount = static_cast<uint32_t>(model.meshes[node.mesh].primitives.size());
+            }
+            nodes.push_back(std::move(result));
+
+            auto index = static_cast<int32_t>(nodes.size() - 1);
+            for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+                stack.emplace_back(*it, index);
+            }
+        }
+
+        return nodes;
+    }
 }
 
 Expected<RawGeometry> RawGeometry::LoadGLTF(
     std::filesystem::path const& path) {
+    std::vector<GLTFNode> nodes;
+    return LoadGLTF(path, nodes);
+}
+
+Expected<RawGeometry> RawGeometry::LoadGLTF(
+    std::filesystem::path const& path,
+    std::vector<GLTFNode>& nodes) {
 
     RawGeometry result;
 
@@ -229,107 +1290,65 @@ Expected<RawGeometry> RawGeometry::LoadGLTF(
 
     // Load GLTF model
     tinygltf::Model model;
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-
-    bool ret;
     if (extension == ".glb") {
-        ret = loader.LoadBinaryFromFile(&model, &err, &warn, path.string());
-    } else {
-        ret = loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
-    }
-
-    if (!warn.empty()) {
-        LOG(WARNING) << "GLTF loading warning: " << warn;
-    }
+        auto glb = LoadGLBModel(path, model);
+        OKAMI_UNEXPECTED_RETURN(glb);
 
-    if (!err.empty()) {
-        return std::unexpected(Error("GLTF loading error: " + err));
-    }
+        // The embedded buffer stays in the file mapping
+        result.m_buffers.reserve(model.buffers.size());
+        for (int i = 0; i < static_cast<int>(model.buffers.size()); ++i) {
+            if (i == glb->m_embeddedBuffer) {
+                result.m_buffers.emplace_back(glb->m_embeddedData, glb->m_mapping);
+            } else {
+                result.m_buffers.emplace_back(std::move(model.buffers[i].data));
+            }
+        }
+    } else {
+        auto error = LoadGLTFModel(path, model);
+        OKAMI_UNEXPECTED_RETURN(error);
 
-    if (!ret) {
-        return std::unexpected(Error("Failed to parse GLTF file"));
+        result.m_buffers.reserve(model.buffers.size());
+        for (auto& buffer : model.buffers) {
+            result.m_buffers.emplace_back(std::move(buffer.data));
+        }
     }
 
-    // Copy buffer data
-    result.m_buffers.reserve(model.buffers.size());
-    for (const auto& buffer : model.buffers) {
-        result.m_buffers.emplace_back(std::move(buffer.data));
+    // Every primitive becomes one mesh, in file order
+    std::vector<std::pair<int, int>> primitives;
+    for (int meshIndex = 0; meshIndex < static_cast<int>(model.meshes.size()); ++meshIndex) {
+        for (int primitiveIndex = 0; primitiveIndex < static_cast<int>(model.meshes[meshIndex].primitives.size()); ++primitiveIndex) {
+            primitives.emplace_back(meshIndex, primitiveIndex);
+        }
     }
 
-    // Process each mesh
-    result.m_meshes.reserve(model.meshes.size());
-    for (const auto& mesh : model.meshes) {
-        for (const auto& primitive : mesh.primitives) {
-            GeometryMeshDesc geometryMesh;
-            geometryMesh.m_type = MeshType::Static;
-            
-            // Process attributes
-            size_t vertexCount = 0;
-            for (const auto& [attribName, accessorIndex] : primitive.attributes) {
-                const auto& accessor = model.accessors[accessorIndex];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                
-                AttributeType attrType = MapGLTFAttributeName(attribName);
-                if (attrType == AttributeType::Unknown) {
-                    LOG(WARNING) << "Skipping unknown attribute: " << attribName;
-                    continue;
-                }
-
-                Attribute attribute;
-                attribute.m_type = attrType;
-                attribute.m_buffer = bufferView.buffer;
-                attribute.m_offset = bufferView.byteOffset + accessor.byteOffset;
-                
-                geometryMesh.m_attributes.push_back(attribute);
-                
-                // Track vertex count (should be same for all attributes)
-                if (vertexCount == 0) {
-                    vertexCount = accessor.count;
-                } else if (vertexCount != accessor.count) {
-                    LOG(WARNING) << "Attribute " << attribName << " has different vertex count (" 
-                                << accessor.count << ") than expected (" << vertexCount << ")";
-                }
+    // Primitives are independent, so extraction, validation and bounds run
+    // in parallel. Each writes only its own mesh and error slot; the first
+    // error in file order is reported.
+    result.m_meshes.resize(primitives.size());
+    std::vector<Error> errors(primitives.size());
+    ParallelFor(primitives.size(), kGLTFPrimitiveGrainSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto [meshIndex, primitiveIndex] = primitives[i];
+            auto mesh = ExtractGLTFPrimitive(model, result.m_buffers, model.meshes[meshIndex].primitives[primitiveIndex]);
+            if (!mesh) {
+                errors[i] = Error("Mesh " + std::to_string(meshIndex) + " primitive " +
+                    std::to_string(primitiveIndex) + ": " + mesh.error().Str());
+                continue;
             }
-            
-            geometryMesh.m_vertexCount = vertexCount;
-
-            // Process indices if present
-            if (primitive.indices >= 0) {
-                const auto& accessor = model.accessors[primitive.indices];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                
-                IndexInfo indexInfo;
-                indexInfo.m_type = ConvertComponentType(accessor.componentType);
-                indexInfo.m_buffer = bufferView.buffer;
-                indexInfo.m_count = accessor.count;
-                indexInfo.m_offset = bufferView.byteOffset + accessor.byteOffset;
-                
-                geometryMesh.m_indices = indexInfo;
-            }
-
-            result.m_meshes.push_back(std::move(geometryMesh));
-        }
-    }
-
-    // Compute AABBs
-    for (int i = 0; i < result.GetMeshCount(); ++i) {
-        auto aabb_max = glm::vec3(-std::numeric_limits<float>::infinity());
-        auto aabb_min = glm::vec3(std::numeric_limits<float>::infinity());
-        auto access = result.TryAccess<glm::vec3>(AttributeType::Position, i);
-        if (access) {
-            aabb_max = std::accumulate(access->begin(), access->end(), aabb_max,
-                [](const glm::vec3& a, const glm::vec3& b) {
-                    return glm::max(a, b);
-                });
-            aabb_min = std::accumulate(access->begin(), access->end(), aabb_min,
-                [](const glm::vec3& a, const glm::vec3& b) {
-                    return glm::min(a, b);
-                });
+            result.m_meshes[i] = std::move(*mesh);
+
+            auto positions = result.TryAccess<glm::vec3 const>(AttributeType::Position, i);
+            result.m_meshes[i].m_aabb = ComputeAABB(positions ? *positions : std::span<glm::vec3 const>{});
         }
-        result.m_meshes[i].m_aabb = AABB{aabb_min, aabb_max};
+    });
+
+    for (auto const& error : errors) {
+        OKAMI_UNEXPECTED_RETURN(error);
     }
 
+    auto sceneNodes = ReadGLTFNodes(model);
+    OKAMI_UNEXPECTED_RETURN(sceneNodes);
+    nodes = std::move(*sceneNodes);
+
     return result;
 }
\ No newline at end of file
@@ -4,14 +4,26 @@
 #include <optional>
 #include <span>
 #include <filesystem>
+#include <memory>
+#include <array>
+#include <unordered_map>
+#include <string>
 
 #include "common.hpp"
 #include "aabb.hpp"
+#include "hash.hpp"
 
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/common.hpp>
 
 namespace okami {
+	class TriangleBVH;
+	class MeshletTable;
+	struct MeshOptimizationParams;
+	struct MeshOptimizationStats;
+	struct LodChainParams;
+
     enum class AttributeType {
 		Position,
 		Normal,
@@ -62,15 +74,27 @@ namespace okami {
         UByte
     };
 
+	// How the values of an attribute are stored. Float is the layout given by
+	// GetAccessorType and GetComponentType. Quantized stores positions as
+	// unorm16 normalized to the mesh's AABB, normals, bitangents and tangents
+	// octahedral encoded in snorm16, and texture coordinates and colors as
+	// half floats (see vertex_quantization.hpp).
+	enum class AttributeEncoding {
+		Float,
+		Quantized
+	};
+
 	AccessorType GetAccessorType(AttributeType type);
 	AccessorComponentType GetComponentType(AttributeType type);
 	uint32_t GetStride(AccessorType type, AccessorComponentType componentType);
 	uint32_t GetStride(AttributeType type);
+	uint32_t GetStride(AttributeType type, AttributeEncoding encoding);
 
     struct Attribute {
         AttributeType m_type;
         int m_buffer;
         size_t m_offset;
+        AttributeEncoding m_encoding = AttributeEncoding::Float;
 
         uint32_t GetStride() const;
     };
@@ -83,6 +107,14 @@ namespace okami {
 
 		uint32_t GetStride() const;
 	};
+
+	// A simplified version of a mesh, stored as another mesh of the same
+	// geometry that shares the base mesh's vertices
+	struct MeshLod {
+		uint32_t m_meshIndex;
+		// Largest object space deviation from the base mesh
+		float m_error;
+	};
 	
 	struct GeometryMeshDesc {
 		std::vector<Attribute> m_attributes;
@@ -90,6 +122,8 @@ namespace okami {
 		std::optional<IndexInfo> m_indices;
 		MeshType m_type;
 		AABB m_aabb;
+		// Levels of detail of this mesh, finest first
+		std::vector<MeshLod> m_lods;
 
 		size_t GetVertexByteSize() const;
 		size_t GetIndexByteSize() const;
@@ -100,21 +134,95 @@ namespace okami {
 		}
 	};
 
+	// Bounds of positions in a single pass; empty input gives an inverted
+	// AABB (min at +infinity, max at -infinity). NaNs are ignored.
+	AABB ComputeAABB(std::span<glm::vec3 const> positions);
+
 	void GenerateDefaultAttributeData(
     	std::span<uint8_t> buffer, 
     	AttributeType attrType);
 
+	// Vertex layout expected by the renderer for static meshes. Each attribute
+	// is stored as its own contiguous block in the packed vertex buffer.
+	constexpr std::array<AttributeType, 4> kStaticMeshAttributes = {
+		AttributeType::Position,
+		AttributeType::Normal,
+		AttributeType::TexCoord,
+		AttributeType::Tangent
+	};
+
+	struct AttributeRequirement {
+		AttributeType m_type;
+		AttributeEncoding m_encoding = AttributeEncoding::Float;
+
+		constexpr AttributeRequirement(AttributeType type, AttributeEncoding encoding = AttributeEncoding::Float) :
+			m_type(type), m_encoding(encoding) {}
+	};
+
+	using MeshRequirements = std::unordered_map<MeshType, std::vector<AttributeRequirement>>;
+
+	// kStaticMeshAttributes for static meshes, all stored with the given encoding
+	MeshRequirements GetDefaultMeshRequirements(AttributeEncoding encoding = AttributeEncoding::Float);
+
+	// A node of a glTF scene. Nodes are listed depth first, so parents come
+	// before their children.
+	struct GLTFNode {
+		// Index of the parent node, or -1 for the scene's root nodes
+		int32_t m_parent = -1;
+		glm::mat4 m_localTransform = glm::mat4(1.0f);
+		// The node's glTF mesh, as the range of geometry meshes its primitives became
+		uint32_t m_firstMesh = 0;
+		uint32_t m_meshCount = 0;
+		std::string m_name;
+	};
+
+	// Bytes backing one buffer of a RawGeometry. The bytes are either owned
+	// or live in external memory (such as a file mapping) kept alive by m_owner.
+	class GeometryBuffer {
+	private:
+		std::span<uint8_t> m_data;
+		std::shared_ptr<void> m_owner;
+
+	public:
+		GeometryBuffer() = default;
+		GeometryBuffer(std::vector<uint8_t> data);
+		inline GeometryBuffer(std::span<uint8_t> data, std::shared_ptr<void> owner) :
+			m_data(data), m_owner(std::move(owner)) {}
+
+		inline std::span<uint8_t const> GetData() const {
+			return m_data;
+		}
+
+		inline std::span<uint8_t> GetData() {
+			return m_data;
+		}
+
+		inline size_t size() const {
+			return m_data.size();
+		}
+	};
+
     class RawGeometry {
 	private:
-        std::vector<std::vector<uint8_t>> m_buffers;
+        std::vector<GeometryBuffer> m_buffers;
         std::vector<GeometryMeshDesc> m_meshes;
+		// One entry per mesh once BuildBVHs has run; null for meshes without float positions
+		std::vector<std::shared_ptr<TriangleBVH const>> m_bvhs;
+		// One entry per mesh once BuildMeshlets has run; null for meshes without float positions
+		std::vector<std::shared_ptr<MeshletTable const>> m_meshlets;
 
 	public:
 		RawGeometry() = default;
+		RawGeometry(
+			std::vector<std::vector<uint8_t>> buffers,
+			std::vector<GeometryMeshDesc> meshes);
+		RawGeometry(
+			std::vector<GeometryBuffer> buffers,
+			std::vector<GeometryMeshDesc> meshes);
 		OKAMI_NO_COPY(RawGeometry);
 		OKAMI_MOVE(RawGeometry);
 
-		inline std::span<std::vector<uint8_t> const> GetBuffers() const {
+		inline std::span<GeometryBuffer const> GetBuffers() const {
 			return std::span(m_buffers);
 		}
 
@@ -130,16 +238,17 @@ namespace okami {
 			if (buffer < 0 || buffer >= m_buffers.size()) {
 				throw std::out_of_range("Invalid buffer index");
 			}
-			return m_buffers[buffer];
+			return m_buffers[buffer].GetData();
 		}
 
 		inline std::span<uint8_t> GetRawVertexData(int buffer = 0) {
 			if (buffer < 0 || buffer >= m_buffers.size()) {
 				throw std::out_of_range("Invalid buffer index");
 			}
-			return m_buffers[buffer];
+			return m_buffers[buffer].GetData();
 		}
 
+		// Views are only handed out for attributes with AttributeEncoding::Float
 		template <typename T>
 		std::optional<GeometryView<T>> TryAccess(AttributeType attrType, size_t meshIndex = 0) const {
 			if (meshIndex >= m_meshes.size()) {
@@ -150,7 +259,7 @@ namespace okami {
 
             // Find the attribute for the given attribute type
             auto const attribute = mesh.TryGetAttribute(attrType);
-            if (!attribute) {
+            if (!attribute || attribute->m_encoding != AttributeEncoding::Float) {
                 return std::nullopt;
             }
 
@@ -177,7 +286,7 @@ namespace okami {
             
             // Find the attribute for the given attribute type
             auto const attribute = mesh.TryGetAttribute(attrType);
-            if (!attribute) {
+            if (!attribute || attribute->m_encoding != AttributeEncoding::Float) {
                 return std::nullopt;
             }
 
@@ -194,6 +303,66 @@ namespace okami {
 			};
 		}
 
+		// Reads the mesh's index buffer widened to 32 bits. Meshes without an
+		// index buffer get the sequence 0 .. vertexCount - 1.
+		Expected<std::vector<uint32_t>> ReadIndices(size_t meshIndex = 0) const;
+
+		// Builds a triangle BVH for every mesh with positions
+		Error BuildBVHs();
+
+		inline std::span<std::shared_ptr<TriangleBVH const> const> GetBVHs() const {
+			return std::span(m_bvhs);
+		}
+
+		inline std::shared_ptr<TriangleBVH const> GetBVH(size_t meshIndex = 0) const {
+			return meshIndex < m_bvhs.size() ? m_bvhs[meshIndex] : nullptr;
+		}
+
+		// Splits every mesh with positions into meshlets with bounds for cluster culling
+		Error BuildMeshlets();
+
+		inline std::span<std::shared_ptr<MeshletTable const> const> GetMeshletTables() const {
+			return std::span(m_meshlets);
+		}
+
+		inline std::shared_ptr<MeshletTable const> GetMeshletTable(size_t meshIndex = 0) const {
+			return meshIndex < m_meshlets.size() ? m_meshlets[meshIndex] : nullptr;
+		}
+
+		// Repacks the geometry into the layout the renderer uploads as is:
+		// buffer 0 holds, per mesh, one block per required attribute (missing
+		// attributes get default data) and buffer 1 holds all index data.
+		// Attributes are converted to the required encoding. Meshes reading
+		// the same source vertices, such as levels of detail, share their blocks.
+		Expected<RawGeometry> Pack(MeshRequirements const& requirements) const;
+
+		// True if the geometry is already laid out the way Pack would lay it out
+		bool IsPacked(MeshRequirements const& requirements) const;
+
+		// Hash of the buffers and mesh descriptions; byte-identical geometry
+		// hashes the same wherever it was loaded from. BVHs and meshlets are
+		// derived data and not included.
+		ContentHash ComputeContentHash() const;
+
+		// Import-time optimization of every triangle list mesh: deduplicates
+		// vertices, reorders triangles for the vertex cache and overdraw,
+		// reorders vertices for fetch locality and narrows indices. The result
+		// has one attribute buffer and one index buffer. If stats is given it
+		// receives one entry per mesh.
+		Expected<RawGeometry> Optimize(
+			MeshOptimizationParams const& params,
+			std::vector<MeshOptimizationStats>* stats = nullptr) const;
+
+		// Appends a chain of simplified index buffers for every triangle list
+		// mesh with positions. Each level becomes a new mesh sharing the base
+		// mesh's vertices and is listed in the base mesh's m_lods.
+		Error GenerateLods(LodChainParams const& params);
+
+		// Loads .okmesh caches, falling back to glTF for .gltf and .glb files
+		static Expected<RawGeometry> Load(std::filesystem::path const& path);
+
         static Expected<RawGeometry> LoadGLTF(std::filesystem::path const& path);
+		// Also reads the node hierarchy of the file's default scene
+		static Expected<RawGeometry> LoadGLTF(std::filesystem::path const& path, std::vector<GLTFNode>& nodes);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "hash.hpp"
+#include "simd.hpp"
+
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace okami;
+
+namespace {
+    constexpr uint64_t kPrime32_1 = 0x9E3779B1u;
+    constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+
+    constexpr size_t kSecretSize = 192;
+    constexpr size_t kStripeSize = 64;
+    // Stripes accumulated between scrambles, each keyed 8 bytes further
+    // into the secret
+    constexpr size_t kStripesPerBlock = (kSecretSize - kStripeSize) / 8;
+
+    constexpr uint64_t SplitMix64(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    struct Secret {
+        alignas(16) uint8_t m_bytes[kSecretSize];
+    };
+
+    constexpr Secret MakeSecret() {
+        Secret secret{};
+        uint64_t state = 0x6F6B616D69ull; // "okami"
+        for (size_t i = 0; i < kSecretSize; i += 8) {
+            uint64_t value = SplitMix64(state);
+            for (size_t b = 0; b < 8; ++b) {
+                secret.m_bytes[i + b] = static_cast<uint8_t>(value >> (b * 8));
+            }
+        }
+        return secret;
+    }
+
+    constexpr Secret kSecret = MakeSecret();
+
+    inline uint64_t Read64(uint8_t const* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t Mul128Fold64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+        auto product = static_cast<unsigned __int128>(a) * b;
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        uint64_t high;
+        uint64_t low = _umul128(a, b, &high);
+        return low ^ high;
+#else
+        uint64_t aLow = a & 0xFFFFFFFF, aHigh = a >> 32;
+        uint64_t bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+        uint64_t ll = aLow * bLow, lh = aLow * bHigh, hl = aHigh * bLow, hh = aHigh * bHigh;
+        uint64_t cross = (ll >> 32) + (lh & 0xFFFFFFFF) + hl;
+        uint64_t high = hh + (lh >> 32) + (cross >> 32);
+        uint64_t low = (cross << 32) | (ll & 0xFFFFFFFF);
+        return low ^ high;
+#endif
+    }
+
+    inline uint64_t Avalanche(uint64_t h) {
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ull;
+        h ^= h >> 32;
+        return h;
+    }
+
+    void Accumulate(uint64_t* accumulators, uint8_t const* stripe, uint8_t const* key) {
+#ifdef OKAMI_SSE2
+        auto* acc = reinterpret_cast<__m128i*>(accumulators);
+        for (int i = 0; i < 4; ++i) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<__m128i const*>(stripe) + i);
+            __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<__m128i const*>(key) + i));
+            // low 32 bits times high 32 bits of each 64-bit lane
+            __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+            // Each lane also takes its neighbour's raw data
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+        }
+#else
+        for (int i = 0; i < 8; ++i) {
+            uint64_t data = Read64(stripe + i * 8);
+            uint64_t keyed = data ^ Read64(key + i * 8);
+            accumulators[i ^ 1] += data;
+            accumulators[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+#endif
+    }
+
+    void Scramble(uint64_t* accumulators, uint8_t const* key) {
+#ifdef OKAMI_SSE2
+        auto* acc = reinterpret_cast<__m128i*>(accumulators);
+        __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+        for (int i = 0; i < 4; ++i) {
+            __m128i value = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+            value = _mm_xor_si128(value, _mm_loadu_si128(reinterpret_cast<__m128i const*>(key) + i));
+            // 64 x 32 bit multiply from two 32 x 32 bit halves
+            __m128i low = _mm_mul_epu32(value, prime);
+            __m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+            acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+        }
+#else
+        for (int i = 0; i < 8; ++i) {
+            uint64_t value = accumulators[i];
+            value ^= value >> 47;
+            value ^= Read64(key + i * 8);
+            accumulators[i] = value * kPrime32_1;
+        }
+#endif
+    }
+
+    uint64_t Merge(uint64_t const* accumulators, uint8_t const* key, uint64_t start) {
+        uint64_t result = start;
+        for (int i = 0; i < 4; ++i) {
+            result += Mul128Fold64(
+                accumulators[2 * i] ^ Read64(key + 16 * i),
+                accumulators[2 * i + 1] ^ Read64(key + 16 * i + 8));
+        }
+        return Avalanche(result);
+    }
+}
+
+ContentHasher::ContentHasher() :
+    m_accumulators{ kPrime32_1, kPrime64_1, kPrime64_2, kPrime64_3, 0x85EBCA77u, kPrime64_2 ^ kPrime64_3, 0xC2B2AE3Du, kPrime64_1 ^ kPrime32_1 } {
+}
+
+void ContentHasher::ConsumeStripe(uint8_t const* stripe) {
+    Accumulate(m_accumulators.data(), stripe, kSecret.m_bytes + m_stripeInBlock * 8);
+    if (++m_stripeInBlock == kStripesPerBlock) {
+        Scramble(m_accumulators.data(), kSecret.m_bytes + kSecretSize - kStripeSize);
+        m_stripeInBlock = 0;
+    }
+}
+
+void ContentHasher::Update(std::span<uint8_t const> data) {
+    m_length += data.size();
+    auto const* input = data.data();
+    size_t remaining = data.size();
+
+    if (m_bufferSize > 0) {
+        size_t fill = std::min(remaining, kStripeSize - m_bufferSize);
+        std::memcpy(m_buffer.data() + m_bufferSize, input, fill);
+        m_bufferSize += fill;
+        input += fill;
+        remaining -= fill;
+        if (m_bufferSize < kStripeSize) {
+            return;
+        }
+        ConsumeStripe(m_buffer.data());
+        m_bufferSize = 0;
+    }
+
+    for (; remaining >= kStripeSize; remaining -= kStripeSize, input += kStripeSize) {
+        ConsumeStripe(input);
+    }
+
+    if (remaining > 0) {
+        std::memcpy(m_buffer.data(), input, remaining);
+        m_bufferSize = remaining;
+    }
+}
+
+ContentHash ContentHasher::Finish() const {
+    alignas(16) std::array<uint64_t, 8> accumulators = m_accumulators;
+    if (m_bufferSize > 0) {
+        // The tail is zero padded; the length mixed in below tells it apart
+        // from input that really ends in zeros
+        alignas(16) std::array<uint8_t, kStripeSize> tail = {};
+        std::memcpy(tail.data(), m_buffer.data(), m_bufferSize);
+        Accumulate(accumulators.data(), tail.data(), kSecret.m_bytes + m_stripeInBlock * 8);
+    }
+
+    return ContentHash{
+        .m_low = Merge(accumulators.data(), kSecret.m_bytes + 11, m_length * kPrime64_1),
+        .m_high = Merge(accumulators.data(), kSecret.m_bytes + kSecretSize - kStripeSize - 11, ~(m_length * kPrime64_2)),
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+#include <functional>
+
+namespace okami {
+	// 128-bit content fingerprint, used to find byte-identical resources
+	struct ContentHash {
+		uint64_t m_low = 0;
+		uint64_t m_high = 0;
+
+		auto operator<=>(ContentHash const&) const = default;
+	};
+
+	// Streaming 128-bit hash for bulk data. Input is consumed in 64 byte
+	// stripes over eight 64-bit accumulators (the XXH3 construction: each
+	// lane multiplies the 32-bit halves of data xor key), so SSE2 processes
+	// two lanes per instruction. Not for cryptographic use. Feeding the same
+	// bytes in any number of Update calls gives the same hash.
+	class ContentHasher {
+	private:
+		static constexpr size_t kStripeSize = 64;
+
+		alignas(16) std::array<uint64_t, 8> m_accumulators;
+		alignas(16) std::array<uint8_t, kStripeSize> m_buffer = {};
+		size_t m_bufferSize = 0;
+		size_t m_stripeInBlock = 0;
+		uint64_t m_length = 0;
+
+		void ConsumeStripe(uint8_t const* stripe);
+
+	public:
+		ContentHasher();
+
+		void Update(std::span<uint8_t const> data);
+
+		// Hashes the object representation, so T must not contain padding
+		template <typename T>
+			requires std::is_trivially_copyable_v<T>
+		inline void UpdateValue(T const& value) {
+			static_assert(std::has_unique_object_representations_v<T> || std::is_floating_point_v<T>,
+				"Hash padded types field by field");
+			Update(std::span(reinterpret_cast<uint8_t const*>(&value), sizeof(T)));
+		}
+
+		inline void Update(std::string_view text) {
+			UpdateValue(static_cast<uint64_t>(text.size()));
+			Update(std::span(reinterpret_cast<uint8_t const*>(text.data()), text.size()));
+		}
+
+		ContentHash Finish() const;
+	};
+
+	inline ContentHash HashBytes(std::span<uint8_t const> data) {
+		ContentHasher hasher;
+		hasher.Update(data);
+		return hasher.Finish();
+	}
+}
+
+template <>
+struct std::hash<okami::ContentHash> {
+	inline size_t operator()(okami::ContentHash const& hash) const noexcept {
+		// The halves are already well mixed
+		return static_cast<size_t>(hash.m_low);
+	}
+};
@@ -0,0 +1,1038 @@
+#include "image_writer.hpp"
+#include "texture_conversion.hpp"
+#include "thread_pool.hpp"
+#include "lodepng.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    constexpr uint8_t kPngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    constexpr size_t kRowsPerTask = 16;
+
+    constexpr size_t kWindowSize = 32768;
+    constexpr size_t kWindowMask = kWindowSize - 1;
+    constexpr size_t kMinMatch = 3;
+    constexpr size_t kMaxMatch = 258;
+    constexpr size_t kMaxStoredBlock = 65535;
+    constexpr size_t kBlockTokens = 16 * 1024;
+    constexpr int kHashBits = 15;
+    constexpr uint32_t kAdlerBase = 65521;
+
+    constexpr uint16_t kLengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t kLengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    constexpr uint16_t kDistanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    constexpr uint8_t kDistanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    // Order code length code lengths are sent in
+    constexpr uint8_t kCodeLengthOrder[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    struct DeflateLevel {
+        // Candidates tried per match search
+        int m_chainLength;
+        // Matches this long end the search
+        size_t m_niceLength;
+        // Tries a match one byte later before taking one
+        bool m_lazy;
+    };
+
+    // Roughly zlib's settings for the same levels
+    constexpr DeflateLevel kDeflateLevels[10] = {
+        { 0, 0, false },
+        { 4, 8, false },
+        { 8, 16, false },
+        { 32, 32, false },
+        { 16, 16, true },
+        { 32, 32, true },
+        { 128, 128, true },
+        { 256, 128, true },
+        { 1024, 258, true },
+        { 4096, 258, true },
+    };
+
+    inline void StoreBigEndian(uint8_t* out, uint32_t value) {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+
+    inline uint32_t LoadLittleEndian32(uint8_t const* in) {
+        uint32_t value;
+        std::memcpy(&value, in, sizeof(value));
+        if constexpr (std::endian::native == std::endian::big) {
+            value = std::byteswap(value);
+        }
+        return value;
+    }
+
+    // CRC-32 as used by PNG chunks, eight bytes at a time
+    class Crc32 {
+    private:
+        uint32_t m_value = 0xFFFFFFFFu;
+
+        static std::array<std::array<uint32_t, 256>, 8> const& GetTables() {
+            static auto const tables = []() {
+                std::array<std::array<uint32_t, 256>, 8> result;
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t crc = i;
+                    for (int bit = 0; bit < 8; ++bit) {
+                        crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+                    }
+                    result[0][i] = crc;
+                }
+                for (size_t slice = 1; slice < 8; ++slice) {
+                    for (uint32_t i = 0; i < 256; ++i) {
+                        auto previous = result[slice - 1][i];
+                        result[slice][i] = (previous >> 8) ^ result[0][previous & 0xFF];
+                    }
+                }
+                return result;
+            }();
+            return tables;
+        }
+
+    public:
+        void Update(uint8_t const* data, size_t size) {
+            auto const& tables = GetTables();
+            auto crc = m_value;
+            for (; size >= 8; size -= 8, data += 8) {
+                auto low = LoadLittleEndian32(data) ^ crc;
+                auto high = LoadLittleEndian32(data + 4);
+                crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^
+                    tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24] ^
+                    tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^
+                    tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+            }
+            for (; size > 0; --size, ++data) {
+                crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+            }
+            m_value = crc;
+        }
+
+        inline uint32_t Finish() const {
+            return ~m_value;
+        }
+    };
+
+    class Adler32 {
+    private:
+        uint32_t m_a = 1;
+        uint32_t m_b = 0;
+
+    public:
+        void Update(uint8_t const* data, size_t size) {
+            // Largest run that cannot overflow the sums before reducing
+            constexpr size_t kMaxRun = 5552;
+            while (size > 0) {
+                auto run = std::min(size, kMaxRun);
+                for (size_t i = 0; i < run; ++i) {
+                    m_a += data[i];
+                    m_b += m_a;
+                }
+                m_a %= kAdlerBase;
+                m_b %= kAdlerBase;
+                data += run;
+                size -= run;
+            }
+        }
+
+        inline uint32_t Finish() const {
+            return (m_b << 16) | m_a;
+        }
+    };
+
+    // Checksum of two buffers one after the other, from the checksums of each
+    uint32_t CombineAdler32(uint32_t first, uint32_t second, size_t secondSize) {
+        uint64_t remainder = secondSize % kAdlerBase;
+        uint64_t a = first & 0xFFFF;
+        uint64_t b = (remainder * a) % kAdlerBase;
+        a += (second & 0xFFFF) + kAdlerBase - 1;
+        b += (first >> 16) + (second >> 16) + kAdlerBase - remainder;
+        return static_cast<uint32_t>(((b % kAdlerBase) << 16) | (a % kAdlerBase));
+    }
+
+    // Writes PNG chunks, checksumming each as it goes
+    class PngChunkWriter {
+    private:
+        std::ostream& m_stream;
+        Crc32 m_crc;
+
+    public:
+        PngChunkWriter(std::ostream& stream) : m_stream(stream) {}
+
+        void Begin(char const (&type)[5], size_t size) {
+            uint8_t header[8];
+            StoreBigEndian(header, static_cast<uint32_t>(size));
+            std::memcpy(header + 4, type, 4);
+            m_stream.write(reinterpret_cast<char const*>(header), sizeof(header));
+            m_crc = Crc32{};
+            m_crc.Update(header + 4, 4);
+        }
+
+        void Write(uint8_t const* data, size_t size) {
+            m_stream.write(reinterpret_cast<char const*>(data), size);
+            m_crc.Update(data, size);
+        }
+
+        void End() {
+            uint8_t crc[4];
+            StoreBigEndian(crc, m_crc.Finish());
+            m_stream.write(reinterpret_cast<char const*>(crc), sizeof(crc));
+        }
+
+        void Chunk(char const (&type)[5], std::span<uint8_t const> data) {
+            Begin(type, data.size());
+            Write(data.data(), data.size());
+            End();
+        }
+    };
+
+    // Packs bits least significant first, as deflate wants
+    class BitWriter {
+    private:
+        std::vector<uint8_t>& m_out;
+        uint64_t m_bits = 0;
+        int m_count = 0;
+
+    public:
+        BitWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        inline void Put(uint32_t bits, int count) {
+            m_bits |= static_cast<uint64_t>(bits) << m_count;
+            m_count += count;
+            while (m_count >= 8) {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+                m_bits >>= 8;
+                m_count -= 8;
+            }
+        }
+
+        inline void Align() {
+            if (m_count > 0) {
+                m_out.push_back(static_cast<uint8_t>(m_bits));
+                m_bits = 0;
+                m_count = 0;
+            }
+        }
+
+        // Non-final stored blocks holding the bytes as they are
+        void PutStored(uint8_t const* data, size_t size) {
+            do {
+                auto length = static_cast<uint16_t>(std::min(size, kMaxStoredBlock));
+                Put(0, 3);
+                Align();
+                m_out.push_back(static_cast<uint8_t>(length));
+                m_out.push_back(static_cast<uint8_t>(length >> 8));
+                m_out.push_back(static_cast<uint8_t>(~length));
+                m_out.push_back(static_cast<uint8_t>(~length >> 8));
+                m_out.insert(m_out.end(), data, data + length);
+                data += length;
+                size -= length;
+            } while (size > 0);
+        }
+    };
+
+    struct DeflateTables {
+        std::array<uint8_t, kMaxMatch + 1> m_lengthCodes;
+        // Indexed by distance - 1 below 256, by 256 + ((distance - 1) >> 7) above
+        std::array<uint8_t, 512> m_distanceCodes;
+
+        DeflateTables() {
+            for (uint8_t code = 0; code < 29; ++code) {
+                for (size_t length = kLengthBase[code]; length < kLengthBase[code] + (1u << kLengthExtra[code]) && length <= kMaxMatch; ++length) {
+                    m_lengthCodes[length] = code;
+                }
+            }
+            m_lengthCodes[kMaxMatch] = 28;
+            for (uint8_t code = 0; code < 30; ++code) {
+                for (size_t distance = kDistanceBase[code]; distance < kDistanceBase[code] + (1u << kDistanceExtra[code]); ++distance) {
+                    auto index = distance - 1 < 256 ? distance - 1 : 256 + ((distance - 1) >> 7);
+                    m_distanceCodes[index] = code;
+                }
+            }
+        }
+
+        inline uint8_t GetDistanceCode(size_t distance) const {
+            return distance - 1 < 256 ? m_distanceCodes[distance - 1] : m_distanceCodes[256 + ((distance - 1) >> 7)];
+        }
+
+        static DeflateTables const& Get() {
+            static DeflateTables const tables;
+            return tables;
+        }
+    };
+
+    // Canonical codes for the lengths, bit reversed for BitWriter
+    void BuildHuffmanCodes(unsigned const* lengths, size_t count, uint16_t* codes) {
+        std::array<uint16_t, 16> lengthCounts = {};
+        for (size_t i = 0; i < count; ++i) {
+            ++lengthCounts[lengths[i]];
+        }
+        lengthCounts[0] = 0;
+
+        std::array<uint16_t, 16> nextCode = {};
+        uint16_t code = 0;
+        for (size_t bits = 1; bits < 16; ++bits) {
+            code = static_cast<uint16_t>((code + lengthCounts[bits - 1]) << 1);
+            nextCode[bits] = code;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            auto length = lengths[i];
+            if (length == 0) {
+                codes[i] = 0;
+                continue;
+            }
+            auto value = nextCode[length]++;
+            uint16_t reversed = 0;
+            for (unsigned bit = 0; bit < length; ++bit) {
+                reversed = static_cast<uint16_t>((reversed << 1) | ((value >> bit) & 1));
+            }
+            codes[i] = reversed;
+        }
+    }
+
+    // Literal when m_distance is zero
+    struct Token {
+        uint16_t m_length;
+        uint16_t m_distance;
+    };
+
+    // Deflates one piece of a stream into non-final blocks followed by a
+    // sync flush, so pieces deflated separately can be concatenated. Matches
+    // may reach up to a window back into the bytes before the piece.
+    class PieceDeflater {
+    private:
+        uint8_t const* m_data;
+        size_t m_size;
+        DeflateLevel m_level;
+        DeflateTables const& m_tables = DeflateTables::Get();
+        std::vector<int32_t> m_head;
+        std::vector<int32_t> m_prev;
+        std::vector<Token> m_tokens;
+        size_t m_nextInsert = 0;
+
+        inline uint32_t Hash(size_t position) const {
+            auto const* p = m_data + position;
+            uint32_t bytes = p[0] | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+            return (bytes * 2654435761u) >> (32 - kHashBits);
+        }
+
+        inline void InsertUpTo(size_t position) {
+            auto last = std::min(position, m_size - std::min(m_size, kMinMatch - 1));
+            for (; m_nextInsert < last; ++m_nextInsert) {
+                auto& head = m_head[Hash(m_nextInsert)];
+                m_prev[m_nextInsert & kWindowMask] = head;
+                head = static_cast<int32_t>(m_nextInsert);
+            }
+        }
+
+        inline size_t GetMatchLength(uint8_t const* a, uint8_t const* b, size_t maxLength) const {
+            size_t length = 0;
+            for (; length + 8 <= maxLength; length += 8) {
+                uint64_t x, y;
+                std::memcpy(&x, a + length, 8);
+                std::memcpy(&y, b + length, 8);
+                if (x != y) {
+                    if constexpr (std::endian::native == std::endian::little) {
+                        return length + std::countr_zero(x ^ y) / 8;
+                    } else {
+                        return length + std::countl_zero(x ^ y) / 8;
+                    }
+                }
+            }
+            while (length < maxLength && a[length] == b[length]) {
+                ++length;
+            }
+            return length;
+        }
+
+        // Longest match before position, zero if none is at least kMinMatch
+        size_t FindMatch(size_t position, size_t end, size_t& distance) const {
+            auto maxLength = std::min(kMaxMatch, end - position);
+            if (maxLength < kMinMatch) {
+                return 0;
+            }
+            auto limit = position > kWindowSize ? position - kWindowSize : 0;
+            auto const* current = m_data + position;
+            size_t best = kMinMatch - 1;
+            auto candidate = m_head[Hash(position)];
+            for (int chain = m_level.m_chainLength; candidate >= 0 && static_cast<size_t>(candidate) >= limit && chain > 0; --chain) {
+                auto const* previous = m_data + candidate;
+                if (previous[best] == current[best] && previous[0] == current[0] && previous[1] == current[1]) {
+                    auto length = GetMatchLength(previous, current, maxLength);
+                    if (length > best) {
+                        best = length;
+                        distance = position - candidate;
+                        if (length >= m_level.m_niceLength || length == maxLength) {
+                            break;
+                        }
+                    }
+                }
+                candidate = m_prev[candidate & kWindowMask];
+            }
+            return best >= kMinMatch ? best : 0;
+        }
+
+        void WriteBlock(BitWriter& writer, size_t begin, size_t end) {
+            std::array<unsigned, 286> literalCounts = {};
+            std::array<unsigned, 30> distanceCounts = {};
+            size_t extraBits = 0;
+            for (auto const& token : m_tokens) {
+                if (token.m_distance == 0) {
+                    ++literalCounts[token.m_length];
+                } else {
+                    auto lengthCode = m_tables.m_lengthCodes[token.m_length];
+                    auto distanceCode = m_tables.GetDistanceCode(token.m_distance);
+                    ++literalCounts[257 + lengthCode];
+                    ++distanceCounts[distanceCode];
+                    extraBits += kLengthExtra[lengthCode] + kDistanceExtra[distanceCode];
+                }
+            }
+            literalCounts[256] = 1;
+
+            std::array<unsigned, 286> literalLengths;
+            std::array<unsigned, 30> distanceLengths;
+            lodepng_huffman_code_lengths(literalLengths.data(), literalCounts.data(), literalLengths.size(), 15);
+            lodepng_huffman_code_lengths(distanceLengths.data(), distanceCounts.data(), distanceLengths.size(), 15);
+
+            size_t literalCount = 286;
+            while (literalCount > 257 && literalLengths[literalCount - 1] == 0) {
+                --literalCount;
+            }
+            size_t distanceCount = 30;
+            while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0) {
+                --distanceCount;
+            }
+
+            // Both code lengths run length encoded together, as symbol and
+            // repeat count pairs
+            std::array<unsigned, 286 + 30> lengths;
+            std::copy_n(literalLengths.begin(), literalCount, lengths.begin());
+            std::copy_n(distanceLengths.begin(), distanceCount, lengths.begin() + literalCount);
+            auto lengthCount = literalCount + distanceCount;
+
+            std::vector<std::pair<uint8_t, uint8_t>> runs;
+            std::array<unsigned, 19> codeLengthCounts = {};
+            auto addRun = [&](unsigned symbol, unsigned extra) {
+                runs.emplace_back(static_cast<uint8_t>(symbol), static_cast<uint8_t>(extra));
+                ++codeLengthCounts[symbol];
+            };
+            for (size_t i = 0; i < lengthCount;) {
+                auto length = lengths[i];
+                size_t run = 1;
+                while (i + run < lengthCount && lengths[i + run] == length) {
+                    ++run;
+                }
+                i += run;
+
+                if (length == 0) {
+                    for (; run >= 11; run -= std::min<size_t>(run, 138)) {
+                        addRun(18, static_cast<unsigned>(std::min<size_t>(run, 138) - 11));
+                    }
+                    if (run >= 3) {
+                        addRun(17, static_cast<unsigned>(run - 3));
+                        run = 0;
+                    }
+                } else {
+                    addRun(length, 0);
+                    --run;
+                    for (; run >= 3; run -= std::min<size_t>(run, 6)) {
+                        addRun(16, static_cast<unsigned>(std::min<size_t>(run, 6) - 3));
+                    }
+                }
+                for (; run > 0; --run) {
+                    addRun(length, 0);
+                }
+            }
+
+            std::array<unsigned, 19> codeLengthLengths;
+            lodepng_huffman_code_lengths(codeLengthLengths.data(), codeLengthCounts.data(), codeLengthLengths.size(), 7);
+            size_t codeLengthCount = 19;
+            while (codeLengthCount > 4 && codeLengthLengths[kCodeLengthOrder[codeLengthCount - 1]] == 0) {
+                --codeLengthCount;
+            }
+
+            // Fall back to storing blocks that would not shrink
+            size_t bits = 3 + 14 + 3 * codeLengthCount + extraBits;
+            for (auto const& [symbol, extra] : runs) {
+                bits += codeLengthLengths[symbol] + (symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0);
+            }
+            for (size_t i = 0; i < literalCounts.size(); ++i) {
+                bits += size_t(literalCounts[i]) * literalLengths[i];
+            }
+            for (size_t i = 0; i < distanceCounts.size(); ++i) {
+                bits += size_t(distanceCounts[i]) * distanceLengths[i];
+            }
+            auto size = end - begin;
+            auto storedBits = (size + 5 * ((size + kMaxStoredBlock - 1) / kMaxStoredBlock)) * 8;
+            if (storedBits <= bits) {
+                writer.PutStored(m_data + begin, size);
+                m_tokens.clear();
+                return;
+            }
+
+            std::array<uint16_t, 286> literalCodes;
+            std::array<uint16_t, 30> distanceCodes;
+            std::array<uint16_t, 19> codeLengthCodes;
+            BuildHuffmanCodes(literalLengths.data(), literalLengths.size(), literalCodes.data());
+            BuildHuffmanCodes(distanceLengths.data(), distanceLengths.size(), distanceCodes.data());
+            BuildHuffmanCodes(codeLengthLengths.data(), codeLengthLengths.size(), codeLengthCodes.data());
+
+            writer.Put(0, 1);
+            writer.Put(2, 2);
+            writer.Put(static_cast<uint32_t>(literalCount - 257), 5);
+            writer.Put(static_cast<uint32_t>(distanceCount - 1), 5);
+            writer.Put(static_cast<uint32_t>(codeLengthCount - 4), 4);
+            for (size_t i = 0; i < codeLengthCount; ++i) {
+                writer.Put(codeLengthLengths[kCodeLengthOrder[i]], 3);
+            }
+            for (auto const& [symbol, extra] : runs) {
+                writer.Put(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+                if (symbol >= 16) {
+                    writer.Put(extra, symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+                }
+            }
+
+            for (auto const& token : m_tokens) {
+                if (token.m_distance == 0) {
+                    writer.Put(literalCodes[token.m_length], literalLengths[token.m_length]);
+                    continue;
+                }
+                auto lengthCode = m_tables.m_lengthCodes[token.m_length];
+                writer.Put(literalCodes[257 + lengthCode], literalLengths[257 + lengthCode]);
+                writer.Put(token.m_length - kLengthBase[lengthCode], kLengthExtra[lengthCode]);
+                auto distanceCode = m_tables.GetDistanceCode(token.m_distance);
+                writer.Put(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+                writer.Put(token.m_distance - kDistanceBase[distanceCode], kDistanceExtra[distanceCode]);
+            }
+            writer.Put(literalCodes[256], literalLengths[256]);
+            m_tokens.clear();
+        }
+
+    public:
+        PieceDeflater(std::span<uint8_t const> data, DeflateLevel const& level) :
+            m_data(data.data()),
+            m_size(data.size()),
+            m_level(level),
+            m_head(size_t(1) << kHashBits),
+            m_prev(kWindowSize) {
+            m_tokens.reserve(kBlockTokens);
+        }
+
+        void Deflate(size_t begin, size_t end, std::vector<uint8_t>& out) {
+            std::fill(m_head.begin(), m_head.end(), -1);
+            m_nextInsert = begin > kWindowSize ? begin - kWindowSize : 0;
+            m_tokens.clear();
+
+            BitWriter writer(out);
+            auto blockBegin = begin;
+            for (auto position = begin; position < end;) {
+                InsertUpTo(position);
+                size_t distance = 0;
+                auto length = FindMatch(position, end, distance);
+
+                if (length > 0 && m_level.m_lazy) {
+                    while (length < m_level.m_niceLength && position + 1 < end) {
+                        InsertUpTo(position + 1);
+                        size_t nextDistance = 0;
+                        auto nextLength = FindMatch(position + 1, end, nextDistance);
+                        if (nextLength <= length) {
+                            break;
+                        }
+                        m_tokens.push_back(Token{ m_data[position], 0 });
+                        ++position;
+                        length = nextLength;
+                        distance = nextDistance;
+                    }
+                }
+
+                if (length > 0) {
+                    m_tokens.push_back(Token{ static_cast<uint16_t>(length), static_cast<uint16_t>(distance) });
+                    // The fast levels do not index the inside of long matches
+                    if (!m_level.m_lazy && length > m_level.m_niceLength) {
+                        m_nextInsert = position + length;
+                    }
+                    position += length;
+                } else {
+                    m_tokens.push_back(Token{ m_data[position], 0 });
+                    ++position;
+                }
+
+                if (m_tokens.size() >= kBlockTokens) {
+                    WriteBlock(writer, blockBegin, position);
+                    blockBegin = position;
+                }
+            }
+            if (!m_tokens.empty()) {
+                WriteBlock(writer, blockBegin, end);
+            }
+
+            // Sync flush: an empty stored block leaves the stream byte aligned
+            writer.Put(0, 3);
+            writer.Align();
+            out.insert(out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+        }
+    };
+
+    inline uint8_t Paeth(int a, int b, int c) {
+        auto p = a + b - c;
+        auto pa = std::abs(p - a);
+        auto pb = std::abs(p - b);
+        auto pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) {
+            return static_cast<uint8_t>(a);
+        }
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    // Filters row y into out, filter type byte first. Fast levels use Up
+    // (Sub for the first row); the others pick the filter with the smallest
+    // sum of absolute differences for each row, as libpng does.
+    void FilterRow(ImageView const& image, uint32_t y, bool adaptive, uint8_t* out, std::vector<uint8_t>& scratch) {
+        auto bpp = image.m_channels;
+        auto rowSize = size_t(image.m_width) * bpp;
+        auto const* row = image.m_data + y * image.m_rowPitch;
+        auto const* prior = y > 0 ? row - image.m_rowPitch : nullptr;
+
+        auto filter = [&](int type, uint8_t* dest) {
+            for (size_t i = 0; i < rowSize; ++i) {
+                int a = i >= bpp ? row[i - bpp] : 0;
+                int b = prior ? prior[i] : 0;
+                int c = prior && i >= bpp ? prior[i - bpp] : 0;
+                int predicted = 0;
+                switch (type) {
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) >> 1; break;
+                    case 4: predicted = Paeth(a, b, c); break;
+                }
+                dest[i] = static_cast<uint8_t>(row[i] - predicted);
+            }
+        };
+
+        if (!adaptive) {
+            if (prior) {
+                out[0] = 2;
+                for (size_t i = 0; i < rowSize; ++i) {
+                    out[i + 1] = static_cast<uint8_t>(row[i] - prior[i]);
+                }
+            } else {
+                out[0] = 1;
+                filter(1, out + 1);
+            }
+            return;
+        }
+
+        scratch.resize(rowSize);
+        uint64_t bestSum = UINT64_MAX;
+        for (int type = 0; type < 5; ++type) {
+            auto* dest = type == 0 ? out + 1 : scratch.data();
+            filter(type, dest);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < rowSize; ++i) {
+                sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(dest[i])));
+            }
+            if (sum < bestSum) {
+                bestSum = sum;
+                out[0] = static_cast<uint8_t>(type);
+                if (type != 0) {
+                    std::memcpy(out + 1, scratch.data(), rowSize);
+                }
+            }
+        }
+    }
+
+    // Stored deflate blocks written straight from the image rows
+    void WriteStoredPngData(PngChunkWriter& writer, ImageView const& image, size_t streamSize) {
+        Adler32 adler;
+        auto streamLeft = streamSize;
+        size_t blockLeft = 0;
+        auto write = [&](uint8_t const* data, size_t size) {
+            while (size > 0) {
+                if (blockLeft == 0) {
+                    auto length = static_cast<uint16_t>(std::min(streamLeft, kMaxStoredBlock));
+                    uint8_t header[5] = {
+                        static_cast<uint8_t>(length == streamLeft ? 1 : 0),
+                        static_cast<uint8_t>(length),
+                        static_cast<uint8_t>(length >> 8),
+                        static_cast<uint8_t>(~length),
+                        static_cast<uint8_t>(~length >> 8) };
+                    writer.Write(header, sizeof(header));
+                    blockLeft = length;
+                    streamLeft -= length;
+                }
+                auto part = std::min(size, blockLeft);
+                writer.Write(data, part);
+                adler.Update(data, part);
+                data += part;
+                size -= part;
+                blockLeft -= part;
+            }
+        };
+
+        uint8_t const zlibHeader[2] = { 0x78, 0x01 };
+        writer.Write(zlibHeader, sizeof(zlibHeader));
+        uint8_t const filterNone = 0;
+        auto rowSize = size_t(image.m_width) * image.m_channels;
+        for (uint32_t y = 0; y < image.m_height; ++y) {
+            write(&filterNone, 1);
+            write(image.m_data + y * image.m_rowPitch, rowSize);
+        }
+        uint8_t trailer[4];
+        StoreBigEndian(trailer, adler.Finish());
+        writer.Write(trailer, sizeof(trailer));
+    }
+
+    Error WritePng(std::ostream& stream, ImageView const& image, ImageWriteParams const& params) {
+        if (params.m_pngLevel < 0 || params.m_pngLevel > 9) {
+            return Error("PNG compression level must be between 0 and 9");
+        }
+        static constexpr uint8_t kColorTypes[5] = { 0, 0, 4, 2, 6 };
+
+        PngChunkWriter writer(stream);
+        stream.write(reinterpret_cast<char const*>(kPngSignature), sizeof(kPngSignature));
+
+        uint8_t header[13];
+        StoreBigEndian(header, image.m_width);
+        StoreBigEndian(header + 4, image.m_height);
+        header[8] = 8;
+        header[9] = kColorTypes[image.m_channels];
+        header[10] = 0;
+        header[11] = 0;
+        header[12] = 0;
+        writer.Chunk("IHDR", header);
+
+        auto rowSize = size_t(image.m_width) * image.m_channels;
+        auto streamSize = (rowSize + 1) * image.m_height;
+        if (streamSize > INT32_MAX) {
+            return Error("Image is too large to write as PNG");
+        }
+
+        if (params.m_pngLevel == 0) {
+            auto blockCount = (streamSize + kMaxStoredBlock - 1) / kMaxStoredBlock;
+            writer.Begin("IDAT", 2 + 5 * blockCount + streamSize + 4);
+            WriteStoredPngData(writer, image, streamSize);
+            writer.End();
+        } else {
+            auto const& level = kDeflateLevels[params.m_pngLevel];
+
+            std::vector<uint8_t> filtered(streamSize);
+            ParallelFor(image.m_height, kRowsPerTask, [&](size_t begin, size_t end) {
+                std::vector<uint8_t> scratch;
+                for (size_t y = begin; y < end; ++y) {
+                    FilterRow(image, static_cast<uint32_t>(y), level.m_lazy, &filtered[y * (rowSize + 1)], scratch);
+                }
+            });
+
+            auto pieceSize = params.m_pngChunkSize > 0 ? std::min(params.m_pngChunkSize, streamSize) : streamSize;
+            auto pieceCount = (streamSize + pieceSize - 1) / pieceSize;
+            std::vector<std::vector<uint8_t>> pieces(pieceCount);
+            std::vector<uint32_t> checksums(pieceCount);
+            ParallelFor(pieceCount, 1, [&](size_t begin, size_t end) {
+                PieceDeflater deflater(filtered, level);
+                for (size_t i = begin; i < end; ++i) {
+                    auto pieceBegin = i * pieceSize;
+                    auto pieceEnd = std::min(pieceBegin + pieceSize, streamSize);
+                    auto& out = pieces[i];
+                    out.reserve(pieceEnd - pieceBegin + 64);
+                    if (i == 0) {
+                        uint8_t flags = params.m_pngLevel == 1 ? 0x01 : params.m_pngLevel < 6 ? 0x5E : params.m_pngLevel == 6 ? 0x9C : 0xDA;
+                        out.insert(out.end(), { 0x78, flags });
+                    }
+                    deflater.Deflate(pieceBegin, pieceEnd, out);
+
+                    Adler32 adler;
+                    adler.Update(&filtered[pieceBegin], pieceEnd - pieceBegin);
+                    checksums[i] = adler.Finish();
+                }
+            });
+
+            auto checksum = checksums[0];
+            for (size_t i = 1; i < pieceCount; ++i) {
+                checksum = CombineAdler32(checksum, checksums[i], std::min(pieceSize, streamSize - i * pieceSize));
+            }
+            // An empty final stored block ends the stream
+            auto& last = pieces.back();
+            last.insert(last.end(), { 0x01, 0x00, 0x00, 0xFF, 0xFF });
+            last.resize(last.size() + 4);
+            StoreBigEndian(&last[last.size() - 4], checksum);
+
+            for (auto const& piece : pieces) {
+                writer.Chunk("IDAT", piece);
+            }
+        }
+
+        writer.Chunk("IEND", {});
+        return {};
+    }
+
+    Error WriteQoi(std::ostream& stream, ImageView const& image) {
+        if (image.m_channels != 3 && image.m_channels != 4) {
+            return Error("QOI only holds RGB and RGBA images");
+        }
+        constexpr uint8_t kOpIndex = 0x00;
+        constexpr uint8_t kOpDiff = 0x40;
+        constexpr uint8_t kOpLuma = 0x80;
+        constexpr uint8_t kOpRun = 0xC0;
+        constexpr uint8_t kOpRgb = 0xFE;
+        constexpr uint8_t kOpRgba = 0xFF;
+
+        struct Pixel {
+            uint8_t r, g, b, a;
+            bool operator==(Pixel const&) const = default;
+        };
+
+        auto pixelCount = size_t(image.m_width) * image.m_height;
+        std::vector<uint8_t> out(14 + pixelCount * (image.m_channels + 1) + 8);
+        auto* cursor = out.data();
+        std::memcpy(cursor, "qoif", 4);
+        StoreBigEndian(cursor + 4, image.m_width);
+        StoreBigEndian(cursor + 8, image.m_height);
+        cursor[12] = static_cast<uint8_t>(image.m_channels);
+        cursor[13] = 0; // sRGB color, linear alpha
+        cursor += 14;
+
+        std::array<Pixel, 64> seen = {};
+        Pixel previous{ 0, 0, 0, 255 };
+        uint32_t run = 0;
+        for (uint32_t y = 0; y < image.m_height; ++y) {
+            auto const* row = image.m_data + y * image.m_rowPitch;
+            for (uint32_t x = 0; x < image.m_width; ++x) {
+                auto const* texel = row + size_t(x) * image.m_channels;
+                Pixel pixel{ texel[0], texel[1], texel[2], image.m_channels == 4 ? texel[3] : uint8_t(255) };
+
+                if (pixel == previous) {
+                    if (++run == 62) {
+                        *cursor++ = kOpRun | (run - 1);
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    *cursor++ = kOpRun | (run - 1);
+                    run = 0;
+                }
+
+                auto index = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+                if (seen[index] == pixel) {
+                    *cursor++ = static_cast<uint8_t>(kOpIndex | index);
+                } else {
+                    seen[index] = pixel;
+                    if (pixel.a == previous.a) {
+                        auto dr = static_cast<int8_t>(pixel.r - previous.r);
+                        auto dg = static_cast<int8_t>(pixel.g - previous.g);
+                        auto db = static_cast<int8_t>(pixel.b - previous.b);
+                        auto drg = dr - dg;
+                        auto dbg = db - dg;
+                        if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                            *cursor++ = static_cast<uint8_t>(kOpDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                        } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                            *cursor++ = static_cast<uint8_t>(kOpLuma | (dg + 32));
+                            *cursor++ = static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8));
+                        } else {
+                            *cursor++ = kOpRgb;
+                            *cursor++ = pixel.r;
+                            *cursor++ = pixel.g;
+                            *cursor++ = pixel.b;
+                        }
+                    } else {
+                        *cursor++ = kOpRgba;
+                        *cursor++ = pixel.r;
+                        *cursor++ = pixel.g;
+                        *cursor++ = pixel.b;
+                        *cursor++ = pixel.a;
+                    }
+                }
+                previous = pixel;
+            }
+        }
+        if (run > 0) {
+            *cursor++ = kOpRun | (run - 1);
+        }
+        constexpr uint8_t kEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        std::memcpy(cursor, kEnd, sizeof(kEnd));
+        cursor += sizeof(kEnd);
+
+        stream.write(reinterpret_cast<char const*>(out.data()), cursor - out.data());
+        return {};
+    }
+
+    Error WritePpm(std::ostream& stream, ImageView const& image) {
+        if (image.m_channels == 2) {
+            return Error("PPM cannot hold two channel images");
+        }
+        auto header = std::string(image.m_channels == 1 ? "P5" : "P6") + "\n" +
+            std::to_string(image.m_width) + " " + std::to_string(image.m_height) + "\n255\n";
+        stream.write(header.data(), header.size());
+
+        if (image.m_channels != 4) {
+            auto rowSize = size_t(image.m_width) * image.m_channels;
+            for (uint32_t y = 0; y < image.m_height; ++y) {
+                stream.write(reinterpret_cast<char const*>(image.m_data + y * image.m_rowPitch), rowSize);
+            }
+            return {};
+        }
+
+        // Alpha is dropped a row at a time
+        std::vector<uint8_t> row(size_t(image.m_width) * 3);
+        for (uint32_t y = 0; y < image.m_height; ++y) {
+            auto const* source = image.m_data + y * image.m_rowPitch;
+            for (uint32_t x = 0; x < image.m_width; ++x) {
+                std::memcpy(&row[x * 3], source + x * 4, 3);
+            }
+            stream.write(reinterpret_cast<char const*>(row.data()), row.size());
+        }
+        return {};
+    }
+
+    void WriteRaw(std::ostream& stream, ImageView const& image) {
+        auto rowSize = size_t(image.m_width) * image.m_channels;
+        if (image.m_rowPitch == rowSize) {
+            stream.write(reinterpret_cast<char const*>(image.m_data), rowSize * image.m_height);
+            return;
+        }
+        for (uint32_t y = 0; y < image.m_height; ++y) {
+            stream.write(reinterpret_cast<char const*>(image.m_data + y * image.m_rowPitch), rowSize);
+        }
+    }
+}
+
+std::optional<ImageFileFormat> okami::GetImageFileFormat(std::filesystem::path const& path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".png") {
+        return ImageFileFormat::PNG;
+    }
+    if (extension == ".qoi") {
+        return ImageFileFormat::QOI;
+    }
+    if (extension == ".ppm" || extension == ".pgm") {
+        return ImageFileFormat::PPM;
+    }
+    if (extension == ".raw") {
+        return ImageFileFormat::Raw;
+    }
+    return std::nullopt;
+}
+
+std::string_view okami::GetImageFileExtension(ImageFileFormat format) {
+    switch (format) {
+        case ImageFileFormat::QOI:
+            return ".qoi";
+        case ImageFileFormat::PPM:
+            return ".ppm";
+        case ImageFileFormat::Raw:
+            return ".raw";
+        default:
+            return ".png";
+    }
+}
+
+Error okami::WriteImage(std::ostream& stream, ImageView const& image, ImageFileFormat format, ImageWriteParams const& params) {
+    if (image.m_width == 0 || image.m_height == 0) {
+        return Error("Cannot write an empty image");
+    }
+    if (format != ImageFileFormat::Raw && (image.m_channels == 0 || image.m_channels > 4)) {
+        return Error("Images must have between 1 and 4 channels");
+    }
+
+    switch (format) {
+        case ImageFileFormat::PNG:
+            return WritePng(stream, image, params);
+        case ImageFileFormat::QOI:
+            return WriteQoi(stream, image);
+        case ImageFileFormat::PPM:
+            return WritePpm(stream, image);
+        case ImageFileFormat::Raw:
+            WriteRaw(stream, image);
+            return {};
+    }
+    return Error("Unknown image file format");
+}
+
+Error okami::WriteImage(std::filesystem::path const& path, ImageView const& image, ImageWriteParams const& params) {
+    auto format = params.m_format.value_or(GetImageFileFormat(path).value_or(ImageFileFormat::PNG));
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return Error("Failed to open file for writing: " + path.string());
+    }
+
+    auto error = WriteImage(file, image, format, params);
+    OKAMI_ERROR_RETURN(error);
+
+    file.close();
+    if (!file.good()) {
+        return Error("Failed to write image to file: " + path.string());
+    }
+    return {};
+}
+
+Error RawTexture::Save(const std::filesystem::path& path, ImageWriteParams const& params) const {
+    if (m_info.type != TextureType::TEXTURE_2D) {
+        return Error("Only 2D textures can be saved as images");
+    }
+    if (IsBlockCompressed(m_info.format)) {
+        return Error("Block compressed textures cannot be saved as images");
+    }
+    if (m_info.mipLevels > 1) {
+        LOG(WARNING) << "Image export will only save the first mip level of texture";
+    }
+    if (m_info.arraySize > 1) {
+        LOG(WARNING) << "Image export will only save the first array slice of texture";
+    }
+
+    auto format = params.m_format.value_or(GetImageFileFormat(path).value_or(ImageFileFormat::PNG));
+    auto writeParams = params;
+    writeParams.m_format = format;
+
+    auto channels = GetChannelCount(m_info.format);
+    auto stride = GetPixelStride(m_info.format);
+    ImageView image{
+        .m_data = m_data.data(),
+        .m_width = m_info.width,
+        .m_height = m_info.height,
+        .m_channels = channels,
+        .m_rowPitch = size_t(m_info.width) * stride
+    };
+
+    // Raw files hold the texels as they are, floats included
+    if (format == ImageFileFormat::Raw) {
+        image.m_channels = stride;
+        return WriteImage(path, image, writeParams);
+    }
+    if (stride == channels) {
+        return WriteImage(path, image, writeParams);
+    }
+
+    // Float formats are stored as 8 bit
+    auto texelCount = size_t(m_info.width) * m_info.height;
+    std::vector<uint8_t> converted(texelCount * channels);
+    static constexpr TextureFormat kUnorm8Formats[5] = {
+        TextureFormat::R8, TextureFormat::R8, TextureFormat::RG8, TextureFormat::RGB8, TextureFormat::RGBA8 };
+    ConvertPixels(m_data.subspan(0, texelCount * stride), m_info.format, converted, kUnorm8Formats[channels]);
+    image.m_data = converted.data();
+    image.m_rowPitch = size_t(m_info.width) * channels;
+    return WriteImage(path, image, writeParams);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+#include "common.hpp"
+#include "texture.hpp"
+
+namespace okami {
+	enum class ImageFileFormat {
+		PNG,
+		// Quite OK Image format; lossless, much faster to write than PNG
+		// and usually within a third of its size. RGB and RGBA only.
+		QOI,
+		// Binary PGM for one channel, PPM for three; alpha is dropped
+		PPM,
+		// Texels as stored, without a header
+		Raw,
+	};
+
+	struct ImageWriteParams {
+		// Format to write; chosen from the file extension when unset, with
+		// PNG for unknown extensions
+		std::optional<ImageFileFormat> m_format;
+		// 0 stores the pixels without compressing them, the fastest; 1 to 9
+		// trade speed for size like zlib's levels
+		int m_pngLevel = 6;
+		// Filtered bytes per independently deflated piece of a PNG. Pieces
+		// are compressed in parallel, each primed with the window before
+		// it, so smaller pieces cost little size. Zero deflates in one piece.
+		size_t m_pngChunkSize = 256 * 1024;
+	};
+
+	// Rows of 8 bit pixels, m_rowPitch bytes apart
+	struct ImageView {
+		uint8_t const* m_data;
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_channels;
+		size_t m_rowPitch;
+	};
+
+	// Format for an extension such as ".png", if it is one we write
+	std::optional<ImageFileFormat> GetImageFileFormat(std::filesystem::path const& path);
+	std::string_view GetImageFileExtension(ImageFileFormat format);
+
+	// Writes the pixels straight from the view wherever the format stores
+	// them as they are: stored PNGs, three channel PPMs and raw files
+	Error WriteImage(std::ostream& stream, ImageView const& image, ImageFileFormat format, ImageWriteParams const& params = {});
+	Error WriteImage(std::filesystem::path const& path, ImageView const& image, ImageWriteParams const& params = {});
+}
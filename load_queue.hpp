@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "engine.hpp"
+
+namespace okami {
+	struct LoadQueueStats {
+		// Values waiting now, by priority
+		std::array<size_t, kLoadPriorityCount> m_queuedCount{};
+		size_t m_peakQueuedCount = 0;
+		// Totals since the queue was created. Popped values count under the
+		// priority they left with.
+		std::array<size_t, kLoadPriorityCount> m_poppedCount{};
+		size_t m_cancelledCount = 0;
+		size_t m_reprioritizedCount = 0;
+		// Seconds popped values spent queued, by the priority they left with
+		std::array<double, kLoadPriorityCount> m_waitSeconds{};
+
+		inline size_t GetQueuedCount() const {
+			size_t count = 0;
+			for (auto queued : m_queuedCount) {
+				count += queued;
+			}
+			return count;
+		}
+
+		inline double GetAverageWaitSeconds(LoadPriority priority) const {
+			auto index = static_cast<size_t>(priority);
+			return m_poppedCount[index] > 0 ? m_waitSeconds[index] / m_poppedCount[index] : 0.0;
+		}
+	};
+
+	// Pending loads, most urgent priority first and oldest first within a
+	// priority. Values pushed with a key can be found again: to move them to
+	// a more urgent priority when they are requested again, or to cancel
+	// them. Keys must be unique among queued values. Not thread safe.
+	template <typename T, typename Key = resource_id_t>
+	class LoadQueue {
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Item {
+			std::optional<Key> m_key;
+			LoadPriority m_priority;
+			Clock::time_point m_queuedAt;
+			T m_value;
+		};
+
+		using Iterator = typename std::list<Item>::iterator;
+
+		std::array<std::list<Item>, kLoadPriorityCount> m_items;
+		std::unordered_map<Key, Iterator> m_keys;
+		LoadQueueStats m_stats;
+
+		inline std::list<Item>& GetItems(LoadPriority priority) {
+			return m_items[static_cast<size_t>(priority)];
+		}
+
+		Item Take(Iterator it) {
+			auto& items = GetItems(it->m_priority);
+			if (it->m_key) {
+				m_keys.erase(*it->m_key);
+			}
+			m_stats.m_queuedCount[static_cast<size_t>(it->m_priority)]--;
+			Item item = std::move(*it);
+			items.erase(it);
+			return item;
+		}
+
+	public:
+		inline LoadQueueStats const& GetStats() const {
+			return m_stats;
+		}
+
+		inline size_t GetSize() const {
+			return m_stats.GetQueuedCount();
+		}
+
+		inline bool IsEmpty() const {
+			return GetSize() == 0;
+		}
+
+		// Values waiting at priority or a more urgent one
+		inline size_t GetSizeUpTo(LoadPriority priority) const {
+			size_t count = 0;
+			for (size_t i = 0; i <= static_cast<size_t>(priority); ++i) {
+				count += m_stats.m_queuedCount[i];
+			}
+			return count;
+		}
+
+		void Push(T value, LoadPriority priority, std::optional<Key> key = std::nullopt) {
+			auto& items = GetItems(priority);
+			items.push_back(Item{ key, priority, Clock::now(), std::move(value) });
+			if (key) {
+				// An older value under the same key can no longer be found
+				if (auto it = m_keys.find(*key); it != m_keys.end()) {
+					it->second->m_key.reset();
+					it->second = std::prev(items.end());
+				} else {
+					m_keys.emplace(*key, std::prev(items.end()));
+				}
+			}
+			m_stats.m_queuedCount[static_cast<size_t>(priority)]++;
+			m_stats.m_peakQueuedCount = std::max(m_stats.m_peakQueuedCount, GetSize());
+		}
+
+		inline std::optional<LoadPriority> GetPriority(Key const& key) const {
+			auto it = m_keys.find(key);
+			return it != m_keys.end() ? std::optional(it->second->m_priority) : std::nullopt;
+		}
+
+		// Moves a queued value to the back of a more urgent priority.
+		// Returns whether it moved; values are never made less urgent.
+		bool Reprioritize(Key const& key, LoadPriority priority) {
+			auto it = m_keys.find(key);
+			if (it == m_keys.end() || it->second->m_priority <= priority) {
+				return false;
+			}
+
+			auto& item = *it->second;
+			auto& from = GetItems(item.m_priority);
+			m_stats.m_queuedCount[static_cast<size_t>(item.m_priority)]--;
+			m_stats.m_queuedCount[static_cast<size_t>(priority)]++;
+			m_stats.m_reprioritizedCount++;
+			item.m_priority = priority;
+			// Splicing keeps the iterator in m_keys valid
+			auto& to = GetItems(priority);
+			to.splice(to.end(), from, it->second);
+			return true;
+		}
+
+		// Removes a queued value before it runs
+		std::optional<T> Cancel(Key const& key) {
+			auto it = m_keys.find(key);
+			if (it == m_keys.end()) {
+				return std::nullopt;
+			}
+			m_stats.m_cancelledCount++;
+			return std::move(Take(it->second).m_value);
+		}
+
+		// Next value to pop, if any
+		inline T* Peek() {
+			for (auto& items : m_items) {
+				if (!items.empty()) {
+					return &items.front().m_value;
+				}
+			}
+			return nullptr;
+		}
+
+		// Removes the most urgent value, storing the priority it left with
+		// in priority if given. Values isWanted rejects on the way are
+		// appended to cancelled instead of being returned.
+		template <typename F>
+		std::optional<T> Pop(F&& isWanted, std::vector<T>& cancelled, LoadPriority* priority = nullptr) {
+			for (auto& items : m_items) {
+				while (!items.empty()) {
+					auto item = Take(items.begin());
+					if (!isWanted(std::as_const(item.m_value))) {
+						m_stats.m_cancelledCount++;
+						cancelled.push_back(std::move(item.m_value));
+						continue;
+					}
+
+					if (priority) {
+						*priority = item.m_priority;
+					}
+					auto index = static_cast<size_t>(item.m_priority);
+					m_stats.m_poppedCount[index]++;
+					m_stats.m_waitSeconds[index] +=
+						std::chrono::duration<double>(Clock::now() - item.m_queuedAt).count();
+					return std::move(item.m_value);
+				}
+			}
+			return std::nullopt;
+		}
+
+		inline std::optional<T> Pop() {
+			std::vector<T> cancelled;
+			return Pop([](T const&) { return true; }, cancelled);
+		}
+
+		// Drops every queued value without counting it as cancelled
+		inline void Clear() {
+			for (auto& items : m_items) {
+				items.clear();
+			}
+			m_keys.clear();
+			m_stats.m_queuedCount = {};
+		}
+	};
+}
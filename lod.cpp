@@ -0,0 +1,425 @@
+#include "lod.hpp"
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+using namespace okami;
+
+namespace {
+    // Border edges are kept in place by perpendicular planes weighted this
+    // much more than the surface planes around them
+    constexpr double kBorderWeight = 10.0;
+    constexpr float kMinLodDistance = 1e-4f;
+
+    struct Quadric {
+        double m_a00 = 0, m_a01 = 0, m_a02 = 0, m_a11 = 0, m_a12 = 0, m_a22 = 0;
+        double m_b0 = 0, m_b1 = 0, m_b2 = 0;
+        double m_c = 0;
+        double m_weight = 0;
+
+        // Squared distance to the plane dot(normal, p) + offset = 0, times weight
+        static Quadric FromPlane(glm::dvec3 const& normal, double offset, double weight) {
+            Quadric q;
+            q.m_a00 = normal.x * normal.x * weight;
+            q.m_a01 = normal.x * normal.y * weight;
+            q.m_a02 = normal.x * normal.z * weight;
+            q.m_a11 = normal.y * normal.y * weight;
+            q.m_a12 = normal.y * normal.z * weight;
+            q.m_a22 = normal.z * normal.z * weight;
+            q.m_b0 = normal.x * offset * weight;
+            q.m_b1 = normal.y * offset * weight;
+            q.m_b2 = normal.z * offset * weight;
+            q.m_c = offset * offset * weight;
+            q.m_weight = weight;
+            return q;
+        }
+
+        Quadric& operator+=(Quadric const& o) {
+            m_a00 += o.m_a00; m_a01 += o.m_a01; m_a02 += o.m_a02;
+            m_a11 += o.m_a11; m_a12 += o.m_a12; m_a22 += o.m_a22;
+            m_b0 += o.m_b0; m_b1 += o.m_b1; m_b2 += o.m_b2;
+            m_c += o.m_c;
+            m_weight += o.m_weight;
+            return *this;
+        }
+
+        double Evaluate(glm::vec3 const& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double result =
+                m_a00 * x * x + m_a11 * y * y + m_a22 * z * z +
+                2.0 * (m_a01 * x * y + m_a02 * x * z + m_a12 * y * z) +
+                2.0 * (m_b0 * x + m_b1 * y + m_b2 * z) +
+                m_c;
+            return std::max(result, 0.0);
+        }
+    };
+
+    // Mean squared distance of p to the planes accumulated in a and b
+    float CollapseCost(Quadric const& a, Quadric const& b, glm::vec3 const& p) {
+        double weight = a.m_weight + b.m_weight;
+        if (weight <= 0.0) {
+            return 0.0f;
+        }
+        return static_cast<float>((a.Evaluate(p) + b.Evaluate(p)) / weight);
+    }
+
+    struct Collapse {
+        float m_cost;
+        uint32_t m_from;
+        uint32_t m_to;
+    };
+}
+
+Expected<SimplifyResult> okami::SimplifyMesh(
+    std::span<glm::vec3 const> positions,
+    std::span<uint32_t const> indices,
+    size_t targetIndexCount,
+    float targetError) {
+    if (indices.size() % 3 != 0) {
+        return std::unexpected(Error("Index count is not a multiple of 3"));
+    }
+    for (auto index : indices) {
+        if (index >= positions.size()) {
+            return std::unexpected(Error("Index out of range"));
+        }
+    }
+
+    // Vertices split along attribute seams share a position and are
+    // simplified as one; their separate indices are "wedges" of that position
+    VertexStream positionStream{
+        std::span(reinterpret_cast<uint8_t const*>(positions.data()), positions.size() * sizeof(glm::vec3)),
+        sizeof(glm::vec3)
+    };
+    auto weld = DeduplicateVertices(std::span(&positionStream, 1), positions.size());
+    auto const& positionOf = weld.m_remap;
+    size_t positionCount = weld.m_vertexCount;
+
+    std::vector<glm::vec3> welded(positionCount);
+    for (size_t v = 0; v < positions.size(); ++v) {
+        welded[positionOf[v]] = positions[v];
+    }
+
+    std::vector<uint32_t> triangles(indices.begin(), indices.end());
+    size_t triangleCount = triangles.size() / 3;
+    std::vector<bool> alive(triangleCount, true);
+    size_t liveCount = 0;
+
+    auto corner = [&](size_t t, size_t c) {
+        return positionOf[triangles[t * 3 + c]];
+    };
+
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        auto a = corner(t, 0), b = corner(t, 1), c = corner(t, 2);
+        if (a == b || b == c || a == c) {
+            alive[t] = false;
+            continue;
+        }
+        ++liveCount;
+
+        glm::dvec3 p0(welded[a]), p1(welded[b]), p2(welded[c]);
+        auto normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+        if (length <= 0.0) {
+            continue;
+        }
+        normal /= length;
+        auto plane = Quadric::FromPlane(normal, -glm::dot(normal, p0), length * 0.5);
+        quadrics[a] += plane;
+        quadrics[b] += plane;
+        quadrics[c] += plane;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(positionCount + 1);
+    std::vector<uint32_t> adjacency;
+
+    auto buildAdjacency = [&]() {
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (alive[t]) {
+                for (size_t c = 0; c < 3; ++c) {
+                    ++adjacencyOffsets[corner(t, c) + 1];
+                }
+            }
+        }
+        for (size_t p = 0; p < positionCount; ++p) {
+            adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+        }
+        adjacency.resize(adjacencyOffsets[positionCount]);
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (alive[t]) {
+                for (size_t c = 0; c < 3; ++c) {
+                    adjacency[cursor[corner(t, c)]++] = static_cast<uint32_t>(t);
+                }
+            }
+        }
+    };
+
+    auto neighborTriangles = [&](uint32_t p) {
+        return std::span(adjacency.data() + adjacencyOffsets[p], adjacency.data() + adjacencyOffsets[p + 1]);
+    };
+
+    auto contains = [&](size_t t, uint32_t p) {
+        return corner(t, 0) == p || corner(t, 1) == p || corner(t, 2) == p;
+    };
+
+    // Number of live triangles sharing the edge (a, b)
+    auto edgeValence = [&](uint32_t a, uint32_t b) {
+        uint32_t count = 0;
+        for (auto t : neighborTriangles(a)) {
+            count += alive[t] && contains(t, b);
+        }
+        return count;
+    };
+
+    // Open borders get constraint planes through each border edge, perpendicular to its triangle
+    buildAdjacency();
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (!alive[t]) {
+            continue;
+        }
+        glm::dvec3 p[3] = { glm::dvec3(welded[corner(t, 0)]), glm::dvec3(welded[corner(t, 1)]), glm::dvec3(welded[corner(t, 2)]) };
+        auto normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if (glm::length(normal) <= 0.0) {
+            continue;
+        }
+        normal = glm::normalize(normal);
+        for (size_t e = 0; e < 3; ++e) {
+            auto a = corner(t, e), b = corner(t, (e + 1) % 3);
+            if (edgeValence(a, b) != 1) {
+                continue;
+            }
+            auto edge = p[(e + 1) % 3] - p[e];
+            auto sideNormal = glm::cross(edge, normal);
+            double sideLength = glm::length(sideNormal);
+            if (sideLength <= 0.0) {
+                continue;
+            }
+            sideNormal /= sideLength;
+            auto plane = Quadric::FromPlane(sideNormal, -glm::dot(sideNormal, p[e]), glm::dot(edge, edge) * kBorderWeight);
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+        }
+    }
+
+    float maxCost = targetError * targetError;
+    float resultCost = 0.0f;
+    std::vector<uint8_t> border(positionCount);
+    std::vector<uint8_t> locked(positionCount);
+    std::vector<std::pair<uint32_t, uint32_t>> wedgeMap;
+
+    // Finds how every wedge at from continues at to, and rejects the collapse
+    // if a wedge has no counterpart (a seam would tear) or a triangle flips
+    auto tryCollapse = [&](uint32_t from, uint32_t to) {
+        wedgeMap.clear();
+        for (auto t : neighborTriangles(from)) {
+            if (!alive[t] || !contains(t, to)) {
+                continue;
+            }
+            uint32_t fromWedge = 0, toWedge = 0;
+            for (size_t c = 0; c < 3; ++c) {
+                if (corner(t, c) == from) {
+                    fromWedge = triangles[t * 3 + c];
+                } else if (corner(t, c) == to) {
+                    toWedge = triangles[t * 3 + c];
+                }
+            }
+            auto it = std::find_if(wedgeMap.begin(), wedgeMap.end(), [&](auto const& pair) { return pair.first == fromWedge; });
+            if (it == wedgeMap.end()) {
+                wedgeMap.emplace_back(fromWedge, toWedge);
+            }
+        }
+
+        for (auto t : neighborTriangles(from)) {
+            if (!alive[t] || contains(t, to)) {
+                continue;
+            }
+            glm::vec3 before[3];
+            glm::vec3 after[3];
+            for (size_t c = 0; c < 3; ++c) {
+                auto p = corner(t, c);
+                before[c] = welded[p];
+                after[c] = p == from ? welded[to] : welded[p];
+                if (p == from && std::find_if(wedgeMap.begin(), wedgeMap.end(),
+                    [&](auto const& pair) { return pair.first == triangles[t * 3 + c]; }) == wedgeMap.end()) {
+                    return false;
+                }
+            }
+            auto n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            auto n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(n0, n1) <= 0.0f) {
+                return false;
+            }
+        }
+
+        for (auto t : neighborTriangles(from)) {
+            if (!alive[t]) {
+                continue;
+            }
+            if (contains(t, to)) {
+                alive[t] = false;
+                --liveCount;
+                continue;
+            }
+            for (size_t c = 0; c < 3; ++c) {
+                auto& index = triangles[t * 3 + c];
+                for (auto const& [fromWedge, toWedge] : wedgeMap) {
+                    if (index == fromWedge) {
+                        index = toWedge;
+                        break;
+                    }
+                }
+            }
+        }
+        return true;
+    };
+
+    std::vector<Collapse> candidates;
+    std::vector<uint8_t> passLocked(positionCount);
+
+    while (liveCount * 3 > targetIndexCount) {
+        buildAdjacency();
+
+        // Classify vertices: on an open border, or touching a non-manifold
+        // edge (never collapsed)
+        std::fill(border.begin(), border.end(), 0);
+        std::fill(locked.begin(), locked.end(), 0);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (!alive[t]) {
+                continue;
+            }
+            for (size_t e = 0; e < 3; ++e) {
+                auto a = corner(t, e), b = corner(t, (e + 1) % 3);
+                auto valence = edgeValence(a, b);
+                if (valence == 1) {
+                    border[a] = border[b] = 1;
+                } else if (valence > 2) {
+                    locked[a] = locked[b] = 1;
+                }
+            }
+        }
+
+        auto allowed = [&](uint32_t from, uint32_t to) {
+            if (locked[from]) {
+                return false;
+            }
+            // Border vertices may only slide along their own border
+            return !border[from] || (border[to] && edgeValence(from, to) == 1);
+        };
+
+        candidates.clear();
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (!alive[t]) {
+                continue;
+            }
+            for (size_t e = 0; e < 3; ++e) {
+                auto a = corner(t, e), b = corner(t, (e + 1) % 3);
+                // Interior edges show up in two triangles; take them once
+                if (a > b && !border[a]) {
+                    continue;
+                }
+                float costAB = allowed(a, b) ? CollapseCost(quadrics[a], quadrics[b], welded[b]) : INFINITY;
+                float costBA = allowed(b, a) ? CollapseCost(quadrics[a], quadrics[b], welded[a]) : INFINITY;
+                if (std::min(costAB, costBA) > maxCost) {
+                    continue;
+                }
+                candidates.push_back(costAB <= costBA ? Collapse{ costAB, a, b } : Collapse{ costBA, b, a });
+            }
+        }
+        if (candidates.empty()) {
+            break;
+        }
+        std::sort(candidates.begin(), candidates.end(), [](auto const& x, auto const& y) {
+            return x.m_cost < y.m_cost;
+        });
+
+        // Collapses in one pass must not overlap: each one locks the ring
+        // around the collapsed vertex, whose triangles it rewrites
+        std::fill(passLocked.begin(), passLocked.end(), 0);
+        size_t collapsed = 0;
+        for (auto const& collapse : candidates) {
+            if (liveCount * 3 <= targetIndexCount) {
+                break;
+            }
+            if (passLocked[collapse.m_from] || passLocked[collapse.m_to]) {
+                continue;
+            }
+            if (!tryCollapse(collapse.m_from, collapse.m_to)) {
+                continue;
+            }
+            for (auto t : neighborTriangles(collapse.m_from)) {
+                for (size_t c = 0; c < 3; ++c) {
+                    passLocked[corner(t, c)] = 1;
+                }
+            }
+            passLocked[collapse.m_from] = passLocked[collapse.m_to] = 1;
+            quadrics[collapse.m_to] += quadrics[collapse.m_from];
+            resultCost = std::max(resultCost, collapse.m_cost);
+            ++collapsed;
+        }
+        if (collapsed == 0) {
+            break;
+        }
+    }
+
+    SimplifyResult result;
+    result.m_indices.reserve(liveCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (alive[t]) {
+            result.m_indices.insert(result.m_indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        }
+    }
+    result.m_error = std::sqrt(resultCost);
+    return result;
+}
+
+LodSelector::LodSelector(
+    Camera const& camera,
+    Transform const& cameraTransform,
+    int viewportWidth,
+    int viewportHeight,
+    float pixelError) :
+    m_cameraPosition(cameraTransform.m_position),
+    m_perspective(std::holds_alternative<PerspectiveProjection>(camera.m_projection)),
+    m_pixelError(pixelError) {
+    // The projection's y scale maps view space units (at unit distance for
+    // perspective) to half the viewport height
+    auto projection = camera.GetProjectionMatrix(viewportWidth, viewportHeight, true);
+    m_pixelsPerUnit = std::abs(projection[1][1]) * 0.5f * static_cast<float>(viewportHeight);
+}
+
+float LodSelector::GetPixelsPerUnit(glm::vec3 const& position, float radius) const {
+    if (!m_perspective) {
+        return m_pixelsPerUnit;
+    }
+    return m_pixelsPerUnit / std::max(glm::length(position - m_cameraPosition) - radius, kMinLodDistance);
+}
+
+int LodSelector::Select(
+    std::span<GeometryMeshDesc const> meshes,
+    int meshIndex,
+    Transform const& transform) const {
+    auto const& mesh = meshes[meshIndex];
+    if (mesh.m_lods.empty()) {
+        return meshIndex;
+    }
+
+    auto const& m = transform.m_scaleShear;
+    float scale = std::sqrt(std::max({ glm::dot(m[0], m[0]), glm::dot(m[1], m[1]), glm::dot(m[2], m[2]) }));
+
+    // Measured at the nearest point of the mesh's bounding sphere
+    auto center = transform.TransformPoint((mesh.m_aabb.m_min + mesh.m_aabb.m_max) * 0.5f);
+    float radius = glm::length(mesh.m_aabb.m_max - mesh.m_aabb.m_min) * 0.5f * scale;
+    float pixelsPerUnit = GetPixelsPerUnit(center, radius) * scale;
+
+    for (auto it = mesh.m_lods.rbegin(); it != mesh.m_lods.rend(); ++it) {
+        if (it->m_error * pixelsPerUnit <= m_pixelError && it->m_meshIndex < meshes.size()) {
+            return static_cast<int>(it->m_meshIndex);
+        }
+    }
+    return meshIndex;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "common.hpp"
+#include "camera.hpp"
+#include "geometry.hpp"
+#include "transform.hpp"
+
+#include <glm/vec3.hpp>
+
+namespace okami {
+	struct LodLevelParams {
+		// Fraction of the base mesh's triangles to aim for
+		float m_targetRatio;
+		// Largest error allowed, relative to the diagonal of the mesh's AABB.
+		// Simplification stops at whichever of the two limits comes first.
+		float m_maxError;
+	};
+
+	struct LodChainParams {
+		std::vector<LodLevelParams> m_levels = {
+			{ 0.5f, 0.005f },
+			{ 0.25f, 0.01f },
+			{ 0.125f, 0.02f },
+			{ 0.0625f, 0.05f },
+		};
+		// A level that removes less than this fraction of the previous level's
+		// triangles ends the chain
+		float m_minReduction = 0.05f;
+	};
+
+	struct SimplifyResult {
+		std::vector<uint32_t> m_indices;
+		// Largest object space distance introduced by any collapse
+		float m_error = 0.0f;
+	};
+
+	// Quadric error edge collapse simplification (Garland & Heckbert) of a
+	// triangle list. Vertices are collapsed onto neighbors rather than moved,
+	// so the result indexes the same vertex data. Vertices sharing a position
+	// are treated as one; collapses that would tear attribute seams, shrink
+	// open borders or flip triangles are rejected.
+	Expected<SimplifyResult> SimplifyMesh(
+		std::span<glm::vec3 const> positions,
+		std::span<uint32_t const> indices,
+		size_t targetIndexCount,
+		float targetError);
+
+	// Picks levels of detail by how large their simplification error appears
+	// on screen. Built once per view, then queried per instance.
+	class LodSelector {
+	private:
+		glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+		// Pixels covered by one unit of error at unit distance (perspective) or
+		// at any distance (orthographic)
+		float m_pixelsPerUnit = 0.0f;
+		bool m_perspective = false;
+		float m_pixelError = 1.0f;
+
+	public:
+		LodSelector() = default;
+		LodSelector(
+			Camera const& camera,
+			Transform const& cameraTransform,
+			int viewportWidth,
+			int viewportHeight,
+			float pixelError = 1.0f);
+
+		// Pixels one world unit covers near position, or at the nearest point
+		// of a sphere of radius around it
+		float GetPixelsPerUnit(glm::vec3 const& position, float radius = 0.0f) const;
+
+		// Returns the mesh index of the coarsest level of meshes[meshIndex]
+		// whose error stays under the pixel threshold when drawn with transform
+		int Select(
+			std::span<GeometryMeshDesc const> meshes,
+			int meshIndex,
+			Transform const& transform) const;
+	};
+}
@@ -0,0 +1,94 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace okami;
+
+#ifdef _WIN32
+
+Expected<std::shared_ptr<MappedFile>> MappedFile::Open(std::filesystem::path const& path) {
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::unexpected(Error("Failed to open file: " + path.string()));
+    }
+    OKAMI_DEFER(CloseHandle(file));
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        return std::unexpected(Error("Failed to query file size: " + path.string()));
+    }
+
+    auto result = std::shared_ptr<MappedFile>(new MappedFile());
+    result->m_size = static_cast<size_t>(size.QuadPart);
+    if (result->m_size == 0) {
+        return result;
+    }
+
+    result->m_mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!result->m_mapping) {
+        return std::unexpected(Error("Failed to create file mapping: " + path.string()));
+    }
+
+    result->m_data = static_cast<uint8_t*>(MapViewOfFile(result->m_mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (!result->m_data) {
+        return std::unexpected(Error("Failed to map file: " + path.string()));
+    }
+
+    return result;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+}
+
+#else
+
+Expected<std::shared_ptr<MappedFile>> MappedFile::Open(std::filesystem::path const& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::unexpected(Error("Failed to open file: " + path.string()));
+    }
+    // The mapping stays valid after the descriptor is closed
+    OKAMI_DEFER(close(fd));
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        return std::unexpected(Error("Failed to query file size: " + path.string()));
+    }
+
+    auto result = std::shared_ptr<MappedFile>(new MappedFile());
+    result->m_size = static_cast<size_t>(info.st_size);
+    if (result->m_size == 0) {
+        return result;
+    }
+
+    void* data = mmap(nullptr, result->m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        result->m_size = 0;
+        return std::unexpected(Error("Failed to map file: " + path.string()));
+    }
+    result->m_data = static_cast<uint8_t*>(data);
+
+    return result;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <filesystem>
+
+#include "common.hpp"
+
+namespace okami {
+	// Read-only file mapped into memory. The mapping is private (copy-on-write),
+	// so callers may modify the returned bytes without touching the file.
+	class MappedFile {
+	private:
+		uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_mapping = nullptr;
+#endif
+
+		MappedFile() = default;
+
+	public:
+		~MappedFile();
+
+		OKAMI_NO_COPY(MappedFile);
+		OKAMI_NO_MOVE(MappedFile);
+
+		static Expected<std::shared_ptr<MappedFile>> Open(std::filesystem::path const& path);
+
+		inline std::span<uint8_t const> GetData() const {
+			return std::span(m_data, m_size);
+		}
+
+		inline std::span<uint8_t> GetData() {
+			return std::span(m_data, m_size);
+		}
+
+		inline size_t GetSize() const {
+			return m_size;
+		}
+	};
+}
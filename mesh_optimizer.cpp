@@ -0,0 +1,419 @@
+#include "mesh_optimizer.hpp"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+using namespace okami;
+
+namespace {
+    // Tuning constants from Forsyth, "Linear-Speed Vertex Cache Optimisation"
+    constexpr uint32_t kForsythCacheSize = 32;
+    constexpr uint32_t kForsythMaxValence = 32;
+    constexpr float kCacheDecayPower = 1.5f;
+    constexpr float kLastTriangleScore = 0.75f;
+    constexpr float kValenceBoostScale = 2.0f;
+    constexpr float kValenceBoostPower = 0.5f;
+
+    struct ForsythScoreTable {
+        // Index 0 is "not in cache", index i + 1 is cache position i
+        std::array<float, kForsythCacheSize + 1> m_cache;
+        std::array<float, kForsythMaxValence + 1> m_valence;
+
+        ForsythScoreTable() {
+            m_cache[0] = 0.0f;
+            for (uint32_t i = 0; i < kForsythCacheSize; ++i) {
+                if (i < 3) {
+                    // The last triangle's vertices get a fixed score so that
+                    // the next triangle does not simply reuse the same edge
+                    m_cache[i + 1] = kLastTriangleScore;
+                } else {
+                    float scaled = 1.0f - float(i - 3) / float(kForsythCacheSize - 3);
+                    m_cache[i + 1] = std::pow(scaled, kCacheDecayPower);
+                }
+            }
+            m_valence[0] = 0.0f;
+            for (uint32_t i = 1; i <= kForsythMaxValence; ++i) {
+                m_valence[i] = kValenceBoostScale * std::pow(float(i), -kValenceBoostPower);
+            }
+        }
+
+        inline float Score(int32_t cachePosition, uint32_t liveTriangles) const {
+            if (liveTriangles == 0) {
+                return -1.0f;
+            }
+            return m_cache[cachePosition + 1] + m_valence[std::min(liveTriangles, kForsythMaxValence)];
+        }
+    };
+
+    // Simulated FIFO cache. A vertex is cached if it was inserted less than
+    // cacheSize insertions ago; bumping the timestamp past cacheSize flushes it.
+    struct FifoCache {
+        std::vector<uint32_t> m_insertTime;
+        uint32_t m_timestamp;
+        uint32_t m_size;
+
+        FifoCache(size_t vertexCount, uint32_t size) :
+            m_insertTime(vertexCount, 0), m_timestamp(size + 1), m_size(size) {}
+
+        // Returns 1 on a miss
+        inline uint32_t Touch(uint32_t vertex) {
+            if (m_timestamp - m_insertTime[vertex] > m_size) {
+                m_insertTime[vertex] = m_timestamp++;
+                return 1;
+            }
+            return 0;
+        }
+
+        inline uint32_t TouchTriangle(uint32_t const* triangle) {
+            return Touch(triangle[0]) + Touch(triangle[1]) + Touch(triangle[2]);
+        }
+
+        inline void Flush() {
+            m_timestamp += m_size + 1;
+        }
+    };
+
+    inline uint64_t HashBytes(uint64_t hash, uint8_t const* data, size_t size) {
+        // FNV-1a
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+VertexCacheStats okami::AnalyzeVertexCache(
+    std::span<uint32_t const> indices,
+    size_t vertexCount,
+    uint32_t cacheSize) {
+    VertexCacheStats stats;
+    stats.m_triangleCount = indices.size() / 3;
+    stats.m_vertexCount = vertexCount;
+
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        stats.m_transformedVertexCount += cache.TouchTriangle(&indices[i]);
+    }
+
+    if (stats.m_triangleCount > 0) {
+        stats.m_acmr = float(stats.m_transformedVertexCount) / float(stats.m_triangleCount);
+    }
+    if (vertexCount > 0) {
+        stats.m_atvr = float(stats.m_transformedVertexCount) / float(vertexCount);
+    }
+    return stats;
+}
+
+VertexRemap okami::DeduplicateVertices(
+    std::span<VertexStream const> streams,
+    size_t vertexCount) {
+    VertexRemap result;
+    result.m_remap.assign(vertexCount, kUnusedVertex);
+
+    auto hashVertex = [&](size_t vertex) {
+        uint64_t hash = 14695981039346656037ull;
+        for (auto const& stream : streams) {
+            hash = HashBytes(hash, stream.m_data.data() + vertex * stream.m_stride, stream.m_stride);
+        }
+        return hash;
+    };
+
+    auto equalVertices = [&](size_t a, size_t b) {
+        for (auto const& stream : streams) {
+            if (std::memcmp(
+                stream.m_data.data() + a * stream.m_stride,
+                stream.m_data.data() + b * stream.m_stride,
+                stream.m_stride) != 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Open addressing table holding the first old index of every distinct vertex
+    size_t tableSize = 1;
+    while (tableSize < vertexCount + vertexCount / 4 + 1) {
+        tableSize *= 2;
+    }
+    std::vector<uint32_t> table(tableSize, kUnusedVertex);
+
+    for (size_t i = 0; i < vertexCount; ++i) {
+        size_t slot = hashVertex(i) & (tableSize - 1);
+        while (table[slot] != kUnusedVertex && !equalVertices(table[slot], i)) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (table[slot] == kUnusedVertex) {
+            table[slot] = static_cast<uint32_t>(i);
+            result.m_remap[i] = static_cast<uint32_t>(result.m_vertexCount++);
+        } else {
+            result.m_remap[i] = result.m_remap[table[slot]];
+        }
+    }
+
+    return result;
+}
+
+VertexRemap okami::OptimizeVertexFetch(
+    std::span<uint32_t const> indices,
+    size_t vertexCount) {
+    VertexRemap result;
+    result.m_remap.assign(vertexCount, kUnusedVertex);
+
+    for (auto index : indices) {
+        if (result.m_remap[index] == kUnusedVertex) {
+            result.m_remap[index] = static_cast<uint32_t>(result.m_vertexCount++);
+        }
+    }
+
+    return result;
+}
+
+void okami::RemapIndices(std::span<uint32_t> indices, VertexRemap const& remap) {
+    for (auto& index : indices) {
+        index = remap.m_remap[index];
+    }
+}
+
+std::vector<uint8_t> okami::RemapVertexStream(VertexStream const& stream, VertexRemap const& remap) {
+    std::vector<uint8_t> result(remap.m_vertexCount * stream.m_stride);
+    for (size_t i = 0; i < remap.m_remap.size(); ++i) {
+        auto target = remap.m_remap[i];
+        if (target != kUnusedVertex) {
+            std::memcpy(
+                result.data() + target * stream.m_stride,
+                stream.m_data.data() + i * stream.m_stride,
+                stream.m_stride);
+        }
+    }
+    return result;
+}
+
+std::vector<uint32_t> okami::OptimizeVertexCache(
+    std::span<uint32_t const> indices,
+    size_t vertexCount) {
+    static ForsythScoreTable const scores;
+
+    size_t triangleCount = indices.size() / 3;
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    if (triangleCount == 0) {
+        return result;
+    }
+
+    // Triangles adjacent to each vertex; the first liveCount[v] entries of a
+    // vertex's range are the triangles that have not been emitted yet
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        ++liveCount[indices[i]];
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+    }
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i) {
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        vertexScore[v] = scores.Score(-1, liveCount[v]);
+    }
+
+    auto triangleScore = [&](size_t t) {
+        return vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    };
+
+    std::vector<float> triScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    size_t best = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triScore[t] = triangleScore(t);
+        if (triScore[t] > triScore[best]) {
+            best = t;
+        }
+    }
+
+    std::array<uint32_t, kForsythCacheSize + 3> cache;
+    std::array<uint32_t, kForsythCacheSize + 3> nextCache;
+    size_t cacheCount = 0;
+    size_t deadEndCursor = 0;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best == SIZE_MAX) {
+            // Nothing in the cache has triangles left: continue in input order
+            while (emitted[deadEndCursor]) {
+                ++deadEndCursor;
+            }
+            best = deadEndCursor;
+        }
+
+        uint32_t const* triangle = &indices[best * 3];
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        size_t nextCount = 0;
+        for (size_t corner = 0; corner < 3; ++corner) {
+            auto v = triangle[corner];
+
+            auto begin = adjacency.begin() + adjacencyOffsets[v];
+            auto end = begin + liveCount[v];
+            auto it = std::find(begin, end, static_cast<uint32_t>(best));
+            if (it != end) {
+                std::iter_swap(it, end - 1);
+                --liveCount[v];
+            }
+
+            if (std::find(nextCache.begin(), nextCache.begin() + nextCount, v) == nextCache.begin() + nextCount) {
+                nextCache[nextCount++] = v;
+            }
+        }
+
+        for (size_t i = 0; i < cacheCount; ++i) {
+            auto v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache[nextCount++] = v;
+            }
+        }
+
+        // Vertices pushed past the end of the cache are evicted, but their
+        // triangles still need rescoring
+        for (size_t i = 0; i < nextCount; ++i) {
+            auto v = nextCache[i];
+            cachePosition[v] = i < kForsythCacheSize ? static_cast<int32_t>(i) : -1;
+            vertexScore[v] = scores.Score(cachePosition[v], liveCount[v]);
+        }
+
+        best = SIZE_MAX;
+        float bestScore = -std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < nextCount; ++i) {
+            auto v = nextCache[i];
+            auto begin = adjacencyOffsets[v];
+            for (size_t j = begin; j < begin + liveCount[v]; ++j) {
+                auto t = adjacency[j];
+                triScore[t] = triangleScore(t);
+                if (i < kForsythCacheSize && triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        std::swap(cache, nextCache);
+        cacheCount = std::min<size_t>(nextCount, kForsythCacheSize);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> okami::OptimizeOverdraw(
+    std::span<uint32_t const> indices,
+    std::span<glm::vec3 const> positions,
+    float threshold,
+    uint32_t cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return std::vector<uint32_t>(indices.begin(), indices.end());
+    }
+
+    FifoCache cache(positions.size(), cacheSize);
+
+    // Hard boundaries: triangles where the cache starts over anyway
+    std::vector<size_t> hardBoundaries;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (cache.TouchTriangle(&indices[t * 3]) == 3 || t == 0) {
+            hardBoundaries.push_back(t);
+        }
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Soft boundaries: split a hard cluster as soon as the ACMR of the current
+    // piece gets within threshold of the whole cluster's ACMR
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c) {
+        size_t begin = hardBoundaries[c];
+        size_t end = hardBoundaries[c + 1];
+
+        cache.Flush();
+        uint32_t clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t) {
+            clusterMisses += cache.TouchTriangle(&indices[t * 3]);
+        }
+        float clusterThreshold = threshold * float(clusterMisses) / float(end - begin);
+
+        cache.Flush();
+        clusters.push_back(begin);
+        size_t start = begin;
+        uint32_t misses = 0;
+        for (size_t t = begin; t < end; ++t) {
+            misses += cache.TouchTriangle(&indices[t * 3]);
+            if (t + 1 < end && float(misses) / float(t - start + 1) <= clusterThreshold) {
+                clusters.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                cache.Flush();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    glm::vec3 meshCenter(0.0f);
+    for (auto const& position : positions) {
+        meshCenter += position;
+    }
+    meshCenter /= float(std::max<size_t>(positions.size(), 1));
+
+    // Clusters whose area weighted normal points away from the mesh center are
+    // likely to occlude the rest, so they go first
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        glm::vec3 normal(0.0f);
+        glm::vec3 center(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            auto const& p0 = positions[indices[t * 3 + 0]];
+            auto const& p1 = positions[indices[t * 3 + 1]];
+            auto const& p2 = positions[indices[t * 3 + 2]];
+            auto triangleNormal = glm::cross(p1 - p0, p2 - p0);
+            auto triangleArea = glm::length(triangleNormal);
+            normal += triangleNormal;
+            center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+
+        float normalLength = glm::length(normal);
+        if (area <= 0.0f || normalLength <= 0.0f) {
+            sortKeys[c] = 0.0f;
+            continue;
+        }
+        sortKeys[c] = glm::dot(center / area - meshCenter, normal / normalLength);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (auto c : order) {
+        result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    }
+    return result;
+}
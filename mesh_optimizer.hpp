@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "common.hpp"
+
+#include <glm/vec3.hpp>
+
+namespace okami {
+	// FIFO cache size used when simulating the post-transform vertex cache
+	constexpr uint32_t kDefaultVertexCacheSize = 16;
+
+	constexpr uint32_t kUnusedVertex = 0xFFFFFFFF;
+
+	struct VertexCacheStats {
+		size_t m_triangleCount = 0;
+		size_t m_vertexCount = 0;
+		// Vertices the simulated cache had to transform (cache misses)
+		size_t m_transformedVertexCount = 0;
+		// Average cache miss ratio: transformed vertices per triangle
+		float m_acmr = 0.0f;
+		// Average transform to vertex ratio: transformed vertices per vertex
+		float m_atvr = 0.0f;
+	};
+
+	// One attribute of a vertex: vertex i occupies m_data[i * m_stride, (i + 1) * m_stride)
+	struct VertexStream {
+		std::span<uint8_t const> m_data;
+		size_t m_stride;
+	};
+
+	// Maps old vertex indices to new ones. Vertices mapping to kUnusedVertex are dropped.
+	struct VertexRemap {
+		std::vector<uint32_t> m_remap;
+		size_t m_vertexCount = 0;
+	};
+
+	struct MeshOptimizationParams {
+		// Merge vertices whose attributes are bitwise identical
+		bool m_deduplicateVertices = true;
+		// Reorder triangles for the post-transform vertex cache (Forsyth)
+		bool m_optimizeVertexCache = true;
+		// Reorder clusters of triangles so outward facing ones are drawn first
+		bool m_optimizeOverdraw = true;
+		// How much the ACMR may degrade to create more clusters for overdraw sorting
+		float m_overdrawThreshold = 1.05f;
+		// Store vertices in the order they are first referenced
+		bool m_optimizeVertexFetch = true;
+		// Use 16 bit indices whenever the vertex count allows it
+		bool m_narrowIndices = true;
+		uint32_t m_cacheSize = kDefaultVertexCacheSize;
+	};
+
+	struct MeshOptimizationStats {
+		VertexCacheStats m_before;
+		VertexCacheStats m_after;
+		size_t m_indexBytesBefore = 0;
+		size_t m_indexBytesAfter = 0;
+	};
+
+	// Simulates a FIFO post-transform cache over a triangle list
+	VertexCacheStats AnalyzeVertexCache(
+		std::span<uint32_t const> indices,
+		size_t vertexCount,
+		uint32_t cacheSize = kDefaultVertexCacheSize);
+
+	// Assigns bitwise identical vertices the same new index. New indices
+	// follow the order in which distinct vertices first appear.
+	VertexRemap DeduplicateVertices(
+		std::span<VertexStream const> streams,
+		size_t vertexCount);
+
+	// Orders vertices by first use in the index buffer; unreferenced vertices are dropped
+	VertexRemap OptimizeVertexFetch(
+		std::span<uint32_t const> indices,
+		size_t vertexCount);
+
+	void RemapIndices(std::span<uint32_t> indices, VertexRemap const& remap);
+
+	// Gathers the stream's vertices into their remapped order
+	std::vector<uint8_t> RemapVertexStream(VertexStream const& stream, VertexRemap const& remap);
+
+	// Reorders triangles with Tom Forsyth's linear-speed vertex cache optimization
+	std::vector<uint32_t> OptimizeVertexCache(
+		std::span<uint32_t const> indices,
+		size_t vertexCount);
+
+	// Splits a cache optimized triangle list into clusters, giving up at most
+	// threshold times the ACMR, and sorts clusters so that those facing away
+	// from the mesh center are drawn first (Sander et al. 2007).
+	std::vector<uint32_t> OptimizeOverdraw(
+		std::span<uint32_t const> indices,
+		std::span<glm::vec3 const> positions,
+		float threshold = 1.05f,
+		uint32_t cacheSize = kDefaultVertexCacheSize);
+}
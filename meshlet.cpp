@@ -0,0 +1,356 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+using namespace okami;
+
+namespace {
+    constexpr uint32_t kNotInMeshlet = 0xFFFFFFFF;
+    constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+    // Ritter's bounding sphere: start from the pair of axis extremes that are
+    // furthest apart, then grow the sphere to cover every point
+    void ComputeBoundingSphere(std::span<glm::vec3 const> points, glm::vec3& center, float& radius) {
+        size_t minIndex[3] = { 0, 0, 0 };
+        size_t maxIndex[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < points.size(); ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                if (points[i][axis] < points[minIndex[axis]][axis]) {
+                    minIndex[axis] = i;
+                }
+                if (points[i][axis] > points[maxIndex[axis]][axis]) {
+                    maxIndex[axis] = i;
+                }
+            }
+        }
+
+        int widest = 0;
+        float widestDistance = -1.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            auto d = points[maxIndex[axis]] - points[minIndex[axis]];
+            float distance = glm::dot(d, d);
+            if (distance > widestDistance) {
+                widestDistance = distance;
+                widest = axis;
+            }
+        }
+
+        center = (points[minIndex[widest]] + points[maxIndex[widest]]) * 0.5f;
+        radius = std::sqrt(widestDistance) * 0.5f;
+
+        for (auto const& point : points) {
+            float distance = glm::length(point - center);
+            if (distance > radius) {
+                float newRadius = (radius + distance) * 0.5f;
+                center += (point - center) * ((newRadius - radius) / distance);
+                radius = newRadius;
+            }
+        }
+    }
+
+    MeshletBounds ComputeBounds(
+        std::span<glm::vec3 const> positions,
+        std::span<uint32_t const> vertices,
+        std::span<uint8_t const> triangles) {
+        MeshletBounds bounds;
+
+        std::vector<glm::vec3> points;
+        points.reserve(vertices.size());
+        bounds.m_aabb = AABB{ glm::vec3(kInfinity), glm::vec3(-kInfinity) };
+        for (auto vertex : vertices) {
+            auto const& p = positions[vertex];
+            points.push_back(p);
+            bounds.m_aabb.m_min = glm::min(bounds.m_aabb.m_min, p);
+            bounds.m_aabb.m_max = glm::max(bounds.m_aabb.m_max, p);
+        }
+        ComputeBoundingSphere(points, bounds.m_center, bounds.m_radius);
+
+        // Normal cone around the average triangle normal
+        std::vector<glm::vec3> normals;
+        normals.reserve(triangles.size() / 3);
+        glm::vec3 axis(0.0f);
+        for (size_t i = 0; i < triangles.size(); i += 3) {
+            auto const& p0 = points[triangles[i + 0]];
+            auto const& p1 = points[triangles[i + 1]];
+            auto const& p2 = points[triangles[i + 2]];
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normals.push_back(normal / length);
+                axis += normals.back();
+            } else {
+                normals.push_back(glm::vec3(0.0f));
+            }
+        }
+
+        bounds.m_coneApex = bounds.m_center;
+        bounds.m_coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        bounds.m_coneCutoff = 1.0f;
+
+        float axisLength = glm::length(axis);
+        if (axisLength <= 0.0f) {
+            return bounds;
+        }
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (auto const& normal : normals) {
+            if (normal != glm::vec3(0.0f)) {
+                minDot = std::min(minDot, glm::dot(axis, normal));
+            }
+        }
+        // Normals spread over a hemisphere or more: no viewpoint sees only backfaces
+        if (minDot <= 0.0f) {
+            bounds.m_coneAxis = axis;
+            return bounds;
+        }
+
+        // Move the apex back along the axis until it lies behind every triangle plane
+        float maxT = 0.0f;
+        for (size_t i = 0; i < normals.size(); ++i) {
+            auto const& normal = normals[i];
+            if (normal == glm::vec3(0.0f)) {
+                continue;
+            }
+            auto const& p0 = points[triangles[i * 3]];
+            maxT = std::max(maxT, glm::dot(bounds.m_center - p0, normal) / glm::dot(axis, normal));
+        }
+
+        bounds.m_coneApex = bounds.m_center - axis * maxT;
+        bounds.m_coneAxis = axis;
+        bounds.m_coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        return bounds;
+    }
+}
+
+Expected<MeshletTable> MeshletTable::Build(
+    std::span<glm::vec3 const> positions,
+    std::span<uint32_t const> indices,
+    MeshletBuildParams const& params) {
+    if (params.m_maxVertices < 3 || params.m_maxVertices > 256) {
+        return std::unexpected(Error("Meshlets must allow between 3 and 256 vertices"));
+    }
+    if (params.m_maxTriangles < 1) {
+        return std::unexpected(Error("Meshlets must allow at least one triangle"));
+    }
+
+    std::vector<uint32_t> sequence;
+    if (indices.empty()) {
+        sequence.resize(positions.size());
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            sequence[i] = static_cast<uint32_t>(i);
+        }
+        indices = sequence;
+    }
+
+    if (indices.size() % 3 != 0) {
+        return std::unexpected(Error("Index count is not a multiple of 3"));
+    }
+    for (auto index : indices) {
+        if (index >= positions.size()) {
+            return std::unexpected(Error("Index out of range"));
+        }
+    }
+
+    size_t vertexCount = positions.size();
+    size_t triangleCount = indices.size() / 3;
+
+    // Triangles adjacent to each vertex; the first liveCount[v] entries of a
+    // vertex's range are the triangles not yet placed in a meshlet
+    std::vector<uint32_t> liveCount(vertexCount, 0);
+    for (auto index : indices) {
+        ++liveCount[index];
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<glm::vec3> triangleCenters(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleCenters[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+    }
+
+    MeshletTable table;
+    std::vector<bool> placed(triangleCount, false);
+    std::vector<uint32_t> localIndex(vertexCount, kNotInMeshlet);
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint8_t> meshletTriangles;
+    glm::vec3 centerSum(0.0f);
+    size_t seedCursor = 0;
+
+    auto newVertexCount = [&](size_t t) {
+        uint32_t a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+        uint32_t count = 0;
+        count += localIndex[a] == kNotInMeshlet;
+        count += localIndex[b] == kNotInMeshlet && b != a;
+        count += localIndex[c] == kNotInMeshlet && c != a && c != b;
+        return count;
+    };
+
+    auto flush = [&]() {
+        if (meshletTriangles.empty()) {
+            return;
+        }
+        table.m_meshlets.push_back(Meshlet{
+            .m_vertexOffset = static_cast<uint32_t>(table.m_vertices.size()),
+            .m_triangleOffset = static_cast<uint32_t>(table.m_triangles.size()),
+            .m_vertexCount = static_cast<uint32_t>(meshletVertices.size()),
+            .m_triangleCount = static_cast<uint32_t>(meshletTriangles.size() / 3),
+        });
+        table.m_bounds.push_back(ComputeBounds(positions, meshletVertices, meshletTriangles));
+        table.m_vertices.insert(table.m_vertices.end(), meshletVertices.begin(), meshletVertices.end());
+        table.m_triangles.insert(table.m_triangles.end(), meshletTriangles.begin(), meshletTriangles.end());
+
+        for (auto vertex : meshletVertices) {
+            localIndex[vertex] = kNotInMeshlet;
+        }
+        meshletVertices.clear();
+        meshletTriangles.clear();
+        centerSum = glm::vec3(0.0f);
+    };
+
+    auto place = [&](size_t t) {
+        placed[t] = true;
+        for (size_t corner = 0; corner < 3; ++corner) {
+            auto v = indices[t * 3 + corner];
+
+            auto begin = adjacency.begin() + adjacencyOffsets[v];
+            auto end = begin + liveCount[v];
+            auto it = std::find(begin, end, static_cast<uint32_t>(t));
+            if (it != end) {
+                std::iter_swap(it, end - 1);
+                --liveCount[v];
+            }
+
+            if (localIndex[v] == kNotInMeshlet) {
+                localIndex[v] = static_cast<uint32_t>(meshletVertices.size());
+                meshletVertices.push_back(v);
+                centerSum += positions[v];
+            }
+            meshletTriangles.push_back(static_cast<uint8_t>(localIndex[v]));
+        }
+    };
+
+    for (size_t placedCount = 0; placedCount < triangleCount; ++placedCount) {
+        size_t next = SIZE_MAX;
+
+        if (!meshletVertices.empty()) {
+            auto center = centerSum / float(meshletVertices.size());
+            uint32_t bestNew = 4;
+            float bestDistance = kInfinity;
+            for (auto v : meshletVertices) {
+                auto begin = adjacencyOffsets[v];
+                for (size_t j = begin; j < begin + liveCount[v]; ++j) {
+                    auto t = adjacency[j];
+                    auto added = newVertexCount(t);
+                    auto offset = triangleCenters[t] - center;
+                    float distance = glm::dot(offset, offset);
+                    if (added < bestNew || (added == bestNew && distance < bestDistance)) {
+                        bestNew = added;
+                        bestDistance = distance;
+                        next = t;
+                    }
+                }
+            }
+
+            // Start a new meshlet when nothing connects or the best candidate
+            // does not fit; the candidate then seeds the next meshlet
+            if (next == SIZE_MAX ||
+                meshletVertices.size() + bestNew > params.m_maxVertices ||
+                meshletTriangles.size() / 3 + 1 > params.m_maxTriangles) {
+                flush();
+            }
+        }
+
+        if (next == SIZE_MAX) {
+            while (placed[seedCursor]) {
+                ++seedCursor;
+            }
+            next = seedCursor;
+        }
+
+        place(next);
+    }
+    flush();
+
+    return table;
+}
+
+Expected<MeshletTable> MeshletTable::Build(
+    RawGeometry const& geometry,
+    size_t meshIndex,
+    MeshletBuildParams const& params) {
+    if (meshIndex >= geometry.GetMeshCount()) {
+        return std::unexpected(Error("Invalid mesh index"));
+    }
+
+    auto positions = geometry.TryAccess<glm::vec3 const>(AttributeType::Position, meshIndex);
+    if (!positions) {
+        return std::unexpected(Error("Mesh has no position attribute"));
+    }
+
+    auto indices = geometry.ReadIndices(meshIndex);
+    OKAMI_UNEXPECTED_RETURN(indices);
+
+    return Build(
+        std::span<glm::vec3 const>(positions->begin(), positions->end()),
+        *indices,
+        params);
+}
+
+void MeshletTable::Cull(
+    Frustum const& frustum,
+    glm::vec3 const& cameraPosition,
+    Transform const& transform,
+    std::vector<uint32_t>& visible) const {
+    auto const& m = transform.m_scaleShear;
+
+    // Rotation does not change lengths, so only the scale/shear part matters
+    // for the sphere radius. The Frobenius norm bounds the largest stretch.
+    bool diagonal = m[0][1] == 0.0f && m[0][2] == 0.0f && m[1][0] == 0.0f &&
+        m[1][2] == 0.0f && m[2][0] == 0.0f && m[2][1] == 0.0f;
+    float radiusScale = diagonal ?
+        std::max({ std::abs(m[0][0]), std::abs(m[1][1]), std::abs(m[2][2]) }) :
+        std::sqrt(glm::dot(m[0], m[0]) + glm::dot(m[1], m[1]) + glm::dot(m[2], m[2]));
+
+    // Cones survive rotations and positive uniform scales only
+    float scale2 = glm::dot(m[0], m[0]);
+    float tolerance = 1e-4f * scale2;
+    bool useCones = glm::determinant(m) > 0.0f &&
+        std::abs(glm::dot(m[1], m[1]) - scale2) <= tolerance &&
+        std::abs(glm::dot(m[2], m[2]) - scale2) <= tolerance &&
+        std::abs(glm::dot(m[0], m[1])) <= tolerance &&
+        std::abs(glm::dot(m[0], m[2])) <= tolerance &&
+        std::abs(glm::dot(m[1], m[2])) <= tolerance;
+
+    for (size_t i = 0; i < m_bounds.size(); ++i) {
+        auto const& bounds = m_bounds[i];
+
+        if (!frustum.Intersects(transform.TransformPoint(bounds.m_center), bounds.m_radius * radiusScale)) {
+            continue;
+        }
+
+        if (useCones && bounds.m_coneCutoff < 1.0f) {
+            auto apex = transform.TransformPoint(bounds.m_coneApex);
+            auto axis = glm::normalize(transform.TransformVector(bounds.m_coneAxis));
+            if (glm::dot(glm::normalize(apex - cameraPosition), axis) >= bounds.m_coneCutoff) {
+                continue;
+            }
+        }
+
+        visible.push_back(static_cast<uint32_t>(i));
+    }
+}
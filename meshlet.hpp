@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "common.hpp"
+#include "aabb.hpp"
+#include "camera.hpp"
+#include "geometry.hpp"
+#include "transform.hpp"
+
+#include <glm/vec3.hpp>
+
+namespace okami {
+	// Limits recommended for mesh shaders; 124 triangles keep the local index
+	// block of a meshlet within 372 bytes
+	constexpr uint32_t kMaxMeshletVertices = 64;
+	constexpr uint32_t kMaxMeshletTriangles = 124;
+
+	// Entry of the cluster table. Vertices index MeshletTable::GetVertices,
+	// triangles are three bytes each in MeshletTable::GetTriangles and refer to
+	// the meshlet's own vertices.
+	struct Meshlet {
+		uint32_t m_vertexOffset;
+		uint32_t m_triangleOffset;
+		uint32_t m_vertexCount;
+		uint32_t m_triangleCount;
+	};
+
+	struct MeshletBounds {
+		glm::vec3 m_center;
+		float m_radius;
+		AABB m_aabb;
+		// Every triangle faces away from a viewer at p if
+		// dot(normalize(m_coneApex - p), m_coneAxis) >= m_coneCutoff.
+		// The cutoff is 1 for meshlets that can never be backface culled.
+		glm::vec3 m_coneApex;
+		glm::vec3 m_coneAxis;
+		float m_coneCutoff;
+	};
+
+	struct MeshletBuildParams {
+		uint32_t m_maxVertices = kMaxMeshletVertices;
+		uint32_t m_maxTriangles = kMaxMeshletTriangles;
+	};
+
+	// Splits one mesh into meshlets. Triangles are grown from a seed across
+	// shared vertices, preferring triangles that add the fewest new vertices,
+	// so meshlets stay spatially compact and their cones tight.
+	class MeshletTable {
+	private:
+		std::vector<Meshlet> m_meshlets;
+		std::vector<MeshletBounds> m_bounds;
+		std::vector<uint32_t> m_vertices;
+		std::vector<uint8_t> m_triangles;
+
+	public:
+		MeshletTable() = default;
+		OKAMI_NO_COPY(MeshletTable);
+		OKAMI_MOVE(MeshletTable);
+
+		// If indices is empty, every three consecutive positions form a triangle
+		static Expected<MeshletTable> Build(
+			std::span<glm::vec3 const> positions,
+			std::span<uint32_t const> indices,
+			MeshletBuildParams const& params = {});
+
+		static Expected<MeshletTable> Build(
+			RawGeometry const& geometry,
+			size_t meshIndex = 0,
+			MeshletBuildParams const& params = {});
+
+		inline std::span<Meshlet const> GetMeshlets() const {
+			return m_meshlets;
+		}
+
+		inline std::span<MeshletBounds const> GetBounds() const {
+			return m_bounds;
+		}
+
+		inline std::span<uint32_t const> GetVertices() const {
+			return m_vertices;
+		}
+
+		inline std::span<uint8_t const> GetTriangles() const {
+			return m_triangles;
+		}
+
+		inline size_t GetMeshletCount() const {
+			return m_meshlets.size();
+		}
+
+		// Appends the meshlets that pass the frustum test and are not entirely
+		// backfacing to visible. The frustum and camera position are in world
+		// space; transform takes the mesh to world space. Cone culling is
+		// skipped under non-uniform scale, where cones do not stay cones.
+		void Cull(
+			Frustum const& frustum,
+			glm::vec3 const& cameraPosition,
+			Transform const& transform,
+			std::vector<uint32_t>& visible) const;
+	};
+}
@@ -0,0 +1,290 @@
+#include "offset_allocator.hpp"
+
+#include <bit>
+
+using namespace okami;
+
+namespace {
+    inline uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+OffsetAllocator::OffsetAllocator(uint64_t size) : m_size(size) {
+    m_binHeads.fill(kNoNode);
+    if (size > 0) {
+        m_first = NewNode();
+        m_nodes[m_first].m_size = size;
+        InsertFree(m_first);
+    }
+}
+
+uint32_t OffsetAllocator::SizeToBinRoundDown(uint64_t size) {
+    if (size < kBinsPerLevel) {
+        return static_cast<uint32_t>(size);
+    }
+    uint32_t mantissaStart = static_cast<uint32_t>(std::bit_width(size)) - 1 - kMantissaBits;
+    uint32_t exponent = mantissaStart + 1;
+    uint32_t mantissa = static_cast<uint32_t>(size >> mantissaStart) & (kBinsPerLevel - 1);
+    return (exponent << kMantissaBits) | mantissa;
+}
+
+uint32_t OffsetAllocator::SizeToBinRoundUp(uint64_t size) {
+    if (size < kBinsPerLevel) {
+        return static_cast<uint32_t>(size);
+    }
+    uint32_t mantissaStart = static_cast<uint32_t>(std::bit_width(size)) - 1 - kMantissaBits;
+    uint64_t lowBits = size & ((uint64_t(1) << mantissaStart) - 1);
+    // A carry out of the mantissa moves on to the next exponent
+    return SizeToBinRoundDown(size) + (lowBits != 0 ? 1 : 0);
+}
+
+uint64_t OffsetAllocator::BinToSize(uint32_t bin) {
+    uint32_t exponent = bin >> kMantissaBits;
+    uint64_t mantissa = bin & (kBinsPerLevel - 1);
+    if (exponent == 0) {
+        return mantissa;
+    }
+    return (mantissa | kBinsPerLevel) << (exponent - 1);
+}
+
+uint32_t OffsetAllocator::NewNode() {
+    if (!m_unusedNodes.empty()) {
+        auto node = m_unusedNodes.back();
+        m_unusedNodes.pop_back();
+        m_nodes[node] = Node{};
+        return node;
+    }
+    m_nodes.emplace_back();
+    return static_cast<uint32_t>(m_nodes.size() - 1);
+}
+
+void OffsetAllocator::InsertFree(uint32_t index) {
+    auto& node = m_nodes[index];
+    auto bin = SizeToBinRoundDown(node.m_size);
+    auto top = bin >> kMantissaBits;
+
+    node.m_used = false;
+    node.m_binPrevious = kNoNode;
+    node.m_binNext = m_binHeads[bin];
+    if (node.m_binNext != kNoNode) {
+        m_nodes[node.m_binNext].m_binPrevious = index;
+    }
+    m_binHeads[bin] = index;
+    m_usedBins[top] |= uint8_t(1) << (bin & (kBinsPerLevel - 1));
+    m_usedTopLevels |= uint64_t(1) << top;
+    m_freeSize += node.m_size;
+}
+
+void OffsetAllocator::RemoveFree(uint32_t index) {
+    auto& node = m_nodes[index];
+    if (node.m_binPrevious != kNoNode) {
+        m_nodes[node.m_binPrevious].m_binNext = node.m_binNext;
+    } else {
+        auto bin = SizeToBinRoundDown(node.m_size);
+        m_binHeads[bin] = node.m_binNext;
+        if (node.m_binNext == kNoNode) {
+            auto top = bin >> kMantissaBits;
+            m_usedBins[top] &= ~(uint8_t(1) << (bin & (kBinsPerLevel - 1)));
+            if (m_usedBins[top] == 0) {
+                m_usedTopLevels &= ~(uint64_t(1) << top);
+            }
+        }
+    }
+    if (node.m_binNext != kNoNode) {
+        m_nodes[node.m_binNext].m_binPrevious = node.m_binPrevious;
+    }
+    node.m_binPrevious = kNoNode;
+    node.m_binNext = kNoNode;
+    m_freeSize -= node.m_size;
+}
+
+std::optional<OffsetAllocation> OffsetAllocator::Allocate(uint64_t size, uint64_t alignment) {
+    OKAMI_ASSERT(std::has_single_bit(alignment), "Alignment must be a power of two");
+    size = std::max<uint64_t>(size, 1);
+    if (size > m_freeSize || alignment - 1 > m_freeSize - size) {
+        return std::nullopt;
+    }
+
+    // Any range in a bin at or above the rounded up size fits, whatever
+    // padding alignment takes
+    auto bin = SizeToBinRoundUp(size + alignment - 1);
+    auto top = bin >> kMantissaBits;
+    auto leaf = bin & (kBinsPerLevel - 1);
+
+    uint32_t found = kNoNode;
+    if (top < kTopLevelCount) {
+        uint32_t leafMask = m_usedBins[top] & (0xFFu << leaf);
+        if (leafMask != 0) {
+            found = (top << kMantissaBits) | std::countr_zero(leafMask);
+        } else if (top + 1 < kTopLevelCount) {
+            auto topMask = m_usedTopLevels & (~uint64_t(0) << (top + 1));
+            if (topMask != 0) {
+                auto foundTop = static_cast<uint32_t>(std::countr_zero(topMask));
+                found = (foundTop << kMantissaBits) | std::countr_zero(uint32_t(m_usedBins[foundTop]));
+            }
+        }
+    }
+    if (found == kNoNode) {
+        return std::nullopt;
+    }
+
+    auto index = m_binHeads[found];
+    RemoveFree(index);
+
+    // Padding in front of the aligned offset stays free
+    auto alignedOffset = AlignUp(m_nodes[index].m_offset, alignment);
+    if (auto padding = alignedOffset - m_nodes[index].m_offset; padding > 0) {
+        auto front = NewNode();
+        auto& node = m_nodes[index];
+        m_nodes[front].m_offset = node.m_offset;
+        m_nodes[front].m_size = padding;
+        m_nodes[front].m_previous = node.m_previous;
+        m_nodes[front].m_next = index;
+        if (node.m_previous != kNoNode) {
+            m_nodes[node.m_previous].m_next = front;
+        } else {
+            m_first = front;
+        }
+        node.m_previous = front;
+        node.m_offset = alignedOffset;
+        node.m_size -= padding;
+        InsertFree(front);
+    }
+
+    // As does whatever is left behind the allocation
+    if (auto remainder = m_nodes[index].m_size - size; remainder > 0) {
+        auto back = NewNode();
+        auto& node = m_nodes[index];
+        m_nodes[back].m_offset = node.m_offset + size;
+        m_nodes[back].m_size = remainder;
+        m_nodes[back].m_previous = index;
+        m_nodes[back].m_next = node.m_next;
+        if (node.m_next != kNoNode) {
+            m_nodes[node.m_next].m_previous = back;
+        }
+        node.m_next = back;
+        node.m_size = size;
+        InsertFree(back);
+    }
+
+    auto& node = m_nodes[index];
+    node.m_used = true;
+    node.m_alignment = alignment;
+    ++m_allocationCount;
+    return OffsetAllocation{ .m_offset = node.m_offset, .m_size = node.m_size, .m_node = index };
+}
+
+void OffsetAllocator::Free(OffsetAllocation const& allocation) {
+    auto index = allocation.m_node;
+    OKAMI_ASSERT(index < m_nodes.size() && m_nodes[index].m_used, "Allocation is not live");
+    --m_allocationCount;
+
+    // Absorb free neighbours on both sides
+    auto previous = m_nodes[index].m_previous;
+    if (previous != kNoNode && !m_nodes[previous].m_used) {
+        RemoveFree(previous);
+        auto& node = m_nodes[index];
+        node.m_offset = m_nodes[previous].m_offset;
+        node.m_size += m_nodes[previous].m_size;
+        node.m_previous = m_nodes[previous].m_previous;
+        if (node.m_previous != kNoNode) {
+            m_nodes[node.m_previous].m_next = index;
+        } else {
+            m_first = index;
+        }
+        m_unusedNodes.push_back(previous);
+    }
+
+    auto next = m_nodes[index].m_next;
+    if (next != kNoNode && !m_nodes[next].m_used) {
+        RemoveFree(next);
+        auto& node = m_nodes[index];
+        node.m_size += m_nodes[next].m_size;
+        node.m_next = m_nodes[next].m_next;
+        if (node.m_next != kNoNode) {
+            m_nodes[node.m_next].m_previous = index;
+        }
+        m_unusedNodes.push_back(next);
+    }
+
+    m_nodes[index].m_alignment = 1;
+    InsertFree(index);
+}
+
+uint64_t OffsetAllocator::GetLargestFreeSize() const {
+    if (m_usedTopLevels == 0) {
+        return 0;
+    }
+    auto top = static_cast<uint32_t>(std::bit_width(m_usedTopLevels)) - 1;
+    auto bin = (top << kMantissaBits) | (static_cast<uint32_t>(std::bit_width(uint32_t(m_usedBins[top]))) - 1);
+
+    uint64_t largest = 0;
+    for (auto index = m_binHeads[bin]; index != kNoNode; index = m_nodes[index].m_binNext) {
+        largest = std::max(largest, m_nodes[index].m_size);
+    }
+    return largest;
+}
+
+std::vector<OffsetAllocationMove> OffsetAllocator::Defragment(uint64_t maxBytes) {
+    std::vector<uint32_t> allocations;
+    allocations.reserve(m_allocationCount);
+    for (auto index = m_first; index != kNoNode;) {
+        auto next = m_nodes[index].m_next;
+        if (m_nodes[index].m_used) {
+            allocations.push_back(index);
+        } else {
+            m_unusedNodes.push_back(index);
+        }
+        index = next;
+    }
+
+    // Relink from scratch, with fresh free ranges for the gaps
+    m_binHeads.fill(kNoNode);
+    m_usedBins.fill(0);
+    m_usedTopLevels = 0;
+    m_freeSize = 0;
+    m_first = kNoNode;
+
+    std::vector<OffsetAllocationMove> moves;
+    uint64_t cursor = 0;
+    uint64_t moved = 0;
+    uint32_t last = kNoNode;
+    auto append = [&](uint32_t index) {
+        m_nodes[index].m_previous = last;
+        m_nodes[index].m_next = kNoNode;
+        if (last != kNoNode) {
+            m_nodes[last].m_next = index;
+        } else {
+            m_first = index;
+        }
+        last = index;
+    };
+    auto appendFree = [&](uint64_t offset, uint64_t size) {
+        auto index = NewNode();
+        m_nodes[index].m_offset = offset;
+        m_nodes[index].m_size = size;
+        append(index);
+        InsertFree(index);
+    };
+
+    for (auto index : allocations) {
+        auto& node = m_nodes[index];
+        auto target = AlignUp(cursor, node.m_alignment);
+        if (target < node.m_offset && node.m_size <= maxBytes - moved) {
+            moves.push_back(OffsetAllocationMove{ index, node.m_offset, target, node.m_size });
+            node.m_offset = target;
+            moved += node.m_size;
+        }
+        if (node.m_offset > cursor) {
+            appendFree(cursor, node.m_offset - cursor);
+        }
+        append(index);
+        cursor = m_nodes[index].m_offset + m_nodes[index].m_size;
+    }
+    if (cursor < m_size) {
+        appendFree(cursor, m_size - cursor);
+    }
+
+    return moves;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "common.hpp"
+
+namespace okami {
+	// A range handed out by OffsetAllocator. m_node names the range to the
+	// allocator and stays the same when Defragment moves it.
+	struct OffsetAllocation {
+		uint64_t m_offset = 0;
+		uint64_t m_size = 0;
+		uint32_t m_node = 0;
+	};
+
+	// A range moved by Defragment from m_from to m_to
+	struct OffsetAllocationMove {
+		uint32_t m_node;
+		uint64_t m_from;
+		uint64_t m_to;
+		uint64_t m_size;
+	};
+
+	// Suballocates ranges of a linear resource, such as a GPU buffer, without
+	// touching the resource itself. It is a two level segregated fit (TLSF):
+	// free ranges sit in bins on a float-like size scale with eight bins per
+	// power of two, and two levels of bitmasks find the smallest nonempty
+	// bin that fits, so allocating and freeing take constant time. Freed
+	// ranges merge with free neighbours immediately.
+	class OffsetAllocator {
+	public:
+		static constexpr uint32_t kMantissaBits = 3;
+		static constexpr uint32_t kBinsPerLevel = 1 << kMantissaBits;
+		static constexpr uint32_t kTopLevelCount = 64;
+		static constexpr uint32_t kBinCount = kTopLevelCount * kBinsPerLevel;
+		static constexpr uint32_t kNoNode = std::numeric_limits<uint32_t>::max();
+
+	private:
+		struct Node {
+			uint64_t m_offset = 0;
+			uint64_t m_size = 0;
+			uint64_t m_alignment = 1;
+			// Free list of the node's bin
+			uint32_t m_binPrevious = kNoNode;
+			uint32_t m_binNext = kNoNode;
+			// Neighbours in address order
+			uint32_t m_previous = kNoNode;
+			uint32_t m_next = kNoNode;
+			bool m_used = false;
+		};
+
+		uint64_t m_size = 0;
+		uint64_t m_freeSize = 0;
+		size_t m_allocationCount = 0;
+
+		std::vector<Node> m_nodes;
+		std::vector<uint32_t> m_unusedNodes;
+		// Node at offset zero
+		uint32_t m_first = kNoNode;
+
+		uint64_t m_usedTopLevels = 0;
+		std::array<uint8_t, kTopLevelCount> m_usedBins{};
+		std::array<uint32_t, kBinCount> m_binHeads;
+
+		uint32_t NewNode();
+		void InsertFree(uint32_t node);
+		void RemoveFree(uint32_t node);
+
+	public:
+		explicit OffsetAllocator(uint64_t size);
+
+		// Size classes: RoundDown gives the bin a free range of this size is
+		// kept in, RoundUp the first bin whose ranges all hold this size
+		static uint32_t SizeToBinRoundDown(uint64_t size);
+		static uint32_t SizeToBinRoundUp(uint64_t size);
+		static uint64_t BinToSize(uint32_t bin);
+
+		// Alignment must be a power of two. Empty when no free range fits.
+		std::optional<OffsetAllocation> Allocate(uint64_t size, uint64_t alignment = 1);
+		void Free(OffsetAllocation const& allocation);
+
+		// Current offset of an allocation, which Defragment may change
+		inline uint64_t GetOffset(OffsetAllocation const& allocation) const {
+			return m_nodes[allocation.m_node].m_offset;
+		}
+
+		inline uint64_t GetSize() const {
+			return m_size;
+		}
+
+		inline uint64_t GetFreeSize() const {
+			return m_freeSize;
+		}
+
+		inline size_t GetAllocationCount() const {
+			return m_allocationCount;
+		}
+
+		// Size of the largest free range; anything up to it can be allocated
+		// without alignment
+		uint64_t GetLargestFreeSize() const;
+
+		// Slides allocations toward offset zero in address order, keeping
+		// their alignment, while at most maxBytes are moved. The caller copies
+		// the data of every move in the order given; a move's destination can
+		// overlap its own source but never data still to be moved.
+		std::vector<OffsetAllocationMove> Defragment(uint64_t maxBytes = std::numeric_limits<uint64_t>::max());
+	};
+}
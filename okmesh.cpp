@@ -0,0 +1,293 @@
+#include "okmesh.hpp"
+#include "mapped_file.hpp"
+#include "scene.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <array>
+
+using namespace okami;
+
+namespace {
+    inline uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Reads a record at the given file offset. Records are read by value so the
+    // table offsets do not need to be aligned.
+    template <typename T>
+    bool ReadRecord(std::span<uint8_t const> file, uint64_t offset, T& record) {
+        if (offset > file.size() || file.size() - offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&record, file.data() + offset, sizeof(T));
+        return true;
+    }
+
+    inline bool InRange(uint64_t offset, uint64_t size, uint64_t limit) {
+        return offset <= limit && size <= limit - offset;
+    }
+
+    // count elements of stride bytes from offset, without multiplying the
+    // untrusted count
+    inline bool InRange(uint64_t offset, uint64_t count, uint64_t stride, uint64_t limit) {
+        return offset <= limit && (stride == 0 || count <= (limit - offset) / stride);
+    }
+
+    bool IsValidComponentType(uint32_t type) {
+        return type <= static_cast<uint32_t>(AccessorComponentType::UByte);
+    }
+}
+
+Expected<RawGeometry> okami::LoadOkMesh(std::filesystem::path const& path) {
+    auto mapping = MappedFile::Open(path);
+    OKAMI_UNEXPECTED_RETURN(mapping);
+
+    std::span<uint8_t const> file = (*mapping)->GetData();
+
+    OkMeshHeader header;
+    if (!ReadRecord(file, 0, header) || std::memcmp(header.m_magic, kOkMeshMagic, sizeof(kOkMeshMagic)) != 0) {
+        return std::unexpected(Error("Not an okmesh file: " + path.string()));
+    }
+    if (header.m_version != kOkMeshVersion) {
+        return std::unexpected(Error("Unsupported okmesh version " + std::to_string(header.m_version) +
+            " in " + path.string() + ", the file needs to be re-cooked"));
+    }
+
+    // Every table has to fit in the file before anything is sized by its count
+    if (!InRange(header.m_bufferTableOffset, header.m_bufferCount, sizeof(OkMeshBufferRecord), file.size()) ||
+        !InRange(header.m_meshTableOffset, header.m_meshCount, sizeof(OkMeshMeshRecord), file.size()) ||
+        !InRange(header.m_attributeTableOffset, header.m_attributeCount, sizeof(OkMeshAttributeRecord), file.size())) {
+        return std::unexpected(Error("Corrupt okmesh table sizes: " + path.string()));
+    }
+
+    std::vector<GeometryBuffer> buffers;
+    buffers.reserve(header.m_bufferCount);
+    for (uint32_t i = 0; i < header.m_bufferCount; ++i) {
+        OkMeshBufferRecord record;
+        if (!ReadRecord(file, header.m_bufferTableOffset + i * sizeof(OkMeshBufferRecord), record) ||
+            !InRange(record.m_offset, record.m_size, file.size())) {
+            return std::unexpected(Error("Corrupt okmesh buffer table: " + path.string()));
+        }
+        auto data = (*mapping)->GetData().subspan(record.m_offset, record.m_size);
+        buffers.emplace_back(data, *mapping);
+    }
+
+    std::vector<GeometryMeshDesc> meshes;
+    std::vector<uint32_t> lodOf;
+    meshes.reserve(header.m_meshCount);
+    for (uint32_t i = 0; i < header.m_meshCount; ++i) {
+        OkMeshMeshRecord record;
+        if (!ReadRecord(file, header.m_meshTableOffset + i * sizeof(OkMeshMeshRecord), record) ||
+            record.m_type != static_cast<uint32_t>(MeshType::Static) ||
+            !InRange(record.m_firstAttribute, record.m_attributeCount, header.m_attributeCount)) {
+            return std::unexpected(Error("Corrupt okmesh mesh table: " + path.string()));
+        }
+
+        GeometryMeshDesc mesh;
+        mesh.m_type = static_cast<MeshType>(record.m_type);
+        mesh.m_vertexCount = record.m_vertexCount;
+        mesh.m_aabb = AABB{
+            glm::vec3(record.m_aabbMin[0], record.m_aabbMin[1], record.m_aabbMin[2]),
+            glm::vec3(record.m_aabbMax[0], record.m_aabbMax[1], record.m_aabbMax[2])
+        };
+
+        for (uint32_t j = 0; j < record.m_attributeCount; ++j) {
+            OkMeshAttributeRecord attribute;
+            if (!ReadRecord(file, header.m_attributeTableOffset +
+                    (record.m_firstAttribute + j) * sizeof(OkMeshAttributeRecord), attribute) ||
+                attribute.m_type >= static_cast<uint32_t>(AttributeType::Unknown) ||
+                attribute.m_encoding > static_cast<uint32_t>(AttributeEncoding::Quantized) ||
+                attribute.m_buffer >= buffers.size() ||
+                !InRange(attribute.m_offset, mesh.m_vertexCount,
+                    GetStride(static_cast<AttributeType>(attribute.m_type), static_cast<AttributeEncoding>(attribute.m_encoding)),
+                    buffers[attribute.m_buffer].size())) {
+                return std::unexpected(Error("Corrupt okmesh attribute table: " + path.string()));
+            }
+
+            mesh.m_attributes.push_back(Attribute{
+                .m_type = static_cast<AttributeType>(attribute.m_type),
+                .m_buffer = static_cast<int>(attribute.m_buffer),
+                .m_offset = attribute.m_offset,
+                .m_encoding = static_cast<AttributeEncoding>(attribute.m_encoding),
+            });
+        }
+
+        if (record.m_indexType != kOkMeshNoIndices) {
+            if (!IsValidComponentType(record.m_indexType) || record.m_indexBuffer >= buffers.size()) {
+                return std::unexpected(Error("Corrupt okmesh index data: " + path.string()));
+            }
+            IndexInfo indices{
+                .m_type = static_cast<AccessorComponentType>(record.m_indexType),
+                .m_buffer = static_cast<int>(record.m_indexBuffer),
+                .m_count = record.m_indexCount,
+                .m_offset = record.m_indexOffset,
+            };
+            if (!InRange(indices.m_offset, indices.m_count, indices.GetStride(), buffers[indices.m_buffer].size())) {
+                return std::unexpected(Error("Corrupt okmesh index data: " + path.string()));
+            }
+            mesh.m_indices = indices;
+        }
+
+        if (record.m_lodOf != kOkMeshNoLod) {
+            if (record.m_lodOf >= i || lodOf[record.m_lodOf] != kOkMeshNoLod) {
+                return std::unexpected(Error("Corrupt okmesh level of detail: " + path.string()));
+            }
+            meshes[record.m_lodOf].m_lods.push_back(MeshLod{ i, record.m_lodError });
+        }
+        lodOf.push_back(record.m_lodOf);
+
+        meshes.push_back(std::move(mesh));
+    }
+
+    return RawGeometry(std::move(buffers), std::move(meshes));
+}
+
+Error okami::SaveOkMesh(RawGeometry const& geometry, std::filesystem::path const& path) {
+    auto meshes = geometry.GetMeshes();
+    auto buffers = geometry.GetBuffers();
+
+    OkMeshHeader header = {};
+    std::memcpy(header.m_magic, kOkMeshMagic, sizeof(kOkMeshMagic));
+    header.m_version = kOkMeshVersion;
+    header.m_meshCount = static_cast<uint32_t>(meshes.size());
+    header.m_bufferCount = static_cast<uint32_t>(buffers.size());
+
+    std::vector<OkMeshMeshRecord> meshRecords;
+    std::vector<OkMeshAttributeRecord> attributeRecords;
+    meshRecords.reserve(meshes.size());
+
+    // Levels of detail point back at their base mesh
+    std::vector<uint32_t> lodOf(meshes.size(), kOkMeshNoLod);
+    std::vector<float> lodError(meshes.size(), 0.0f);
+    for (uint32_t i = 0; i < meshes.size(); ++i) {
+        for (auto const& lod : meshes[i].m_lods) {
+            if (lod.m_meshIndex <= i || lod.m_meshIndex >= meshes.size() || lodOf[lod.m_meshIndex] != kOkMeshNoLod) {
+                return Error("Levels of detail must follow their base mesh");
+            }
+            lodOf[lod.m_meshIndex] = i;
+            lodError[lod.m_meshIndex] = lod.m_error;
+        }
+    }
+
+    for (uint32_t i = 0; i < meshes.size(); ++i) {
+        auto const& mesh = meshes[i];
+        OkMeshMeshRecord record = {};
+        record.m_type = static_cast<uint32_t>(mesh.m_type);
+        record.m_firstAttribute = static_cast<uint32_t>(attributeRecords.size());
+        record.m_attributeCount = static_cast<uint32_t>(mesh.m_attributes.size());
+        record.m_vertexCount = mesh.m_vertexCount;
+        record.m_indexType = kOkMeshNoIndices;
+        record.m_lodOf = lodOf[i];
+        record.m_lodError = lodError[i];
+        if (mesh.m_indices) {
+            record.m_indexType = static_cast<uint32_t>(mesh.m_indices->m_type);
+            record.m_indexBuffer = static_cast<uint32_t>(mesh.m_indices->m_buffer);
+            record.m_indexCount = mesh.m_indices->m_count;
+            record.m_indexOffset = mesh.m_indices->m_offset;
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            record.m_aabbMin[axis] = mesh.m_aabb.m_min[axis];
+            record.m_aabbMax[axis] = mesh.m_aabb.m_max[axis];
+        }
+        meshRecords.push_back(record);
+
+        for (auto const& attribute : mesh.m_attributes) {
+            if (attribute.m_type == AttributeType::Unknown) {
+                return Error("Cannot save attributes of unknown type to okmesh");
+            }
+            attributeRecords.push_back(OkMeshAttributeRecord{
+                .m_type = static_cast<uint16_t>(attribute.m_type),
+                .m_encoding = static_cast<uint16_t>(attribute.m_encoding),
+                .m_buffer = static_cast<uint32_t>(attribute.m_buffer),
+                .m_offset = attribute.m_offset,
+            });
+        }
+    }
+    header.m_attributeCount = static_cast<uint32_t>(attributeRecords.size());
+
+    header.m_meshTableOffset = sizeof(OkMeshHeader);
+    header.m_attributeTableOffset = header.m_meshTableOffset + meshRecords.size() * sizeof(OkMeshMeshRecord);
+    header.m_bufferTableOffset = header.m_attributeTableOffset + attributeRecords.size() * sizeof(OkMeshAttributeRecord);
+
+    std::vector<OkMeshBufferRecord> bufferRecords;
+    bufferRecords.reserve(buffers.size());
+    uint64_t dataOffset = header.m_bufferTableOffset + buffers.size() * sizeof(OkMeshBufferRecord);
+    for (auto const& buffer : buffers) {
+        dataOffset = AlignUp(dataOffset, kOkMeshDataAlignment);
+        bufferRecords.push_back(OkMeshBufferRecord{ dataOffset, buffer.size() });
+        dataOffset += buffer.size();
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return Error("Failed to open file for writing: " + path.string());
+    }
+
+    auto write = [&file](void const* data, size_t size) {
+        file.write(reinterpret_cast<char const*>(data), static_cast<std::streamsize>(size));
+    };
+
+    write(&header, sizeof(header));
+    write(meshRecords.data(), meshRecords.size() * sizeof(OkMeshMeshRecord));
+    write(attributeRecords.data(), attributeRecords.size() * sizeof(OkMeshAttributeRecord));
+    write(bufferRecords.data(), bufferRecords.size() * sizeof(OkMeshBufferRecord));
+
+    std::array<char, kOkMeshDataAlignment> padding = {};
+    uint64_t position = header.m_bufferTableOffset + buffers.size() * sizeof(OkMeshBufferRecord);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        write(padding.data(), bufferRecords[i].m_offset - position);
+        auto data = buffers[i].GetData();
+        write(data.data(), data.size());
+        position = bufferRecords[i].m_offset + data.size();
+    }
+
+    file.close();
+    if (!file.good()) {
+        return Error("Failed to write okmesh data to file: " + path.string());
+    }
+
+    return {};
+}
+
+Error okami::CookOkMesh(
+    std::filesystem::path const& source,
+    std::filesystem::path const& destination,
+    OkMeshCookParams const& params,
+    std::vector<MeshOptimizationStats>* stats) {
+    Expected<RawGeometry> geometry;
+    if (params.m_staticBatch) {
+        std::vector<GLTFNode> nodes;
+        auto scene = RawGeometry::LoadGLTF(source, nodes);
+        OKAMI_ERROR_RETURN(scene);
+
+        auto desc = SceneDesc::FromGLTFNodes(nodes);
+        auto instances = GetStaticBatchInstances(desc, *scene);
+        auto batch = BuildStaticBatch(instances, *params.m_staticBatch);
+        OKAMI_ERROR_RETURN(batch);
+        geometry = std::move(batch->m_geometry);
+    } else {
+        geometry = RawGeometry::Load(source);
+        OKAMI_ERROR_RETURN(geometry);
+    }
+
+    if (params.m_optimization) {
+        auto optimized = geometry->Optimize(*params.m_optimization, stats);
+        OKAMI_ERROR_RETURN(optimized);
+        geometry = std::move(optimized);
+    }
+
+    if (params.m_lods) {
+        auto error = geometry->GenerateLods(*params.m_lods);
+        OKAMI_ERROR_RETURN(error);
+    }
+
+    if (geometry->IsPacked(params.m_requirements)) {
+        return SaveOkMesh(*geometry, destination);
+    }
+
+    auto packed = geometry->Pack(params.m_requirements);
+    OKAMI_ERROR_RETURN(packed);
+
+    return SaveOkMesh(*packed, destination);
+}
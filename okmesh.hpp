@@ -0,0 +1,105 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <optional>
+
+#include "common.hpp"
+#include "geometry.hpp"
+#include "mesh_optimizer.hpp"
+#include "lod.hpp"
+#include "static_batch.hpp"
+
+namespace okami {
+	// .okmesh is a binary cache of a RawGeometry that can be mapped into memory
+	// and used in place. All values are little endian. The file consists of
+	//
+	//   OkMeshHeader
+	//   OkMeshMeshRecord[m_meshCount]
+	//   OkMeshAttributeRecord[m_attributeCount]
+	//   OkMeshBufferRecord[m_bufferCount]
+	//   buffer data, each buffer aligned to kOkMeshDataAlignment
+	//
+	// Files are cooked with the renderer's MeshRequirements, so that the buffers
+	// are already in the layout the GPU consumes and upload is a straight copy.
+	constexpr std::string_view kOkMeshExtension = ".okmesh";
+	constexpr char kOkMeshMagic[8] = { 'O', 'K', 'M', 'E', 'S', 'H', '\0', '\0' };
+	// Bump whenever the layout of any record below changes
+	constexpr uint32_t kOkMeshVersion = 3;
+	constexpr uint64_t kOkMeshDataAlignment = 256;
+	constexpr uint32_t kOkMeshNoIndices = 0xFFFFFFFF;
+	constexpr uint32_t kOkMeshNoLod = 0xFFFFFFFF;
+
+	struct OkMeshHeader {
+		char m_magic[8];
+		uint32_t m_version;
+		uint32_t m_meshCount;
+		uint32_t m_attributeCount;
+		uint32_t m_bufferCount;
+		uint64_t m_meshTableOffset;
+		uint64_t m_attributeTableOffset;
+		uint64_t m_bufferTableOffset;
+	};
+
+	struct OkMeshMeshRecord {
+		uint32_t m_type;
+		uint32_t m_firstAttribute;
+		uint32_t m_attributeCount;
+		// AccessorComponentType of the indices, or kOkMeshNoIndices
+		uint32_t m_indexType;
+		uint32_t m_indexBuffer;
+		// Index of the mesh this is a level of detail of, or kOkMeshNoLod.
+		// Levels of a mesh are stored finest first.
+		uint32_t m_lodOf;
+		uint64_t m_vertexCount;
+		uint64_t m_indexCount;
+		uint64_t m_indexOffset;
+		float m_aabbMin[3];
+		float m_aabbMax[3];
+		float m_lodError;
+		uint32_t m_reserved;
+	};
+
+	struct OkMeshAttributeRecord {
+		uint16_t m_type;
+		// AttributeEncoding of the values
+		uint16_t m_encoding;
+		uint32_t m_buffer;
+		uint64_t m_offset;
+	};
+
+	struct OkMeshBufferRecord {
+		uint64_t m_offset;
+		uint64_t m_size;
+	};
+
+	static_assert(sizeof(OkMeshHeader) == 48);
+	static_assert(sizeof(OkMeshMeshRecord) == 80);
+	static_assert(sizeof(OkMeshAttributeRecord) == 16);
+	static_assert(sizeof(OkMeshBufferRecord) == 16);
+
+	// Maps the file and returns a RawGeometry whose buffers point into the mapping
+	Expected<RawGeometry> LoadOkMesh(std::filesystem::path const& path);
+
+	Error SaveOkMesh(RawGeometry const& geometry, std::filesystem::path const& path);
+
+	struct OkMeshCookParams {
+		MeshRequirements m_requirements = GetDefaultMeshRequirements();
+		// Optimization applied before packing; none if empty
+		std::optional<MeshOptimizationParams> m_optimization = MeshOptimizationParams{};
+		// Levels of detail generated after optimization; none if empty
+		std::optional<LodChainParams> m_lods = LodChainParams{};
+		// If set, the source's scene is merged into static batch chunks before
+		// optimization; only glTF sources have a scene
+		std::optional<StaticBatchParams> m_staticBatch;
+	};
+
+	// Loads any geometry RawGeometry::Load understands, optionally static batches it, optimizes it, generates
+	// levels of detail, packs it with the given requirements and writes it out as .okmesh. If stats is
+	// given it receives the optimizer's per-mesh statistics.
+	Error CookOkMesh(
+		std::filesystem::path const& source,
+		std::filesystem::path const& destination,
+		OkMeshCookParams const& params = {},
+		std::vector<MeshOptimizationStats>* stats = nullptr);
+}
@@ -0,0 +1,190 @@
+#include "oktex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+
+using namespace okami;
+
+namespace {
+    inline uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    inline bool InRange(uint64_t offset, uint64_t size, uint64_t limit) {
+        return offset <= limit && size <= limit - offset;
+    }
+
+    // D3D12's resource dimension limits
+    constexpr uint32_t kMaxTextureDimension = 16384;
+    constexpr uint32_t kMaxTexture3DDimension = 2048;
+    constexpr uint32_t kMaxTextureArraySize = 2048;
+
+    inline bool CheckedMul(uint64_t a, uint64_t b, uint64_t& result) {
+        if (b != 0 && a > std::numeric_limits<uint64_t>::max() / b) {
+            return false;
+        }
+        result = a * b;
+        return true;
+    }
+
+    // GetTextureSize in 64 bits, so that a corrupt header cannot wrap it.
+    // Empty on overflow.
+    std::optional<uint64_t> GetCheckedTextureSize(TextureInfo const& info) {
+        uint64_t total = 0;
+        for (uint32_t mip = 0; mip < info.mipLevels; ++mip) {
+            uint32_t mipWidth = std::max(1u, info.width >> mip);
+            uint32_t mipHeight = std::max(1u, info.height >> mip);
+            uint32_t mipDepth = std::max(1u, info.depth >> mip);
+
+            uint64_t size = 0;
+            if (!CheckedMul(GetRowPitch(info.format, mipWidth), GetRowCount(info.format, mipHeight), size) ||
+                !CheckedMul(size, mipDepth, size) ||
+                (info.type == TextureType::TEXTURE_2D_ARRAY && !CheckedMul(size, info.arraySize, size)) ||
+                size > std::numeric_limits<uint64_t>::max() - total) {
+                return std::nullopt;
+            }
+            total += size;
+        }
+        return total;
+    }
+
+    TextureInfo GetInfo(OkTexHeader const& header) {
+        TextureInfo info{};
+        info.type = static_cast<TextureType>(header.m_type);
+        info.format = static_cast<TextureFormat>(header.m_format);
+        info.width = header.m_width;
+        info.height = header.m_height;
+        info.depth = header.m_depth;
+        info.arraySize = header.m_arraySize;
+        info.mipLevels = header.m_mipLevels;
+        return info;
+    }
+
+    Expected<OkTexHeader> ReadHeader(std::span<uint8_t const> file) {
+        OkTexHeader header;
+        if (file.size() < sizeof(OkTexHeader)) {
+            return std::unexpected(Error("File is too small for an oktex header"));
+        }
+        std::memcpy(&header, file.data(), sizeof(OkTexHeader));
+        if (std::memcmp(header.m_magic, kOkTexMagic, sizeof(kOkTexMagic)) != 0) {
+            return std::unexpected(Error("Not an oktex file"));
+        }
+        if (header.m_version != kOkTexVersion) {
+            return std::unexpected(Error("Unsupported oktex version " + std::to_string(header.m_version) +
+                ", the file needs to be re-cooked"));
+        }
+        if (header.m_type > static_cast<uint32_t>(TextureType::TEXTURE_CUBE) ||
+            header.m_format > static_cast<uint32_t>(TextureFormat::RGB9E5) ||
+            header.m_width == 0 || header.m_height == 0 || header.m_depth == 0 ||
+            header.m_arraySize == 0 || header.m_mipLevels == 0 ||
+            header.m_mipLevels > GetFullMipCount(header.m_width, header.m_height)) {
+            return std::unexpected(Error("Corrupt oktex header"));
+        }
+
+        auto type = static_cast<TextureType>(header.m_type);
+        uint32_t maxDimension = type == TextureType::TEXTURE_3D ? kMaxTexture3DDimension : kMaxTextureDimension;
+        if (header.m_width > maxDimension || header.m_height > maxDimension || header.m_depth > maxDimension ||
+            header.m_arraySize > kMaxTextureArraySize ||
+            (type != TextureType::TEXTURE_3D && header.m_depth > 1)) {
+            return std::unexpected(Error("Unsupported oktex dimensions"));
+        }
+
+        // RawTexture addresses its texels with 32 bit offsets
+        auto expectedSize = GetCheckedTextureSize(GetInfo(header));
+        if (!expectedSize || *expectedSize > std::numeric_limits<uint32_t>::max() ||
+            header.m_dataSize != *expectedSize) {
+            return std::unexpected(Error("Corrupt oktex data size"));
+        }
+        return header;
+    }
+}
+
+Expected<TextureInfo> okami::ReadOkTexInfo(std::span<uint8_t const> file) {
+    auto header = ReadHeader(file);
+    OKAMI_UNEXPECTED_RETURN(header);
+    return GetInfo(*header);
+}
+
+Expected<RawTexture> okami::LoadOkTex(std::filesystem::path const& path) {
+    auto mapping = MappedFile::Open(path);
+    OKAMI_UNEXPECTED_RETURN(mapping);
+
+    auto texture = LoadOkTex(std::move(mapping.value()));
+    if (!texture) {
+        return std::unexpected(texture.error().WithContext(path.string()));
+    }
+    return texture;
+}
+
+Expected<RawTexture> okami::LoadOkTex(std::shared_ptr<MappedFile> file) {
+    auto header = ReadHeader(file->GetData());
+    OKAMI_UNEXPECTED_RETURN(header);
+
+    auto info = GetInfo(*header);
+    if (!InRange(header->m_dataOffset, header->m_dataSize, file->GetSize())) {
+        return std::unexpected(Error("Corrupt oktex data range"));
+    }
+
+    auto data = file->GetData().subspan(header->m_dataOffset, header->m_dataSize);
+    return RawTexture(info, data, std::move(file));
+}
+
+Error okami::SaveOkTex(RawTexture const& texture, std::filesystem::path const& path) {
+    auto const& info = texture.GetInfo();
+    auto data = texture.GetData();
+
+    OkTexHeader header = {};
+    std::memcpy(header.m_magic, kOkTexMagic, sizeof(kOkTexMagic));
+    header.m_version = kOkTexVersion;
+    header.m_type = static_cast<uint32_t>(info.type);
+    header.m_format = static_cast<uint32_t>(info.format);
+    header.m_width = info.width;
+    header.m_height = info.height;
+    header.m_depth = info.depth;
+    header.m_arraySize = info.arraySize;
+    header.m_mipLevels = info.mipLevels;
+    header.m_dataOffset = AlignUp(sizeof(OkTexHeader), kOkTexDataAlignment);
+    header.m_dataSize = data.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return Error("Failed to open file for writing: " + path.string());
+    }
+
+    std::array<char, kOkTexDataAlignment> padding = {};
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(padding.data(), static_cast<std::streamsize>(header.m_dataOffset - sizeof(header)));
+    file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+    file.close();
+    if (!file.good()) {
+        return Error("Failed to write oktex data to file: " + path.string());
+    }
+
+    return {};
+}
+
+Error okami::CookOkTex(
+    std::filesystem::path const& source,
+    std::filesystem::path const& destination,
+    OkTexCookParams const& params) {
+    auto texture = RawTexture::FromPNG(source);
+    OKAMI_ERROR_RETURN(texture);
+
+    if (params.m_mips) {
+        auto error = texture->GenerateMips(*params.m_mips);
+        OKAMI_ERROR_RETURN(error);
+    }
+
+    auto const& info = texture->GetInfo();
+    if (params.m_compressTo && info.width % 4 == 0 && info.height % 4 == 0) {
+        auto error = texture->Compress(*params.m_compressTo, params.m_compression);
+        OKAMI_ERROR_RETURN(error);
+    }
+
+    return SaveOkTex(*texture, destination);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include "common.hpp"
+#include "mapped_file.hpp"
+#include "texture.hpp"
+#include "texture_compression.hpp"
+#include "texture_mips.hpp"
+
+namespace okami {
+	// .oktex is a binary cache of a RawTexture in its final format, mips and
+	// compression included, that can be mapped into memory and used in place.
+	// All values are little endian. The file consists of
+	//
+	//   OkTexHeader
+	//   texel data at m_dataOffset, laid out as in RawTexture: levels largest
+	//   first, each level holding every array slice
+	//
+	// Loading a cooked texture only reads the file; decoding, mip generation
+	// and compression all happened when it was cooked.
+	constexpr std::string_view kOkTexExtension = ".oktex";
+	constexpr char kOkTexMagic[8] = { 'O', 'K', 'T', 'E', 'X', '\0', '\0', '\0' };
+	// Bump whenever the header or the texel layout changes
+	constexpr uint32_t kOkTexVersion = 1;
+	// Page aligned, which also meets D3D12's texture data placement alignment
+	constexpr uint64_t kOkTexDataAlignment = 4096;
+
+	struct OkTexHeader {
+		char m_magic[8];
+		uint32_t m_version;
+		// TextureType
+		uint32_t m_type;
+		// TextureFormat
+		uint32_t m_format;
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_depth;
+		uint32_t m_arraySize;
+		uint32_t m_mipLevels;
+		uint64_t m_dataOffset;
+		uint64_t m_dataSize;
+		uint64_t m_reserved;
+	};
+
+	static_assert(sizeof(OkTexHeader) == 64);
+
+	// Size and format of a cooked texture, read from the header alone
+	Expected<TextureInfo> ReadOkTexInfo(std::span<uint8_t const> file);
+
+	// Maps the file and returns a RawTexture whose texels point into the mapping
+	Expected<RawTexture> LoadOkTex(std::filesystem::path const& path);
+	// As above, for a file that is already mapped
+	Expected<RawTexture> LoadOkTex(std::shared_ptr<MappedFile> file);
+
+	Error SaveOkTex(RawTexture const& texture, std::filesystem::path const& path);
+
+	struct OkTexCookParams {
+		// Mip chain generated from the source; none if empty
+		std::optional<MipChainParams> m_mips = MipChainParams{};
+		// Block compressed after mips are generated; left as decoded if empty.
+		// Sources whose size is not a multiple of 4 are left as decoded too,
+		// since GPUs need whole blocks at the base level.
+		std::optional<TextureFormat> m_compressTo;
+		BlockCompressionParams m_compression = { .m_quality = CompressionQuality::High };
+	};
+
+	// Decodes a PNG, generates mips, compresses and writes the result as .oktex
+	Error CookOkTex(
+		std::filesystem::path const& source,
+		std::filesystem::path const& destination,
+		OkTexCookParams const& params = {});
+}
@@ -113,4 +113,12 @@ std::filesystem::path okami::GetTestAssetsPath() {
 
 std::filesystem::path okami::GetTestAssetPath(const std::filesystem::path& relativePath) {
     return GetTestAssetsPath() / relativePath;
-}
\ No newline at end of file
+}
+std::filesystem::path okami::NormalizePath(const std::filesystem::path& path) {
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    if (ec) {
+        return path.lexically_normal();
+    }
+    return absolute.lexically_normal();
+}
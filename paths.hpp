@@ -13,4 +13,8 @@ namespace okami {
 
 	std::filesystem::path GetTestAssetsPath();
 	std::filesystem::path GetTestAssetPath(const std::filesystem::path& relativePath);
+
+	// Absolute, lexically normalized form of a path, so that different
+	// spellings of the same file compare equal. Does not touch the file system.
+	std::filesystem::path NormalizePath(const std::filesystem::path& path);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <type_traits>
 #include <vector>
 #include <set>
+#include <algorithm>
 
 #include "common.hpp"
 
@@ -30,6 +31,15 @@ namespace okami {
 			}
 		}
 
+		// Makes room for count more objects without reallocating. Growth
+		// stays geometric so repeated small reservations remain cheap.
+		void Reserve(size_t count) {
+			size_t required = m_objects.size() + count;
+			if (required > m_objects.capacity()) {
+				m_objects.reserve(std::max(required, m_objects.capacity() * 2));
+			}
+		}
+
 		bool IsFree(IndexT index) const {
 			return index < 0 || index >= static_cast<IndexT>(m_objects.size()) || m_freeIndices.find(index) != m_freeIndices.end();
 		}
@@ -38,6 +38,12 @@ namespace okami {
 
 	struct Geometry {
         std::vector<GeometryMeshDesc> m_meshes;
+		// CPU-side triangle BVHs for raycasting, one per mesh (may be null).
+		// Empty unless the geometry manager was asked to build them.
+		std::vector<std::shared_ptr<TriangleBVH const>> m_bvhs;
+		// Meshlet cluster tables for per-cluster culling, one per mesh (may be null).
+		// Empty unless the geometry manager was asked to build them.
+		std::vector<std::shared_ptr<MeshletTable const>> m_meshlets;
 		std::any m_privateData;
 
 		using CreationData = RawGeometry;
@@ -55,6 +61,18 @@ namespace okami {
 		}
 	};
 
+	template <>
+	struct ComponentCloner<StaticMeshComponent> {
+		static void Clone(StaticMeshComponent const& source, size_t count, std::vector<StaticMeshComponent>& copies) {
+			source.m_mesh.Retain(static_cast<int>(count));
+			for (size_t i = 0; i < count; ++i) {
+				copies.push_back(StaticMeshComponent{
+					.m_mesh = ResHandle<Geometry>(source.m_mesh.Ptr(), AdoptRef{}),
+					.m_meshIndex = source.m_meshIndex });
+			}
+		}
+	};
+
 	struct Rect {
 		glm::vec2 m_position = glm::vec2(0.0f, 0.0f);
 		glm::vec2 m_size = glm::vec2(0.0f, 0.0f);
@@ -79,4 +97,19 @@ namespace okami {
 		Color m_color = color::White;
 		int m_layer = 0;
 	};
+
+	template <>
+	struct ComponentCloner<SpriteComponent> {
+		static void Clone(SpriteComponent const& source, size_t count, std::vector<SpriteComponent>& copies) {
+			source.m_texture.Retain(static_cast<int>(count));
+			for (size_t i = 0; i < count; ++i) {
+				copies.push_back(SpriteComponent{
+					.m_texture = ResHandle<Texture>(source.m_texture.Ptr(), AdoptRef{}),
+					.m_origin = source.m_origin,
+					.m_sourceRect = source.m_sourceRect,
+					.m_color = source.m_color,
+					.m_layer = source.m_layer });
+			}
+		}
+	};
 }
@@ -0,0 +1,81 @@
+#include "resource_cache.hpp"
+
+using namespace okami;
+
+ResourceCache::ResourceCache(ResourceCacheParams params) : m_params(params) {
+}
+
+void ResourceCache::Add(resource_id_t id, size_t bytes) {
+    Remove(id);
+
+    m_entries.emplace(id, Entry{ .m_bytes = bytes });
+    m_stats.m_trackedBytes += bytes;
+    m_stats.m_trackedCount++;
+}
+
+void ResourceCache::Remove(resource_id_t id) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    auto& entry = it->second;
+    if (!entry.m_referenced) {
+        m_released.erase(entry.m_releasedPosition);
+        m_stats.m_cachedBytes -= entry.m_bytes;
+        m_stats.m_cachedCount--;
+    }
+    m_stats.m_trackedBytes -= entry.m_bytes;
+    m_stats.m_trackedCount--;
+    m_entries.erase(it);
+}
+
+void ResourceCache::SetBytes(resource_id_t id, size_t bytes) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    auto& entry = it->second;
+    m_stats.m_trackedBytes += bytes - entry.m_bytes;
+    if (!entry.m_referenced) {
+        m_stats.m_cachedBytes += bytes - entry.m_bytes;
+    }
+    entry.m_bytes = bytes;
+}
+
+void ResourceCache::SetReferenced(resource_id_t id, bool referenced) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end() || it->second.m_referenced == referenced) {
+        return;
+    }
+
+    auto& entry = it->second;
+    entry.m_referenced = referenced;
+    if (referenced) {
+        m_released.erase(entry.m_releasedPosition);
+        m_stats.m_cachedBytes -= entry.m_bytes;
+        m_stats.m_cachedCount--;
+        m_stats.m_hitCount++;
+        return;
+    }
+
+    // Without bytes there is nothing to keep warm, so these go first
+    entry.m_releasedPosition = entry.m_bytes == 0 ?
+        m_released.insert(m_released.begin(), id) :
+        m_released.insert(m_released.end(), id);
+    m_stats.m_cachedBytes += entry.m_bytes;
+    m_stats.m_cachedCount++;
+}
+
+void ResourceCache::Collect(std::vector<resource_id_t>& evicted) {
+    while (!m_released.empty()) {
+        auto id = m_released.front();
+        if (m_stats.m_cachedBytes <= m_params.m_budgetBytes && m_entries.at(id).m_bytes > 0) {
+            break;
+        }
+        Remove(id);
+        m_stats.m_evictedCount++;
+        evicted.push_back(id);
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "engine.hpp"
+
+namespace okami {
+	struct ResourceCacheParams {
+		// Bytes of released resources kept loaded in case they are requested
+		// again. Zero destroys resources as soon as nothing references them.
+		size_t m_budgetBytes = size_t(64) << 20;
+	};
+
+	struct ResourceCacheStats {
+		// Every tracked resource, referenced or not
+		size_t m_trackedBytes = 0;
+		size_t m_trackedCount = 0;
+		// Released resources still loaded
+		size_t m_cachedBytes = 0;
+		size_t m_cachedCount = 0;
+		// Totals since the cache was created: released resources referenced
+		// again before eviction, and released resources evicted
+		size_t m_hitCount = 0;
+		size_t m_evictedCount = 0;
+	};
+
+	// Decides when loaded resources nothing references are destroyed.
+	// Backend neutral: managers track resources once loaded, report each
+	// frame whether anything still references them, then destroy what
+	// Collect evicts. Released resources stay loaded, least recently
+	// released evicted first, while their bytes fit the budget. Not thread
+	// safe.
+	class ResourceCache {
+	private:
+		struct Entry {
+			size_t m_bytes = 0;
+			bool m_referenced = true;
+			// Position in m_released while not referenced
+			std::list<resource_id_t>::iterator m_releasedPosition;
+		};
+
+		ResourceCacheParams m_params;
+		std::unordered_map<resource_id_t, Entry> m_entries;
+		// Released resources, least recently released first
+		std::list<resource_id_t> m_released;
+		ResourceCacheStats m_stats;
+
+	public:
+		explicit ResourceCache(ResourceCacheParams params = {});
+
+		inline ResourceCacheParams const& GetParams() const {
+			return m_params;
+		}
+
+		inline ResourceCacheStats const& GetStats() const {
+			return m_stats;
+		}
+
+		inline bool Contains(resource_id_t id) const {
+			return m_entries.contains(id);
+		}
+
+		// Starts tracking a loaded resource holding bytes, as referenced
+		void Add(resource_id_t id, size_t bytes);
+		// Stops tracking a resource without evicting it
+		void Remove(resource_id_t id);
+		// The resource grew or shrank, as streamed textures do
+		void SetBytes(resource_id_t id, size_t bytes);
+
+		// Whether anything references the resource; ignored for untracked ones
+		void SetReferenced(resource_id_t id, bool referenced);
+
+		// Appends the released resources that no longer fit the budget to
+		// evicted and stops tracking them. Released resources without bytes
+		// have nothing to keep warm and are always evicted.
+		void Collect(std::vector<resource_id_t>& evicted);
+	};
+
+	// Keeps values the GPU may still be using until the frame that last used
+	// them has completed. Frames are whatever increasing counter the caller
+	// signals its fence with.
+	template <typename T>
+	class DeferredReleaseQueue {
+	private:
+		struct Item {
+			uint64_t m_frame;
+			T m_value;
+		};
+
+		std::deque<Item> m_items;
+
+	public:
+		// Releases value once frame has completed. Frames must not decrease
+		// from one call to the next.
+		inline void Push(T value, uint64_t frame) {
+			m_items.push_back(Item{ frame, std::move(value) });
+		}
+
+		// Passes each value whose frame is at most completedFrame to release,
+		// oldest first, then drops it. Returns how many were released.
+		template <typename F>
+		size_t Release(uint64_t completedFrame, F&& release) {
+			size_t count = 0;
+			while (!m_items.empty() && m_items.front().m_frame <= completedFrame) {
+				release(m_items.front().m_value);
+				m_items.pop_front();
+				++count;
+			}
+			return count;
+		}
+
+		inline size_t Release(uint64_t completedFrame) {
+			return Release(completedFrame, [](T&) {});
+		}
+
+		inline size_t GetSize() const {
+			return m_items.size();
+		}
+
+		inline bool IsEmpty() const {
+			return m_items.empty();
+		}
+	};
+}
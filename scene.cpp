@@ -0,0 +1,127 @@
+#include "scene.hpp"
+
+#include <optional>
+
+using namespace okami;
+
+namespace {
+    std::optional<float> GetUniformScale(Transform const& transform) {
+        auto const& m = transform.m_scaleShear;
+        if (m[0][1] != 0.0f || m[0][2] != 0.0f || m[1][0] != 0.0f ||
+            m[1][2] != 0.0f || m[2][0] != 0.0f || m[2][1] != 0.0f ||
+            m[0][0] != m[1][1] || m[0][0] != m[2][2]) {
+            return std::nullopt;
+        }
+        return m[0][0];
+    }
+}
+
+SceneDesc SceneDesc::FromGLTFNodes(std::span<GLTFNode const> nodes) {
+    SceneDesc desc;
+    desc.m_parents.reserve(nodes.size() + 1);
+    desc.m_transforms.reserve(nodes.size() + 1);
+
+    desc.m_parents.push_back(-1);
+    desc.m_transforms.push_back(Transform::Identity());
+
+    // Root-relative matrices of the glTF nodes, by glTF node index
+    std::vector<glm::mat4> matrices(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto const& node = nodes[i];
+        matrices[i] = node.m_parent >= 0 ?
+            matrices[node.m_parent] * node.m_localTransform :
+            node.m_localTransform;
+    }
+
+    // Node indices shift as primitive children are inserted
+    std::vector<int32_t> indices(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto const& node = nodes[i];
+        auto transform = Transform::FromMatrix(matrices[i]);
+
+        auto index = static_cast<int32_t>(desc.m_parents.size());
+        indices[i] = index;
+        desc.m_parents.push_back(node.m_parent >= 0 ? indices[node.m_parent] : 0);
+        desc.m_transforms.push_back(transform);
+
+        if (node.m_meshCount == 1) {
+            desc.m_meshNodes.push_back(index);
+            desc.m_meshIndices.push_back(static_cast<int32_t>(node.m_firstMesh));
+        } else {
+            for (uint32_t j = 0; j < node.m_meshCount; ++j) {
+                desc.m_meshNodes.push_back(static_cast<int32_t>(desc.m_parents.size()));
+                desc.m_meshIndices.push_back(static_cast<int32_t>(node.m_firstMesh + j));
+                desc.m_parents.push_back(index);
+                desc.m_transforms.push_back(transform);
+            }
+        }
+    }
+
+    return desc;
+}
+
+Expected<Scene> Scene::LoadGLTF(
+    std::filesystem::path const& path,
+    IResourceManager<Geometry>& geometryManager) {
+    std::vector<GLTFNode> nodes;
+    auto geometry = RawGeometry::LoadGLTF(path, nodes);
+    OKAMI_UNEXPECTED_RETURN(geometry);
+
+    auto desc = SceneDesc::FromGLTFNodes(nodes);
+    return Scene(std::move(desc), geometryManager.Create(std::move(*geometry)));
+}
+
+void Scene::Instantiate(
+    Engine& engine,
+    std::span<Transform const> placements,
+    std::span<entity_t> roots,
+    entity_t parent) const {
+    OKAMI_ASSERT(roots.size() >= placements.size(), "Every placement needs a root");
+
+    auto nodeCount = m_desc.GetNodeCount();
+    auto meshCount = m_desc.m_meshNodes.size();
+    auto copies = placements.size();
+    if (nodeCount == 0 || copies == 0) {
+        return;
+    }
+
+    std::vector<entity_t> entities(nodeCount * copies);
+    std::vector<Transform> transforms(nodeCount * copies);
+    for (size_t copy = 0; copy < copies; ++copy) {
+        auto copyEntities = std::span(entities).subspan(copy * nodeCount, nodeCount);
+        engine.CreateEntities(m_desc.m_parents, copyEntities, parent);
+        roots[copy] = copyEntities[0];
+
+        auto const& placement = placements[copy];
+        auto* copyTransforms = transforms.data() + copy * nodeCount;
+        if (auto scale = GetUniformScale(placement)) {
+            // Uniform scale commutes with the node rotations, so composing
+            // is a quaternion product and a scaled rotate per node
+            for (size_t node = 0; node < nodeCount; ++node) {
+                auto const& local = m_desc.m_transforms[node];
+                copyTransforms[node] = Transform(
+                    placement.m_position + placement.m_rotation * (*scale * local.m_position),
+                    placement.m_rotation * local.m_rotation,
+                    *scale * local.m_scaleShear);
+            }
+        } else {
+            for (size_t node = 0; node < nodeCount; ++node) {
+                copyTransforms[node] = placement * m_desc.m_transforms[node];
+            }
+        }
+    }
+
+    if (meshCount > 0) {
+        std::vector<entity_t> meshEntities(meshCount * copies);
+        std::vector<StaticMeshComponent> meshes(meshCount * copies);
+        for (size_t copy = 0; copy < copies; ++copy) {
+            for (size_t mesh = 0; mesh < meshCount; ++mesh) {
+                meshEntities[copy * meshCount + mesh] = entities[copy * nodeCount + m_desc.m_meshNodes[mesh]];
+                meshes[copy * meshCount + mesh] = StaticMeshComponent{ m_geometry, m_desc.m_meshIndices[mesh] };
+            }
+        }
+        engine.AddComponents(std::move(meshEntities), std::move(meshes));
+    }
+
+    engine.AddComponents(std::move(entities), std::move(transforms));
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <filesystem>
+
+#include "common.hpp"
+#include "engine.hpp"
+#include "geometry.hpp"
+#include "renderer.hpp"
+#include "transform.hpp"
+
+namespace okami {
+	// Node hierarchy of an imported scene, flattened once so that stamping
+	// out copies is a linear pass over flat arrays. Node 0 is the instance
+	// root; every other node's parent comes before it.
+	struct SceneDesc {
+		// Parent of each node as an index of an earlier node, -1 for the root
+		std::vector<int32_t> m_parents;
+		// Transform of each node relative to the instance root
+		std::vector<Transform> m_transforms;
+		// Nodes that draw a mesh, and the geometry mesh each one draws
+		std::vector<int32_t> m_meshNodes;
+		std::vector<int32_t> m_meshIndices;
+
+		inline size_t GetNodeCount() const {
+			return m_parents.size();
+		}
+
+		// glTF nodes with several primitives get one child node per primitive,
+		// since an entity holds a single StaticMeshComponent
+		static SceneDesc FromGLTFNodes(std::span<GLTFNode const> nodes);
+	};
+
+	// A scene description together with the geometry its meshes index into
+	class Scene {
+	private:
+		SceneDesc m_desc;
+		ResHandle<Geometry> m_geometry;
+
+	public:
+		Scene() = default;
+		inline Scene(SceneDesc desc, ResHandle<Geometry> geometry) :
+			m_desc(std::move(desc)), m_geometry(std::move(geometry)) {}
+
+		inline SceneDesc const& GetDesc() const {
+			return m_desc;
+		}
+
+		inline ResHandle<Geometry> const& GetGeometry() const {
+			return m_geometry;
+		}
+
+		// Imports a .gltf or .glb, handing its geometry to the manager
+		static Expected<Scene> LoadGLTF(
+			std::filesystem::path const& path,
+			IResourceManager<Geometry>& geometryManager);
+
+		// Creates one copy of the scene per placement under parent, writing
+		// the root entity of each copy to roots. Entities are created in one
+		// batch per copy and components are added in one batch per type.
+		void Instantiate(
+			Engine& engine,
+			std::span<Transform const> placements,
+			std::span<entity_t> roots,
+			entity_t parent = kRoot) const;
+
+		inline entity_t Instantiate(
+			Engine& engine,
+			Transform const& placement = Transform::Identity(),
+			entity_t parent = kRoot) const {
+			entity_t root = kNullEntity;
+			Instantiate(engine, std::span(&placement, 1), std::span(&root, 1), parent);
+			return root;
+		}
+	};
+}
@@ -18,6 +18,7 @@ struct GSInput
     float4 color : COLOR2;
     float2 uv0 : TEXCOORD0;
     float2 uv1 : TEXCOORD1;
+    nointerpolation uint textureIndex : TEXINDEX;
 };
 
 struct PSInput
@@ -25,6 +26,7 @@ struct PSInput
     float4 position : SV_POSITION;
     float2 uv : TEXCOORD0;
     float4 color : COLOR;
+    nointerpolation uint textureIndex : TEXINDEX;
 };
 
 GSInput VSMain(SpriteInstance input)
@@ -52,6 +54,7 @@ GSInput VSMain(SpriteInstance input)
 
     result.uv0 = input.uv0;
     result.uv1 = input.uv1;
+    result.textureIndex = input.textureIndex;
 
     return result;
 }
@@ -62,21 +65,25 @@ void GSMain(point GSInput input[1], inout TriangleStream<PSInput> output) {
     v0.position = input[0].position;
     v0.uv = float2(input[0].uv0.x, input[0].uv1.y);
     v0.color = input[0].color;
+    v0.textureIndex = input[0].textureIndex;
 
     PSInput v1;
     v1.position = input[0].position + input[0].dx;
     v1.uv = float2(input[0].uv1.x, input[0].uv1.y);
     v1.color = input[0].color;
+    v1.textureIndex = input[0].textureIndex;
 
     PSInput v2;
     v2.position = input[0].position + input[0].dy;
     v2.uv = float2(input[0].uv0.x, input[0].uv0.y);
     v2.color = input[0].color;
+    v2.textureIndex = input[0].textureIndex;
 
     PSInput v3;
     v3.position = input[0].position + input[0].dx + input[0].dy;
     v3.uv = float2(input[0].uv1.x, input[0].uv0.y);
     v3.color = input[0].color;
+    v3.textureIndex = input[0].textureIndex;
 
     output.Append(v0);
     output.Append(v1);
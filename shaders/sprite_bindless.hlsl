@@ -0,0 +1,20 @@
+// Pixel shader for bindless sprite batches, paired with the vertex and
+// geometry shaders of sprite.hlsl. Every texture of the SRV heap is bound
+// at once and each sprite picks its own, so a whole layer is one draw.
+Texture2D<float4> SpriteTextures[] : register(t0, space1);
+
+SamplerState SpriteSampler : register(s0);
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+    float4 color : COLOR;
+    nointerpolation uint textureIndex : TEXINDEX;
+};
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    Texture2D<float4> spriteTexture = SpriteTextures[NonUniformResourceIndex(input.textureIndex)];
+    return spriteTexture.Sample(SpriteSampler, input.uv) * input.color;
+}
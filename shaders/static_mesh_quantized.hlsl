@@ -0,0 +1,28 @@
+#include "static_mesh.fxh"
+
+// Vertices packed with AttributeEncoding::Quantized. Positions are unorm16
+// within the mesh's bounds, which the instance world matrix maps back to
+// object space; normals and tangents are octahedral snorm16 and texture
+// coordinates are half floats. Shares the pixel shader of static_mesh.hlsl.
+struct VSInput
+{
+    float4 position : POSITION;
+    float2 uv : TEXCOORD;
+    float2 normal : NORMAL;
+    float4 tangent : TANGENT;
+    uint instanceID : SV_InstanceID;
+};
+
+float3 OctahedralDecode(float2 encoded)
+{
+    float3 direction = float3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = saturate(-direction.z);
+    direction.xy += (direction.xy >= 0.0) ? -fold : fold;
+    return normalize(direction);
+}
+
+PSInput VSMain(VSInput input)
+{
+    float4 tangent = float4(OctahedralDecode(input.tangent.xy), input.tangent.z);
+    return TransformVertex(input.instanceID, input.position.xyz, input.uv, OctahedralDecode(input.normal), tangent);
+}
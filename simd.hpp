@@ -0,0 +1,15 @@
+#pragma once
+
+// OKAMI_SSE2 is defined when SSE2 intrinsics can be used unconditionally:
+// always on x64, and on x86 builds that target it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OKAMI_SSE2
+#include <emmintrin.h>
+#endif
+
+// OKAMI_F16C is defined when the half float conversion instructions can be
+// used unconditionally. MSVC has no __F16C__; every AVX2 target has them.
+#if defined(OKAMI_SSE2) && (defined(__F16C__) || defined(__AVX2__))
+#define OKAMI_F16C
+#include <immintrin.h>
+#endif
@@ -0,0 +1,314 @@
+#include "sprite_atlas.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+using namespace okami;
+
+namespace {
+    struct PackRect {
+        uint32_t m_x;
+        uint32_t m_y;
+        uint32_t m_width;
+        uint32_t m_height;
+
+        inline uint32_t Right() const {
+            return m_x + m_width;
+        }
+
+        inline uint32_t Bottom() const {
+            return m_y + m_height;
+        }
+
+        inline bool Contains(PackRect const& other) const {
+            return other.m_x >= m_x && other.m_y >= m_y &&
+                other.Right() <= Right() && other.Bottom() <= Bottom();
+        }
+
+        inline bool Intersects(PackRect const& other) const {
+            return other.m_x < Right() && m_x < other.Right() &&
+                other.m_y < Bottom() && m_y < other.Bottom();
+        }
+    };
+
+    inline uint32_t AlignUp(uint32_t value, uint32_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Tracks the maximal free rectangles of one page, which may overlap
+    class MaxRectsBin {
+    private:
+        std::vector<PackRect> m_free;
+        uint32_t m_usedWidth = 0;
+        uint32_t m_usedHeight = 0;
+
+        void SplitFree(PackRect const& used) {
+            std::vector<PackRect> split;
+            for (size_t i = 0; i < m_free.size();) {
+                auto free = m_free[i];
+                if (!free.Intersects(used)) {
+                    ++i;
+                    continue;
+                }
+                m_free[i] = m_free.back();
+                m_free.pop_back();
+
+                if (used.m_x > free.m_x) {
+                    split.push_back(PackRect{ free.m_x, free.m_y, used.m_x - free.m_x, free.m_height });
+                }
+                if (used.Right() < free.Right()) {
+                    split.push_back(PackRect{ used.Right(), free.m_y, free.Right() - used.Right(), free.m_height });
+                }
+                if (used.m_y > free.m_y) {
+                    split.push_back(PackRect{ free.m_x, free.m_y, free.m_width, used.m_y - free.m_y });
+                }
+                if (used.Bottom() < free.Bottom()) {
+                    split.push_back(PackRect{ free.m_x, used.Bottom(), free.m_width, free.Bottom() - used.Bottom() });
+                }
+            }
+
+            // Only keep the new rectangles that no other free one contains,
+            // and drop the old ones they contain
+            auto oldCount = m_free.size();
+            for (size_t i = 0; i < split.size(); ++i) {
+                bool contained = false;
+                for (size_t j = 0; j < split.size() && !contained; ++j) {
+                    contained = i != j && split[j].Contains(split[i]) &&
+                        (!split[i].Contains(split[j]) || j < i);
+                }
+                for (size_t j = 0; j < oldCount && !contained; ++j) {
+                    contained = m_free[j].Contains(split[i]);
+                }
+                if (!contained) {
+                    m_free.push_back(split[i]);
+                }
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < oldCount; ++i) {
+                bool contained = std::any_of(m_free.begin() + oldCount, m_free.end(),
+                    [&](PackRect const& added) { return added.Contains(m_free[i]); });
+                if (!contained) {
+                    m_free[kept++] = m_free[i];
+                }
+            }
+            m_free.erase(m_free.begin() + kept, m_free.begin() + oldCount);
+        }
+
+    public:
+        MaxRectsBin(uint32_t width, uint32_t height) : m_free{ PackRect{ 0, 0, width, height } } {}
+
+        std::optional<PackRect> Insert(uint32_t width, uint32_t height) {
+            // Best short side fit: the free rectangle leaving the least
+            // space along its tighter side, then along the other
+            std::optional<PackRect> best;
+            uint32_t bestShort = UINT32_MAX;
+            uint32_t bestLong = UINT32_MAX;
+            for (auto const& free : m_free) {
+                if (free.m_width < width || free.m_height < height) {
+                    continue;
+                }
+                auto leftoverX = free.m_width - width;
+                auto leftoverY = free.m_height - height;
+                auto shortSide = std::min(leftoverX, leftoverY);
+                auto longSide = std::max(leftoverX, leftoverY);
+                if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong)) {
+                    best = PackRect{ free.m_x, free.m_y, width, height };
+                    bestShort = shortSide;
+                    bestLong = longSide;
+                }
+            }
+
+            if (best) {
+                SplitFree(*best);
+                m_usedWidth = std::max(m_usedWidth, best->Right());
+                m_usedHeight = std::max(m_usedHeight, best->Bottom());
+            }
+            return best;
+        }
+
+        inline uint32_t GetUsedWidth() const {
+            return m_usedWidth;
+        }
+
+        inline uint32_t GetUsedHeight() const {
+            return m_usedHeight;
+        }
+    };
+
+    // Copies the sprite into its cell of the page and fills the rest of the
+    // cell with the nearest edge texel
+    void BlitSprite(RawTexture const& sprite, PackRect const& cell, uint32_t padding, RawTexture& page) {
+        auto const& info = sprite.GetInfo();
+        auto stride = GetPixelStride(info.format);
+        auto pageWidth = page.GetInfo().width;
+        auto source = sprite.GetData();
+        auto destination = page.GetData();
+
+        for (uint32_t y = 0; y < cell.m_height; ++y) {
+            auto sourceY = static_cast<uint32_t>(std::clamp(
+                static_cast<int64_t>(y) - padding, int64_t(0), int64_t(info.height) - 1));
+            auto const* sourceRow = &source[size_t(sourceY) * info.width * stride];
+            auto* destinationRow = &destination[(size_t(cell.m_y + y) * pageWidth + cell.m_x) * stride];
+
+            for (uint32_t x = 0; x < padding; ++x) {
+                std::memcpy(destinationRow + size_t(x) * stride, sourceRow, stride);
+            }
+            std::memcpy(destinationRow + size_t(padding) * stride, sourceRow, size_t(info.width) * stride);
+            auto const* lastTexel = sourceRow + size_t(info.width - 1) * stride;
+            for (uint32_t x = padding + info.width; x < cell.m_width; ++x) {
+                std::memcpy(destinationRow + size_t(x) * stride, lastTexel, stride);
+            }
+        }
+    }
+}
+
+Rect SpriteAtlasEntry::Remap(std::optional<Rect> const& sourceRect) const {
+    if (!sourceRect) {
+        return m_rect;
+    }
+    return Rect{
+        .m_position = m_rect.m_position + sourceRect->m_position,
+        .m_size = sourceRect->m_size
+    };
+}
+
+SpriteComponent SpriteAtlasRegion::Remap(SpriteComponent const& sprite) const {
+    return SpriteComponent{
+        .m_texture = m_texture,
+        .m_origin = sprite.m_origin,
+        .m_sourceRect = m_entry.Remap(sprite.m_sourceRect),
+        .m_color = sprite.m_color,
+        .m_layer = sprite.m_layer
+    };
+}
+
+std::vector<SpriteAtlasRegion> SpriteAtlas::Instantiate(IResourceManager<Texture>& textureManager) {
+    std::vector<ResHandle<Texture>> pages;
+    pages.reserve(m_pages.size());
+    for (auto& page : m_pages) {
+        pages.push_back(textureManager.Create(std::move(page)));
+    }
+    m_pages.clear();
+
+    std::vector<SpriteAtlasRegion> regions;
+    regions.reserve(m_entries.size());
+    for (auto const& entry : m_entries) {
+        regions.push_back(SpriteAtlasRegion{ .m_texture = pages[entry.m_page], .m_entry = entry });
+    }
+    return regions;
+}
+
+Expected<SpriteAtlas> okami::BuildSpriteAtlas(
+    std::span<RawTexture const* const> sprites,
+    SpriteAtlasParams const& params) {
+    if (params.m_mipLevels == 0 || params.m_mipLevels > 16) {
+        return std::unexpected(Error("Sprite atlas mip levels must be between 1 and 16"));
+    }
+
+    // Cells start and end on multiples of the alignment, which keeps every
+    // free rectangle aligned as well
+    uint32_t alignment = 1u << (params.m_mipLevels - 1);
+    uint32_t pageSize = params.m_maxPageSize / alignment * alignment;
+    if (pageSize == 0) {
+        return std::unexpected(Error("Sprite atlas pages are smaller than the mip alignment"));
+    }
+
+    SpriteAtlas atlas;
+    if (sprites.empty()) {
+        return atlas;
+    }
+
+    auto format = sprites.front()->GetInfo().format;
+    std::vector<PackRect> cells(sprites.size());
+    for (size_t i = 0; i < sprites.size(); ++i) {
+        auto const& info = sprites[i]->GetInfo();
+        if (info.type != TextureType::TEXTURE_2D || info.arraySize != 1 || info.depth != 1) {
+            return std::unexpected(Error("Sprite atlases only hold 2D textures"));
+        }
+        if (IsBlockCompressed(info.format)) {
+            return std::unexpected(Error("Sprite atlases cannot pack block compressed textures"));
+        }
+        if (info.format != format) {
+            return std::unexpected(Error("Sprites in one atlas must share a format"));
+        }
+        cells[i].m_width = AlignUp(info.width + 2 * params.m_padding, alignment);
+        cells[i].m_height = AlignUp(info.height + 2 * params.m_padding, alignment);
+        if (cells[i].m_width > pageSize || cells[i].m_height > pageSize) {
+            return std::unexpected(Error("Sprite " + std::to_string(i) + " (" + std::to_string(info.width) + "x" +
+                std::to_string(info.height) + ") does not fit in an atlas page"));
+        }
+    }
+
+    // Largest first, by longer then shorter side
+    std::vector<uint32_t> order(sprites.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        auto const& cellA = cells[a];
+        auto const& cellB = cells[b];
+        auto longA = std::max(cellA.m_width, cellA.m_height);
+        auto longB = std::max(cellB.m_width, cellB.m_height);
+        if (longA != longB) {
+            return longA > longB;
+        }
+        return std::min(cellA.m_width, cellA.m_height) > std::min(cellB.m_width, cellB.m_height);
+    });
+
+    std::vector<MaxRectsBin> bins;
+    atlas.m_entries.resize(sprites.size());
+    for (auto index : order) {
+        auto& cell = cells[index];
+        std::optional<PackRect> placed;
+        uint32_t page = 0;
+        for (; page < bins.size() && !placed; ++page) {
+            placed = bins[page].Insert(cell.m_width, cell.m_height);
+        }
+        if (!placed) {
+            bins.emplace_back(pageSize, pageSize);
+            page = static_cast<uint32_t>(bins.size());
+            placed = bins.back().Insert(cell.m_width, cell.m_height);
+        }
+        cell = *placed;
+
+        auto const& info = sprites[index]->GetInfo();
+        atlas.m_entries[index] = SpriteAtlasEntry{
+            .m_page = page - 1,
+            .m_rect = Rect{
+                .m_position = glm::vec2(cell.m_x + params.m_padding, cell.m_y + params.m_padding),
+                .m_size = glm::vec2(info.width, info.height)
+            }
+        };
+    }
+
+    atlas.m_pages.reserve(bins.size());
+    for (auto const& bin : bins) {
+        TextureInfo info{};
+        info.type = TextureType::TEXTURE_2D;
+        info.format = format;
+        info.width = AlignUp(bin.GetUsedWidth(), alignment);
+        info.height = AlignUp(bin.GetUsedHeight(), alignment);
+        info.depth = 1;
+        info.arraySize = 1;
+        info.mipLevels = 1;
+        atlas.m_pages.emplace_back(info);
+    }
+
+    // Cells never overlap, so sprites are copied in parallel
+    ParallelFor(sprites.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            BlitSprite(*sprites[i], cells[i], params.m_padding, atlas.m_pages[atlas.m_entries[i].m_page]);
+        }
+    });
+
+    if (params.m_mipLevels > 1) {
+        auto mips = params.m_mips;
+        mips.m_maxLevels = params.m_mipLevels;
+        for (auto& page : atlas.m_pages) {
+            auto error = page.GenerateMips(mips);
+            OKAMI_UNEXPECTED_RETURN(error);
+        }
+    }
+
+    return atlas;
+}
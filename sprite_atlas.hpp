@@ -0,0 +1,67 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+#include "engine.hpp"
+#include "renderer.hpp"
+#include "texture.hpp"
+#include "texture_mips.hpp"
+
+namespace okami {
+	struct SpriteAtlasParams {
+		// Pages are at most this wide and tall, and shrink to what they hold
+		uint32_t m_maxPageSize = 2048;
+		// Texels around each sprite filled by repeating its edge, so that
+		// filtering at the edge never samples a neighbour
+		uint32_t m_padding = 2;
+		// Levels generated for each page, including the base. Sprites are
+		// placed on multiples of 2^(levels - 1) texels so that box filtered
+		// levels never mix two sprites; wider filters rely on the padding.
+		uint32_t m_mipLevels = 1;
+		// Filter settings for the levels; m_maxLevels is ignored
+		MipChainParams m_mips;
+	};
+
+	// Where one sprite ended up
+	struct SpriteAtlasEntry {
+		uint32_t m_page = 0;
+		// Texels of the sprite in the page, padding excluded
+		Rect m_rect;
+
+		// Maps a rect in the sprite's own texture into the page; the whole
+		// sprite if empty
+		Rect Remap(std::optional<Rect> const& sourceRect) const;
+	};
+
+	// A sprite's page once it has been handed to a resource manager
+	struct SpriteAtlasRegion {
+		ResHandle<Texture> m_texture;
+		SpriteAtlasEntry m_entry;
+
+		// The same sprite drawn from the page. Size and default origin are
+		// unchanged, so the sprite looks exactly as before.
+		SpriteComponent Remap(SpriteComponent const& sprite) const;
+	};
+
+	// Many small sprite textures packed into a few shared pages, so that
+	// sprites which used to be drawn one texture at a time batch together
+	struct SpriteAtlas {
+		std::vector<RawTexture> m_pages;
+		// One per sprite, in the order they were passed to BuildSpriteAtlas
+		std::vector<SpriteAtlasEntry> m_entries;
+
+		// Hands the pages to the manager and returns one region per sprite
+		std::vector<SpriteAtlasRegion> Instantiate(IResourceManager<Texture>& textureManager);
+	};
+
+	// Packs the base level of each sprite with MaxRects (best short side
+	// fit), largest sprites first, opening a new page whenever none of the
+	// current ones has room. Sprites must be 2D, uncompressed and share a
+	// format.
+	Expected<SpriteAtlas> BuildSpriteAtlas(
+		std::span<RawTexture const* const> sprites,
+		SpriteAtlasParams const& params = {});
+}
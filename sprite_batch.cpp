@@ -0,0 +1,216 @@
+#include "sprite_batch.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+using namespace okami;
+
+namespace {
+    constexpr size_t kParallelGrain = 4096;
+
+    // Layers sort signed, textures by id; the low 32 bits of the id are
+    // enough since batches split on the texture itself, not the key
+    inline uint64_t MakeSortKey(SpriteComponent const& sprite) {
+        auto layer = static_cast<uint32_t>(sprite.m_layer) ^ 0x80000000u;
+        auto texture = static_cast<uint32_t>(sprite.m_texture.GetId());
+        return (static_cast<uint64_t>(layer) << 32) | texture;
+    }
+
+    inline int GetSortKeyLayer(uint64_t key) {
+        return static_cast<int>(static_cast<uint32_t>(key >> 32) ^ 0x80000000u);
+    }
+
+    hlsl::SpriteInstance MakeInstance(Transform const& transform, SpriteComponent const& sprite) {
+        hlsl::SpriteInstance instance;
+        instance.position = transform.m_position;
+        instance.rotation = static_cast<float>(2.0 * glm::atan(transform.m_rotation.z, transform.m_rotation.w));
+        glm::vec2 scale{ transform.m_scaleShear[0][0], transform.m_scaleShear[1][1] };
+        glm::vec2 imageSize;
+
+        auto textureSize = sprite.m_texture.Get().GetSize();
+        if (sprite.m_sourceRect) {
+            imageSize = sprite.m_sourceRect->GetSize();
+            instance.uv0 = sprite.m_sourceRect->GetMin() / textureSize;
+            instance.uv1 = sprite.m_sourceRect->GetMax() / textureSize;
+        } else {
+            imageSize = textureSize;
+            instance.uv0 = glm::vec2(0.0f, 0.0f);
+            instance.uv1 = glm::vec2(1.0f, 1.0f);
+        }
+
+        instance.origin = scale * sprite.m_origin.value_or(imageSize / 2.0f);
+        instance.size = scale * imageSize;
+        instance.color = sprite.m_color;
+        instance.textureIndex = 0;
+        return instance;
+    }
+}
+
+glm::vec2 okami::GetProjectedTextureSize(
+    Transform const& transform,
+    SpriteComponent const& sprite,
+    LodSelector const& view) {
+    // Sprites draw one texel per unit before scaling, as MakeInstance does
+    glm::vec2 scale{ std::abs(transform.m_scaleShear[0][0]), std::abs(transform.m_scaleShear[1][1]) };
+    return sprite.m_texture.Get().GetSize() * scale * view.GetPixelsPerUnit(transform.m_position);
+}
+
+void okami::RadixSort(
+    std::vector<uint64_t>& keys,
+    std::vector<uint32_t>& values,
+    std::vector<uint64_t>& keysScratch,
+    std::vector<uint32_t>& valuesScratch) {
+    constexpr int kDigits = sizeof(uint64_t);
+    auto count = keys.size();
+    if (count < 2) {
+        return;
+    }
+    keysScratch.resize(count);
+    valuesScratch.resize(count);
+
+    // Bytes that are the same in every key would not move anything
+    uint64_t allOnes = ~0ull;
+    uint64_t anyOnes = 0;
+    for (auto key : keys) {
+        allOnes &= key;
+        anyOnes |= key;
+    }
+    auto varying = allOnes ^ anyOnes;
+    std::array<int, kDigits> digits;
+    int digitCount = 0;
+    for (int digit = 0; digit < kDigits; ++digit) {
+        if ((varying >> (digit * 8)) & 0xFF) {
+            digits[digitCount++] = digit;
+        }
+    }
+
+    // Histograms of the remaining bytes in one pass over the keys
+    std::array<std::array<uint32_t, 256>, kDigits> histograms = {};
+    for (auto key : keys) {
+        for (int i = 0; i < digitCount; ++i) {
+            ++histograms[i][(key >> (digits[i] * 8)) & 0xFF];
+        }
+    }
+
+    for (int pass = 0; pass < digitCount; ++pass) {
+        auto& histogram = histograms[pass];
+        auto shift = digits[pass] * 8;
+
+        uint32_t offset = 0;
+        for (auto& bucket : histogram) {
+            auto size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            auto destination = histogram[(keys[i] >> shift) & 0xFF]++;
+            keysScratch[destination] = keys[i];
+            valuesScratch[destination] = values[i];
+        }
+        keys.swap(keysScratch);
+        values.swap(valuesScratch);
+    }
+}
+
+void SpriteBatchBuilder::Clear() {
+    m_entries.clear();
+    m_keys.clear();
+    m_order.clear();
+    m_batches.clear();
+    m_textureRuns.clear();
+    // Staged instances are overwritten by Build; keeping them saves
+    // clearing a large buffer every frame
+}
+
+void SpriteBatchBuilder::Reserve(size_t count) {
+    m_entries.reserve(count);
+    m_textures.reserve(count);
+    m_keys.reserve(count);
+    m_keysScratch.reserve(count);
+    m_order.reserve(count);
+    m_orderScratch.reserve(count);
+    m_staged.reserve(count);
+}
+
+void SpriteBatchBuilder::Add(Transform const* transform, SpriteComponent const& sprite) {
+    if (!sprite.m_texture.IsLoaded()) {
+        return;
+    }
+    m_entries.push_back(Entry{ .m_transform = transform, .m_sprite = &sprite });
+}
+
+void SpriteBatchBuilder::Build(
+    SpriteBatchParams const& params,
+    std::function<uint32_t(Texture const&)> const& textureIndex) {
+    auto count = m_entries.size();
+    m_keys.resize(count);
+    m_order.resize(count);
+    if (m_staged.size() < count) {
+        m_textures.resize(count);
+        m_staged.resize(count);
+    }
+    m_batches.clear();
+    m_textureRuns.clear();
+
+    // Everything read from the sprites is read here, in the order they were
+    // added, so the sorted passes below only touch compact arrays
+    static constexpr Transform kIdentity = Transform::Identity();
+    ParallelFor(count, kParallelGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto const& entry = m_entries[i];
+            m_textures[i] = &entry.m_sprite->m_texture.Get();
+            m_keys[i] = MakeSortKey(*entry.m_sprite);
+            m_order[i] = static_cast<uint32_t>(i);
+            m_staged[i] = MakeInstance(entry.m_transform ? *entry.m_transform : kIdentity, *entry.m_sprite);
+        }
+    });
+    RadixSort(m_keys, m_order, m_keysScratch, m_orderScratch);
+
+    Texture const* runTexture = nullptr;
+    for (uint32_t i = 0; i < count; ++i) {
+        auto layer = GetSortKeyLayer(m_keys[i]);
+        auto const* texture = m_textures[m_order[i]];
+
+        bool newTexture = texture != runTexture;
+        if (newTexture && params.m_bindless) {
+            m_textureRuns.push_back(TextureRun{
+                .m_firstInstance = i,
+                .m_textureIndex = textureIndex ? textureIndex(*texture) : 0 });
+        }
+        runTexture = texture;
+
+        if (m_batches.empty() || m_batches.back().m_layer != layer || (newTexture && !params.m_bindless)) {
+            m_batches.push_back(SpriteBatch{
+                .m_firstInstance = i,
+                .m_instanceCount = 0,
+                .m_layer = layer,
+                .m_texture = params.m_bindless ? nullptr : texture });
+        }
+        ++m_batches.back().m_instanceCount;
+    }
+}
+
+void SpriteBatchBuilder::WriteInstances(std::span<hlsl::SpriteInstance> instances) const {
+    OKAMI_ASSERT(instances.size() >= m_order.size(), "Sprite instance buffer is too small");
+
+    ParallelFor(m_order.size(), kParallelGrain, [&](size_t begin, size_t end) {
+        // Run holding the first instance of the range
+        auto run = std::upper_bound(m_textureRuns.begin(), m_textureRuns.end(), begin,
+            [](size_t instance, TextureRun const& run) { return instance < run.m_firstInstance; });
+        uint32_t index = run == m_textureRuns.begin() ? 0 : std::prev(run)->m_textureIndex;
+
+        for (size_t i = begin; i < end; ++i) {
+            if (run != m_textureRuns.end() && run->m_firstInstance == i) {
+                index = run->m_textureIndex;
+                ++run;
+            }
+            auto instance = m_staged[m_order[i]];
+            instance.textureIndex = index;
+            instances[i] = instance;
+        }
+    });
+}
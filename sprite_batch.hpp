@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "common.hpp"
+#include "lod.hpp"
+#include "renderer.hpp"
+#include "transform.hpp"
+
+#include "shaders/sprite.fxh"
+
+namespace okami {
+	struct SpriteBatchParams {
+		// Writes each sprite's texture index into its instance, so batches
+		// only split where the layer changes and a whole layer draws at once
+		bool m_bindless = false;
+	};
+
+	// One draw call's worth of instances
+	struct SpriteBatch {
+		uint32_t m_firstInstance;
+		uint32_t m_instanceCount;
+		int m_layer;
+		// Texture every instance samples; null when bindless
+		Texture const* m_texture;
+	};
+
+	// Turns sprites into hlsl::SpriteInstances grouped into draws, ordered by
+	// layer and then texture. Sprites are sorted by a 64 bit key (layer, then
+	// texture id) with a radix sort, and sprites with equal keys keep the
+	// order they were added in. Meant to be kept around and refilled every
+	// frame so its buffers are reused.
+	class SpriteBatchBuilder {
+	private:
+		struct Entry {
+			Transform const* m_transform;
+			SpriteComponent const* m_sprite;
+		};
+
+		struct TextureRun {
+			uint32_t m_firstInstance;
+			uint32_t m_textureIndex;
+		};
+
+		std::vector<Entry> m_entries;
+		// Texture of each sprite, in the order they were added
+		std::vector<Texture const*> m_textures;
+		std::vector<uint64_t> m_keys;
+		std::vector<uint64_t> m_keysScratch;
+		std::vector<uint32_t> m_order;
+		std::vector<uint32_t> m_orderScratch;
+		std::vector<SpriteBatch> m_batches;
+		// Sorted instances sharing a texture, used for bindless indices
+		std::vector<TextureRun> m_textureRuns;
+		// Instances in the order sprites were added. Computing them in that
+		// order reads the sprites sequentially; putting them in sorted order
+		// is then a single gather.
+		std::vector<hlsl::SpriteInstance> m_staged;
+
+	public:
+		void Clear();
+		void Reserve(size_t count);
+
+		// The transform (identity if null) and sprite must stay alive until
+		// WriteInstances. Sprites whose texture is not loaded are skipped.
+		void Add(Transform const* transform, SpriteComponent const& sprite);
+
+		// Sorts the sprites, splits them into batches and computes their
+		// instances. When bindless, textureIndex is called once per run of
+		// sprites sharing a texture.
+		void Build(
+			SpriteBatchParams const& params = {},
+			std::function<uint32_t(Texture const&)> const& textureIndex = {});
+
+		inline size_t GetInstanceCount() const {
+			return m_order.size();
+		}
+
+		inline std::span<SpriteBatch const> GetBatches() const {
+			return m_batches;
+		}
+
+		// Fills instances, which must hold GetInstanceCount() elements, in
+		// batch order. Writes are sequential, so this suits mapped upload
+		// memory.
+		void WriteInstances(std::span<hlsl::SpriteInstance> instances) const;
+	};
+
+	// Pixels the sprite's whole texture would cover on screen, ignoring
+	// rotation and its source rect. Feeds texture streaming.
+	glm::vec2 GetProjectedTextureSize(
+		Transform const& transform,
+		SpriteComponent const& sprite,
+		LodSelector const& view);
+
+	// Sorts keys and carries values along, keeping equal keys in their
+	// original order. Only the bytes that differ between keys are sorted.
+	void RadixSort(
+		std::vector<uint64_t>& keys,
+		std::vector<uint32_t>& values,
+		std::vector<uint64_t>& keysScratch,
+		std::vector<uint32_t>& valuesScratch);
+}
@@ -0,0 +1,371 @@
+#include "static_batch.hpp"
+#include "scene.hpp"
+#include "thread_pool.hpp"
+#include "vertex_quantization.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+using namespace okami;
+
+namespace {
+    struct PreparedInstance {
+        AABB m_bounds;
+        glm::vec3 m_center;
+        size_t m_vertexCount;
+        size_t m_indexCount;
+    };
+
+    // A range of the instance order that becomes one chunk
+    struct ChunkRange {
+        size_t m_begin;
+        size_t m_end;
+        size_t m_vertexCount;
+        size_t m_indexCount;
+    };
+
+    AABB TransformBounds(AABB const& bounds, Transform const& transform) {
+        constexpr float kInf = std::numeric_limits<float>::infinity();
+        AABB result{ glm::vec3(kInf), glm::vec3(-kInf) };
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 point(
+                (corner & 1) ? bounds.m_max.x : bounds.m_min.x,
+                (corner & 2) ? bounds.m_max.y : bounds.m_min.y,
+                (corner & 4) ? bounds.m_max.z : bounds.m_min.z);
+            point = transform.TransformPoint(point);
+            result.m_min = glm::min(result.m_min, point);
+            result.m_max = glm::max(result.m_max, point);
+        }
+        return result;
+    }
+
+    // Median splits along the longest axis of the instance centers until
+    // every chunk is within the limits or down to a single instance
+    void SplitChunks(
+        std::vector<uint32_t>& order,
+        size_t begin,
+        size_t end,
+        std::span<PreparedInstance const> prepared,
+        StaticBatchParams const& params,
+        std::vector<ChunkRange>& chunks) {
+        constexpr float kInf = std::numeric_limits<float>::infinity();
+        AABB centers{ glm::vec3(kInf), glm::vec3(-kInf) };
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (size_t i = begin; i < end; ++i) {
+            auto const& instance = prepared[order[i]];
+            centers.m_min = glm::min(centers.m_min, instance.m_center);
+            centers.m_max = glm::max(centers.m_max, instance.m_center);
+            vertexCount += instance.m_vertexCount;
+            indexCount += instance.m_indexCount;
+        }
+
+        auto extent = centers.m_max - centers.m_min;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        bool fits = vertexCount <= params.m_maxChunkVertices && extent[axis] <= params.m_maxChunkExtent;
+        if (fits || end - begin == 1 || extent[axis] <= 0.0f) {
+            chunks.push_back(ChunkRange{ begin, end, vertexCount, indexCount });
+            return;
+        }
+
+        auto middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+            [&](uint32_t a, uint32_t b) {
+                return prepared[a].m_center[axis] < prepared[b].m_center[axis];
+            });
+        SplitChunks(order, begin, middle, prepared, params, chunks);
+        SplitChunks(order, middle, end, prepared, params, chunks);
+    }
+
+    inline glm::vec3 NormalizeOr(glm::vec3 const& v, glm::vec3 const& fallback) {
+        auto length = glm::length(v);
+        return length > 0.0f ? v / length : fallback;
+    }
+
+    // Copies one instance's vertices to the chunk as floats and moves them
+    // into world space. Normals go through the cofactor matrix, which is the
+    // inverse transpose up to the determinant's scale and sign.
+    Error WriteInstanceVertices(
+        StaticBatchInstance const& instance,
+        std::span<GeometryMeshDesc const> chunkMeshes,
+        size_t chunkIndex,
+        std::span<uint8_t> vertexData,
+        size_t firstVertex,
+        bool& mirrored) {
+        auto const& geometry = *instance.m_geometry;
+        auto const& source = geometry.GetMeshes()[instance.m_meshIndex];
+        auto const& chunk = chunkMeshes[chunkIndex];
+        auto vertexCount = source.m_vertexCount;
+
+        for (auto const& attrib : chunk.m_attributes) {
+            auto stride = attrib.GetStride();
+            auto dest = vertexData.subspan(attrib.m_offset + firstVertex * stride, vertexCount * stride);
+            auto sourceAttrib = source.TryGetAttribute(attrib.m_type);
+            if (!sourceAttrib) {
+                GenerateDefaultAttributeData(dest, attrib.m_type);
+                continue;
+            }
+
+            auto buffers = geometry.GetBuffers();
+            if (sourceAttrib->m_buffer < 0 || sourceAttrib->m_buffer >= buffers.size()) {
+                return Error("Invalid attribute buffer index");
+            }
+            auto sourceData = buffers[sourceAttrib->m_buffer].GetData();
+            auto sourceSize = sourceAttrib->GetStride() * vertexCount;
+            if (sourceAttrib->m_offset + sourceSize > sourceData.size()) {
+                return Error("Attribute data out of range");
+            }
+            auto error = ConvertAttribute(attrib.m_type, sourceAttrib->m_encoding, AttributeEncoding::Float,
+                sourceData.subspan(sourceAttrib->m_offset, sourceSize), dest, vertexCount, source.m_aabb);
+            OKAMI_ERROR_RETURN(error);
+        }
+
+        auto const& transform = instance.m_transform;
+        glm::mat3 linear = glm::mat3_cast(transform.m_rotation) * transform.m_scaleShear;
+        glm::mat3 cofactor(
+            glm::cross(linear[1], linear[2]),
+            glm::cross(linear[2], linear[0]),
+            glm::cross(linear[0], linear[1]));
+        float determinant = glm::dot(linear[0], cofactor[0]);
+        mirrored = determinant < 0.0f;
+        float handedness = mirrored ? -1.0f : 1.0f;
+
+        auto access = [&]<typename T>(AttributeType type, TypeWrapper<T>) {
+            auto attrib = chunk.TryGetAttribute(type);
+            return std::span(reinterpret_cast<T*>(vertexData.data() + attrib->m_offset) + firstVertex, vertexCount);
+        };
+        for (auto& position : access(AttributeType::Position, TypeWrapper<glm::vec3>{})) {
+            position = transform.m_position + linear * position;
+        }
+        for (auto& normal : access(AttributeType::Normal, TypeWrapper<glm::vec3>{})) {
+            normal = NormalizeOr(handedness * (cofactor * normal), normal);
+        }
+        for (auto& tangent : access(AttributeType::Tangent, TypeWrapper<glm::vec4>{})) {
+            auto direction = NormalizeOr(linear * glm::vec3(tangent), glm::vec3(tangent));
+            tangent = glm::vec4(direction, tangent.w * handedness);
+        }
+        return {};
+    }
+}
+
+StaticBatchSource const* StaticBatchChunk::FindSource(uint32_t triangle) const {
+    auto it = std::upper_bound(m_sources.begin(), m_sources.end(), triangle,
+        [](uint32_t value, StaticBatchSource const& source) {
+            return value < source.m_firstTriangle;
+        });
+    if (it == m_sources.begin()) {
+        return nullptr;
+    }
+    --it;
+    return triangle < it->m_firstTriangle + it->m_triangleCount ? &*it : nullptr;
+}
+
+Expected<StaticBatch> okami::BuildStaticBatch(
+    std::span<StaticBatchInstance const> instances,
+    StaticBatchParams const& params) {
+    std::vector<PreparedInstance> prepared;
+    prepared.reserve(instances.size());
+    for (auto const& instance : instances) {
+        if (!instance.m_geometry || instance.m_meshIndex >= instance.m_geometry->GetMeshCount()) {
+            return std::unexpected(Error("Static batch instance has no such mesh"));
+        }
+        auto const& mesh = instance.m_geometry->GetMeshes()[instance.m_meshIndex];
+        if (!mesh.TryGetAttribute(AttributeType::Position)) {
+            return std::unexpected(Error("Static batch meshes need positions"));
+        }
+        auto indexCount = mesh.m_indices ? mesh.m_indices->m_count : mesh.m_vertexCount;
+        if (indexCount % 3 != 0) {
+            return std::unexpected(Error("Static batch meshes must be triangle lists"));
+        }
+
+        auto bounds = TransformBounds(mesh.m_aabb, instance.m_transform);
+        prepared.push_back(PreparedInstance{
+            .m_bounds = bounds,
+            .m_center = (bounds.m_min + bounds.m_max) * 0.5f,
+            .m_vertexCount = mesh.m_vertexCount,
+            .m_indexCount = indexCount,
+        });
+    }
+
+    StaticBatch batch;
+    if (instances.empty()) {
+        return batch;
+    }
+
+    std::vector<uint32_t> order(instances.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::vector<ChunkRange> ranges;
+    SplitChunks(order, 0, order.size(), prepared, params, ranges);
+
+    // Lay the chunks out the way RawGeometry::Pack would, so the result
+    // uploads without repacking
+    // Indices, source offsets and GPU buffer offsets are all 32 bit
+    constexpr uint64_t kMaxCount = std::numeric_limits<uint32_t>::max();
+    size_t vertexBufferSize = 0;
+    size_t indexBufferSize = 0;
+    std::vector<GeometryMeshDesc> meshes;
+    meshes.reserve(ranges.size());
+    for (auto const& range : ranges) {
+        if (range.m_vertexCount > kMaxCount) {
+            return std::unexpected(Error("Static batch chunk has too many vertices"));
+        }
+        if (range.m_indexCount > kMaxCount) {
+            return std::unexpected(Error("Static batch chunk has too many indices"));
+        }
+        GeometryMeshDesc mesh;
+        mesh.m_type = MeshType::Static;
+        mesh.m_vertexCount = range.m_vertexCount;
+        for (auto type : kStaticMeshAttributes) {
+            mesh.m_attributes.push_back(Attribute{ .m_type = type, .m_buffer = 0, .m_offset = vertexBufferSize });
+            vertexBufferSize += GetStride(type) * range.m_vertexCount;
+            if (vertexBufferSize > kMaxCount) {
+                return std::unexpected(Error("Static batch vertex buffer exceeds 4 GiB"));
+            }
+        }
+        mesh.m_indices = IndexInfo{
+            .m_type = AccessorComponentType::UInt,
+            .m_buffer = 1,
+            .m_count = range.m_indexCount,
+            .m_offset = indexBufferSize,
+        };
+        indexBufferSize += sizeof(uint32_t) * range.m_indexCount;
+        if (indexBufferSize > kMaxCount) {
+            return std::unexpected(Error("Static batch index buffer exceeds 4 GiB"));
+        }
+        meshes.push_back(std::move(mesh));
+    }
+
+    std::vector<uint8_t> vertexData(vertexBufferSize);
+    std::vector<uint8_t> indexData(indexBufferSize);
+    batch.m_chunks.resize(ranges.size());
+    std::vector<Error> errors(ranges.size());
+
+    ParallelFor(ranges.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t chunkIndex = begin; chunkIndex < end; ++chunkIndex) {
+            auto const& range = ranges[chunkIndex];
+            auto& chunk = batch.m_chunks[chunkIndex];
+            auto& mesh = meshes[chunkIndex];
+            auto indices = reinterpret_cast<uint32_t*>(indexData.data() + mesh.m_indices->m_offset);
+
+            chunk.m_sources.reserve(range.m_end - range.m_begin);
+
+            uint32_t firstVertex = 0;
+            uint32_t firstIndex = 0;
+            for (size_t i = range.m_begin; i < range.m_end; ++i) {
+                auto const& instance = instances[order[i]];
+                auto vertexCount = static_cast<uint32_t>(prepared[order[i]].m_vertexCount);
+
+                bool mirrored = false;
+                auto error = WriteInstanceVertices(instance, meshes, chunkIndex, vertexData, firstVertex, mirrored);
+                if (error.IsError()) {
+                    errors[chunkIndex] = error;
+                    break;
+                }
+
+                auto sourceIndices = instance.m_geometry->ReadIndices(instance.m_meshIndex);
+                if (!sourceIndices) {
+                    errors[chunkIndex] = sourceIndices.error();
+                    break;
+                }
+                auto indexCount = static_cast<uint32_t>(sourceIndices->size());
+                for (uint32_t j = 0; j < indexCount; ++j) {
+                    auto index = (*sourceIndices)[j];
+                    if (index >= vertexCount) {
+                        errors[chunkIndex] = Error("Index out of range");
+                        break;
+                    }
+                    indices[firstIndex + j] = firstVertex + index;
+                }
+                if (errors[chunkIndex].IsError()) {
+                    break;
+                }
+                // Mirroring transforms turn the winding around
+                if (mirrored) {
+                    for (uint32_t j = 0; j < indexCount; j += 3) {
+                        std::swap(indices[firstIndex + j + 1], indices[firstIndex + j + 2]);
+                    }
+                }
+
+                chunk.m_sources.push_back(StaticBatchSource{
+                    .m_instance = order[i],
+                    .m_entity = instance.m_entity,
+                    .m_firstVertex = firstVertex,
+                    .m_vertexCount = vertexCount,
+                    .m_firstTriangle = firstIndex / 3,
+                    .m_triangleCount = indexCount / 3,
+                });
+                firstVertex += vertexCount;
+                firstIndex += indexCount;
+            }
+
+            if (errors[chunkIndex].IsOk()) {
+                auto positions = std::span(
+                    reinterpret_cast<glm::vec3 const*>(vertexData.data() + mesh.m_attributes[0].m_offset),
+                    mesh.m_vertexCount);
+                mesh.m_aabb = ComputeAABB(positions);
+                chunk.m_bounds = mesh.m_aabb;
+            }
+        }
+    });
+
+    for (auto const& error : errors) {
+        OKAMI_UNEXPECTED_RETURN(error);
+    }
+
+    std::vector<GeometryBuffer> buffers;
+    buffers.emplace_back(std::move(vertexData));
+    buffers.emplace_back(std::move(indexData));
+    batch.m_geometry = RawGeometry(std::move(buffers), std::move(meshes));
+    return batch;
+}
+
+std::vector<entity_t> StaticBatch::Instantiate(
+    Engine& engine,
+    IResourceManager<Geometry>& geometryManager,
+    entity_t parent) {
+    auto geometry = geometryManager.Create(std::move(m_geometry));
+
+    std::vector<int32_t> parentIndices(m_chunks.size(), -1);
+    std::vector<entity_t> entities(m_chunks.size());
+    engine.CreateEntities(parentIndices, entities, parent);
+
+    std::vector<StaticMeshComponent> meshes;
+    meshes.reserve(m_chunks.size());
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        meshes.push_back(StaticMeshComponent{ .m_mesh = geometry, .m_meshIndex = static_cast<int>(i) });
+    }
+    engine.AddComponents(entities, std::move(meshes));
+    engine.AddComponents(entities, std::vector<Transform>(m_chunks.size(), Transform::Identity()));
+
+    std::unordered_set<entity_t> batched;
+    for (auto const& chunk : m_chunks) {
+        for (auto const& source : chunk.m_sources) {
+            if (source.m_entity != kNullEntity && batched.insert(source.m_entity).second) {
+                engine.RemoveComponent<StaticMeshComponent>(source.m_entity);
+            }
+        }
+    }
+    return entities;
+}
+
+std::vector<StaticBatchInstance> okami::GetStaticBatchInstances(
+    SceneDesc const& desc,
+    RawGeometry const& geometry,
+    Transform const& placement) {
+    std::vector<StaticBatchInstance> instances;
+    instances.reserve(desc.m_meshNodes.size());
+    for (size_t i = 0; i < desc.m_meshNodes.size(); ++i) {
+        instances.push_back(StaticBatchInstance{
+            .m_geometry = &geometry,
+            .m_meshIndex = static_cast<uint32_t>(desc.m_meshIndices[i]),
+            .m_transform = placement * desc.m_transforms[desc.m_meshNodes[i]],
+        });
+    }
+    return instances;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <span>
+
+#include "common.hpp"
+#include "engine.hpp"
+#include "geometry.hpp"
+#include "renderer.hpp"
+#include "transform.hpp"
+
+namespace okami {
+	struct SceneDesc;
+
+	// One mesh placed in the world that will not move again
+	struct StaticBatchInstance {
+		RawGeometry const* m_geometry = nullptr;
+		uint32_t m_meshIndex = 0;
+		Transform m_transform;
+		// Entity drawing the mesh today, or kNullEntity if there is none
+		entity_t m_entity = kNullEntity;
+	};
+
+	struct StaticBatchParams {
+		// Chunks are split until they hold at most this many vertices...
+		size_t m_maxChunkVertices = 1 << 18;
+		// ...and their instances' centers lie within a box this wide
+		float m_maxChunkExtent = 64.0f;
+	};
+
+	// The part of a chunk that came from one instance
+	struct StaticBatchSource {
+		// Index of the instance passed to BuildStaticBatch
+		uint32_t m_instance;
+		entity_t m_entity;
+		uint32_t m_firstVertex;
+		uint32_t m_vertexCount;
+		uint32_t m_firstTriangle;
+		uint32_t m_triangleCount;
+	};
+
+	struct StaticBatchChunk {
+		AABB m_bounds;
+		// Sorted by m_firstTriangle
+		std::vector<StaticBatchSource> m_sources;
+
+		// The source a triangle of the chunk's mesh belongs to, such as the
+		// triangle of a raycast hit; null if it is out of range
+		StaticBatchSource const* FindSource(uint32_t triangle) const;
+	};
+
+	// Instances pre-transformed into world space and merged into a few large
+	// meshes, one per chunk, so that static environments take a handful of
+	// draws. Chunks are spatially coherent so they still cull well.
+	struct StaticBatch {
+		// Mesh i is chunk i, packed for GetDefaultMeshRequirements() with
+		// 32 bit indices
+		RawGeometry m_geometry;
+		std::vector<StaticBatchChunk> m_chunks;
+
+		// Hands the geometry to the manager, creates one entity per chunk
+		// under parent and removes the StaticMeshComponents of the batched
+		// entities. Returns the chunk entities in chunk order.
+		std::vector<entity_t> Instantiate(
+			Engine& engine,
+			IResourceManager<Geometry>& geometryManager,
+			entity_t parent = kRoot);
+	};
+
+	// Batches the base (finest) mesh of every instance. Meshes must be
+	// triangle lists with positions; any encoding is accepted and the result
+	// is stored as floats.
+	Expected<StaticBatch> BuildStaticBatch(
+		std::span<StaticBatchInstance const> instances,
+		StaticBatchParams const& params = {});
+
+	// Every mesh node of a scene placed at placement, without entities
+	std::vector<StaticBatchInstance> GetStaticBatchInstances(
+		SceneDesc const& desc,
+		RawGeometry const& geometry,
+		Transform const& placement = Transform::Identity());
+}
@@ -22,8 +22,11 @@ namespace okami {
 	struct Storage {
 		std::tuple<std::queue<ComponentUpdateSignal<Ts>>...> updateSignals;
 		std::tuple<std::queue<ComponentAddSignal<Ts>>...> addSignals;
+		std::tuple<std::queue<ComponentAddBatchSignal<Ts>>...> addBatchSignals;
 		std::tuple<std::queue<ComponentRemoveSignal<Ts>>...> removeSignals;
 		std::queue<EntityRemoveSignal> entityRemoveSignals;
+		// Every component type reads these, so they are only cleared once all have
+		std::vector<EntityCloneSignal> entityCloneSignals;
 
 		std::tuple<StorageAccessor<Ts, Ts...>...> accessors = std::make_tuple(
 			StorageAccessor<Ts, Ts...>(this)...);
@@ -60,6 +63,11 @@ namespace okami {
 						std::get<std::queue<ComponentAddSignal<T>>>(addSignals).push(std::move(signal));
 					}
 				);
+				collection.RegisterHandler<ComponentAddBatchSignal<T>>(
+					[this](ComponentAddBatchSignal<T> signal) {
+						std::get<std::queue<ComponentAddBatchSignal<T>>>(addBatchSignals).push(std::move(signal));
+					}
+				);
 				collection.RegisterHandler<ComponentUpdateSignal<T>>(
 					[this](ComponentUpdateSignal<T> signal) {
 						std::get<std::queue<ComponentUpdateSignal<T>>>(updateSignals).push(std::move(signal));
@@ -74,6 +82,11 @@ namespace okami {
 
 			(registerForType(TypeWrapper<Ts>{}), ...);
 
+			collection.RegisterHandler<EntityCloneSignal>(
+				[this](EntityCloneSignal signal) {
+					entityCloneSignals.push_back(std::move(signal));
+				}
+			);
 			collection.RegisterHandler<EntityRemoveSignal>(
 				[this](EntityRemoveSignal signal) {
 					entityRemoveSignals.push(std::move(signal));
@@ -117,6 +130,69 @@ namespace okami {
 					}
 					hasSignals = true;
 				}
+				// Process batched add signals
+				auto& addBatchQueue = std::get<std::queue<ComponentAddBatchSignal<T>>>(addBatchSignals);
+				while (!addBatchQueue.empty()) {
+					auto signal = std::move(addBatchQueue.front());
+					addBatchQueue.pop();
+					auto const& batch = *signal.m_batch;
+					auto& storage = GetStorage<T>();
+					storage.reserve(storage.size() + batch.m_entities.size());
+					auto& callback = std::get<std::function<void(entity_t, T const&)>>(addCallbacks);
+					for (size_t i = 0; i < batch.m_entities.size(); ++i) {
+						auto [resultIt, inserted] = storage.try_emplace(batch.m_entities[i], batch.m_components[i]);
+						if (!inserted) {
+							std::stringstream ss;
+							ss << "Entity " << batch.m_entities[i] << " already has component of type " << typeid(T).name();
+							errors.push_back(Error(ss.str()));
+						}
+						else if (callback) {
+							callback(resultIt->first, resultIt->second);
+						}
+					}
+					hasSignals = true;
+				}
+				// Process clone signals after adds so that components added to
+				// the sources in the same frame are copied too
+				for (auto const& signal : entityCloneSignals) {
+					auto const& batch = *signal.m_batch;
+					auto& storage = GetStorage<T>();
+					auto const sourceCount = batch.m_sources.size();
+					auto const copyCount = batch.m_clones.size() / sourceCount;
+
+					std::vector<std::pair<size_t, T const*>> sources;
+					for (size_t i = 0; i < sourceCount; ++i) {
+						auto it = storage.find(batch.m_sources[i]);
+						if (it != storage.end()) {
+							sources.emplace_back(i, &it->second);
+						}
+					}
+					if (sources.empty()) {
+						continue;
+					}
+					storage.reserve(storage.size() + sources.size() * copyCount);
+
+					auto& callback = std::get<std::function<void(entity_t, T const&)>>(addCallbacks);
+					std::vector<T> copies;
+					copies.reserve(copyCount);
+					for (auto [sourceIndex, component] : sources) {
+						copies.clear();
+						ComponentCloner<T>::Clone(*component, copyCount, copies);
+						for (size_t copy = 0; copy < copyCount; ++copy) {
+							auto clone = batch.m_clones[copy * sourceCount + sourceIndex];
+							auto [resultIt, inserted] = storage.try_emplace(clone, std::move(copies[copy]));
+							if (!inserted) {
+								std::stringstream ss;
+								ss << "Entity " << clone << " already has component of type " << typeid(T).name();
+								errors.push_back(Error(ss.str()));
+							}
+							else if (callback) {
+								callback(resultIt->first, resultIt->second);
+							}
+						}
+					}
+					hasSignals = true;
+				}
 				// Process update signals
 				auto& updateQueue = std::get<std::queue<ComponentUpdateSignal<T>>>(updateSignals);
 				while (!updateQueue.empty()) {
@@ -160,6 +236,7 @@ namespace okami {
 				};
 
 			(processForType(TypeWrapper<Ts>{}), ...);
+			entityCloneSignals.clear();
 
 			auto processEntityRemovedForType = [this, &hasSignals](auto typeWrapper, entity_t e) {
 				using T = typename decltype(typeWrapper)::Type;
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include "../bvh.hpp"
+#include "../geometry.hpp"
+#include "../transform.hpp"
+#include "mesh_utils.hpp"
+#include <chrono>
+#include <random>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+using namespace okami;
+
+namespace {
+    // Reference closest hit, using the same intersection convention as the BVH
+    std::optional<RayHit> BruteForceRaycast(
+        std::span<glm::vec3 const> positions,
+        std::span<uint32_t const> indices,
+        Ray const& ray) {
+        std::optional<RayHit> best;
+        for (size_t i = 0; i < indices.size() / 3; ++i) {
+            glm::vec3 v0 = positions[indices[3 * i]];
+            glm::vec3 v1 = positions[indices[3 * i + 1]];
+            glm::vec3 v2 = positions[indices[3 * i + 2]];
+            auto single = TriangleBVH::Build(std::vector<glm::vec3>{ v0, v1, v2 }, {}, BVHBuildParams{ .m_parallel = false });
+            auto hit = single->Raycast(ray);
+            if (hit && (!best || hit->m_distance < best->m_distance)) {
+                best = RayHit{ hit->m_distance, static_cast<uint32_t>(i), hit->m_barycentrics };
+            }
+        }
+        return best;
+    }
+}
+
+class BVHTest : public ::testing::Test {
+protected:
+    std::mt19937 rng{ 42 };
+};
+
+TEST_F(BVHTest, EmptyMesh_NoHits) {
+    auto bvh = TriangleBVH::Build(std::span<glm::vec3 const>{}, {});
+    ASSERT_TRUE(bvh.has_value());
+    EXPECT_EQ(bvh->GetTriangleCount(), 0);
+    EXPECT_FALSE(bvh->Raycast(Ray{ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f) }).has_value());
+}
+
+TEST_F(BVHTest, InvalidIndex_Fails) {
+    std::vector<glm::vec3> positions{ glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+    std::vector<uint32_t> indices{ 0, 1, 3 };
+    auto bvh = TriangleBVH::Build(positions, indices);
+    EXPECT_FALSE(bvh.has_value());
+}
+
+TEST_F(BVHTest, SingleTriangle_DistanceAndBarycentrics) {
+    std::vector<glm::vec3> positions{ glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(1.0f, 0.0f, 5.0f), glm::vec3(0.0f, 1.0f, 5.0f) };
+    auto bvh = TriangleBVH::Build(positions, {});
+    ASSERT_TRUE(bvh.has_value());
+
+    auto hit = bvh->Raycast(Ray{ glm::vec3(0.25f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) });
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_NEAR(hit->m_distance, 5.0f, 1e-5f);
+    EXPECT_EQ(hit->m_triangle, 0);
+    EXPECT_NEAR(hit->m_barycentrics.x, 0.25f, 1e-5f);
+    EXPECT_NEAR(hit->m_barycentrics.y, 0.5f, 1e-5f);
+
+    // Both faces are hit
+    auto backHit = bvh->Raycast(Ray{ glm::vec3(0.25f, 0.25f, 10.0f), glm::vec3(0.0f, 0.0f, -1.0f) });
+    ASSERT_TRUE(backHit.has_value());
+    EXPECT_NEAR(backHit->m_distance, 5.0f, 1e-5f);
+
+    // Respects the ray interval
+    EXPECT_FALSE(bvh->Raycast(Ray{ glm::vec3(0.25f, 0.25f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 0.0f, 4.0f }).has_value());
+    EXPECT_FALSE(bvh->Raycast(Ray{ glm::vec3(0.25f, 0.25f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 6.0f }).has_value());
+}
+
+TEST_F(BVHTest, RandomRays_MatchBruteForce) {
+    auto geometry = MakeIndexedGeometry(MakeGridMesh(24, 0.4f));
+    auto positions = geometry.TryAccess<glm::vec3 const>(AttributeType::Position);
+    ASSERT_TRUE(positions.has_value());
+    auto indices = geometry.ReadIndices();
+    ASSERT_TRUE(indices.has_value());
+
+    for (bool parallel : { false, true }) {
+        auto bvh = TriangleBVH::Build(geometry, 0, BVHBuildParams{ .m_maxLeafSize = 2, .m_parallel = parallel });
+        ASSERT_TRUE(bvh.has_value());
+        EXPECT_EQ(bvh->GetTriangleCount(), indices->size() / 3);
+
+        std::uniform_real_distribution<float> coord(-4.0f, 28.0f);
+        std::uniform_real_distribution<float> height(-5.0f, 5.0f);
+        for (int i = 0; i < 300; ++i) {
+            glm::vec3 origin(coord(rng), coord(rng), height(rng) > 0.0f ? 5.0f : -5.0f);
+            glm::vec3 target(coord(rng), coord(rng), 0.0f);
+            Ray ray{ origin, glm::normalize(target - origin) };
+
+            auto expected = BruteForceRaycast(
+                std::span(positions->begin(), positions->end()), *indices, ray);
+            auto actual = bvh->Raycast(ray);
+
+            ASSERT_EQ(expected.has_value(), actual.has_value()) << "Ray " << i;
+            if (expected) {
+                EXPECT_NEAR(expected->m_distance, actual->m_distance, 1e-4f);
+                EXPECT_EQ(expected->m_triangle, actual->m_triangle);
+            }
+            EXPECT_EQ(bvh->Occluded(ray), expected.has_value());
+        }
+    }
+}
+
+TEST_F(BVHTest, SharedEdgesAndVertices_AreWatertight) {
+    auto geometry = MakeIndexedGeometry(MakeGridMesh(16));
+    ASSERT_TRUE(geometry.BuildBVHs().IsOk());
+    auto bvh = geometry.GetBVH(0);
+    ASSERT_NE(bvh, nullptr);
+
+    // Rays aimed exactly at grid vertices, edge midpoints and diagonals must not leak
+    for (int y = 1; y < 16; ++y) {
+        for (int x = 1; x < 16; ++x) {
+            for (glm::vec3 offset : { glm::vec3(0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.0f) }) {
+                glm::vec3 target = glm::vec3(x, y, 0.0f) + offset;
+                glm::vec3 origin = target + glm::vec3(0.3f, -0.7f, 2.0f);
+                auto hit = bvh->Raycast(Ray{ origin, target - origin });
+                ASSERT_TRUE(hit.has_value()) << "Leak at " << target.x << ", " << target.y;
+                EXPECT_NEAR(hit->m_distance, 1.0f, 1e-5f);
+            }
+        }
+    }
+}
+
+TEST_F(BVHTest, HitBarycentrics_ReconstructHitPoint) {
+    auto geometry = MakeIndexedGeometry(MakeGridMesh(8, 0.3f));
+    ASSERT_TRUE(geometry.BuildBVHs().IsOk());
+    auto positions = geometry.TryAccess<glm::vec3 const>(AttributeType::Position);
+    auto indices = geometry.ReadIndices();
+    ASSERT_TRUE(indices.has_value());
+
+    std::uniform_real_distribution<float> coord(0.1f, 7.9f);
+    for (int i = 0; i < 100; ++i) {
+        Ray ray{ glm::vec3(coord(rng), coord(rng), 10.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        auto hit = geometry.GetBVH()->Raycast(ray);
+        ASSERT_TRUE(hit.has_value());
+
+        auto p = positions->begin();
+        glm::vec3 v0 = p[(*indices)[3 * hit->m_triangle]];
+        glm::vec3 v1 = p[(*indices)[3 * hit->m_triangle + 1]];
+        glm::vec3 v2 = p[(*indices)[3 * hit->m_triangle + 2]];
+        auto b = hit->m_barycentrics;
+        glm::vec3 point = (1.0f - b.x - b.y) * v0 + b.x * v1 + b.y * v2;
+        glm::vec3 expected = ray.m_origin + hit->m_distance * ray.m_direction;
+        EXPECT_NEAR(point.x, expected.x, 1e-4f);
+        EXPECT_NEAR(point.y, expected.y, 1e-4f);
+        EXPECT_NEAR(point.z, expected.z, 1e-4f);
+    }
+}
+
+TEST_F(BVHTest, InstanceRaycast_UsesWorldTransform) {
+    auto geometry = MakeIndexedGeometry(MakeGridMesh(4));
+    ASSERT_TRUE(geometry.BuildBVHs().IsOk());
+    auto bvh = geometry.GetBVH();
+
+    // Grid scaled by 2, laid flat facing +y and moved up to y = 10
+    auto transform = Transform::Translate(0.0f, 10.0f, 0.0f) * Transform::RotateX(-glm::pi<float>() * 0.5f) * Transform::Scale(2.0f);
+
+    Ray ray{ glm::vec3(3.0f, 0.0f, -3.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+    auto hit = Raycast(*bvh, transform, ray);
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_NEAR(hit->m_distance, 10.0f, 1e-4f);
+    EXPECT_TRUE(Occluded(*bvh, transform, ray));
+
+    // Outside of the scaled grid
+    Ray miss{ glm::vec3(9.0f, 0.0f, -3.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+    EXPECT_FALSE(Raycast(*bvh, transform, miss).has_value());
+    EXPECT_FALSE(Occluded(*bvh, transform, miss));
+}
+
+TEST_F(BVHTest, MillionTriangles_Benchmark) {
+    // 708 x 708 quads ~ 1M triangles
+    auto geometry = MakeIndexedGeometry(MakeGridMesh(708, 0.5f));
+
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(geometry.BuildBVHs().IsOk());
+    auto buildTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - buildStart).count();
+    auto bvh = geometry.GetBVH();
+    ASSERT_NE(bvh, nullptr);
+
+    const int rayCount = 10000;
+    std::uniform_real_distribution<float> coord(0.0f, 708.0f);
+    // Keep targets away from the border, where a grazing ray can pass under the jittered edge
+    std::uniform_real_distribution<float> targetCoord(16.0f, 692.0f);
+    std::vector<Ray> rays;
+    for (int i = 0; i < rayCount; ++i) {
+        glm::vec3 origin(coord(rng), coord(rng), 50.0f);
+        glm::vec3 target(targetCoord(rng), targetCoord(rng), 0.0f);
+        rays.push_back(Ray{ origin, glm::normalize(target - origin) });
+    }
+
+    int hits = 0;
+    auto castStart = std::chrono::high_resolution_clock::now();
+    for (auto const& ray : rays) {
+        hits += bvh->Raycast(ray).has_value() ? 1 : 0;
+    }
+    auto castTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - castStart).count();
+
+    std::cout << "Built BVH over " << bvh->GetTriangleCount() << " triangles in "
+              << buildTime << "ms, " << rayCount << " raycasts in " << castTime << "ms ("
+              << (castTime * 1000.0 / rayCount) << " us per ray)" << std::endl;
+
+    EXPECT_EQ(hits, rayCount);
+    EXPECT_LT(buildTime, 10000.0);
+    EXPECT_LT(castTime / rayCount, 1.0); // Sub-millisecond picking
+}
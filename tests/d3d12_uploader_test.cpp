@@ -201,17 +201,11 @@ TEST_F(D3D12Test, UploaderMesh) {
         Sleep(1);
     }
 
-    // Transition resource
-    m_commandAllocator->Reset();
-    m_commandList->Reset(m_commandAllocator.Get(), nullptr);
-    manager.TransitionMeshes(*m_commandList.Get());
-    m_commandList->Close();
-
-    std::array<ID3D12CommandList*, 1> commandLists = {
-        m_commandList.Get()
-    };
-    m_commandQueue->ExecuteCommandLists(1, commandLists.data());
-	m_commandQueue->Signal(m_fence.Get(), ++m_fenceValue);
+    // Geometry is suballocated from a shared page and needs no transition
+    auto const& privateData = std::any_cast<GeometryPrivate const&>(resource->m_privateData);
+    EXPECT_EQ(manager.GetVertexHeap().GetPageCount(), 1);
+    EXPECT_EQ(privateData.m_vertices.m_resource, manager.GetVertexHeap().GetPage(0));
+    EXPECT_EQ(privateData.m_vertices.m_allocation.m_offset % GeometryManager::kGeometryAlignment, 0);
 
     uploader->Stop();
 }
@@ -114,6 +114,15 @@ TEST(ErrorTest, StringViewConstructorTest) {
     EXPECT_EQ(error.Str(), message);
 }
 
+TEST(ErrorTest, CancelledSurvivesContextTest) {
+    auto error = LoadCancelledError().WithContext("texture.oktex");
+    EXPECT_TRUE(IsLoadCancelled(error));
+    EXPECT_EQ(error.Str(), "Load cancelled: texture.oktex");
+
+    // Only the code marks cancellation, not the message
+    EXPECT_FALSE(IsLoadCancelled(Error("Load cancelled")));
+}
+
 // Test InterfaceCollection
 TEST(InterfaceCollectionTest, RegisterAndQueryTest) {
     InterfaceCollection collection;
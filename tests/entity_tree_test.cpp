@@ -40,6 +40,77 @@ TEST_F(EntityTreeTest, CreateEntityWithParentTest) {
 }
 
 // Hierarchy Tests
+TEST_F(EntityTreeTest, CreateEntitiesTest) {
+	entity_t parent = world->CreateEntity(*signalHandlers);
+
+	size_t createSignals = 0;
+	signalHandlers->RegisterHandler<EntityCreateSignal>([&](EntityCreateSignal) { ++createSignals; });
+
+	std::vector<int32_t> parentIndices{ -1, 0, 0, 1, -1 };
+	std::vector<entity_t> entities(parentIndices.size());
+	world->CreateEntities(*signalHandlers, parentIndices, entities, parent);
+
+	EXPECT_EQ(createSignals, parentIndices.size());
+	EXPECT_EQ(world->GetParent(entities[0]), parent);
+	EXPECT_EQ(world->GetParent(entities[1]), entities[0]);
+	EXPECT_EQ(world->GetParent(entities[2]), entities[0]);
+	EXPECT_EQ(world->GetParent(entities[3]), entities[1]);
+	EXPECT_EQ(world->GetParent(entities[4]), parent);
+
+	// Children keep batch order
+	std::vector<entity_t> children;
+	for (auto child : world->GetChildren(entities[0])) {
+		children.push_back(child);
+	}
+	EXPECT_EQ(children, (std::vector<entity_t>{ entities[1], entities[2] }));
+}
+
+TEST_F(EntityTreeTest, CloneSubtreeTest) {
+	entity_t a = world->CreateEntity(*signalHandlers);
+	entity_t b = world->CreateEntity(*signalHandlers, a);
+	entity_t c = world->CreateEntity(*signalHandlers, a);
+	entity_t d = world->CreateEntity(*signalHandlers, b);
+	entity_t target = world->CreateEntity(*signalHandlers);
+
+	std::vector<EntityCloneSignal> cloneSignals;
+	signalHandlers->RegisterHandler<EntityCloneSignal>([&](EntityCloneSignal signal) {
+		cloneSignals.push_back(std::move(signal));
+	});
+
+	auto roots = world->CloneSubtree(*signalHandlers, a, target, 3);
+	ASSERT_EQ(roots.size(), 3);
+	ASSERT_EQ(cloneSignals.size(), 1);
+
+	auto const& batch = *cloneSignals[0].m_batch;
+	EXPECT_EQ(batch.m_sources, (std::vector<entity_t>{ a, b, d, c }));
+	ASSERT_EQ(batch.m_clones.size(), 12);
+
+	std::vector<entity_t> targetChildren;
+	for (auto child : world->GetChildren(target)) {
+		targetChildren.push_back(child);
+	}
+	EXPECT_EQ(targetChildren, roots);
+
+	for (size_t copy = 0; copy < roots.size(); ++copy) {
+		auto const* clones = &batch.m_clones[copy * 4];
+		EXPECT_EQ(clones[0], roots[copy]);
+		EXPECT_EQ(world->GetParent(clones[1]), clones[0]);
+		EXPECT_EQ(world->GetParent(clones[2]), clones[1]);
+		EXPECT_EQ(world->GetParent(clones[3]), clones[0]);
+
+		// Siblings keep their order
+		std::vector<entity_t> children;
+		for (auto child : world->GetChildren(clones[0])) {
+			children.push_back(child);
+		}
+		EXPECT_EQ(children, (std::vector<entity_t>{ clones[1], clones[3] }));
+	}
+
+	// The source is untouched
+	EXPECT_EQ(world->GetParent(a), kRoot);
+	EXPECT_EQ(world->GetFirstChild(d), kNullEntity);
+}
+
 TEST_F(EntityTreeTest, SetParentTest) {
 	entity_t entity1 = world->CreateEntity(*signalHandlers);
 	entity_t entity2 = world->CreateEntity(*signalHandlers);
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include "../float_packing.hpp"
+#include <cmath>
+#include <glm/common.hpp>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    // Random positive values over the exponents the packed formats cover
+    std::vector<float> RandomValues(size_t count, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> exponent(-20.0f, 16.0f);
+        std::uniform_real_distribution<float> mantissa(1.0f, 2.0f);
+        std::vector<float> values;
+        for (size_t i = 0; i < count; ++i) {
+            values.push_back(std::ldexp(mantissa(rng), static_cast<int>(exponent(rng))));
+        }
+        return values;
+    }
+}
+
+class FloatPackingTest : public ::testing::Test {
+};
+
+TEST_F(FloatPackingTest, Half_RoundTripsEveryValue) {
+    std::vector<uint16_t> halves(65536);
+    for (size_t i = 0; i < halves.size(); ++i) {
+        halves[i] = static_cast<uint16_t>(i);
+    }
+    std::vector<float> values(halves.size());
+    DecodeHalf(halves, values);
+
+    std::vector<uint16_t> encoded(halves.size());
+    EncodeHalf(values, encoded);
+
+    for (size_t i = 0; i < halves.size(); ++i) {
+        auto half = halves[i];
+        bool isNaN = (half & 0x7c00) == 0x7c00 && (half & 0x03ff) != 0;
+        EXPECT_EQ(std::isnan(values[i]), isNaN) << i;
+        if (isNaN) {
+            EXPECT_TRUE((encoded[i] & 0x7c00) == 0x7c00 && (encoded[i] & 0x03ff) != 0) << i;
+            continue;
+        }
+        EXPECT_EQ(values[i], HalfToFloat(half)) << i;
+        EXPECT_EQ(encoded[i], half) << i;
+        EXPECT_EQ(FloatToHalf(values[i]), half) << i;
+    }
+}
+
+TEST_F(FloatPackingTest, Half_RoundsToNearest) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> exponent(-30.0f, 16.0f);
+    std::uniform_real_distribution<float> mantissa(1.0f, 2.0f);
+    std::vector<float> values;
+    for (int i = 0; i < 100000; ++i) {
+        float value = std::ldexp(mantissa(rng), static_cast<int>(exponent(rng)));
+        values.push_back(i % 2 ? value : -value);
+    }
+    values.insert(values.end(), { 0.0f, -0.0f, 65504.0f, 65520.0f, 1e10f, 6.0e-8f, 1e-10f });
+
+    // Odd length so the vector path and the scalar tail are both used
+    std::vector<uint16_t> halves(values.size());
+    EncodeHalf(values, halves);
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        float value = values[i];
+        ASSERT_EQ(halves[i], FloatToHalf(value)) << value;
+        float decoded = HalfToFloat(halves[i]);
+        if (std::abs(value) >= 65520.0f) {
+            EXPECT_TRUE(std::isinf(decoded)) << value;
+            continue;
+        }
+        // No other half is closer to the value
+        uint16_t magnitude = halves[i] & 0x7fff;
+        uint16_t sign = halves[i] & 0x8000;
+        float error = std::abs(decoded - value);
+        if (magnitude > 0) {
+            EXPECT_LE(error, std::abs(HalfToFloat(sign | (magnitude - 1)) - value)) << value;
+        }
+        if (magnitude < 0x7bff) {
+            EXPECT_LE(error, std::abs(HalfToFloat(sign | (magnitude + 1)) - value)) << value;
+        }
+        // Normal halves keep the relative error bound
+        if (std::abs(value) >= 6.103515625e-5f) {
+            EXPECT_LE(error, std::abs(value) * kHalfMaxRelativeError) << value;
+        }
+    }
+}
+
+TEST_F(FloatPackingTest, R11G11B10F_RoundTripsEveryValue) {
+    // Every finite code of each channel; exponent 31 holds infinity and NaN
+    for (uint32_t code = 0; code < (31u << 6); ++code) {
+        auto red = UnpackR11G11B10F(code).x;
+        auto green = UnpackR11G11B10F(code << 11).y;
+        ASSERT_EQ(PackR11G11B10F(glm::vec3(red, 0.0f, 0.0f)), code) << red;
+        ASSERT_EQ(PackR11G11B10F(glm::vec3(0.0f, green, 0.0f)), code << 11) << green;
+        // Same exponent and top mantissa bits as a half
+        EXPECT_EQ(red, HalfToFloat(static_cast<uint16_t>(code << 4))) << code;
+    }
+    for (uint32_t code = 0; code < (31u << 5); ++code) {
+        auto blue = UnpackR11G11B10F(code << 22).z;
+        ASSERT_EQ(PackR11G11B10F(glm::vec3(0.0f, 0.0f, blue)), code << 22) << blue;
+        EXPECT_EQ(blue, HalfToFloat(static_cast<uint16_t>(code << 5))) << code;
+    }
+    EXPECT_TRUE(std::isinf(UnpackR11G11B10F(31u << 6).x));
+    EXPECT_TRUE(std::isnan(UnpackR11G11B10F(31u << 27 | 1u << 22).z));
+}
+
+TEST_F(FloatPackingTest, R11G11B10F_RoundsToNearestAndClamps) {
+    for (float value : RandomValues(100000, 5)) {
+        auto packed = PackR11G11B10F(glm::vec3(value));
+        auto decoded = UnpackR11G11B10F(packed);
+        uint32_t codes[3] = { packed & 0x7FFu, (packed >> 11) & 0x7FFu, packed >> 22 };
+        uint32_t largest[3] = { 0x7BFu, 0x7BFu, 0x3DFu };
+        for (int c = 0; c < 3; ++c) {
+            uint32_t shift = c * 11;
+            float error = std::abs(decoded[c] - value);
+            // No other code is closer to the value
+            if (codes[c] > 0) {
+                EXPECT_LE(error, std::abs(UnpackR11G11B10F((codes[c] - 1) << shift)[c] - value)) << value;
+            }
+            if (codes[c] < largest[c]) {
+                EXPECT_LE(error, std::abs(UnpackR11G11B10F((codes[c] + 1) << shift)[c] - value)) << value;
+            }
+        }
+    }
+
+    auto nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_EQ(PackR11G11B10F(glm::vec3(-1.0f, nan, -0.0f)), 0u);
+    auto clamped = UnpackR11G11B10F(PackR11G11B10F(glm::vec3(1e10f, std::numeric_limits<float>::infinity(), 65535.0f)));
+    EXPECT_EQ(clamped, glm::vec3(65024.0f, 65024.0f, 64512.0f));
+}
+
+TEST_F(FloatPackingTest, RGB9E5_RoundTripsAndBoundsError) {
+    auto values = RandomValues(30000, 9);
+    for (size_t i = 0; i + 3 <= values.size(); i += 3) {
+        // Values past the largest encoding clamp to it
+        glm::vec3 color = glm::min(glm::vec3(values[i], values[i + 1], values[i + 2]), glm::vec3(65408.0f));
+        auto packed = PackRGB9E5(color);
+        auto decoded = UnpackRGB9E5(packed);
+
+        // Each channel is within half a step of the shared exponent, and the
+        // largest keeps 9 significant bits above the smallest exponent
+        float step = std::ldexp(1.0f, static_cast<int>(packed >> 27) - 24);
+        for (int c = 0; c < 3; ++c) {
+            EXPECT_LE(std::abs(decoded[c] - color[c]), 0.5f * step) << color[c];
+        }
+        float largest = std::max(std::max(color.x, color.y), color.z);
+        float decodedLargest = std::max(std::max(decoded.x, decoded.y), decoded.z);
+        if (largest >= 1.0f / 32768.0f) {
+            EXPECT_LE(std::abs(decodedLargest - largest), largest / 512.0f) << largest;
+        }
+
+        // Decoded colors are exactly representable
+        EXPECT_EQ(PackRGB9E5(decoded), packed);
+    }
+
+    EXPECT_EQ(UnpackRGB9E5(PackRGB9E5(glm::vec3(0.0f))), glm::vec3(0.0f));
+    EXPECT_EQ(UnpackRGB9E5(PackRGB9E5(glm::vec3(1.0f, 0.5f, 0.25f))), glm::vec3(1.0f, 0.5f, 0.25f));
+    auto nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_EQ(UnpackRGB9E5(PackRGB9E5(glm::vec3(1e10f, -4.0f, nan))), glm::vec3(65408.0f, 0.0f, 0.0f));
+}
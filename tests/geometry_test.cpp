@@ -1,8 +1,13 @@
 #include <gtest/gtest.h>
 #include "../geometry.hpp"
 #include "../paths.hpp"
+#include "gltf_utils.hpp"
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <random>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
@@ -264,3 +269,240 @@ TEST_F(GeometryTest, GetRawVertexData_InvalidBuffer_Throws) {
         auto data = geometry.GetRawVertexData(999);
     }, std::out_of_range) << "Should throw for invalid buffer index";
 }
+
+namespace {
+    // Reference bounds, one axis at a time as LoadGLTF used to compute them
+    AABB ReferenceAABB(std::span<glm::vec3 const> positions) {
+        AABB aabb{ glm::vec3(std::numeric_limits<float>::infinity()), glm::vec3(-std::numeric_limits<float>::infinity()) };
+        for (auto const& p : positions) {
+            aabb.m_min = glm::min(aabb.m_min, p);
+        }
+        for (auto const& p : positions) {
+            aabb.m_max = glm::max(aabb.m_max, p);
+        }
+        return aabb;
+    }
+
+    // size x size quad grid at a random offset, with 16 bit indices
+    struct GridPrimitive {
+        std::vector<glm::vec3> m_positions;
+        std::vector<glm::vec3> m_normals;
+        std::vector<uint16_t> m_indices;
+    };
+
+    GridPrimitive MakeGridPrimitive(int size, std::mt19937& rng) {
+        std::uniform_real_distribution<float> offset(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> jitter(-0.25f, 0.25f);
+        glm::vec3 origin(offset(rng), offset(rng), offset(rng));
+
+        GridPrimitive grid;
+        for (int y = 0; y <= size; ++y) {
+            for (int x = 0; x <= size; ++x) {
+                grid.m_positions.push_back(origin + glm::vec3(float(x), float(y), jitter(rng)));
+                grid.m_normals.emplace_back(0.0f, 0.0f, 1.0f);
+            }
+        }
+        auto vertex = [size](int x, int y) { return static_cast<uint16_t>(y * (size + 1) + x); };
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                grid.m_indices.insert(grid.m_indices.end(), { vertex(x, y), vertex(x + 1, y), vertex(x + 1, y + 1) });
+                grid.m_indices.insert(grid.m_indices.end(), { vertex(x, y), vertex(x + 1, y + 1), vertex(x, y + 1) });
+            }
+        }
+        return grid;
+    }
+}
+
+TEST_F(GeometryTest, ComputeAABB_MatchesReference) {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> coord(-1000.0f, 1000.0f);
+
+    // Every remainder of the 4-wide kernel, with NaNs scattered in
+    for (size_t count = 0; count < 40; ++count) {
+        std::vector<glm::vec3> positions;
+        for (size_t i = 0; i < count; ++i) {
+            positions.emplace_back(coord(rng), coord(rng), coord(rng));
+        }
+        if (count > 5) {
+            positions[count / 2].y = std::numeric_limits<float>::quiet_NaN();
+        }
+
+        auto expected = ReferenceAABB(positions);
+        auto actual = ComputeAABB(positions);
+        EXPECT_EQ(actual.m_min, expected.m_min) << count;
+        EXPECT_EQ(actual.m_max, expected.m_max) << count;
+    }
+}
+
+TEST_F(GeometryTest, LoadGLTF_InvalidAccessor_Fails) {
+    auto path = std::filesystem::temp_directory_path() / "okami_geometry_test_invalid.glb";
+
+    std::vector<glm::vec3> positions{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+    std::vector<uint16_t> indices{ 0, 1, 2 };
+    GLBBuilder builder;
+    auto position = builder.AddVec3(positions);
+    auto index = builder.AddIndices(indices);
+    // Texture coordinates that claim more data than the buffer holds
+    auto uv = builder.AddVec2(std::vector<glm::vec2>(1));
+    builder.AddMesh({ GLBBuilder::Primitive{ { { "POSITION", position } }, index } });
+    builder.AddMesh({ GLBBuilder::Primitive{ { { "POSITION", position }, { "TEXCOORD_0", uv } }, index } });
+    builder.Save(path);
+
+    // Bump the accessor count past the end of its view
+    auto glb = builder.Build();
+    std::string bytes(glb.begin(), glb.end());
+    auto pos = bytes.find(R"("count":1,"type":"VEC2")");
+    ASSERT_NE(pos, std::string::npos);
+    bytes.replace(pos, 9, R"("count":9)");
+    std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size());
+
+    auto result = RawGeometry::LoadGLTF(path);
+    ASSERT_FALSE(result.has_value());
+    EXPECT_NE(result.error().Str().find("Mesh 1 primitive 0"), std::string::npos) << result.error();
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+TEST_F(GeometryTest, LoadGLTF_ManyPrimitives_Benchmark) {
+    // 64 meshes of 64 primitives, each a 16 x 16 grid
+    constexpr int kMeshCount = 64;
+    constexpr int kPrimitivesPerMesh = 64;
+    std::mt19937 rng(9);
+
+    GLBBuilder builder;
+    std::vector<AABB> expected;
+    for (int m = 0; m < kMeshCount; ++m) {
+        std::vector<GLBBuilder::Primitive> primitives;
+        for (int p = 0; p < kPrimitivesPerMesh; ++p) {
+            auto grid = MakeGridPrimitive(16, rng);
+            expected.push_back(ReferenceAABB(grid.m_positions));
+            primitives.push_back(GLBBuilder::Primitive{
+                .m_attributes = {
+                    { "POSITION", builder.AddVec3(grid.m_positions) },
+                    { "NORMAL", builder.AddVec3(grid.m_normals) } },
+                .m_indices = builder.AddIndices(grid.m_indices) });
+        }
+        builder.AddMesh(std::move(primitives));
+    }
+
+    auto path = std::filesystem::temp_directory_path() / "okami_geometry_test_many.glb";
+    builder.Save(path);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto result = RawGeometry::LoadGLTF(path);
+    auto loadTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(result.has_value()) << result.error();
+
+    std::cout << "Loaded " << result->GetMeshCount() << " primitives in " << loadTime << "ms" << std::endl;
+
+    ASSERT_EQ(result->GetMeshCount(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        auto const& mesh = result->GetMeshes()[i];
+        EXPECT_EQ(mesh.m_vertexCount, 17 * 17);
+        ASSERT_TRUE(mesh.HasIndexBuffer());
+        EXPECT_EQ(mesh.m_indices->m_count, 16 * 16 * 6);
+        EXPECT_EQ(mesh.m_aabb.m_min, expected[i].m_min) << i;
+        EXPECT_EQ(mesh.m_aabb.m_max, expected[i].m_max) << i;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+TEST_F(GeometryTest, LoadGLTF_GlbMatchesGltf) {
+    std::mt19937 rng(12);
+    GLBBuilder builder;
+    std::vector<GLBBuilder::Primitive> primitives;
+    for (int p = 0; p < 3; ++p) {
+        auto grid = MakeGridPrimitive(4 + p, rng);
+        primitives.push_back(GLBBuilder::Primitive{
+            .m_attributes = {
+                { "POSITION", builder.AddVec3(grid.m_positions) },
+                { "NORMAL", builder.AddVec3(grid.m_normals) } },
+            .m_indices = builder.AddIndices(grid.m_indices) });
+    }
+    builder.AddMesh(std::move(primitives));
+
+    auto directory = std::filesystem::temp_directory_path() / "okami_geometry_test_formats";
+    std::filesystem::create_directories(directory);
+    builder.Save(directory / "grids.glb");
+    builder.SaveGLTF(directory / "grids.gltf");
+
+    {
+        auto glb = RawGeometry::LoadGLTF(directory / "grids.glb");
+        ASSERT_TRUE(glb.has_value()) << glb.error();
+        auto gltf = RawGeometry::LoadGLTF(directory / "grids.gltf");
+        ASSERT_TRUE(gltf.has_value()) << gltf.error();
+
+        ASSERT_EQ(glb->GetMeshCount(), gltf->GetMeshCount());
+        ASSERT_EQ(glb->GetBuffers().size(), gltf->GetBuffers().size());
+        for (size_t i = 0; i < glb->GetBuffers().size(); ++i) {
+            auto a = glb->GetBuffers()[i].GetData();
+            auto b = gltf->GetBuffers()[i].GetData();
+            ASSERT_EQ(a.size(), b.size());
+            EXPECT_TRUE(std::equal(a.begin(), a.end(), b.begin()));
+            // Buffers of a .glb are used where the binary chunk was mapped
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(a.data()) % 4, 0);
+        }
+        for (size_t i = 0; i < glb->GetMeshCount(); ++i) {
+            auto const& a = glb->GetMeshes()[i];
+            auto const& b = gltf->GetMeshes()[i];
+            EXPECT_EQ(a.m_vertexCount, b.m_vertexCount);
+            EXPECT_EQ(a.m_aabb.m_min, b.m_aabb.m_min);
+            EXPECT_EQ(a.m_aabb.m_max, b.m_aabb.m_max);
+            EXPECT_EQ(*glb->ReadIndices(i), *gltf->ReadIndices(i));
+        }
+
+        // The mapping moves with the buffers that reference it
+        auto moved = std::move(*glb);
+        auto positions = moved.TryAccess<glm::vec3 const>(AttributeType::Position, 0);
+        ASSERT_TRUE(positions.has_value());
+        EXPECT_EQ(ComputeAABB(*positions).m_min, moved.GetMeshes()[0].m_aabb.m_min);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+}
+
+TEST_F(GeometryTest, LoadGLTF_LargeGlb_Benchmark) {
+    // One 1024 x 1024 grid: ~1M vertices, 24MB of positions and normals
+    std::mt19937 rng(13);
+    auto grid = MakeGridPrimitive(1023, rng);
+    std::vector<uint32_t> indices;
+    for (int y = 0; y < 1023; ++y) {
+        for (int x = 0; x < 1023; ++x) {
+            uint32_t v = y * 1024 + x;
+            indices.insert(indices.end(), { v, v + 1, v + 1025, v, v + 1025, v + 1024 });
+        }
+    }
+
+    GLBBuilder builder;
+    builder.AddMesh({ GLBBuilder::Primitive{
+        .m_attributes = {
+            { "POSITION", builder.AddVec3(grid.m_positions) },
+            { "NORMAL", builder.AddVec3(grid.m_normals) } },
+        .m_indices = builder.AddIndices(indices) } });
+    auto path = std::filesystem::temp_directory_path() / "okami_geometry_test_large.glb";
+    builder.Save(path);
+
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto result = RawGeometry::LoadGLTF(path);
+        auto loadTime = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        ASSERT_TRUE(result.has_value()) << result.error();
+
+        size_t bytes = result->GetBuffers()[0].size();
+        std::cout << "Loaded " << (bytes >> 20) << "MB .glb in " << loadTime << "ms" << std::endl;
+
+        auto expected = ReferenceAABB(grid.m_positions);
+        EXPECT_EQ(result->GetMeshes()[0].m_vertexCount, 1024 * 1024);
+        EXPECT_EQ(result->GetMeshes()[0].m_aabb.m_min, expected.m_min);
+        EXPECT_EQ(result->GetMeshes()[0].m_aabb.m_max, expected.m_max);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
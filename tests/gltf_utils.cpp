@@ -0,0 +1,164 @@
+#include "gltf_utils.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+	constexpr int kFloat = 5126;
+	constexpr int kUnsignedShort = 5123;
+	constexpr int kUnsignedInt = 5125;
+
+	void AppendUInt32(std::vector<uint8_t>& out, uint32_t value) {
+		uint8_t bytes[4];
+		std::memcpy(bytes, &value, sizeof(value));
+		out.insert(out.end(), bytes, bytes + 4);
+	}
+}
+
+int GLBBuilder::AddAccessor(void const* data, size_t byteLength, int componentType, std::string type, size_t count) {
+	// Keep every view 4 byte aligned, as glTF requires for float data
+	m_binary.resize((m_binary.size() + 3) & ~size_t(3));
+	size_t offset = m_binary.size();
+	m_binary.resize(offset + byteLength);
+	if (byteLength > 0) {
+		std::memcpy(m_binary.data() + offset, data, byteLength);
+	}
+	m_accessors.push_back(Accessor{ offset, byteLength, componentType, std::move(type), count });
+	return static_cast<int>(m_accessors.size() - 1);
+}
+
+int GLBBuilder::AddVec3(std::span<glm::vec3 const> values) {
+	return AddAccessor(values.data(), values.size_bytes(), kFloat, "VEC3", values.size());
+}
+
+int GLBBuilder::AddVec2(std::span<glm::vec2 const> values) {
+	return AddAccessor(values.data(), values.size_bytes(), kFloat, "VEC2", values.size());
+}
+
+int GLBBuilder::AddIndices(std::span<uint16_t const> indices) {
+	return AddAccessor(indices.data(), indices.size_bytes(), kUnsignedShort, "SCALAR", indices.size());
+}
+
+int GLBBuilder::AddIndices(std::span<uint32_t const> indices) {
+	return AddAccessor(indices.data(), indices.size_bytes(), kUnsignedInt, "SCALAR", indices.size());
+}
+
+int GLBBuilder::AddMesh(std::vector<Primitive> primitives) {
+	m_meshes.push_back(std::move(primitives));
+	return static_cast<int>(m_meshes.size() - 1);
+}
+
+int GLBBuilder::AddNode(Node node) {
+	m_nodes.push_back(std::move(node));
+	return static_cast<int>(m_nodes.size() - 1);
+}
+
+std::string GLBBuilder::BuildJSON(size_t binaryLength, std::string const& uri) const {
+	std::ostringstream json;
+	json << R"({"asset":{"version":"2.0"},"buffers":[{"byteLength":)" << binaryLength;
+	if (!uri.empty()) {
+		json << R"(,"uri":")" << uri << '"';
+	}
+	json << "}]";
+
+	json << R"(,"bufferViews":[)";
+	for (size_t i = 0; i < m_accessors.size(); ++i) {
+		json << (i ? "," : "") << R"({"buffer":0,"byteOffset":)" << m_accessors[i].m_offset
+			<< R"(,"byteLength":)" << m_accessors[i].m_byteLength << "}";
+	}
+	json << R"(],"accessors":[)";
+	for (size_t i = 0; i < m_accessors.size(); ++i) {
+		json << (i ? "," : "") << R"({"bufferView":)" << i << R"(,"componentType":)" << m_accessors[i].m_componentType
+			<< R"(,"count":)" << m_accessors[i].m_count << R"(,"type":")" << m_accessors[i].m_type << R"("})";
+	}
+	json << R"(],"meshes":[)";
+	for (size_t i = 0; i < m_meshes.size(); ++i) {
+		json << (i ? "," : "") << R"({"primitives":[)";
+		for (size_t j = 0; j < m_meshes[i].size(); ++j) {
+			auto const& primitive = m_meshes[i][j];
+			json << (j ? "," : "") << R"({"attributes":{)";
+			bool first = true;
+			for (auto const& [name, accessor] : primitive.m_attributes) {
+				json << (first ? "" : ",") << '"' << name << R"(":)" << accessor;
+				first = false;
+			}
+			json << "}";
+			if (primitive.m_indices >= 0) {
+				json << R"(,"indices":)" << primitive.m_indices;
+			}
+			json << "}";
+		}
+		json << "]}";
+	}
+	json << "]";
+
+	if (!m_nodes.empty()) {
+		std::vector<bool> isChild(m_nodes.size(), false);
+		json << R"(,"nodes":[)";
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			auto const& node = m_nodes[i];
+			json << (i ? "," : "") << R"({"translation":[)" << node.m_translation.x << "," << node.m_translation.y << "," << node.m_translation.z
+				<< R"(],"rotation":[)" << node.m_rotation.x << "," << node.m_rotation.y << "," << node.m_rotation.z << "," << node.m_rotation.w
+				<< R"(],"scale":[)" << node.m_scale.x << "," << node.m_scale.y << "," << node.m_scale.z << "]";
+			if (node.m_mesh >= 0) {
+				json << R"(,"mesh":)" << node.m_mesh;
+			}
+			if (!node.m_children.empty()) {
+				json << R"(,"children":[)";
+				for (size_t j = 0; j < node.m_children.size(); ++j) {
+					json << (j ? "," : "") << node.m_children[j];
+					isChild[node.m_children[j]] = true;
+				}
+				json << "]";
+			}
+			json << "}";
+		}
+		json << R"(],"scene":0,"scenes":[{"nodes":[)";
+		bool first = true;
+		for (size_t i = 0; i < m_nodes.size(); ++i) {
+			if (!isChild[i]) {
+				json << (first ? "" : ",") << i;
+				first = false;
+			}
+		}
+		json << "]}]";
+	}
+
+	json << "}";
+	return json.str();
+}
+
+std::vector<uint8_t> GLBBuilder::Build() const {
+	auto binary = m_binary;
+	binary.resize((binary.size() + 3) & ~size_t(3));
+
+	auto text = BuildJSON(binary.size(), "");
+	text.resize((text.size() + 3) & ~size_t(3), ' ');
+
+	std::vector<uint8_t> glb;
+	AppendUInt32(glb, 0x46546C67); // glTF
+	AppendUInt32(glb, 2);
+	AppendUInt32(glb, static_cast<uint32_t>(12 + 8 + text.size() + 8 + binary.size()));
+	AppendUInt32(glb, static_cast<uint32_t>(text.size()));
+	AppendUInt32(glb, 0x4E4F534A); // JSON
+	glb.insert(glb.end(), text.begin(), text.end());
+	AppendUInt32(glb, static_cast<uint32_t>(binary.size()));
+	AppendUInt32(glb, 0x004E4942); // BIN
+	glb.insert(glb.end(), binary.begin(), binary.end());
+	return glb;
+}
+
+void GLBBuilder::Save(std::filesystem::path const& path) const {
+	auto glb = Build();
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<char const*>(glb.data()), static_cast<std::streamsize>(glb.size()));
+}
+
+void GLBBuilder::SaveGLTF(std::filesystem::path const& path) const {
+	auto binaryPath = path;
+	binaryPath.replace_extension(".bin");
+	std::ofstream(binaryPath, std::ios::binary).write(
+		reinterpret_cast<char const*>(m_binary.data()), static_cast<std::streamsize>(m_binary.size()));
+	std::ofstream(path) << BuildJSON(m_binary.size(), binaryPath.filename().string());
+}
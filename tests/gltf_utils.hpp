@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Writes minimal .glb and .gltf files for tests. Every accessor gets its own tightly
+// packed buffer view in the single binary chunk.
+class GLBBuilder {
+public:
+	struct Primitive {
+		std::map<std::string, int> m_attributes;
+		int m_indices = -1;
+	};
+
+	struct Node {
+		int m_mesh = -1;
+		glm::vec3 m_translation = glm::vec3(0.0f);
+		// x, y, z, w as glTF stores it
+		glm::vec4 m_rotation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		glm::vec3 m_scale = glm::vec3(1.0f);
+		std::vector<int> m_children;
+	};
+
+private:
+	struct Accessor {
+		size_t m_offset;
+		size_t m_byteLength;
+		int m_componentType;
+		std::string m_type;
+		size_t m_count;
+	};
+
+	std::vector<uint8_t> m_binary;
+	std::vector<Accessor> m_accessors;
+	std::vector<std::vector<Primitive>> m_meshes;
+	std::vector<Node> m_nodes;
+
+	int AddAccessor(void const* data, size_t byteLength, int componentType, std::string type, size_t count);
+	std::string BuildJSON(size_t binaryLength, std::string const& uri) const;
+
+public:
+	int AddVec3(std::span<glm::vec3 const> values);
+	int AddVec2(std::span<glm::vec2 const> values);
+	int AddIndices(std::span<uint16_t const> indices);
+	int AddIndices(std::span<uint32_t const> indices);
+
+	int AddMesh(std::vector<Primitive> primitives);
+	// Nodes that are nobody's child become the roots of the default scene
+	int AddNode(Node node);
+
+	std::vector<uint8_t> Build() const;
+	void Save(std::filesystem::path const& path) const;
+	// Writes a .gltf with the binary data in a .bin file next to it
+	void SaveGLTF(std::filesystem::path const& path) const;
+};
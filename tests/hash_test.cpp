@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "../hash.hpp"
+#include "../geometry.hpp"
+#include "../texture.hpp"
+#include "texture_utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+
+using namespace okami;
+
+namespace {
+    std::vector<uint8_t> RandomBytes(size_t count, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> bytes(count);
+        for (auto& byte : bytes) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return bytes;
+    }
+
+    RawGeometry MakeTriangle(float scale) {
+        std::vector<glm::vec3> positions{ { 0.0f, 0.0f, 0.0f }, { scale, 0.0f, 0.0f }, { 0.0f, scale, 0.0f } };
+        std::vector<uint8_t> bytes(positions.size() * sizeof(glm::vec3));
+        std::memcpy(bytes.data(), positions.data(), bytes.size());
+
+        GeometryMeshDesc mesh;
+        mesh.m_type = MeshType::Static;
+        mesh.m_vertexCount = positions.size();
+        mesh.m_attributes = { Attribute{ AttributeType::Position, 0, 0 } };
+        mesh.m_aabb = AABB{ glm::vec3(0.0f), glm::vec3(scale, scale, 0.0f) };
+
+        std::vector<std::vector<uint8_t>> buffers;
+        buffers.push_back(std::move(bytes));
+        return RawGeometry(std::move(buffers), { mesh });
+    }
+
+}
+
+class HashTest : public ::testing::Test {
+};
+
+TEST_F(HashTest, Incremental_MatchesOneShot) {
+    auto bytes = RandomBytes(10000, 1);
+
+    // Split points around stripe and block boundaries
+    for (size_t split : { 0, 1, 63, 64, 65, 1023, 1024, 1025, 5000, 10000 }) {
+        ContentHasher hasher;
+        hasher.Update(std::span(bytes).first(split));
+        hasher.Update(std::span(bytes).subspan(split));
+        EXPECT_EQ(hasher.Finish(), HashBytes(bytes)) << "Split at " << split;
+    }
+
+    ContentHasher byteByByte;
+    for (auto byte : bytes) {
+        byteByByte.Update(std::span(&byte, 1));
+    }
+    EXPECT_EQ(byteByByte.Finish(), HashBytes(bytes));
+}
+
+TEST_F(HashTest, Finish_DoesNotConsumeState) {
+    auto bytes = RandomBytes(300, 2);
+    ContentHasher hasher;
+    hasher.Update(std::span(bytes).first(100));
+    auto partial = hasher.Finish();
+    EXPECT_EQ(partial, hasher.Finish());
+    hasher.Update(std::span(bytes).subspan(100));
+    EXPECT_EQ(hasher.Finish(), HashBytes(bytes));
+}
+
+TEST_F(HashTest, SingleBitChanges_GiveDistinctHashes) {
+    auto bytes = RandomBytes(2048, 3);
+    std::unordered_set<ContentHash> hashes;
+    hashes.insert(HashBytes(bytes));
+    for (size_t bit = 0; bit < bytes.size() * 8; bit += 7) {
+        auto flipped = bytes;
+        flipped[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+        EXPECT_TRUE(hashes.insert(HashBytes(flipped)).second) << "Collision flipping bit " << bit;
+    }
+}
+
+TEST_F(HashTest, TrailingZeros_ChangeHash) {
+    // The zero padded tail must not make these collide
+    std::unordered_set<ContentHash> hashes;
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i <= 130; ++i) {
+        EXPECT_TRUE(hashes.insert(HashBytes(bytes)).second) << "Collision at length " << i;
+        bytes.push_back(0);
+    }
+}
+
+TEST_F(HashTest, Geometry_HashesContent) {
+    auto a = MakeTriangle(1.0f);
+    auto b = MakeTriangle(1.0f);
+    auto c = MakeTriangle(2.0f);
+    EXPECT_EQ(a.ComputeContentHash(), b.ComputeContentHash());
+    EXPECT_NE(a.ComputeContentHash(), c.ComputeContentHash());
+
+    // Same bytes described differently
+    auto desc = b.GetMeshes()[0];
+    desc.m_vertexCount = 2;
+    std::vector<std::vector<uint8_t>> buffers;
+    buffers.emplace_back(b.GetRawVertexData().begin(), b.GetRawVertexData().end());
+    RawGeometry d(std::move(buffers), { desc });
+    EXPECT_NE(a.ComputeContentHash(), d.ComputeContentHash());
+}
+
+TEST_F(HashTest, Texture_HashesContent) {
+    auto a = MakeNoiseTexture(16, 8, 4);
+    auto b = MakeNoiseTexture(16, 8, 4);
+    auto c = MakeNoiseTexture(16, 8, 5);
+    // Same pixels with the rows laid out differently
+    RawTexture d(MakeTextureInfo(8, 16));
+    std::copy(a.GetData().begin(), a.GetData().end(), d.GetData().begin());
+    EXPECT_EQ(a.ComputeContentHash(), b.ComputeContentHash());
+    EXPECT_NE(a.ComputeContentHash(), c.ComputeContentHash());
+    EXPECT_NE(a.ComputeContentHash(), d.ComputeContentHash());
+}
+
+TEST_F(HashTest, Throughput_Benchmark) {
+    auto bytes = RandomBytes(64 << 20, 6);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto hash = HashBytes(bytes);
+    auto hashTime = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Hashed " << (bytes.size() >> 20) << "MB in " << hashTime * 1000.0 << "ms ("
+        << (bytes.size() / double(1 << 30)) / hashTime << " GB/s)" << std::endl;
+    EXPECT_NE(hash, ContentHash{});
+}
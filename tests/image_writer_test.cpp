@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+#include "../image_writer.hpp"
+#include "../texture_conversion.hpp"
+#include "../lodepng.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace okami;
+
+namespace {
+    // Smooth gradients, flat areas and a noisy band, like a rendered frame
+    std::vector<uint8_t> MakePixels(uint32_t width, uint32_t height, uint32_t channels, size_t rowPitch) {
+        std::vector<uint8_t> pixels(rowPitch * height, 0xCD);
+        std::mt19937 rng(3);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                auto* texel = &pixels[y * rowPitch + size_t(x) * channels];
+                bool noisy = y > height / 2 && y < height / 2 + height / 8;
+                for (uint32_t c = 0; c < channels; ++c) {
+                    uint8_t value = x < width / 4 ? 40 : static_cast<uint8_t>((x * (c + 1) + y * 3) / 2);
+                    texel[c] = noisy ? static_cast<uint8_t>(rng()) : value;
+                }
+            }
+        }
+        return pixels;
+    }
+
+    std::vector<uint8_t> Tight(ImageView const& image) {
+        std::vector<uint8_t> result;
+        auto rowSize = size_t(image.m_width) * image.m_channels;
+        for (uint32_t y = 0; y < image.m_height; ++y) {
+            auto const* row = image.m_data + y * image.m_rowPitch;
+            result.insert(result.end(), row, row + rowSize);
+        }
+        return result;
+    }
+
+    std::string Write(ImageView const& image, ImageFileFormat format, ImageWriteParams const& params = {}) {
+        std::ostringstream stream;
+        auto error = WriteImage(stream, image, format, params);
+        EXPECT_TRUE(error.IsOk()) << error;
+        return stream.str();
+    }
+
+    std::vector<uint8_t> DecodePng(std::string const& encoded, uint32_t channels) {
+        static constexpr LodePNGColorType kColorTypes[5] = { LCT_GREY, LCT_GREY, LCT_GREY_ALPHA, LCT_RGB, LCT_RGBA };
+        std::vector<uint8_t> pixels;
+        unsigned width = 0;
+        unsigned height = 0;
+        auto error = lodepng::decode(pixels, width, height,
+            reinterpret_cast<unsigned char const*>(encoded.data()), encoded.size(), kColorTypes[channels], 8);
+        EXPECT_EQ(error, 0u) << lodepng_error_text(error);
+        return pixels;
+    }
+
+    // Reference QOI decoder, following the specification
+    std::vector<uint8_t> DecodeQoi(std::string const& encoded, uint32_t& width, uint32_t& height, uint32_t& channels) {
+        auto const* data = reinterpret_cast<uint8_t const*>(encoded.data());
+        auto readBigEndian = [&](size_t offset) {
+            return (uint32_t(data[offset]) << 24) | (uint32_t(data[offset + 1]) << 16) |
+                (uint32_t(data[offset + 2]) << 8) | data[offset + 3];
+        };
+        EXPECT_EQ(std::memcmp(data, "qoif", 4), 0);
+        width = readBigEndian(4);
+        height = readBigEndian(8);
+        channels = data[12];
+
+        std::vector<uint8_t> pixels;
+        std::array<std::array<uint8_t, 4>, 64> seen = {};
+        std::array<uint8_t, 4> pixel = { 0, 0, 0, 255 };
+        size_t position = 14;
+        int run = 0;
+        for (size_t i = 0; i < size_t(width) * height; ++i) {
+            if (run > 0) {
+                --run;
+            } else {
+                auto op = data[position++];
+                if (op == 0xFE) {
+                    pixel[0] = data[position++];
+                    pixel[1] = data[position++];
+                    pixel[2] = data[position++];
+                } else if (op == 0xFF) {
+                    for (auto& value : pixel) {
+                        value = data[position++];
+                    }
+                } else if ((op & 0xC0) == 0x00) {
+                    pixel = seen[op];
+                } else if ((op & 0xC0) == 0x40) {
+                    pixel[0] += ((op >> 4) & 3) - 2;
+                    pixel[1] += ((op >> 2) & 3) - 2;
+                    pixel[2] += (op & 3) - 2;
+                } else if ((op & 0xC0) == 0x80) {
+                    auto second = data[position++];
+                    int dg = (op & 0x3F) - 32;
+                    pixel[0] += dg - 8 + ((second >> 4) & 0x0F);
+                    pixel[1] += dg;
+                    pixel[2] += dg - 8 + (second & 0x0F);
+                } else {
+                    run = op & 0x3F;
+                }
+                seen[(pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64] = pixel;
+            }
+            pixels.insert(pixels.end(), pixel.begin(), pixel.begin() + channels);
+        }
+        EXPECT_EQ(encoded.size(), position + 8);
+        return pixels;
+    }
+}
+
+class ImageWriterTest : public ::testing::Test {
+protected:
+    std::filesystem::path m_directory;
+
+    void SetUp() override {
+        m_directory = std::filesystem::temp_directory_path() / "okami_image_writer_test";
+        std::filesystem::create_directories(m_directory);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(m_directory, ec);
+    }
+};
+
+TEST_F(ImageWriterTest, PngRoundTripsAtEveryLevel) {
+    for (uint32_t channels = 1; channels <= 4; ++channels) {
+        // Rows padded past the pixels, as in a GPU readback
+        uint32_t width = 131;
+        uint32_t height = 97;
+        size_t rowPitch = size_t(width) * channels + 13;
+        auto pixels = MakePixels(width, height, channels, rowPitch);
+        ImageView image{ pixels.data(), width, height, channels, rowPitch };
+        auto expected = Tight(image);
+
+        for (int level = 0; level <= 9; ++level) {
+            // Small pieces, so the image is deflated in many
+            for (size_t chunkSize : { size_t(0), size_t(1000) }) {
+                auto encoded = Write(image, ImageFileFormat::PNG,
+                    ImageWriteParams{ .m_pngLevel = level, .m_pngChunkSize = chunkSize });
+                EXPECT_EQ(DecodePng(encoded, channels), expected)
+                    << channels << " channels, level " << level << ", chunk size " << chunkSize;
+            }
+        }
+    }
+}
+
+TEST_F(ImageWriterTest, PngLevelsTradeSpeedForSize) {
+    uint32_t width = 256;
+    uint32_t height = 256;
+    auto pixels = MakePixels(width, height, 4, width * 4);
+    ImageView image{ pixels.data(), width, height, 4, width * 4 };
+
+    auto stored = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 0 }).size();
+    auto fast = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 1 }).size();
+    auto best = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 9 }).size();
+    EXPECT_GT(stored, pixels.size());
+    EXPECT_LT(fast, stored / 2);
+    EXPECT_LE(best, fast);
+
+    // Splitting into pieces costs little
+    auto whole = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 6, .m_pngChunkSize = 0 }).size();
+    auto split = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 6, .m_pngChunkSize = 16 * 1024 }).size();
+    EXPECT_LT(split, whole + whole / 20);
+}
+
+TEST_F(ImageWriterTest, IncompressiblePixelsAreStored) {
+    uint32_t width = 200;
+    uint32_t height = 200;
+    std::vector<uint8_t> pixels(size_t(width) * height * 3);
+    std::mt19937 rng(11);
+    for (auto& value : pixels) {
+        value = static_cast<uint8_t>(rng());
+    }
+    ImageView image{ pixels.data(), width, height, 3, size_t(width) * 3 };
+    auto encoded = Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = 9 });
+    EXPECT_EQ(DecodePng(encoded, 3), pixels);
+    EXPECT_LT(encoded.size(), pixels.size() + pixels.size() / 50);
+}
+
+TEST_F(ImageWriterTest, QoiRoundTrips) {
+    for (uint32_t channels : { 3u, 4u }) {
+        uint32_t width = 173;
+        uint32_t height = 61;
+        size_t rowPitch = size_t(width) * channels + 4;
+        auto pixels = MakePixels(width, height, channels, rowPitch);
+        ImageView image{ pixels.data(), width, height, channels, rowPitch };
+
+        uint32_t decodedWidth = 0;
+        uint32_t decodedHeight = 0;
+        uint32_t decodedChannels = 0;
+        auto decoded = DecodeQoi(Write(image, ImageFileFormat::QOI), decodedWidth, decodedHeight, decodedChannels);
+        EXPECT_EQ(decodedWidth, width);
+        EXPECT_EQ(decodedHeight, height);
+        EXPECT_EQ(decodedChannels, channels);
+        EXPECT_EQ(decoded, Tight(image));
+    }
+
+    std::vector<uint8_t> grey(16, 0);
+    EXPECT_TRUE(WriteImage(std::cout, ImageView{ grey.data(), 4, 4, 1, 4 }, ImageFileFormat::QOI).IsError());
+}
+
+TEST_F(ImageWriterTest, WritesPpmAndRaw) {
+    std::vector<uint8_t> pixels = {
+        1, 2, 3, 4, 5, 6, 7, 8, 0xEE,
+        9, 10, 11, 12, 13, 14, 15, 16, 0xEE,
+    };
+    ImageView image{ pixels.data(), 2, 2, 4, 9 };
+
+    EXPECT_EQ(Write(image, ImageFileFormat::PPM),
+        std::string("P6\n2 2\n255\n") + std::string("\x01\x02\x03\x05\x06\x07\x09\x0A\x0B\x0D\x0E\x0F", 12));
+    EXPECT_EQ(Write(image, ImageFileFormat::Raw),
+        std::string("\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F\x10", 16));
+
+    ImageView grey{ pixels.data(), 3, 2, 1, 9 };
+    EXPECT_EQ(Write(grey, ImageFileFormat::PPM), std::string("P5\n3 2\n255\n\x01\x02\x03\x09\x0A\x0B"));
+
+    ImageView greyAlpha{ pixels.data(), 2, 2, 2, 9 };
+    EXPECT_TRUE(WriteImage(std::cout, greyAlpha, ImageFileFormat::PPM).IsError());
+}
+
+TEST_F(ImageWriterTest, TextureSavePicksFormatFromExtension) {
+    TextureInfo info{ TextureType::TEXTURE_2D, TextureFormat::RGBA32F, 8, 4, 1, 1, 1 };
+    RawTexture texture(info);
+    auto* values = reinterpret_cast<float*>(texture.GetData().data());
+    for (size_t i = 0; i < size_t(8) * 4 * 4; ++i) {
+        values[i] = static_cast<float>(i % 7) / 4.0f - 0.25f;
+    }
+
+    EXPECT_EQ(GetImageFileFormat("a/b.QOI"), ImageFileFormat::QOI);
+    EXPECT_EQ(GetImageFileFormat("frame.ppm"), ImageFileFormat::PPM);
+    EXPECT_EQ(GetImageFileFormat("frame.jpg"), std::nullopt);
+
+    ImageWriteParams params{ .m_pngLevel = 1 };
+    ASSERT_TRUE(texture.Save(m_directory / "frame.png", params).IsOk());
+    ASSERT_TRUE(texture.Save(m_directory / "frame.qoi", params).IsOk());
+    ASSERT_TRUE(texture.Save(m_directory / "frame.raw", params).IsOk());
+
+    auto png = RawTexture::FromPNG(m_directory / "frame.png");
+    ASSERT_TRUE(png.has_value());
+    auto decoded = png->GetData();
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        EXPECT_EQ(decoded[i], static_cast<uint8_t>(std::lround(std::clamp(values[i], 0.0f, 1.0f) * 255.0f)));
+    }
+
+    // Half float captures are saved the same way; these values are exact in halves
+    auto half = texture;
+    ASSERT_TRUE(half.Convert(TextureFormat::RGBA16F, PixelConversionParams{}).IsOk());
+    ASSERT_TRUE(half.Save(m_directory / "half.png", params).IsOk());
+    auto halfPng = RawTexture::FromPNG(m_directory / "half.png");
+    ASSERT_TRUE(halfPng.has_value());
+    EXPECT_TRUE(std::ranges::equal(halfPng->GetData(), decoded));
+
+    std::ifstream qoi(m_directory / "frame.qoi", std::ios::binary);
+    char magic[4] = {};
+    qoi.read(magic, 4);
+    EXPECT_EQ(std::string(magic, 4), "qoif");
+    EXPECT_EQ(std::filesystem::file_size(m_directory / "frame.raw"), texture.GetData().size());
+}
+
+TEST_F(ImageWriterTest, Benchmark) {
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    auto pixels = MakePixels(width, height, 4, size_t(width) * 4);
+    ImageView image{ pixels.data(), width, height, 4, size_t(width) * 4 };
+
+    auto time = [&](char const* name, auto&& write) {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto size = write();
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << name << ": " << ms << "ms, " << size / 1024 << " KiB" << std::endl;
+    };
+
+    time("lodepng default", [&]() {
+        std::vector<uint8_t> encoded;
+        lodepng::encode(encoded, pixels, width, height, LCT_RGBA, 8);
+        return encoded.size();
+    });
+    for (int level : { 0, 1, 3, 6, 9 }) {
+        auto name = "PNG level " + std::to_string(level);
+        time(name.c_str(), [&]() {
+            return Write(image, ImageFileFormat::PNG, ImageWriteParams{ .m_pngLevel = level }).size();
+        });
+    }
+    time("QOI", [&]() { return Write(image, ImageFileFormat::QOI).size(); });
+    time("PPM", [&]() { return Write(image, ImageFileFormat::PPM).size(); });
+    time("Raw", [&]() { return Write(image, ImageFileFormat::Raw).size(); });
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include "../load_queue.hpp"
+#include <memory>
+
+using namespace okami;
+
+namespace {
+    std::vector<int> Drain(LoadQueue<int>& queue) {
+        std::vector<int> values;
+        while (auto value = queue.Pop()) {
+            values.push_back(*value);
+        }
+        return values;
+    }
+}
+
+class LoadQueueTest : public ::testing::Test {
+};
+
+TEST_F(LoadQueueTest, MostUrgentFirstThenOldest) {
+    LoadQueue<int> queue;
+    queue.Push(1, LoadPriority::Prefetch);
+    queue.Push(2, LoadPriority::Visible);
+    queue.Push(3, LoadPriority::Prefetch);
+    queue.Push(4, LoadPriority::Immediate);
+    queue.Push(5, LoadPriority::Visible);
+    EXPECT_EQ(queue.GetSize(), 5u);
+    EXPECT_EQ(queue.GetSizeUpTo(LoadPriority::Immediate), 1u);
+    EXPECT_EQ(queue.GetSizeUpTo(LoadPriority::Visible), 3u);
+    ASSERT_NE(queue.Peek(), nullptr);
+    EXPECT_EQ(*queue.Peek(), 4);
+
+    EXPECT_EQ(Drain(queue), (std::vector<int>{ 4, 2, 5, 1, 3 }));
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_EQ(queue.Peek(), nullptr);
+
+    auto const& stats = queue.GetStats();
+    EXPECT_EQ(stats.m_peakQueuedCount, 5u);
+    EXPECT_EQ(stats.m_poppedCount[size_t(LoadPriority::Immediate)], 1u);
+    EXPECT_EQ(stats.m_poppedCount[size_t(LoadPriority::Visible)], 2u);
+    EXPECT_EQ(stats.m_poppedCount[size_t(LoadPriority::Prefetch)], 2u);
+    EXPECT_GE(stats.GetAverageWaitSeconds(LoadPriority::Prefetch), 0.0);
+}
+
+TEST_F(LoadQueueTest, RequestedAgainMovesUp) {
+    LoadQueue<int> queue;
+    queue.Push(1, LoadPriority::Visible, 10);
+    queue.Push(2, LoadPriority::Prefetch, 20);
+    queue.Push(3, LoadPriority::Prefetch, 30);
+
+    // Joins the back of its new priority
+    EXPECT_TRUE(queue.Reprioritize(30, LoadPriority::Visible));
+    EXPECT_EQ(queue.GetPriority(30), LoadPriority::Visible);
+    // Never less urgent, and unknown keys are ignored
+    EXPECT_FALSE(queue.Reprioritize(10, LoadPriority::Prefetch));
+    EXPECT_FALSE(queue.Reprioritize(30, LoadPriority::Visible));
+    EXPECT_FALSE(queue.Reprioritize(40, LoadPriority::Immediate));
+
+    EXPECT_EQ(queue.GetStats().m_queuedCount[size_t(LoadPriority::Visible)], 2u);
+    EXPECT_EQ(queue.GetStats().m_queuedCount[size_t(LoadPriority::Prefetch)], 1u);
+    EXPECT_EQ(queue.GetStats().m_reprioritizedCount, 1u);
+
+    EXPECT_TRUE(queue.Reprioritize(20, LoadPriority::Immediate));
+    EXPECT_EQ(Drain(queue), (std::vector<int>{ 2, 1, 3 }));
+    EXPECT_EQ(queue.GetPriority(20), std::nullopt);
+}
+
+TEST_F(LoadQueueTest, CancelsUnwantedLoads) {
+    LoadQueue<std::unique_ptr<int>> queue;
+    queue.Push(std::make_unique<int>(1), LoadPriority::Visible, 1);
+    queue.Push(std::make_unique<int>(2), LoadPriority::Visible, 2);
+    queue.Push(std::make_unique<int>(3), LoadPriority::Visible, 3);
+    queue.Push(std::make_unique<int>(4), LoadPriority::Prefetch);
+
+    auto cancelled = queue.Cancel(2);
+    ASSERT_TRUE(cancelled.has_value());
+    EXPECT_EQ(**cancelled, 2);
+    EXPECT_FALSE(queue.Cancel(2).has_value());
+
+    // Rejected values are skipped over and handed back
+    std::vector<std::unique_ptr<int>> rejected;
+    auto isWanted = [](std::unique_ptr<int> const& value) { return *value != 1 && *value != 4; };
+    auto next = queue.Pop(isWanted, rejected);
+    ASSERT_TRUE(next.has_value());
+    EXPECT_EQ(**next, 3);
+    ASSERT_EQ(rejected.size(), 1u);
+    EXPECT_EQ(*rejected[0], 1);
+
+    EXPECT_FALSE(queue.Pop(isWanted, rejected).has_value());
+    EXPECT_EQ(rejected.size(), 2u);
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_EQ(queue.GetStats().m_cancelledCount, 3u);
+}
+
+TEST_F(LoadQueueTest, ClearAndReusedKeys) {
+    LoadQueue<int> queue;
+    queue.Push(1, LoadPriority::Prefetch, 7);
+    // The newer value takes the key over
+    queue.Push(2, LoadPriority::Prefetch, 7);
+    EXPECT_TRUE(queue.Reprioritize(7, LoadPriority::Immediate));
+    EXPECT_EQ(Drain(queue), (std::vector<int>{ 2, 1 }));
+
+    queue.Push(3, LoadPriority::Visible, 8);
+    queue.Push(4, LoadPriority::Prefetch);
+    queue.Clear();
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_EQ(queue.GetPriority(8), std::nullopt);
+    EXPECT_EQ(queue.GetStats().m_cancelledCount, 0u);
+
+    queue.Push(5, LoadPriority::Visible, 8);
+    EXPECT_EQ(Drain(queue), (std::vector<int>{ 5 }));
+}
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include "../lod.hpp"
+#include "../okmesh.hpp"
+#include "../geometry.hpp"
+#include "../camera.hpp"
+#include "../transform.hpp"
+#include "mesh_utils.hpp"
+#include <algorithm>
+#include <array>
+#include <map>
+#include <tuple>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+using namespace okami;
+
+namespace {
+    // Number of triangles on each edge, keyed by the coordinates of its
+    // endpoints so vertices sharing a position count as one
+    std::map<std::array<float, 6>, int> CountEdges(std::vector<glm::vec3> const& positions, std::vector<uint32_t> const& indices) {
+        std::map<std::array<float, 6>, int> edges;
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            for (size_t e = 0; e < 3; ++e) {
+                auto a = positions[indices[t + e]];
+                auto b = positions[indices[t + (e + 1) % 3]];
+                if (std::tie(b.x, b.y, b.z) < std::tie(a.x, a.y, a.z)) {
+                    std::swap(a, b);
+                }
+                ++edges[{ a.x, a.y, a.z, b.x, b.y, b.z }];
+            }
+        }
+        return edges;
+    }
+
+    float TotalArea(std::vector<glm::vec3> const& positions, std::vector<uint32_t> const& indices) {
+        float area = 0.0f;
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            auto const& p0 = positions[indices[t]];
+            auto const& p1 = positions[indices[t + 1]];
+            auto const& p2 = positions[indices[t + 2]];
+            area += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+        }
+        return area;
+    }
+}
+
+class LodTest : public ::testing::Test {
+};
+
+TEST_F(LodTest, Simplify_FlatGrid_KeepsShapeExactly) {
+    auto grid = MakeGridMesh(16);
+    size_t target = grid.m_indices.size() / 10;
+
+    auto result = SimplifyMesh(grid.m_positions, grid.m_indices, target, 0.01f);
+    ASSERT_TRUE(result.has_value()) << result.error();
+
+    EXPECT_LE(result->m_indices.size(), target);
+    EXPECT_LT(result->m_error, 1e-4f);
+    // Collapses inside the plane or along its straight borders cover the
+    // same square
+    EXPECT_NEAR(TotalArea(grid.m_positions, result->m_indices), 256.0f, 1e-2f);
+}
+
+TEST_F(LodTest, Simplify_Sphere_StaysWithinErrorAndClosed) {
+    auto sphere = MakeSphereMesh(32, 64);
+    float maxError = 0.05f;
+
+    auto result = SimplifyMesh(sphere.m_positions, sphere.m_indices, 0, maxError);
+    ASSERT_TRUE(result.has_value()) << result.error();
+
+    EXPECT_LE(result->m_error, maxError);
+    EXPECT_LT(result->m_indices.size(), sphere.m_indices.size() / 2);
+
+    // No holes open up: every edge still borders exactly two triangles
+    auto edges = CountEdges(sphere.m_positions, result->m_indices);
+    for (auto const& [edge, count] : edges) {
+        EXPECT_EQ(count, 2);
+    }
+}
+
+TEST_F(LodTest, Simplify_ZeroError_OnlyRemovesFlatDetail) {
+    auto sphere = MakeSphereMesh(16, 32);
+    auto result = SimplifyMesh(sphere.m_positions, sphere.m_indices, 0, 0.0f);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_EQ(result->m_indices.size(), sphere.m_indices.size());
+    EXPECT_EQ(result->m_error, 0.0f);
+}
+
+TEST_F(LodTest, Simplify_AttributeSeam_IsNotTorn) {
+    // Two grids side by side whose shared column is duplicated, as if the
+    // halves had different texture coordinates
+    int size = 8;
+    auto left = MakeGridMesh(size);
+    auto right = MakeGridMesh(size);
+    TestMesh mesh = left;
+    auto rightBase = static_cast<uint32_t>(mesh.m_positions.size());
+    for (auto p : right.m_positions) {
+        mesh.m_positions.push_back(p + glm::vec3(float(size), 0.0f, 0.0f));
+    }
+    for (auto index : right.m_indices) {
+        mesh.m_indices.push_back(index + rightBase);
+    }
+
+    auto result = SimplifyMesh(mesh.m_positions, mesh.m_indices, 0, 0.01f);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_LT(result->m_indices.size(), mesh.m_indices.size() / 4);
+
+    for (size_t t = 0; t < result->m_indices.size(); t += 3) {
+        bool isLeft = result->m_indices[t] < rightBase;
+        EXPECT_EQ(result->m_indices[t + 1] < rightBase, isLeft);
+        EXPECT_EQ(result->m_indices[t + 2] < rightBase, isLeft);
+    }
+
+    // The welded surface stays watertight along the seam
+    auto edges = CountEdges(mesh.m_positions, result->m_indices);
+    for (auto const& [edge, count] : edges) {
+        bool onBorder =
+            (edge[0] == edge[3] && (edge[0] == 0.0f || edge[0] == 2.0f * size)) ||
+            (edge[1] == edge[4] && (edge[1] == 0.0f || edge[1] == float(size)));
+        EXPECT_EQ(count, onBorder ? 1 : 2);
+    }
+    EXPECT_NEAR(TotalArea(mesh.m_positions, result->m_indices), 2.0f * size * size, 1e-2f);
+}
+
+TEST_F(LodTest, Simplify_InvalidInput_Fails) {
+    std::vector<glm::vec3> positions(3, glm::vec3(0.0f));
+    EXPECT_FALSE(SimplifyMesh(positions, std::vector<uint32_t>{ 0, 1 }, 0, 1.0f).has_value());
+    EXPECT_FALSE(SimplifyMesh(positions, std::vector<uint32_t>{ 0, 1, 3 }, 0, 1.0f).has_value());
+}
+
+TEST_F(LodTest, GenerateLods_AppendsCoarserLevels) {
+    auto geometry = MakeIndexedGeometry(MakeSphereMesh(32, 64));
+    auto baseIndexCount = geometry.GetMeshes()[0].m_indices->m_count;
+
+    auto error = geometry.GenerateLods(LodChainParams{});
+    ASSERT_TRUE(error.IsOk()) << error;
+
+    auto meshes = geometry.GetMeshes();
+    auto const& base = meshes[0];
+    ASSERT_GE(base.m_lods.size(), 2u);
+    EXPECT_EQ(meshes.size(), 1 + base.m_lods.size());
+
+    size_t previousCount = baseIndexCount;
+    float previousError = 0.0f;
+    for (auto const& lod : base.m_lods) {
+        ASSERT_LT(lod.m_meshIndex, meshes.size());
+        auto const& mesh = meshes[lod.m_meshIndex];
+        EXPECT_TRUE(mesh.m_lods.empty());
+        EXPECT_EQ(mesh.m_vertexCount, base.m_vertexCount);
+        EXPECT_EQ(mesh.m_attributes.size(), base.m_attributes.size());
+        EXPECT_EQ(mesh.m_attributes[0].m_offset, base.m_attributes[0].m_offset);
+        EXPECT_EQ(mesh.m_indices->m_type, AccessorComponentType::UShort);
+
+        EXPECT_LT(mesh.m_indices->m_count, previousCount);
+        EXPECT_GE(lod.m_error, previousError);
+        previousCount = mesh.m_indices->m_count;
+        previousError = lod.m_error;
+
+        auto indices = geometry.ReadIndices(lod.m_meshIndex);
+        ASSERT_TRUE(indices.has_value());
+        for (auto index : *indices) {
+            ASSERT_LT(index, mesh.m_vertexCount);
+        }
+    }
+
+    EXPECT_FALSE(geometry.GenerateLods(LodChainParams{}).IsOk());
+}
+
+TEST_F(LodTest, Pack_SharesVerticesBetweenLevels) {
+    auto withoutLods = MakeIndexedGeometry(MakeSphereMesh(16, 32)).Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(withoutLods.has_value());
+
+    auto geometry = MakeIndexedGeometry(MakeSphereMesh(16, 32));
+    ASSERT_TRUE(geometry.GenerateLods(LodChainParams{}).IsOk());
+    auto packed = geometry.Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(packed.has_value()) << packed.error();
+
+    EXPECT_EQ(packed->GetRawVertexData(0).size(), withoutLods->GetRawVertexData(0).size());
+    EXPECT_TRUE(packed->IsPacked(GetDefaultMeshRequirements()));
+
+    auto meshes = packed->GetMeshes();
+    ASSERT_FALSE(meshes[0].m_lods.empty());
+    for (auto const& lod : meshes[0].m_lods) {
+        auto const& mesh = meshes[lod.m_meshIndex];
+        for (size_t a = 0; a < mesh.m_attributes.size(); ++a) {
+            EXPECT_EQ(mesh.m_attributes[a].m_offset, meshes[0].m_attributes[a].m_offset);
+        }
+    }
+}
+
+TEST_F(LodTest, OkMesh_RoundTripsLevels) {
+    auto geometry = MakeIndexedGeometry(MakeSphereMesh(16, 32));
+    ASSERT_TRUE(geometry.GenerateLods(LodChainParams{}).IsOk());
+    auto packed = geometry.Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(packed.has_value());
+
+    auto path = std::filesystem::temp_directory_path() / "okami_lod_test.okmesh";
+    ASSERT_TRUE(SaveOkMesh(*packed, path).IsOk());
+    auto loaded = LoadOkMesh(path);
+    ASSERT_TRUE(loaded.has_value()) << loaded.error();
+
+    auto expected = packed->GetMeshes();
+    auto actual = loaded->GetMeshes();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(actual[i].m_lods.size(), expected[i].m_lods.size());
+        for (size_t j = 0; j < expected[i].m_lods.size(); ++j) {
+            EXPECT_EQ(actual[i].m_lods[j].m_meshIndex, expected[i].m_lods[j].m_meshIndex);
+            EXPECT_EQ(actual[i].m_lods[j].m_error, expected[i].m_lods[j].m_error);
+        }
+    }
+
+    loaded = RawGeometry();
+    std::filesystem::remove(path);
+}
+
+TEST_F(LodTest, Selector_Perspective_CoarsensWithDistance) {
+    GeometryMeshDesc base;
+    base.m_type = MeshType::Static;
+    base.m_aabb = AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) };
+    base.m_lods = { MeshLod{ 1, 0.001f }, MeshLod{ 2, 0.01f } };
+    std::vector<GeometryMeshDesc> meshes{ base, GeometryMeshDesc{}, GeometryMeshDesc{} };
+
+    // 90 degrees vertically over 1000 pixels: 500 pixels per unit at unit distance
+    LodSelector selector(Camera::Perspective(glm::half_pi<float>(), 0.1f, 1000.0f), Transform::Identity(), 1000, 1000);
+
+    EXPECT_EQ(selector.Select(meshes, 0, Transform::Translate(0.0f, 0.0f, -2.0f)), 0);
+    EXPECT_EQ(selector.Select(meshes, 0, Transform::Translate(0.0f, 0.0f, -3.0f)), 1);
+    EXPECT_EQ(selector.Select(meshes, 0, Transform::Translate(0.0f, 0.0f, -10.0f)), 2);
+    // Scaling up the instance scales its error and bounds
+    EXPECT_EQ(selector.Select(meshes, 0, Transform(glm::vec3(0.0f, 0.0f, -10.0f), 10.0f)), 0);
+    // Meshes without levels are returned as is
+    EXPECT_EQ(selector.Select(meshes, 1, Transform::Translate(0.0f, 0.0f, -10.0f)), 1);
+
+    EXPECT_NEAR(selector.GetPixelsPerUnit(glm::vec3(0.0f, 0.0f, -2.0f)), 250.0f, 1e-2f);
+    EXPECT_NEAR(selector.GetPixelsPerUnit(glm::vec3(0.0f, 0.0f, -2.0f), 1.0f), 500.0f, 1e-2f);
+}
+
+TEST_F(LodTest, Selector_Orthographic_IgnoresDistance) {
+    GeometryMeshDesc base;
+    base.m_type = MeshType::Static;
+    base.m_aabb = AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) };
+    base.m_lods = { MeshLod{ 1, 0.001f }, MeshLod{ 2, 0.01f } };
+    std::vector<GeometryMeshDesc> meshes{ base, GeometryMeshDesc{}, GeometryMeshDesc{} };
+
+    // One unit covers the 1000 pixel viewport
+    LodSelector selector(Camera::Orthographic(1.0f, 1.0f, 0.1f, 1000.0f), Transform::Identity(), 1000, 1000);
+    EXPECT_EQ(selector.Select(meshes, 0, Transform::Translate(0.0f, 0.0f, -2.0f)), 1);
+    EXPECT_EQ(selector.Select(meshes, 0, Transform::Translate(0.0f, 0.0f, -500.0f)), 1);
+    EXPECT_NEAR(selector.GetPixelsPerUnit(glm::vec3(0.0f, 0.0f, -500.0f)), 1000.0f, 1e-2f);
+}
@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+#include "../mesh_optimizer.hpp"
+#include "../geometry.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+using namespace okami;
+
+namespace {
+    struct Soup {
+        std::vector<glm::vec3> m_positions;
+        std::vector<glm::vec2> m_uvs;
+    };
+
+    // Unindexed (size x size) grid of quads with triangles in random order, as
+    // exported by tools that emit one vertex per corner
+    Soup MakeGridSoup(int size, uint32_t seed = 11) {
+        std::vector<std::array<glm::ivec2, 3>> triangles;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                triangles.push_back({ glm::ivec2(x, y), glm::ivec2(x + 1, y), glm::ivec2(x + 1, y + 1) });
+                triangles.push_back({ glm::ivec2(x, y), glm::ivec2(x + 1, y + 1), glm::ivec2(x, y + 1) });
+            }
+        }
+        std::mt19937 rng(seed);
+        std::shuffle(triangles.begin(), triangles.end(), rng);
+
+        Soup soup;
+        for (auto const& triangle : triangles) {
+            for (auto const& corner : triangle) {
+                soup.m_positions.emplace_back(float(corner.x), float(corner.y), 0.0f);
+                soup.m_uvs.emplace_back(float(corner.x) / size, float(corner.y) / size);
+            }
+        }
+        return soup;
+    }
+
+    RawGeometry MakeGeometry(Soup const& soup) {
+        std::vector<uint8_t> buffer(soup.m_positions.size() * (sizeof(glm::vec3) + sizeof(glm::vec2)));
+        std::memcpy(buffer.data(), soup.m_positions.data(), soup.m_positions.size() * sizeof(glm::vec3));
+        size_t uvOffset = soup.m_positions.size() * sizeof(glm::vec3);
+        std::memcpy(buffer.data() + uvOffset, soup.m_uvs.data(), soup.m_uvs.size() * sizeof(glm::vec2));
+
+        GeometryMeshDesc mesh;
+        mesh.m_type = MeshType::Static;
+        mesh.m_vertexCount = soup.m_positions.size();
+        mesh.m_attributes = {
+            Attribute{ AttributeType::Position, 0, 0 },
+            Attribute{ AttributeType::TexCoord, 0, uvOffset },
+        };
+
+        std::vector<std::vector<uint8_t>> buffers;
+        buffers.push_back(std::move(buffer));
+        return RawGeometry(std::move(buffers), { mesh });
+    }
+
+    // Triangles as sorted corner positions, so that two meshes can be compared
+    // regardless of vertex order, triangle order and winding rotation
+    std::vector<std::array<float, 9>> GetTriangleSet(RawGeometry const& geometry, size_t mesh = 0) {
+        auto positions = geometry.TryAccess<glm::vec3 const>(AttributeType::Position, mesh);
+        auto indices = geometry.ReadIndices(mesh);
+        std::vector<std::array<float, 9>> result;
+        for (size_t i = 0; i < indices->size(); i += 3) {
+            std::array<glm::vec3, 3> corners;
+            for (size_t c = 0; c < 3; ++c) {
+                corners[c] = positions->begin()[(*indices)[i + c]];
+            }
+            // Rotate the smallest corner first without changing the winding
+            size_t first = 0;
+            for (size_t c = 1; c < 3; ++c) {
+                if (std::tie(corners[c].x, corners[c].y, corners[c].z) <
+                    std::tie(corners[first].x, corners[first].y, corners[first].z)) {
+                    first = c;
+                }
+            }
+            std::array<float, 9> key;
+            for (size_t c = 0; c < 3; ++c) {
+                auto const& p = corners[(first + c) % 3];
+                key[c * 3 + 0] = p.x;
+                key[c * 3 + 1] = p.y;
+                key[c * 3 + 2] = p.z;
+            }
+            result.push_back(key);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+}
+
+class MeshOptimizerTest : public ::testing::Test {
+};
+
+TEST_F(MeshOptimizerTest, AnalyzeVertexCache_CountsMisses) {
+    // Two triangles sharing an edge: 4 misses with any cache of at least 3 entries
+    std::vector<uint32_t> quad{ 0, 1, 2, 2, 1, 3 };
+    auto stats = AnalyzeVertexCache(quad, 4, 16);
+    EXPECT_EQ(stats.m_triangleCount, 2);
+    EXPECT_EQ(stats.m_transformedVertexCount, 4);
+    EXPECT_FLOAT_EQ(stats.m_acmr, 2.0f);
+    EXPECT_FLOAT_EQ(stats.m_atvr, 1.0f);
+
+    // A 3 entry cache has evicted vertex 0 when the third triangle needs it
+    std::vector<uint32_t> fan{ 0, 1, 2, 1, 2, 3, 0, 3, 4 };
+    EXPECT_EQ(AnalyzeVertexCache(fan, 5, 3).m_transformedVertexCount, 6);
+    EXPECT_EQ(AnalyzeVertexCache(fan, 5, 16).m_transformedVertexCount, 5);
+}
+
+TEST_F(MeshOptimizerTest, DeduplicateVertices_MergesIdenticalVertices) {
+    std::vector<glm::vec3> positions{ { 0, 0, 0 }, { 1, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 1, 0, 0 } };
+    std::vector<glm::vec2> uvs{ { 0, 0 }, { 1, 0 }, { 0, 0 }, { 0, 1 }, { 1, 0 } };
+    std::array<VertexStream, 2> streams{
+        VertexStream{ std::span(reinterpret_cast<uint8_t const*>(positions.data()), positions.size() * sizeof(glm::vec3)), sizeof(glm::vec3) },
+        VertexStream{ std::span(reinterpret_cast<uint8_t const*>(uvs.data()), uvs.size() * sizeof(glm::vec2)), sizeof(glm::vec2) },
+    };
+
+    auto remap = DeduplicateVertices(streams, positions.size());
+    EXPECT_EQ(remap.m_vertexCount, 3);
+    EXPECT_EQ(remap.m_remap, (std::vector<uint32_t>{ 0, 1, 0, 2, 1 }));
+
+    auto merged = RemapVertexStream(streams[1], remap);
+    ASSERT_EQ(merged.size(), 3 * sizeof(glm::vec2));
+    EXPECT_EQ(reinterpret_cast<glm::vec2 const*>(merged.data())[2], glm::vec2(0, 1));
+}
+
+TEST_F(MeshOptimizerTest, OptimizeVertexFetch_OrdersByFirstUse) {
+    std::vector<uint32_t> indices{ 4, 2, 0, 0, 2, 5 };
+    auto remap = OptimizeVertexFetch(indices, 6);
+    EXPECT_EQ(remap.m_vertexCount, 4);
+    EXPECT_EQ(remap.m_remap[4], 0);
+    EXPECT_EQ(remap.m_remap[2], 1);
+    EXPECT_EQ(remap.m_remap[0], 2);
+    EXPECT_EQ(remap.m_remap[5], 3);
+    EXPECT_EQ(remap.m_remap[1], kUnusedVertex);
+    EXPECT_EQ(remap.m_remap[3], kUnusedVertex);
+
+    RemapIndices(indices, remap);
+    EXPECT_EQ(indices, (std::vector<uint32_t>{ 0, 1, 2, 2, 1, 3 }));
+}
+
+TEST_F(MeshOptimizerTest, OptimizeVertexCache_KeepsTrianglesAndLowersACMR) {
+    auto geometry = MakeGeometry(MakeGridSoup(32));
+    auto optimized = geometry.Optimize(MeshOptimizationParams{
+        .m_optimizeOverdraw = false,
+        .m_optimizeVertexFetch = false,
+    });
+    ASSERT_TRUE(optimized.has_value()) << optimized.error();
+
+    auto indices = optimized->ReadIndices(0);
+    auto shuffled = indices.value();
+    std::mt19937 rng(3);
+    for (size_t i = shuffled.size() / 3; i > 1; --i) {
+        std::uniform_int_distribution<size_t> dist(0, i - 1);
+        auto j = dist(rng);
+        std::swap_ranges(shuffled.begin() + (i - 1) * 3, shuffled.begin() + i * 3, shuffled.begin() + j * 3);
+    }
+
+    auto vertexCount = optimized->GetMeshes()[0].m_vertexCount;
+    auto reordered = OptimizeVertexCache(shuffled, vertexCount);
+    ASSERT_EQ(reordered.size(), shuffled.size());
+
+    auto key = [](std::vector<uint32_t> const& list) {
+        std::vector<std::array<uint32_t, 3>> triangles;
+        for (size_t i = 0; i < list.size(); i += 3) {
+            triangles.push_back({ list[i], list[i + 1], list[i + 2] });
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    };
+    EXPECT_EQ(key(shuffled), key(reordered));
+
+    auto before = AnalyzeVertexCache(shuffled, vertexCount);
+    auto after = AnalyzeVertexCache(reordered, vertexCount);
+    std::cout << "Grid ACMR " << before.m_acmr << " -> " << after.m_acmr << std::endl;
+    EXPECT_LT(after.m_acmr, 0.8f);
+    EXPECT_LT(after.m_acmr, before.m_acmr * 0.5f);
+}
+
+TEST_F(MeshOptimizerTest, OptimizeOverdraw_KeepsTrianglesAndACMRBound) {
+    auto geometry = MakeGeometry(MakeGridSoup(32));
+    auto optimized = geometry.Optimize(MeshOptimizationParams{ .m_optimizeOverdraw = false });
+    ASSERT_TRUE(optimized.has_value());
+
+    auto indices = optimized->ReadIndices(0);
+    auto positions = optimized->TryAccess<glm::vec3 const>(AttributeType::Position);
+    std::vector<glm::vec3> positionList(positions->begin(), positions->end());
+
+    float threshold = 1.05f;
+    auto reordered = OptimizeOverdraw(*indices, positionList, threshold);
+    ASSERT_EQ(reordered.size(), indices->size());
+
+    auto before = AnalyzeVertexCache(*indices, positionList.size());
+    auto after = AnalyzeVertexCache(reordered, positionList.size());
+    // Clusters restart the cache, so only allow a bit more than the threshold
+    EXPECT_LE(after.m_acmr, before.m_acmr * threshold * 1.2f);
+}
+
+TEST_F(MeshOptimizerTest, Optimize_Soup) {
+    auto soup = MakeGridSoup(64);
+    auto geometry = MakeGeometry(soup);
+
+    std::vector<MeshOptimizationStats> stats;
+    auto start = std::chrono::high_resolution_clock::now();
+    auto optimized = geometry.Optimize(MeshOptimizationParams{}, &stats);
+    auto time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(optimized.has_value()) << optimized.error();
+    ASSERT_EQ(stats.size(), 1);
+
+    std::cout << "Optimized " << soup.m_positions.size() / 3 << " triangles in " << time << "ms: "
+        << "ACMR " << stats[0].m_before.m_acmr << " -> " << stats[0].m_after.m_acmr << ", "
+        << "ATVR " << stats[0].m_before.m_atvr << " -> " << stats[0].m_after.m_atvr << std::endl;
+
+    auto const& mesh = optimized->GetMeshes()[0];
+    EXPECT_EQ(mesh.m_vertexCount, 65 * 65);
+    ASSERT_TRUE(mesh.m_indices.has_value());
+    EXPECT_EQ(mesh.m_indices->m_type, AccessorComponentType::UShort);
+    EXPECT_EQ(mesh.m_indices->m_count, soup.m_positions.size());
+    EXPECT_EQ(stats[0].m_before.m_acmr, 3.0f);
+    EXPECT_LT(stats[0].m_after.m_acmr, 1.0f);
+    EXPECT_LT(stats[0].m_after.m_atvr, 1.5f);
+    EXPECT_EQ(stats[0].m_indexBytesBefore, 0);
+    EXPECT_EQ(stats[0].m_indexBytesAfter, soup.m_positions.size() * sizeof(uint16_t));
+
+    EXPECT_EQ(GetTriangleSet(geometry), GetTriangleSet(*optimized));
+
+    // Texture coordinates still travel with their positions
+    auto positions = optimized->TryAccess<glm::vec3 const>(AttributeType::Position);
+    auto uvs = optimized->TryAccess<glm::vec2 const>(AttributeType::TexCoord);
+    for (size_t i = 0; i < mesh.m_vertexCount; ++i) {
+        auto p = positions->begin()[i];
+        EXPECT_EQ(uvs->begin()[i], glm::vec2(p.x / 64.0f, p.y / 64.0f));
+    }
+
+    // Vertex fetch order: indices first reference vertices in increasing order
+    auto indices = optimized->ReadIndices(0);
+    uint32_t next = 0;
+    for (auto index : *indices) {
+        ASSERT_LE(index, next);
+        if (index == next) {
+            ++next;
+        }
+    }
+    EXPECT_EQ(next, mesh.m_vertexCount);
+}
+
+TEST_F(MeshOptimizerTest, Optimize_KeepsWideIndicesForLargeMeshes) {
+    auto geometry = MakeGeometry(MakeGridSoup(256));
+    auto optimized = geometry.Optimize(MeshOptimizationParams{ .m_optimizeOverdraw = false });
+    ASSERT_TRUE(optimized.has_value());
+
+    auto const& mesh = optimized->GetMeshes()[0];
+    EXPECT_EQ(mesh.m_vertexCount, 257 * 257);
+    EXPECT_EQ(mesh.m_indices->m_type, AccessorComponentType::UInt);
+    EXPECT_EQ(GetTriangleSet(geometry), GetTriangleSet(*optimized));
+}
+
+TEST_F(MeshOptimizerTest, Optimize_RejectsNonTriangleLists) {
+    auto soup = MakeGridSoup(2);
+    soup.m_positions.pop_back();
+    soup.m_uvs.pop_back();
+    auto geometry = MakeGeometry(soup);
+    EXPECT_FALSE(geometry.Optimize(MeshOptimizationParams{}).has_value());
+}
@@ -0,0 +1,84 @@
+#include "mesh_utils.hpp"
+
+#include <cmath>
+#include <random>
+
+#include <glm/common.hpp>
+#include <glm/gtc/constants.hpp>
+
+using namespace okami;
+
+TestMesh MakeGridMesh(int size, float jitter, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dist(-jitter, jitter);
+
+	TestMesh mesh;
+	for (int y = 0; y <= size; ++y) {
+		for (int x = 0; x <= size; ++x) {
+			mesh.m_positions.emplace_back(float(x), float(y), jitter > 0.0f ? dist(rng) : 0.0f);
+		}
+	}
+	auto vertex = [size](int x, int y) { return static_cast<uint32_t>(y * (size + 1) + x); };
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			mesh.m_indices.insert(mesh.m_indices.end(), { vertex(x, y), vertex(x + 1, y), vertex(x + 1, y + 1) });
+			mesh.m_indices.insert(mesh.m_indices.end(), { vertex(x, y), vertex(x + 1, y + 1), vertex(x, y + 1) });
+		}
+	}
+	return mesh;
+}
+
+TestMesh MakeSphereMesh(int rings, int segments) {
+	TestMesh mesh;
+	for (int r = 0; r <= rings; ++r) {
+		float theta = glm::pi<float>() * float(r) / float(rings);
+		float sinTheta = (r == 0 || r == rings) ? 0.0f : std::sin(theta);
+		for (int s = 0; s <= segments; ++s) {
+			float phi = glm::two_pi<float>() * float(s % segments) / float(segments);
+			mesh.m_positions.emplace_back(sinTheta * std::cos(phi), sinTheta * std::sin(phi), std::cos(theta));
+		}
+	}
+	auto vertex = [segments](int r, int s) { return static_cast<uint32_t>(r * (segments + 1) + s); };
+	for (int r = 0; r < rings; ++r) {
+		for (int s = 0; s < segments; ++s) {
+			if (r > 0) {
+				mesh.m_indices.insert(mesh.m_indices.end(), { vertex(r, s), vertex(r + 1, s), vertex(r, s + 1) });
+			}
+			if (r + 1 < rings) {
+				mesh.m_indices.insert(mesh.m_indices.end(), { vertex(r, s + 1), vertex(r + 1, s), vertex(r + 1, s + 1) });
+			}
+		}
+	}
+	return mesh;
+}
+
+RawGeometry MakeIndexedGeometry(TestMesh const& mesh) {
+	auto vertexBytes = ToBytes(mesh.m_positions);
+	auto normalBytes = vertexBytes;
+	size_t normalOffset = vertexBytes.size();
+	vertexBytes.insert(vertexBytes.end(), normalBytes.begin(), normalBytes.end());
+
+	AABB aabb{ glm::vec3(0.0f), glm::vec3(0.0f) };
+	if (!mesh.m_positions.empty()) {
+		aabb = AABB{ mesh.m_positions[0], mesh.m_positions[0] };
+		for (auto const& position : mesh.m_positions) {
+			aabb.m_min = glm::min(aabb.m_min, position);
+			aabb.m_max = glm::max(aabb.m_max, position);
+		}
+	}
+
+	GeometryMeshDesc desc;
+	desc.m_type = MeshType::Static;
+	desc.m_vertexCount = mesh.m_positions.size();
+	desc.m_attributes = {
+		Attribute{ AttributeType::Position, 0, 0 },
+		Attribute{ AttributeType::Normal, 0, normalOffset },
+	};
+	desc.m_indices = IndexInfo{ AccessorComponentType::UInt, 1, mesh.m_indices.size(), 0 };
+	desc.m_aabb = aabb;
+
+	std::vector<std::vector<uint8_t>> buffers;
+	buffers.push_back(std::move(vertexBytes));
+	buffers.push_back(ToBytes(mesh.m_indices));
+	return RawGeometry(std::move(buffers), { desc });
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "../geometry.hpp"
+
+// Procedural meshes shared by the geometry processing tests
+struct TestMesh {
+	std::vector<glm::vec3> m_positions;
+	std::vector<uint32_t> m_indices;
+};
+
+// (size x size) grid of quads in the XY plane facing +Z, spanning [0, size].
+// With jitter, z is offset by up to that much, seeded for repeatability.
+TestMesh MakeGridMesh(int size, float jitter = 0.0f, uint32_t seed = 7);
+
+// Unit UV sphere with outward facing counter-clockwise triangles. The
+// seam column and the pole rows duplicate positions exactly.
+TestMesh MakeSphereMesh(int rings, int segments);
+
+// One static mesh with 32 bit indices. Positions double as normals, which
+// is exact for the unit sphere.
+okami::RawGeometry MakeIndexedGeometry(TestMesh const& mesh);
+
+template <typename T>
+std::vector<uint8_t> ToBytes(std::vector<T> const& values) {
+	std::vector<uint8_t> bytes(values.size() * sizeof(T));
+	std::memcpy(bytes.data(), values.data(), bytes.size());
+	return bytes;
+}
@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include "../meshlet.hpp"
+#include "../camera.hpp"
+#include "../geometry.hpp"
+#include "../transform.hpp"
+#include "mesh_utils.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace okami;
+
+namespace {
+    // Triangles of the table, in mesh vertex indices
+    std::vector<std::array<uint32_t, 3>> GetTriangles(MeshletTable const& table) {
+        std::vector<std::array<uint32_t, 3>> result;
+        for (auto const& meshlet : table.GetMeshlets()) {
+            for (uint32_t t = 0; t < meshlet.m_triangleCount; ++t) {
+                std::array<uint32_t, 3> triangle;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    auto local = table.GetTriangles()[meshlet.m_triangleOffset + t * 3 + c];
+                    triangle[c] = table.GetVertices()[meshlet.m_vertexOffset + local];
+                }
+                result.push_back(triangle);
+            }
+        }
+        return result;
+    }
+
+    std::vector<std::array<uint32_t, 3>> GetTriangles(std::vector<uint32_t> const& indices) {
+        std::vector<std::array<uint32_t, 3>> result;
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            result.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+        }
+        return result;
+    }
+
+    bool IsBackfacing(TestMesh const& mesh, std::array<uint32_t, 3> const& triangle, glm::vec3 const& eye) {
+        auto const& p0 = mesh.m_positions[triangle[0]];
+        auto normal = glm::cross(mesh.m_positions[triangle[1]] - p0, mesh.m_positions[triangle[2]] - p0);
+        return glm::dot(normal, eye - p0) <= 0.0f;
+    }
+
+    Frustum MakeFrustum(glm::vec3 const& eye, glm::vec3 const& target) {
+        auto projection = Camera::Perspective(glm::radians(60.0f), 1.0f, 0.1f, 100.0f).GetProjectionMatrix(1, 1, true);
+        auto direction = glm::normalize(target - eye);
+        auto up = std::abs(direction.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        auto view = glm::lookAt(eye, target, up);
+        return Frustum::FromMatrix(projection * view, true);
+    }
+}
+
+class MeshletTest : public ::testing::Test {
+};
+
+TEST_F(MeshletTest, Build_CoversEveryTriangleWithinLimits) {
+    auto grid = MakeGridMesh(40);
+    auto table = MeshletTable::Build(grid.m_positions, grid.m_indices);
+    ASSERT_TRUE(table.has_value()) << table.error();
+
+    for (auto const& meshlet : table->GetMeshlets()) {
+        EXPECT_LE(meshlet.m_vertexCount, kMaxMeshletVertices);
+        EXPECT_LE(meshlet.m_triangleCount, kMaxMeshletTriangles);
+        EXPECT_GT(meshlet.m_triangleCount, 0);
+    }
+
+    auto triangles = GetTriangles(*table);
+    auto expected = GetTriangles(grid.m_indices);
+    std::sort(triangles.begin(), triangles.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(triangles, expected);
+
+    // 64 vertices span at most 98 grid triangles (a 7x7 quad patch); greedy
+    // growth should get reasonably close to that
+    float averageTriangles = float(expected.size()) / float(table->GetMeshletCount());
+    EXPECT_GT(averageTriangles, 60.0f);
+}
+
+TEST_F(MeshletTest, Build_BoundsContainVertices) {
+    auto sphere = MakeSphereMesh(24, 48);
+    auto table = MeshletTable::Build(sphere.m_positions, sphere.m_indices);
+    ASSERT_TRUE(table.has_value());
+
+    for (size_t i = 0; i < table->GetMeshletCount(); ++i) {
+        auto const& meshlet = table->GetMeshlets()[i];
+        auto const& bounds = table->GetBounds()[i];
+        for (uint32_t v = 0; v < meshlet.m_vertexCount; ++v) {
+            auto const& p = sphere.m_positions[table->GetVertices()[meshlet.m_vertexOffset + v]];
+            EXPECT_LE(glm::length(p - bounds.m_center), bounds.m_radius * 1.0001f + 1e-6f);
+            EXPECT_TRUE(bounds.m_aabb.Contains(p));
+        }
+        EXPECT_LE(bounds.m_coneCutoff, 1.0f);
+    }
+}
+
+TEST_F(MeshletTest, Build_RespectsCustomLimits) {
+    auto grid = MakeGridMesh(16);
+    MeshletBuildParams params;
+    params.m_maxVertices = 16;
+    params.m_maxTriangles = 8;
+    auto table = MeshletTable::Build(grid.m_positions, grid.m_indices, params);
+    ASSERT_TRUE(table.has_value());
+    for (auto const& meshlet : table->GetMeshlets()) {
+        EXPECT_LE(meshlet.m_vertexCount, 16);
+        EXPECT_LE(meshlet.m_triangleCount, 8);
+    }
+    EXPECT_EQ(GetTriangles(*table).size(), grid.m_indices.size() / 3);
+
+    params.m_maxVertices = 300;
+    EXPECT_FALSE(MeshletTable::Build(grid.m_positions, grid.m_indices, params).has_value());
+}
+
+TEST_F(MeshletTest, Cull_FlatGridFromBehind) {
+    auto grid = MakeGridMesh(32);
+    auto table = MeshletTable::Build(grid.m_positions, grid.m_indices);
+    ASSERT_TRUE(table.has_value());
+
+    // The whole grid is in view from either side
+    std::vector<uint32_t> visible;
+    glm::vec3 front(16.0f, 16.0f, 40.0f);
+    table->Cull(MakeFrustum(front, glm::vec3(16.0f, 16.0f, 0.0f)), front, Transform::Identity(), visible);
+    EXPECT_EQ(visible.size(), table->GetMeshletCount());
+
+    visible.clear();
+    glm::vec3 back(16.0f, 16.0f, -40.0f);
+    table->Cull(MakeFrustum(back, glm::vec3(16.0f, 16.0f, 0.0f)), back, Transform::Identity(), visible);
+    EXPECT_TRUE(visible.empty());
+}
+
+TEST_F(MeshletTest, Cull_ConesAreConservative) {
+    auto sphere = MakeSphereMesh(32, 64);
+    auto table = MeshletTable::Build(sphere.m_positions, sphere.m_indices);
+    ASSERT_TRUE(table.has_value());
+
+    glm::vec3 eye(0.0f, -6.0f, 1.0f);
+    std::vector<uint32_t> visible;
+    table->Cull(MakeFrustum(eye, glm::vec3(0.0f)), eye, Transform::Identity(), visible);
+
+    // Roughly the back half of the sphere is rejected
+    EXPECT_LT(visible.size(), table->GetMeshletCount() * 3 / 4);
+    EXPECT_GT(visible.size(), table->GetMeshletCount() / 4);
+
+    // Every rejected meshlet really has only backfacing triangles
+    for (size_t i = 0; i < table->GetMeshletCount(); ++i) {
+        if (std::find(visible.begin(), visible.end(), i) != visible.end()) {
+            continue;
+        }
+        auto const& meshlet = table->GetMeshlets()[i];
+        for (uint32_t t = 0; t < meshlet.m_triangleCount; ++t) {
+            std::array<uint32_t, 3> triangle;
+            for (uint32_t c = 0; c < 3; ++c) {
+                auto local = table->GetTriangles()[meshlet.m_triangleOffset + t * 3 + c];
+                triangle[c] = table->GetVertices()[meshlet.m_vertexOffset + local];
+            }
+            EXPECT_TRUE(IsBackfacing(sphere, triangle, eye)) << "meshlet " << i << " triangle " << t;
+        }
+    }
+}
+
+TEST_F(MeshletTest, Cull_FrustumWithTransform) {
+    auto grid = MakeGridMesh(64);
+    auto table = MeshletTable::Build(grid.m_positions, grid.m_indices);
+    ASSERT_TRUE(table.has_value());
+
+    // Looking at one corner of a grid that has been moved and scaled
+    auto transform = Transform(glm::vec3(100.0f, 0.0f, 0.0f), 2.0f);
+    glm::vec3 target(110.0f, 10.0f, 0.0f);
+    glm::vec3 eye = target + glm::vec3(0.0f, 0.0f, 10.0f);
+    auto frustum = MakeFrustum(eye, target);
+
+    std::vector<uint32_t> visible;
+    table->Cull(frustum, eye, transform, visible);
+    EXPECT_FALSE(visible.empty());
+    EXPECT_LT(visible.size(), table->GetMeshletCount() / 4);
+
+    for (size_t i = 0; i < table->GetMeshletCount(); ++i) {
+        auto const& bounds = table->GetBounds()[i];
+        bool inside = frustum.Intersects(transform.TransformPoint(bounds.m_center), bounds.m_radius * 2.0f);
+        bool reported = std::find(visible.begin(), visible.end(), i) != visible.end();
+        EXPECT_EQ(inside, reported);
+    }
+
+    // Non-uniform scale disables cones, leaving only the frustum test
+    visible.clear();
+    auto stretched = Transform(glm::mat3(glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    glm::vec3 back(32.0f, 64.0f, -60.0f);
+    auto backFrustum = MakeFrustum(back, glm::vec3(32.0f, 64.0f, 0.0f));
+    table->Cull(backFrustum, back, stretched, visible);
+    EXPECT_FALSE(visible.empty());
+
+    for (size_t i = 0; i < table->GetMeshletCount(); ++i) {
+        auto const& bounds = table->GetBounds()[i];
+        bool inside = backFrustum.Intersects(stretched.TransformPoint(bounds.m_center), bounds.m_radius * 2.0f);
+        bool reported = std::find(visible.begin(), visible.end(), i) != visible.end();
+        EXPECT_EQ(inside, reported);
+    }
+}
+
+TEST_F(MeshletTest, RawGeometry_BuildMeshlets) {
+    auto sphere = MakeSphereMesh(64, 128);
+    auto geometry = MakeIndexedGeometry(sphere);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    ASSERT_TRUE(geometry.BuildMeshlets().IsOk());
+    auto time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    auto table = geometry.GetMeshletTable(0);
+    ASSERT_NE(table, nullptr);
+    std::cout << "Built " << table->GetMeshletCount() << " meshlets for "
+        << sphere.m_indices.size() / 3 << " triangles in " << time << "ms" << std::endl;
+    EXPECT_EQ(GetTriangles(*table).size(), sphere.m_indices.size() / 3);
+
+    auto packed = geometry.Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(packed.has_value());
+    EXPECT_EQ(packed->GetMeshletTable(0), table);
+}
+
+TEST_F(MeshletTest, Frustum_FromMatrix) {
+    auto frustum = MakeFrustum(glm::vec3(0.0f, -10.0f, 0.0f), glm::vec3(0.0f));
+    EXPECT_TRUE(frustum.Intersects(glm::vec3(0.0f), 0.0f));
+    EXPECT_FALSE(frustum.Intersects(glm::vec3(0.0f, -20.0f, 0.0f), 1.0f));
+    EXPECT_FALSE(frustum.Intersects(glm::vec3(0.0f, 200.0f, 0.0f), 1.0f));
+    EXPECT_FALSE(frustum.Intersects(glm::vec3(50.0f, 0.0f, 0.0f), 1.0f));
+    EXPECT_TRUE(frustum.Intersects(glm::vec3(50.0f, 0.0f, 0.0f), 50.0f));
+
+    EXPECT_TRUE(frustum.Intersects(AABB{ glm::vec3(-1.0f), glm::vec3(1.0f) }));
+    EXPECT_FALSE(frustum.Intersects(AABB{ glm::vec3(40.0f, -1.0f, -1.0f), glm::vec3(42.0f, 1.0f, 1.0f) }));
+}
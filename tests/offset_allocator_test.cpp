@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include "../offset_allocator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    // Checks that live allocations are inside the range and disjoint
+    void ExpectDisjoint(OffsetAllocator const& allocator, std::vector<OffsetAllocation> const& allocations) {
+        std::map<uint64_t, uint64_t> ranges;
+        for (auto const& allocation : allocations) {
+            auto offset = allocator.GetOffset(allocation);
+            EXPECT_LE(offset + allocation.m_size, allocator.GetSize());
+            ranges.emplace(offset, allocation.m_size);
+        }
+        uint64_t end = 0;
+        for (auto [offset, size] : ranges) {
+            EXPECT_GE(offset, end);
+            end = offset + size;
+        }
+    }
+}
+
+class OffsetAllocatorTest : public ::testing::Test {
+};
+
+TEST_F(OffsetAllocatorTest, Bins) {
+    for (uint64_t size = 0; size < 8; ++size) {
+        EXPECT_EQ(OffsetAllocator::SizeToBinRoundDown(size), size);
+        EXPECT_EQ(OffsetAllocator::SizeToBinRoundUp(size), size);
+    }
+
+    std::mt19937_64 rng(3);
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t size = rng() >> (2 + rng() % 62);
+        auto down = OffsetAllocator::SizeToBinRoundDown(size);
+        auto up = OffsetAllocator::SizeToBinRoundUp(size);
+        EXPECT_LE(OffsetAllocator::BinToSize(down), size);
+        EXPECT_GT(OffsetAllocator::BinToSize(down + 1), size);
+        EXPECT_GE(OffsetAllocator::BinToSize(up), size);
+        EXPECT_LE(up, down + 1);
+        EXPECT_LT(up, OffsetAllocator::kBinCount);
+    }
+}
+
+TEST_F(OffsetAllocatorTest, AllocateAndMerge) {
+    OffsetAllocator allocator(1024);
+    auto a = allocator.Allocate(100);
+    auto b = allocator.Allocate(200);
+    auto c = allocator.Allocate(300);
+    ASSERT_TRUE(a && b && c);
+    EXPECT_EQ(allocator.GetAllocationCount(), 3);
+    EXPECT_EQ(allocator.GetFreeSize(), 1024 - 600);
+    ExpectDisjoint(allocator, { *a, *b, *c });
+
+    // Freeing the middle then its neighbours leaves one range again
+    allocator.Free(*b);
+    allocator.Free(*a);
+    allocator.Free(*c);
+    EXPECT_EQ(allocator.GetFreeSize(), 1024);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 1024);
+    EXPECT_EQ(allocator.GetAllocationCount(), 0);
+
+    auto all = allocator.Allocate(1024);
+    ASSERT_TRUE(all.has_value());
+    EXPECT_EQ(all->m_offset, 0);
+    EXPECT_FALSE(allocator.Allocate(1).has_value());
+}
+
+TEST_F(OffsetAllocatorTest, Alignment) {
+    OffsetAllocator allocator(1 << 20);
+    std::vector<OffsetAllocation> allocations;
+    std::mt19937 rng(5);
+    for (int i = 0; i < 200; ++i) {
+        uint64_t alignment = uint64_t(1) << (rng() % 9);
+        auto allocation = allocator.Allocate(1 + rng() % 1000, alignment);
+        ASSERT_TRUE(allocation.has_value());
+        EXPECT_EQ(allocation->m_offset % alignment, 0);
+        allocations.push_back(*allocation);
+    }
+    ExpectDisjoint(allocator, allocations);
+
+    for (auto const& allocation : allocations) {
+        allocator.Free(allocation);
+    }
+    EXPECT_EQ(allocator.GetFreeSize(), allocator.GetSize());
+    EXPECT_EQ(allocator.GetLargestFreeSize(), allocator.GetSize());
+}
+
+TEST_F(OffsetAllocatorTest, RandomChurn) {
+    OffsetAllocator allocator(1 << 24);
+    std::vector<OffsetAllocation> live;
+    std::mt19937 rng(11);
+    uint64_t liveBytes = 0;
+    for (int i = 0; i < 100000; ++i) {
+        if (live.empty() || rng() % 3 != 0) {
+            auto allocation = allocator.Allocate(1 + rng() % 4096, uint64_t(1) << (rng() % 5));
+            if (allocation) {
+                liveBytes += allocation->m_size;
+                live.push_back(*allocation);
+            }
+        } else {
+            auto index = rng() % live.size();
+            liveBytes -= live[index].m_size;
+            allocator.Free(live[index]);
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    EXPECT_EQ(allocator.GetAllocationCount(), live.size());
+    // Alignment padding stays free, so only the live bytes are in use
+    EXPECT_EQ(allocator.GetFreeSize(), allocator.GetSize() - liveBytes);
+    ExpectDisjoint(allocator, live);
+}
+
+TEST_F(OffsetAllocatorTest, Defragment) {
+    OffsetAllocator allocator(64 * 1024);
+    std::vector<OffsetAllocation> allocations;
+    while (auto allocation = allocator.Allocate(1000, 256)) {
+        allocations.push_back(*allocation);
+    }
+    // Free every other allocation to leave holes no large request fits in
+    std::vector<OffsetAllocation> kept;
+    for (size_t i = 0; i < allocations.size(); ++i) {
+        if (i % 2 == 0) {
+            allocator.Free(allocations[i]);
+        } else {
+            kept.push_back(allocations[i]);
+        }
+    }
+    EXPECT_FALSE(allocator.Allocate(16 * 1024).has_value());
+
+    // Each move's data goes to its new place in order
+    std::vector<uint32_t> memory(allocator.GetSize(), 0);
+    for (auto const& allocation : kept) {
+        std::fill_n(memory.begin() + allocation.m_offset, allocation.m_size, allocation.m_node + 1);
+    }
+    auto moves = allocator.Defragment();
+    EXPECT_FALSE(moves.empty());
+    for (auto const& move : moves) {
+        std::copy(memory.begin() + move.m_from, memory.begin() + move.m_from + move.m_size, memory.begin() + move.m_to);
+    }
+
+    uint64_t end = 0;
+    for (auto const& allocation : kept) {
+        auto offset = allocator.GetOffset(allocation);
+        EXPECT_EQ(offset % 256, 0);
+        EXPECT_EQ(memory[offset], allocation.m_node + 1);
+        EXPECT_EQ(memory[offset + allocation.m_size - 1], allocation.m_node + 1);
+        end = std::max(end, offset + allocation.m_size);
+    }
+    ExpectDisjoint(allocator, kept);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), allocator.GetSize() - end);
+    EXPECT_TRUE(allocator.Allocate(16 * 1024).has_value());
+
+    // Freeing after defragmenting still merges
+    for (auto const& allocation : kept) {
+        allocator.Free(OffsetAllocation{ .m_size = allocation.m_size, .m_node = allocation.m_node });
+    }
+    EXPECT_EQ(allocator.GetAllocationCount(), 1);
+}
+
+TEST_F(OffsetAllocatorTest, DefragmentBudget) {
+    OffsetAllocator allocator(10000);
+    std::vector<OffsetAllocation> allocations;
+    for (int i = 0; i < 10; ++i) {
+        allocations.push_back(*allocator.Allocate(1000));
+    }
+    allocator.Free(allocations[0]);
+
+    auto moves = allocator.Defragment(2500);
+    ASSERT_EQ(moves.size(), 2);
+    EXPECT_EQ(moves[0].m_to, 0);
+    EXPECT_EQ(moves[1].m_to, 1000);
+    EXPECT_EQ(allocator.GetOffset(allocations[3]), 3000);
+    EXPECT_EQ(allocator.GetLargestFreeSize(), 1000);
+}
+
+TEST_F(OffsetAllocatorTest, Benchmark) {
+    constexpr int kOperations = 1000000;
+    OffsetAllocator allocator(uint64_t(1) << 32);
+
+    std::mt19937 rng(17);
+    std::vector<uint64_t> sizes(kOperations);
+    for (auto& size : sizes) {
+        size = 64 + rng() % (256 * 1024);
+    }
+
+    std::vector<OffsetAllocation> live;
+    live.reserve(kOperations);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < kOperations; ++i) {
+        if (live.size() < 10000 || (i & 1)) {
+            if (auto allocation = allocator.Allocate(sizes[i], 256)) {
+                live.push_back(*allocation);
+            }
+        } else {
+            auto index = sizes[i] % live.size();
+            allocator.Free(live[index]);
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Offset allocator: " << elapsed / kOperations << "ns per operation with "
+        << live.size() << " live allocations" << std::endl;
+    EXPECT_EQ(allocator.GetAllocationCount(), live.size());
+}
@@ -0,0 +1,299 @@
+#include <gtest/gtest.h>
+#include "../okmesh.hpp"
+#include "../mapped_file.hpp"
+#include "../geometry.hpp"
+#include "../paths.hpp"
+#include "mesh_utils.hpp"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+using namespace okami;
+
+namespace {
+    // Two meshes sharing one interleaved-by-block buffer: the first has 8 bit
+    // indices and no tangents, the second 32 bit indices and all attributes.
+    RawGeometry MakeTestGeometry() {
+        std::vector<glm::vec3> positions{
+            { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 2.0f }, { 1.0f, 0.0f, 2.0f }, { 0.0f, 1.0f, 2.0f }
+        };
+        std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f, 0.0f, 1.0f));
+        std::vector<glm::vec2> uvs{ { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f },
+            { 0.5f, 0.0f }, { 1.0f, 0.5f }, { 0.5f, 1.0f } };
+        std::vector<glm::vec4> tangents(3, glm::vec4(0.0f, 1.0f, 0.0f, -1.0f));
+
+        auto vertexBytes = ToBytes(positions);
+        size_t normalOffset = vertexBytes.size();
+        auto normalBytes = ToBytes(normals);
+        vertexBytes.insert(vertexBytes.end(), normalBytes.begin(), normalBytes.end());
+        size_t uvOffset = vertexBytes.size();
+        auto uvBytes = ToBytes(uvs);
+        vertexBytes.insert(vertexBytes.end(), uvBytes.begin(), uvBytes.end());
+        size_t tangentOffset = vertexBytes.size();
+        auto tangentBytes = ToBytes(tangents);
+        vertexBytes.insert(vertexBytes.end(), tangentBytes.begin(), tangentBytes.end());
+
+        std::vector<uint8_t> indexBytes{ 0, 1, 2, 2, 1, 3 };
+        size_t index32Offset = 8;
+        indexBytes.resize(index32Offset);
+        auto index32Bytes = ToBytes(std::vector<uint32_t>{ 0, 1, 2 });
+        indexBytes.insert(indexBytes.end(), index32Bytes.begin(), index32Bytes.end());
+
+        GeometryMeshDesc quad;
+        quad.m_type = MeshType::Static;
+        quad.m_vertexCount = 4;
+        quad.m_attributes = {
+            Attribute{ AttributeType::Position, 0, 0 },
+            Attribute{ AttributeType::Normal, 0, normalOffset },
+            Attribute{ AttributeType::TexCoord, 0, uvOffset },
+        };
+        quad.m_indices = IndexInfo{ AccessorComponentType::UByte, 1, 6, 0 };
+        quad.m_aabb = AABB{ glm::vec3(0.0f), glm::vec3(1.0f, 1.0f, 0.0f) };
+
+        GeometryMeshDesc triangle;
+        triangle.m_type = MeshType::Static;
+        triangle.m_vertexCount = 3;
+        triangle.m_attributes = {
+            Attribute{ AttributeType::TexCoord, 0, uvOffset + 4 * sizeof(glm::vec2) },
+            Attribute{ AttributeType::Position, 0, 4 * sizeof(glm::vec3) },
+            Attribute{ AttributeType::Tangent, 0, tangentOffset },
+            Attribute{ AttributeType::Normal, 0, normalOffset + 4 * sizeof(glm::vec3) },
+        };
+        triangle.m_indices = IndexInfo{ AccessorComponentType::UInt, 1, 3, index32Offset };
+        triangle.m_aabb = AABB{ glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f, 1.0f, 2.0f) };
+
+        std::vector<std::vector<uint8_t>> buffers;
+        buffers.push_back(std::move(vertexBytes));
+        buffers.push_back(std::move(indexBytes));
+        return RawGeometry(std::move(buffers), { quad, triangle });
+    }
+
+    template <typename T>
+    std::vector<T> ReadAttribute(RawGeometry const& geometry, AttributeType type, size_t mesh) {
+        auto view = geometry.TryAccess<T const>(type, mesh);
+        if (!view) {
+            return {};
+        }
+        return std::vector<T>(view->begin(), view->end());
+    }
+
+    // Attributes missing from a are allowed to have been filled with defaults in b
+    template <typename T>
+    void ExpectSameAttribute(RawGeometry const& a, RawGeometry const& b, AttributeType type, size_t mesh) {
+        auto expected = ReadAttribute<T>(a, type, mesh);
+        if (!expected.empty()) {
+            EXPECT_EQ(expected, ReadAttribute<T>(b, type, mesh));
+        }
+    }
+
+    void ExpectSameContent(RawGeometry const& a, RawGeometry const& b) {
+        ASSERT_EQ(a.GetMeshCount(), b.GetMeshCount());
+        for (size_t i = 0; i < a.GetMeshCount(); ++i) {
+            EXPECT_EQ(a.GetMeshes()[i].m_vertexCount, b.GetMeshes()[i].m_vertexCount);
+            EXPECT_EQ(ReadAttribute<glm::vec3>(a, AttributeType::Position, i), ReadAttribute<glm::vec3>(b, AttributeType::Position, i));
+            ExpectSameAttribute<glm::vec3>(a, b, AttributeType::Normal, i);
+            ExpectSameAttribute<glm::vec2>(a, b, AttributeType::TexCoord, i);
+            EXPECT_EQ(*a.ReadIndices(i), *b.ReadIndices(i));
+        }
+    }
+}
+
+class OkMeshTest : public ::testing::Test {
+protected:
+    std::filesystem::path m_directory;
+
+    void SetUp() override {
+        m_directory = std::filesystem::temp_directory_path() / "okami_okmesh_test";
+        std::filesystem::create_directories(m_directory);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(m_directory, ec);
+    }
+};
+
+TEST_F(OkMeshTest, Pack_ProducesRendererLayout) {
+    auto geometry = MakeTestGeometry();
+    auto reqs = GetDefaultMeshRequirements();
+    EXPECT_FALSE(geometry.IsPacked(reqs));
+
+    auto packed = geometry.Pack(reqs);
+    ASSERT_TRUE(packed.has_value()) << packed.error();
+    EXPECT_TRUE(packed->IsPacked(reqs));
+    ASSERT_EQ(packed->GetBuffers().size(), 2);
+
+    for (auto const& mesh : packed->GetMeshes()) {
+        ASSERT_EQ(mesh.m_attributes.size(), kStaticMeshAttributes.size());
+        for (size_t i = 0; i < kStaticMeshAttributes.size(); ++i) {
+            EXPECT_EQ(mesh.m_attributes[i].m_type, kStaticMeshAttributes[i]);
+            EXPECT_EQ(mesh.m_attributes[i].m_buffer, 0);
+        }
+        ASSERT_TRUE(mesh.m_indices.has_value());
+        EXPECT_EQ(mesh.m_indices->m_buffer, 1);
+        EXPECT_EQ(mesh.m_indices->m_offset % mesh.m_indices->GetStride(), 0);
+    }
+
+    // 8 bit indices are widened, since GPUs cannot consume them
+    EXPECT_EQ(packed->GetMeshes()[0].m_indices->m_type, AccessorComponentType::UShort);
+    EXPECT_EQ(packed->GetMeshes()[1].m_indices->m_type, AccessorComponentType::UInt);
+
+    // Missing tangents are filled with defaults
+    auto tangents = ReadAttribute<glm::vec4>(*packed, AttributeType::Tangent, 0);
+    ASSERT_EQ(tangents.size(), 4);
+    EXPECT_EQ(tangents[0], glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+    EXPECT_EQ(ReadAttribute<glm::vec4>(*packed, AttributeType::Tangent, 1),
+        ReadAttribute<glm::vec4>(geometry, AttributeType::Tangent, 1));
+
+    ExpectSameContent(geometry, *packed);
+}
+
+TEST_F(OkMeshTest, SaveAndLoad_RoundTrips) {
+    auto packed = MakeTestGeometry().Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(packed.has_value());
+
+    auto path = m_directory / "roundtrip.okmesh";
+    ASSERT_TRUE(SaveOkMesh(*packed, path).IsOk());
+
+    auto loaded = RawGeometry::Load(path);
+    ASSERT_TRUE(loaded.has_value()) << loaded.error();
+    EXPECT_TRUE(loaded->IsPacked(GetDefaultMeshRequirements()));
+    ExpectSameContent(*packed, *loaded);
+
+    for (size_t i = 0; i < packed->GetMeshCount(); ++i) {
+        auto const& expected = packed->GetMeshes()[i];
+        auto const& actual = loaded->GetMeshes()[i];
+        EXPECT_EQ(expected.m_aabb.m_min, actual.m_aabb.m_min);
+        EXPECT_EQ(expected.m_aabb.m_max, actual.m_aabb.m_max);
+        EXPECT_EQ(expected.m_indices->m_type, actual.m_indices->m_type);
+        EXPECT_EQ(expected.m_indices->m_offset, actual.m_indices->m_offset);
+    }
+
+    // Buffers are used in place and start on the data alignment of the format
+    for (auto const& buffer : loaded->GetBuffers()) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.GetData().data()) % kOkMeshDataAlignment, 0);
+    }
+}
+
+TEST_F(OkMeshTest, LoadedGeometry_OutlivesOtherReferences) {
+    auto packed = MakeTestGeometry().Pack(GetDefaultMeshRequirements());
+    auto path = m_directory / "lifetime.okmesh";
+    ASSERT_TRUE(SaveOkMesh(*packed, path).IsOk());
+
+    std::optional<RawGeometry> moved;
+    {
+        auto loaded = LoadOkMesh(path);
+        ASSERT_TRUE(loaded.has_value());
+        moved = std::move(loaded.value());
+    }
+
+    // Writing goes to private pages and leaves the file untouched
+    auto positions = moved->TryAccess<glm::vec3>(AttributeType::Position, 0);
+    ASSERT_TRUE(positions.has_value());
+    positions->begin()[0] = glm::vec3(42.0f);
+
+    auto reloaded = LoadOkMesh(path);
+    ASSERT_TRUE(reloaded.has_value());
+    EXPECT_EQ(reloaded->TryAccess<glm::vec3>(AttributeType::Position, 0)->begin()[0], glm::vec3(0.0f));
+    EXPECT_EQ(moved->TryAccess<glm::vec3>(AttributeType::Position, 0)->begin()[0], glm::vec3(42.0f));
+}
+
+TEST_F(OkMeshTest, Load_RejectsBadFiles) {
+    auto packed = MakeTestGeometry().Pack(GetDefaultMeshRequirements());
+    auto path = m_directory / "bad.okmesh";
+    ASSERT_TRUE(SaveOkMesh(*packed, path).IsOk());
+
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(bytes.data(), bytes.size());
+    }
+
+    auto writeAndLoad = [&](std::vector<char> const& data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.close();
+        return LoadOkMesh(path);
+    };
+
+    auto badMagic = bytes;
+    badMagic[0] = 'X';
+    EXPECT_FALSE(writeAndLoad(badMagic).has_value());
+
+    auto badVersion = bytes;
+    uint32_t version = kOkMeshVersion + 1;
+    std::memcpy(badVersion.data() + offsetof(OkMeshHeader, m_version), &version, sizeof(version));
+    EXPECT_FALSE(writeAndLoad(badVersion).has_value());
+
+    auto truncated = bytes;
+    truncated.resize(truncated.size() - 16);
+    EXPECT_FALSE(writeAndLoad(truncated).has_value());
+
+    // Tables larger than the file
+    auto hugeMeshCount = bytes;
+    uint32_t meshCount = 0xFFFFFFFF;
+    std::memcpy(hugeMeshCount.data() + offsetof(OkMeshHeader, m_meshCount), &meshCount, sizeof(meshCount));
+    EXPECT_FALSE(writeAndLoad(hugeMeshCount).has_value());
+
+    auto hugeBufferCount = bytes;
+    uint32_t bufferCount = 0xFFFFFFFF;
+    std::memcpy(hugeBufferCount.data() + offsetof(OkMeshHeader, m_bufferCount), &bufferCount, sizeof(bufferCount));
+    EXPECT_FALSE(writeAndLoad(hugeBufferCount).has_value());
+
+    auto badTableOffset = bytes;
+    uint64_t tableOffset = ~0ull - 8;
+    std::memcpy(badTableOffset.data() + offsetof(OkMeshHeader, m_meshTableOffset), &tableOffset, sizeof(tableOffset));
+    EXPECT_FALSE(writeAndLoad(badTableOffset).has_value());
+
+    // Counts whose size in bytes wraps around to zero
+    OkMeshHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    auto hugeVertexCount = bytes;
+    uint64_t vertexCount = 1ull << 62;
+    std::memcpy(hugeVertexCount.data() + header.m_meshTableOffset + offsetof(OkMeshMeshRecord, m_vertexCount),
+        &vertexCount, sizeof(vertexCount));
+    EXPECT_FALSE(writeAndLoad(hugeVertexCount).has_value());
+
+    auto hugeIndexCount = bytes;
+    uint64_t indexCount = 1ull << 63;
+    std::memcpy(hugeIndexCount.data() + header.m_meshTableOffset + offsetof(OkMeshMeshRecord, m_indexCount),
+        &indexCount, sizeof(indexCount));
+    EXPECT_FALSE(writeAndLoad(hugeIndexCount).has_value());
+
+    EXPECT_FALSE(writeAndLoad({}).has_value());
+    EXPECT_FALSE(LoadOkMesh(m_directory / "missing.okmesh").has_value());
+
+    EXPECT_TRUE(writeAndLoad(bytes).has_value());
+}
+
+TEST_F(OkMeshTest, Cook_BoxFile_MatchesGLTF) {
+    auto boxPath = GetTestAssetsPath() / "box.glb";
+    ASSERT_TRUE(std::filesystem::exists(boxPath));
+
+    // Without optimization or LODs the cooked mesh must match the source exactly
+    OkMeshCookParams params;
+    params.m_optimization = std::nullopt;
+    params.m_lods = std::nullopt;
+
+    auto cookedPath = m_directory / "box.okmesh";
+    auto error = CookOkMesh(boxPath, cookedPath, params);
+    ASSERT_TRUE(error.IsOk()) << error;
+
+    auto gltf = RawGeometry::LoadGLTF(boxPath);
+    ASSERT_TRUE(gltf.has_value());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto cooked = RawGeometry::Load(cookedPath);
+    auto loadTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(cooked.has_value()) << cooked.error();
+
+    std::cout << "Loaded cooked box.okmesh in " << loadTime << "ms" << std::endl;
+
+    EXPECT_TRUE(cooked->IsPacked(GetDefaultMeshRequirements()));
+    ExpectSameContent(*gltf, *cooked);
+}
@@ -0,0 +1,220 @@
+#include <gtest/gtest.h>
+#include "../oktex.hpp"
+#include "../texture_decoder.hpp"
+#include "../texture_conversion.hpp"
+#include "../paths.hpp"
+#include "texture_utils.hpp"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace okami;
+
+namespace {
+    bool SameContent(RawTexture const& a, RawTexture const& b) {
+        return std::memcmp(&a.GetInfo(), &b.GetInfo(), sizeof(TextureInfo)) == 0 &&
+            std::equal(a.GetData().begin(), a.GetData().end(), b.GetData().begin(), b.GetData().end());
+    }
+}
+
+class OkTexTest : public ::testing::Test {
+protected:
+    std::filesystem::path m_directory;
+
+    void SetUp() override {
+        m_directory = std::filesystem::temp_directory_path() / "okami_oktex_test";
+        std::filesystem::create_directories(m_directory);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(m_directory, ec);
+    }
+};
+
+TEST_F(OkTexTest, SaveAndLoad_RoundTrips) {
+    auto texture = MakeNoiseTexture(64, 32, 0);
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    auto compressed = texture;
+    ASSERT_TRUE(compressed.Compress(TextureFormat::BC7, BlockCompressionParams{}).IsOk());
+    auto half = texture;
+    ASSERT_TRUE(half.Convert(TextureFormat::RGBA16F, PixelConversionParams{}).IsOk());
+
+    for (auto const* source : { &texture, &compressed, &half }) {
+        auto path = m_directory / "roundtrip.oktex";
+        ASSERT_TRUE(SaveOkTex(*source, path).IsOk());
+
+        auto loaded = LoadOkTex(path);
+        ASSERT_TRUE(loaded.has_value()) << loaded.error();
+        EXPECT_TRUE(loaded->IsExternal());
+        EXPECT_TRUE(SameContent(*source, *loaded));
+        // Texels start on a page, ready to be copied to an upload buffer
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(loaded->GetData().data()) % kOkTexDataAlignment, 0);
+    }
+}
+
+TEST_F(OkTexTest, LoadedTexture_OutlivesOtherReferences) {
+    auto path = m_directory / "lifetime.oktex";
+    ASSERT_TRUE(SaveOkTex(MakeNoiseTexture(16, 16, 0), path).IsOk());
+
+    std::optional<RawTexture> moved;
+    {
+        auto loaded = RawTexture::Load(path);
+        ASSERT_TRUE(loaded.has_value());
+        moved = std::move(loaded.value());
+    }
+    EXPECT_TRUE(moved->IsExternal());
+
+    // Copies own their texels, and writes to the mapping stay private
+    auto copy = *moved;
+    EXPECT_FALSE(copy.IsExternal());
+    copy.GetData()[0] = 1;
+    moved->GetData()[1] = 2;
+    EXPECT_EQ(moved->GetData()[0], 0);
+    EXPECT_EQ(copy.GetData()[1], 0);
+
+    auto reloaded = LoadOkTex(path);
+    ASSERT_TRUE(reloaded.has_value());
+    EXPECT_EQ(reloaded->GetData()[1], 0);
+}
+
+TEST_F(OkTexTest, Load_RejectsBadFiles) {
+    auto path = m_directory / "bad.oktex";
+    ASSERT_TRUE(SaveOkTex(MakeNoiseTexture(16, 16, 0), path).IsOk());
+
+    std::vector<char> bytes(std::filesystem::file_size(path));
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.read(bytes.data(), bytes.size());
+    }
+
+    auto writeAndLoad = [&](std::vector<char> const& data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.close();
+        return LoadOkTex(path);
+    };
+
+    auto badMagic = bytes;
+    badMagic[0] = 'X';
+    EXPECT_FALSE(writeAndLoad(badMagic).has_value());
+
+    auto badVersion = bytes;
+    uint32_t version = kOkTexVersion + 1;
+    std::memcpy(badVersion.data() + offsetof(OkTexHeader, m_version), &version, sizeof(version));
+    EXPECT_FALSE(writeAndLoad(badVersion).has_value());
+
+    auto badFormat = bytes;
+    uint32_t format = 1000;
+    std::memcpy(badFormat.data() + offsetof(OkTexHeader, m_format), &format, sizeof(format));
+    EXPECT_FALSE(writeAndLoad(badFormat).has_value());
+
+    auto badLevels = bytes;
+    uint32_t levels = 6;
+    std::memcpy(badLevels.data() + offsetof(OkTexHeader, m_mipLevels), &levels, sizeof(levels));
+    EXPECT_FALSE(writeAndLoad(badLevels).has_value());
+
+    auto withHeader = [&](auto modify) {
+        auto data = bytes;
+        OkTexHeader header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        modify(header);
+        std::memcpy(data.data(), &header, sizeof(header));
+        return data;
+    };
+
+    // Sizes that wrap in 32 bits, with the data size the wrapped math gives
+    auto huge = withHeader([](OkTexHeader& header) {
+        header.m_width = 65536;
+        header.m_height = 65536;
+        header.m_mipLevels = 1;
+        header.m_dataSize = 0;
+    });
+    EXPECT_FALSE(writeAndLoad(huge).has_value());
+
+    auto hugeArray = withHeader([](OkTexHeader& header) {
+        header.m_type = static_cast<uint32_t>(TextureType::TEXTURE_2D_ARRAY);
+        header.m_width = 16384;
+        header.m_height = 16384;
+        header.m_arraySize = 2048;
+        header.m_mipLevels = 1;
+        header.m_dataSize = 0;
+    });
+    EXPECT_FALSE(writeAndLoad(hugeArray).has_value());
+    EXPECT_FALSE(ReadOkTexInfo(std::span(reinterpret_cast<uint8_t const*>(hugeArray.data()), hugeArray.size())).has_value());
+
+    auto flatWithDepth = withHeader([](OkTexHeader& header) { header.m_depth = 2; });
+    EXPECT_FALSE(writeAndLoad(flatWithDepth).has_value());
+
+    auto truncated = bytes;
+    truncated.resize(truncated.size() - 16);
+    EXPECT_FALSE(writeAndLoad(truncated).has_value());
+
+    EXPECT_FALSE(writeAndLoad({}).has_value());
+    EXPECT_FALSE(LoadOkTex(m_directory / "missing.oktex").has_value());
+
+    EXPECT_TRUE(writeAndLoad(bytes).has_value());
+}
+
+TEST_F(OkTexTest, Cook_PNG_MatchesDecode) {
+    auto pngPath = GetTestAssetPath("test.png");
+    auto decoded = RawTexture::FromPNG(pngPath);
+    ASSERT_TRUE(decoded.has_value()) << decoded.error();
+    auto expected = *decoded;
+    ASSERT_TRUE(expected.GenerateMips(MipChainParams{}).IsOk());
+
+    auto cookedPath = m_directory / "test.oktex";
+    auto error = CookOkTex(pngPath, cookedPath);
+    ASSERT_TRUE(error.IsOk()) << error;
+
+    auto decodeStart = std::chrono::high_resolution_clock::now();
+    auto png = RawTexture::Load(pngPath);
+    auto decodeTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - decodeStart).count();
+    ASSERT_TRUE(png.has_value());
+
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    auto cooked = RawTexture::Load(cookedPath);
+    auto loadTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - loadStart).count();
+    ASSERT_TRUE(cooked.has_value()) << cooked.error();
+
+    std::cout << "Decoded test.png in " << decodeTime << "ms, mapped cooked test.oktex with "
+        << cooked->GetInfo().mipLevels << " levels in " << loadTime << "ms" << std::endl;
+    EXPECT_TRUE(SameContent(expected, *cooked));
+
+    // Compression is skipped for sizes that are not whole blocks
+    auto compressedPath = m_directory / "test_bc1.oktex";
+    ASSERT_TRUE(CookOkTex(pngPath, compressedPath, OkTexCookParams{ .m_compressTo = TextureFormat::BC1 }).IsOk());
+    auto compressed = LoadOkTex(compressedPath);
+    ASSERT_TRUE(compressed.has_value());
+    auto const& info = decoded->GetInfo();
+    bool wholeBlocks = info.width % 4 == 0 && info.height % 4 == 0;
+    EXPECT_EQ(compressed->GetInfo().format, wholeBlocks ? TextureFormat::BC1 : TextureFormat::RGBA8);
+}
+
+TEST_F(OkTexTest, Decoder_MapsCookedFiles) {
+    auto texture = MakeNoiseTexture(32, 32, 0);
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    auto path = m_directory / "decoder.oktex";
+    ASSERT_TRUE(SaveOkTex(texture, path).IsOk());
+
+    std::optional<Expected<RawTexture>> result;
+    size_t leaseBytes = 0;
+    {
+        // Decoder settings do not apply to textures that were already cooked
+        TextureDecoder decoder(TextureDecoderParams{ .m_mips = MipChainParams{ .m_maxLevels = 2 } });
+        decoder.Submit(path, [&](Expected<RawTexture> decoded, TextureDecodeLease lease) {
+            result = std::move(decoded);
+            leaseBytes = lease.GetBytes();
+        });
+        decoder.Wait();
+    }
+
+    ASSERT_TRUE(result.has_value());
+    ASSERT_TRUE(result->has_value()) << result->error();
+    EXPECT_TRUE((*result)->IsExternal());
+    EXPECT_TRUE(SameContent(texture, **result));
+    EXPECT_EQ(leaseBytes, texture.GetData().size());
+}
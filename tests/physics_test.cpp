@@ -55,6 +55,38 @@ TEST(TransformTest, Multiplication) {
     EXPECT_EQ(result.m_position, glm::vec3(1.0f, 1.0f, 0.0f));
 }
 
+TEST(TransformTest, Multiplication_MatchesMatrices) {
+    Transform t1(glm::vec3(1.0f, 2.0f, 3.0f), glm::angleAxis(0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 0.5f))),
+        glm::mat3(glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 3.0f)));
+    Transform t2(glm::vec3(-1.0f, 0.0f, 4.0f), glm::angleAxis(-1.2f, glm::normalize(glm::vec3(0.0f, 1.0f, 1.0f))), 1.5f);
+    glm::vec3 point(0.3f, -2.0f, 1.0f);
+
+    for (auto const& [a, b] : { std::pair(t1, t2), std::pair(t2, t1) }) {
+        auto expected = a.TransformPoint(b.TransformPoint(point));
+        auto actual = (a * b).TransformPoint(point);
+        EXPECT_NEAR(actual.x, expected.x, 1e-4f);
+        EXPECT_NEAR(actual.y, expected.y, 1e-4f);
+        EXPECT_NEAR(actual.z, expected.z, 1e-4f);
+    }
+}
+
+TEST(TransformTest, FromMatrix) {
+    Transform t(glm::vec3(1.0f, 2.0f, 3.0f), glm::angleAxis(0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 0.5f))),
+        glm::mat3(glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.5f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 3.0f)));
+    auto decomposed = Transform::FromMatrix(t.AsMatrix());
+    glm::vec3 point(0.3f, -2.0f, 1.0f);
+
+    auto expected = t.TransformPoint(point);
+    auto actual = decomposed.TransformPoint(point);
+    EXPECT_NEAR(actual.x, expected.x, 1e-4f);
+    EXPECT_NEAR(actual.y, expected.y, 1e-4f);
+    EXPECT_NEAR(actual.z, expected.z, 1e-4f);
+    // What remains after the rotation is upper triangular
+    EXPECT_NEAR(decomposed.m_scaleShear[0][1], 0.0f, 1e-5f);
+    EXPECT_NEAR(decomposed.m_scaleShear[0][2], 0.0f, 1e-5f);
+    EXPECT_NEAR(decomposed.m_scaleShear[1][2], 0.0f, 1e-5f);
+}
+
 class PhysicsModuleTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -106,4 +138,44 @@ TEST_F(PhysicsModuleTest, TransformStorage) {
     en->Run(1);
 
 	EXPECT_THROW(storage->Get(entity1), std::runtime_error);
-}
\ No newline at end of file
+}
+
+TEST_F(PhysicsModuleTest, TransformBatchStorage) {
+    std::vector<int32_t> parentIndices(100, -1);
+    std::vector<entity_t> entities(parentIndices.size());
+    en->CreateEntities(parentIndices, entities);
+
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < entities.size(); ++i) {
+        transforms.push_back(Transform::Translate(float(i), 0.0f, 0.0f));
+    }
+    en->AddComponents(entities, transforms);
+
+    en->Run(1);
+
+    auto storage = en->GetStorageAccessor<Transform>();
+    for (size_t i = 0; i < entities.size(); ++i) {
+        EXPECT_EQ(storage->Get(entities[i]).m_position, glm::vec3(float(i), 0.0f, 0.0f));
+    }
+}
+
+TEST_F(PhysicsModuleTest, TransformCloneStorage) {
+    entity_t source = en->CreateEntity();
+    entity_t child = en->CreateEntity(source);
+    en->AddComponent(source, Transform::Translate(1.0f, 2.0f, 3.0f));
+    en->Run(1);
+
+    // Components added in the same frame as the clone are copied too
+    en->AddComponent(child, Transform::Translate(4.0f, 5.0f, 6.0f));
+    auto roots = en->CloneSubtree(source, kRoot, 5);
+    en->Run(1);
+
+    auto storage = en->GetStorageAccessor<Transform>();
+    ASSERT_EQ(roots.size(), 5);
+    for (auto root : roots) {
+        EXPECT_EQ(storage->Get(root).m_position, glm::vec3(1.0f, 2.0f, 3.0f));
+        auto clonedChild = en->GetEntityTree().GetFirstChild(root);
+        ASSERT_NE(clonedChild, kNullEntity);
+        EXPECT_EQ(storage->Get(clonedChild).m_position, glm::vec3(4.0f, 5.0f, 6.0f));
+    }
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include "../resource_cache.hpp"
+#include <memory>
+#include <optional>
+
+using namespace okami;
+
+namespace {
+    struct Blob {
+        using CreationData = size_t;
+        size_t m_bytes = 0;
+    };
+
+    // The loop a resource manager runs each frame, minus the GPU
+    class BlobManager {
+    public:
+        std::unordered_map<resource_id_t, std::unique_ptr<Resource<Blob>>> m_blobs;
+        ResourceCache m_cache;
+        DeferredReleaseQueue<resource_id_t> m_released;
+        std::vector<resource_id_t> m_destroyed;
+        std::vector<resource_id_t> m_evicted;
+
+        explicit BlobManager(ResourceCacheParams params) : m_cache(params) {}
+
+        ResHandle<Blob> Load(resource_id_t id, size_t bytes) {
+            auto& blob = m_blobs[id];
+            if (!blob) {
+                blob = std::make_unique<Resource<Blob>>();
+                blob->m_id = id;
+                blob->m_data.m_bytes = bytes;
+                blob->m_loaded.store(true);
+                m_cache.Add(id, bytes);
+            }
+            return blob.get();
+        }
+
+        void Collect(uint64_t submittedFrame, uint64_t completedFrame) {
+            m_released.Release(completedFrame, [this](resource_id_t id) {
+                m_destroyed.push_back(id);
+            });
+
+            for (auto const& [id, blob] : m_blobs) {
+                m_cache.SetReferenced(id, blob->m_refCount.load() > 0);
+            }
+            m_evicted.clear();
+            m_cache.Collect(m_evicted);
+            for (auto id : m_evicted) {
+                m_blobs.erase(id);
+                m_released.Push(id, submittedFrame);
+            }
+        }
+    };
+}
+
+class ResourceCacheTest : public ::testing::Test {
+};
+
+TEST_F(ResourceCacheTest, KeepsReleasedResourcesWithinBudget) {
+    ResourceCache cache(ResourceCacheParams{ .m_budgetBytes = 250 });
+    cache.Add(1, 100);
+    cache.Add(2, 100);
+    cache.Add(3, 100);
+    EXPECT_EQ(cache.GetStats().m_trackedBytes, 300u);
+    EXPECT_EQ(cache.GetStats().m_trackedCount, 3u);
+
+    std::vector<resource_id_t> evicted;
+    cache.Collect(evicted);
+    EXPECT_TRUE(evicted.empty());
+
+    cache.SetReferenced(2, false);
+    cache.SetReferenced(1, false);
+    cache.Collect(evicted);
+    EXPECT_TRUE(evicted.empty());
+    EXPECT_EQ(cache.GetStats().m_cachedBytes, 200u);
+    EXPECT_EQ(cache.GetStats().m_cachedCount, 2u);
+
+    // Over budget: the least recently released goes first
+    cache.SetReferenced(3, false);
+    cache.Collect(evicted);
+    EXPECT_EQ(evicted, (std::vector<resource_id_t>{ 2 }));
+    EXPECT_FALSE(cache.Contains(2));
+    EXPECT_TRUE(cache.Contains(1));
+
+    auto const& stats = cache.GetStats();
+    EXPECT_EQ(stats.m_trackedBytes, 200u);
+    EXPECT_EQ(stats.m_cachedBytes, 200u);
+    EXPECT_EQ(stats.m_evictedCount, 1u);
+
+    // Resources that grow are weighed at their new size
+    cache.SetBytes(3, 200);
+    EXPECT_EQ(stats.m_trackedBytes, 300u);
+    EXPECT_EQ(stats.m_cachedBytes, 300u);
+    cache.Collect(evicted);
+    EXPECT_EQ(evicted, (std::vector<resource_id_t>{ 2, 1 }));
+}
+
+TEST_F(ResourceCacheTest, ReferencedAgainLeavesTheCache) {
+    ResourceCache cache(ResourceCacheParams{ .m_budgetBytes = 150 });
+    cache.Add(1, 100);
+    cache.Add(2, 100);
+
+    cache.SetReferenced(1, false);
+    cache.SetReferenced(1, true);
+    EXPECT_EQ(cache.GetStats().m_hitCount, 1u);
+    EXPECT_EQ(cache.GetStats().m_cachedCount, 0u);
+
+    // Releasing again counts from the new release
+    cache.SetReferenced(1, false);
+    cache.SetReferenced(2, false);
+    cache.SetReferenced(1, true);
+    cache.SetReferenced(1, false);
+
+    std::vector<resource_id_t> evicted;
+    cache.Collect(evicted);
+    EXPECT_EQ(evicted, (std::vector<resource_id_t>{ 2 }));
+
+    // Untracked resources are ignored
+    cache.SetReferenced(7, false);
+    EXPECT_EQ(cache.GetStats().m_cachedCount, 1u);
+}
+
+TEST_F(ResourceCacheTest, ZeroBudgetAndEmptyResourcesGoAtOnce) {
+    ResourceCache none(ResourceCacheParams{ .m_budgetBytes = 0 });
+    none.Add(1, 100);
+    none.SetReferenced(1, false);
+    std::vector<resource_id_t> evicted;
+    none.Collect(evicted);
+    EXPECT_EQ(evicted, (std::vector<resource_id_t>{ 1 }));
+
+    ResourceCache cache;
+    cache.Add(1, 100);
+    cache.Add(2, 0);
+    cache.SetReferenced(1, false);
+    cache.SetReferenced(2, false);
+    evicted.clear();
+    cache.Collect(evicted);
+    EXPECT_EQ(evicted, (std::vector<resource_id_t>{ 2 }));
+    EXPECT_TRUE(cache.Contains(1));
+
+    cache.Remove(1);
+    EXPECT_EQ(cache.GetStats().m_trackedCount, 0u);
+    EXPECT_EQ(cache.GetStats().m_cachedBytes, 0u);
+}
+
+TEST_F(ResourceCacheTest, DeferredReleaseWaitsForFrames) {
+    DeferredReleaseQueue<int> queue;
+    queue.Push(1, 3);
+    queue.Push(2, 3);
+    queue.Push(3, 5);
+    EXPECT_EQ(queue.GetSize(), 3u);
+
+    std::vector<int> released;
+    auto release = [&](int value) { released.push_back(value); };
+    EXPECT_EQ(queue.Release(2, release), 0u);
+    EXPECT_EQ(queue.Release(4, release), 2u);
+    EXPECT_EQ(released, (std::vector<int>{ 1, 2 }));
+    EXPECT_EQ(queue.Release(5, release), 1u);
+    EXPECT_TRUE(queue.IsEmpty());
+
+    // Values without a callback are simply dropped
+    auto shared = std::make_shared<int>(0);
+    DeferredReleaseQueue<std::shared_ptr<int>> pointers;
+    pointers.Push(shared, 1);
+    EXPECT_EQ(shared.use_count(), 2);
+    pointers.Release(1);
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST_F(ResourceCacheTest, HandlesDriveCollection) {
+    BlobManager manager(ResourceCacheParams{ .m_budgetBytes = 100 });
+    std::optional<ResHandle<Blob>> a = manager.Load(1, 100);
+    std::optional<ResHandle<Blob>> b = manager.Load(2, 100);
+    manager.Collect(1, 0);
+
+    // Released resources stay warm while they fit the budget
+    a.reset();
+    manager.Collect(2, 0);
+    EXPECT_TRUE(manager.m_evicted.empty());
+
+    b.reset();
+    manager.Collect(3, 0);
+    EXPECT_EQ(manager.m_evicted, (std::vector<resource_id_t>{ 1 }));
+    EXPECT_EQ(manager.m_blobs.size(), 1u);
+
+    // Loading it again hands back the cached resource
+    auto again = manager.Load(2, 100);
+    manager.Collect(4, 2);
+    EXPECT_EQ(manager.m_cache.GetStats().m_hitCount, 1u);
+    EXPECT_EQ(manager.m_blobs.size(), 1u);
+
+    // Destruction waits for the frame that last used the resource
+    EXPECT_TRUE(manager.m_destroyed.empty());
+    manager.Collect(5, 3);
+    EXPECT_EQ(manager.m_destroyed, (std::vector<resource_id_t>{ 1 }));
+}
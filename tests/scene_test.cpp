@@ -0,0 +1,335 @@
+#include <gtest/gtest.h>
+#include "../scene.hpp"
+#include "../storage.hpp"
+#include "gltf_utils.hpp"
+#include "utils.hpp"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+using namespace okami;
+
+namespace {
+    // Hands out resources without uploading anything
+    class CpuGeometryManager final : public IResourceManager<Geometry> {
+    public:
+        std::vector<std::unique_ptr<Resource<Geometry>>> m_resources;
+        std::vector<RawGeometry> m_geometries;
+
+        ResHandle<Geometry> Load(std::string_view path, LoadParams<Geometry> params) override {
+            auto geometry = RawGeometry::Load(path);
+            auto handle = geometry ? Create(std::move(*geometry)) : ResHandle<Geometry>();
+            if (params.m_onLoaded) {
+                params.m_onLoaded(handle, geometry ? Error() : geometry.error());
+            }
+            return handle;
+        }
+
+        ResHandle<Geometry> Create(RawGeometry&& data) override {
+            auto resource = std::make_unique<Resource<Geometry>>();
+            resource->m_id = static_cast<resource_id_t>(m_resources.size());
+            resource->m_data.m_meshes.assign(data.GetMeshes().begin(), data.GetMeshes().end());
+            resource->m_loaded.store(true);
+            m_geometries.push_back(std::move(data));
+            m_resources.push_back(std::move(resource));
+            return m_resources.back().get();
+        }
+    };
+
+    // Keeps static mesh components around, as the renderer would
+    class StaticMeshStorageModule final : public IEngineModule {
+    public:
+        void Register(InterfaceCollection& queryable, SignalHandlerCollection& handlers) override {
+            m_storage.RegisterInterfaces(queryable);
+            m_storage.RegisterSignalHandlers(handlers);
+        }
+        Error Startup(InterfaceCollection&, SignalHandlerCollection&, ISignalBus&) override {
+            return {};
+        }
+        void Shutdown(IInterfaceQueryable&, ISignalBus&) override {}
+        void OnFrameBegin(Time const&, ISignalBus&, EntityTree&) override {}
+        void UploadResources() override {}
+        ModuleResult HandleSignals(Time const&, ISignalBus&) override {
+            return m_storage.ProcessSignals();
+        }
+        std::string_view GetName() const override {
+            return "Static Mesh Storage";
+        }
+
+    private:
+        Storage<StaticMeshComponent> m_storage;
+    };
+
+    void ExpectNear(glm::vec3 const& a, glm::vec3 const& b, float tolerance = 1e-5f) {
+        EXPECT_NEAR(a.x, b.x, tolerance);
+        EXPECT_NEAR(a.y, b.y, tolerance);
+        EXPECT_NEAR(a.z, b.z, tolerance);
+    }
+
+    // Two roots: A (mesh 0) with child B (mesh 1, two primitives), and C
+    // (no mesh, rotated) with child D (mesh 0)
+    std::filesystem::path WriteHierarchy() {
+        GLBBuilder builder;
+        std::vector<glm::vec3> positions{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+        std::vector<uint16_t> indices{ 0, 1, 2 };
+        int position = builder.AddVec3(positions);
+        int index = builder.AddIndices(std::span<uint16_t const>(indices));
+        GLBBuilder::Primitive primitive{ { { "POSITION", position } }, index };
+        builder.AddMesh({ primitive });
+        builder.AddMesh({ primitive, primitive });
+
+        float halfSqrt2 = std::sqrt(0.5f);
+        builder.AddNode({ .m_mesh = 0, .m_translation = glm::vec3(1.0f, 0.0f, 0.0f), .m_children = { 1 } });
+        builder.AddNode({ .m_mesh = 1, .m_translation = glm::vec3(0.0f, 1.0f, 0.0f), .m_scale = glm::vec3(2.0f, 1.0f, 1.0f) });
+        builder.AddNode({ .m_rotation = glm::vec4(0.0f, halfSqrt2, 0.0f, halfSqrt2), .m_children = { 3 } });
+        builder.AddNode({ .m_mesh = 0, .m_translation = glm::vec3(0.0f, 0.0f, 1.0f) });
+
+        auto path = std::filesystem::temp_directory_path() / "okami_scene_test_hierarchy.glb";
+        builder.Save(path);
+        return path;
+    }
+
+    // A root with ten chains of up to five nodes below it, each node drawing
+    // one of four meshes
+    std::filesystem::path WritePrefab(int nodeCount) {
+        GLBBuilder builder;
+        std::vector<glm::vec3> positions{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+        std::vector<uint16_t> indices{ 0, 1, 2 };
+        int position = builder.AddVec3(positions);
+        int index = builder.AddIndices(std::span<uint16_t const>(indices));
+        for (int i = 0; i < 4; ++i) {
+            builder.AddMesh({ GLBBuilder::Primitive{ { { "POSITION", position } }, index } });
+        }
+
+        for (int i = 0; i < nodeCount; ++i) {
+            GLBBuilder::Node node{ .m_mesh = i % 4 };
+            if (i == 0) {
+                for (int j = 1; j < nodeCount; j += 5) {
+                    node.m_children.push_back(j);
+                }
+            } else {
+                node.m_translation = glm::vec3(float(i % 5), 0.0f, float(i / 5));
+                if (i % 5 != 0 && i + 1 < nodeCount) {
+                    node.m_children.push_back(i + 1);
+                }
+            }
+            builder.AddNode(node);
+        }
+
+        auto path = std::filesystem::temp_directory_path() / "okami_scene_test_prefab.glb";
+        builder.Save(path);
+        return path;
+    }
+}
+
+class SceneTest : public ::testing::Test {
+};
+
+TEST_F(SceneTest, LoadGLTF_FlattensHierarchy) {
+    auto path = WriteHierarchy();
+    std::vector<GLTFNode> nodes;
+    auto geometry = RawGeometry::LoadGLTF(path, nodes);
+    ASSERT_TRUE(geometry.has_value()) << geometry.error().Str();
+    EXPECT_EQ(geometry->GetMeshCount(), 3);
+
+    ASSERT_EQ(nodes.size(), 4);
+    EXPECT_EQ(nodes[0].m_parent, -1);
+    EXPECT_EQ(nodes[1].m_parent, 0);
+    EXPECT_EQ(nodes[2].m_parent, -1);
+    EXPECT_EQ(nodes[3].m_parent, 2);
+    EXPECT_EQ(nodes[1].m_firstMesh, 1);
+    EXPECT_EQ(nodes[1].m_meshCount, 2);
+    EXPECT_EQ(nodes[2].m_meshCount, 0);
+
+    auto desc = SceneDesc::FromGLTFNodes(nodes);
+    // Root, four nodes and one extra node for B's second primitive
+    ASSERT_EQ(desc.GetNodeCount(), 7);
+    EXPECT_EQ(desc.m_parents, (std::vector<int32_t>{ -1, 0, 1, 2, 2, 0, 5 }));
+    EXPECT_EQ(desc.m_meshNodes, (std::vector<int32_t>{ 1, 3, 4, 6 }));
+    EXPECT_EQ(desc.m_meshIndices, (std::vector<int32_t>{ 0, 1, 2, 0 }));
+
+    // B sits on top of A and is stretched along x
+    ExpectNear(desc.m_transforms[2].m_position, glm::vec3(1.0f, 1.0f, 0.0f));
+    ExpectNear(desc.m_transforms[2].TransformVector(glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(2.0f, 0.0f, 0.0f));
+    // C turns D's offset from +z to +x
+    ExpectNear(desc.m_transforms[6].m_position, glm::vec3(1.0f, 0.0f, 0.0f));
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(SceneTest, Instantiate_CreatesEntitiesAndTransforms) {
+    std::vector<char const*> argsv;
+    Engine engine(GetTestEngineParams(argsv));
+    ASSERT_TRUE(engine.Startup().IsOk());
+
+    auto path = WriteHierarchy();
+    CpuGeometryManager manager;
+    auto scene = Scene::LoadGLTF(path, manager);
+    ASSERT_TRUE(scene.has_value()) << scene.error().Str();
+    EXPECT_EQ(manager.m_resources.size(), 1);
+
+    std::vector<Transform> placements{
+        Transform::Translate(10.0f, 0.0f, 0.0f),
+        Transform(glm::vec3(0.0f, 0.0f, -10.0f), 2.0f),
+    };
+    std::vector<entity_t> roots(placements.size());
+    scene->Instantiate(engine, placements, roots);
+    engine.Run(1);
+
+    auto& tree = engine.GetEntityTree();
+    auto* transforms = engine.GetStorageAccessor<Transform>();
+    ASSERT_NE(transforms, nullptr);
+    for (size_t copy = 0; copy < roots.size(); ++copy) {
+        EXPECT_EQ(tree.GetParent(roots[copy]), kRoot);
+        size_t descendants = 0;
+        for (auto entity : tree.GetDescendants(roots[copy])) {
+            EXPECT_NE(transforms->TryGet(entity), nullptr);
+            ++descendants;
+        }
+        EXPECT_EQ(descendants, scene->GetDesc().GetNodeCount() - 1);
+        ExpectNear(transforms->Get(roots[copy]).m_position, placements[copy].m_position);
+    }
+
+    // The first child of the second copy's root is A, at (1, 0, 0) scaled by two
+    auto a = tree.GetFirstChild(roots[1]);
+    ExpectNear(transforms->Get(a).m_position, glm::vec3(2.0f, 0.0f, -10.0f));
+    auto b = tree.GetFirstChild(a);
+    ExpectNear(transforms->Get(b).TransformPoint(glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(6.0f, 2.0f, -10.0f));
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(SceneTest, Instantiate_Benchmark) {
+    constexpr int kNodeCount = 50;
+    constexpr size_t kCopies = 2000;
+
+    std::vector<char const*> argsv;
+    Engine engine(GetTestEngineParams(argsv));
+    ASSERT_TRUE(engine.Startup().IsOk());
+
+    auto path = WritePrefab(kNodeCount);
+    CpuGeometryManager manager;
+    auto scene = Scene::LoadGLTF(path, manager);
+    ASSERT_TRUE(scene.has_value()) << scene.error().Str();
+    ASSERT_EQ(scene->GetDesc().GetNodeCount(), kNodeCount + 1);
+
+    std::vector<Transform> placements;
+    for (size_t i = 0; i < kCopies; ++i) {
+        placements.push_back(Transform::Translate(float(i % 100) * 10.0f, 0.0f, float(i / 100) * 10.0f));
+    }
+    std::vector<entity_t> roots(kCopies);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    scene->Instantiate(engine, placements, roots);
+    auto instantiateTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    engine.Run(1);
+    auto processTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Instantiated " << kCopies << " copies of a " << kNodeCount << " node scene in "
+        << instantiateTime << "ms, components stored in " << processTime << "ms" << std::endl;
+
+    auto* transforms = engine.GetStorageAccessor<Transform>();
+    auto last = roots.back();
+    ExpectNear(transforms->Get(last).m_position, placements.back().m_position);
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(SceneTest, CloneSubtree_CopiesComponents) {
+    constexpr int kNodeCount = 12;
+    constexpr size_t kClones = 10;
+
+    std::vector<char const*> argsv;
+    Engine engine(GetTestEngineParams(argsv));
+    engine.AddModule<StaticMeshStorageModule>();
+    ASSERT_TRUE(engine.Startup().IsOk());
+
+    auto path = WritePrefab(kNodeCount);
+    CpuGeometryManager manager;
+    auto scene = Scene::LoadGLTF(path, manager);
+    ASSERT_TRUE(scene.has_value()) << scene.error().Str();
+
+    auto prefab = scene->Instantiate(engine, Transform::Identity());
+    engine.Run(1);
+    auto& refCount = manager.m_resources[0]->m_refCount;
+    int refsBefore = refCount.load();
+
+    auto roots = engine.CloneSubtree(prefab, kRoot, kClones);
+    engine.Run(1);
+
+    // One reference per cloned mesh node
+    EXPECT_EQ(refCount.load(), refsBefore + int(kClones * scene->GetDesc().m_meshNodes.size()));
+
+    auto& tree = engine.GetEntityTree();
+    auto* meshes = engine.GetStorageAccessor<StaticMeshComponent>();
+    auto* transforms = engine.GetStorageAccessor<Transform>();
+    ASSERT_NE(meshes, nullptr);
+    std::vector<entity_t> sources{ prefab };
+    for (auto entity : tree.GetDescendants(prefab)) {
+        sources.push_back(entity);
+    }
+    for (auto root : roots) {
+        std::vector<entity_t> clones{ root };
+        for (auto entity : tree.GetDescendants(root)) {
+            clones.push_back(entity);
+        }
+        ASSERT_EQ(clones.size(), sources.size());
+        for (size_t i = 0; i < clones.size(); ++i) {
+            auto* sourceMesh = meshes->TryGet(sources[i]);
+            auto* cloneMesh = meshes->TryGet(clones[i]);
+            ASSERT_EQ(sourceMesh == nullptr, cloneMesh == nullptr);
+            if (sourceMesh) {
+                EXPECT_EQ(*sourceMesh, *cloneMesh);
+            }
+            ExpectNear(transforms->Get(clones[i]).m_position, transforms->Get(sources[i]).m_position);
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(SceneTest, CloneSubtree_Benchmark) {
+    constexpr int kNodeCount = 50;
+    constexpr size_t kClones = 10000;
+
+    std::vector<char const*> argsv;
+    Engine engine(GetTestEngineParams(argsv));
+    engine.AddModule<StaticMeshStorageModule>();
+    ASSERT_TRUE(engine.Startup().IsOk());
+
+    auto path = WritePrefab(kNodeCount);
+    CpuGeometryManager manager;
+    auto scene = Scene::LoadGLTF(path, manager);
+    ASSERT_TRUE(scene.has_value()) << scene.error().Str();
+
+    auto prefab = scene->Instantiate(engine, Transform::Identity());
+    engine.Run(1);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto roots = engine.CloneSubtree(prefab, kRoot, kClones);
+    auto cloneTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    engine.Run(1);
+    auto processTime = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "Cloned a " << kNodeCount << " node prefab " << kClones << " times in "
+        << cloneTime << "ms, components stored in " << processTime << "ms" << std::endl;
+
+    ASSERT_EQ(roots.size(), kClones);
+    auto* meshes = engine.GetStorageAccessor<StaticMeshComponent>();
+    auto* transforms = engine.GetStorageAccessor<Transform>();
+    EXPECT_NE(meshes->TryGet(engine.GetEntityTree().GetFirstChild(roots.back())), nullptr);
+    EXPECT_NE(transforms->TryGet(roots.back()), nullptr);
+
+    std::filesystem::remove(path);
+}
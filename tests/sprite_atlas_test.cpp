@@ -0,0 +1,275 @@
+#include <gtest/gtest.h>
+#include "../sprite_atlas.hpp"
+#include "../texture_compression.hpp"
+#include "texture_utils.hpp"
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+using namespace okami;
+
+namespace {
+    // Every texel encodes its sprite and position, so misplaced texels show
+    RawTexture MakeSprite(uint32_t width, uint32_t height, uint32_t id) {
+        RawTexture texture(MakeTextureInfo(width, height));
+        auto data = texture.GetData();
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                auto* texel = &data[(size_t(y) * width + x) * 4];
+                texel[0] = static_cast<uint8_t>(x);
+                texel[1] = static_cast<uint8_t>(y);
+                texel[2] = static_cast<uint8_t>(id);
+                texel[3] = static_cast<uint8_t>(id >> 8);
+            }
+        }
+        return texture;
+    }
+
+    RawTexture MakeSolid(uint32_t width, uint32_t height, std::array<uint8_t, 4> color) {
+        RawTexture texture(MakeTextureInfo(width, height));
+        auto data = texture.GetData();
+        for (size_t i = 0; i < data.size(); i += 4) {
+            data[i + 0] = color[0];
+            data[i + 1] = color[1];
+            data[i + 2] = color[2];
+            data[i + 3] = color[3];
+        }
+        return texture;
+    }
+
+    std::vector<RawTexture const*> Pointers(std::vector<RawTexture> const& textures) {
+        std::vector<RawTexture const*> pointers;
+        for (auto const& texture : textures) {
+            pointers.push_back(&texture);
+        }
+        return pointers;
+    }
+
+    uint8_t const* TexelAt(RawTexture const& texture, int x, int y) {
+        return &texture.GetData()[(size_t(y) * texture.GetInfo().width + x) * 4];
+    }
+
+    // Hands out resources without uploading anything
+    class CpuTextureManager final : public IResourceManager<Texture> {
+    public:
+        std::vector<std::unique_ptr<Resource<Texture>>> m_resources;
+
+        ResHandle<Texture> Load(std::string_view path, LoadParams<Texture> params) override {
+            auto texture = RawTexture::Load(path);
+            auto handle = texture ? Create(std::move(*texture)) : ResHandle<Texture>();
+            if (params.m_onLoaded) {
+                params.m_onLoaded(handle, texture ? Error() : texture.error());
+            }
+            return handle;
+        }
+
+        ResHandle<Texture> Create(RawTexture&& data) override {
+            auto resource = std::make_unique<Resource<Texture>>();
+            resource->m_id = static_cast<resource_id_t>(m_resources.size());
+            resource->m_data.m_info = data.GetInfo();
+            resource->m_loaded.store(true);
+            m_resources.push_back(std::move(resource));
+            return m_resources.back().get();
+        }
+    };
+}
+
+class SpriteAtlasTest : public ::testing::Test {
+};
+
+TEST_F(SpriteAtlasTest, PacksWithoutOverlap) {
+    std::mt19937 rng(7);
+    std::vector<RawTexture> sprites;
+    for (uint32_t i = 0; i < 300; ++i) {
+        sprites.push_back(MakeSprite(1 + rng() % 48, 1 + rng() % 48, i));
+    }
+
+    SpriteAtlasParams params{ .m_maxPageSize = 512, .m_padding = 2 };
+    auto atlas = BuildSpriteAtlas(Pointers(sprites), params);
+    ASSERT_TRUE(atlas.has_value()) << atlas.error();
+    ASSERT_EQ(atlas->m_entries.size(), sprites.size());
+    EXPECT_LE(atlas->m_pages.size(), 2u);
+
+    size_t usedArea = 0;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+        auto const& entry = atlas->m_entries[i];
+        ASSERT_LT(entry.m_page, atlas->m_pages.size());
+        auto const& page = atlas->m_pages[entry.m_page];
+        auto const& info = sprites[i].GetInfo();
+        EXPECT_EQ(entry.m_rect.m_size, glm::vec2(info.width, info.height));
+
+        // The padded cell lies inside the page
+        int x0 = static_cast<int>(entry.m_rect.m_position.x);
+        int y0 = static_cast<int>(entry.m_rect.m_position.y);
+        ASSERT_GE(x0, 2);
+        ASSERT_GE(y0, 2);
+        ASSERT_LE(x0 + info.width + 2, page.GetInfo().width);
+        ASSERT_LE(y0 + info.height + 2, page.GetInfo().height);
+
+        // Padded cells never overlap
+        for (size_t j = 0; j < i; ++j) {
+            auto const& other = atlas->m_entries[j];
+            if (other.m_page != entry.m_page) {
+                continue;
+            }
+            auto minA = entry.m_rect.GetMin() - 2.0f;
+            auto maxA = entry.m_rect.GetMax() + 2.0f;
+            auto minB = other.m_rect.GetMin() - 2.0f;
+            auto maxB = other.m_rect.GetMax() + 2.0f;
+            bool overlaps = minA.x < maxB.x && minB.x < maxA.x && minA.y < maxB.y && minB.y < maxA.y;
+            EXPECT_FALSE(overlaps) << "sprites " << i << " and " << j;
+        }
+
+        // Texels are copied and the padding repeats the edge
+        for (int y = -2; y < int(info.height) + 2; ++y) {
+            for (int x = -2; x < int(info.width) + 2; ++x) {
+                auto const* texel = TexelAt(page, x0 + x, y0 + y);
+                ASSERT_EQ(texel[0], std::clamp(x, 0, int(info.width) - 1));
+                ASSERT_EQ(texel[1], std::clamp(y, 0, int(info.height) - 1));
+                ASSERT_EQ(texel[2], i & 0xFF);
+                ASSERT_EQ(texel[3], i >> 8);
+            }
+        }
+        usedArea += size_t(info.width + 4) * (info.height + 4);
+    }
+
+    size_t pageArea = 0;
+    for (auto const& page : atlas->m_pages) {
+        pageArea += size_t(page.GetInfo().width) * page.GetInfo().height;
+    }
+    std::cout << "Packed " << sprites.size() << " sprites into " << atlas->m_pages.size()
+        << " pages at " << 100.0 * usedArea / pageArea << "% occupancy" << std::endl;
+    EXPECT_GT(double(usedArea) / pageArea, 0.75);
+}
+
+TEST_F(SpriteAtlasTest, OpensPagesAsNeeded) {
+    std::vector<RawTexture> sprites;
+    for (uint32_t i = 0; i < 20; ++i) {
+        sprites.push_back(MakeSprite(60, 60, i));
+    }
+
+    auto atlas = BuildSpriteAtlas(Pointers(sprites), SpriteAtlasParams{ .m_maxPageSize = 128, .m_padding = 2 });
+    ASSERT_TRUE(atlas.has_value());
+    // Four 64x64 cells per page
+    EXPECT_EQ(atlas->m_pages.size(), 5u);
+    for (auto const& page : atlas->m_pages) {
+        EXPECT_EQ(page.GetInfo().width, 128u);
+        EXPECT_EQ(page.GetInfo().height, 128u);
+    }
+
+    // Pages shrink to what they hold
+    auto single = BuildSpriteAtlas(Pointers(std::vector<RawTexture>{}), {});
+    ASSERT_TRUE(single.has_value());
+    EXPECT_TRUE(single->m_pages.empty());
+    auto small = MakeSprite(10, 6, 0);
+    RawTexture const* smallPointer = &small;
+    auto shrunk = BuildSpriteAtlas(std::span(&smallPointer, 1), SpriteAtlasParams{ .m_padding = 1 });
+    ASSERT_TRUE(shrunk.has_value());
+    EXPECT_EQ(shrunk->m_pages[0].GetInfo().width, 12u);
+    EXPECT_EQ(shrunk->m_pages[0].GetInfo().height, 8u);
+}
+
+TEST_F(SpriteAtlasTest, MipLevelsKeepSpritesApart) {
+    std::mt19937 rng(3);
+    std::vector<RawTexture> sprites;
+    std::vector<std::array<uint8_t, 4>> colors;
+    for (uint32_t i = 0; i < 40; ++i) {
+        colors.push_back({ uint8_t(rng()), uint8_t(rng()), uint8_t(rng()), 255 });
+        sprites.push_back(MakeSolid(3 + rng() % 30, 3 + rng() % 30, colors.back()));
+    }
+
+    SpriteAtlasParams params{ .m_maxPageSize = 256, .m_padding = 1, .m_mipLevels = 3 };
+    auto atlas = BuildSpriteAtlas(Pointers(sprites), params);
+    ASSERT_TRUE(atlas.has_value()) << atlas.error();
+
+    for (auto const& page : atlas->m_pages) {
+        EXPECT_EQ(page.GetInfo().mipLevels, 3u);
+        EXPECT_EQ(page.GetInfo().width % 4, 0u);
+        EXPECT_EQ(page.GetInfo().height % 4, 0u);
+    }
+
+    // Every texel of level 2 over a sprite comes from that sprite alone
+    for (size_t i = 0; i < sprites.size(); ++i) {
+        auto const& entry = atlas->m_entries[i];
+        auto const& page = atlas->m_pages[entry.m_page];
+        auto level = page.GetMipData(2);
+        uint32_t levelWidth = page.GetInfo().width / 4;
+        auto min = glm::uvec2(entry.m_rect.GetMin()) / 4u;
+        auto max = (glm::uvec2(entry.m_rect.GetMax()) + 3u) / 4u;
+        for (uint32_t y = min.y; y < max.y; ++y) {
+            for (uint32_t x = min.x; x < max.x; ++x) {
+                auto const* texel = &level[(size_t(y) * levelWidth + x) * 4];
+                for (int c = 0; c < 4; ++c) {
+                    ASSERT_NEAR(texel[c], colors[i][c], 1) << "sprite " << i;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(SpriteAtlasTest, RemapsSprites) {
+    std::vector<RawTexture> sprites;
+    sprites.push_back(MakeSprite(32, 16, 0));
+    sprites.push_back(MakeSprite(8, 8, 1));
+    auto atlas = BuildSpriteAtlas(Pointers(sprites));
+    ASSERT_TRUE(atlas.has_value());
+
+    auto entry = atlas->m_entries[0];
+    CpuTextureManager manager;
+    auto regions = atlas->Instantiate(manager);
+    ASSERT_EQ(regions.size(), 2u);
+    EXPECT_TRUE(atlas->m_pages.empty());
+    EXPECT_EQ(manager.m_resources.size(), 1u);
+    // Both sprites now share a texture, so they draw in one batch
+    EXPECT_EQ(regions[0].m_texture.Ptr(), regions[1].m_texture.Ptr());
+
+    SpriteComponent whole{ .m_color = color::Red, .m_layer = 3 };
+    auto remapped = regions[0].Remap(whole);
+    ASSERT_TRUE(remapped.m_sourceRect.has_value());
+    EXPECT_EQ(remapped.m_sourceRect->m_position, entry.m_rect.m_position);
+    EXPECT_EQ(remapped.m_sourceRect->m_size, glm::vec2(32.0f, 16.0f));
+    EXPECT_EQ(remapped.m_color, color::Red);
+    EXPECT_EQ(remapped.m_layer, 3);
+    EXPECT_FALSE(remapped.m_origin.has_value());
+
+    SpriteComponent frame{ .m_origin = glm::vec2(2.0f, 2.0f), .m_sourceRect = Rect{ glm::vec2(16.0f, 0.0f), glm::vec2(16.0f, 16.0f) } };
+    remapped = regions[0].Remap(frame);
+    EXPECT_EQ(remapped.m_sourceRect->m_position, entry.m_rect.m_position + glm::vec2(16.0f, 0.0f));
+    EXPECT_EQ(remapped.m_sourceRect->m_size, glm::vec2(16.0f, 16.0f));
+    EXPECT_EQ(remapped.m_origin, glm::vec2(2.0f, 2.0f));
+}
+
+TEST_F(SpriteAtlasTest, RejectsUnsupported) {
+    auto large = MakeSprite(100, 10, 0);
+    RawTexture const* largePointer = &large;
+    EXPECT_FALSE(BuildSpriteAtlas(std::span(&largePointer, 1), SpriteAtlasParams{ .m_maxPageSize = 64 }).has_value());
+
+    std::vector<RawTexture> mixed;
+    mixed.push_back(MakeSprite(8, 8, 0));
+    mixed.emplace_back(MakeTextureInfo(8, 8, TextureFormat::R8));
+    EXPECT_FALSE(BuildSpriteAtlas(Pointers(mixed)).has_value());
+
+    auto compressed = MakeSprite(8, 8, 0);
+    ASSERT_TRUE(compressed.Compress(TextureFormat::BC1, BlockCompressionParams{}).IsOk());
+    RawTexture const* compressedPointer = &compressed;
+    EXPECT_FALSE(BuildSpriteAtlas(std::span(&compressedPointer, 1)).has_value());
+
+    EXPECT_FALSE(BuildSpriteAtlas(Pointers(mixed), SpriteAtlasParams{ .m_mipLevels = 0 }).has_value());
+}
+
+TEST_F(SpriteAtlasTest, Benchmark) {
+    std::mt19937 rng(11);
+    std::vector<RawTexture> sprites;
+    for (uint32_t i = 0; i < 4000; ++i) {
+        sprites.push_back(MakeSprite(4 + rng() % 60, 4 + rng() % 60, i));
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto atlas = BuildSpriteAtlas(Pointers(sprites), SpriteAtlasParams{ .m_mipLevels = 3 });
+    auto elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(atlas.has_value());
+    std::cout << "Packed " << sprites.size() << " sprites into " << atlas->m_pages.size()
+        << " pages in " << elapsed << "ms" << std::endl;
+}
@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+#include "../sprite_batch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <glm/gtc/constants.hpp>
+
+using namespace okami;
+
+namespace {
+    // Loaded textures without a backend behind them
+    class Textures {
+    public:
+        std::vector<std::unique_ptr<Resource<Texture>>> m_resources;
+
+        ResHandle<Texture> Add(uint32_t width, uint32_t height, bool loaded = true) {
+            auto resource = std::make_unique<Resource<Texture>>();
+            resource->m_id = static_cast<resource_id_t>(m_resources.size());
+            resource->m_data.m_info = TextureInfo{
+                TextureType::TEXTURE_2D, TextureFormat::RGBA8, width, height, 1, 1, 1 };
+            resource->m_loaded.store(loaded);
+            m_resources.push_back(std::move(resource));
+            return m_resources.back().get();
+        }
+    };
+
+    std::vector<hlsl::SpriteInstance> Write(SpriteBatchBuilder const& builder) {
+        std::vector<hlsl::SpriteInstance> instances(builder.GetInstanceCount());
+        builder.WriteInstances(instances);
+        return instances;
+    }
+}
+
+class SpriteBatchTest : public ::testing::Test {
+};
+
+TEST_F(SpriteBatchTest, SortsByLayerThenTexture) {
+    Textures textures;
+    auto a = textures.Add(16, 16);
+    auto b = textures.Add(32, 32);
+
+    // Positions record the order sprites were added in
+    std::vector<SpriteComponent> sprites = {
+        { .m_texture = b, .m_layer = 1 },
+        { .m_texture = a, .m_layer = 1 },
+        { .m_texture = b, .m_layer = -2 },
+        { .m_texture = a, .m_layer = 1 },
+        { .m_texture = b, .m_layer = 1 },
+    };
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+        transforms.emplace_back(glm::vec3(static_cast<float>(i), 0.0f, 0.0f));
+    }
+
+    SpriteBatchBuilder builder;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+        builder.Add(&transforms[i], sprites[i]);
+    }
+    builder.Build();
+
+    auto batches = builder.GetBatches();
+    ASSERT_EQ(batches.size(), 3u);
+    EXPECT_EQ(batches[0].m_layer, -2);
+    EXPECT_EQ(batches[0].m_instanceCount, 1u);
+    EXPECT_EQ(batches[0].m_texture, &b.Get());
+    EXPECT_EQ(batches[1].m_layer, 1);
+    EXPECT_EQ(batches[1].m_texture, &a.Get());
+    EXPECT_EQ(batches[1].m_firstInstance, 1u);
+    EXPECT_EQ(batches[1].m_instanceCount, 2u);
+    EXPECT_EQ(batches[2].m_texture, &b.Get());
+    EXPECT_EQ(batches[2].m_firstInstance, 3u);
+    EXPECT_EQ(batches[2].m_instanceCount, 2u);
+
+    // Sprites sharing a layer and texture keep the order they were added in
+    auto instances = Write(builder);
+    std::vector<float> order;
+    for (auto const& instance : instances) {
+        order.push_back(instance.position.x);
+    }
+    EXPECT_EQ(order, (std::vector<float>{ 2.0f, 1.0f, 3.0f, 0.0f, 4.0f }));
+}
+
+TEST_F(SpriteBatchTest, ComputesInstances) {
+    Textures textures;
+    auto texture = textures.Add(64, 32);
+
+    SpriteComponent whole{ .m_texture = texture, .m_color = color::Red };
+    SpriteComponent frame{
+        .m_texture = texture,
+        .m_origin = glm::vec2(1.0f, 2.0f),
+        .m_sourceRect = Rect{ glm::vec2(16.0f, 8.0f), glm::vec2(16.0f, 8.0f) } };
+    Transform transform(glm::vec3(1.0f, 2.0f, 3.0f), glm::angleAxis(glm::half_pi<float>(), glm::vec3(0.0f, 0.0f, 1.0f)), 2.0f);
+
+    SpriteBatchBuilder builder;
+    builder.Add(nullptr, whole);
+    builder.Add(&transform, frame);
+    builder.Build();
+    auto instances = Write(builder);
+    ASSERT_EQ(instances.size(), 2u);
+
+    EXPECT_EQ(instances[0].position, glm::vec3(0.0f));
+    EXPECT_FLOAT_EQ(instances[0].rotation, 0.0f);
+    EXPECT_EQ(instances[0].size, glm::vec2(64.0f, 32.0f));
+    EXPECT_EQ(instances[0].origin, glm::vec2(32.0f, 16.0f));
+    EXPECT_EQ(instances[0].uv0, glm::vec2(0.0f, 0.0f));
+    EXPECT_EQ(instances[0].uv1, glm::vec2(1.0f, 1.0f));
+    EXPECT_EQ(instances[0].color, color::Red);
+
+    EXPECT_EQ(instances[1].position, glm::vec3(1.0f, 2.0f, 3.0f));
+    EXPECT_NEAR(instances[1].rotation, glm::half_pi<float>(), 1e-5f);
+    EXPECT_EQ(instances[1].size, glm::vec2(32.0f, 16.0f));
+    EXPECT_EQ(instances[1].origin, glm::vec2(2.0f, 4.0f));
+    EXPECT_EQ(instances[1].uv0, glm::vec2(0.25f, 0.25f));
+    EXPECT_EQ(instances[1].uv1, glm::vec2(0.5f, 0.5f));
+}
+
+TEST_F(SpriteBatchTest, BindlessDrawsLayersAtOnce) {
+    Textures textures;
+    std::vector<ResHandle<Texture>> handles;
+    for (int i = 0; i < 8; ++i) {
+        handles.push_back(textures.Add(8, 8));
+    }
+
+    std::vector<SpriteComponent> sprites;
+    for (int i = 0; i < 1000; ++i) {
+        sprites.push_back(SpriteComponent{ .m_texture = handles[(i * 7) % 8], .m_layer = i % 3 });
+    }
+
+    SpriteBatchBuilder builder;
+    for (auto const& sprite : sprites) {
+        builder.Add(nullptr, sprite);
+    }
+
+    int lookups = 0;
+    builder.Build(SpriteBatchParams{ .m_bindless = true }, [&](Texture const& texture) {
+        ++lookups;
+        return 100 + static_cast<uint32_t>(std::find_if(handles.begin(), handles.end(),
+            [&](auto const& handle) { return &handle.Get() == &texture; }) - handles.begin());
+    });
+
+    auto batches = builder.GetBatches();
+    ASSERT_EQ(batches.size(), 3u);
+    for (auto const& batch : batches) {
+        EXPECT_EQ(batch.m_texture, nullptr);
+    }
+    // One lookup per texture per layer
+    EXPECT_EQ(lookups, 24);
+
+    auto instances = Write(builder);
+    for (auto const& batch : batches) {
+        for (uint32_t i = batch.m_firstInstance; i < batch.m_firstInstance + batch.m_instanceCount; ++i) {
+            EXPECT_GE(instances[i].textureIndex, 100u);
+            EXPECT_LT(instances[i].textureIndex, 108u);
+        }
+    }
+
+    // Every instance carries the index of its own texture
+    std::vector<int> counts(8);
+    for (auto const& instance : instances) {
+        ++counts[instance.textureIndex - 100];
+    }
+    EXPECT_EQ(counts, std::vector<int>(8, 125));
+}
+
+TEST_F(SpriteBatchTest, SkipsUnloadedTextures) {
+    Textures textures;
+    auto loaded = textures.Add(8, 8);
+    auto pending = textures.Add(8, 8, false);
+
+    SpriteComponent a{ .m_texture = loaded };
+    SpriteComponent b{ .m_texture = pending };
+    SpriteComponent c{};
+
+    SpriteBatchBuilder builder;
+    builder.Add(nullptr, a);
+    builder.Add(nullptr, b);
+    builder.Add(nullptr, c);
+    builder.Build();
+    EXPECT_EQ(builder.GetInstanceCount(), 1u);
+    EXPECT_EQ(builder.GetBatches().size(), 1u);
+
+    // Buffers are reused from frame to frame
+    builder.Clear();
+    builder.Build();
+    EXPECT_EQ(builder.GetInstanceCount(), 0u);
+    EXPECT_TRUE(builder.GetBatches().empty());
+}
+
+TEST_F(SpriteBatchTest, ProjectedTextureSize) {
+    Textures textures;
+    auto texture = textures.Add(64, 32);
+
+    // The whole texture counts, not just the source rect
+    SpriteComponent sprite{
+        .m_texture = texture,
+        .m_sourceRect = Rect{ glm::vec2(0.0f), glm::vec2(8.0f) } };
+
+    // 100 units over 1000 pixels
+    LodSelector view(Camera::Orthographic(100.0f, 100.0f, 0.1f, 1000.0f), Transform::Identity(), 1000, 1000);
+    auto size = GetProjectedTextureSize(Transform(glm::vec3(0.0f, 0.0f, -5.0f), 0.5f), sprite, view);
+    EXPECT_NEAR(size.x, 320.0f, 1e-2f);
+    EXPECT_NEAR(size.y, 160.0f, 1e-2f);
+
+    // Twice as far away is half as large in perspective
+    LodSelector perspective(Camera::Perspective(glm::half_pi<float>(), 0.1f, 1000.0f), Transform::Identity(), 1000, 1000);
+    auto near = GetProjectedTextureSize(Transform::Translate(0.0f, 0.0f, -10.0f), sprite, perspective);
+    auto far = GetProjectedTextureSize(Transform::Translate(0.0f, 0.0f, -20.0f), sprite, perspective);
+    EXPECT_NEAR(near.x, 2.0f * far.x, 1e-2f);
+    EXPECT_NEAR(near.x, 64.0f * 50.0f, 1e-1f);
+}
+
+TEST_F(SpriteBatchTest, RadixSortIsStable) {
+    std::mt19937_64 rng(5);
+    for (uint64_t mask : { 0xFFull, 0xFFFF0000000000FFull, ~0ull }) {
+        std::vector<uint64_t> keys(5000);
+        for (auto& key : keys) {
+            key = rng() & mask;
+        }
+        std::vector<uint32_t> values(keys.size());
+        std::iota(values.begin(), values.end(), 0);
+
+        auto expected = values;
+        std::stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+        std::vector<uint64_t> keysScratch;
+        std::vector<uint32_t> valuesScratch;
+        auto sortedKeys = keys;
+        RadixSort(sortedKeys, values, keysScratch, valuesScratch);
+        EXPECT_EQ(values, expected);
+        EXPECT_TRUE(std::is_sorted(sortedKeys.begin(), sortedKeys.end()));
+    }
+}
+
+TEST_F(SpriteBatchTest, Benchmark) {
+    constexpr size_t kSpriteCount = 1'000'000;
+    Textures textures;
+    std::vector<ResHandle<Texture>> handles;
+    for (int i = 0; i < 256; ++i) {
+        handles.push_back(textures.Add(32, 32));
+    }
+
+    std::mt19937 rng(9);
+    std::vector<SpriteComponent> sprites;
+    std::vector<Transform> transforms;
+    sprites.reserve(kSpriteCount);
+    transforms.reserve(kSpriteCount);
+    for (size_t i = 0; i < kSpriteCount; ++i) {
+        sprites.push_back(SpriteComponent{
+            .m_texture = handles[rng() % handles.size()],
+            .m_sourceRect = Rect{ glm::vec2(0.0f), glm::vec2(16.0f) },
+            .m_layer = static_cast<int>(rng() % 8) });
+        transforms.emplace_back(glm::vec3(rng() % 1000, rng() % 1000, 0.0f));
+    }
+    std::vector<hlsl::SpriteInstance> instances(kSpriteCount);
+
+    for (bool bindless : { false, true }) {
+        SpriteBatchBuilder builder;
+        for (int frame = 0; frame < 3; ++frame) {
+            auto start = std::chrono::high_resolution_clock::now();
+            builder.Clear();
+            for (size_t i = 0; i < kSpriteCount; ++i) {
+                builder.Add(&transforms[i], sprites[i]);
+            }
+            auto added = std::chrono::high_resolution_clock::now();
+            builder.Build(SpriteBatchParams{ .m_bindless = bindless }, [](Texture const&) { return 0u; });
+            auto built = std::chrono::high_resolution_clock::now();
+            builder.WriteInstances(instances);
+            auto written = std::chrono::high_resolution_clock::now();
+
+            auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+            std::cout << (bindless ? "Bindless" : "Bound") << " frame " << frame << ": " << kSpriteCount
+                << " sprites in " << builder.GetBatches().size() << " batches, add " << ms(start, added)
+                << "ms, sort and batch " << ms(added, built) << "ms, write " << ms(built, written) << "ms" << std::endl;
+        }
+    }
+
+    // The same keys sorted with std::sort, for comparison
+    std::vector<std::pair<uint64_t, uint32_t>> pairs(kSpriteCount);
+    for (size_t i = 0; i < kSpriteCount; ++i) {
+        pairs[i] = { (uint64_t(uint32_t(sprites[i].m_layer)) << 32) | uint32_t(sprites[i].m_texture.GetId()), uint32_t(i) };
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    std::sort(pairs.begin(), pairs.end());
+    std::cout << "std::sort of the same keys: " << std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count() << "ms" << std::endl;
+}
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include "../static_batch.hpp"
+#include "../bvh.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+
+using namespace okami;
+
+namespace {
+    // A (size x size) grid of quads in the XY plane spanning [0, size],
+    // facing +z, with 16 bit indices
+    RawGeometry MakeGrid(int size) {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        for (int y = 0; y <= size; ++y) {
+            for (int x = 0; x <= size; ++x) {
+                positions.emplace_back(static_cast<float>(x), static_cast<float>(y), 0.0f);
+                normals.emplace_back(0.0f, 0.0f, 1.0f);
+            }
+        }
+
+        std::vector<uint16_t> indices;
+        auto vertex = [size](int x, int y) { return static_cast<uint16_t>(y * (size + 1) + x); };
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                indices.insert(indices.end(), { vertex(x, y), vertex(x + 1, y), vertex(x + 1, y + 1) });
+                indices.insert(indices.end(), { vertex(x, y), vertex(x + 1, y + 1), vertex(x, y + 1) });
+            }
+        }
+
+        std::vector<uint8_t> vertexBuffer((positions.size() + normals.size()) * sizeof(glm::vec3));
+        std::memcpy(vertexBuffer.data(), positions.data(), positions.size() * sizeof(glm::vec3));
+        std::memcpy(vertexBuffer.data() + positions.size() * sizeof(glm::vec3), normals.data(), normals.size() * sizeof(glm::vec3));
+        std::vector<uint8_t> indexBuffer(indices.size() * sizeof(uint16_t));
+        std::memcpy(indexBuffer.data(), indices.data(), indexBuffer.size());
+
+        GeometryMeshDesc mesh;
+        mesh.m_type = MeshType::Static;
+        mesh.m_vertexCount = positions.size();
+        mesh.m_attributes.push_back(Attribute{ AttributeType::Position, 0, 0 });
+        mesh.m_attributes.push_back(Attribute{ AttributeType::Normal, 0, positions.size() * sizeof(glm::vec3) });
+        mesh.m_indices = IndexInfo{ AccessorComponentType::UShort, 1, indices.size(), 0 };
+        mesh.m_aabb = AABB{ glm::vec3(0.0f), glm::vec3(size, size, 0.0f) };
+
+        std::vector<std::vector<uint8_t>> buffers;
+        buffers.push_back(std::move(vertexBuffer));
+        buffers.push_back(std::move(indexBuffer));
+        std::vector<GeometryMeshDesc> meshes;
+        meshes.push_back(std::move(mesh));
+        return RawGeometry(std::move(buffers), std::move(meshes));
+    }
+
+    void ExpectNear(glm::vec3 const& a, glm::vec3 const& b, float tolerance = 1e-5f) {
+        EXPECT_NEAR(a.x, b.x, tolerance);
+        EXPECT_NEAR(a.y, b.y, tolerance);
+        EXPECT_NEAR(a.z, b.z, tolerance);
+    }
+}
+
+class StaticBatchTest : public ::testing::Test {
+};
+
+TEST_F(StaticBatchTest, PreTransformsIntoOneChunk) {
+    auto grid = MakeGrid(2);
+    std::vector<StaticBatchInstance> instances{
+        { .m_geometry = &grid, .m_transform = Transform::Translate(5.0f, 0.0f, 0.0f), .m_entity = 10 },
+        { .m_geometry = &grid, .m_transform = Transform::RotateX(glm::half_pi<float>()), .m_entity = 11 },
+        { .m_geometry = &grid, .m_transform = Transform(glm::mat3(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f))), .m_entity = 12 },
+    };
+
+    auto batch = BuildStaticBatch(instances);
+    ASSERT_TRUE(batch.has_value()) << batch.error().Str();
+    ASSERT_EQ(batch->m_chunks.size(), 1);
+    ASSERT_EQ(batch->m_geometry.GetMeshCount(), 1);
+    EXPECT_TRUE(batch->m_geometry.IsPacked(GetDefaultMeshRequirements()));
+
+    auto const& chunk = batch->m_chunks[0];
+    auto const& mesh = batch->m_geometry.GetMeshes()[0];
+    EXPECT_EQ(mesh.m_vertexCount, 27);
+    EXPECT_EQ(mesh.m_indices->m_count, 72);
+    ASSERT_EQ(chunk.m_sources.size(), 3);
+
+    auto positions = batch->m_geometry.TryAccess<glm::vec3>(AttributeType::Position);
+    auto normals = batch->m_geometry.TryAccess<glm::vec3>(AttributeType::Normal);
+    auto indices = batch->m_geometry.ReadIndices();
+    ASSERT_TRUE(positions && normals && indices);
+
+    auto sourcePositions = *grid.TryAccess<glm::vec3>(AttributeType::Position);
+    for (auto const& source : chunk.m_sources) {
+        auto const& instance = instances[source.m_instance];
+        EXPECT_EQ(source.m_entity, instance.m_entity);
+        ASSERT_EQ(source.m_vertexCount, 9);
+        ASSERT_EQ(source.m_triangleCount, 8);
+
+        auto expectedNormal = glm::normalize(instance.m_transform.TransformVector(glm::vec3(0.0f, 0.0f, 1.0f)));
+        for (uint32_t i = 0; i < source.m_vertexCount; ++i) {
+            ExpectNear(positions->m_begin[source.m_firstVertex + i],
+                instance.m_transform.TransformPoint(sourcePositions.m_begin[i]));
+            // The grid lies in a plane each transform keeps the normal of
+            ExpectNear(normals->m_begin[source.m_firstVertex + i], expectedNormal);
+        }
+
+        // Triangles still wind around the normal, mirrored or not
+        for (uint32_t t = source.m_firstTriangle; t < source.m_firstTriangle + source.m_triangleCount; ++t) {
+            auto a = positions->m_begin[(*indices)[3 * t]];
+            auto b = positions->m_begin[(*indices)[3 * t + 1]];
+            auto c = positions->m_begin[(*indices)[3 * t + 2]];
+            EXPECT_GT(glm::dot(glm::cross(b - a, c - a), expectedNormal), 0.0f);
+            EXPECT_EQ(chunk.FindSource(t), &source);
+        }
+    }
+    EXPECT_EQ(chunk.FindSource(24), nullptr);
+
+    ExpectNear(chunk.m_bounds.m_min, glm::vec3(-2.0f, 0.0f, 0.0f));
+    ExpectNear(chunk.m_bounds.m_max, glm::vec3(7.0f, 2.0f, 2.0f));
+}
+
+TEST_F(StaticBatchTest, SplitsSpatially) {
+    auto grid = MakeGrid(1);
+    std::vector<StaticBatchInstance> instances;
+    for (int z = 0; z < 16; ++z) {
+        for (int x = 0; x < 16; ++x) {
+            instances.push_back({
+                .m_geometry = &grid,
+                .m_transform = Transform::Translate(x * 10.0f, 0.0f, z * 10.0f),
+                .m_entity = static_cast<entity_t>(instances.size()),
+            });
+        }
+    }
+
+    auto batch = BuildStaticBatch(instances, StaticBatchParams{ .m_maxChunkExtent = 40.0f });
+    ASSERT_TRUE(batch.has_value()) << batch.error().Str();
+    EXPECT_GT(batch->m_chunks.size(), 1);
+    EXPECT_LT(batch->m_chunks.size(), instances.size() / 8);
+    ASSERT_EQ(batch->m_geometry.GetMeshCount(), batch->m_chunks.size());
+
+    std::set<uint32_t> seen;
+    for (size_t i = 0; i < batch->m_chunks.size(); ++i) {
+        auto const& chunk = batch->m_chunks[i];
+        auto const& mesh = batch->m_geometry.GetMeshes()[i];
+        EXPECT_EQ(chunk.m_bounds.m_min, mesh.m_aabb.m_min);
+        EXPECT_EQ(chunk.m_bounds.m_max, mesh.m_aabb.m_max);
+        EXPECT_LE(chunk.m_bounds.m_max.x - chunk.m_bounds.m_min.x, 41.0f);
+        EXPECT_LE(chunk.m_bounds.m_max.z - chunk.m_bounds.m_min.z, 41.0f);
+        for (auto const& source : chunk.m_sources) {
+            EXPECT_TRUE(seen.insert(source.m_instance).second);
+            auto position = instances[source.m_instance].m_transform.m_position;
+            EXPECT_TRUE(chunk.m_bounds.Contains(position));
+        }
+    }
+    EXPECT_EQ(seen.size(), instances.size());
+}
+
+TEST_F(StaticBatchTest, RaycastPicksEntity) {
+    auto grid = MakeGrid(4);
+    std::vector<StaticBatchInstance> instances;
+    for (int i = 0; i < 8; ++i) {
+        instances.push_back({
+            .m_geometry = &grid,
+            .m_transform = Transform::Translate(i * 5.0f, 0.0f, 0.0f),
+            .m_entity = 100 + i,
+        });
+    }
+
+    auto batch = BuildStaticBatch(instances);
+    ASSERT_TRUE(batch.has_value()) << batch.error().Str();
+    ASSERT_TRUE(batch->m_geometry.BuildBVHs().IsOk());
+    ASSERT_EQ(batch->m_chunks.size(), 1);
+
+    auto hit = batch->m_geometry.GetBVH(0)->Raycast(
+        Ray{ glm::vec3(31.5f, 2.5f, 10.0f), glm::vec3(0.0f, 0.0f, -1.0f) });
+    ASSERT_TRUE(hit.has_value());
+    auto source = batch->m_chunks[0].FindSource(hit->m_triangle);
+    ASSERT_NE(source, nullptr);
+    EXPECT_EQ(source->m_entity, 106);
+}
+
+TEST_F(StaticBatchTest, Benchmark) {
+    constexpr int kSide = 100;
+
+    // Ten distinct small meshes scattered over a 1km square
+    std::vector<RawGeometry> meshes;
+    for (int i = 1; i <= 10; ++i) {
+        meshes.push_back(MakeGrid(i));
+    }
+    std::vector<StaticBatchInstance> instances;
+    for (int z = 0; z < kSide; ++z) {
+        for (int x = 0; x < kSide; ++x) {
+            instances.push_back({
+                .m_geometry = &meshes[(x + z) % meshes.size()],
+                .m_transform = Transform::Translate(x * 10.0f, 0.0f, z * 10.0f) * Transform::RotateY(float(x * z)),
+                .m_entity = static_cast<entity_t>(instances.size()),
+            });
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto batch = BuildStaticBatch(instances, StaticBatchParams{ .m_maxChunkExtent = 256.0f });
+    auto elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    ASSERT_TRUE(batch.has_value()) << batch.error().Str();
+
+    size_t vertexCount = 0;
+    for (auto const& mesh : batch->m_geometry.GetMeshes()) {
+        vertexCount += mesh.m_vertexCount;
+    }
+    std::cout << "Batched " << instances.size() << " meshes (" << vertexCount << " vertices) into "
+        << batch->m_chunks.size() << " chunks in " << elapsed << "ms" << std::endl;
+
+    EXPECT_LE(batch->m_chunks.size() * 100, instances.size());
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+#include "../texture_compression.hpp"
+#include "../texture_mips.hpp"
+#include "../paths.hpp"
+#include "texture_utils.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace okami;
+
+namespace {
+    // Gradients, hard edged shapes and a little noise, with alpha that
+    // fades and has a cut out hole like a sprite
+    RawTexture MakeImage(uint32_t width, uint32_t height, uint32_t seed = 1) {
+        RawTexture texture(MakeTextureInfo(width, height));
+        std::mt19937 rng(seed);
+        auto data = texture.GetData();
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                float u = x / float(width);
+                float v = y / float(height);
+                float dx = u - 0.5f;
+                float dy = v - 0.5f;
+                bool inCircle = dx * dx + dy * dy < 0.08f;
+                bool inStripe = (x / 16 + y / 16) % 5 == 0;
+                int noise = static_cast<int>(rng() % 9) - 4;
+
+                auto* texel = &data[(size_t(y) * width + x) * 4];
+                texel[0] = static_cast<uint8_t>(std::clamp(int(255 * u) + noise, 0, 255));
+                texel[1] = static_cast<uint8_t>(std::clamp(int(255 * v * (inCircle ? 0.3f : 1.0f)) + noise, 0, 255));
+                texel[2] = static_cast<uint8_t>(inStripe ? 220 : 40 + int(100 * u * v));
+                texel[3] = inCircle && dx > 0.1f ? 0 : static_cast<uint8_t>(255 - int(128 * v));
+            }
+        }
+        return texture;
+    }
+
+    // Peak signal to noise ratio over the given channels of the first level
+    double ComputePSNR(RawTexture const& original, RawTexture const& decoded, uint32_t firstChannel, uint32_t channelCount) {
+        auto const& info = original.GetInfo();
+        auto originalStride = GetPixelStride(info.format);
+        auto decodedStride = GetPixelStride(decoded.GetInfo().format);
+        double squaredError = 0.0;
+        size_t texels = size_t(info.width) * info.height;
+        for (size_t i = 0; i < texels; ++i) {
+            for (uint32_t c = firstChannel; c < firstChannel + channelCount; ++c) {
+                double d = double(original.GetData()[i * originalStride + c]) - decoded.GetData()[i * decodedStride + c];
+                squaredError += d * d;
+            }
+        }
+        double meanError = squaredError / (texels * channelCount);
+        return meanError == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / meanError);
+    }
+
+    RawTexture RoundTrip(RawTexture const& source, TextureFormat format, CompressionQuality quality) {
+        auto texture = source;
+        EXPECT_TRUE(texture.Compress(format, BlockCompressionParams{ .m_quality = quality }).IsOk());
+        EXPECT_EQ(texture.GetInfo().format, format);
+        EXPECT_EQ(texture.GetData().size(), GetTextureSize(texture.GetInfo()));
+        EXPECT_TRUE(texture.Decompress().IsOk());
+        return texture;
+    }
+
+    struct PSNRCase {
+        TextureFormat m_format;
+        double m_minPSNR;
+    };
+
+    constexpr CompressionQuality kQualities[] = {
+        CompressionQuality::Fast, CompressionQuality::Normal, CompressionQuality::High };
+}
+
+class TextureCompressionTest : public ::testing::Test {
+};
+
+TEST_F(TextureCompressionTest, BlockLayout) {
+    EXPECT_TRUE(IsBlockCompressed(TextureFormat::BC7));
+    EXPECT_FALSE(IsBlockCompressed(TextureFormat::RGBA8));
+    EXPECT_EQ(GetRowPitch(TextureFormat::BC1, 5), 16);
+    EXPECT_EQ(GetRowPitch(TextureFormat::BC7, 8), 32);
+    EXPECT_EQ(GetRowPitch(TextureFormat::RGBA8, 5), 20);
+    EXPECT_EQ(GetRowCount(TextureFormat::BC4, 5), 2);
+    EXPECT_EQ(GetRowCount(TextureFormat::R8, 5), 5);
+
+    // Levels below 4x4 still take a whole block
+    auto info = MakeTextureInfo(16, 8, TextureFormat::BC1);
+    info.mipLevels = 5;
+    EXPECT_EQ(GetTextureSize(info), (4 * 2 + 2 * 1 + 1 + 1 + 1) * 8);
+    EXPECT_EQ(GetMipOffset(info, 1), 4 * 2 * 8);
+
+    // A quarter of the bytes of RGBA8 for BC7, an eighth for BC1
+    auto texture = MakeImage(64, 64);
+    auto bc7 = texture;
+    ASSERT_TRUE(bc7.Compress(TextureFormat::BC7, BlockCompressionParams{}).IsOk());
+    EXPECT_EQ(bc7.GetData().size() * 4, texture.GetData().size());
+    auto bc1 = texture;
+    ASSERT_TRUE(bc1.Compress(TextureFormat::BC1, BlockCompressionParams{}).IsOk());
+    EXPECT_EQ(bc1.GetData().size() * 8, texture.GetData().size());
+}
+
+TEST_F(TextureCompressionTest, ColorPSNR) {
+    // Opaque, so BC1 is not limited by its one bit alpha
+    auto source = MakeImage(256, 256);
+    for (size_t i = 3; i < source.GetData().size(); i += 4) {
+        source.GetData()[i] = 255;
+    }
+
+    for (auto [format, minPSNR] : { PSNRCase{ TextureFormat::BC1, 40.0 }, PSNRCase{ TextureFormat::BC3, 40.0 }, PSNRCase{ TextureFormat::BC7, 46.0 } }) {
+        double previous = 0.0;
+        for (auto quality : kQualities) {
+            auto decoded = RoundTrip(source, format, quality);
+            auto psnr = ComputePSNR(source, decoded, 0, 3);
+            std::cout << "Format " << static_cast<int>(format) << " quality " << static_cast<int>(quality)
+                << ": " << psnr << "dB" << std::endl;
+            EXPECT_GE(psnr, minPSNR);
+            // Better presets never lose quality
+            EXPECT_GE(psnr, previous - 0.01);
+            previous = psnr;
+        }
+    }
+}
+
+TEST_F(TextureCompressionTest, AlphaAndChannelPSNR) {
+    auto source = MakeImage(256, 256);
+    for (auto quality : kQualities) {
+        auto bc3 = RoundTrip(source, TextureFormat::BC3, quality);
+        EXPECT_GE(ComputePSNR(source, bc3, 3, 1), 45.0);
+        auto bc7 = RoundTrip(source, TextureFormat::BC7, quality);
+        EXPECT_GE(ComputePSNR(source, bc7, 0, 4), 46.0);
+
+        // BC4 and BC5 keep the first one and two channels
+        auto bc4 = RoundTrip(source, TextureFormat::BC4, quality);
+        EXPECT_EQ(bc4.GetInfo().format, TextureFormat::R8);
+        EXPECT_GE(ComputePSNR(source, bc4, 0, 1), 50.0);
+        auto bc5 = RoundTrip(source, TextureFormat::BC5, quality);
+        EXPECT_EQ(bc5.GetInfo().format, TextureFormat::RG8);
+        EXPECT_GE(ComputePSNR(source, bc5, 0, 2), 48.0);
+    }
+}
+
+TEST_F(TextureCompressionTest, TestAsset) {
+    auto source = RawTexture::FromPNG(GetTestAssetPath("test.png"));
+    ASSERT_TRUE(source.has_value()) << source.error();
+    for (auto [format, minPSNR] : { PSNRCase{ TextureFormat::BC1, 32.0 }, PSNRCase{ TextureFormat::BC7, 34.0 } }) {
+        auto decoded = RoundTrip(*source, format, CompressionQuality::Normal);
+        EXPECT_GE(ComputePSNR(*source, decoded, 0, 3), minPSNR) << "format " << static_cast<int>(format);
+    }
+}
+
+TEST_F(TextureCompressionTest, BC1Transparency) {
+    auto source = MakeImage(64, 64);
+    auto decoded = RoundTrip(source, TextureFormat::BC1, CompressionQuality::Normal);
+    auto original = source.GetData();
+    auto result = decoded.GetData();
+    for (size_t i = 3; i < original.size(); i += 4) {
+        EXPECT_EQ(result[i], original[i] < 128 ? 0 : 255);
+    }
+}
+
+TEST_F(TextureCompressionTest, ConstantBlocks) {
+    RawTexture source(MakeTextureInfo(8, 8));
+    for (size_t i = 0; i < source.GetData().size(); i += 4) {
+        source.GetData()[i + 0] = 30;
+        source.GetData()[i + 1] = 140;
+        source.GetData()[i + 2] = 250;
+        source.GetData()[i + 3] = 77;
+    }
+    for (auto format : { TextureFormat::BC3, TextureFormat::BC7 }) {
+        auto decoded = RoundTrip(source, format, CompressionQuality::Fast);
+        for (size_t i = 0; i < decoded.GetData().size(); i += 4) {
+            // BC3 color is 5:6:5; BC7 endpoints carry 8 bits
+            int tolerance = format == TextureFormat::BC3 ? 4 : 1;
+            EXPECT_NEAR(decoded.GetData()[i + 0], 30, tolerance);
+            EXPECT_NEAR(decoded.GetData()[i + 1], 140, tolerance);
+            EXPECT_NEAR(decoded.GetData()[i + 2], 250, tolerance);
+            EXPECT_NEAR(decoded.GetData()[i + 3], 77, 1);
+        }
+    }
+}
+
+TEST_F(TextureCompressionTest, MipChainsAndOddSizes) {
+    auto source = MakeImage(37, 23);
+    ASSERT_TRUE(source.GenerateMips(MipChainParams{}).IsOk());
+    auto decoded = RoundTrip(source, TextureFormat::BC7, CompressionQuality::Normal);
+    EXPECT_EQ(decoded.GetInfo().width, 37);
+    EXPECT_EQ(decoded.GetInfo().mipLevels, source.GetInfo().mipLevels);
+    EXPECT_EQ(decoded.GetData().size(), source.GetData().size());
+    EXPECT_GE(ComputePSNR(source, decoded, 0, 4), 30.0);
+
+    // The smallest levels decode to the texels they were made from
+    auto last = source.GetInfo().mipLevels - 1;
+    auto expected = source.GetMipData(last);
+    auto actual = decoded.GetMipData(last);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(actual[i], expected[i], 2);
+    }
+}
+
+TEST_F(TextureCompressionTest, RejectsUnsupported) {
+    auto texture = MakeImage(8, 8);
+    EXPECT_TRUE(texture.Compress(TextureFormat::RGBA8, BlockCompressionParams{}).IsError());
+    EXPECT_TRUE(texture.Decompress().IsError());
+
+    RawTexture floats(MakeTextureInfo(8, 8, TextureFormat::RGBA32F));
+    EXPECT_TRUE(floats.Compress(TextureFormat::BC7, BlockCompressionParams{}).IsError());
+
+    ASSERT_TRUE(texture.Compress(TextureFormat::BC1, BlockCompressionParams{}).IsOk());
+    EXPECT_TRUE(texture.GenerateMips(MipChainParams{}).IsError());
+    EXPECT_TRUE(texture.Compress(TextureFormat::BC7, BlockCompressionParams{}).IsError());
+}
+
+TEST_F(TextureCompressionTest, Benchmark) {
+    auto source = MakeImage(1024, 1024);
+    for (auto format : { TextureFormat::BC1, TextureFormat::BC3, TextureFormat::BC4, TextureFormat::BC5, TextureFormat::BC7 }) {
+        for (auto quality : kQualities) {
+            auto texture = source;
+            auto start = std::chrono::high_resolution_clock::now();
+            ASSERT_TRUE(texture.Compress(format, BlockCompressionParams{ .m_quality = quality }).IsOk());
+            auto elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << "Compressed 1024x1024 to format " << static_cast<int>(format)
+                << " at quality " << static_cast<int>(quality) << " in " << elapsed << "ms ("
+                << 1024.0 * 1024.0 / elapsed / 1000.0 << " MTexels/s)" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,312 @@
+#include <gtest/gtest.h>
+#include "../texture_conversion.hpp"
+#include "../texture_compression.hpp"
+#include "../float_packing.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace okami;
+
+namespace {
+    constexpr TextureFormat kFormats[] = {
+        TextureFormat::R8, TextureFormat::RG8, TextureFormat::RGB8, TextureFormat::RGBA8,
+        TextureFormat::R32F, TextureFormat::RG32F, TextureFormat::RGB32F, TextureFormat::RGBA32F,
+        TextureFormat::R16F, TextureFormat::RG16F, TextureFormat::RGBA16F,
+        TextureFormat::R11G11B10F, TextureFormat::RGB9E5,
+    };
+
+    // Largest rounding error of values in [0, 1] stored in a format; 8 bit
+    // and 32 bit float formats hold the test's multiples of 1/255 exactly
+    float GetPrecision(TextureFormat format) {
+        switch (format) {
+            case TextureFormat::R16F:
+            case TextureFormat::RG16F:
+            case TextureFormat::RGBA16F:
+                return 1.0f / 4096.0f;
+            case TextureFormat::R11G11B10F:
+                return 1.0f / 128.0f;
+            case TextureFormat::RGB9E5:
+                return 1.0f / 1024.0f;
+            default:
+                return 1e-6f;
+        }
+    }
+
+    // Reads any uncompressed texel as floats, missing channels as 0 and alpha as 1
+    std::array<float, 4> ReadTexel(std::vector<uint8_t> const& data, TextureFormat format, size_t index) {
+        std::array<float, 4> texel = { 0.0f, 0.0f, 0.0f, 1.0f };
+        auto channels = GetChannelCount(format);
+        auto stride = GetPixelStride(format);
+        auto const* bytes = &data[index * stride];
+        if (format == TextureFormat::R11G11B10F || format == TextureFormat::RGB9E5) {
+            uint32_t packed;
+            std::memcpy(&packed, bytes, sizeof(packed));
+            auto color = format == TextureFormat::RGB9E5 ? UnpackRGB9E5(packed) : UnpackR11G11B10F(packed);
+            return { color.x, color.y, color.z, 1.0f };
+        }
+        for (uint32_t c = 0; c < channels; ++c) {
+            if (stride == channels * sizeof(float)) {
+                std::memcpy(&texel[c], bytes + c * sizeof(float), sizeof(float));
+            } else if (stride == channels * sizeof(uint16_t)) {
+                uint16_t half;
+                std::memcpy(&half, bytes + c * sizeof(uint16_t), sizeof(half));
+                texel[c] = HalfToFloat(half);
+            } else {
+                texel[c] = bytes[c] / 255.0f;
+            }
+        }
+        return texel;
+    }
+
+    std::vector<uint8_t> Convert(std::vector<uint8_t> const& source, TextureFormat from, TextureFormat to,
+        PixelConversionParams const& params = {}) {
+        auto count = source.size() / GetPixelStride(from);
+        std::vector<uint8_t> result(count * GetPixelStride(to));
+        ConvertPixels(source, from, result, to, params);
+        return result;
+    }
+
+    double ReferenceLinearToSrgb(double c) {
+        return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+    }
+
+    double ReferenceSrgbToLinear(double c) {
+        return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+}
+
+class TextureConversionTest : public ::testing::Test {
+};
+
+TEST_F(TextureConversionTest, ConvertsEveryFormatPair) {
+    // Every 8 bit value in every channel, a few texels more than a block so
+    // the vector and scalar tails both run
+    constexpr size_t kCount = 259;
+    std::vector<uint8_t> rgba(kCount * 4);
+    for (size_t i = 0; i < rgba.size(); ++i) {
+        rgba[i] = static_cast<uint8_t>(i * 7 + i / 4);
+    }
+
+    for (auto from : kFormats) {
+        auto source = Convert(rgba, TextureFormat::RGBA8, from);
+        for (auto to : kFormats) {
+            auto converted = Convert(source, from, to);
+            auto channels = std::min(GetChannelCount(from), GetChannelCount(to));
+            auto tolerance = std::max(GetPrecision(from), GetPrecision(to));
+            for (size_t i = 0; i < kCount; ++i) {
+                auto expected = ReadTexel(source, from, i);
+                auto actual = ReadTexel(converted, to, i);
+                for (uint32_t c = 0; c < 4; ++c) {
+                    float want = c < channels ? expected[c] : (c == 3 ? 1.0f : 0.0f);
+                    EXPECT_NEAR(actual[c], want, tolerance) << static_cast<int>(from) << " to " << static_cast<int>(to)
+                        << ", texel " << i << ", channel " << c;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(TextureConversionTest, FloatToUnormRoundsAndClamps) {
+    std::vector<float> values = {
+        -1.0f, 0.0f, 0.5f / 255.0f, 0.49f / 255.0f, 0.5f, 127.5f / 255.0f, 1.0f, 2.0f,
+        std::numeric_limits<float>::quiet_NaN(), 0.25f, 0.75f, 1.0f };
+    std::vector<uint8_t> source(values.size() * sizeof(float));
+    std::memcpy(source.data(), values.data(), source.size());
+
+    std::vector<uint8_t> expected = { 0, 0, 1, 0, 128, 128, 255, 255, 0, 64, 191, 255 };
+    EXPECT_EQ(Convert(source, TextureFormat::RGBA32F, TextureFormat::RGBA8), expected);
+    EXPECT_EQ(Convert(source, TextureFormat::R32F, TextureFormat::R8), expected);
+}
+
+TEST_F(TextureConversionTest, SrgbRoundTripsAndMatchesReference) {
+    std::vector<uint8_t> codes(256 * 4);
+    for (size_t i = 0; i < 256; ++i) {
+        codes[i * 4] = codes[i * 4 + 1] = codes[i * 4 + 2] = static_cast<uint8_t>(i);
+        codes[i * 4 + 3] = static_cast<uint8_t>(i);
+    }
+    PixelConversionParams decode{ .m_source = { .m_color = ColorEncoding::Srgb } };
+    PixelConversionParams encode{ .m_destination = { .m_color = ColorEncoding::Srgb } };
+
+    auto linear = Convert(codes, TextureFormat::RGBA8, TextureFormat::RGBA32F, decode);
+    for (size_t i = 0; i < 256; ++i) {
+        auto texel = ReadTexel(linear, TextureFormat::RGBA32F, i);
+        EXPECT_NEAR(texel[0], ReferenceSrgbToLinear(i / 255.0), 1e-6);
+        // Alpha is never sRGB encoded
+        EXPECT_FLOAT_EQ(texel[3], i / 255.0f);
+    }
+    EXPECT_EQ(Convert(linear, TextureFormat::RGBA32F, TextureFormat::RGBA8, encode), codes);
+
+    // Encoding rounds to the nearest code, for any value
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> distribution(-0.1f, 1.1f);
+    std::vector<float> values(4096 * 3);
+    for (auto& value : values) {
+        value = distribution(rng);
+    }
+    std::vector<uint8_t> source(values.size() * sizeof(float));
+    std::memcpy(source.data(), values.data(), source.size());
+    auto encoded = Convert(source, TextureFormat::RGB32F, TextureFormat::RGB8, encode);
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto reference = ReferenceLinearToSrgb(std::clamp(double(values[i]), 0.0, 1.0)) * 255.0;
+        EXPECT_LE(std::abs(encoded[i] - reference), 0.5 + 1e-4) << values[i];
+    }
+}
+
+TEST_F(TextureConversionTest, PremultipliesAlpha) {
+    std::vector<uint8_t> straight = {
+        200, 100, 50, 128,
+        255, 255, 255, 0,
+        10, 20, 30, 255,
+        255, 128, 0, 64,
+        90, 180, 45, 3,
+    };
+    PixelConversionParams premultiply{ .m_destination = { .m_alpha = AlphaMode::Premultiplied } };
+    auto premultiplied = Convert(straight, TextureFormat::RGBA8, TextureFormat::RGBA8, premultiply);
+    for (size_t i = 0; i < straight.size(); ++i) {
+        auto alpha = straight[i / 4 * 4 + 3];
+        auto expected = i % 4 == 3 ? alpha : std::lround(straight[i] * alpha / 255.0);
+        EXPECT_EQ(premultiplied[i], expected) << i;
+    }
+
+    // Undone in float, where nothing was lost
+    auto floats = Convert(straight, TextureFormat::RGBA8, TextureFormat::RGBA32F, premultiply);
+    PixelConversionParams unpremultiply{ .m_source = { .m_alpha = AlphaMode::Premultiplied } };
+    auto restored = Convert(floats, TextureFormat::RGBA32F, TextureFormat::RGBA8, unpremultiply);
+    for (size_t i = 0; i < straight.size(); ++i) {
+        // Fully transparent texels lose their color
+        auto expected = straight[i / 4 * 4 + 3] == 0 && i % 4 != 3 ? 0 : straight[i];
+        EXPECT_EQ(restored[i], expected) << i;
+    }
+
+    // In sRGB, color is multiplied in linear space
+    PixelConversionParams srgbPremultiply{
+        .m_source = { .m_color = ColorEncoding::Srgb },
+        .m_destination = { .m_color = ColorEncoding::Srgb, .m_alpha = AlphaMode::Premultiplied } };
+    auto srgb = Convert(straight, TextureFormat::RGBA8, TextureFormat::RGBA8, srgbPremultiply);
+    auto expected = std::lround(ReferenceLinearToSrgb(ReferenceSrgbToLinear(200 / 255.0) * 128 / 255.0) * 255.0);
+    EXPECT_EQ(srgb[0], expected);
+}
+
+TEST_F(TextureConversionTest, HalfAndPackedFormatsKeepHdrValues) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> exponent(-12.0f, 15.0f);
+    std::vector<float> values(1027 * 4);
+    for (auto& value : values) {
+        value = std::exp2(exponent(rng));
+    }
+    values[0] = -2.0f;
+    values[1] = 1e6f;
+    std::vector<uint8_t> source(values.size() * sizeof(float));
+    std::memcpy(source.data(), values.data(), source.size());
+
+    // Matches the batch half kernels both ways, through the block pipeline too
+    std::vector<uint16_t> halves(values.size());
+    EncodeHalf(values, halves);
+    auto half = Convert(source, TextureFormat::RGBA32F, TextureFormat::RGBA16F);
+    ASSERT_EQ(half.size(), halves.size() * sizeof(uint16_t));
+    EXPECT_EQ(std::memcmp(half.data(), halves.data(), half.size()), 0);
+    auto viaPipeline = Convert(Convert(source, TextureFormat::RGBA32F, TextureFormat::RGB32F),
+        TextureFormat::RGB32F, TextureFormat::RGBA16F);
+    for (size_t i = 0; i < values.size() / 4; ++i) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            auto expected = c < 3 ? halves[i * 4 + c] : uint16_t(0x3C00);
+            uint16_t actual;
+            std::memcpy(&actual, &viaPipeline[(i * 4 + c) * sizeof(uint16_t)], sizeof(actual));
+            ASSERT_EQ(actual, expected) << i << ", channel " << c;
+        }
+    }
+    auto widened = Convert(half, TextureFormat::RGBA16F, TextureFormat::RGBA32F);
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(ReadTexel(widened, TextureFormat::RGBA32F, i / 4)[i % 4], HalfToFloat(halves[i]));
+    }
+
+    // Packed formats take RGB and pack each texel alone
+    for (auto format : { TextureFormat::R11G11B10F, TextureFormat::RGB9E5 }) {
+        auto packed = Convert(source, TextureFormat::RGBA32F, format);
+        for (size_t i = 0; i < values.size() / 4; ++i) {
+            glm::vec3 color(values[i * 4], values[i * 4 + 1], values[i * 4 + 2]);
+            uint32_t expected = format == TextureFormat::RGB9E5 ? PackRGB9E5(color) : PackR11G11B10F(color);
+            uint32_t actual;
+            std::memcpy(&actual, &packed[i * 4], sizeof(actual));
+            ASSERT_EQ(actual, expected) << i;
+        }
+    }
+}
+
+TEST_F(TextureConversionTest, ConvertsEveryMipLevel) {
+    TextureInfo info{ TextureType::TEXTURE_2D, TextureFormat::RGB8, 8, 4, 1, 1, 4 };
+    RawTexture texture(info);
+    auto data = texture.GetData();
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    auto original = texture;
+
+    ASSERT_TRUE(texture.Convert(TextureFormat::RGBA8, PixelConversionParams{}).IsOk());
+    EXPECT_EQ(texture.GetInfo().format, TextureFormat::RGBA8);
+    EXPECT_EQ(texture.GetData().size(), GetTextureSize(texture.GetInfo()));
+    for (uint32_t mip = 0; mip < info.mipLevels; ++mip) {
+        auto source = original.GetMipData(mip);
+        auto converted = texture.GetMipData(mip);
+        ASSERT_EQ(converted.size(), source.size() / 3 * 4);
+        for (size_t i = 0; i < source.size() / 3; ++i) {
+            EXPECT_EQ(converted[i * 4], source[i * 3]);
+            EXPECT_EQ(converted[i * 4 + 2], source[i * 3 + 2]);
+            EXPECT_EQ(converted[i * 4 + 3], 255);
+        }
+    }
+
+    ASSERT_TRUE(texture.Compress(TextureFormat::BC1, BlockCompressionParams{}).IsOk());
+    EXPECT_TRUE(texture.Convert(TextureFormat::RGBA8, PixelConversionParams{}).IsError());
+}
+
+TEST_F(TextureConversionTest, Benchmark) {
+    constexpr size_t kCount = 2048 * 2048;
+    std::vector<uint8_t> rgba8(kCount * 4);
+    std::mt19937 rng(1);
+    for (auto& value : rgba8) {
+        value = static_cast<uint8_t>(rng());
+    }
+    auto rgb8 = Convert(rgba8, TextureFormat::RGBA8, TextureFormat::RGB8);
+    auto rgba32f = Convert(rgba8, TextureFormat::RGBA8, TextureFormat::RGBA32F);
+
+    auto time = [&](char const* name, std::vector<uint8_t> const& source, TextureFormat from, TextureFormat to,
+        PixelConversionParams const& params) {
+        std::vector<uint8_t> destination(kCount * GetPixelStride(to));
+        auto start = std::chrono::high_resolution_clock::now();
+        ConvertPixels(source, from, destination, to, params);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << name << ": " << ms << "ms, " << kCount / ms / 1000.0 << " Mtexels/s" << std::endl;
+    };
+
+    PixelConversionParams srgbDecode{ .m_source = { .m_color = ColorEncoding::Srgb } };
+    PixelConversionParams srgbEncode{ .m_destination = { .m_color = ColorEncoding::Srgb } };
+    PixelConversionParams premultiply{ .m_destination = { .m_alpha = AlphaMode::Premultiplied } };
+    time("RGB8 to RGBA8", rgb8, TextureFormat::RGB8, TextureFormat::RGBA8, {});
+    time("RGBA8 to RGBA32F", rgba8, TextureFormat::RGBA8, TextureFormat::RGBA32F, {});
+    time("RGBA32F to RGBA8", rgba32f, TextureFormat::RGBA32F, TextureFormat::RGBA8, {});
+    time("sRGB RGBA8 to linear RGBA32F", rgba8, TextureFormat::RGBA8, TextureFormat::RGBA32F, srgbDecode);
+    time("Linear RGBA32F to sRGB RGBA8", rgba32f, TextureFormat::RGBA32F, TextureFormat::RGBA8, srgbEncode);
+    time("Premultiply RGBA8", rgba8, TextureFormat::RGBA8, TextureFormat::RGBA8, premultiply);
+
+    auto rgba16f = Convert(rgba32f, TextureFormat::RGBA32F, TextureFormat::RGBA16F);
+    auto rgb32f = Convert(rgba32f, TextureFormat::RGBA32F, TextureFormat::RGB32F);
+    time("RGBA32F to RGBA16F", rgba32f, TextureFormat::RGBA32F, TextureFormat::RGBA16F, {});
+    time("RGBA16F to RGBA32F", rgba16f, TextureFormat::RGBA16F, TextureFormat::RGBA32F, {});
+    time("RGBA16F to RGBA8", rgba16f, TextureFormat::RGBA16F, TextureFormat::RGBA8, {});
+    time("RGB32F to R11G11B10F", rgb32f, TextureFormat::RGB32F, TextureFormat::R11G11B10F, {});
+    time("RGB32F to RGB9E5", rgb32f, TextureFormat::RGB32F, TextureFormat::RGB9E5, {});
+
+    // The scalar clamp SavePNG used before, for comparison
+    std::vector<uint8_t> scalar(kCount * 4);
+    auto const* floats = reinterpret_cast<float const*>(rgba32f.data());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < kCount * 4; ++i) {
+        scalar[i] = static_cast<uint8_t>(std::clamp(floats[i], 0.0f, 1.0f) * 255.0f);
+    }
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Scalar RGBA32F to RGBA8: " << ms << "ms" << std::endl;
+}
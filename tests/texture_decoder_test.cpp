@@ -0,0 +1,287 @@
+#include <gtest/gtest.h>
+#include "../texture_decoder.hpp"
+#include "texture_utils.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <random>
+
+using namespace okami;
+
+namespace {
+    // Collects decoded textures the way an upload thread would consume them
+    struct Receiver {
+        struct Item {
+            size_t m_index;
+            Expected<RawTexture> m_texture;
+            TextureDecodeLease m_lease;
+        };
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::deque<Item> m_items;
+
+        TextureDecoder::Callback MakeCallback(size_t index) {
+            return [this, index](Expected<RawTexture> texture, TextureDecodeLease lease) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_items.push_back(Item{ index, std::move(texture), std::move(lease) });
+                }
+                m_condition.notify_one();
+            };
+        }
+
+        Item Pop() {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return !m_items.empty(); });
+            auto item = std::move(m_items.front());
+            m_items.pop_front();
+            return item;
+        }
+    };
+}
+
+class TextureDecoderTest : public ::testing::Test {
+protected:
+    std::filesystem::path m_directory;
+
+    void SetUp() override {
+        m_directory = std::filesystem::temp_directory_path() / "okami_texture_decoder_test";
+        std::filesystem::create_directories(m_directory);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(m_directory, ec);
+    }
+
+    std::vector<std::filesystem::path> WriteTextures(std::vector<RawTexture> const& textures) {
+        std::vector<std::filesystem::path> paths;
+        for (size_t i = 0; i < textures.size(); ++i) {
+            paths.push_back(m_directory / ("texture_" + std::to_string(i) + ".png"));
+            EXPECT_TRUE(textures[i].SavePNG(paths.back()).IsOk());
+        }
+        return paths;
+    }
+};
+
+TEST_F(TextureDecoderTest, ReadPNGInfo) {
+    auto path = WriteTextures({ MakeNoiseTexture(37, 11, 1) })[0];
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> encoded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    auto info = RawTexture::ReadPNGInfo(encoded);
+    ASSERT_TRUE(info.has_value()) << info.error();
+    EXPECT_EQ(info->width, 37);
+    EXPECT_EQ(info->height, 11);
+    EXPECT_EQ(info->format, TextureFormat::RGBA8);
+
+    std::vector<uint8_t> garbage(64, 0xAB);
+    EXPECT_FALSE(RawTexture::ReadPNGInfo(garbage).has_value());
+    EXPECT_FALSE(RawTexture::FromPNG(std::span<uint8_t const>(garbage)).has_value());
+}
+
+TEST_F(TextureDecoderTest, DecodesFiles) {
+    std::vector<RawTexture> textures;
+    for (uint32_t i = 0; i < 16; ++i) {
+        textures.push_back(MakeNoiseTexture(16 + i, 8 + 2 * i, i));
+    }
+    auto paths = WriteTextures(textures);
+
+    Receiver receiver;
+    TextureDecoder decoder;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        decoder.Submit(paths[i], receiver.MakeCallback(i));
+    }
+    decoder.Submit(m_directory / "missing.png", receiver.MakeCallback(paths.size()));
+    decoder.Wait();
+
+    ASSERT_EQ(receiver.m_items.size(), paths.size() + 1);
+    for (auto& item : receiver.m_items) {
+        if (item.m_index == paths.size()) {
+            EXPECT_FALSE(item.m_texture.has_value());
+            EXPECT_EQ(item.m_lease.GetBytes(), 0);
+            continue;
+        }
+        ASSERT_TRUE(item.m_texture.has_value()) << item.m_texture.error();
+        auto const& expected = textures[item.m_index];
+        EXPECT_EQ(item.m_texture->GetInfo().width, expected.GetInfo().width);
+        EXPECT_EQ(item.m_texture->GetInfo().height, expected.GetInfo().height);
+        EXPECT_TRUE(std::equal(expected.GetData().begin(), expected.GetData().end(),
+            item.m_texture->GetData().begin(), item.m_texture->GetData().end()));
+        EXPECT_EQ(item.m_lease.GetBytes(), expected.GetData().size());
+    }
+
+    // Leases keep their bytes in flight until released
+    EXPECT_GT(decoder.GetInFlightBytes(), 0);
+    receiver.m_items.clear();
+    EXPECT_EQ(decoder.GetInFlightBytes(), 0);
+}
+
+TEST_F(TextureDecoderTest, StaysWithinBudget) {
+    constexpr size_t kTextureBytes = 64 * 64 * 4;
+    std::vector<RawTexture> textures;
+    for (uint32_t i = 0; i < 24; ++i) {
+        textures.push_back(MakeNoiseTexture(64, 64, i));
+    }
+    auto paths = WriteTextures(textures);
+
+    Receiver receiver;
+    TextureDecoder decoder(TextureDecoderParams{ .m_maxInFlightBytes = 3 * kTextureBytes });
+    for (size_t i = 0; i < paths.size(); ++i) {
+        decoder.Submit(paths[i], receiver.MakeCallback(i));
+    }
+
+    // Release each texture after "uploading" it, which lets the next decode start
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto item = receiver.Pop();
+        ASSERT_TRUE(item.m_texture.has_value()) << item.m_texture.error();
+        EXPECT_LE(decoder.GetInFlightBytes(), 3 * kTextureBytes);
+        item.m_lease.Reset();
+    }
+    decoder.Wait();
+    EXPECT_EQ(decoder.GetInFlightBytes(), 0);
+    EXPECT_LE(decoder.GetPeakInFlightBytes(), 3 * kTextureBytes);
+}
+
+TEST_F(TextureDecoderTest, OversizedTextureDecodesAlone) {
+    auto paths = WriteTextures({ MakeNoiseTexture(32, 32, 1), MakeNoiseTexture(32, 32, 2), MakeNoiseTexture(32, 32, 3) });
+
+    Receiver receiver;
+    TextureDecoder decoder(TextureDecoderParams{ .m_maxInFlightBytes = 1 });
+    for (size_t i = 0; i < paths.size(); ++i) {
+        decoder.Submit(paths[i], receiver.MakeCallback(i));
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        auto item = receiver.Pop();
+        ASSERT_TRUE(item.m_texture.has_value()) << item.m_texture.error();
+    }
+    decoder.Wait();
+    EXPECT_EQ(decoder.GetPeakInFlightBytes(), 32 * 32 * 4);
+}
+
+TEST_F(TextureDecoderTest, UrgentFirstAndUnwantedCancelled) {
+    auto paths = WriteTextures({ MakeNoiseTexture(8, 8, 1), MakeNoiseTexture(8, 8, 2), MakeNoiseTexture(8, 8, 3), MakeNoiseTexture(8, 8, 4) });
+
+    // Holds the only thread until everything is submitted
+    ThreadPool pool(1);
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool started = false;
+    pool.Submit([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&]() { return started; });
+    });
+
+    Receiver receiver;
+    TextureDecoder decoder(TextureDecoderParams{}, pool);
+    int keys[4] = {};
+    decoder.Submit(paths[0], receiver.MakeCallback(0), LoadPriority::Prefetch, &keys[0]);
+    decoder.Submit(paths[1], receiver.MakeCallback(1), LoadPriority::Prefetch, &keys[1], []() { return false; });
+    decoder.Submit(paths[2], receiver.MakeCallback(2), LoadPriority::Visible, &keys[2]);
+    decoder.Submit(paths[3], receiver.MakeCallback(3), LoadPriority::Prefetch, &keys[3]);
+    // Requested again, now needed this frame
+    decoder.Reprioritize(&keys[3], LoadPriority::Immediate);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        started = true;
+    }
+    condition.notify_one();
+    decoder.Wait();
+
+    ASSERT_EQ(receiver.m_items.size(), 4u);
+    std::vector<size_t> order;
+    for (auto const& item : receiver.m_items) {
+        order.push_back(item.m_index);
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{ 3, 2, 0, 1 }));
+    ASSERT_FALSE(receiver.m_items.back().m_texture.has_value());
+    EXPECT_TRUE(IsLoadCancelled(receiver.m_items.back().m_texture.error()));
+    EXPECT_EQ(receiver.m_items.back().m_lease.GetBytes(), 0u);
+
+    auto stats = decoder.GetQueueStats();
+    EXPECT_EQ(stats.m_reprioritizedCount, 1u);
+    EXPECT_EQ(stats.m_cancelledCount, 1u);
+    EXPECT_EQ(stats.m_poppedCount[size_t(LoadPriority::Immediate)], 1u);
+    EXPECT_EQ(stats.m_poppedCount[size_t(LoadPriority::Prefetch)], 1u);
+    EXPECT_EQ(stats.GetQueuedCount(), 0u);
+}
+
+TEST_F(TextureDecoderTest, GeneratesMips) {
+    auto paths = WriteTextures({ MakeNoiseTexture(64, 32, 1) });
+
+    Receiver receiver;
+    TextureDecoder decoder(TextureDecoderParams{ .m_mips = MipChainParams{} });
+    decoder.Submit(paths[0], receiver.MakeCallback(0));
+    auto item = receiver.Pop();
+    ASSERT_TRUE(item.m_texture.has_value()) << item.m_texture.error();
+    EXPECT_EQ(item.m_texture->GetInfo().mipLevels, 7);
+    // The budget covers the whole chain, reserved before decoding
+    EXPECT_EQ(item.m_lease.GetBytes(), item.m_texture->GetData().size());
+}
+
+TEST_F(TextureDecoderTest, CompressesTextures) {
+    auto paths = WriteTextures({ MakeNoiseTexture(64, 32, 1), MakeNoiseTexture(30, 30, 2) });
+
+    Receiver receiver;
+    TextureDecoder decoder(TextureDecoderParams{
+        .m_mips = MipChainParams{},
+        .m_compressTo = TextureFormat::BC7,
+        .m_compression = BlockCompressionParams{ .m_quality = CompressionQuality::Fast },
+    });
+    for (size_t i = 0; i < paths.size(); ++i) {
+        decoder.Submit(paths[i], receiver.MakeCallback(i));
+    }
+    decoder.Wait();
+
+    ASSERT_EQ(receiver.m_items.size(), 2);
+    for (auto& item : receiver.m_items) {
+        ASSERT_TRUE(item.m_texture.has_value()) << item.m_texture.error();
+        auto const& info = item.m_texture->GetInfo();
+        EXPECT_EQ(info.mipLevels, item.m_index == 0 ? 7 : 5);
+        EXPECT_EQ(item.m_texture->GetData().size(), GetTextureSize(info));
+        // Only whole blocks at the base level are compressed
+        EXPECT_EQ(info.format, item.m_index == 0 ? TextureFormat::BC7 : TextureFormat::RGBA8);
+    }
+}
+
+TEST_F(TextureDecoderTest, Benchmark) {
+    constexpr size_t kSprites = 1000;
+    std::vector<RawTexture> textures;
+    for (uint32_t i = 0; i < kSprites; ++i) {
+        textures.push_back(MakeNoiseTexture(128, 128, i));
+    }
+    auto paths = WriteTextures(textures);
+
+    auto measure = [&](ThreadPool& pool) {
+        std::atomic<size_t> decoded = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            TextureDecoder decoder(TextureDecoderParams{}, pool);
+            for (auto const& path : paths) {
+                decoder.Submit(path, [&decoded](Expected<RawTexture> texture, TextureDecodeLease) {
+                    if (texture) {
+                        decoded.fetch_add(1);
+                    }
+                });
+            }
+            decoder.Wait();
+        }
+        EXPECT_EQ(decoded.load(), kSprites);
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    ThreadPool single(1);
+    auto singleMs = measure(single);
+    auto pooledMs = measure(ThreadPool::Default());
+    std::cout << "Decoded " << kSprites << " 128x128 sprites in " << singleMs << "ms on 1 thread, "
+        << pooledMs << "ms on " << std::max<size_t>(ThreadPool::Default().GetThreadCount(), 1)
+        << " threads" << std::endl;
+}
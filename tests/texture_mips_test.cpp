@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include "../texture_mips.hpp"
+#include "../texture_conversion.hpp"
+#include "texture_utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace okami;
+
+namespace {
+    void SetTexel(RawTexture& texture, uint32_t x, uint32_t y, std::array<uint8_t, 4> rgba) {
+        auto offset = (y * texture.GetInfo().width + x) * 4;
+        std::memcpy(texture.GetData().data() + offset, rgba.data(), 4);
+    }
+}
+
+class TextureMipsTest : public ::testing::Test {
+};
+
+TEST_F(TextureMipsTest, ChainLayout) {
+    EXPECT_EQ(GetFullMipCount(1, 1), 1);
+    EXPECT_EQ(GetFullMipCount(256, 256), 9);
+    EXPECT_EQ(GetFullMipCount(300, 17), 9);
+
+    RawTexture texture(MakeTextureInfo(300, 17));
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    auto const& info = texture.GetInfo();
+    EXPECT_EQ(info.mipLevels, 9);
+    EXPECT_EQ(texture.GetData().size(), GetTextureSize(info));
+    EXPECT_EQ(GetMipOffset(info, 0), 0);
+    EXPECT_EQ(GetMipOffset(info, 1), 300 * 17 * 4);
+    EXPECT_EQ(texture.GetMipData(1).size(), 150 * 8 * 4);
+    EXPECT_EQ(texture.GetMipData(8).size(), 4);
+
+    RawTexture limited(MakeTextureInfo(64, 64));
+    ASSERT_TRUE(limited.GenerateMips(MipChainParams{ .m_maxLevels = 3 }).IsOk());
+    EXPECT_EQ(limited.GetInfo().mipLevels, 3);
+}
+
+TEST_F(TextureMipsTest, BoxFiltersInLinearSpace) {
+    RawTexture texture(MakeTextureInfo(2, 2));
+    SetTexel(texture, 0, 0, { 0, 0, 0, 255 });
+    SetTexel(texture, 1, 0, { 255, 255, 255, 255 });
+    SetTexel(texture, 0, 1, { 0, 0, 0, 255 });
+    SetTexel(texture, 1, 1, { 255, 255, 255, 255 });
+    auto gamma = texture;
+
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    auto mip = texture.GetMipData(1);
+    // Half of the light, encoded as sRGB
+    EXPECT_NEAR(mip[0], 188, 1);
+    EXPECT_EQ(mip[3], 255);
+
+    ASSERT_TRUE(gamma.GenerateMips(MipChainParams{ .m_srgb = false }).IsOk());
+    EXPECT_NEAR(gamma.GetMipData(1)[0], 128, 1);
+}
+
+TEST_F(TextureMipsTest, AlphaWeighting) {
+    RawTexture texture(MakeTextureInfo(2, 2));
+    SetTexel(texture, 0, 0, { 255, 0, 0, 255 });
+    SetTexel(texture, 1, 0, { 0, 255, 0, 0 });
+    SetTexel(texture, 0, 1, { 0, 255, 0, 0 });
+    SetTexel(texture, 1, 1, { 0, 255, 0, 0 });
+    auto unweighted = texture;
+
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    auto mip = texture.GetMipData(1);
+    // Invisible green does not bleed into the visible red
+    EXPECT_EQ(mip[0], 255);
+    EXPECT_EQ(mip[1], 0);
+    EXPECT_NEAR(mip[3], 64, 1);
+
+    ASSERT_TRUE(unweighted.GenerateMips(MipChainParams{ .m_alphaWeighted = false }).IsOk());
+    EXPECT_GT(unweighted.GetMipData(1)[1], 0);
+}
+
+TEST_F(TextureMipsTest, FiltersPreserveConstantsAndFlattenCheckerboards) {
+    for (auto filter : { MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos }) {
+        RawTexture constant(MakeTextureInfo(37, 23));
+        for (uint32_t y = 0; y < 23; ++y) {
+            for (uint32_t x = 0; x < 37; ++x) {
+                SetTexel(constant, x, y, { 10, 120, 230, 200 });
+            }
+        }
+        ASSERT_TRUE(constant.GenerateMips(MipChainParams{ .m_filter = filter }).IsOk());
+        auto const& info = constant.GetInfo();
+        auto chain = std::span(constant.GetData()).subspan(GetMipOffset(info, 1));
+        for (size_t i = 0; i < chain.size(); i += 4) {
+            EXPECT_NEAR(chain[i + 0], 10, 1);
+            EXPECT_NEAR(chain[i + 1], 120, 1);
+            EXPECT_NEAR(chain[i + 2], 230, 1);
+            EXPECT_NEAR(chain[i + 3], 200, 1);
+        }
+
+        // A one texel checkerboard is above the first level's Nyquist limit
+        RawTexture checker(MakeTextureInfo(32, 32));
+        for (uint32_t y = 0; y < 32; ++y) {
+            for (uint32_t x = 0; x < 32; ++x) {
+                uint8_t value = (x + y) % 2 ? 255 : 0;
+                SetTexel(checker, x, y, { value, value, value, 255 });
+            }
+        }
+        ASSERT_TRUE(checker.GenerateMips(MipChainParams{ .m_filter = filter, .m_srgb = false }).IsOk());
+        auto mip = checker.GetMipData(1);
+        for (size_t i = 0; i < mip.size(); i += 4) {
+            EXPECT_NEAR(mip[i], 128, 16) << "filter " << static_cast<int>(filter);
+        }
+    }
+}
+
+TEST_F(TextureMipsTest, FloatFormats) {
+    RawTexture texture(MakeTextureInfo(4, 2, TextureFormat::R32F));
+    float values[] = { 1.0f, 3.0f, 10.0f, 20.0f, 5.0f, 7.0f, -2.0f, 4.0f };
+    std::memcpy(texture.GetData().data(), values, sizeof(values));
+
+    ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+    ASSERT_EQ(texture.GetInfo().mipLevels, 3);
+    auto mip = texture.GetMipData(1);
+    float averages[2];
+    std::memcpy(averages, mip.data(), sizeof(averages));
+    // Float data is neither clamped nor sRGB encoded
+    EXPECT_FLOAT_EQ(averages[0], 4.0f);
+    EXPECT_FLOAT_EQ(averages[1], 8.0f);
+
+    float last;
+    std::memcpy(&last, texture.GetMipData(2).data(), sizeof(float));
+    EXPECT_FLOAT_EQ(last, 6.0f);
+}
+
+TEST_F(TextureMipsTest, HalfAndPackedFormatsFilterAsFloat) {
+    RawTexture wide(MakeTextureInfo(8, 8, TextureFormat::RGBA32F));
+    auto* values = reinterpret_cast<float*>(wide.GetData().data());
+    for (size_t i = 0; i < size_t(8) * 8 * 4; ++i) {
+        values[i] = static_cast<float>(i % 13) * 0.75f;
+    }
+
+    for (auto format : { TextureFormat::RGBA16F, TextureFormat::R11G11B10F, TextureFormat::RGB9E5 }) {
+        // Filtering the stored values in 32 bit and narrowing each level
+        // gives the same chain
+        auto texture = wide;
+        ASSERT_TRUE(texture.Convert(format, PixelConversionParams{}).IsOk());
+        auto expected = texture;
+        ASSERT_TRUE(expected.Convert(TextureFormat::RGBA32F, PixelConversionParams{}).IsOk());
+        ASSERT_TRUE(expected.GenerateMips(MipChainParams{}).IsOk());
+        ASSERT_TRUE(expected.Convert(format, PixelConversionParams{}).IsOk());
+
+        ASSERT_TRUE(texture.GenerateMips(MipChainParams{}).IsOk());
+        EXPECT_EQ(texture.GetInfo().format, format);
+        EXPECT_EQ(texture.GetInfo().mipLevels, 4u);
+        EXPECT_TRUE(std::ranges::equal(texture.GetData(), expected.GetData())) << static_cast<int>(format);
+    }
+}
+
+TEST_F(TextureMipsTest, RejectsNon2D) {
+    auto info = MakeTextureInfo(4, 4);
+    info.type = TextureType::TEXTURE_3D;
+    RawTexture texture(info);
+    EXPECT_TRUE(texture.GenerateMips(MipChainParams{}).IsError());
+}
+
+TEST_F(TextureMipsTest, Benchmark) {
+    RawTexture source(MakeTextureInfo(2048, 2048));
+    std::mt19937 rng(3);
+    for (auto& value : source.GetData()) {
+        value = static_cast<uint8_t>(rng());
+    }
+
+    for (auto filter : { MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos }) {
+        auto texture = source;
+        auto start = std::chrono::high_resolution_clock::now();
+        ASSERT_TRUE(texture.GenerateMips(MipChainParams{ .m_filter = filter }).IsOk());
+        auto elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "Mip chain for 2048x2048 RGBA8 with filter " << static_cast<int>(filter)
+            << ": " << elapsed << "ms" << std::endl;
+        EXPECT_EQ(texture.GetInfo().mipLevels, 12);
+    }
+}
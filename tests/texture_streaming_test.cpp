@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+#include "../texture_streaming.hpp"
+#include "texture_utils.hpp"
+#include <algorithm>
+
+using namespace okami;
+
+namespace {
+    // 256x256 with a 64 texel tail: levels 2 and coarser are always resident
+    TextureInfo const kInfo = MakeTextureInfo(256, 256, TextureFormat::RGBA8, GetFullMipCount(256, 256));
+    glm::vec2 const kFull(256.0f, 256.0f);
+
+    std::vector<TextureStreamRequest> Update(TextureStreamer& streamer) {
+        std::vector<TextureStreamRequest> requests;
+        streamer.Update(requests);
+        std::sort(requests.begin(), requests.end(), [](auto const& a, auto const& b) {
+            return a.m_texture < b.m_texture;
+        });
+        return requests;
+    }
+
+    void Complete(TextureStreamer& streamer, std::vector<TextureStreamRequest> const& requests) {
+        for (auto const& request : requests) {
+            streamer.OnStreamed(request.m_texture, true);
+        }
+    }
+}
+
+class TextureStreamingTest : public ::testing::Test {
+};
+
+TEST_F(TextureStreamingTest, MipFromProjectedSize) {
+    EXPECT_EQ(GetStreamingMip(kInfo, kFull), 0u);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(1024.0f)), 0u);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(128.0f)), 1u);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(100.0f)), 1u);
+    // The more minified axis decides
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(64.0f, 32.0f)), 3u);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(0.0f)), kInfo.mipLevels - 1);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(0.01f)), kInfo.mipLevels - 1);
+    EXPECT_EQ(GetStreamingMip(kInfo, kFull, 1.0f), 1u);
+    EXPECT_EQ(GetStreamingMip(kInfo, glm::vec2(128.0f), -1.0f), 0u);
+
+    EXPECT_EQ(GetStreamingTailMip(kInfo, 64), 2u);
+    EXPECT_EQ(GetStreamingTailMip(MakeTextureInfo(256, 16, TextureFormat::RGBA8, GetFullMipCount(256, 16)), 64), 2u);
+    EXPECT_EQ(GetStreamingTailMip(MakeTextureInfo(32, 32, TextureFormat::RGBA8, GetFullMipCount(32, 32)), 64), 0u);
+
+    EXPECT_EQ(GetStreamedBytes(kInfo, 0), GetTextureSize(kInfo));
+    EXPECT_EQ(GetStreamedBytes(kInfo, kInfo.mipLevels - 1), 4u);
+    EXPECT_EQ(GetStreamedBytes(kInfo, kInfo.mipLevels), 0u);
+}
+
+TEST_F(TextureStreamingTest, StartsWithTailAndLoadsWhatUsageAsks) {
+    TextureStreamer streamer;
+    streamer.Add(1, kInfo);
+    EXPECT_EQ(streamer.GetResidentMip(1), 2u);
+    EXPECT_EQ(streamer.GetResidentMip(2), std::nullopt);
+    EXPECT_EQ(streamer.GetStats().m_committedBytes, GetStreamedBytes(kInfo, 2));
+    EXPECT_TRUE(Update(streamer).empty());
+
+    // The largest of several draws counts
+    streamer.ReportUsage(1, glm::vec2(16.0f));
+    streamer.ReportUsage(1, glm::vec2(128.0f));
+    auto requests = Update(streamer);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0], (TextureStreamRequest{ 1, 1 }));
+    EXPECT_EQ(streamer.GetStats().m_pendingCount, 1u);
+    EXPECT_EQ(streamer.GetStats().m_committedBytes, GetStreamedBytes(kInfo, 1));
+
+    // Nothing more is asked of a texture until its request finishes
+    streamer.ReportUsage(1, kFull);
+    EXPECT_TRUE(Update(streamer).empty());
+    EXPECT_EQ(streamer.GetResidentMip(1), 2u);
+
+    Complete(streamer, requests);
+    EXPECT_EQ(streamer.GetResidentMip(1), 1u);
+    EXPECT_EQ(streamer.GetStats().m_pendingCount, 0u);
+    EXPECT_EQ(streamer.GetStats().m_loadedBytes, GetStreamedBytes(kInfo, 1) - GetStreamedBytes(kInfo, 2));
+
+    streamer.ReportUsage(1, kFull);
+    requests = Update(streamer);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0], (TextureStreamRequest{ 1, 0 }));
+    Complete(streamer, requests);
+
+    // Levels stay while the budget allows, used or not
+    for (int frame = 0; frame < 10; ++frame) {
+        EXPECT_TRUE(Update(streamer).empty());
+    }
+    EXPECT_EQ(streamer.GetResidentMip(1), 0u);
+    EXPECT_EQ(streamer.GetStats().m_committedBytes, GetTextureSize(kInfo));
+}
+
+TEST_F(TextureStreamingTest, LoadsStopAtTheBudget) {
+    TextureStreamingParams params;
+    params.m_budgetBytes = GetStreamedBytes(kInfo, 1) + 1000;
+    TextureStreamer streamer(params);
+    streamer.Add(1, kInfo);
+
+    streamer.ReportUsage(1, kFull);
+    auto requests = Update(streamer);
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0], (TextureStreamRequest{ 1, 1 }));
+    Complete(streamer, requests);
+    EXPECT_LE(streamer.GetStats().m_committedBytes, params.m_budgetBytes);
+
+    // Tails are kept even when they alone exceed the budget
+    params.m_budgetBytes = 1;
+    TextureStreamer tight(params);
+    tight.Add(1, kInfo);
+    tight.ReportUsage(1, kFull);
+    EXPECT_TRUE(Update(tight).empty());
+    EXPECT_EQ(tight.GetResidentMip(1), 2u);
+}
+
+TEST_F(TextureStreamingTest, EvictsLeastRecentlyUsedFirst) {
+    auto full = GetTextureSize(kInfo);
+    auto tail = GetStreamedBytes(kInfo, 2);
+
+    TextureStreamingParams params;
+    params.m_budgetBytes = 2 * full + tail;
+    TextureStreamer streamer(params);
+    streamer.Add(1, kInfo);
+    streamer.Add(2, kInfo);
+    streamer.Add(3, kInfo);
+
+    streamer.ReportUsage(1, kFull);
+    streamer.ReportUsage(2, kFull);
+    auto requests = Update(streamer);
+    EXPECT_EQ(requests, (std::vector<TextureStreamRequest>{ { 1, 0 }, { 2, 0 } }));
+    Complete(streamer, requests);
+
+    streamer.ReportUsage(2, kFull);
+    EXPECT_TRUE(Update(streamer).empty());
+
+    // 1 went unused longest, so it drops back to its tail to make room
+    streamer.ReportUsage(3, kFull);
+    requests = Update(streamer);
+    EXPECT_EQ(requests, (std::vector<TextureStreamRequest>{ { 1, 2 }, { 3, 0 } }));
+    EXPECT_EQ(streamer.GetStats().m_committedBytes, params.m_budgetBytes);
+    Complete(streamer, requests);
+    EXPECT_EQ(streamer.GetResidentMip(1), 2u);
+    EXPECT_EQ(streamer.GetResidentMip(2), 0u);
+    EXPECT_EQ(streamer.GetResidentMip(3), 0u);
+    EXPECT_EQ(streamer.GetStats().m_evictedBytes, full - tail);
+}
+
+TEST_F(TextureStreamingTest, UsedTexturesOnlyLoseLevelsTheyDoNotNeed) {
+    auto full = GetTextureSize(kInfo);
+
+    TextureStreamingParams params;
+    params.m_budgetBytes = full + GetStreamedBytes(kInfo, 1);
+    TextureStreamer streamer(params);
+    streamer.Add(1, kInfo);
+    streamer.Add(2, kInfo);
+
+    streamer.ReportUsage(1, kFull);
+    auto requests = Update(streamer);
+    Complete(streamer, requests);
+
+    // 1 now only needs level 1, so level 0 can go; 2 gets what is left
+    streamer.ReportUsage(1, glm::vec2(128.0f));
+    streamer.ReportUsage(2, kFull);
+    requests = Update(streamer);
+    EXPECT_EQ(requests, (std::vector<TextureStreamRequest>{ { 1, 1 }, { 2, 0 } }));
+    Complete(streamer, requests);
+
+    // With both needing everything, neither loses levels to the other
+    streamer.ReportUsage(1, kFull);
+    streamer.ReportUsage(2, kFull);
+    requests = Update(streamer);
+    EXPECT_TRUE(requests.empty());
+    EXPECT_LE(streamer.GetStats().m_committedBytes, params.m_budgetBytes);
+}
+
+TEST_F(TextureStreamingTest, MostNeededLoadsFirst) {
+    TextureStreamingParams params;
+    params.m_maxRequestsPerUpdate = 1;
+    TextureStreamer streamer(params);
+    streamer.Add(1, kInfo);
+    streamer.Add(2, kInfo);
+    streamer.Add(3, kInfo);
+
+    // Furthest from the wanted level first, then largest on screen
+    streamer.ReportUsage(1, glm::vec2(100.0f));
+    streamer.ReportUsage(2, glm::vec2(128.0f));
+    streamer.ReportUsage(3, kFull);
+    EXPECT_EQ(Update(streamer), (std::vector<TextureStreamRequest>{ { 3, 0 } }));
+
+    streamer.ReportUsage(1, glm::vec2(100.0f));
+    streamer.ReportUsage(2, glm::vec2(128.0f));
+    EXPECT_EQ(Update(streamer), (std::vector<TextureStreamRequest>{ { 2, 1 } }));
+
+    streamer.ReportUsage(1, glm::vec2(100.0f));
+    EXPECT_EQ(Update(streamer), (std::vector<TextureStreamRequest>{ { 1, 1 } }));
+}
+
+TEST_F(TextureStreamingTest, FailedRequestsAreRetried) {
+    TextureStreamer streamer;
+    streamer.Add(1, kInfo);
+
+    streamer.ReportUsage(1, kFull);
+    auto requests = Update(streamer);
+    ASSERT_EQ(requests.size(), 1u);
+    streamer.OnStreamed(1, false);
+    EXPECT_EQ(streamer.GetResidentMip(1), 2u);
+    EXPECT_EQ(streamer.GetStats().m_committedBytes, GetStreamedBytes(kInfo, 2));
+    EXPECT_EQ(streamer.GetStats().m_pendingCount, 0u);
+    EXPECT_EQ(streamer.GetStats().m_loadedBytes, 0u);
+
+    streamer.ReportUsage(1, kFull);
+    EXPECT_EQ(Update(streamer), requests);
+}
+
+TEST_F(TextureStreamingTest, RemoveDropsPendingRequests) {
+    TextureStreamer streamer;
+    streamer.Add(1, kInfo);
+    streamer.Add(2, MakeTextureInfo(64, 64, TextureFormat::RGBA8, GetFullMipCount(64, 64)), 0);
+    EXPECT_EQ(streamer.GetStats().m_textureCount, 2u);
+
+    streamer.ReportUsage(1, kFull);
+    auto requests = Update(streamer);
+    ASSERT_EQ(requests.size(), 1u);
+
+    streamer.Remove(1);
+    streamer.OnStreamed(1, true);
+    streamer.ReportUsage(1, kFull);
+    EXPECT_EQ(streamer.GetResidentMip(1), std::nullopt);
+
+    auto const& stats = streamer.GetStats();
+    EXPECT_EQ(stats.m_textureCount, 1u);
+    EXPECT_EQ(stats.m_pendingCount, 0u);
+    EXPECT_EQ(stats.m_committedBytes, GetTextureSize(MakeTextureInfo(64, 64, TextureFormat::RGBA8, GetFullMipCount(64, 64))));
+}
@@ -0,0 +1,33 @@
+#include "texture_utils.hpp"
+
+#include <random>
+
+using namespace okami;
+
+TextureInfo MakeTextureInfo(uint32_t width, uint32_t height, TextureFormat format, uint32_t mipLevels) {
+	TextureInfo info{};
+	info.type = TextureType::TEXTURE_2D;
+	info.format = format;
+	info.width = width;
+	info.height = height;
+	info.depth = 1;
+	info.arraySize = 1;
+	info.mipLevels = mipLevels;
+	return info;
+}
+
+RawTexture MakeNoiseTexture(uint32_t width, uint32_t height, uint32_t seed) {
+	RawTexture texture(MakeTextureInfo(width, height));
+	std::mt19937 rng(seed);
+	auto data = texture.GetData();
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			auto pixel = data.subspan((size_t(y) * width + x) * 4, 4);
+			pixel[0] = static_cast<uint8_t>(x + seed);
+			pixel[1] = static_cast<uint8_t>(y * 2);
+			pixel[2] = static_cast<uint8_t>(rng() & 0x0F);
+			pixel[3] = 255;
+		}
+	}
+	return texture;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../texture.hpp"
+
+// Texture factories shared by the texture tests
+
+// Single 2D texture without an array
+okami::TextureInfo MakeTextureInfo(
+	uint32_t width,
+	uint32_t height,
+	okami::TextureFormat format = okami::TextureFormat::RGBA8,
+	uint32_t mipLevels = 1);
+
+// RGBA8 smooth gradients with some seeded noise, so it compresses like a
+// sprite. The texel at the origin is (seed, 0, noise, 255).
+okami::RawTexture MakeNoiseTexture(uint32_t width, uint32_t height, uint32_t seed);
@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include "../vertex_quantization.hpp"
+#include "../okmesh.hpp"
+#include "../geometry.hpp"
+#include "mesh_utils.hpp"
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+
+using namespace okami;
+
+namespace {
+    std::vector<glm::vec3> RandomDirections(size_t count, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> dist;
+        std::vector<glm::vec3> directions;
+        while (directions.size() < count) {
+            glm::vec3 v(dist(rng), dist(rng), dist(rng));
+            if (glm::length(v) > 1e-3f) {
+                directions.push_back(glm::normalize(v));
+            }
+        }
+        // The octahedron's vertices and edges are where encodings fold over
+        directions.insert(directions.end(), {
+            { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+            { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+            glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f)), glm::normalize(glm::vec3(-1.0f, 0.0f, -1.0f)) });
+        return directions;
+    }
+
+    float AngleBetween(glm::vec3 const& a, glm::vec3 const& b) {
+        return std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b));
+    }
+
+    struct Vertices {
+        std::vector<glm::vec3> m_positions;
+        std::vector<glm::vec3> m_normals;
+        std::vector<glm::vec2> m_uvs;
+        std::vector<glm::vec4> m_tangents;
+    };
+
+    Vertices MakeVertices(size_t count) {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> position(-5.0f, 3.0f);
+        std::uniform_real_distribution<float> uv(-2.0f, 2.0f);
+        Vertices vertices;
+        vertices.m_normals = RandomDirections(count, 11);
+        vertices.m_normals.resize(count);
+        auto tangents = RandomDirections(count, 13);
+        for (size_t i = 0; i < count; ++i) {
+            vertices.m_positions.emplace_back(position(rng), position(rng), position(rng));
+            vertices.m_uvs.emplace_back(uv(rng), uv(rng));
+            vertices.m_tangents.emplace_back(tangents[i], (i % 3 == 0) ? -1.0f : 1.0f);
+        }
+        return vertices;
+    }
+
+    RawGeometry MakeGeometry(Vertices const& vertices) {
+        auto bytes = ToBytes(vertices.m_positions);
+        size_t normalOffset = bytes.size();
+        auto normals = ToBytes(vertices.m_normals);
+        bytes.insert(bytes.end(), normals.begin(), normals.end());
+        size_t uvOffset = bytes.size();
+        auto uvs = ToBytes(vertices.m_uvs);
+        bytes.insert(bytes.end(), uvs.begin(), uvs.end());
+        size_t tangentOffset = bytes.size();
+        auto tangents = ToBytes(vertices.m_tangents);
+        bytes.insert(bytes.end(), tangents.begin(), tangents.end());
+
+        GeometryMeshDesc mesh;
+        mesh.m_type = MeshType::Static;
+        mesh.m_vertexCount = vertices.m_positions.size();
+        mesh.m_attributes = {
+            Attribute{ AttributeType::Position, 0, 0 },
+            Attribute{ AttributeType::Normal, 0, normalOffset },
+            Attribute{ AttributeType::TexCoord, 0, uvOffset },
+            Attribute{ AttributeType::Tangent, 0, tangentOffset },
+        };
+        mesh.m_aabb = AABB{ glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest()) };
+        for (auto const& p : vertices.m_positions) {
+            mesh.m_aabb.m_min = glm::min(mesh.m_aabb.m_min, p);
+            mesh.m_aabb.m_max = glm::max(mesh.m_aabb.m_max, p);
+        }
+
+        std::vector<std::vector<uint8_t>> buffers;
+        buffers.push_back(std::move(bytes));
+        return RawGeometry(std::move(buffers), { mesh });
+    }
+
+    template <typename T>
+    std::vector<T> ReadAttribute(RawGeometry const& geometry, AttributeType type) {
+        auto view = geometry.TryAccess<T const>(type, 0);
+        if (!view) {
+            return {};
+        }
+        return std::vector<T>(view->begin(), view->end());
+    }
+}
+
+class VertexQuantizationTest : public ::testing::Test {
+};
+
+TEST_F(VertexQuantizationTest, Octahedral_StaysWithinAngleError) {
+    auto directions = RandomDirections(200000, 1);
+    std::vector<int16_t> encoded(directions.size() * 2);
+    EncodeOctahedral(directions, encoded);
+    std::vector<glm::vec3> decoded(directions.size());
+    DecodeOctahedral(encoded, decoded);
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < directions.size(); ++i) {
+        EXPECT_NEAR(glm::length(decoded[i]), 1.0f, 1e-5f);
+        maxError = std::max(maxError, AngleBetween(directions[i], decoded[i]));
+    }
+    EXPECT_LE(maxError, kOctahedralMaxAngleError);
+}
+
+TEST_F(VertexQuantizationTest, OctahedralTangents_KeepHandedness) {
+    auto directions = RandomDirections(1000, 2);
+    std::vector<glm::vec4> tangents;
+    for (size_t i = 0; i < directions.size(); ++i) {
+        tangents.emplace_back(directions[i], (i % 2) ? 1.0f : -1.0f);
+    }
+    std::vector<int16_t> encoded(tangents.size() * 4);
+    EncodeOctahedralTangents(tangents, encoded);
+    std::vector<glm::vec4> decoded(tangents.size());
+    DecodeOctahedralTangents(encoded, decoded);
+
+    for (size_t i = 0; i < tangents.size(); ++i) {
+        EXPECT_EQ(decoded[i].w, tangents[i].w);
+        EXPECT_LE(AngleBetween(glm::vec3(tangents[i]), glm::vec3(decoded[i])), kOctahedralMaxAngleError);
+    }
+}
+
+TEST_F(VertexQuantizationTest, Positions_StayWithinQuantizationError) {
+    auto vertices = MakeVertices(10001);
+    auto geometry = MakeGeometry(vertices);
+    auto const& bounds = geometry.GetMeshes()[0].m_aabb;
+
+    std::vector<uint16_t> quantized(vertices.m_positions.size() * 4);
+    QuantizePositions(vertices.m_positions, bounds, quantized);
+    std::vector<glm::vec3> decoded(vertices.m_positions.size());
+    DequantizePositions(quantized, bounds, decoded);
+
+    float maxError = GetPositionQuantizationError(bounds);
+    EXPECT_GT(maxError, 0.0f);
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        EXPECT_LE(glm::length(decoded[i] - vertices.m_positions[i]), maxError) << i;
+        EXPECT_EQ(quantized[i * 4 + 3], 0);
+    }
+}
+
+TEST_F(VertexQuantizationTest, Positions_FlatAxisDecodesToBounds) {
+    std::vector<glm::vec3> positions{ { 0.0f, 2.0f, 1.0f }, { 1.0f, 2.0f, 3.0f } };
+    AABB bounds{ glm::vec3(0.0f, 2.0f, 1.0f), glm::vec3(1.0f, 2.0f, 3.0f) };
+
+    std::vector<uint16_t> quantized(positions.size() * 4);
+    QuantizePositions(positions, bounds, quantized);
+    std::vector<glm::vec3> decoded(positions.size());
+    DequantizePositions(quantized, bounds, decoded);
+
+    EXPECT_EQ(decoded, positions);
+}
+
+TEST_F(VertexQuantizationTest, Pack_QuantizedHalvesVertexSize) {
+    auto vertices = MakeVertices(1000);
+    auto geometry = MakeGeometry(vertices);
+
+    auto floatPacked = geometry.Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(floatPacked.has_value()) << floatPacked.error();
+    auto quantized = geometry.Pack(GetDefaultMeshRequirements(AttributeEncoding::Quantized));
+    ASSERT_TRUE(quantized.has_value()) << quantized.error();
+
+    EXPECT_EQ(floatPacked->GetBuffers()[0].GetData().size(), 48 * vertices.m_positions.size());
+    EXPECT_EQ(quantized->GetBuffers()[0].GetData().size(), 24 * vertices.m_positions.size());
+    EXPECT_TRUE(quantized->IsPacked(GetDefaultMeshRequirements(AttributeEncoding::Quantized)));
+    EXPECT_FALSE(quantized->IsPacked(GetDefaultMeshRequirements()));
+
+    // Encoded data can't be viewed as floats
+    EXPECT_FALSE(quantized->TryAccess<glm::vec3 const>(AttributeType::Position, 0).has_value());
+
+    // Unpacking back to floats stays within each encoding's error
+    auto unpacked = quantized->Pack(GetDefaultMeshRequirements());
+    ASSERT_TRUE(unpacked.has_value()) << unpacked.error();
+    auto positions = ReadAttribute<glm::vec3>(*unpacked, AttributeType::Position);
+    auto normals = ReadAttribute<glm::vec3>(*unpacked, AttributeType::Normal);
+    auto uvs = ReadAttribute<glm::vec2>(*unpacked, AttributeType::TexCoord);
+    auto tangents = ReadAttribute<glm::vec4>(*unpacked, AttributeType::Tangent);
+    ASSERT_EQ(positions.size(), vertices.m_positions.size());
+
+    float positionError = GetPositionQuantizationError(geometry.GetMeshes()[0].m_aabb);
+    for (size_t i = 0; i < positions.size(); ++i) {
+        EXPECT_LE(glm::length(positions[i] - vertices.m_positions[i]), positionError);
+        EXPECT_LE(AngleBetween(normals[i], vertices.m_normals[i]), kOctahedralMaxAngleError);
+        EXPECT_LE(AngleBetween(glm::vec3(tangents[i]), glm::vec3(vertices.m_tangents[i])), kOctahedralMaxAngleError);
+        EXPECT_EQ(tangents[i].w, vertices.m_tangents[i].w);
+        for (int c = 0; c < 2; ++c) {
+            EXPECT_LE(std::abs(uvs[i][c] - vertices.m_uvs[i][c]), std::abs(vertices.m_uvs[i][c]) * kHalfMaxRelativeError + 1e-7f);
+        }
+    }
+}
+
+TEST_F(VertexQuantizationTest, OkMesh_KeepsEncodings) {
+    auto packed = MakeGeometry(MakeVertices(100)).Pack(GetDefaultMeshRequirements(AttributeEncoding::Quantized));
+    ASSERT_TRUE(packed.has_value()) << packed.error();
+
+    auto path = std::filesystem::temp_directory_path() / "okami_vertex_quantization_test.okmesh";
+    ASSERT_TRUE(SaveOkMesh(*packed, path).IsOk());
+    {
+        auto loaded = RawGeometry::Load(path);
+        ASSERT_TRUE(loaded.has_value()) << loaded.error();
+        EXPECT_TRUE(loaded->IsPacked(GetDefaultMeshRequirements(AttributeEncoding::Quantized)));
+
+        auto expected = packed->GetBuffers()[0].GetData();
+        auto actual = loaded->GetBuffers()[0].GetData();
+        ASSERT_EQ(expected.size(), actual.size());
+        EXPECT_EQ(std::memcmp(expected.data(), actual.data(), expected.size()), 0);
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
@@ -1,10 +1,13 @@
 #include <cmath>
 #include <algorithm>
 #include <fstream>
+#include <utility>
 
 #include <glog/logging.h>
 
 #include "texture.hpp"
+#include "image_writer.hpp"
+#include "oktex.hpp"
 #include "lodepng.h"
 
 namespace okami {
@@ -13,16 +16,28 @@ uint32_t GetChannelCount(TextureFormat format) {
     switch (format) {
         case TextureFormat::R8:
         case TextureFormat::R32F:
+        case TextureFormat::R16F:
             return 1;
         case TextureFormat::RG8:
         case TextureFormat::RG32F:
+        case TextureFormat::RG16F:
             return 2;
         case TextureFormat::RGB8:
         case TextureFormat::RGB32F:
+        case TextureFormat::R11G11B10F:
+        case TextureFormat::RGB9E5:
             return 3;
         case TextureFormat::RGBA8:
         case TextureFormat::RGBA32F:
+        case TextureFormat::RGBA16F:
+        case TextureFormat::BC1:
+        case TextureFormat::BC3:
+        case TextureFormat::BC7:
             return 4;
+        case TextureFormat::BC4:
+            return 1;
+        case TextureFormat::BC5:
+            return 2;
         default:
             return 0;
     }
@@ -46,13 +61,67 @@ uint32_t GetPixelStride(TextureFormat format) {
             return 12;
         case TextureFormat::RGBA32F:
             return 16;
+        case TextureFormat::R16F:
+            return 2;
+        case TextureFormat::RG16F:
+            return 4;
+        case TextureFormat::RGBA16F:
+            return 8;
+        case TextureFormat::R11G11B10F:
+        case TextureFormat::RGB9E5:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+bool IsFloatFormat(TextureFormat format) {
+    switch (format) {
+        case TextureFormat::R32F:
+        case TextureFormat::RG32F:
+        case TextureFormat::RGB32F:
+        case TextureFormat::RGBA32F:
+        case TextureFormat::R16F:
+        case TextureFormat::RG16F:
+        case TextureFormat::RGBA16F:
+        case TextureFormat::R11G11B10F:
+        case TextureFormat::RGB9E5:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool IsBlockCompressed(TextureFormat format) {
+    return GetBlockSize(format) != 0;
+}
+
+uint32_t GetBlockSize(TextureFormat format) {
+    switch (format) {
+        case TextureFormat::BC1:
+        case TextureFormat::BC4:
+            return 8;
+        case TextureFormat::BC3:
+        case TextureFormat::BC5:
+        case TextureFormat::BC7:
+            return 16;
         default:
             return 0;
     }
 }
 
+uint32_t GetRowPitch(TextureFormat format, uint32_t width) {
+    if (IsBlockCompressed(format)) {
+        return (width + 3) / 4 * GetBlockSize(format);
+    }
+    return width * GetPixelStride(format);
+}
+
+uint32_t GetRowCount(TextureFormat format, uint32_t height) {
+    return IsBlockCompressed(format) ? (height + 3) / 4 : height;
+}
+
 uint32_t GetTextureSize(const TextureInfo& info) {
-    uint32_t pixelStride = GetPixelStride(info.format);
     uint32_t totalSize = 0;
     
     // Calculate size for all mip levels
@@ -61,7 +130,7 @@ uint32_t GetTextureSize(const TextureInfo& info) {
         uint32_t mipHeight = std::max(1u, info.height >> mip);
         uint32_t mipDepth = std::max(1u, info.depth >> mip);
         
-        uint32_t mipSize = mipWidth * mipHeight * mipDepth * pixelStride;
+        uint32_t mipSize = GetRowPitch(info.format, mipWidth) * GetRowCount(info.format, mipHeight) * mipDepth;
         
         // For texture arrays, multiply by array size
         if (info.type == TextureType::TEXTURE_2D_ARRAY) {
@@ -74,6 +143,79 @@ uint32_t GetTextureSize(const TextureInfo& info) {
     return totalSize;
 }
 
+uint32_t GetMipOffset(const TextureInfo& info, uint32_t mip) {
+    TextureInfo levelsBefore = info;
+    levelsBefore.mipLevels = mip;
+    return GetTextureSize(levelsBefore);
+}
+
+uint32_t GetFullMipCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0) {
+        ++levels;
+    }
+    return levels;
+}
+
+RawTexture::RawTexture(RawTexture const& other) :
+    m_info(other.m_info), m_storage(other.m_data.begin(), other.m_data.end()), m_data(m_storage) {
+}
+
+RawTexture& RawTexture::operator=(RawTexture const& other) {
+    if (this != &other) {
+        m_info = other.m_info;
+        SetData(std::vector<uint8_t>(other.m_data.begin(), other.m_data.end()));
+    }
+    return *this;
+}
+
+RawTexture::RawTexture(RawTexture&& other) noexcept :
+    m_info(other.m_info),
+    m_storage(std::move(other.m_storage)),
+    m_data(std::exchange(other.m_data, {})),
+    m_owner(std::move(other.m_owner)) {
+}
+
+RawTexture& RawTexture::operator=(RawTexture&& other) noexcept {
+    if (this != &other) {
+        m_info = other.m_info;
+        m_storage = std::move(other.m_storage);
+        m_data = std::exchange(other.m_data, {});
+        m_owner = std::move(other.m_owner);
+    }
+    return *this;
+}
+
+void RawTexture::SetData(std::vector<uint8_t> data) {
+    m_storage = std::move(data);
+    m_data = m_storage;
+    m_owner.reset();
+}
+
+namespace {
+    // PNGs are always decoded to RGBA8, 2D texture, single mip level
+    TextureInfo MakePNGInfo(uint32_t width, uint32_t height) {
+        TextureInfo info = {};
+        info.type = TextureType::TEXTURE_2D;
+        info.format = TextureFormat::RGBA8;
+        info.width = width;
+        info.height = height;
+        info.depth = 1;
+        info.arraySize = 1;
+        info.mipLevels = 1;
+        return info;
+    }
+}
+
+Expected<RawTexture> RawTexture::Load(const std::filesystem::path& path) {
+    auto extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == kOkTexExtension) {
+        return LoadOkTex(path);
+    }
+    return FromPNG(path);
+}
+
 Expected<RawTexture> RawTexture::FromPNG(const std::filesystem::path& path) {
     // Check if file exists
     if (!std::filesystem::exists(path)) {
@@ -101,22 +243,12 @@ Expected<RawTexture> RawTexture::FromPNG(const std::filesystem::path& path) {
         return std::unexpected(Error("Invalid PNG data"));
     }
     
-    // Create texture info - PNG loaded as RGBA8, 2D texture, single mip level
-    TextureInfo info = {};
-    info.type = TextureType::TEXTURE_2D;
-    info.format = TextureFormat::RGBA8;
-    info.width = width;
-    info.height = height;
-    info.depth = 1;
-    info.arraySize = 1;
-    info.mipLevels = 1;
-    
     // Create texture
-    RawTexture texture(info);
+    RawTexture texture(MakePNGInfo(width, height));
     
     // Copy data to texture
     uint32_t dataSize = width * height * 4; // RGBA8 = 4 bytes per pixel
-    std::copy(imageData, imageData + dataSize, texture.m_data.begin());
+    std::copy(imageData, imageData + dataSize, texture.m_data.data());
     
     // Free lodepng allocated memory
     free(imageData);
@@ -124,125 +256,59 @@ Expected<RawTexture> RawTexture::FromPNG(const std::filesystem::path& path) {
     return texture;
 }
 
-Error RawTexture::SavePNG(const std::filesystem::path& path) const {
-    // PNG only supports certain formats, so we need to convert
-    std::vector<uint8_t> pngData;
-    unsigned width = m_info.width;
-    unsigned height = m_info.height;
-    LodePNGColorType colorType;
-    unsigned bitDepth = 8;
-
-    // Convert texture data to PNG-compatible format
-    switch (m_info.format) {
-        case TextureFormat::R8: {
-            colorType = LCT_GREY;
-            pngData = m_data; // Direct copy for single channel 8-bit
-            break;
-        }
-        case TextureFormat::RG8: {
-            colorType = LCT_GREY_ALPHA;
-            pngData = m_data; // Direct copy for two channel 8-bit
-            break;
-        }
-        case TextureFormat::RGB8: {
-            colorType = LCT_RGB;
-            pngData = m_data; // Direct copy for three channel 8-bit
-            break;
-        }
-        case TextureFormat::RGBA8: {
-            colorType = LCT_RGBA;
-            pngData = m_data; // Direct copy for four channel 8-bit
-            break;
-        }
-        case TextureFormat::R32F: {
-            // Convert R32F to R8
-            colorType = LCT_GREY;
-            pngData.resize(width * height);
-            const float* srcData = reinterpret_cast<const float*>(m_data.data());
-            for (size_t i = 0; i < width * height; ++i) {
-                // Clamp to [0,1] and convert to 8-bit
-                float val = std::clamp(srcData[i], 0.0f, 1.0f);
-                pngData[i] = static_cast<uint8_t>(val * 255.0f);
-            }
-            break;
-        }
-        case TextureFormat::RG32F: {
-            // Convert RG32F to RG8
-            colorType = LCT_GREY_ALPHA;
-            pngData.resize(width * height * 2);
-            const float* srcData = reinterpret_cast<const float*>(m_data.data());
-            for (size_t i = 0; i < width * height * 2; ++i) {
-                // Clamp to [0,1] and convert to 8-bit
-                float val = std::clamp(srcData[i], 0.0f, 1.0f);
-                pngData[i] = static_cast<uint8_t>(val * 255.0f);
-            }
-            break;
-        }
-        case TextureFormat::RGB32F: {
-            // Convert RGB32F to RGB8
-            colorType = LCT_RGB;
-            pngData.resize(width * height * 3);
-            const float* srcData = reinterpret_cast<const float*>(m_data.data());
-            for (size_t i = 0; i < width * height * 3; ++i) {
-                // Clamp to [0,1] and convert to 8-bit
-                float val = std::clamp(srcData[i], 0.0f, 1.0f);
-                pngData[i] = static_cast<uint8_t>(val * 255.0f);
-            }
-            break;
-        }
-        case TextureFormat::RGBA32F: {
-            // Convert RGBA32F to RGBA8
-            colorType = LCT_RGBA;
-            pngData.resize(width * height * 4);
-            const float* srcData = reinterpret_cast<const float*>(m_data.data());
-            for (size_t i = 0; i < width * height * 4; ++i) {
-                // Clamp to [0,1] and convert to 8-bit
-                float val = std::clamp(srcData[i], 0.0f, 1.0f);
-                pngData[i] = static_cast<uint8_t>(val * 255.0f);
-            }
-            break;
-        }
-        default:
-            return Error("Unsupported texture format for PNG export: " + std::to_string(static_cast<int>(m_info.format)));
+Expected<TextureInfo> RawTexture::ReadPNGInfo(std::span<uint8_t const> encoded) {
+    unsigned width = 0, height = 0;
+    lodepng::State state;
+    unsigned error = lodepng_inspect(&width, &height, &state, encoded.data(), encoded.size());
+    if (error) {
+        return std::unexpected(Error("Failed to read PNG header: " + std::string(lodepng_error_text(error))));
     }
+    return MakePNGInfo(width, height);
+}
 
-    // Only support 2D textures for PNG export
-    if (m_info.type != TextureType::TEXTURE_2D) {
-        return Error("PNG export only supports 2D textures");
-    }
+Expected<RawTexture> RawTexture::FromPNG(std::span<uint8_t const> encoded) {
+    unsigned char* imageData = nullptr;
+    unsigned width, height;
 
-    // Only export the first mip level
-    if (m_info.mipLevels > 1) {
-        LOG(WARNING) << "PNG export will only save the first mip level of texture";
+    unsigned error = lodepng_decode32(&imageData, &width, &height, encoded.data(), encoded.size());
+    if (error) {
+        return std::unexpected(Error("Failed to decode PNG: " + std::string(lodepng_error_text(error))));
     }
-
-    // Only export the first array slice
-    if (m_info.arraySize > 1) {
-        LOG(WARNING) << "PNG export will only save the first array slice of texture";
+    if (!imageData || width == 0 || height == 0) {
+        if (imageData) {
+            free(imageData);
+        }
+        return std::unexpected(Error("Invalid PNG data"));
     }
 
-    // Use lodepng to encode and save the PNG
-    std::vector<uint8_t> encodedPng;
-    unsigned error = lodepng::encode(encodedPng, pngData, width, height, colorType, bitDepth);
-    
-    if (error) {
-        return Error("LodePNG encoding error: " + std::string(lodepng_error_text(error)));
-    }
+    RawTexture texture(MakePNGInfo(width, height));
+    std::copy(imageData, imageData + width * height * 4, texture.m_data.data());
+    free(imageData);
 
-    // Save to file
-    std::ofstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        return Error("Failed to open file for writing: " + path.string());
-    }
+    return texture;
+}
 
-    file.write(reinterpret_cast<const char*>(encodedPng.data()), encodedPng.size());
-    file.close();
+std::span<uint8_t const> RawTexture::GetMipData(uint32_t mip) const {
+    auto begin = GetMipOffset(m_info, mip);
+    auto end = GetMipOffset(m_info, mip + 1);
+    return std::span(m_data).subspan(begin, end - begin);
+}
 
-    if (!file.good()) {
-        return Error("Failed to write PNG data to file: " + path.string());
-    }
+ContentHash RawTexture::ComputeContentHash() const {
+    ContentHasher hasher;
+    hasher.UpdateValue(m_info.type);
+    hasher.UpdateValue(m_info.format);
+    hasher.UpdateValue(m_info.width);
+    hasher.UpdateValue(m_info.height);
+    hasher.UpdateValue(m_info.depth);
+    hasher.UpdateValue(m_info.arraySize);
+    hasher.UpdateValue(m_info.mipLevels);
+    hasher.Update(GetData());
+    return hasher.Finish();
+}
 
-    return {};
+Error RawTexture::SavePNG(const std::filesystem::path& path) const {
+    return Save(path, ImageWriteParams{ .m_format = ImageFileFormat::PNG });
 }
 
 } // namespace okami
@@ -4,12 +4,19 @@
 #include <span>
 #include <filesystem>
 #include <any>
+#include <memory>
 
 #include "common.hpp"
+#include "hash.hpp"
 
 #include <glm/vec2.hpp>
 
 namespace okami {
+    struct MipChainParams;
+    struct BlockCompressionParams;
+    struct ImageWriteParams;
+    struct PixelConversionParams;
+
     enum class TextureType {
         TEXTURE_1D,
         TEXTURE_2D,
@@ -27,6 +34,20 @@ namespace okami {
         RG32F,
         RGB32F,
         RGBA32F,
+        // Block compressed, 4x4 texels per block
+        BC1, // RGB with 1 bit alpha, 8 bytes per block
+        BC3, // RGBA, 16 bytes per block
+        BC4, // R, 8 bytes per block
+        BC5, // RG, 16 bytes per block
+        BC7, // RGBA, 16 bytes per block
+        // Half floats, 2 bytes per channel
+        R16F,
+        RG16F,
+        RGBA16F,
+        // Unsigned floats packed in 32 bits: 11 bit red and green, 10 bit blue
+        R11G11B10F,
+        // Unsigned RGB with 9 bit mantissas and a shared 5 bit exponent
+        RGB9E5,
     };
 
     struct TextureInfo {
@@ -40,32 +61,100 @@ namespace okami {
     };
 
     uint32_t GetChannelCount(TextureFormat format);
+    // Bytes per texel, zero for block compressed formats
     uint32_t GetPixelStride(TextureFormat format);
+    // True for 32 bit, half and packed float formats
+    bool IsFloatFormat(TextureFormat format);
+    bool IsBlockCompressed(TextureFormat format);
+    // Bytes per 4x4 block, zero for uncompressed formats
+    uint32_t GetBlockSize(TextureFormat format);
+    // Bytes per row of texels, or per row of blocks when block compressed
+    uint32_t GetRowPitch(TextureFormat format, uint32_t width);
+    // Rows of texels, or rows of blocks when block compressed
+    uint32_t GetRowCount(TextureFormat format, uint32_t height);
     uint32_t GetTextureSize(TextureInfo const& info);
+    // Byte offset of a mip level; levels are stored largest first
+    uint32_t GetMipOffset(TextureInfo const& info, uint32_t mip);
+    // Levels of a full chain down to 1x1
+    uint32_t GetFullMipCount(uint32_t width, uint32_t height);
 
     class RawTexture {
     private:
         TextureInfo m_info;
-        std::vector<uint8_t> m_data; // Raw texture data
+        // Owned pixels; empty when the pixels live in external memory (such
+        // as a file mapping) kept alive by m_owner
+        std::vector<uint8_t> m_storage;
+        std::span<uint8_t> m_data;
+        std::shared_ptr<void> m_owner;
+
+        void SetData(std::vector<uint8_t> data);
+
     public:
 
         RawTexture(const TextureInfo& info)
-            : m_info(info), m_data(GetTextureSize(info), 0) {}
+            : m_info(info), m_storage(GetTextureSize(info), 0), m_data(m_storage) {}
+        // Uses data in place, without copying
+        inline RawTexture(const TextureInfo& info, std::span<uint8_t> data, std::shared_ptr<void> owner)
+            : m_info(info), m_data(data), m_owner(std::move(owner)) {}
+
+        // Copies always own their pixels
+        RawTexture(RawTexture const& other);
+        RawTexture& operator=(RawTexture const& other);
+        RawTexture(RawTexture&& other) noexcept;
+        RawTexture& operator=(RawTexture&& other) noexcept;
+
+        // True when the pixels live in external memory
+        inline bool IsExternal() const {
+            return m_owner != nullptr;
+        }
 
         inline const TextureInfo& GetInfo() const { 
             return m_info; 
         }
 
         inline const std::span<uint8_t const> GetData() const {
-            return std::span(m_data);
+            return m_data;
         }
 
         inline const std::span<uint8_t> GetData() {
-            return std::span(m_data);
+            return m_data;
         }
 
-        static Expected<RawTexture> FromPNG(const std::filesystem::path& path);
+        // Bytes of one mip level
+        std::span<uint8_t const> GetMipData(uint32_t mip) const;
 
+        // Replaces any mip levels below the base with a generated chain.
+        // Only 2D textures are supported.
+        Error GenerateMips(MipChainParams const& params);
+
+        // Encodes every mip level of a 2D R8, RG8 or RGBA8 texture to a
+        // block compressed format. BC1, BC3 and BC7 take RGBA, BC4 the first
+        // channel and BC5 the first two. Levels that are not a multiple of 4
+        // are padded by repeating their edge texels.
+        Error Compress(TextureFormat format, BlockCompressionParams const& params);
+        // Decodes a block compressed texture to RGBA8, or R8 for BC4 and RG8
+        // for BC5. BC7 is decoded for modes 1 and 6, the ones Compress writes.
+        Error Decompress();
+
+        // Converts every level to another uncompressed format, see
+        // ConvertPixels
+        Error Convert(TextureFormat format, PixelConversionParams const& params);
+
+        // Hash of the texture description and pixels
+        ContentHash ComputeContentHash() const;
+
+        // Maps a cooked .oktex file in place, or decodes any other file as PNG
+        static Expected<RawTexture> Load(const std::filesystem::path& path);
+        static Expected<RawTexture> FromPNG(const std::filesystem::path& path);
+        // Decodes a PNG already in memory
+        static Expected<RawTexture> FromPNG(std::span<uint8_t const> encoded);
+        // Size and format FromPNG would produce, read from the header alone
+        static Expected<TextureInfo> ReadPNGInfo(std::span<uint8_t const> encoded);
+
+        // Writes the base level of the first slice as an image file, in the
+        // format params or the extension ask for. 8 bit formats are written
+        // from the texels in place; float formats are converted to 8 bit.
+        Error Save(const std::filesystem::path& path, ImageWriteParams const& params) const;
         Error SavePNG(const std::filesystem::path& path) const;
     };
 
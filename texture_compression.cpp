@@ -0,0 +1,1085 @@
+#include "texture_compression.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    // Blocks per ParallelFor chunk
+    constexpr size_t kBlocksPerTask = 256;
+    constexpr uint16_t kAllTexels = 0xFFFF;
+
+    // Texels of a 4x4 block, row major, with each channel in its own plane
+    // so that four texels of a channel fill a register. Values are 0 to 255.
+    struct Block {
+        alignas(16) float m_channels[4][16];
+    };
+
+    struct Endpoints {
+        float m_low[4];
+        float m_high[4];
+    };
+
+    constexpr float kColorWeights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    constexpr float kRgbaWeights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    int GetRefinements(CompressionQuality quality) {
+        switch (quality) {
+        case CompressionQuality::Fast:
+            return 0;
+        case CompressionQuality::Normal:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    // Picks the palette entry nearest to each texel in mask, by squared
+    // distance with per channel weights, and returns the summed distance.
+    // Indices of texels outside the mask are left alone.
+    float SelectIndices(Block const& block, float const (*palette)[4], int paletteSize,
+        float const* weights, uint16_t mask, uint8_t* indices) {
+        float total = 0.0f;
+#ifdef OKAMI_SSE2
+        __m128 entries[16][4];
+        for (int p = 0; p < paletteSize; ++p) {
+            for (int c = 0; c < 4; ++c) {
+                entries[p][c] = _mm_set1_ps(palette[p][c]);
+            }
+        }
+        __m128 channelWeights[4];
+        for (int c = 0; c < 4; ++c) {
+            channelWeights[c] = _mm_set1_ps(weights[c]);
+        }
+
+        for (int group = 0; group < 4; ++group) {
+            auto groupMask = (mask >> (group * 4)) & 0xF;
+            if (groupMask == 0) {
+                continue;
+            }
+            __m128 texels[4];
+            for (int c = 0; c < 4; ++c) {
+                texels[c] = _mm_load_ps(&block.m_channels[c][group * 4]);
+            }
+
+            __m128 best = _mm_set1_ps(FLT_MAX);
+            __m128i bestIndex = _mm_setzero_si128();
+            for (int p = 0; p < paletteSize; ++p) {
+                __m128 distance = _mm_setzero_ps();
+                for (int c = 0; c < 4; ++c) {
+                    __m128 d = _mm_sub_ps(texels[c], entries[p][c]);
+                    distance = _mm_add_ps(distance, _mm_mul_ps(_mm_mul_ps(d, d), channelWeights[c]));
+                }
+                __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+                best = _mm_min_ps(distance, best);
+                bestIndex = _mm_or_si128(
+                    _mm_andnot_si128(closer, bestIndex),
+                    _mm_and_si128(closer, _mm_set1_epi32(p)));
+            }
+
+            alignas(16) float distances[4];
+            alignas(16) int32_t chosen[4];
+            _mm_store_ps(distances, best);
+            _mm_store_si128(reinterpret_cast<__m128i*>(chosen), bestIndex);
+            for (int i = 0; i < 4; ++i) {
+                if (groupMask & (1 << i)) {
+                    indices[group * 4 + i] = static_cast<uint8_t>(chosen[i]);
+                    total += distances[i];
+                }
+            }
+        }
+#else
+        for (int i = 0; i < 16; ++i) {
+            if (!(mask & (1 << i))) {
+                continue;
+            }
+            float best = FLT_MAX;
+            int bestIndex = 0;
+            for (int p = 0; p < paletteSize; ++p) {
+                float distance = 0.0f;
+                for (int c = 0; c < 4; ++c) {
+                    float d = block.m_channels[c][i] - palette[p][c];
+                    distance += d * d * weights[c];
+                }
+                if (distance < best) {
+                    best = distance;
+                    bestIndex = p;
+                }
+            }
+            indices[i] = static_cast<uint8_t>(bestIndex);
+            total += best;
+        }
+#endif
+        return total;
+    }
+
+    struct LineFit {
+        Endpoints m_endpoints;
+        // Squared distance of the texels from the line
+        float m_residual;
+    };
+
+    // Fits a line through the first channels of the texels in mask along
+    // their principal axis, found by power iteration on their scatter
+    // matrix, and spans the endpoints over the texels' projections
+    LineFit FitLine(Block const& block, uint16_t mask, int channels) {
+        LineFit fit{};
+        float count = 0.0f;
+        float mean[4] = {};
+        for (int i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) {
+                count += 1.0f;
+                for (int c = 0; c < channels; ++c) {
+                    mean[c] += block.m_channels[c][i];
+                }
+            }
+        }
+        if (count == 0.0f) {
+            return fit;
+        }
+        for (int c = 0; c < 4; ++c) {
+            mean[c] /= count;
+            fit.m_endpoints.m_low[c] = mean[c];
+            fit.m_endpoints.m_high[c] = mean[c];
+        }
+
+        float scatter[4][4] = {};
+        for (int i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) {
+                float d[4];
+                for (int c = 0; c < channels; ++c) {
+                    d[c] = block.m_channels[c][i] - mean[c];
+                }
+                for (int a = 0; a < channels; ++a) {
+                    for (int b = 0; b < channels; ++b) {
+                        scatter[a][b] += d[a] * d[b];
+                    }
+                }
+            }
+        }
+
+        int major = 0;
+        float trace = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            trace += scatter[c][c];
+            if (scatter[c][c] > scatter[major][major]) {
+                major = c;
+            }
+        }
+        if (scatter[major][major] <= 0.0f) {
+            return fit;
+        }
+
+        float axis[4] = {};
+        for (int c = 0; c < channels; ++c) {
+            axis[c] = scatter[c][major];
+        }
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[4] = {};
+            float length = 0.0f;
+            for (int a = 0; a < channels; ++a) {
+                for (int b = 0; b < channels; ++b) {
+                    next[a] += scatter[a][b] * axis[b];
+                }
+                length += next[a] * next[a];
+            }
+            if (length <= 0.0f) {
+                break;
+            }
+            length = 1.0f / std::sqrt(length);
+            for (int c = 0; c < channels; ++c) {
+                axis[c] = next[c] * length;
+            }
+        }
+
+        float tMin = FLT_MAX;
+        float tMax = -FLT_MAX;
+        float along = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) {
+                float t = 0.0f;
+                for (int c = 0; c < channels; ++c) {
+                    t += (block.m_channels[c][i] - mean[c]) * axis[c];
+                }
+                tMin = std::min(tMin, t);
+                tMax = std::max(tMax, t);
+                along += t * t;
+            }
+        }
+        fit.m_residual = std::max(trace - along, 0.0f);
+        for (int c = 0; c < channels; ++c) {
+            fit.m_endpoints.m_low[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+            fit.m_endpoints.m_high[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+        }
+        return fit;
+    }
+
+    // Least squares endpoints for fixed indices, where texel i sits at
+    // lerps[indices[i]] of the way from low to high. Fails when every
+    // texel uses the same weight.
+    bool FitEndpoints(Block const& block, uint16_t mask, int channels,
+        uint8_t const* indices, float const* lerps, Endpoints& result) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float xa[4] = {};
+        float xb[4] = {};
+        for (int i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) {
+                float t = lerps[indices[i]];
+                float s = 1.0f - t;
+                aa += s * s;
+                ab += s * t;
+                bb += t * t;
+                for (int c = 0; c < channels; ++c) {
+                    xa[c] += s * block.m_channels[c][i];
+                    xb[c] += t * block.m_channels[c][i];
+                }
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (determinant < 1e-6f) {
+            return false;
+        }
+        for (int c = 0; c < 4; ++c) {
+            if (c < channels) {
+                result.m_low[c] = std::clamp((bb * xa[c] - ab * xb[c]) / determinant, 0.0f, 255.0f);
+                result.m_high[c] = std::clamp((aa * xb[c] - ab * xa[c]) / determinant, 0.0f, 255.0f);
+            } else {
+                result.m_low[c] = 255.0f;
+                result.m_high[c] = 255.0f;
+            }
+        }
+        return true;
+    }
+
+    // BC1 color, also the second half of BC3
+
+    uint16_t To565(float const* rgb) {
+        auto quantize = [](float value, float levels) {
+            return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 255.0f) * levels / 255.0f));
+        };
+        return static_cast<uint16_t>(
+            (quantize(rgb[0], 31.0f) << 11) | (quantize(rgb[1], 63.0f) << 5) | quantize(rgb[2], 31.0f));
+    }
+
+    void From565(uint16_t color, float* rgb) {
+        int r = color >> 11;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+        rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+        rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    // Four colors, or three and transparent black
+    void MakeColorPalette(uint16_t c0, uint16_t c1, bool fourColors, float (*palette)[4]) {
+        From565(c0, palette[0]);
+        From565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            if (fourColors) {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            } else {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+                palette[3][c] = 0.0f;
+            }
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255.0f;
+        palette[3][3] = fourColors ? 255.0f : 0.0f;
+    }
+
+    struct ColorBlock {
+        uint16_t m_c0;
+        uint16_t m_c1;
+        uint8_t m_indices[16];
+        float m_error;
+    };
+
+    ColorBlock QuantizeColorBlock(Block const& block, Endpoints const& endpoints, uint16_t opaque, bool fourColors) {
+        ColorBlock result;
+        result.m_c0 = To565(endpoints.m_low);
+        result.m_c1 = To565(endpoints.m_high);
+        // Decoders pick the mode from the endpoint order
+        if (fourColors ? result.m_c0 < result.m_c1 : result.m_c0 > result.m_c1) {
+            std::swap(result.m_c0, result.m_c1);
+        }
+
+        float palette[4][4];
+        MakeColorPalette(result.m_c0, result.m_c1, fourColors, palette);
+        std::fill(std::begin(result.m_indices), std::end(result.m_indices), uint8_t(3));
+        result.m_error = SelectIndices(block, palette, fourColors ? 4 : 3, kColorWeights, opaque, result.m_indices);
+        return result;
+    }
+
+    void EncodeColorBlock(Block const& block, bool allowTransparent, BlockCompressionParams const& params, uint8_t* out) {
+        static constexpr float kFourLerps[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        static constexpr float kThreeLerps[3] = { 0.0f, 1.0f, 0.5f };
+
+        uint16_t opaque = kAllTexels;
+        if (allowTransparent) {
+            opaque = 0;
+            for (int i = 0; i < 16; ++i) {
+                if (block.m_channels[3][i] >= params.m_alphaThreshold) {
+                    opaque |= 1 << i;
+                }
+            }
+        }
+        bool fourColors = opaque == kAllTexels;
+
+        ColorBlock best{};
+        if (opaque == 0) {
+            std::fill(std::begin(best.m_indices), std::end(best.m_indices), uint8_t(3));
+        } else {
+            best = QuantizeColorBlock(block, FitLine(block, opaque, 3).m_endpoints, opaque, fourColors);
+            for (int i = 0; i < GetRefinements(params.m_quality) && best.m_error > 0.0f; ++i) {
+                Endpoints refined;
+                if (!FitEndpoints(block, opaque, 3, best.m_indices, fourColors ? kFourLerps : kThreeLerps, refined)) {
+                    break;
+                }
+                auto candidate = QuantizeColorBlock(block, refined, opaque, fourColors);
+                if (candidate.m_error >= best.m_error) {
+                    break;
+                }
+                best = candidate;
+            }
+        }
+
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; ++i) {
+            bits |= uint32_t(best.m_indices[i]) << (2 * i);
+        }
+        out[0] = static_cast<uint8_t>(best.m_c0);
+        out[1] = static_cast<uint8_t>(best.m_c0 >> 8);
+        out[2] = static_cast<uint8_t>(best.m_c1);
+        out[3] = static_cast<uint8_t>(best.m_c1 >> 8);
+        for (int i = 0; i < 4; ++i) {
+            out[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    void DecodeColorBlock(uint8_t const* in, bool bc1, uint8_t (*rgba)[4]) {
+        auto c0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+        auto c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+        float palette[4][4];
+        MakeColorPalette(c0, c1, !bc1 || c0 > c1, palette);
+        uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+        for (int i = 0; i < 16; ++i) {
+            auto const& entry = palette[(bits >> (2 * i)) & 3];
+            for (int c = 0; c < 4; ++c) {
+                rgba[i][c] = static_cast<uint8_t>(std::lround(entry[c]));
+            }
+        }
+    }
+
+    // BC4 single channel, also BC5 and the first half of BC3
+
+    // Eight values when a0 > a1, otherwise six and then 0 and 255
+    void MakeAlphaPalette(uint8_t a0, uint8_t a1, float* palette) {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1) {
+            for (int k = 1; k < 7; ++k) {
+                palette[k + 1] = ((7 - k) * a0 + k * a1) / 7.0f;
+            }
+        } else {
+            for (int k = 1; k < 5; ++k) {
+                palette[k + 1] = ((5 - k) * a0 + k * a1) / 5.0f;
+            }
+            palette[6] = 0.0f;
+            palette[7] = 255.0f;
+        }
+    }
+
+    struct AlphaBlock {
+        uint8_t m_a0;
+        uint8_t m_a1;
+        uint8_t m_indices[16];
+        float m_error;
+    };
+
+    AlphaBlock QuantizeAlphaBlock(float const* values, float low, float high, bool eightValues) {
+        auto a = static_cast<uint8_t>(std::lround(std::clamp(low, 0.0f, 255.0f)));
+        auto b = static_cast<uint8_t>(std::lround(std::clamp(high, 0.0f, 255.0f)));
+        AlphaBlock result;
+        result.m_a0 = eightValues ? std::max(a, b) : std::min(a, b);
+        result.m_a1 = eightValues ? std::min(a, b) : std::max(a, b);
+
+        float palette[8];
+        MakeAlphaPalette(result.m_a0, result.m_a1, palette);
+        result.m_error = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            float best = FLT_MAX;
+            for (int p = 0; p < 8; ++p) {
+                float d = values[i] - palette[p];
+                if (d * d < best) {
+                    best = d * d;
+                    result.m_indices[i] = static_cast<uint8_t>(p);
+                }
+            }
+            result.m_error += best;
+        }
+        return result;
+    }
+
+    // Least squares range for fixed indices, as FitEndpoints
+    bool FitRange(float const* values, uint16_t mask, uint8_t const* indices, float const* lerps, float& low, float& high) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, xa = 0.0f, xb = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            if (mask & (1 << i)) {
+                float t = lerps[indices[i]];
+                float s = 1.0f - t;
+                aa += s * s;
+                ab += s * t;
+                bb += t * t;
+                xa += s * values[i];
+                xb += t * values[i];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (determinant < 1e-6f) {
+            return false;
+        }
+        low = (bb * xa - ab * xb) / determinant;
+        high = (aa * xb - ab * xa) / determinant;
+        return true;
+    }
+
+    AlphaBlock RefineAlphaBlock(float const* values, AlphaBlock best, bool eightValues, int refinements) {
+        static constexpr float kEightLerps[8] = { 0.0f, 1.0f, 1 / 7.0f, 2 / 7.0f, 3 / 7.0f, 4 / 7.0f, 5 / 7.0f, 6 / 7.0f };
+        static constexpr float kSixLerps[6] = { 0.0f, 1.0f, 0.2f, 0.4f, 0.6f, 0.8f };
+
+        for (int i = 0; i < refinements && best.m_error > 0.0f; ++i) {
+            // The fixed 0 and 255 of six value blocks do not depend on the range
+            uint16_t mask = 0;
+            for (int t = 0; t < 16; ++t) {
+                if (eightValues || best.m_indices[t] < 6) {
+                    mask |= 1 << t;
+                }
+            }
+            float low, high;
+            if (!FitRange(values, mask, best.m_indices, eightValues ? kEightLerps : kSixLerps, low, high)) {
+                break;
+            }
+            auto candidate = QuantizeAlphaBlock(values, low, high, eightValues);
+            if (candidate.m_error >= best.m_error) {
+                break;
+            }
+            best = candidate;
+        }
+        return best;
+    }
+
+    void EncodeAlphaBlock(float const* values, CompressionQuality quality, uint8_t* out) {
+        auto [low, high] = std::minmax_element(values, values + 16);
+        auto best = RefineAlphaBlock(values, QuantizeAlphaBlock(values, *high, *low, true), true, GetRefinements(quality));
+
+        // Six value blocks win when a few texels sit at 0 or 255 apart from
+        // an otherwise narrow range
+        if (quality == CompressionQuality::High && best.m_error > 0.0f) {
+            float innerLow = 255.0f;
+            float innerHigh = 0.0f;
+            for (int i = 0; i < 16; ++i) {
+                if (values[i] >= 0.5f && values[i] < 254.5f) {
+                    innerLow = std::min(innerLow, values[i]);
+                    innerHigh = std::max(innerHigh, values[i]);
+                }
+            }
+            if (innerLow <= innerHigh) {
+                auto candidate = RefineAlphaBlock(values,
+                    QuantizeAlphaBlock(values, innerLow, innerHigh, false), false, GetRefinements(quality));
+                if (candidate.m_error < best.m_error) {
+                    best = candidate;
+                }
+            }
+        }
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 16; ++i) {
+            bits |= uint64_t(best.m_indices[i]) << (3 * i);
+        }
+        out[0] = best.m_a0;
+        out[1] = best.m_a1;
+        for (int i = 0; i < 6; ++i) {
+            out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    // Writes one channel of a decoded block, stride bytes apart
+    void DecodeAlphaBlock(uint8_t const* in, uint8_t* values, size_t stride) {
+        float palette[8];
+        MakeAlphaPalette(in[0], in[1], palette);
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; ++i) {
+            bits |= uint64_t(in[2 + i]) << (8 * i);
+        }
+        for (int i = 0; i < 16; ++i) {
+            values[i * stride] = static_cast<uint8_t>(std::lround(palette[(bits >> (3 * i)) & 7]));
+        }
+    }
+
+    // BC7, modes 1 and 6
+
+    // Subset 1 texels of the 64 two subset partitions, bit i for texel i
+    constexpr uint16_t kPartitions2[64] = {
+        0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+        0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+        0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+        0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+        0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+        0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+        0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+        0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+    };
+
+    // Texel whose index drops its top bit in subset 1; subset 0 uses texel 0
+    constexpr uint8_t kAnchors2[64] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+        15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+        6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+    };
+
+    constexpr int kWeights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    constexpr int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    // Partitions, ranked by how well lines fit their subsets, encoded in full
+    constexpr int kPartitionCandidates = 4;
+
+    class BitWriter {
+    private:
+        uint8_t* m_out;
+        int m_position = 0;
+
+    public:
+        // out must start zeroed
+        explicit BitWriter(uint8_t* out) : m_out(out) {}
+
+        void Write(uint32_t value, int count) {
+            for (int i = 0; i < count; ++i, ++m_position) {
+                if ((value >> i) & 1) {
+                    m_out[m_position >> 3] |= static_cast<uint8_t>(1 << (m_position & 7));
+                }
+            }
+        }
+    };
+
+    class BitReader {
+    private:
+        uint8_t const* m_in;
+        int m_position = 0;
+
+    public:
+        explicit BitReader(uint8_t const* in) : m_in(in) {}
+
+        uint32_t Read(int count) {
+            uint32_t value = 0;
+            for (int i = 0; i < count; ++i, ++m_position) {
+                value |= uint32_t((m_in[m_position >> 3] >> (m_position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    // An endpoint channel of bits plus a p-bit, expanded to 8 bits
+    int ExpandEndpoint(int quantized, int pbit, int bits) {
+        int value = (quantized << 1) | pbit;
+        int total = bits + 1;
+        return total == 8 ? value : (value << (8 - total)) | (value >> (2 * total - 8));
+    }
+
+    // Nearest quantized value for one channel with the p-bit fixed
+    int QuantizeEndpoint(float value, int pbit, int bits, float& error) {
+        int maximum = (1 << bits) - 1;
+        float scaled = (value * ((2 << bits) - 1) / 255.0f - pbit) / 2.0f;
+        int floor = std::clamp(static_cast<int>(scaled), 0, maximum);
+        error = FLT_MAX;
+        int best = floor;
+        for (int q = floor; q <= std::min(floor + 1, maximum); ++q) {
+            float d = value - ExpandEndpoint(q, pbit, bits);
+            if (d * d < error) {
+                error = d * d;
+                best = q;
+            }
+        }
+        return best;
+    }
+
+    void Interpolate(int const* e0, int const* e1, int const* weights, int count, float (*palette)[4]) {
+        for (int k = 0; k < count; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                palette[k][c] = static_cast<float>(((64 - weights[k]) * e0[c] + weights[k] * e1[c] + 32) >> 6);
+            }
+        }
+    }
+
+    template <int count>
+    std::array<float, count> MakeLerps(int const* weights) {
+        std::array<float, count> lerps;
+        for (int k = 0; k < count; ++k) {
+            lerps[k] = weights[k] / 64.0f;
+        }
+        return lerps;
+    }
+
+    // Mode 6: one subset, RGBA endpoints of 7 bits and a p-bit each,
+    // 4 bit indices
+    struct Mode6Block {
+        int m_endpoints[2][4];
+        int m_pbits[2];
+        uint8_t m_indices[16];
+        float m_error;
+    };
+
+    Mode6Block QuantizeMode6(Block const& block, Endpoints const& endpoints) {
+        Mode6Block result;
+        float const* sources[2] = { endpoints.m_low, endpoints.m_high };
+        int expanded[2][4];
+        for (int e = 0; e < 2; ++e) {
+            float bestError = FLT_MAX;
+            for (int pbit = 0; pbit < 2; ++pbit) {
+                int quantized[4];
+                float error = 0.0f;
+                for (int c = 0; c < 4; ++c) {
+                    float channelError;
+                    quantized[c] = QuantizeEndpoint(sources[e][c], pbit, 7, channelError);
+                    error += channelError;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    result.m_pbits[e] = pbit;
+                    std::copy(quantized, quantized + 4, result.m_endpoints[e]);
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                expanded[e][c] = ExpandEndpoint(result.m_endpoints[e][c], result.m_pbits[e], 7);
+            }
+        }
+
+        float palette[16][4];
+        Interpolate(expanded[0], expanded[1], kWeights4, 16, palette);
+        result.m_error = SelectIndices(block, palette, 16, kRgbaWeights, kAllTexels, result.m_indices);
+        return result;
+    }
+
+    void WriteMode6(Mode6Block block, uint8_t* out) {
+        // The anchor index is stored without its top bit
+        if (block.m_indices[0] >= 8) {
+            std::swap(block.m_endpoints[0], block.m_endpoints[1]);
+            std::swap(block.m_pbits[0], block.m_pbits[1]);
+            for (auto& index : block.m_indices) {
+                index = static_cast<uint8_t>(15 - index);
+            }
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer(out);
+        writer.Write(1 << 6, 7);
+        for (int c = 0; c < 4; ++c) {
+            writer.Write(block.m_endpoints[0][c], 7);
+            writer.Write(block.m_endpoints[1][c], 7);
+        }
+        writer.Write(block.m_pbits[0], 1);
+        writer.Write(block.m_pbits[1], 1);
+        for (int i = 0; i < 16; ++i) {
+            writer.Write(block.m_indices[i], i == 0 ? 3 : 4);
+        }
+    }
+
+    // Mode 1: two subsets, RGB endpoints of 6 bits with a p-bit shared per
+    // subset, 3 bit indices; alpha is 255
+    struct Mode1Block {
+        int m_partition;
+        int m_endpoints[2][2][3];
+        int m_pbits[2];
+        uint8_t m_indices[16];
+        float m_error;
+    };
+
+    float QuantizeMode1Subset(Block const& block, uint16_t mask, Endpoints const& endpoints,
+        int (*quantized)[3], int& sharedPbit, uint8_t* indices) {
+        float const* sources[2] = { endpoints.m_low, endpoints.m_high };
+        float bestError = FLT_MAX;
+        for (int pbit = 0; pbit < 2; ++pbit) {
+            int candidate[2][3];
+            float error = 0.0f;
+            for (int e = 0; e < 2; ++e) {
+                for (int c = 0; c < 3; ++c) {
+                    float channelError;
+                    candidate[e][c] = QuantizeEndpoint(sources[e][c], pbit, 6, channelError);
+                    error += channelError;
+                }
+            }
+            if (error < bestError) {
+                bestError = error;
+                sharedPbit = pbit;
+                std::memcpy(quantized, candidate, sizeof(candidate));
+            }
+        }
+
+        int expanded[2][4];
+        for (int e = 0; e < 2; ++e) {
+            for (int c = 0; c < 3; ++c) {
+                expanded[e][c] = ExpandEndpoint(quantized[e][c], sharedPbit, 6);
+            }
+            expanded[e][3] = 255;
+        }
+        float palette[8][4];
+        Interpolate(expanded[0], expanded[1], kWeights3, 8, palette);
+        return SelectIndices(block, palette, 8, kColorWeights, mask, indices);
+    }
+
+    Mode1Block EncodeMode1(Block const& block, int partition, int refinements) {
+        static auto const kLerps = MakeLerps<8>(kWeights3);
+
+        Mode1Block result;
+        result.m_partition = partition;
+        result.m_error = 0.0f;
+        uint16_t masks[2] = { static_cast<uint16_t>(~kPartitions2[partition]), kPartitions2[partition] };
+        for (int s = 0; s < 2; ++s) {
+            auto& endpoints = result.m_endpoints[s];
+            float error = QuantizeMode1Subset(block, masks[s], FitLine(block, masks[s], 3).m_endpoints,
+                endpoints, result.m_pbits[s], result.m_indices);
+            for (int i = 0; i < refinements && error > 0.0f; ++i) {
+                Endpoints refined;
+                if (!FitEndpoints(block, masks[s], 3, result.m_indices, kLerps.data(), refined)) {
+                    break;
+                }
+                int candidate[2][3];
+                int pbit;
+                uint8_t indices[16];
+                std::memcpy(indices, result.m_indices, sizeof(indices));
+                float candidateError = QuantizeMode1Subset(block, masks[s], refined, candidate, pbit, indices);
+                if (candidateError >= error) {
+                    break;
+                }
+                error = candidateError;
+                std::memcpy(endpoints, candidate, sizeof(candidate));
+                result.m_pbits[s] = pbit;
+                std::memcpy(result.m_indices, indices, sizeof(indices));
+            }
+            result.m_error += error;
+        }
+        return result;
+    }
+
+    void WriteMode1(Mode1Block block, uint8_t* out) {
+        uint16_t subset1 = kPartitions2[block.m_partition];
+        int anchors[2] = { 0, kAnchors2[block.m_partition] };
+        for (int s = 0; s < 2; ++s) {
+            if (block.m_indices[anchors[s]] < 4) {
+                continue;
+            }
+            std::swap(block.m_endpoints[s][0], block.m_endpoints[s][1]);
+            for (int i = 0; i < 16; ++i) {
+                if (((subset1 >> i) & 1) == s) {
+                    block.m_indices[i] = static_cast<uint8_t>(7 - block.m_indices[i]);
+                }
+            }
+        }
+
+        std::memset(out, 0, 16);
+        BitWriter writer(out);
+        writer.Write(1 << 1, 2);
+        writer.Write(block.m_partition, 6);
+        for (int c = 0; c < 3; ++c) {
+            for (int s = 0; s < 2; ++s) {
+                writer.Write(block.m_endpoints[s][0][c], 6);
+                writer.Write(block.m_endpoints[s][1][c], 6);
+            }
+        }
+        writer.Write(block.m_pbits[0], 1);
+        writer.Write(block.m_pbits[1], 1);
+        for (int i = 0; i < 16; ++i) {
+            writer.Write(block.m_indices[i], i == anchors[0] || i == anchors[1] ? 2 : 3);
+        }
+    }
+
+    void EncodeBC7Block(Block const& block, CompressionQuality quality, uint8_t* out) {
+        static auto const kLerps = MakeLerps<16>(kWeights4);
+
+        auto best = QuantizeMode6(block, FitLine(block, kAllTexels, 4).m_endpoints);
+        for (int i = 0; i < GetRefinements(quality) && best.m_error > 0.0f; ++i) {
+            Endpoints refined;
+            if (!FitEndpoints(block, kAllTexels, 4, best.m_indices, kLerps.data(), refined)) {
+                break;
+            }
+            auto candidate = QuantizeMode6(block, refined);
+            if (candidate.m_error >= best.m_error) {
+                break;
+            }
+            best = candidate;
+        }
+
+        bool opaque = std::all_of(block.m_channels[3], block.m_channels[3] + 16,
+            [](float alpha) { return alpha == 255.0f; });
+        if (quality != CompressionQuality::High || !opaque || best.m_error == 0.0f) {
+            WriteMode6(best, out);
+            return;
+        }
+
+        // Rank partitions by how far their texels lie from one line per
+        // subset, then encode the most promising ones
+        std::pair<float, int> ranked[64];
+        for (int p = 0; p < 64; ++p) {
+            ranked[p] = {
+                FitLine(block, static_cast<uint16_t>(~kPartitions2[p]), 3).m_residual +
+                    FitLine(block, kPartitions2[p], 3).m_residual,
+                p };
+        }
+        std::partial_sort(ranked, ranked + kPartitionCandidates, ranked + 64);
+
+        Mode1Block bestMode1{};
+        bestMode1.m_error = FLT_MAX;
+        for (int i = 0; i < kPartitionCandidates; ++i) {
+            auto candidate = EncodeMode1(block, ranked[i].second, GetRefinements(quality));
+            if (candidate.m_error < bestMode1.m_error) {
+                bestMode1 = candidate;
+            }
+        }
+
+        if (bestMode1.m_error < best.m_error) {
+            WriteMode1(bestMode1, out);
+        } else {
+            WriteMode6(best, out);
+        }
+    }
+
+    bool DecodeBC7Block(uint8_t const* in, uint8_t (*rgba)[4]) {
+        BitReader reader(in);
+        if (in[0] & 1) {
+            return false;
+        }
+        if (reader.Read(2) == 2) {
+            int partition = static_cast<int>(reader.Read(6));
+            int quantized[2][2][3];
+            for (int c = 0; c < 3; ++c) {
+                for (int s = 0; s < 2; ++s) {
+                    quantized[s][0][c] = static_cast<int>(reader.Read(6));
+                    quantized[s][1][c] = static_cast<int>(reader.Read(6));
+                }
+            }
+            int pbits[2] = { static_cast<int>(reader.Read(1)), static_cast<int>(reader.Read(1)) };
+
+            float palettes[2][8][4];
+            for (int s = 0; s < 2; ++s) {
+                int expanded[2][4];
+                for (int e = 0; e < 2; ++e) {
+                    for (int c = 0; c < 3; ++c) {
+                        expanded[e][c] = ExpandEndpoint(quantized[s][e][c], pbits[s], 6);
+                    }
+                    expanded[e][3] = 255;
+                }
+                Interpolate(expanded[0], expanded[1], kWeights3, 8, palettes[s]);
+            }
+            for (int i = 0; i < 16; ++i) {
+                bool anchor = i == 0 || i == kAnchors2[partition];
+                auto index = reader.Read(anchor ? 2 : 3);
+                auto const& entry = palettes[(kPartitions2[partition] >> i) & 1][index];
+                for (int c = 0; c < 4; ++c) {
+                    rgba[i][c] = static_cast<uint8_t>(entry[c]);
+                }
+            }
+            return true;
+        }
+
+        // Modes 2 to 5 and 7 are not written by the encoder
+        reader = BitReader(in);
+        if (reader.Read(7) != 1 << 6) {
+            return false;
+        }
+        int quantized[2][4];
+        for (int c = 0; c < 4; ++c) {
+            quantized[0][c] = static_cast<int>(reader.Read(7));
+            quantized[1][c] = static_cast<int>(reader.Read(7));
+        }
+        int pbits[2] = { static_cast<int>(reader.Read(1)), static_cast<int>(reader.Read(1)) };
+        int expanded[2][4];
+        for (int e = 0; e < 2; ++e) {
+            for (int c = 0; c < 4; ++c) {
+                expanded[e][c] = ExpandEndpoint(quantized[e][c], pbits[e], 7);
+            }
+        }
+        float palette[16][4];
+        Interpolate(expanded[0], expanded[1], kWeights4, 16, palette);
+        for (int i = 0; i < 16; ++i) {
+            auto const& entry = palette[reader.Read(i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; ++c) {
+                rgba[i][c] = static_cast<uint8_t>(entry[c]);
+            }
+        }
+        return true;
+    }
+
+    // Reads the block at (blockX, blockY) of an 8 bit level, repeating edge
+    // texels past its right and bottom. Missing channels are 0, alpha 255.
+    Block LoadBlock(uint8_t const* texels, uint32_t width, uint32_t height, uint32_t stride,
+        uint32_t blockX, uint32_t blockY) {
+        Block block;
+        for (uint32_t y = 0; y < 4; ++y) {
+            auto sourceY = std::min(blockY * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; ++x) {
+                auto sourceX = std::min(blockX * 4 + x, width - 1);
+                auto const* texel = texels + (size_t(sourceY) * width + sourceX) * stride;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    block.m_channels[c][y * 4 + x] = c < stride ? texel[c] : (c == 3 ? 255.0f : 0.0f);
+                }
+            }
+        }
+        return block;
+    }
+
+    void EncodeBlock(TextureFormat format, Block const& block, BlockCompressionParams const& params, uint8_t* out) {
+        switch (format) {
+        case TextureFormat::BC1:
+            EncodeColorBlock(block, true, params, out);
+            break;
+        case TextureFormat::BC3:
+            EncodeAlphaBlock(block.m_channels[3], params.m_quality, out);
+            EncodeColorBlock(block, false, params, out + 8);
+            break;
+        case TextureFormat::BC4:
+            EncodeAlphaBlock(block.m_channels[0], params.m_quality, out);
+            break;
+        case TextureFormat::BC5:
+            EncodeAlphaBlock(block.m_channels[0], params.m_quality, out);
+            EncodeAlphaBlock(block.m_channels[1], params.m_quality, out + 8);
+            break;
+        default:
+            EncodeBC7Block(block, params.m_quality, out);
+            break;
+        }
+    }
+
+    // Decodes to RGBA; BC4 and BC5 only fill their channels
+    bool DecodeBlock(TextureFormat format, uint8_t const* in, uint8_t (*rgba)[4]) {
+        switch (format) {
+        case TextureFormat::BC1:
+            DecodeColorBlock(in, true, rgba);
+            return true;
+        case TextureFormat::BC3:
+            DecodeColorBlock(in + 8, false, rgba);
+            DecodeAlphaBlock(in, &rgba[0][3], 4);
+            return true;
+        case TextureFormat::BC4:
+            DecodeAlphaBlock(in, &rgba[0][0], 4);
+            return true;
+        case TextureFormat::BC5:
+            DecodeAlphaBlock(in, &rgba[0][0], 4);
+            DecodeAlphaBlock(in + 8, &rgba[0][1], 4);
+            return true;
+        default:
+            return DecodeBC7Block(in, rgba);
+        }
+    }
+
+    size_t GetBlockRowGrain(uint32_t blocksPerRow) {
+        return std::max<size_t>(1, kBlocksPerTask / blocksPerRow);
+    }
+}
+
+Error RawTexture::Compress(TextureFormat format, BlockCompressionParams const& params) {
+    if (!IsBlockCompressed(format)) {
+        return Error("Compression target is not a block compressed format");
+    }
+    if (m_info.type != TextureType::TEXTURE_2D) {
+        return Error("Block compression only supports 2D textures");
+    }
+    switch (m_info.format) {
+    case TextureFormat::R8:
+    case TextureFormat::RG8:
+    case TextureFormat::RGB8:
+    case TextureFormat::RGBA8:
+        break;
+    default:
+        return Error("Block compression needs an 8 bit texture");
+    }
+
+    TextureInfo info = m_info;
+    info.format = format;
+    std::vector<uint8_t> data(GetTextureSize(info));
+    auto stride = GetPixelStride(m_info.format);
+    auto blockSize = GetBlockSize(format);
+
+    for (uint32_t mip = 0; mip < info.mipLevels; ++mip) {
+        auto width = std::max(1u, info.width >> mip);
+        auto height = std::max(1u, info.height >> mip);
+        auto blocksX = (width + 3) / 4;
+        auto const* source = GetMipData(mip).data();
+        auto* destination = data.data() + GetMipOffset(info, mip);
+
+        ParallelFor(GetRowCount(format, height), GetBlockRowGrain(blocksX), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                for (uint32_t x = 0; x < blocksX; ++x) {
+                    auto block = LoadBlock(source, width, height, stride, x, static_cast<uint32_t>(y));
+                    EncodeBlock(format, block, params, destination + (y * blocksX + x) * blockSize);
+                }
+            }
+        });
+    }
+
+    m_info = info;
+    SetData(std::move(data));
+    return {};
+}
+
+Error RawTexture::Decompress() {
+    if (!IsBlockCompressed(m_info.format)) {
+        return Error("Texture is not block compressed");
+    }
+
+    TextureInfo info = m_info;
+    switch (m_info.format) {
+    case TextureFormat::BC4:
+        info.format = TextureFormat::R8;
+        break;
+    case TextureFormat::BC5:
+        info.format = TextureFormat::RG8;
+        break;
+    default:
+        info.format = TextureFormat::RGBA8;
+        break;
+    }
+    std::vector<uint8_t> data(GetTextureSize(info));
+    auto stride = GetPixelStride(info.format);
+    auto blockSize = GetBlockSize(m_info.format);
+    std::atomic<bool> unsupported = false;
+
+    for (uint32_t mip = 0; mip < info.mipLevels; ++mip) {
+        auto width = std::max(1u, info.width >> mip);
+        auto height = std::max(1u, info.height >> mip);
+        auto blocksX = (width + 3) / 4;
+        auto const* source = GetMipData(mip).data();
+        auto* destination = data.data() + GetMipOffset(info, mip);
+
+        ParallelFor(GetRowCount(m_info.format, height), GetBlockRowGrain(blocksX), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                for (uint32_t x = 0; x < blocksX; ++x) {
+                    uint8_t rgba[16][4] = {};
+                    if (!DecodeBlock(m_info.format, source + (y * blocksX + x) * blockSize, rgba)) {
+                        unsupported.store(true);
+                    }
+                    for (uint32_t ty = 0; ty < 4 && y * 4 + ty < height; ++ty) {
+                        for (uint32_t tx = 0; tx < 4 && x * 4 + tx < width; ++tx) {
+                            auto* texel = destination + ((y * 4 + ty) * width + x * 4 + tx) * stride;
+                            std::memcpy(texel, rgba[ty * 4 + tx], stride);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    if (unsupported.load()) {
+        return Error("BC7 block uses a mode other than 1 or 6, which is not supported");
+    }
+    m_info = info;
+    SetData(std::move(data));
+    return {};
+}
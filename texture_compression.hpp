@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common.hpp"
+#include "texture.hpp"
+
+namespace okami {
+	enum class CompressionQuality {
+		// Principal axis endpoints as fitted, BC7 mode 6 only; for
+		// compressing at load time
+		Fast,
+		// Endpoints refined by least squares
+		Normal,
+		// More refinement, BC4 six value blocks and BC7 two subset
+		// partitions; for cooking assets offline
+		High,
+	};
+
+	struct BlockCompressionParams {
+		CompressionQuality m_quality = CompressionQuality::Normal;
+		// BC1 texels with less alpha than this become transparent black
+		uint8_t m_alphaThreshold = 128;
+	};
+}
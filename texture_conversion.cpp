@@ -0,0 +1,445 @@
+#include "texture_conversion.hpp"
+#include "float_packing.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    // Texels converted through floats at a time
+    constexpr size_t kBlockTexels = 64;
+    constexpr size_t kTexelsPerTask = 16 * 1024;
+    constexpr size_t kSrgbEncodeCells = 4096;
+
+    enum class ComponentType {
+        Unorm8,
+        Float,
+        Half,
+        // Three channels packed in 32 bits
+        R11G11B10F,
+        RGB9E5,
+    };
+
+    struct FormatLayout {
+        uint32_t m_channels;
+        ComponentType m_type;
+    };
+
+    FormatLayout GetLayout(TextureFormat format) {
+        auto channels = GetChannelCount(format);
+        switch (format) {
+            case TextureFormat::R16F:
+            case TextureFormat::RG16F:
+            case TextureFormat::RGBA16F:
+                return FormatLayout{ channels, ComponentType::Half };
+            case TextureFormat::R11G11B10F:
+                return FormatLayout{ channels, ComponentType::R11G11B10F };
+            case TextureFormat::RGB9E5:
+                return FormatLayout{ channels, ComponentType::RGB9E5 };
+            default:
+                return FormatLayout{ channels, IsFloatFormat(format) ? ComponentType::Float : ComponentType::Unorm8 };
+        }
+    }
+
+    // Half and packed texels to 32 bit floats, channels as stored
+    void UnpackFloats(uint8_t const* source, FormatLayout layout, size_t count, float* values) {
+        if (layout.m_type == ComponentType::Half) {
+            auto valueCount = count * layout.m_channels;
+            DecodeHalf(std::span(reinterpret_cast<uint16_t const*>(source), valueCount), std::span(values, valueCount));
+            return;
+        }
+        bool sharedExponent = layout.m_type == ComponentType::RGB9E5;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t packed;
+            std::memcpy(&packed, source + i * sizeof(packed), sizeof(packed));
+            auto color = sharedExponent ? UnpackRGB9E5(packed) : UnpackR11G11B10F(packed);
+            for (int c = 0; c < 3; ++c) {
+                values[i * 3 + c] = color[c];
+            }
+        }
+    }
+
+    void PackFloats(float const* values, FormatLayout layout, size_t count, uint8_t* destination) {
+        if (layout.m_type == ComponentType::Half) {
+            auto valueCount = count * layout.m_channels;
+            EncodeHalf(std::span(values, valueCount), std::span(reinterpret_cast<uint16_t*>(destination), valueCount));
+            return;
+        }
+        bool sharedExponent = layout.m_type == ComponentType::RGB9E5;
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec3 color(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+            uint32_t packed = sharedExponent ? PackRGB9E5(color) : PackR11G11B10F(color);
+            std::memcpy(destination + i * sizeof(packed), &packed, sizeof(packed));
+        }
+    }
+
+    double SrgbToLinear(double c) {
+        return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    double LinearToSrgb(double c) {
+        return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+    }
+
+    struct SrgbTables {
+        // 8 bit code to float, through the sRGB curve and directly
+        std::array<float, 256> m_decode;
+        std::array<float, 256> m_unorm;
+        // Linear value from which each 8 bit code is the nearest encoding,
+        // with a sentinel past the last code
+        std::array<float, 257> m_thresholds;
+        // Code of the start of each of kSrgbEncodeCells equal cells of [0, 1].
+        // Cells are narrow enough that no more than one threshold falls
+        // inside any of them.
+        std::array<uint8_t, kSrgbEncodeCells + 1> m_cellCodes;
+
+        SrgbTables() {
+            for (int i = 0; i < 256; ++i) {
+                m_decode[i] = static_cast<float>(SrgbToLinear(i / 255.0));
+                m_unorm[i] = i / 255.0f;
+            }
+            m_thresholds[0] = -std::numeric_limits<float>::infinity();
+            for (int code = 1; code < 256; ++code) {
+                m_thresholds[code] = static_cast<float>(SrgbToLinear((code - 0.5) / 255.0));
+            }
+            m_thresholds[256] = std::numeric_limits<float>::infinity();
+
+            uint8_t code = 0;
+            for (size_t cell = 0; cell <= kSrgbEncodeCells; ++cell) {
+                auto value = static_cast<float>(cell) / kSrgbEncodeCells;
+                while (value >= m_thresholds[code + 1]) {
+                    ++code;
+                }
+                m_cellCodes[cell] = code;
+            }
+        }
+
+        // Exact against the thresholds: the cell gives the code at its start
+        // and at most one step remains
+        inline uint8_t Encode(float linear) const {
+            linear = linear > 0.0f ? (linear < 1.0f ? linear : 1.0f) : 0.0f;
+            auto code = m_cellCodes[static_cast<size_t>(linear * kSrgbEncodeCells)];
+            return static_cast<uint8_t>(code + (linear >= m_thresholds[code + 1]));
+        }
+
+        static SrgbTables const& Get() {
+            static SrgbTables const tables;
+            return tables;
+        }
+    };
+
+    inline uint8_t ToUnorm8(float value) {
+        value = value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+        return static_cast<uint8_t>(value * 255.0f + 0.5f);
+    }
+
+    // Reads 8 bit texels through a table per channel
+    template <uint32_t Channels>
+    void DecodeUnorm8(uint8_t const* source, std::array<float const*, 4> const& tables, size_t count, float (*texels)[4]) {
+        for (size_t i = 0; i < count; ++i) {
+            auto const* texel = source + i * Channels;
+            for (uint32_t c = 0; c < 4; ++c) {
+                texels[i][c] = c < Channels ? tables[c][texel[c]] : (c == 3 ? 1.0f : 0.0f);
+            }
+        }
+    }
+
+    // Reads texels into linear RGBA floats, alpha as stored
+    void DecodeBlock(uint8_t const* source, FormatLayout layout, ColorEncoding encoding, size_t count, float (*texels)[4]) {
+        auto channels = layout.m_channels;
+        bool srgb = encoding == ColorEncoding::Srgb;
+
+        if (layout.m_type == ComponentType::Unorm8) {
+            size_t i = 0;
+#ifdef OKAMI_SSE2
+            if (channels == 4 && !srgb) {
+                auto const zero = _mm_setzero_si128();
+                auto const scale = _mm_set1_ps(1.0f / 255.0f);
+                for (; i + 4 <= count; i += 4) {
+                    auto bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i * 4));
+                    auto low = _mm_unpacklo_epi8(bytes, zero);
+                    auto high = _mm_unpackhi_epi8(bytes, zero);
+                    _mm_storeu_ps(texels[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+                    _mm_storeu_ps(texels[i + 1], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+                    _mm_storeu_ps(texels[i + 2], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+                    _mm_storeu_ps(texels[i + 3], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+                }
+            }
+#endif
+            auto const& tables = SrgbTables::Get();
+            auto const* color = srgb ? tables.m_decode.data() : tables.m_unorm.data();
+            std::array<float const*, 4> channelTables = { color, color, color, tables.m_unorm.data() };
+            source += i * channels;
+            switch (channels) {
+                case 1: DecodeUnorm8<1>(source, channelTables, count - i, texels + i); break;
+                case 2: DecodeUnorm8<2>(source, channelTables, count - i, texels + i); break;
+                case 3: DecodeUnorm8<3>(source, channelTables, count - i, texels + i); break;
+                case 4: DecodeUnorm8<4>(source, channelTables, count - i, texels + i); break;
+            }
+            return;
+        }
+
+        auto const* values = reinterpret_cast<float const*>(source);
+        alignas(16) float unpacked[kBlockTexels * 4];
+        if (layout.m_type != ComponentType::Float) {
+            UnpackFloats(source, layout, count, unpacked);
+            values = unpacked;
+        }
+        if (channels == 4 && !srgb) {
+            std::memcpy(texels, values, count * sizeof(float) * 4);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                if (c >= channels) {
+                    texels[i][c] = c == 3 ? 1.0f : 0.0f;
+                } else {
+                    auto value = values[i * channels + c];
+                    texels[i][c] = srgb && c < 3 ? static_cast<float>(SrgbToLinear(value)) : value;
+                }
+            }
+        }
+    }
+
+    void ConvertAlpha(AlphaMode from, AlphaMode to, size_t count, float (*texels)[4]) {
+        if (from == to) {
+            return;
+        }
+        bool premultiply = to == AlphaMode::Premultiplied;
+        size_t i = 0;
+#ifdef OKAMI_SSE2
+        auto const one = _mm_set1_ps(1.0f);
+        auto const zero = _mm_setzero_ps();
+        auto const colorMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        for (; i < count; ++i) {
+            auto texel = _mm_loadu_ps(texels[i]);
+            auto alpha = _mm_shuffle_ps(texel, texel, _MM_SHUFFLE(3, 3, 3, 3));
+            auto scale = alpha;
+            if (!premultiply) {
+                // Fully transparent texels keep their (zero) color
+                scale = _mm_and_ps(_mm_div_ps(one, alpha), _mm_cmpgt_ps(alpha, zero));
+            }
+            scale = _mm_or_ps(_mm_and_ps(colorMask, scale), _mm_andnot_ps(colorMask, one));
+            _mm_storeu_ps(texels[i], _mm_mul_ps(texel, scale));
+        }
+#endif
+        for (; i < count; ++i) {
+            auto alpha = texels[i][3];
+            auto scale = premultiply ? alpha : (alpha > 0.0f ? 1.0f / alpha : 0.0f);
+            for (int c = 0; c < 3; ++c) {
+                texels[i][c] *= scale;
+            }
+        }
+    }
+
+    template <uint32_t Channels>
+    void EncodeUnorm8(float const (*texels)[4], size_t count, bool srgb, uint8_t* destination) {
+        auto const& tables = SrgbTables::Get();
+        for (size_t i = 0; i < count; ++i) {
+            auto* texel = destination + i * Channels;
+            for (uint32_t c = 0; c < Channels; ++c) {
+                texel[c] = srgb && c < 3 ? tables.Encode(texels[i][c]) : ToUnorm8(texels[i][c]);
+            }
+        }
+    }
+
+    // Writes linear RGBA floats with the alpha mode already applied
+    void EncodeBlock(float const (*texels)[4], size_t count, FormatLayout layout, ColorEncoding encoding, uint8_t* destination) {
+        auto channels = layout.m_channels;
+        bool srgb = encoding == ColorEncoding::Srgb;
+
+        if (layout.m_type == ComponentType::Unorm8) {
+            size_t i = 0;
+#ifdef OKAMI_SSE2
+            if (channels == 4 && !srgb) {
+                auto const zero = _mm_setzero_ps();
+                auto const one = _mm_set1_ps(1.0f);
+                auto const scale = _mm_set1_ps(255.0f);
+                auto const half = _mm_set1_ps(0.5f);
+                auto toInt = [&](float const* texel) {
+                    // max returns its second operand for NaN, clamping it to 0
+                    auto value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(texel), zero), one);
+                    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half));
+                };
+                for (; i + 4 <= count; i += 4) {
+                    auto low = _mm_packs_epi32(toInt(texels[i]), toInt(texels[i + 1]));
+                    auto high = _mm_packs_epi32(toInt(texels[i + 2]), toInt(texels[i + 3]));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 4), _mm_packus_epi16(low, high));
+                }
+            }
+#endif
+            destination += i * channels;
+            switch (channels) {
+                case 1: EncodeUnorm8<1>(texels + i, count - i, srgb, destination); break;
+                case 2: EncodeUnorm8<2>(texels + i, count - i, srgb, destination); break;
+                case 3: EncodeUnorm8<3>(texels + i, count - i, srgb, destination); break;
+                case 4: EncodeUnorm8<4>(texels + i, count - i, srgb, destination); break;
+            }
+            return;
+        }
+
+        // Other float formats are packed from 32 bit floats afterwards
+        alignas(16) float unpacked[kBlockTexels * 4];
+        bool packs = layout.m_type != ComponentType::Float;
+        auto* values = packs ? unpacked : reinterpret_cast<float*>(destination);
+        if (channels == 4 && !srgb) {
+            std::memcpy(values, texels, count * sizeof(float) * 4);
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    auto value = texels[i][c];
+                    values[i * channels + c] = srgb && c < 3 ? static_cast<float>(LinearToSrgb(std::max(value, 0.0f))) : value;
+                }
+            }
+        }
+        if (packs) {
+            PackFloats(values, layout, count, destination);
+        }
+    }
+
+    // Moves channels without changing their values. Missing color reads as
+    // 0 and missing alpha as all ones.
+    template <typename T, uint32_t SourceChannels, uint32_t DestinationChannels>
+    void ReorderChannels(T const* source, T* destination, size_t count, T opaque) {
+        for (size_t i = 0; i < count; ++i) {
+            for (uint32_t c = 0; c < DestinationChannels; ++c) {
+                destination[i * DestinationChannels + c] = c < SourceChannels ? source[i * SourceChannels + c] : (c == 3 ? opaque : T(0));
+            }
+        }
+    }
+
+    template <typename T, uint32_t SourceChannels>
+    void ReorderChannels(T const* source, uint32_t destinationChannels, T* destination, size_t count, T opaque) {
+        switch (destinationChannels) {
+            case 1: ReorderChannels<T, SourceChannels, 1>(source, destination, count, opaque); break;
+            case 2: ReorderChannels<T, SourceChannels, 2>(source, destination, count, opaque); break;
+            case 3: ReorderChannels<T, SourceChannels, 3>(source, destination, count, opaque); break;
+            case 4: ReorderChannels<T, SourceChannels, 4>(source, destination, count, opaque); break;
+        }
+    }
+
+    template <typename T>
+    void ReorderChannels(T const* source, uint32_t sourceChannels, T* destination, uint32_t destinationChannels, size_t count, T opaque) {
+        switch (sourceChannels) {
+            case 1: ReorderChannels<T, 1>(source, destinationChannels, destination, count, opaque); break;
+            case 2: ReorderChannels<T, 2>(source, destinationChannels, destination, count, opaque); break;
+            case 3: ReorderChannels<T, 3>(source, destinationChannels, destination, count, opaque); break;
+            case 4: ReorderChannels<T, 4>(source, destinationChannels, destination, count, opaque); break;
+        }
+    }
+
+    // RGB8 to RGBA8 a word at a time: each texel's three bytes, and the
+    // first byte of the next, are loaded together and that byte replaced
+    void ExpandRgb8(uint8_t const* source, uint8_t* destination, size_t count) {
+        size_t i = 0;
+        for (; i + 1 < count; ++i) {
+            uint32_t texel;
+            std::memcpy(&texel, source + i * 3, 4);
+            if constexpr (std::endian::native == std::endian::little) {
+                texel |= 0xFF000000u;
+            } else {
+                texel |= 0xFFu;
+            }
+            std::memcpy(destination + i * 4, &texel, 4);
+        }
+        for (; i < count; ++i) {
+            std::memcpy(destination + i * 4, source + i * 3, 3);
+            destination[i * 4 + 3] = 0xFF;
+        }
+    }
+}
+
+void okami::ConvertPixels(
+    std::span<uint8_t const> source,
+    TextureFormat sourceFormat,
+    std::span<uint8_t> destination,
+    TextureFormat destinationFormat,
+    PixelConversionParams const& params) {
+    OKAMI_ASSERT(!IsBlockCompressed(sourceFormat) && !IsBlockCompressed(destinationFormat),
+        "Block compressed formats cannot be converted texel by texel");
+    auto sourceStride = GetPixelStride(sourceFormat);
+    auto destinationStride = GetPixelStride(destinationFormat);
+    auto count = source.size() / sourceStride;
+    OKAMI_ASSERT(destination.size() >= count * destinationStride, "Pixel conversion destination is too small");
+
+    auto sourceLayout = GetLayout(sourceFormat);
+    auto destinationLayout = GetLayout(destinationFormat);
+    auto const& from = params.m_source;
+    auto const& to = params.m_destination;
+
+    bool sameEncoding = from.m_color == to.m_color && from.m_alpha == to.m_alpha;
+    // Same encoding and component type: only channels move. Packed types
+    // have a single format each, so they are copied.
+    if (sameEncoding && sourceLayout.m_type == destinationLayout.m_type) {
+        if (sourceFormat == destinationFormat) {
+            std::memcpy(destination.data(), source.data(), count * sourceStride);
+        } else if (sourceFormat == TextureFormat::RGB8 && destinationFormat == TextureFormat::RGBA8) {
+            ExpandRgb8(source.data(), destination.data(), count);
+        } else if (sourceLayout.m_type == ComponentType::Float) {
+            ReorderChannels(reinterpret_cast<float const*>(source.data()), sourceLayout.m_channels,
+                reinterpret_cast<float*>(destination.data()), destinationLayout.m_channels, count, 1.0f);
+        } else if (sourceLayout.m_type == ComponentType::Half) {
+            ReorderChannels(reinterpret_cast<uint16_t const*>(source.data()), sourceLayout.m_channels,
+                reinterpret_cast<uint16_t*>(destination.data()), destinationLayout.m_channels, count, uint16_t(0x3C00));
+        } else {
+            ReorderChannels(source.data(), sourceLayout.m_channels,
+                destination.data(), destinationLayout.m_channels, count, uint8_t(0xFF));
+        }
+        return;
+    }
+
+    // Same channels between 32 and 16 bit floats: one batch conversion
+    if (sameEncoding && sourceLayout.m_channels == destinationLayout.m_channels) {
+        auto valueCount = count * sourceLayout.m_channels;
+        if (sourceLayout.m_type == ComponentType::Float && destinationLayout.m_type == ComponentType::Half) {
+            EncodeHalf(std::span(reinterpret_cast<float const*>(source.data()), valueCount),
+                std::span(reinterpret_cast<uint16_t*>(destination.data()), valueCount));
+            return;
+        }
+        if (sourceLayout.m_type == ComponentType::Half && destinationLayout.m_type == ComponentType::Float) {
+            DecodeHalf(std::span(reinterpret_cast<uint16_t const*>(source.data()), valueCount),
+                std::span(reinterpret_cast<float*>(destination.data()), valueCount));
+            return;
+        }
+    }
+
+    alignas(16) float texels[kBlockTexels][4];
+    for (size_t begin = 0; begin < count; begin += kBlockTexels) {
+        auto blockCount = std::min(kBlockTexels, count - begin);
+        DecodeBlock(source.data() + begin * sourceStride, sourceLayout, from.m_color, blockCount, texels);
+        ConvertAlpha(from.m_alpha, to.m_alpha, blockCount, texels);
+        EncodeBlock(texels, blockCount, destinationLayout, to.m_color, destination.data() + begin * destinationStride);
+    }
+}
+
+Error RawTexture::Convert(TextureFormat format, PixelConversionParams const& params) {
+    if (IsBlockCompressed(m_info.format) || IsBlockCompressed(format)) {
+        return Error("Block compressed textures must be compressed or decompressed, not converted");
+    }
+
+    auto info = m_info;
+    info.format = format;
+    std::vector<uint8_t> converted(GetTextureSize(info));
+    auto sourceStride = GetPixelStride(m_info.format);
+    auto destinationStride = GetPixelStride(format);
+
+    // Every level and slice is converted alike, so the whole buffer is one run
+    ParallelFor(m_data.size() / sourceStride, kTexelsPerTask, [&](size_t begin, size_t end) {
+        ConvertPixels(
+            std::span<uint8_t const>(m_data).subspan(begin * sourceStride, (end - begin) * sourceStride), m_info.format,
+            std::span(converted).subspan(begin * destinationStride, (end - begin) * destinationStride), format,
+            params);
+    });
+
+    m_info = info;
+    SetData(std::move(converted));
+    return {};
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "common.hpp"
+#include "texture.hpp"
+
+namespace okami {
+	enum class ColorEncoding {
+		Linear,
+		// sRGB transfer function on the color channels; alpha is always
+		// linear
+		Srgb,
+	};
+
+	enum class AlphaMode {
+		Straight,
+		// Color multiplied by alpha in linear space, before any sRGB encoding
+		Premultiplied,
+	};
+
+	struct PixelEncoding {
+		ColorEncoding m_color = ColorEncoding::Linear;
+		AlphaMode m_alpha = AlphaMode::Straight;
+	};
+
+	struct PixelConversionParams {
+		PixelEncoding m_source;
+		PixelEncoding m_destination;
+	};
+
+	// Converts the texels in source between two uncompressed formats.
+	// Channels the source lacks read as 0, or 1 for alpha; channels the
+	// destination lacks are dropped. Values stored as 8 bit are clamped to
+	// [0, 1] and rounded to nearest; half and packed floats are rounded as
+	// in float_packing.hpp. Destination must hold as many texels.
+	void ConvertPixels(
+		std::span<uint8_t const> source,
+		TextureFormat sourceFormat,
+		std::span<uint8_t> destination,
+		TextureFormat destinationFormat,
+		PixelConversionParams const& params = {});
+}
@@ -0,0 +1,266 @@
+#include "texture_decoder.hpp"
+#include "mapped_file.hpp"
+#include "oktex.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+using namespace okami;
+
+namespace okami {
+    struct TextureDecoderState : public std::enable_shared_from_this<TextureDecoderState> {
+        struct Pending {
+            std::filesystem::path m_path;
+            TextureDecoder::Callback m_callback;
+            void const* m_key;
+            std::function<bool()> m_isWanted;
+        };
+
+        struct Waiting {
+            std::shared_ptr<MappedFile> m_file;
+            size_t m_bytes;
+            bool m_cooked;
+            TextureDecoder::Callback m_callback;
+        };
+
+        ThreadPool* m_pool = nullptr;
+        size_t m_maxInFlightBytes = 0;
+        std::optional<MipChainParams> m_mips;
+        std::optional<TextureFormat> m_compressTo;
+        BlockCompressionParams m_compression;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_idle;
+        size_t m_inFlightBytes = 0;
+        size_t m_peakInFlightBytes = 0;
+        // Submitted textures not yet handed to their callback
+        size_t m_outstanding = 0;
+        bool m_stopping = false;
+        // Submitted, waiting for a pool thread to read them
+        LoadQueue<Pending, void const*> m_reads;
+        // Read and inspected, waiting for budget
+        LoadQueue<Waiting, void const*> m_waiting;
+
+        bool Fits(size_t bytes) const {
+            return m_inFlightBytes == 0 || m_inFlightBytes + bytes <= m_maxInFlightBytes;
+        }
+
+        void Reserve(size_t bytes) {
+            m_inFlightBytes += bytes;
+            m_peakInFlightBytes = std::max(m_peakInFlightBytes, m_inFlightBytes);
+        }
+
+        void Finish() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_outstanding == 0) {
+                m_idle.notify_all();
+            }
+        }
+
+        static std::optional<void const*> GetKey(void const* key) {
+            return key ? std::optional(key) : std::nullopt;
+        }
+
+        // Each submission queues one of these, which reads whatever is most
+        // urgent by the time a thread is free
+        void ReadNext() {
+            std::optional<Pending> next;
+            std::vector<Pending> cancelled;
+            LoadPriority priority = LoadPriority::Visible;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                next = m_reads.Pop([](Pending const& pending) {
+                    return !pending.m_isWanted || pending.m_isWanted();
+                }, cancelled, &priority);
+            }
+
+            for (auto& pending : cancelled) {
+                pending.m_callback(std::unexpected(LoadCancelledError()), TextureDecodeLease());
+                Finish();
+            }
+            if (next) {
+                Read(next->m_path, next->m_callback, priority, next->m_key);
+            }
+        }
+
+        void Read(std::filesystem::path const& path, TextureDecoder::Callback const& callback, LoadPriority priority, void const* key) {
+            auto file = MappedFile::Open(path);
+            if (!file) {
+                callback(std::unexpected(file.error()), TextureDecodeLease());
+                Finish();
+                return;
+            }
+
+            // The header gives the decoded size before anything is inflated.
+            // Cooked textures are already final and are used in place.
+            auto extension = path.extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            bool cooked = extension == kOkTexExtension;
+            auto info = cooked ? ReadOkTexInfo((*file)->GetData()) : RawTexture::ReadPNGInfo((*file)->GetData());
+            if (!info) {
+                callback(std::unexpected(info.error()), TextureDecodeLease());
+                Finish();
+                return;
+            }
+            if (m_mips && !cooked) {
+                info->mipLevels = GetFullMipCount(info->width, info->height);
+                if (m_mips->m_maxLevels > 0) {
+                    info->mipLevels = std::min(info->mipLevels, m_mips->m_maxLevels);
+                }
+            }
+            auto bytes = static_cast<size_t>(GetTextureSize(*info));
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stopping) {
+                    if (--m_outstanding == 0) {
+                        m_idle.notify_all();
+                    }
+                    return;
+                }
+                // Only decodes at least as urgent are ahead of this one
+                if (m_waiting.GetSizeUpTo(priority) > 0 || !Fits(bytes)) {
+                    m_waiting.Push(Waiting{ std::move(file.value()), bytes, cooked, callback }, priority, GetKey(key));
+                    return;
+                }
+                Reserve(bytes);
+            }
+            Decode(std::move(file.value()), bytes, cooked, callback);
+        }
+
+        void Decode(std::shared_ptr<MappedFile> file, size_t bytes, bool cooked, TextureDecoder::Callback const& callback) {
+            if (cooked) {
+                callback(LoadOkTex(std::move(file)), TextureDecodeLease(shared_from_this(), bytes));
+                Finish();
+                return;
+            }
+
+            auto texture = RawTexture::FromPNG(file->GetData());
+            file.reset();
+            if (texture && m_mips) {
+                if (auto error = texture->GenerateMips(*m_mips); error.IsError()) {
+                    texture = std::unexpected(error);
+                }
+            }
+            // Compressing shrinks the pixels, but the lease keeps the
+            // decoded size reserved
+            if (texture && m_compressTo &&
+                texture->GetInfo().width % 4 == 0 && texture->GetInfo().height % 4 == 0) {
+                if (auto error = texture->Compress(*m_compressTo, m_compression); error.IsError()) {
+                    texture = std::unexpected(error);
+                }
+            }
+            callback(std::move(texture), TextureDecodeLease(shared_from_this(), bytes));
+            Finish();
+        }
+
+        void Release(size_t bytes) {
+            std::vector<Waiting> ready;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_inFlightBytes -= bytes;
+                for (auto* next = m_waiting.Peek(); next && Fits(next->m_bytes); next = m_waiting.Peek()) {
+                    Reserve(next->m_bytes);
+                    ready.push_back(std::move(*m_waiting.Pop()));
+                }
+            }
+            for (auto& waiting : ready) {
+                m_pool->Submit([self = shared_from_this(), waiting = std::move(waiting)]() mutable {
+                    self->Decode(std::move(waiting.m_file), waiting.m_bytes, waiting.m_cooked, waiting.m_callback);
+                });
+            }
+        }
+    };
+}
+
+TextureDecodeLease::~TextureDecodeLease() {
+    Reset();
+}
+
+TextureDecodeLease::TextureDecodeLease(TextureDecodeLease&& other) noexcept :
+    m_state(std::move(other.m_state)), m_bytes(std::exchange(other.m_bytes, 0)) {
+}
+
+TextureDecodeLease& TextureDecodeLease::operator=(TextureDecodeLease&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        m_state = std::move(other.m_state);
+        m_bytes = std::exchange(other.m_bytes, 0);
+    }
+    return *this;
+}
+
+void TextureDecodeLease::Reset() {
+    if (m_state) {
+        m_state->Release(m_bytes);
+        m_state.reset();
+    }
+    m_bytes = 0;
+}
+
+TextureDecoder::TextureDecoder(TextureDecoderParams params, ThreadPool& pool) :
+    m_state(std::make_shared<TextureDecoderState>()) {
+    m_state->m_pool = &pool;
+    m_state->m_maxInFlightBytes = params.m_maxInFlightBytes;
+    m_state->m_mips = params.m_mips;
+    m_state->m_compressTo = params.m_compressTo;
+    m_state->m_compression = params.m_compression;
+}
+
+TextureDecoder::~TextureDecoder() {
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    m_state->m_stopping = true;
+    m_state->m_outstanding -= m_state->m_reads.GetSize() + m_state->m_waiting.GetSize();
+    m_state->m_reads.Clear();
+    m_state->m_waiting.Clear();
+    m_state->m_idle.wait(lock, [this]() { return m_state->m_outstanding == 0; });
+}
+
+void TextureDecoder::Submit(
+    std::filesystem::path path,
+    Callback onDecoded,
+    LoadPriority priority,
+    void const* key,
+    std::function<bool()> isWanted) {
+    {
+        std::lock_guard<std::mutex> lock(m_state->m_mutex);
+        ++m_state->m_outstanding;
+        m_state->m_reads.Push(
+            TextureDecoderState::Pending{ std::move(path), std::move(onDecoded), key, std::move(isWanted) },
+            priority,
+            TextureDecoderState::GetKey(key));
+    }
+    m_state->m_pool->Submit([state = m_state]() {
+        state->ReadNext();
+    });
+}
+
+void TextureDecoder::Reprioritize(void const* key, LoadPriority priority) {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    m_state->m_reads.Reprioritize(key, priority);
+    m_state->m_waiting.Reprioritize(key, priority);
+}
+
+void TextureDecoder::Wait() {
+    std::unique_lock<std::mutex> lock(m_state->m_mutex);
+    m_state->m_idle.wait(lock, [this]() { return m_state->m_outstanding == 0; });
+}
+
+size_t TextureDecoder::GetInFlightBytes() const {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    return m_state->m_inFlightBytes;
+}
+
+size_t TextureDecoder::GetPeakInFlightBytes() const {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    return m_state->m_peakInFlightBytes;
+}
+
+LoadQueueStats TextureDecoder::GetQueueStats() const {
+    std::lock_guard<std::mutex> lock(m_state->m_mutex);
+    return m_state->m_reads.GetStats();
+}
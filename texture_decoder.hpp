@@ -0,0 +1,105 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "common.hpp"
+#include "load_queue.hpp"
+#include "texture.hpp"
+#include "texture_compression.hpp"
+#include "texture_mips.hpp"
+#include "thread_pool.hpp"
+
+namespace okami {
+	struct TextureDecoderState;
+
+	struct TextureDecoderParams {
+		// Decoded bytes allowed to exist at once, counted from the start of
+		// a decode until its lease is released. A texture larger than the
+		// whole budget still decodes, alone.
+		size_t m_maxInFlightBytes = size_t(256) << 20;
+		// Generates a mip chain after decoding, before the callback runs
+		std::optional<MipChainParams> m_mips;
+		// Block compresses every level after mips are generated. Textures
+		// whose size is not a multiple of 4 stay uncompressed, since GPUs
+		// need whole blocks at the base level.
+		std::optional<TextureFormat> m_compressTo;
+		BlockCompressionParams m_compression;
+	};
+
+	// Share of a TextureDecoder's budget held by one decoded texture. The
+	// bytes return to the budget when the lease is reset or destroyed, which
+	// should happen once the pixels are no longer needed (for example after
+	// they were copied to an upload buffer).
+	class TextureDecodeLease {
+	private:
+		std::shared_ptr<TextureDecoderState> m_state;
+		size_t m_bytes = 0;
+
+	public:
+		TextureDecodeLease() = default;
+		inline TextureDecodeLease(std::shared_ptr<TextureDecoderState> state, size_t bytes) :
+			m_state(std::move(state)), m_bytes(bytes) {}
+		~TextureDecodeLease();
+
+		TextureDecodeLease(TextureDecodeLease&& other) noexcept;
+		TextureDecodeLease& operator=(TextureDecodeLease&& other) noexcept;
+		OKAMI_NO_COPY(TextureDecodeLease);
+
+		inline size_t GetBytes() const {
+			return m_bytes;
+		}
+
+		void Reset();
+	};
+
+	// Reads and decodes PNG files on a thread pool, off the thread that
+	// records uploads. Cooked .oktex files skip decoding, mips and
+	// compression and are handed over mapped in place. Each result is
+	// handed to its callback, on a pool thread, together with a lease on
+	// the in-flight budget; decodes that would exceed the budget wait,
+	// without holding a thread, until leases are released. Reads and
+	// decodes waiting for budget go most urgent first.
+	class TextureDecoder {
+	public:
+		using Callback = std::function<void(Expected<RawTexture>, TextureDecodeLease)>;
+
+	private:
+		std::shared_ptr<TextureDecoderState> m_state;
+
+	public:
+		explicit TextureDecoder(
+			TextureDecoderParams params = {},
+			ThreadPool& pool = ThreadPool::Default());
+		// Drops decodes still waiting for budget and waits for the rest
+		~TextureDecoder();
+
+		OKAMI_NO_COPY(TextureDecoder);
+		OKAMI_NO_MOVE(TextureDecoder);
+
+		// A key lets the request be reprioritized later. isWanted is checked
+		// before the file is read; unwanted requests are handed to their
+		// callback as LoadCancelledError without being read.
+		void Submit(
+			std::filesystem::path path,
+			Callback onDecoded,
+			LoadPriority priority = LoadPriority::Visible,
+			void const* key = nullptr,
+			std::function<bool()> isWanted = {});
+
+		// Moves a request not yet decoding to a more urgent priority
+		void Reprioritize(void const* key, LoadPriority priority);
+
+		// Returns once every submitted texture was handed to its callback.
+		// Waiting decodes only proceed as leases are released, so the
+		// callbacks must not hold on to them indefinitely.
+		void Wait();
+
+		size_t GetInFlightBytes() const;
+		size_t GetPeakInFlightBytes() const;
+		// Requests waiting to be read
+		LoadQueueStats GetQueueStats() const;
+	};
+}
@@ -0,0 +1,427 @@
+#include "texture_mips.hpp"
+#include "texture_conversion.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+using namespace okami;
+
+namespace {
+    constexpr float kPi = 3.14159265358979f;
+    // Texels per ParallelFor chunk
+    constexpr size_t kTexelsPerTask = 16 * 1024;
+
+    float SrgbToLinear(float c) {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float LinearToSrgb(float c) {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    std::array<float, 256> const& GetSrgbTable() {
+        static auto const table = []() {
+            std::array<float, 256> result;
+            for (int i = 0; i < 256; ++i) {
+                result[i] = SrgbToLinear(i / 255.0f);
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    // Linear to sRGB by interpolating a table, much cheaper than pow and
+    // well within half a step of 8 bit output
+    constexpr int kEncodeTableSize = 4096;
+
+    std::array<float, kEncodeTableSize + 1> const& GetSrgbEncodeTable() {
+        static auto const table = []() {
+            std::array<float, kEncodeTableSize + 1> result;
+            for (int i = 0; i <= kEncodeTableSize; ++i) {
+                result[i] = LinearToSrgb(static_cast<float>(i) / kEncodeTableSize);
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    float EncodeSrgb(std::array<float, kEncodeTableSize + 1> const& table, float c) {
+        float position = c * kEncodeTableSize;
+        auto index = std::min(static_cast<int>(position), kEncodeTableSize - 1);
+        float t = position - index;
+        return table[index] + t * (table[index + 1] - table[index]);
+    }
+
+    float Sinc(float x) {
+        if (std::abs(x) < 1e-6f) {
+            return 1.0f;
+        }
+        return std::sin(kPi * x) / (kPi * x);
+    }
+
+    // Modified Bessel function of the first kind, order zero
+    float BesselI0(float x) {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 32; ++k) {
+            term *= (x * x) / (4.0f * k * k);
+            sum += term;
+            if (term < sum * 1e-7f) {
+                break;
+            }
+        }
+        return sum;
+    }
+
+    struct FilterKernel {
+        // Support in destination texels on each side of the center
+        float m_radius;
+        float (*m_evaluate)(float);
+    };
+
+    FilterKernel GetKernel(MipFilter filter) {
+        switch (filter) {
+        case MipFilter::Kaiser:
+            return { 3.0f, [](float x) {
+                constexpr float kAlpha = 4.0f;
+                if (std::abs(x) >= 3.0f) {
+                    return 0.0f;
+                }
+                float t = x / 3.0f;
+                return Sinc(x) * BesselI0(kAlpha * std::sqrt(1.0f - t * t)) / BesselI0(kAlpha);
+            } };
+        case MipFilter::Lanczos:
+            return { 3.0f, [](float x) {
+                return std::abs(x) < 3.0f ? Sinc(x) * Sinc(x / 3.0f) : 0.0f;
+            } };
+        case MipFilter::Box:
+        default:
+            return { 0.5f, [](float x) {
+                x = std::abs(x);
+                return x < 0.5f ? 1.0f : (x == 0.5f ? 0.5f : 0.0f);
+            } };
+        }
+    }
+
+    // Normalized weights of the source texels under each destination texel
+    // along one axis, with source indices clamped to the edge
+    struct AxisTaps {
+        uint32_t m_tapCount = 0;
+        std::vector<uint32_t> m_sources;
+        std::vector<float> m_weights;
+    };
+
+    AxisTaps BuildTaps(uint32_t sourceSize, uint32_t destSize, FilterKernel const& kernel) {
+        float ratio = static_cast<float>(sourceSize) / static_cast<float>(destSize);
+        float radius = kernel.m_radius * ratio;
+
+        AxisTaps taps;
+        taps.m_tapCount = static_cast<uint32_t>(std::ceil(2.0f * radius)) + 1;
+        taps.m_sources.resize(size_t(destSize) * taps.m_tapCount);
+        taps.m_weights.resize(size_t(destSize) * taps.m_tapCount);
+
+        for (uint32_t d = 0; d < destSize; ++d) {
+            float center = (d + 0.5f) * ratio;
+            auto first = static_cast<int64_t>(std::floor(center - radius));
+            auto* sources = &taps.m_sources[size_t(d) * taps.m_tapCount];
+            auto* weights = &taps.m_weights[size_t(d) * taps.m_tapCount];
+
+            float sum = 0.0f;
+            for (uint32_t k = 0; k < taps.m_tapCount; ++k) {
+                int64_t i = first + k;
+                sources[k] = static_cast<uint32_t>(std::clamp<int64_t>(i, 0, sourceSize - 1));
+                weights[k] = kernel.m_evaluate((i + 0.5f - center) / ratio);
+                sum += weights[k];
+            }
+            for (uint32_t k = 0; k < taps.m_tapCount; ++k) {
+                weights[k] /= sum;
+            }
+        }
+
+        // The window is conservative; drop trailing taps no texel uses
+        uint32_t used = 1;
+        for (uint32_t d = 0; d < destSize; ++d) {
+            for (uint32_t k = used; k < taps.m_tapCount; ++k) {
+                if (taps.m_weights[size_t(d) * taps.m_tapCount + k] != 0.0f) {
+                    used = k + 1;
+                }
+            }
+        }
+        if (used < taps.m_tapCount) {
+            for (uint32_t d = 0; d < destSize; ++d) {
+                for (uint32_t k = 0; k < used; ++k) {
+                    taps.m_sources[size_t(d) * used + k] = taps.m_sources[size_t(d) * taps.m_tapCount + k];
+                    taps.m_weights[size_t(d) * used + k] = taps.m_weights[size_t(d) * taps.m_tapCount + k];
+                }
+            }
+            taps.m_tapCount = used;
+            taps.m_sources.resize(size_t(destSize) * used);
+            taps.m_weights.resize(size_t(destSize) * used);
+        }
+        return taps;
+    }
+
+    struct Level {
+        uint32_t m_width;
+        uint32_t m_height;
+        // Linear, alpha weighted if requested, m_width * m_height * channels
+        std::vector<float> m_texels;
+    };
+
+    size_t GetRowGrain(size_t rowTexels) {
+        return std::max<size_t>(1, kTexelsPerTask / std::max<size_t>(rowTexels, 1));
+    }
+
+    template <uint32_t channels>
+    Level Downsample(Level const& source, uint32_t width, uint32_t height, FilterKernel const& kernel) {
+        auto horizontal = BuildTaps(source.m_width, width, kernel);
+        auto vertical = BuildTaps(source.m_height, height, kernel);
+
+        // Horizontal pass over every source row
+        std::vector<float> rows(size_t(width) * source.m_height * channels);
+        ParallelFor(source.m_height, GetRowGrain(size_t(width) * horizontal.m_tapCount), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                auto const* in = &source.m_texels[y * source.m_width * channels];
+                auto* out = &rows[y * width * channels];
+                for (uint32_t x = 0; x < width; ++x) {
+                    auto const* sources = &horizontal.m_sources[size_t(x) * horizontal.m_tapCount];
+                    auto const* weights = &horizontal.m_weights[size_t(x) * horizontal.m_tapCount];
+                    float sum[channels] = {};
+                    for (uint32_t k = 0; k < horizontal.m_tapCount; ++k) {
+                        auto const* texel = &in[size_t(sources[k]) * channels];
+                        for (uint32_t c = 0; c < channels; ++c) {
+                            sum[c] += weights[k] * texel[c];
+                        }
+                    }
+                    std::memcpy(&out[size_t(x) * channels], sum, sizeof(sum));
+                }
+            }
+        });
+
+        // Vertical pass; each destination row is a weighted sum of whole
+        // rows, which the compiler vectorizes
+        Level result{ width, height, std::vector<float>(size_t(width) * height * channels, 0.0f) };
+        size_t rowFloats = size_t(width) * channels;
+        ParallelFor(height, GetRowGrain(rowFloats * vertical.m_tapCount / channels), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                auto* out = &result.m_texels[y * rowFloats];
+                for (uint32_t k = 0; k < vertical.m_tapCount; ++k) {
+                    float weight = vertical.m_weights[y * vertical.m_tapCount + k];
+                    auto const* in = &rows[size_t(vertical.m_sources[y * vertical.m_tapCount + k]) * rowFloats];
+                    for (size_t i = 0; i < rowFloats; ++i) {
+                        out[i] += weight * in[i];
+                    }
+                }
+            }
+        });
+        return result;
+    }
+
+    // Box filtering an even sized level is a plain 2x2 average, done in
+    // one pass without the intermediate rows
+    template <uint32_t channels>
+    Level Downsample2x2(Level const& source, uint32_t width, uint32_t height) {
+        Level result{ width, height, std::vector<float>(size_t(width) * height * channels) };
+        size_t sourceRow = size_t(source.m_width) * channels;
+        ParallelFor(height, GetRowGrain(width), [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                auto const* top = &source.m_texels[2 * y * sourceRow];
+                auto const* bottom = top + sourceRow;
+                auto* out = &result.m_texels[y * width * channels];
+                for (size_t x = 0; x < width; ++x) {
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        size_t i = 2 * x * channels + c;
+                        out[x * channels + c] = 0.25f * (top[i] + top[i + channels] + bottom[i] + bottom[i + channels]);
+                    }
+                }
+            }
+        });
+        return result;
+    }
+
+    template <uint32_t channels>
+    Level DownsampleLevel(Level const& source, uint32_t width, uint32_t height, MipFilter filter, FilterKernel const& kernel) {
+        if (filter == MipFilter::Box && source.m_width == 2 * width && source.m_height == 2 * height) {
+            return Downsample2x2<channels>(source, width, height);
+        }
+        return Downsample<channels>(source, width, height, kernel);
+    }
+
+    // How each channel is stored in an 8 bit or float texture
+    struct ChannelEncoding {
+        bool m_isFloat = false;
+        bool m_srgb[4] = {};
+        bool m_alphaWeighted = false;
+    };
+
+    template <uint32_t channels>
+    void DecodeLevel(uint8_t const* in, size_t texelCount, ChannelEncoding const& encoding, float* out) {
+        if (encoding.m_isFloat) {
+            std::memcpy(out, in, texelCount * channels * sizeof(float));
+        } else {
+            static auto const linearTable = []() {
+                std::array<float, 256> result;
+                for (int i = 0; i < 256; ++i) {
+                    result[i] = i / 255.0f;
+                }
+                return result;
+            }();
+            float const* tables[channels];
+            for (uint32_t c = 0; c < channels; ++c) {
+                tables[c] = encoding.m_srgb[c] ? GetSrgbTable().data() : linearTable.data();
+            }
+            for (size_t t = 0; t < texelCount; ++t) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    out[t * channels + c] = tables[c][in[t * channels + c]];
+                }
+            }
+        }
+        if constexpr (channels == 4) {
+            if (encoding.m_alphaWeighted) {
+                for (size_t t = 0; t < texelCount; ++t) {
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        out[t * 4 + c] *= out[t * 4 + 3];
+                    }
+                }
+            }
+        }
+    }
+
+    template <uint32_t channels>
+    void EncodeLevel(float const* in, size_t texelCount, ChannelEncoding const& encoding, uint8_t* out) {
+        auto const& encodeTable = GetSrgbEncodeTable();
+        for (size_t t = 0; t < texelCount; ++t) {
+            float texel[channels];
+            std::memcpy(texel, &in[t * channels], sizeof(texel));
+            if constexpr (channels == 4) {
+                if (encoding.m_alphaWeighted) {
+                    float inverseAlpha = texel[3] > 1e-6f ? 1.0f / texel[3] : 0.0f;
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        texel[c] *= inverseAlpha;
+                    }
+                }
+            }
+            if (encoding.m_isFloat) {
+                std::memcpy(&out[t * sizeof(texel)], texel, sizeof(texel));
+                continue;
+            }
+            for (uint32_t c = 0; c < channels; ++c) {
+                // Sharp kernels overshoot, so clamp before encoding
+                float value = std::clamp(texel[c], 0.0f, 1.0f);
+                if (encoding.m_srgb[c]) {
+                    value = EncodeSrgb(encodeTable, value);
+                }
+                out[t * channels + c] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    template <uint32_t channels>
+    void GenerateChain(
+        TextureInfo const& info,
+        std::span<uint8_t const> base,
+        std::span<uint8_t> data,
+        MipFilter filter,
+        ChannelEncoding const& encoding) {
+        auto texelSize = GetPixelStride(info.format);
+
+        // Filter in float, so quantization error does not build up level by level
+        Level level{ info.width, info.height, std::vector<float>(size_t(info.width) * info.height * channels) };
+        ParallelFor(info.height, GetRowGrain(info.width), [&](size_t begin, size_t end) {
+            DecodeLevel<channels>(&base[begin * info.width * texelSize], (end - begin) * info.width, encoding,
+                &level.m_texels[begin * info.width * channels]);
+        });
+
+        auto kernel = GetKernel(filter);
+        for (uint32_t mip = 1; mip < info.mipLevels; ++mip) {
+            auto width = std::max(1u, info.width >> mip);
+            auto height = std::max(1u, info.height >> mip);
+            level = DownsampleLevel<channels>(level, width, height, filter, kernel);
+
+            auto* out = &data[GetMipOffset(info, mip)];
+            ParallelFor(height, GetRowGrain(width), [&](size_t begin, size_t end) {
+                EncodeLevel<channels>(&level.m_texels[begin * width * channels], (end - begin) * width, encoding,
+                    &out[begin * width * texelSize]);
+            });
+        }
+    }
+
+    // 32 bit float format with the same channels, for the half and packed
+    // float formats filtered through it
+    std::optional<TextureFormat> GetFilteringFormat(TextureFormat format) {
+        switch (format) {
+        case TextureFormat::R16F:
+            return TextureFormat::R32F;
+        case TextureFormat::RG16F:
+            return TextureFormat::RG32F;
+        case TextureFormat::RGBA16F:
+            return TextureFormat::RGBA32F;
+        case TextureFormat::R11G11B10F:
+        case TextureFormat::RGB9E5:
+            return TextureFormat::RGB32F;
+        default:
+            return std::nullopt;
+        }
+    }
+}
+
+Error RawTexture::GenerateMips(MipChainParams const& params) {
+    if (m_info.type != TextureType::TEXTURE_2D) {
+        return Error("Mip generation only supports 2D textures");
+    }
+    if (IsBlockCompressed(m_info.format)) {
+        return Error("Mip generation needs uncompressed texels; generate mips before compressing");
+    }
+    if (auto filteringFormat = GetFilteringFormat(m_info.format)) {
+        auto format = m_info.format;
+        auto error = Convert(*filteringFormat, PixelConversionParams{});
+        OKAMI_ERROR_RETURN(error);
+        error = GenerateMips(params);
+        OKAMI_ERROR_RETURN(error);
+        return Convert(format, PixelConversionParams{});
+    }
+
+    auto channels = GetChannelCount(m_info.format);
+    ChannelEncoding encoding;
+    encoding.m_isFloat = IsFloatFormat(m_info.format);
+    encoding.m_alphaWeighted = params.m_alphaWeighted && channels == 4;
+    // Only color channels are sRGB; alpha and one or two channel data stay linear
+    for (uint32_t c = 0; c < 3 && channels >= 3; ++c) {
+        encoding.m_srgb[c] = params.m_srgb && !encoding.m_isFloat;
+    }
+
+    auto levelCount = GetFullMipCount(m_info.width, m_info.height);
+    if (params.m_maxLevels > 0) {
+        levelCount = std::min(levelCount, params.m_maxLevels);
+    }
+
+    TextureInfo info = m_info;
+    info.mipLevels = levelCount;
+    std::vector<uint8_t> data(GetTextureSize(info));
+    auto base = std::span<uint8_t const>(m_data).subspan(0, GetMipOffset(m_info, 1));
+    std::memcpy(data.data(), base.data(), base.size());
+
+    switch (channels) {
+    case 1:
+        GenerateChain<1>(info, base, data, params.m_filter, encoding);
+        break;
+    case 2:
+        GenerateChain<2>(info, base, data, params.m_filter, encoding);
+        break;
+    case 3:
+        GenerateChain<3>(info, base, data, params.m_filter, encoding);
+        break;
+    default:
+        GenerateChain<4>(info, base, data, params.m_filter, encoding);
+        break;
+    }
+
+    m_info = info;
+    SetData(std::move(data));
+    return {};
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common.hpp"
+#include "texture.hpp"
+
+namespace okami {
+	enum class MipFilter {
+		// Averages the texels under each destination texel; fastest
+		Box,
+		// Kaiser windowed sinc, sharper than box with little ringing
+		Kaiser,
+		// Lanczos (three lobes), sharpest, rings most
+		Lanczos,
+	};
+
+	struct MipChainParams {
+		MipFilter m_filter = MipFilter::Box;
+		// 8 bit color channels hold sRGB encoded values and are filtered in
+		// linear space. Alpha and float formats are always linear.
+		bool m_srgb = true;
+		// Weights color by alpha, so transparent texels do not bleed their
+		// color into the edges of sprites
+		bool m_alphaWeighted = true;
+		// Levels including the base, zero for a full chain down to 1x1
+		uint32_t m_maxLevels = 0;
+	};
+}
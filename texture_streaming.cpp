@@ -0,0 +1,252 @@
+#include "texture_streaming.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace okami;
+
+uint32_t okami::GetStreamingMip(TextureInfo const& info, glm::vec2 projectedSize, float lodBias) {
+    uint32_t coarsest = info.mipLevels > 0 ? info.mipLevels - 1 : 0;
+    if (!(projectedSize.x > 0.0f) || !(projectedSize.y > 0.0f)) {
+        return coarsest;
+    }
+
+    // Texels per pixel along the more minified axis, as the sampler sees it
+    float ratio = std::max(
+        static_cast<float>(info.width) / projectedSize.x,
+        static_cast<float>(info.height) / projectedSize.y);
+    float lod = std::log2(ratio) + lodBias;
+    if (!(lod > 0.0f)) {
+        return 0;
+    }
+    if (lod >= static_cast<float>(coarsest)) {
+        return coarsest;
+    }
+    return static_cast<uint32_t>(lod);
+}
+
+uint32_t okami::GetStreamingTailMip(TextureInfo const& info, uint32_t tailSize) {
+    uint32_t coarsest = info.mipLevels > 0 ? info.mipLevels - 1 : 0;
+    uint32_t mip = 0;
+    while (mip < coarsest && std::max(info.width >> mip, info.height >> mip) > tailSize) {
+        ++mip;
+    }
+    return mip;
+}
+
+size_t okami::GetStreamedBytes(TextureInfo const& info, uint32_t finestMip) {
+    return GetTextureSize(info) - GetMipOffset(info, std::min(finestMip, info.mipLevels));
+}
+
+TextureStreamer::TextureStreamer(TextureStreamingParams params) : m_params(params) {
+}
+
+void TextureStreamer::Add(resource_id_t id, TextureInfo const& info, std::optional<uint32_t> tailMip) {
+    Remove(id);
+
+    Entry entry;
+    entry.m_info = info;
+    entry.m_tailMip = std::min(
+        tailMip.value_or(GetStreamingTailMip(info, m_params.m_tailSize)),
+        info.mipLevels > 0 ? info.mipLevels - 1 : 0);
+    entry.m_residentMip = entry.m_tailMip;
+    entry.m_targetMip = entry.m_tailMip;
+    entry.m_wantedMip = entry.m_tailMip;
+    entry.m_lastUsedFrame = m_frame;
+
+    m_stats.m_committedBytes += GetStreamedBytes(info, entry.m_tailMip);
+    m_stats.m_textureCount++;
+    m_entries.emplace(id, entry);
+}
+
+void TextureStreamer::Remove(resource_id_t id) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    auto const& entry = it->second;
+    m_stats.m_committedBytes -= GetStreamedBytes(entry.m_info, entry.m_targetMip);
+    m_stats.m_textureCount--;
+    if (entry.m_residentMip != entry.m_targetMip) {
+        m_stats.m_pendingCount--;
+    }
+    m_entries.erase(it);
+}
+
+void TextureStreamer::ReportUsage(resource_id_t id, glm::vec2 projectedSize) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    auto& entry = it->second;
+    uint32_t mip = std::min(GetStreamingMip(entry.m_info, projectedSize, m_params.m_lodBias), entry.m_tailMip);
+    float coverage = std::max(projectedSize.x, 0.0f) * std::max(projectedSize.y, 0.0f);
+    if (!entry.m_used) {
+        entry.m_used = true;
+        entry.m_wantedMip = mip;
+        entry.m_coverage = coverage;
+    } else {
+        entry.m_wantedMip = std::min(entry.m_wantedMip, mip);
+        entry.m_coverage = std::max(entry.m_coverage, coverage);
+    }
+}
+
+size_t TextureStreamer::GetShortfall(size_t extraBytes) const {
+    size_t total = m_stats.m_committedBytes + extraBytes;
+    return total > m_params.m_budgetBytes ? total - m_params.m_budgetBytes : 0;
+}
+
+void TextureStreamer::Retarget(resource_id_t id, Entry& entry, uint32_t finestMip, std::vector<TextureStreamRequest>& requests) {
+    m_stats.m_committedBytes -= GetStreamedBytes(entry.m_info, entry.m_targetMip);
+    m_stats.m_committedBytes += GetStreamedBytes(entry.m_info, finestMip);
+    m_stats.m_pendingCount++;
+    entry.m_targetMip = finestMip;
+    requests.push_back(TextureStreamRequest{ id, finestMip });
+}
+
+void TextureStreamer::Evict(size_t bytes, Entry const* keep, std::vector<TextureStreamRequest>& requests) {
+    struct Victim {
+        resource_id_t m_id;
+        Entry* m_entry;
+        uint32_t m_keepMip;
+    };
+
+    std::vector<Victim> victims;
+    for (auto& [id, entry] : m_entries) {
+        if (&entry == keep || entry.m_residentMip != entry.m_targetMip) {
+            continue;
+        }
+        uint32_t keepMip = entry.m_used ? entry.m_wantedMip : entry.m_tailMip;
+        if (entry.m_targetMip < keepMip) {
+            victims.push_back(Victim{ id, &entry, keepMip });
+        }
+    }
+
+    std::sort(victims.begin(), victims.end(), [](Victim const& a, Victim const& b) {
+        if (a.m_entry->m_lastUsedFrame != b.m_entry->m_lastUsedFrame) {
+            return a.m_entry->m_lastUsedFrame < b.m_entry->m_lastUsedFrame;
+        }
+        return a.m_id < b.m_id;
+    });
+
+    size_t freed = 0;
+    for (auto const& victim : victims) {
+        if (freed >= bytes) {
+            break;
+        }
+
+        auto& info = victim.m_entry->m_info;
+        size_t current = GetStreamedBytes(info, victim.m_entry->m_targetMip);
+        uint32_t mip = victim.m_entry->m_targetMip;
+        while (mip < victim.m_keepMip && freed + current - GetStreamedBytes(info, mip) < bytes) {
+            ++mip;
+        }
+        freed += current - GetStreamedBytes(info, mip);
+        Retarget(victim.m_id, *victim.m_entry, mip, requests);
+    }
+}
+
+void TextureStreamer::Update(std::vector<TextureStreamRequest>& requests) {
+    requests.clear();
+    ++m_frame;
+
+    struct Load {
+        resource_id_t m_id;
+        Entry* m_entry;
+    };
+
+    std::vector<Load> loads;
+    for (auto& [id, entry] : m_entries) {
+        if (entry.m_used) {
+            entry.m_lastUsedFrame = m_frame;
+        } else {
+            entry.m_wantedMip = entry.m_tailMip;
+        }
+        if (entry.m_residentMip == entry.m_targetMip && entry.m_wantedMip < entry.m_targetMip) {
+            loads.push_back(Load{ id, &entry });
+        }
+    }
+
+    // Textures furthest from the levels they need first, then the largest on screen
+    std::sort(loads.begin(), loads.end(), [](Load const& a, Load const& b) {
+        uint32_t gapA = a.m_entry->m_targetMip - a.m_entry->m_wantedMip;
+        uint32_t gapB = b.m_entry->m_targetMip - b.m_entry->m_wantedMip;
+        if (gapA != gapB) {
+            return gapA > gapB;
+        }
+        if (a.m_entry->m_coverage != b.m_entry->m_coverage) {
+            return a.m_entry->m_coverage > b.m_entry->m_coverage;
+        }
+        return a.m_id < b.m_id;
+    });
+
+    uint32_t loadCount = 0;
+    for (auto const& load : loads) {
+        if (loadCount >= m_params.m_maxRequestsPerUpdate) {
+            break;
+        }
+
+        auto& entry = *load.m_entry;
+        size_t current = GetStreamedBytes(entry.m_info, entry.m_targetMip);
+        size_t shortfall = GetShortfall(GetStreamedBytes(entry.m_info, entry.m_wantedMip) - current);
+        if (shortfall > 0) {
+            Evict(shortfall, &entry, requests);
+        }
+
+        // Stop at a coarser level when eviction could not free enough
+        uint32_t mip = entry.m_wantedMip;
+        while (mip < entry.m_targetMip && GetShortfall(GetStreamedBytes(entry.m_info, mip) - current) > 0) {
+            ++mip;
+        }
+        if (mip < entry.m_targetMip) {
+            Retarget(load.m_id, entry, mip, requests);
+            loadCount++;
+        }
+    }
+
+    for (auto& [id, entry] : m_entries) {
+        entry.m_used = false;
+        entry.m_coverage = 0.0f;
+    }
+}
+
+void TextureStreamer::OnStreamed(resource_id_t id, bool succeeded) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    auto& entry = it->second;
+    if (entry.m_residentMip == entry.m_targetMip) {
+        return;
+    }
+    m_stats.m_pendingCount--;
+
+    size_t resident = GetStreamedBytes(entry.m_info, entry.m_residentMip);
+    size_t target = GetStreamedBytes(entry.m_info, entry.m_targetMip);
+    if (!succeeded) {
+        // Keep what the backend still has; the next Update asks again if
+        // usage still needs it
+        m_stats.m_committedBytes += resident;
+        m_stats.m_committedBytes -= target;
+        entry.m_targetMip = entry.m_residentMip;
+        return;
+    }
+
+    if (target > resident) {
+        m_stats.m_loadedBytes += target - resident;
+    } else {
+        m_stats.m_evictedBytes += resident - target;
+    }
+    entry.m_residentMip = entry.m_targetMip;
+}
+
+std::optional<uint32_t> TextureStreamer::GetResidentMip(resource_id_t id) const {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return std::nullopt;
+    }
+    return it->second.m_residentMip;
+}
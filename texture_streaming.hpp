@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "engine.hpp"
+#include "texture.hpp"
+
+#include <glm/vec2.hpp>
+
+namespace okami {
+	struct TextureStreamingParams {
+		// Bytes of mip levels streamed textures may have resident, levels
+		// still loading included and levels being evicted not. Tails are always
+		// kept, even past the budget.
+		size_t m_budgetBytes = size_t(256) << 20;
+		// Levels no larger than this on either side form a texture's tail,
+		// loaded with the texture before any usage is known and never evicted
+		uint32_t m_tailSize = 64;
+		// Added to the level usage asks for; negative values stream in
+		// sharper levels than the screen needs
+		float m_lodBias = 0.0f;
+		// Residency changes handed out per Update, to spread uploads over frames
+		uint32_t m_maxRequestsPerUpdate = 8;
+	};
+
+	// Asks the backend to make a texture's levels m_finestMip and coarser
+	// resident, and no finer ones. Finer than the current levels is a load,
+	// coarser an eviction.
+	struct TextureStreamRequest {
+		resource_id_t m_texture;
+		uint32_t m_finestMip;
+
+		bool operator==(TextureStreamRequest const&) const = default;
+	};
+
+	struct TextureStreamingStats {
+		// Bytes of the levels textures have or are loading
+		size_t m_committedBytes = 0;
+		size_t m_textureCount = 0;
+		// Textures with a request the backend has not finished
+		size_t m_pendingCount = 0;
+		// Totals since the streamer was created
+		size_t m_loadedBytes = 0;
+		size_t m_evictedBytes = 0;
+	};
+
+	// Finest level worth sampling when the whole texture covers about
+	// projectedSize pixels on screen; the coarsest level when it covers none
+	uint32_t GetStreamingMip(TextureInfo const& info, glm::vec2 projectedSize, float lodBias = 0.0f);
+	// Finest level of the tail, see TextureStreamingParams::m_tailSize
+	uint32_t GetStreamingTailMip(TextureInfo const& info, uint32_t tailSize);
+	// Bytes of levels finestMip and coarser
+	size_t GetStreamedBytes(TextureInfo const& info, uint32_t finestMip);
+
+	// Decides which mip levels of streamed textures should be resident.
+	// Backend neutral: the backend adds textures once their tail is resident,
+	// reports how large they are drawn each frame, then calls Update and
+	// carries out the requests it returns, calling OnStreamed as each one
+	// finishes. Textures load the levels their usage asks for, most needed
+	// first; when that would exceed the budget, levels finer than needed are
+	// evicted from the least recently used textures, and loads that still do
+	// not fit stop at a coarser level. Not thread safe.
+	class TextureStreamer {
+	private:
+		struct Entry {
+			TextureInfo m_info;
+			uint32_t m_tailMip = 0;
+			// Levels the backend has
+			uint32_t m_residentMip = 0;
+			// Levels last requested; equal to m_residentMip when idle
+			uint32_t m_targetMip = 0;
+			// Finest level usage asked for since the last Update
+			uint32_t m_wantedMip = 0;
+			// Largest on screen area reported since the last Update
+			float m_coverage = 0.0f;
+			bool m_used = false;
+			uint64_t m_lastUsedFrame = 0;
+		};
+
+		TextureStreamingParams m_params;
+		std::unordered_map<resource_id_t, Entry> m_entries;
+		uint64_t m_frame = 0;
+		TextureStreamingStats m_stats;
+
+		// Bytes the budget is short of after adding extraBytes
+		size_t GetShortfall(size_t extraBytes) const;
+		void Retarget(resource_id_t id, Entry& entry, uint32_t finestMip, std::vector<TextureStreamRequest>& requests);
+		// Evicts finer than needed levels, least recently used first, until
+		// bytes are freed or nothing else can go
+		void Evict(size_t bytes, Entry const* keep, std::vector<TextureStreamRequest>& requests);
+
+	public:
+		explicit TextureStreamer(TextureStreamingParams params = {});
+
+		inline TextureStreamingParams const& GetParams() const {
+			return m_params;
+		}
+
+		// Starts tracking a texture whose tail is resident. The tail defaults
+		// to GetStreamingTailMip; backends that cannot make every level the
+		// finest one pass their own.
+		void Add(resource_id_t id, TextureInfo const& info, std::optional<uint32_t> tailMip = std::nullopt);
+		// Stops tracking a texture; a request still running for it is ignored
+		void Remove(resource_id_t id);
+
+		// Usage feedback for the frame in progress: the whole texture would
+		// cover about projectedSize pixels where it is drawn. Reported as
+		// often as it is drawn; the largest size counts.
+		void ReportUsage(resource_id_t id, glm::vec2 projectedSize);
+
+		// Ends the frame, replacing requests with the residency changes to
+		// carry out. A texture has at most one request running at a time.
+		void Update(std::vector<TextureStreamRequest>& requests);
+
+		// The backend finished the texture's request, or gave up on it
+		void OnStreamed(resource_id_t id, bool succeeded);
+
+		// Finest level the backend has, if the texture is tracked
+		std::optional<uint32_t> GetResidentMip(resource_id_t id) const;
+
+		inline TextureStreamingStats const& GetStats() const {
+			return m_stats;
+		}
+	};
+}
@@ -0,0 +1,124 @@
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <memory>
+
+using namespace okami;
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    m_workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_stopping && m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    if (m_workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(
+    size_t count,
+    size_t grainSize,
+    std::function<void(size_t, size_t)> const& func) {
+    if (count == 0) {
+        return;
+    }
+
+    grainSize = std::max<size_t>(grainSize, 1);
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (chunkCount == 1 || m_workers.empty()) {
+        func(0, count);
+        return;
+    }
+
+    struct SharedState {
+        std::atomic<size_t> m_nextChunk{0};
+        std::atomic<size_t> m_chunksDone{0};
+        std::mutex m_errorMutex;
+        std::exception_ptr m_error;
+    };
+    auto state = std::make_shared<SharedState>();
+
+    // Helpers that start after all chunks were claimed exit without touching func,
+    // so it is safe for them to outlive this call.
+    auto runChunks = [state, count, grainSize, chunkCount, &func]() {
+        while (true) {
+            size_t chunk = state->m_nextChunk.fetch_add(1);
+            if (chunk >= chunkCount) {
+                return;
+            }
+            size_t begin = chunk * grainSize;
+            size_t end = std::min(begin + grainSize, count);
+            try {
+                func(begin, end);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->m_errorMutex);
+                if (!state->m_error) {
+                    state->m_error = std::current_exception();
+                }
+            }
+            if (state->m_chunksDone.fetch_add(1) + 1 == chunkCount) {
+                state->m_chunksDone.notify_all();
+            }
+        }
+    };
+
+    size_t helperCount = std::min(m_workers.size(), chunkCount - 1);
+    for (size_t i = 0; i < helperCount; ++i) {
+        Submit(runChunks);
+    }
+    runChunks();
+
+    size_t done = state->m_chunksDone.load();
+    while (done != chunkCount) {
+        state->m_chunksDone.wait(done);
+        done = state->m_chunksDone.load();
+    }
+
+    if (state->m_error) {
+        std::rethrow_exception(state->m_error);
+    }
+}
+
+ThreadPool& ThreadPool::Default() {
+    // The calling thread always participates, so leave one hardware thread for it
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return pool;
+}
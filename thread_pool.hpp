@@ -0,0 +1,58 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "common.hpp"
+
+namespace okami {
+	// Fixed-size pool of worker threads for CPU-side content processing
+	// (geometry import, acceleration structure builds, texture work).
+	class ThreadPool {
+	private:
+		std::vector<std::thread> m_workers;
+		std::queue<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		bool m_stopping = false;
+
+		void WorkerLoop();
+
+	public:
+		explicit ThreadPool(size_t threadCount);
+		~ThreadPool();
+
+		OKAMI_NO_COPY(ThreadPool);
+		OKAMI_NO_MOVE(ThreadPool);
+
+		inline size_t GetThreadCount() const {
+			return m_workers.size();
+		}
+
+		void Submit(std::function<void()> task);
+
+		// Calls func(begin, end) over sub-ranges of [0, count) holding at most
+		// grainSize elements each, and returns once every sub-range is done.
+		// The calling thread takes part in the work, so ParallelFor may be
+		// nested inside another ParallelFor. The first exception thrown by
+		// func is rethrown on the calling thread.
+		void ParallelFor(
+			size_t count,
+			size_t grainSize,
+			std::function<void(size_t, size_t)> const& func);
+
+		// Process-wide pool sized to the hardware, created on first use.
+		static ThreadPool& Default();
+	};
+
+	inline void ParallelFor(
+		size_t count,
+		size_t grainSize,
+		std::function<void(size_t, size_t)> const& func) {
+		ThreadPool::Default().ParallelFor(count, grainSize, func);
+	}
+}
@@ -0,0 +1,93 @@
+// Converts glTF/GLB files into .okmesh caches laid out for the renderer.
+//
+// Usage: MeshCook [--no-optimize] [--no-lods] [--quantize] [--static-batch] <input.glb> [output.okmesh]
+//        MeshCook [--no-optimize] [--no-lods] [--quantize] [--static-batch] <input directory> [output directory]
+
+#include "../okmesh.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+using namespace okami;
+
+namespace {
+    bool IsGLTF(std::filesystem::path const& path) {
+        auto extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension == ".glb" || extension == ".gltf";
+    }
+
+    bool Cook(
+        std::filesystem::path const& source,
+        std::filesystem::path const& destination,
+        OkMeshCookParams const& params) {
+        std::vector<MeshOptimizationStats> stats;
+        auto error = CookOkMesh(source, destination, params, &stats);
+        if (error.IsError()) {
+            std::cerr << "Failed to cook " << source.string() << ": " << error << std::endl;
+            return false;
+        }
+        std::cout << source.string() << " -> " << destination.string() << std::endl;
+        for (size_t i = 0; i < stats.size(); ++i) {
+            auto const& mesh = stats[i];
+            std::cout << std::fixed << std::setprecision(3)
+                << "  mesh " << i << ": vertices " << mesh.m_before.m_vertexCount << " -> " << mesh.m_after.m_vertexCount
+                << ", ACMR " << mesh.m_before.m_acmr << " -> " << mesh.m_after.m_acmr
+                << ", ATVR " << mesh.m_before.m_atvr << " -> " << mesh.m_after.m_atvr
+                << ", index bytes " << mesh.m_indexBytesBefore << " -> " << mesh.m_indexBytesAfter
+                << std::endl;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+
+    OkMeshCookParams params;
+    int firstArg = 1;
+    for (; firstArg < argc; ++firstArg) {
+        std::string_view arg = argv[firstArg];
+        if (arg == "--no-optimize") {
+            params.m_optimization = std::nullopt;
+        } else if (arg == "--no-lods") {
+            params.m_lods = std::nullopt;
+        } else if (arg == "--static-batch") {
+            params.m_staticBatch = StaticBatchParams{};
+        } else if (arg == "--quantize") {
+            params.m_requirements = GetDefaultMeshRequirements(AttributeEncoding::Quantized);
+        } else {
+            break;
+        }
+    }
+
+    if (argc - firstArg < 1 || argc - firstArg > 2) {
+        std::cerr << "Usage: " << argv[0] << " [--no-optimize] [--no-lods] [--quantize] [--static-batch] <input.glb|input directory> [output]" << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path input = argv[firstArg];
+    bool hasOutput = argc - firstArg > 1;
+
+    if (!std::filesystem::is_directory(input)) {
+        auto output = hasOutput ? std::filesystem::path(argv[firstArg + 1]) :
+            std::filesystem::path(input).replace_extension(kOkMeshExtension);
+        return Cook(input, output, params) ? 0 : 1;
+    }
+
+    auto outputDirectory = hasOutput ? std::filesystem::path(argv[firstArg + 1]) : input;
+    bool success = true;
+    for (auto const& entry : std::filesystem::recursive_directory_iterator(input)) {
+        if (!entry.is_regular_file() || !IsGLTF(entry.path())) {
+            continue;
+        }
+        auto output = outputDirectory / std::filesystem::relative(entry.path(), input);
+        output.replace_extension(kOkMeshExtension);
+        std::filesystem::create_directories(output.parent_path());
+        success = Cook(entry.path(), output, params) && success;
+    }
+    return success ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+// Converts PNG files into .oktex caches with mips built and, optionally,
+// block compressed.
+//
+// Usage: TextureCook [--no-mips] [--bc1|--bc3|--bc4|--bc5|--bc7] [--fast] <input.png> [output.oktex]
+//        TextureCook [--no-mips] [--bc1|--bc3|--bc4|--bc5|--bc7] [--fast] <input directory> [output directory]
+
+#include "../oktex.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace okami;
+
+namespace {
+    bool IsPNG(std::filesystem::path const& path) {
+        auto extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension == ".png";
+    }
+
+    bool Cook(
+        std::filesystem::path const& source,
+        std::filesystem::path const& destination,
+        OkTexCookParams const& params) {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto error = CookOkTex(source, destination, params);
+        if (error.IsError()) {
+            std::cerr << "Failed to cook " << source.string() << ": " << error << std::endl;
+            return false;
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << source.string() << " -> " << destination.string()
+            << " (" << std::filesystem::file_size(source) << " -> " << std::filesystem::file_size(destination)
+            << " bytes, " << elapsed << "ms)" << std::endl;
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+
+    OkTexCookParams params;
+    int firstArg = 1;
+    for (; firstArg < argc; ++firstArg) {
+        std::string_view arg = argv[firstArg];
+        if (arg == "--no-mips") {
+            params.m_mips = std::nullopt;
+        } else if (arg == "--bc1") {
+            params.m_compressTo = TextureFormat::BC1;
+        } else if (arg == "--bc3") {
+            params.m_compressTo = TextureFormat::BC3;
+        } else if (arg == "--bc4") {
+            params.m_compressTo = TextureFormat::BC4;
+        } else if (arg == "--bc5") {
+            params.m_compressTo = TextureFormat::BC5;
+        } else if (arg == "--bc7") {
+            params.m_compressTo = TextureFormat::BC7;
+        } else if (arg == "--fast") {
+            params.m_compression.m_quality = CompressionQuality::Fast;
+        } else {
+            break;
+        }
+    }
+
+    if (argc - firstArg < 1 || argc - firstArg > 2) {
+        std::cerr << "Usage: " << argv[0] << " [--no-mips] [--bc1|--bc3|--bc4|--bc5|--bc7] [--fast] <input.png|input directory> [output]" << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path input = argv[firstArg];
+    bool hasOutput = argc - firstArg > 1;
+
+    if (!std::filesystem::is_directory(input)) {
+        auto output = hasOutput ? std::filesystem::path(argv[firstArg + 1]) :
+            std::filesystem::path(input).replace_extension(kOkTexExtension);
+        return Cook(input, output, params) ? 0 : 1;
+    }
+
+    auto outputDirectory = hasOutput ? std::filesystem::path(argv[firstArg + 1]) : input;
+    bool success = true;
+    for (auto const& entry : std::filesystem::recursive_directory_iterator(input)) {
+        if (!entry.is_regular_file() || !IsPNG(entry.path())) {
+            continue;
+        }
+        auto output = outputDirectory / std::filesystem::relative(entry.path(), input);
+        output.replace_extension(kOkTexExtension);
+        std::filesystem::create_directories(output.parent_path());
+        success = Cook(entry.path(), output, params) && success;
+    }
+    return success ? 0 : 1;
+}
@@ -8,4 +8,27 @@ Transform Transform::LookAt(glm::vec3 const& eye, glm::vec3 const& target, glm::
     glm::vec3 yaxis = glm::cross(zaxis, xaxis);
     glm::mat3 rotation = glm::mat3(xaxis, yaxis, zaxis);
     return Transform(eye, glm::quat(rotation), 1.0f);
-}
\ No newline at end of file
+}
+
+Transform Transform::FromMatrix(glm::mat4 const& matrix) {
+    glm::mat3 linear(matrix);
+    glm::vec3 position(matrix[3]);
+
+    // Gram-Schmidt on the columns gives the rotation; what remains is upper
+    // triangular. A mirroring matrix keeps a proper rotation and ends up
+    // with a negative last diagonal entry instead.
+    constexpr float kDegenerate = 1e-12f;
+    glm::vec3 x = linear[0];
+    if (glm::length(x) < kDegenerate) {
+        return Transform(position, glm::identity<glm::quat>(), linear);
+    }
+    x = glm::normalize(x);
+    glm::vec3 y = linear[1] - glm::dot(linear[1], x) * x;
+    if (glm::length(y) < kDegenerate) {
+        return Transform(position, glm::identity<glm::quat>(), linear);
+    }
+    y = glm::normalize(y);
+    glm::mat3 rotation(x, y, glm::cross(x, y));
+
+    return Transform(position, glm::quat_cast(rotation), glm::transpose(rotation) * linear);
+}
@@ -86,6 +86,10 @@ namespace okami {
 			return Transform(glm::vec3(x, y, 0.0f), glm::angleAxis(rotation, glm::vec3(0.0f, 0.0f, 1.0f)), scale);
 		}
 
+		// Splits an affine matrix into a rotation and the scale and shear
+		// applied before it
+		static Transform FromMatrix(glm::mat4 const& matrix);
+
 		static Transform LookAt(
 			glm::vec3 const& eye, 
 			glm::vec3 const& target, 
@@ -93,8 +97,9 @@ namespace okami {
 	};
 
 	inline Transform operator*(Transform const& A, Transform const& B) {
+		// A(B(p)) = Ra Sa Rb Sb p, so with rotation Ra Rb what is left is Rb^-1 Sa Rb Sb
 		auto rotation = A.m_rotation * B.m_rotation;
-		glm::mat3 scaleShear = (glm::mat3(glm::inverse(A.m_rotation)) * A.m_scaleShear * glm::mat3(A.m_rotation)) * B.m_scaleShear;
+		glm::mat3 scaleShear = (glm::mat3(glm::inverse(B.m_rotation)) * A.m_scaleShear * glm::mat3(B.m_rotation)) * B.m_scaleShear;
 		auto position = A.TransformPoint(B.m_position);
 		return Transform(position, rotation, scaleShear);
 	}
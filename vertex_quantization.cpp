@@ -0,0 +1,271 @@
+#include "vertex_quantization.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/geometric.hpp>
+
+using namespace okami;
+
+namespace {
+    constexpr float kUNorm16Max = 65535.0f;
+    constexpr float kSNorm16Max = 32767.0f;
+
+    template <typename T>
+    inline std::span<T const> AsSpan(std::span<uint8_t const> bytes, size_t count) {
+        return std::span(reinterpret_cast<T const*>(bytes.data()), count);
+    }
+
+    template <typename T>
+    inline std::span<T> AsSpan(std::span<uint8_t> bytes, size_t count) {
+        return std::span(reinterpret_cast<T*>(bytes.data()), count);
+    }
+
+    inline float SignNotZero(float value) {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    inline float FromSNorm16(int16_t value) {
+        return std::max(static_cast<float>(value) / kSNorm16Max, -1.0f);
+    }
+
+    // Rounding each coordinate on its own is not always the closest snorm16
+    // encoding; try the four neighbors and keep the one that decodes closest
+    void EncodeOctahedralSNorm16(glm::vec3 const& direction, int16_t* encoded) {
+        auto exact = OctahedralEncode(direction);
+        auto unit = glm::normalize(OctahedralDecode(exact));
+        float bestDot = -2.0f;
+        for (int i = 0; i < 4; ++i) {
+            float x = (i & 1) ? std::ceil(exact.x * kSNorm16Max) : std::floor(exact.x * kSNorm16Max);
+            float y = (i & 2) ? std::ceil(exact.y * kSNorm16Max) : std::floor(exact.y * kSNorm16Max);
+            int16_t candidate[2] = {
+                static_cast<int16_t>(std::clamp(x, -kSNorm16Max, kSNorm16Max)),
+                static_cast<int16_t>(std::clamp(y, -kSNorm16Max, kSNorm16Max))
+            };
+            float dot = glm::dot(unit, OctahedralDecode(glm::vec2(FromSNorm16(candidate[0]), FromSNorm16(candidate[1]))));
+            if (dot > bestDot) {
+                bestDot = dot;
+                encoded[0] = candidate[0];
+                encoded[1] = candidate[1];
+            }
+        }
+    }
+
+    // Scale that takes positions inside bounds to [0, 65535]; zero for flat or
+    // unbounded axes, which then decode to the minimum
+    glm::vec3 GetQuantizationScale(AABB const& bounds) {
+        glm::vec3 scale(0.0f);
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = bounds.m_max[axis] - bounds.m_min[axis];
+            if (extent > 0.0f && std::isfinite(extent)) {
+                scale[axis] = kUNorm16Max / extent;
+            }
+        }
+        return scale;
+    }
+
+    glm::vec3 GetQuantizationMin(AABB const& bounds) {
+        glm::vec3 min(0.0f);
+        for (int axis = 0; axis < 3; ++axis) {
+            if (std::isfinite(bounds.m_min[axis])) {
+                min[axis] = bounds.m_min[axis];
+            }
+        }
+        return min;
+    }
+
+#ifdef OKAMI_SSE2
+    // Packs four int32 lanes holding values in [0, 65535] into 16 bits each.
+    // packs saturates signed, so the values are sign extended from 16 bits first.
+    inline __m128i PackUInt16(__m128i values) {
+        values = _mm_srai_epi32(_mm_slli_epi32(values, 16), 16);
+        return _mm_packs_epi32(values, values);
+    }
+#endif
+}
+
+glm::vec2 okami::OctahedralEncode(glm::vec3 const& direction) {
+    float l1 = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    if (!(l1 > 0.0f)) {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 p(direction.x / l1, direction.y / l1);
+    if (direction.z < 0.0f) {
+        p = glm::vec2(
+            (1.0f - std::abs(p.y)) * SignNotZero(p.x),
+            (1.0f - std::abs(p.x)) * SignNotZero(p.y));
+    }
+    return p;
+}
+
+glm::vec3 okami::OctahedralDecode(glm::vec2 const& encoded) {
+    glm::vec3 v(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    float t = std::max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -t : t;
+    v.y += v.y >= 0.0f ? -t : t;
+    return glm::normalize(v);
+}
+
+float okami::GetPositionQuantizationError(AABB const& bounds) {
+    auto scale = GetQuantizationScale(bounds);
+    glm::vec3 step(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (scale[axis] > 0.0f) {
+            step[axis] = 0.5f / scale[axis];
+        }
+    }
+    return glm::length(step);
+}
+
+void okami::QuantizePositions(std::span<glm::vec3 const> positions, AABB const& bounds, std::span<uint16_t> quantized) {
+    auto min = GetQuantizationMin(bounds);
+    auto scale = GetQuantizationScale(bounds);
+    size_t count = std::min(positions.size(), quantized.size() / 4);
+
+#ifdef OKAMI_SSE2
+    __m128 minV = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+    __m128 scaleV = _mm_setr_ps(scale.x, scale.y, scale.z, 0.0f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 maxV = _mm_set1_ps(kUNorm16Max);
+    for (size_t i = 0; i < count; ++i) {
+        auto const& p = positions[i];
+        __m128 v = _mm_setr_ps(p.x, p.y, p.z, 0.0f);
+        v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, minV), scaleV), half);
+        // max returns its second operand for NaN, so NaN becomes zero
+        v = _mm_min_ps(_mm_max_ps(v, zero), maxV);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(quantized.data() + i * 4), PackUInt16(_mm_cvttps_epi32(v)));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        auto q = (positions[i] - min) * scale + 0.5f;
+        for (int axis = 0; axis < 3; ++axis) {
+            float value = q[axis] > 0.0f ? std::min(q[axis], kUNorm16Max) : 0.0f;
+            quantized[i * 4 + axis] = static_cast<uint16_t>(value);
+        }
+        quantized[i * 4 + 3] = 0;
+    }
+#endif
+}
+
+void okami::DequantizePositions(std::span<uint16_t const> quantized, AABB const& bounds, std::span<glm::vec3> positions) {
+    auto min = GetQuantizationMin(bounds);
+    auto scale = GetQuantizationScale(bounds);
+    glm::vec3 step(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (scale[axis] > 0.0f) {
+            step[axis] = 1.0f / scale[axis];
+        }
+    }
+    size_t count = std::min(positions.size(), quantized.size() / 4);
+
+#ifdef OKAMI_SSE2
+    __m128 minV = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+    __m128 stepV = _mm_setr_ps(step.x, step.y, step.z, 0.0f);
+    __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < count; ++i) {
+        __m128i q = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(quantized.data() + i * 4));
+        __m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero));
+        v = _mm_add_ps(_mm_mul_ps(v, stepV), minV);
+        alignas(16) float result[4];
+        _mm_store_ps(result, v);
+        positions[i] = glm::vec3(result[0], result[1], result[2]);
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 q(quantized[i * 4], quantized[i * 4 + 1], quantized[i * 4 + 2]);
+        positions[i] = q * step + min;
+    }
+#endif
+}
+
+void okami::EncodeOctahedral(std::span<glm::vec3 const> directions, std::span<int16_t> encoded) {
+    size_t count = std::min(directions.size(), encoded.size() / 2);
+    for (size_t i = 0; i < count; ++i) {
+        EncodeOctahedralSNorm16(directions[i], encoded.data() + i * 2);
+    }
+}
+
+void okami::DecodeOctahedral(std::span<int16_t const> encoded, std::span<glm::vec3> directions) {
+    size_t count = std::min(directions.size(), encoded.size() / 2);
+    for (size_t i = 0; i < count; ++i) {
+        directions[i] = OctahedralDecode(glm::vec2(FromSNorm16(encoded[i * 2]), FromSNorm16(encoded[i * 2 + 1])));
+    }
+}
+
+void okami::EncodeOctahedralTangents(std::span<glm::vec4 const> tangents, std::span<int16_t> encoded) {
+    size_t count = std::min(tangents.size(), encoded.size() / 4);
+    for (size_t i = 0; i < count; ++i) {
+        auto const& tangent = tangents[i];
+        EncodeOctahedralSNorm16(glm::vec3(tangent), encoded.data() + i * 4);
+        encoded[i * 4 + 2] = tangent.w < 0.0f ? -32767 : 32767;
+        encoded[i * 4 + 3] = 0;
+    }
+}
+
+void okami::DecodeOctahedralTangents(std::span<int16_t const> encoded, std::span<glm::vec4> tangents) {
+    size_t count = std::min(tangents.size(), encoded.size() / 4);
+    for (size_t i = 0; i < count; ++i) {
+        auto direction = OctahedralDecode(glm::vec2(FromSNorm16(encoded[i * 4]), FromSNorm16(encoded[i * 4 + 1])));
+        tangents[i] = glm::vec4(direction, encoded[i * 4 + 2] < 0 ? -1.0f : 1.0f);
+    }
+}
+
+Error okami::ConvertAttribute(
+    AttributeType type,
+    AttributeEncoding from,
+    AttributeEncoding to,
+    std::span<uint8_t const> source,
+    std::span<uint8_t> destination,
+    size_t vertexCount,
+    AABB const& bounds) {
+    if (source.size() < GetStride(type, from) * vertexCount ||
+        destination.size() < GetStride(type, to) * vertexCount) {
+        return Error("Attribute data out of range");
+    }
+
+    if (from == to) {
+        std::memcpy(destination.data(), source.data(), GetStride(type, to) * vertexCount);
+        return {};
+    }
+
+    bool encode = to == AttributeEncoding::Quantized;
+    switch (type) {
+        case AttributeType::Position:
+            if (encode) {
+                QuantizePositions(AsSpan<glm::vec3>(source, vertexCount), bounds, AsSpan<uint16_t>(destination, vertexCount * 4));
+            } else {
+                DequantizePositions(AsSpan<uint16_t>(source, vertexCount * 4), bounds, AsSpan<glm::vec3>(destination, vertexCount));
+            }
+            return {};
+        case AttributeType::Normal:
+        case AttributeType::Bitangent:
+            if (encode) {
+                EncodeOctahedral(AsSpan<glm::vec3>(source, vertexCount), AsSpan<int16_t>(destination, vertexCount * 2));
+            } else {
+                DecodeOctahedral(AsSpan<int16_t>(source, vertexCount * 2), AsSpan<glm::vec3>(destination, vertexCount));
+            }
+            return {};
+        case AttributeType::Tangent:
+            if (encode) {
+                EncodeOctahedralTangents(AsSpan<glm::vec4>(source, vertexCount), AsSpan<int16_t>(destination, vertexCount * 4));
+            } else {
+                DecodeOctahedralTangents(AsSpan<int16_t>(source, vertexCount * 4), AsSpan<glm::vec4>(destination, vertexCount));
+            }
+            return {};
+        case AttributeType::TexCoord:
+        case AttributeType::Color: {
+            size_t components = GetStride(type) / sizeof(float) * vertexCount;
+            if (encode) {
+                EncodeHalf(AsSpan<float>(source, components), AsSpan<uint16_t>(destination, components));
+            } else {
+                DecodeHalf(AsSpan<uint16_t>(source, components), AsSpan<float>(destination, components));
+            }
+            return {};
+        }
+        default:
+            return Error("Attribute type cannot be quantized");
+    }
+}
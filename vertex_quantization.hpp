@@ -0,0 +1,52 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+
+#include "common.hpp"
+#include "aabb.hpp"
+#include "geometry.hpp"
+#include "float_packing.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+namespace okami {
+	// Largest angle between a unit vector and its snorm16 octahedral encoding
+	// once decoded, in radians
+	constexpr float kOctahedralMaxAngleError = 1.5e-4f;
+
+	// Maps a unit vector onto the octahedron unfolded to [-1, 1]^2
+	glm::vec2 OctahedralEncode(glm::vec3 const& direction);
+	glm::vec3 OctahedralDecode(glm::vec2 const& encoded);
+
+	// Largest distance between a position inside bounds and its unorm16
+	// quantization once decoded
+	float GetPositionQuantizationError(AABB const& bounds);
+
+	// Batch kernels; SSE2 is used where available. Quantized positions take
+	// four unorm16 per vertex, the last zero.
+	void QuantizePositions(std::span<glm::vec3 const> positions, AABB const& bounds, std::span<uint16_t> quantized);
+	void DequantizePositions(std::span<uint16_t const> quantized, AABB const& bounds, std::span<glm::vec3> positions);
+
+	// Two snorm16 per direction
+	void EncodeOctahedral(std::span<glm::vec3 const> directions, std::span<int16_t> encoded);
+	void DecodeOctahedral(std::span<int16_t const> encoded, std::span<glm::vec3> directions);
+
+	// Four snorm16 per tangent: the octahedral direction, the handedness in
+	// w as -1 or 1, and zero
+	void EncodeOctahedralTangents(std::span<glm::vec4 const> tangents, std::span<int16_t> encoded);
+	void DecodeOctahedralTangents(std::span<int16_t const> encoded, std::span<glm::vec4> tangents);
+
+	// Converts vertexCount values of one attribute between encodings. Bounds
+	// is the range quantized positions are normalized to, normally the mesh's AABB.
+	Error ConvertAttribute(
+		AttributeType type,
+		AttributeEncoding from,
+		AttributeEncoding to,
+		std::span<uint8_t const> source,
+		std::span<uint8_t> destination,
+		size_t vertexCount,
+		AABB const& bounds);
+}